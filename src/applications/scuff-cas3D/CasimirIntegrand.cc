@@ -122,19 +122,40 @@ double GetTraceMInvdM(SC3Data *SC3D, char XYZT)
   else
    Log("  Computing %cForce...",XYZT);
 
-  /***************************************************************/
-  /* stamp derivative blocks into dM matrix, compute M^{-1} dM,  */
-  /* then sum the diagonals of the upper matrix block            */
-  /***************************************************************/
-  dM->Zero();
-  for(int ns=1; ns<G->NumSurfaces; ns++)
-   dM->InsertBlockAdjoint(dUBlocks[ 6*(ns-1) + Mu ], G->BFIndexOffset[ns], 0);
+  double Trace=0.0;
+  if (SC3D->HaveMInv21)
+   { 
+     /***************************************************************/
+     /* M is hermitian, so the trace over the upper block of        */
+     /* M^{-1} dM is the trace of (M^{-1})_{21} dU, summed over     */
+     /* the dU blocks of surfaces 1, 2, ...; the lower-left block   */
+     /* of M^{-1} was computed by Factorize()                       */
+     /***************************************************************/
+     HMatrix *MInv21=SC3D->MInv21;
+     int N1=SC3D->N1;
+     for(int ns=1; ns<G->NumSurfaces; ns++)
+      { HMatrix *dU = dUBlocks[ 6*(ns-1) + Mu ];
+        int Offset  = G->BFIndexOffset[ns] - N1;
+        for(int nr=0; nr<dU->NR; nr++)
+         for(int nc=0; nc<dU->NC; nc++)
+          Trace+=real( MInv21->GetEntry(Offset+nc, nr) * dU->GetEntry(nr, nc) );
+      };
+   }
+  else
+   { 
+     /***************************************************************/
+     /* stamp derivative blocks into dM matrix, compute M^{-1} dM,  */
+     /* then sum the diagonals of the upper matrix block            */
+     /***************************************************************/
+     dM->Zero();
+     for(int ns=1; ns<G->NumSurfaces; ns++)
+      dM->InsertBlockAdjoint(dUBlocks[ 6*(ns-1) + Mu ], G->BFIndexOffset[ns], 0);
 
-  M->LUSolve(dM);
+     M->LUSolve(dM);
 
-  double Trace=0.0;
-  for(int n=0; n<dM->NC; n++)
-   Trace+=dM->GetEntryD(n,n);
+     for(int n=0; n<dM->NC; n++)
+      Trace+=dM->GetEntryD(n,n);
+   };
   Trace*=2.0;
 
   // paraphrasing the physicists of the 1930s, 'just because
@@ -148,18 +169,23 @@ double GetTraceMInvdM(SC3Data *SC3D, char XYZT)
 
 /***************************************************************/
 /* stamp T and U blocks into the BEM matrix, then LU-factorize.*/
+/* if only the trailing surfaces have moved since the last     */
+/* factorization, only their rows and columns are restamped    */
+/* and the factorization is updated (see BEMBlockTracker.cc).  */
 /***************************************************************/
 void Factorize(SC3Data *SC3D)
 { 
   RWGGeometry *G = SC3D->G;
   HMatrix *M     = SC3D->M;
 
+  int nsFirst = SC3D->Tracker->FirstSurfaceToRestamp(M);
+
   /***************************************************************/
   /* stamp blocks into M matrix                                  */
   /***************************************************************/
   /* T blocks */
   int Offset;
-  for(int ns=0; ns<G->NumSurfaces; ns++)
+  for(int ns=nsFirst; ns<G->NumSurfaces; ns++)
    { 
      Offset=G->BFIndexOffset[ns];
      M->InsertBlock(SC3D->TBlocks[ns], Offset, Offset);
@@ -170,6 +196,7 @@ void Factorize(SC3Data *SC3D)
   for(int nb=0, ns=0; ns<G->NumSurfaces; ns++)
    for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
     { 
+      if (nsp<nsFirst) continue;
       RowOffset=G->BFIndexOffset[ns];
       ColOffset=G->BFIndexOffset[nsp];
       M->InsertBlock(SC3D->UBlocks[nb], RowOffset, ColOffset);
@@ -179,7 +206,19 @@ void Factorize(SC3Data *SC3D)
   /***************************************************************/
   /* LU factorize                                                */
   /***************************************************************/
-  M->LUFactorize();
+  SC3D->Tracker->LUFactorize(M);
+
+  /***************************************************************/
+  /* if the factorization is split after surface 0, the force    */
+  /* and torque traces need only the lower-left block of M^{-1}, */
+  /* which costs O(N N1 (N-N1)) once here instead of an          */
+  /* O(N^2 N1) LUSolve for each quantity in GetTraceMInvdM()     */
+  /***************************************************************/
+  SC3D->HaveMInv21=false;
+  if (SC3D->MInv21 && M->LeadingBlockDim==SC3D->N1)
+   { M->LUInverseLowerLeftBlock(SC3D->MInv21);
+     SC3D->HaveMInv21=true;
+   };
 
 } 
 
@@ -280,17 +319,10 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
   Log("Mem usage: %lu",GetMemoryUsage()/1048576);
 
   /***************************************************************/
-  /* SurfaceNeverMoved[ns] is initialized true and remains true  */
-  /* as long as surface #ns is not displaced or rotated by any   */
-  /* geometrical transformation, but switches to false as soon as*/
-  /* that surface is moved, and then remains false for the rest  */
-  /* of the calculations done at this frequency                  */
+  /* all U blocks and the factorization of M are invalidated by  */
+  /* the change of frequency                                     */
   /***************************************************************/
-  static bool *SurfaceNeverMoved=0;
-  if (SurfaceNeverMoved==0)
-   SurfaceNeverMoved=(bool *)mallocEC(G->NumSurfaces*sizeof(bool));
-  for(int ns=0; ns<G->NumSurfaces; ns++)
-   SurfaceNeverMoved[ns]=true;
+  SC3D->Tracker->Reset();
 
   /***************************************************************/
   /* assemble T matrices                                         */
@@ -422,8 +454,6 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
      /******************************************************************/
      Log("Applying transform %s...",Tag);
      G->Transform( SC3D->GTCList[nt] );
-     for(int ns=0; ns<G->NumSurfaces; ns++)
-      if (G->SurfaceMoved[ns]) SurfaceNeverMoved[ns]=false;
 
      /***************************************************************/
      /* assemble U_{a,b} blocks and dUdXYZT_{0,b} blocks            */
@@ -432,9 +462,12 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
       for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
        { 
          /* if we already computed the interaction between objects ns  */
-         /* and nsp once at this frequency, and if neither object has  */
-         /* moved, then we do not need to recompute the interaction    */
-         if ( nt>0 && SurfaceNeverMoved[ns] && SurfaceNeverMoved[nsp] )
+         /* and nsp at this frequency, and their relative position has */
+         /* not changed since, then we do not need to recompute it.    */
+         /* the ns==0 blocks also yield the dU blocks, which are       */
+         /* derivatives with respect to fixed lab-frame axes and so    */
+         /* change whenever either object moves at all                 */
+         if ( !SC3D->Tracker->BlockIsStale(ns, nsp, ns==0) )
           continue;
 
          Log(" Assembling U(%i,%i)",ns,nsp);
@@ -447,6 +480,7 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
          else
           G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, SC3D->UBlocks[nb], 0,
                                     0, 0, Accelerator, false);
+         SC3D->Tracker->MarkBlockCurrent(ns, nsp);
        };
 
      /***************************************************************/
@@ -483,6 +517,11 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
         fflush(ByXiKFile);
       };
 
+     /******************************************************************/
+     /* checkpoint the values for this transform                       */
+     /******************************************************************/
+     CacheWrite(SC3D, Xi, kBloch, nt, EFT + ntnq - SC3D->NumQuantities);
+
      if (SC3D->WriteHDF5Files)
       ExportHDF5Data(SC3D, Xi, kBloch, (NT==1 ? 0 : Tag) );
 
@@ -75,6 +75,9 @@ SC3Data *CreateSC3Data(RWGGeometry *G, char *TransFile,
 
   SC3D->NTNQ = SC3D->NumTransformations * SC3D->NumQuantities;
 
+  SC3D->Tracker = new BEMBlockTracker(G);
+  SC3D->Tracker->SetLeadingSurfaces(SC3D->GTCList, SC3D->NumTransformations);
+
   SC3D->XiConverged = (bool *)mallocEC( (SC3D->NTNQ) * sizeof(bool) );
   if (LDim==0)
    SC3D->BZConverged = 0;
@@ -147,6 +150,9 @@ SC3Data *CreateSC3Data(RWGGeometry *G, char *TransFile,
   int N1 = SC3D->N1 = SC3D->G->Surfaces[0]->NumBFs;
   SC3D->M           = new HMatrix(N,  N,  RealComplex);
   SC3D->dM          = new HMatrix(N,  N1, RealComplex);
+  bool NeedForces   = (WhichQuantities & ~QUANTITY_ENERGY);
+  SC3D->MInv21      = (NeedForces && N>N1) ? new HMatrix(N-N1, N1, RealComplex) : 0;
+  SC3D->HaveMInv21  = false;
   SC3D->NewEnergyMethod  = NewEnergyMethod;
 
   if (WhichQuantities & QUANTITY_ENERGY)
@@ -179,6 +185,22 @@ SC3Data *CreateSC3Data(RWGGeometry *G, char *TransFile,
      WriteFilePreamble(SC3D, PREAMBLE_BYXIK);
    }
 
+  /*--------------------------------------------------------------*/
+  /*- open the checkpoint store. records are keyed by transform   */
+  /*- tag and (Xi, kx, ky, WhichQuantities), with the frequency   */
+  /*- and bloch vector rounded to the precision of the .byXi and  */
+  /*- .byXikBloch files.                                          */
+  /*--------------------------------------------------------------*/
+  char *StoreFileName=vstrdup("%s.results",FileBase);
+  SC3D->Store = new ResultStore(StoreFileName, "CAS3D", 4, NumQuantities, 6);
+  free(StoreFileName);
+  if (SC3D->Store->ErrMsg)
+   { Warn("%s (results will not be checkpointed)",SC3D->Store->ErrMsg);
+     delete SC3D->Store;
+     SC3D->Store=0;
+   };
+  SC3D->LegacyDataImported=false;
+
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
@@ -35,139 +35,126 @@
 #define XIMAX 10.000
 
 /***************************************************************/
-/* helper routine for CacheRead that, given a line of text     */
-/* from a cache file, does the following:                      */
-/*  1. checks that the first token on the line matches Tag     */
-/*     and that the next NumbersToMatch tokens match the       */
-/*     corresponding entries of Numbers                        */ 
-/*  2. if (1) failed, returns false                            */
-/*  3. otherwise, fills in Values with the remaining numbers   */
-/*     on the line (up to 4) and returns the number of those   */
-/*     numbers that were successfully read as *NumValues       */
-/***************************************************************/
-bool LineMatches(char *Line, char *Tag, double *Keys, int NumKeys,
-                 double *Values, int *NumValues)
+/* keys under which integrand values at (Xi, kBloch) are filed */
+/* in the checkpoint store                                     */
+/***************************************************************/
+static void GetStoreKeys(SC3Data *SC3D, double Xi, double *kBloch,
+                         double Keys[4])
 {
-  char MyTag[1000];
-  double Numbers[7];
-  int nRead=sscanf(Line,"%s %le %le %le %le %le %le %le",
-                         MyTag, Numbers+0, Numbers+1,
-                         Numbers+2, Numbers+3, Numbers+4,
-                         Numbers+5, Numbers+6);
-  
-  if ( nRead < (NumKeys+2) )
-   return false;
+  int LDim = SC3D->G->LBasis ? SC3D->G->LBasis->NC : 0;
 
-  if ( strcasecmp(Tag, MyTag) ) 
-   return false;
+  if (    (kBloch==0 && LDim>0)
+       || (kBloch!=0 && LDim==0)
+     ) ErrExit("%s:%i: internal error",__FILE__,__LINE__);
+
+  Keys[0] = Xi;
+  Keys[1] = LDim>=1 ? kBloch[0] : 0.0;
+  Keys[2] = LDim>=2 ? kBloch[1] : 0.0;
+  Keys[3] = (double) SC3D->WhichQuantities;
+}
 
-  for(int nk=0; nk<NumKeys; nk++)
-   if ( fabs(Numbers[nk]-Keys[nk]) > 1.0e-6*fabs(Keys[nk]) )
-    return false;
+/***************************************************************/
+/* one-time import of the text data in the .byXi (or, for      */
+/* periodic geometries, .byXikBloch) file left behind by runs  */
+/* that predate the checkpoint store. each data line consists  */
+/* of a transform tag, Xi, the bloch-vector components, and    */
+/* NumQuantities integrand values.                             */
+/***************************************************************/
+static void ImportLegacyData(SC3Data *SC3D)
+{
+  int LDim = SC3D->G->LBasis ? SC3D->G->LBasis->NC : 0;
+  char *FileName = LDim ? SC3D->ByXiKFileName : SC3D->ByXiFileName;
+  FILE *f=fopen(FileName,"r");
+  if (!f) return;
+
+  ResultStore *Store=SC3D->Store;
+  int NQ=SC3D->NumQuantities;
+  int NumNumbers=1 + LDim + NQ;
+  double *Numbers=new double[NumNumbers + 1];
+  double *Values=new double[NQ];
+  int NumImported=0;
+
+  Store->Durable=false;
+  char Line[1000];
+  while( fgets(Line,1000,f) )
+   { 
+     char *Tag=strtok(Line," \t\n");
+     if ( !Tag || Tag[0]=='#' )
+      continue;
 
-  *NumValues = nRead - 1 - NumKeys;
-  for(int nv=0; nv < (*NumValues); nv++)
-   Values[nv] = Numbers[NumKeys + nv];
+     int nn;
+     char *Token;
+     for(nn=0; nn<=NumNumbers && (Token=strtok(0," \t\n")); nn++)
+      Numbers[nn]=strtod(Token,0);
+     if (nn!=NumNumbers)
+      continue;
 
-  return true;
+     double Keys[4];
+     GetStoreKeys(SC3D, Numbers[0], LDim ? Numbers+1 : 0, Keys);
+     if ( Store->Lookup(Tag, Keys, Values) )
+      continue;
+     if ( Store->Add(Tag, Keys, Numbers + 1 + LDim) )
+      NumImported++;
+   };
+  Store->Flush();
+  Store->Durable=true;
 
+  fclose(f);
+  delete[] Numbers;
+  delete[] Values;
+  if (NumImported>0)
+   Log("Imported %i records from %s into %s.",NumImported,FileName,Store->FileName);
 }
 
 /***************************************************************/
 /* CacheRead: attempt to bypass an entire GetXiIntegrand       */
-/* calculation by reading results from the .byXi or .byXikbloch*/
-/* file. Returns true if successful (which means the values of */
+/* calculation by reading results from the checkpoint store.   */
+/* Returns true if successful (which means the values of       */
 /* the energy/force/torque integrand for ALL transformations   */
-/* at this value of Xi were successfully read from the file)   */
+/* at this value of Xi were successfully read from the store)  */
 /* or false on failure.                                        */
 /***************************************************************/
 bool CacheRead(SC3Data *SC3D, double Xi, double *kBloch, double *EFT)
 { 
-  if (SC3D->UseExistingData==false)
+  if (SC3D->UseExistingData==false || SC3D->Store==0)
    return false;
-   
-  int LDim = SC3D->G->LBasis ? SC3D->G->LBasis->NC : 0;
 
-  if (    (kBloch==0 && LDim>0)
-       || (kBloch!=0 && LDim==0)
-     ) ErrExit("%s:%i: internal error",__FILE__,__LINE__);
-
-  /*----------------------------------------------------------*/
-  /*----------------------------------------------------------*/
-  /*----------------------------------------------------------*/
-  int NumKeys = 1 + LDim;
-  double Keys[3];
-  Keys[0]=Xi;
-  if(NumKeys>=2) Keys[1]=kBloch[0];
-  if(NumKeys>=3) Keys[2]=kBloch[1];
-
-  /*----------------------------------------------------------*/
-  /* 0. try to open the cache file. --------------------------*/
-  /*----------------------------------------------------------*/
-  FILE *f;
-  if (kBloch)
-   f=fopen(SC3D->ByXiKFileName,"r");
-  else
-   f=fopen(SC3D->ByXiFileName,"r");
-  if (f==0) return false;
-
-  /*----------------------------------------------------------*/
-  /* 1. skip down through the cache file until we find a line */
-  /*    whose...                                              */
-  /*----------------------------------------------------------*/
-  double Values[7];
-  int NumValues;
-  int LineNum=0;
-  char Line[1000];
-  char *Tag = SC3D->GTCList[0]->Tag;
-  bool FoundFirst=false;
-  int NQ = SC3D->NumQuantities;
-  while( !FoundFirst && fgets(Line,1000,f) )
-   { LineNum++;
-     if ( !LineMatches(Line,Tag,Keys,NumKeys,Values,&NumValues) )
-      continue;
-     if ( NumValues != NQ )
-      { Log(" found matching (Tag,freqs) on line %i of cache file"
-            " but number of quantities is wrong (%i, %i)",
-            LineNum,NumValues,NQ);
-        continue;
-      };
-     FoundFirst=true;
-   };
-  if (!FoundFirst)
-   { fclose(f);
-     return false;
+  if (!SC3D->LegacyDataImported)
+   { ImportLegacyData(SC3D);
+     SC3D->LegacyDataImported=true;
    };
 
-  Log("...found matching dataset on line %i...",LineNum);
-  memcpy(EFT,Values,NQ*sizeof(double));
-   
-  /*----------------------------------------------------------*/
-  /* 3. ok, since that worked, now keep going ----------------*/
-  /*----------------------------------------------------------*/
-  for(int nt=1; nt<SC3D->NumTransformations; nt++)
-   { 
-     LineNum++;
-     Tag = SC3D->GTCList[nt]->Tag;
-
-     if (    !fgets(Line,1000,f)  
-          || !LineMatches(Line,Tag,Keys,NumKeys,Values,&NumValues) 
-          || (NumValues!=NQ)
-        )
-      { Log(" ...but data for some transforms were missing (line %i) (aborting)",LineNum);
-        fclose(f);
-        return false;
-      };
+  double Keys[4];
+  GetStoreKeys(SC3D, Xi, kBloch, Keys);
 
-     memcpy(EFT + nt*NQ,Values,NQ*sizeof(double));
-   };
+  int NQ = SC3D->NumQuantities;
+  for(int nt=0; nt<SC3D->NumTransformations; nt++)
+   if ( !SC3D->Store->Lookup(SC3D->GTCList[nt]->Tag, Keys, EFT + nt*NQ) )
+    { if (nt>0)
+       Log(" found stored data for some transforms, but not %s (recomputing)",
+             SC3D->GTCList[nt]->Tag);
+      return false;
+    };
    
-  fclose(f);
-  Log(" ...and successfully read data for all quantities at all transforms");
+  Log("...read stored data for all quantities at all transforms");
   return true;
 
 }
 
+/***************************************************************/
+/* CacheWrite: store the integrand values for transform #nt    */
+/* (EFT[0..NumQuantities-1]) in the checkpoint store.          */
+/***************************************************************/
+void CacheWrite(SC3Data *SC3D, double Xi, double *kBloch, int nt, double *EFT)
+{ 
+  if (SC3D->Store==0)
+   return;
+
+  double Keys[4];
+  GetStoreKeys(SC3D, Xi, kBloch, Keys);
+  SC3D->Store->Add(SC3D->GTCList[nt]->Tag, Keys, EFT);
+}
+
 /***************************************************************/
 /* wrapper around GetCasimirIntegrand with correct prototype   */
 /* prototype for passage to adapt_integrate() to use in        */
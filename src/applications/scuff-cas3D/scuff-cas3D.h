@@ -28,6 +28,7 @@
 #include <libhrutil.h>
 #include <libhmat.h>
 #include <libscuff.h>
+#include <libscuffInternals.h>
 #include <libTriInt.h>
 #include <BZIntegration.h>
 
@@ -66,9 +67,20 @@ typedef struct SC3Data
    // storage for BEM matrix blocks
    int N, N1;
    HMatrix **TBlocks, **UBlocks, **dUBlocks, *M, *dM;
+
+   // (N-N1)xN1 lower-left block of M^{-1}, available (HaveMInv21)
+   // whenever M is factorized in blocks split after surface 0
+   HMatrix *MInv21;
+   bool HaveMInv21;
+
    int *ipiv;
    HVector *MInfLUDiagonal;
 
+   // keeps track of which U blocks are invalidated by each
+   // geometrical transformation, and updates the factorization
+   // of M when only the trailing surfaces have moved
+   BEMBlockTracker *Tracker;
+
    // matrix-block-assembly accelerators for PBC geometries
    void **TAccelerators, ***UAccelerators;
 
@@ -101,6 +113,11 @@ typedef struct SC3Data
 
    char *FileBase, *ByXiFileName, *ByXiKFileName, *OutFileName;
 
+   // binary checkpoint store of integrand values (.results file)
+   // consulted by CacheRead() if UseExistingData is set
+   ResultStore *Store;
+   bool LegacyDataImported;
+
    // adaptive frequency integration limits
    double XiMin;
    int MaxXiPoints, MaxkBlochPoints;
@@ -151,5 +168,6 @@ void GetXiIntegral_TrapSimp(SC3Data *SC3D, int NumIntervals, double *I, double *
 void GetXiIntegral_Cliff(SC3Data *SC3D, double *EFT, double *Error);
 void GetMatsubaraSum(SC3Data *SC3D, double Temperature, double *EFT, double *Error);
 bool CacheRead(SC3Data *SC3D, double Xi, double *kBloch, double *EFT);
+void CacheWrite(SC3Data *SC3D, double Xi, double *kBloch, int nt, double *EFT);
 
 #endif // #define SCUFFCAS3D_H
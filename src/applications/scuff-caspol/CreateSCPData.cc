@@ -115,5 +115,60 @@ SCPData *CreateSCPData(char *GeoFile,
    };
      /*--------------------------------------------------------------*/
 
+  SCPD->FS=0;
+  SCPD->nPoint=0;
+
   return SCPD;
 }
+
+/***************************************************************/
+/* create a second SCPData structure for the same calculation, */
+/* with its own geometry, BEM matrix, and polarizability       */
+/* buffers, so that the two can process different frequencies  */
+/* concurrently. polarizability models and output files are    */
+/* shared with the original; Brillouin-zone integration        */
+/* arguments are copied.                                       */
+/***************************************************************/
+SCPData *CloneSCPData(SCPData *SCPD)
+{
+  SCPData *Clone=(SCPData *)mallocEC(sizeof(SCPData));
+  memcpy(Clone, SCPD, sizeof(SCPData));
+
+  RWGGeometry *G=0;
+  if (SCPD->G)
+   { G = Clone->G = new RWGGeometry(SCPD->G->GeoFileName, SCUFF_TERSELOGGING);
+     Clone->M  = G->AllocateBEMMatrix(SCUFF_PUREIMAGFREQ);
+     Clone->KN = G->AllocateRHSVector(SCUFF_PUREIMAGFREQ);
+   };
+
+  Clone->Alphas = (HMatrix **) malloc(SCPD->NumAtoms * sizeof(HMatrix *) );
+  for(int na=0; na<SCPD->NumAtoms; na++)
+   Clone->Alphas[na] = new HMatrix(3,3);
+
+  if (G && G->LDim>0)
+   { int NS = G->NumSurfaces;
+     int NB = NS*(NS+1)/2;
+     Clone->ABMBCache = (void **)malloc(NB*sizeof(void *));
+     for(int nsa=0, nb=0; nsa<NS; nsa++)
+      for(int nsb=nsa; nsb<NS; nsb++, nb++)
+       Clone->ABMBCache[nb]=G->CreateABMBAccelerator(nsa, nsb, false, false);
+   };
+
+  // the Brillouin-zone integrator calls back into the workspace
+  // named by UserData and keeps its scratch buffers in the argument
+  // structure, so each clone needs its own copy
+  if (SCPD->BZIArgs)
+   { GetBZIArgStruct *BZIArgs
+      = (GetBZIArgStruct *)mallocEC(sizeof(GetBZIArgStruct));
+     memcpy(BZIArgs, SCPD->BZIArgs, sizeof(GetBZIArgStruct));
+     BZIArgs->UserData = (void *)Clone;
+     BZIArgs->RLBasis  = G->RLBasis;
+     BZIArgs->BufSize  = 0;
+     memset(BZIArgs->DataBuffer, 0, 4*sizeof(double *));
+     BZIArgs->BZIError = 0;
+     Clone->BZIArgs    = BZIArgs;
+   };
+
+  Clone->nPoint=0;
+  return Clone;
+}
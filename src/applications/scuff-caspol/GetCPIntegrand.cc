@@ -65,6 +65,24 @@
 #define ABSTOL 0.0
 #define XIMIN  1.0e-6
 
+/***************************************************************/
+/* open an output file for appending. if frequencies are being */
+/* processed concurrently, the output goes to a buffer that is */
+/* written to the file in frequency order.                     */
+/***************************************************************/
+static FILE *OpenOutput(SCPData *SCPD, const char *FileName)
+{
+  if (SCPD->FS)
+   return SCPD->FS->OpenOutput(SCPD->nPoint, FileName);
+  return fopen(FileName,"a");
+}
+
+static void CloseOutput(SCPData *SCPD, FILE *f)
+{
+  if (SCPD->FS==0)
+   fclose(f);
+}
+
 /***************************************************************/
 /* compute the dyadic green's function at a distance Z above a */
 /* PEC plate using the method of images.                       */
@@ -170,7 +188,7 @@ void GetCPIntegrand(void *pSCPD, cdouble Omega, double *kBloch, double *U)
   double R[3];
   cdouble GE[3][3], GM[3][3];
   Log("Computing CP potential at %i eval points...",EPMatrix->NR);
-  FILE *f = kBloch ? fopen(SCPD->ByXikFileName, "a") : 0;
+  FILE *f = kBloch ? OpenOutput(SCPD, SCPD->ByXikFileName) : 0;
   for(int nep=0; nep<EPMatrix->NR; nep++)
    { 
       /* get the dyadic GF at this eval point */
@@ -199,7 +217,7 @@ void GetCPIntegrand(void *pSCPD, cdouble Omega, double *kBloch, double *U)
        };
       if (f) fprintf(f,"\n");
    }; 
-  if (f) fclose(f);
+  if (f) CloseOutput(SCPD, f);
 
 }
 
@@ -236,7 +254,7 @@ void GetXiIntegrand(SCPData *SCPD, double Xi, double *U)
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
-  FILE *f=fopen(SCPD->ByXiFileName,"a");
+  FILE *f=OpenOutput(SCPD, SCPD->ByXiFileName);
   for(int nep=0; nep<EPMatrix->NR; nep++)
    { 
       double R[3];
@@ -248,7 +266,7 @@ void GetXiIntegrand(SCPData *SCPD, double Xi, double *U)
        };
       fprintf(f,"\n");
    }; 
-  fclose(f);
+  CloseOutput(SCPD, f);
 
 }
 
@@ -152,6 +152,62 @@ void Usage(const char *ProgramName, OptStruct *OSArray, const char *ErrMsg)
   exit(1);
 }
 
+/***************************************************************/
+/* data passed to the task routine that processes a single     */
+/* frequency point when --FrequencyGroups is used              */
+/***************************************************************/
+typedef struct FreqTaskData
+ { SCPData **Workspaces;   // one per frequency group
+   HVector *XiList;        // exactly one of XiList, XikList is nonzero
+   HMatrix *XikList;
+ } FreqTaskData;
+
+void FreqTask(void *UserData, int nGroup, int nPoint)
+{
+  FreqTaskData *Data = (FreqTaskData *)UserData;
+  SCPData *SCPD      = Data->Workspaces[nGroup];
+  SCPD->nPoint       = nPoint;
+
+  double *U = new double[SCPD->EPMatrix->NR * SCPD->NumAtoms];
+  if (Data->XikList)
+   { HMatrix *XikList = Data->XikList;
+     double Xi, kBloch[2]={0.0, 0.0};
+     Xi = XikList->GetEntryD(nPoint,0);
+     kBloch[0] = XikList->GetEntryD(nPoint,1);
+     if (SCPD->G->LDim>1)
+      kBloch[1] = XikList->GetEntryD(nPoint,2);
+     GetCPIntegrand((void *)SCPD, cdouble(0.0,Xi), kBloch, U);
+   }
+  else
+   GetXiIntegrand(SCPD, Data->XiList->GetEntryD(nPoint), U);
+  delete[] U;
+}
+
+/***************************************************************/
+/* process all points of XiList or XikList with the given      */
+/* number of frequency groups, creating additional workspaces  */
+/* as needed                                                   */
+/***************************************************************/
+void RunFrequencyGroups(SCPData **Workspaces, int *NumWorkspaces,
+                        int FrequencyGroups, HVector *XiList, HMatrix *XikList)
+{
+  int NumPoints = XikList ? XikList->NR : XiList->N;
+  FrequencyScheduler *FS = new FrequencyScheduler(NumPoints, FrequencyGroups);
+  for(; *NumWorkspaces < FS->NumGroups; (*NumWorkspaces)++)
+   Workspaces[*NumWorkspaces] = CloneSCPData(Workspaces[0]);
+
+  FreqTaskData MyData, *Data=&MyData;
+  Data->Workspaces = Workspaces;
+  Data->XiList     = XikList ? 0 : XiList;
+  Data->XikList    = XikList;
+  for(int nGroup=0; nGroup<FS->NumGroups; nGroup++)
+   Workspaces[nGroup]->FS = FS;
+  FS->Run(FreqTask, (void *)Data);
+  for(int nGroup=0; nGroup<FS->NumGroups; nGroup++)
+   Workspaces[nGroup]->FS = 0;
+  delete FS;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -186,6 +242,8 @@ int main(int argc, char *argv[])
 //
   double RelTol    = 1.0e-2;
   double AbsTol    = 1.0e-10;
+//
+  int FrequencyGroups = 1;
   /* name           type  #args  max_instances  storage    count  description*/
   OptStruct OSArray[]=
    { 
@@ -206,6 +264,8 @@ int main(int argc, char *argv[])
 //
      {"RelTol",      PA_DOUBLE,  1, 1,       (void *)&RelTol,      0,             "relative error tolerance"},
      {"AbsTol",      PA_DOUBLE,  1, 1,       (void *)&AbsTol,      0,             "absolute error tolerance"},
+//
+     {"FrequencyGroups", PA_INT, 1, 1,       (void *)&FrequencyGroups, 0,         "number of frequencies to process concurrently"},
      {0,0,0,0,0,0,0}
    };
   ProcessOptions(argc, argv, OSArray);
@@ -311,7 +371,28 @@ int main(int argc, char *argv[])
   int NumEvalPoints=SCPD->EPMatrix->NR;
   int NumDataValues = NumEvalPoints*NumAtoms;
   double *U=(double *)mallocEC(NumDataValues * sizeof(double));
-  if (XikList)
+
+  // with --FrequencyGroups N, the available threads are split into
+  // N groups that process different points of a user-specified
+  // list of frequencies or (frequency, bloch vector) pairs
+  // concurrently, each in its own copy of SCPD.
+  // (Matsubara sums and frequency integrals are still done one
+  // frequency at a time.)
+  int NumXiPoints  = XiList  ? XiList->N   : 0;
+  int NumXikPoints = XikList ? XikList->NR : 0;
+  bool UseGroups = FrequencyGroups>1 && (NumXiPoints>1 || NumXikPoints>1);
+  if (FrequencyGroups>1 && !UseGroups)
+   Warn("--FrequencyGroups only supported for --XiFile, --Xi, or --XikBlochFile (ignoring)");
+  SCPData **Workspaces = 0;
+  int NumWorkspaces    = 1;
+  if (UseGroups)
+   { Workspaces    = new SCPData *[FrequencyGroups];
+     Workspaces[0] = SCPD;
+   };
+
+  if (XikList && UseGroups && NumXikPoints>1)
+   RunFrequencyGroups(Workspaces, &NumWorkspaces, FrequencyGroups, 0, XikList);
+  else if (XikList)
    {
      for(int n=0; n<XikList->NR; n++)
       { 
@@ -324,7 +405,9 @@ int main(int argc, char *argv[])
         GetCPIntegrand((void *)SCPD, cdouble(0.0,Xi), kBloch, U);
       }
    }
-  if (XiList)
+  if (XiList && UseGroups && NumXiPoints>1)
+   RunFrequencyGroups(Workspaces, &NumWorkspaces, FrequencyGroups, XiList, 0);
+  else if (XiList)
    {
      for(int nXi=0; nXi<XiList->N; nXi++)
       GetXiIntegrand(SCPD, XiList->GetEntryD(nXi), U);
@@ -36,6 +36,7 @@
 #include <libTriInt.h>
 #include <BZIntegration.h>
 #include <libscuff.h>
+#include <libscuffInternals.h>
 
 using namespace scuff;
 
@@ -123,6 +124,12 @@ typedef struct SCPData
    char *ByXikFileName;
    GetBZIArgStruct *BZIArgs;
 
+   // if several frequencies are processed concurrently, output
+   // for frequency point #nPoint is routed through FS so that
+   // it is written in frequency order
+   FrequencyScheduler *FS;
+   int nPoint;
+
  } SCPData; 
 
 /***************************************************************/
@@ -132,6 +139,7 @@ SCPData *CreateSCPData(char *GeoFile,
                        char **Atoms, int NumBIAtoms,
                        char **Particles, int NumParticles,
                        char *EPFile, char *FileBase);
+SCPData *CloneSCPData(SCPData *SCPD);
 
 /***************************************************************/
 /***************************************************************/
@@ -65,12 +65,65 @@ void WriteSIFluxFilePreamble(SNEQData *SNEQD, char *FileName)
   fclose(f);
 }
 
+/***************************************************************/
+/* allocate the frequency-dependent working storage of SNEQD:  */
+/* the BEM matrix, its subblocks, and the output buffers.      */
+/***************************************************************/
+static void AllocateSNEQWorkspace(SNEQData *SNEQD)
+{
+  RWGGeometry *G = SNEQD->G;
+  int NS         = G->NumSurfaces;
+
+  SNEQD->PFTMatrix = new HMatrix(NS, NUMPFT);
+  SNEQD->SRFMatrix = SNEQD->NX ? new HMatrix(SNEQD->NX, NUMSRFLUX) : 0;
+
+  /*--------------------------------------------------------------*/
+  /*- allocate arrays of matrix subblocks that allow us to reuse -*/
+  /*- chunks of the BEM matrices for multiple geometrical        -*/
+  /*- transformations.                                           -*/
+  /*--------------------------------------------------------------*/
+  SNEQD->TExt = (HMatrix **)mallocEC(NS*sizeof(HMatrix *));
+  SNEQD->TInt = (HMatrix **)mallocEC(NS*sizeof(HMatrix *));
+  SNEQD->U = (HMatrix **)mallocEC( ((NS*(NS-1))/2)*sizeof(HMatrix *));
+  Log("Before T, U blocks: mem=%3.1f GB",GetMemoryUsage()/1.0e9);
+  for(int nb=0, ns=0; ns<NS; ns++)
+   { 
+     int NBF=G->Surfaces[ns]->NumBFs;
+
+     if (G->Mate[ns]==-1)
+      { SNEQD->TExt[ns]  = new HMatrix(NBF, NBF, LHM_COMPLEX);
+        SNEQD->TInt[ns]  = new HMatrix(NBF, NBF, LHM_COMPLEX);
+      }
+     else
+      { SNEQD->TExt[ns] = SNEQD->TExt[ G->Mate[ns] ];
+        SNEQD->TInt[ns] = SNEQD->TInt[ G->Mate[ns] ];
+      };
+
+     for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
+      { int NBFp=G->Surfaces[nsp]->NumBFs;
+        SNEQD->U[nb] = new HMatrix(NBF, NBFp, LHM_COMPLEX);
+      };
+   };
+  Log("After T, U blocks: mem=%3.1f GB",GetMemoryUsage()/1.0e9);
+
+  /*--------------------------------------------------------------*/
+  /*- allocate BEM matrix and dressed Rytov matrix ---------------*/
+  /*--------------------------------------------------------------*/
+  SNEQD->M        = new HMatrix(G->TotalBFs, G->TotalBFs, LHM_COMPLEX );
+  SNEQD->DRMatrix = new HMatrix(G->TotalBFs, G->TotalBFs, LHM_COMPLEX );
+  Log("After W, Rytov: mem=%3.1f GB",GetMemoryUsage()/1.0e9);
+
+  SNEQD->Tracker = new BEMBlockTracker(G);
+  SNEQD->Tracker->SetLeadingSurfaces(SNEQD->GTCList, SNEQD->NumTransformations);
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
 SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
                          int *PFTMethods, int NumPFTMethods,
-                         char *EPFile, char *pFileBase)
+                         char *EPFile, char *pFileBase,
+                         bool WritePreambles)
 {
 
   SNEQData *SNEQD=(SNEQData *)mallocEC(sizeof(*SNEQD));
@@ -103,7 +156,6 @@ SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
   /*- figure out which PFT methods were requested and write       */
   /*- SIFlux file preambles                                       */
   /*--------------------------------------------------------------*/
-  SNEQD->PFTMatrix = new HMatrix(G->NumSurfaces, NUMPFT);
   InitPFTOptions( &(SNEQD->PFTOpts) );
   SNEQD->NumPFTMethods = NumPFTMethods;
   SNEQD->DSIOmegaPoints=0;
@@ -123,8 +175,25 @@ SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
 
      SNEQD->SIFluxFileNames[npm]
       = vstrdup("%s.SIFlux.%s",SNEQD->FileBase,PFTName);
-     WriteSIFluxFilePreamble(SNEQD, SNEQD->SIFluxFileNames[npm]);
+     if (WritePreambles)
+      WriteSIFluxFilePreamble(SNEQD, SNEQD->SIFluxFileNames[npm]);
+
+     // records are keyed by transform tag and (Omega, kx, ky, 
+     // source surface); each holds the full PFT matrix for all
+     // destination surfaces, plus a status flag
+     char *StoreFileName=vstrdup("%s.results",SNEQD->SIFluxFileNames[npm]);
+     SNEQD->SIFluxStores[npm]
+      = new ResultStore(StoreFileName, "NEQ", 4, G->NumSurfaces*NUMPFT + 1);
+     free(StoreFileName);
+     if (SNEQD->SIFluxStores[npm]->ErrMsg)
+      { Warn("%s (results will not be checkpointed)",SNEQD->SIFluxStores[npm]->ErrMsg);
+        delete SNEQD->SIFluxStores[npm];
+        SNEQD->SIFluxStores[npm]=0;
+      };
    };
+  SNEQD->UseExistingData=false;
+  SNEQD->FS=0;
+  SNEQD->nPoint=0;
   
   int NT = SNEQD->NumTransformations;
   int NS = SNEQD->G->NumSurfaces;
@@ -134,7 +203,6 @@ SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
   /*- quantities                                                 -*/
   /*--------------------------------------------------------------*/
   SNEQD->SRXMatrix = 0;
-  SNEQD->SRFMatrix = 0;
   SNEQD->NX        = 0; 
   SNEQD->NumSRQs   = 0;
   if (EPFile)
@@ -143,49 +211,14 @@ SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
       ErrExit(SNEQD->SRXMatrix->ErrMsg);
      int NX = SNEQD->NX = SNEQD->SRXMatrix->NR;
      SNEQD->NumSRQs = NT*NS*NX*NUMSRFLUX;
-     SNEQD->SRFMatrix = new HMatrix(NX, NUMSRFLUX);
    };
 
-  /*--------------------------------------------------------------*/
-  /*- allocate arrays of matrix subblocks that allow us to reuse -*/
-  /*- chunks of the BEM matrices for multiple geometrical        -*/
-  /*- transformations.                                           -*/
-  /*--------------------------------------------------------------*/
-  SNEQD->TExt = (HMatrix **)mallocEC(NS*sizeof(HMatrix *));
-  SNEQD->TInt = (HMatrix **)mallocEC(NS*sizeof(HMatrix *));
-  SNEQD->U = (HMatrix **)mallocEC( ((NS*(NS-1))/2)*sizeof(HMatrix *));
-  Log("Before T, U blocks: mem=%3.1f GB",GetMemoryUsage()/1.0e9);
-  for(int nb=0, ns=0; ns<NS; ns++)
-   { 
-     int NBF=G->Surfaces[ns]->NumBFs;
-
-     if (G->Mate[ns]==-1)
-      { SNEQD->TExt[ns]  = new HMatrix(NBF, NBF, LHM_COMPLEX);
-        SNEQD->TInt[ns]  = new HMatrix(NBF, NBF, LHM_COMPLEX);
-      }
-     else
-      { SNEQD->TExt[ns] = SNEQD->TExt[ G->Mate[ns] ];
-        SNEQD->TInt[ns] = SNEQD->TInt[ G->Mate[ns] ];
-      };
-
-     for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
-      { int NBFp=G->Surfaces[nsp]->NumBFs;
-        SNEQD->U[nb] = new HMatrix(NBF, NBFp, LHM_COMPLEX);
-      };
-   };
-  Log("After T, U blocks: mem=%3.1f GB",GetMemoryUsage()/1.0e9);
-
-  /*--------------------------------------------------------------*/
-  /*- allocate BEM matrix and dressed Rytov matrix ---------------*/
-  /*--------------------------------------------------------------*/
-  SNEQD->M        = new HMatrix(G->TotalBFs, G->TotalBFs, LHM_COMPLEX );
-  SNEQD->DRMatrix = new HMatrix(G->TotalBFs, G->TotalBFs, LHM_COMPLEX );
-  Log("After W, Rytov: mem=%3.1f GB",GetMemoryUsage()/1.0e9);
+  AllocateSNEQWorkspace(SNEQD);
 
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
-  if (SNEQD->NumSRQs>0)
+  if (SNEQD->NumSRQs>0 && WritePreambles)
    { FILE *f=vfopen("%s.SRFlux","a",SNEQD->FileBase);
      fprintf(f,"\n");
      fprintf(f,"# scuff-neq run on %s (%s)\n",GetHostName(),GetTimeString());
@@ -212,3 +245,26 @@ SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
   return SNEQD;
 
 }
+
+/***************************************************************/
+/* create a second SNEQData structure for the same calculation,*/
+/* with its own geometry and working storage, so that the two  */
+/* can process different frequencies concurrently. the         */
+/* transformation list, output files, and result stores are    */
+/* shared with the original.                                   */
+/***************************************************************/
+SNEQData *CloneSNEQData(SNEQData *SNEQD)
+{
+  SNEQData *Clone=(SNEQData *)mallocEC(sizeof(*Clone));
+  memcpy(Clone, SNEQD, sizeof(*Clone));
+
+  Clone->G = new RWGGeometry(SNEQD->G->GeoFileName);
+
+  // only the original dumps the cache
+  Clone->WriteCache=0;
+  Clone->nPoint=0;
+
+  AllocateSNEQWorkspace(Clone);
+
+  return Clone;
+}
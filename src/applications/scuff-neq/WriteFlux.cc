@@ -32,15 +32,18 @@
 #define II cdouble(0.0,1.0)
 
 /***************************************************************/
+/* only entries in rows or columns >= Offset are affected      */
 /***************************************************************/
-/***************************************************************/
-void UndoSCUFFMatrixTransformation(HMatrix *M)
+void UndoSCUFFMatrixTransformation(HMatrix *M, int Offset=0)
 { 
   for (int nr=0; nr<M->NR; nr+=2)
-   for (int nc=0; nc<M->NC; nc+=2)
-    { M->SetEntry(nr,   nc,   ZVAC*M->GetEntry(nr,   nc)   );
-      M->SetEntry(nr,   nc+1, -1.0*M->GetEntry(nr,   nc+1) );
-      M->SetEntry(nr+1, nc+1, -1.0*M->GetEntry(nr+1, nc+1)/ZVAC );
+   for (int nc=(nr+1>=Offset ? 0 : (Offset-1) - (Offset-1)%2); nc<M->NC; nc+=2)
+    { if (nr>=Offset || nc>=Offset)
+       M->SetEntry(nr,   nc,   ZVAC*M->GetEntry(nr,   nc)   );
+      if (nr>=Offset || nc+1>=Offset)
+       M->SetEntry(nr,   nc+1, -1.0*M->GetEntry(nr,   nc+1) );
+      if (nr+1>=Offset || nc+1>=Offset)
+       M->SetEntry(nr+1, nc+1, -1.0*M->GetEntry(nr+1, nc+1)/ZVAC );
     };
 }
 
@@ -194,6 +197,108 @@ int GetSIFlux(SNEQData *SNEQD, int SourceSurface, cdouble Omega,
 
 } 
 
+/***************************************************************/
+/* open an output file for appending. if frequencies are being */
+/* processed concurrently, the output goes to a buffer that is */
+/* written to the file in frequency order.                     */
+/***************************************************************/
+static FILE *OpenOutput(SNEQData *SNEQD, const char *FileName)
+{
+  if (SNEQD->FS)
+   return SNEQD->FS->OpenOutput(SNEQD->nPoint, FileName);
+  return fopen(FileName,"a");
+}
+
+static void CloseOutput(SNEQData *SNEQD, FILE *f)
+{
+  if (SNEQD->FS==0)
+   fclose(f);
+}
+
+/***************************************************************/
+/* write the SIFlux data for a single (transform, frequency,   */
+/* source surface) to the .SIFlux file for PFT method #npm.    */
+/* PFTData[nsd*NUMPFT + nq] is PFT quantity #nq for destination*/
+/* surface #nsd.                                               */
+/***************************************************************/
+static void WriteSIFluxLines(SNEQData *SNEQD, int npm, char *Tag,
+                             cdouble Omega, double *kBloch, int nss,
+                             double *PFTData)
+{
+  RWGGeometry *G=SNEQD->G;
+  FILE *f=OpenOutput(SNEQD, SNEQD->SIFluxFileNames[npm]);
+  for(int nsd=0; nsd<G->NumSurfaces; nsd++)
+   { fprintf(f,"%s %e ",Tag,real(Omega));
+     if (kBloch) fprintVec(f,kBloch,G->LDim);
+     fprintf(f,"%i%i ",nss+1,nsd+1);
+     for(int nq=0; nq<NUMPFT; nq++)
+      fprintf(f,"%+.8e ",PFTData[nsd*NUMPFT + nq]);
+     fprintf(f,"\n");
+   };
+  CloseOutput(SNEQD, f);
+}
+
+/***************************************************************/
+/* keys under which the SIFlux data for a given frequency and  */
+/* source surface are filed in the SIFlux stores               */
+/***************************************************************/
+static void GetStoreKeys(SNEQData *SNEQD, cdouble Omega, double *kBloch,
+                         int nss, double Keys[4])
+{
+  int LDim = kBloch ? SNEQD->G->LDim : 0;
+  Keys[0] = real(Omega);
+  Keys[1] = LDim>=1 ? kBloch[0] : 0.0;
+  Keys[2] = LDim>=2 ? kBloch[1] : 0.0;
+  Keys[3] = (double)nss;
+}
+
+/***************************************************************/
+/* if the SIFlux data for all transforms, source surfaces, and */
+/* PFT methods at this frequency were stored by a previous run,*/
+/* write them to the .SIFlux files and return true; otherwise  */
+/* return false without writing anything.                      */
+/***************************************************************/
+static bool WriteStoredFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
+{
+  // spatially-resolved data and flux plots are not stored
+  if (SNEQD->SRXMatrix || SNEQD->PlotFlux)
+   return false;
+
+  RWGGeometry *G    = SNEQD->G;
+  int NS            = G->NumSurfaces;
+  int NT            = SNEQD->NumTransformations;
+  int NumPFTMethods = SNEQD->NumPFTMethods;
+  int NumValues     = NS*NUMPFT + 1;
+
+  double *Values = new double[NT*NS*NumPFTMethods*NumValues];
+  bool AllFound=true;
+  for(int nt=0; AllFound && nt<NT; nt++)
+   for(int nss=0; AllFound && nss<NS; nss++)
+    for(int npm=0; AllFound && npm<NumPFTMethods; npm++)
+     { if (G->Surfaces[nss]->IsPEC)
+        continue;
+       ResultStore *Store = SNEQD->SIFluxStores[npm];
+       double Keys[4];
+       GetStoreKeys(SNEQD, Omega, kBloch, nss, Keys);
+       double *V = Values + ((nt*NS + nss)*NumPFTMethods + npm)*NumValues;
+       AllFound = Store && Store->Lookup(SNEQD->GTCList[nt]->Tag, Keys, V);
+     };
+
+  if (AllFound)
+   for(int nt=0; nt<NT; nt++)
+    for(int nss=0; nss<NS; nss++)
+     for(int npm=0; npm<NumPFTMethods; npm++)
+      { double *V = Values + ((nt*NS + nss)*NumPFTMethods + npm)*NumValues;
+        if ( G->Surfaces[nss]->IsPEC || V[NS*NUMPFT]==0.0 )
+         continue;
+        WriteSIFluxLines(SNEQD, npm, SNEQD->GTCList[nt]->Tag,
+                         Omega, kBloch, nss, V);
+      };
+
+  delete[] Values;
+  return AllFound;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -210,7 +315,16 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
   int NS              = SNEQD->G->NumSurfaces;
   char *FileBase      = SNEQD->FileBase;
 
+  /***************************************************************/
+  /* skip the calculation if a previous run already did it       */
+  /***************************************************************/
+  if ( SNEQD->UseExistingData && WriteStoredFlux(SNEQD, Omega, kBloch) )
+   { Log("Read neq quantities at omega=%s from stored data.",z2s(Omega));
+     return;
+   };
+
   Log("Computing neq quantities at omega=%s...",z2s(Omega));
+  SNEQD->Tracker->Reset();
 
   /***************************************************************/
   /* preinitialize an argument structure for the BEM matrix      */
@@ -265,35 +379,46 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
      /*--------------------------------------------------------------*/
      /* assemble off-diagonal matrix blocks.                         */
      /* note that not all off-diagonal blocks necessarily need to    */
-     /* be recomputed for all transformations; this is what the 'if' */
-     /* statement here is checking for.                              */
+     /* be recomputed for all transformations: only those whose      */
+     /* surfaces have moved relative to each other since the block   */
+     /* was last computed at this frequency.                         */
      /*--------------------------------------------------------------*/
      Args->Symmetric=0;
      for(int nb=0, ns=0; ns<NS; ns++)
       for(int nsp=ns+1; nsp<NS; nsp++, nb++)
-       if ( nt==0 || G->SurfaceMoved[ns] || G->SurfaceMoved[nsp] )
-        G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, U[nb]);
+       if ( SNEQD->Tracker->BlockIsStale(ns, nsp) )
+        { G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, U[nb]);
+          SNEQD->Tracker->MarkBlockCurrent(ns, nsp);
+        };
      Log("...SN done with ABMB");
 
      /*--------------------------------------------------------------*/
-     /*- stamp all blocks into the BEM matrix and LU-factorize      -*/
+     /*- stamp blocks into the BEM matrix and LU-factorize; if only  */
+     /*- the trailing surfaces moved since the last factorization,   */
+     /*- only their rows and columns are restamped and the existing  */
+     /*- factorization is updated                                    */
      /*--------------------------------------------------------------*/
+     int nsFirst = SNEQD->Tracker->FirstSurfaceToRestamp(M);
      for(int nb=0, ns=0; ns<NS; ns++)
       { 
         int RowOffset=G->BFIndexOffset[ns];
-        M->InsertBlock(TExt[ns], RowOffset, RowOffset);
-        if( !(G->Surfaces[ns]->IsPEC) )
-         M->AddBlock(TInt[ns], RowOffset, RowOffset);
+        if (ns>=nsFirst)
+         { M->InsertBlock(TExt[ns], RowOffset, RowOffset);
+           if( !(G->Surfaces[ns]->IsPEC) )
+            M->AddBlock(TInt[ns], RowOffset, RowOffset);
+         };
 
         for(int nsp=ns+1; nsp<NS; nsp++, nb++)
-         { int ColOffset=G->BFIndexOffset[nsp];
+         { if (nsp<nsFirst) continue;
+           int ColOffset=G->BFIndexOffset[nsp];
            M->InsertBlock(U[nb], RowOffset, ColOffset);
            M->InsertBlockTranspose(U[nb], ColOffset, RowOffset);
          };
       };
-     UndoSCUFFMatrixTransformation(M);
+     if (nsFirst<NS)
+      UndoSCUFFMatrixTransformation(M, G->BFIndexOffset[nsFirst]);
      Log("LU factorizing...");
-     M->LUFactorize();
+     SNEQD->Tracker->LUFactorize(M);
 
      /*--------------------------------------------------------------*/
      /*- compute the requested quantities for all objects           -*/
@@ -303,6 +428,7 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
      int NumPFTMethods  = SNEQD->NumPFTMethods;
      int *PFTMethods    = SNEQD->PFTMethods;
      HMatrix *PFTMatrix = SNEQD->PFTMatrix;
+     double *PFTData    = new double[NS*NUMPFT + 1];
      for(int nss=0; nss<NS; nss++)
       {
         // PEC bodies do not act as thermal sources
@@ -319,19 +445,23 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
          { 
            int Status=GetSIFlux(SNEQD, nss, Omega,
                                 PFTMethods[npm], PFTMatrix);
-           if (Status==0)
-            continue;
 
-           FILE *f=vfopen(SNEQD->SIFluxFileNames[npm],"a");
+           // PFTData[NS*NUMPFT] records whether any data were
+           // computed by this method at this frequency
            for(int nsd=0; nsd<NS; nsd++)
-            { fprintf(f,"%s %e ",Tag,real(Omega));
-              if (kBloch) fprintVec(f,kBloch,G->LDim);
-              fprintf(f,"%i%i ",nss+1,nsd+1);
-              for(int nq=0; nq<NUMPFT; nq++)
-               fprintf(f,"%+.8e ",PFTMatrix->GetEntryD(nsd,nq));
-              fprintf(f,"\n");
+            for(int nq=0; nq<NUMPFT; nq++)
+             PFTData[nsd*NUMPFT + nq] = Status ? PFTMatrix->GetEntryD(nsd,nq) : 0.0;
+           PFTData[NS*NUMPFT] = (double)Status;
+           if (SNEQD->SIFluxStores[npm])
+            { double Keys[4];
+              GetStoreKeys(SNEQD, Omega, kBloch, nss, Keys);
+              SNEQD->SIFluxStores[npm]->Add(Tag, Keys, PFTData);
             };
-           fclose(f);
+
+           if (Status==0)
+            continue;
+
+           WriteSIFluxLines(SNEQD, npm, Tag, Omega, kBloch, nss, PFTData);
 
          };
 
@@ -344,7 +474,9 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
             HMatrix *DRMatrix  = SNEQD->DRMatrix;
             GetSRFluxTrace(G, SRXMatrix, Omega, DRMatrix, SRFMatrix);
 
-            FILE *f=vfopen("%s.SRFlux","a",FileBase);
+            char *SRFluxFileName=vstrdup("%s.SRFlux",FileBase);
+            FILE *f=OpenOutput(SNEQD, SRFluxFileName);
+            free(SRFluxFileName);
             for(int nx=0; nx<SRXMatrix->NR; nx++)
              {
                double X[3], SRFlux[NUMSRFLUX];
@@ -359,10 +491,11 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
                 fprintf(f,"%e ",SRFMatrix->GetEntryD(nx,nfc));
                fprintf(f,"\n");
              };
-            fclose(f);
+            CloseOutput(SNEQD, f);
           };
 
       };
+     delete[] PFTData;
 
      /*--------------------------------------------------------------*/
      /* untransform the geometry                                     */
@@ -45,6 +45,50 @@
 
 #define II cdouble(0.0,1.0)
 
+/***************************************************************/
+/* data passed to the task routine that processes a single     */
+/* frequency point when --FrequencyGroups is used              */
+/***************************************************************/
+typedef struct FreqTaskData
+ { SNEQData **Workspaces;   // one per frequency group
+   HVector *OmegaPoints;
+   HMatrix *OmegaKBPoints;
+ } FreqTaskData;
+
+/***************************************************************/
+/* start reading any stored T-blocks for frequency point       */
+/* #nPoint from disk while we work on the preceding point      */
+/***************************************************************/
+void PrefetchPoint(SNEQData *SNEQD, HVector *OmegaPoints,
+                   HMatrix *OmegaKBPoints, int nPoint)
+{
+  if (OmegaKBPoints && nPoint<OmegaKBPoints->NR)
+   { double kBloch[2];
+     kBloch[0] = OmegaKBPoints->GetEntryD(nPoint, 1);
+     kBloch[1] = OmegaKBPoints->GetEntryD(nPoint, 2);
+     SNEQD->G->PrefetchTBlocks(OmegaKBPoints->GetEntryD(nPoint, 0), kBloch);
+   }
+  else if (!OmegaKBPoints && OmegaPoints && nPoint<OmegaPoints->N)
+   SNEQD->G->PrefetchTBlocks(OmegaPoints->GetEntry(nPoint));
+}
+
+void FreqTask(void *UserData, int nGroup, int nPoint)
+{
+  FreqTaskData *Data = (FreqTaskData *)UserData;
+  SNEQData *SNEQD    = Data->Workspaces[nGroup];
+  SNEQD->nPoint      = nPoint;
+  PrefetchPoint(SNEQD, Data->OmegaPoints, Data->OmegaKBPoints, nPoint+1);
+  if (Data->OmegaKBPoints)
+   { double kBloch[2];
+     cdouble Omega = Data->OmegaKBPoints->GetEntryD(nPoint, 0);
+     kBloch[0]     = Data->OmegaKBPoints->GetEntryD(nPoint, 1);
+     kBloch[1]     = Data->OmegaKBPoints->GetEntryD(nPoint, 2);
+     WriteFlux(SNEQD, Omega, kBloch);
+   }
+  else
+   WriteFlux(SNEQD, Data->OmegaPoints->GetEntry(nPoint));
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -89,12 +133,19 @@ int main(int argc, char *argv[])
   /*--------------------------------------------------------------*/
   bool PlotFlux=false;
   bool OmitSelfTerms=false;
+  bool UseExistingData=false;
 
   /*--------------------------------------------------------------*/
   char *Cache=0;
   char *ReadCache[MAXCACHE];         int nReadCache;
   char *WriteCache=0;
 
+  /*--------------------------------------------------------------*/
+  int FrequencyGroups=1;
+  char *WorkDir=0;
+  bool Worker=false;
+  double LeaseTimeout=FS_DEFAULT_LEASE_TIMEOUT;
+
   /* name               type    #args  max_instances  storage           count         description*/
   OptStruct OSArray[]=
    { 
@@ -111,6 +162,7 @@ int main(int argc, char *argv[])
 /**/     
      {"PlotFlux",       PA_BOOL,    0, 1,       (void *)&PlotFlux,   0,             "write spatially-resolved flux data"},
      {"OmitSelfTerms",  PA_BOOL,    0, 1,       (void *)&OmitSelfTerms,   0,             "write spatially-resolved flux data"},
+     {"UseExistingData", PA_BOOL,   0, 1,       (void *)&UseExistingData, 0,            "skip frequencies already stored in .SIFlux.*.results files"},
 /**/
      {"EMTPFT",         PA_BOOL,    0, 1,       (void *)&EMTPFT,     0,            "compute SIFlux using EMT method"},
      {"OPFT",           PA_BOOL,    0, 1,       (void *)&OPFT,       0,             "compute SIFlux using overlap method"},
@@ -123,6 +175,11 @@ int main(int argc, char *argv[])
      {"Cache",          PA_STRING,  1, 1,       (void *)&Cache,      0,             "read/write cache"},
      {"ReadCache",      PA_STRING,  1, MAXCACHE,(void *)ReadCache,   &nReadCache,   "read cache"},
      {"WriteCache",     PA_STRING,  1, 1,       (void *)&WriteCache, 0,             "write cache"},
+/**/     
+     {"FrequencyGroups", PA_INT,    1, 1,       (void *)&FrequencyGroups, 0,        "number of frequencies to process concurrently"},
+     {"WorkDir",        PA_STRING,  1, 1,       (void *)&WorkDir,    0,             "share frequencies with other processes via this directory"},
+     {"Worker",         PA_BOOL,    0, 1,       (void *)&Worker,     0,             "with --WorkDir: run as worker, not coordinator"},
+     {"LeaseTimeout",   PA_DOUBLE,  1, 1,       (void *)&LeaseTimeout, 0,           "with --WorkDir: reassign frequencies whose lease is not renewed for this many seconds (0 = same host only)"},
 /**/     
      {0,0,0,0,0,0,0}
    };
@@ -138,6 +195,8 @@ int main(int argc, char *argv[])
 
   if ( Cache!=0 && WriteCache!=0 )
    ErrExit("--cache and --writecache options are mutually exclusive");
+  if ( Worker && !WorkDir )
+   ErrExit("--Worker requires --WorkDir");
 
   /*******************************************************************/
   /* determine which PFT methods were requested       ****************/
@@ -205,10 +264,11 @@ int main(int argc, char *argv[])
   /*******************************************************************/
   SNEQData *SNEQD=CreateSNEQData(GeoFile, TransFile,
                                  PFTMethods, NumPFTMethods,
-                                 EPFile, FileBase);
+                                 EPFile, FileBase, !Worker);
   RWGGeometry *G=SNEQD->G;
   SNEQD->PlotFlux                = PlotFlux;
   SNEQD->OmitSelfTerms           = OmitSelfTerms;
+  SNEQD->UseExistingData         = UseExistingData;
   SNEQD->PFTOpts.DSIMesh         = DSIMesh;
   SNEQD->PFTOpts.DSIRadius       = DSIRadius;
   SNEQD->PFTOpts.DSIFarField     = DSIFarField;
@@ -234,8 +294,33 @@ int main(int argc, char *argv[])
   /*******************************************************************/
   /* now switch off based on the requested frequency behavior to     */
   /* perform the actual calculations.                                */
+  /*                                                                 */
+  /* with --FrequencyGroups N, the available threads are split into  */
+  /* N groups that process different frequencies concurrently, each  */
+  /* in its own copy of the SNEQData workspace.                      */
+  /*                                                                 */
+  /* with --WorkDir, frequencies are shared with all other scuff-neq */
+  /* processes started with the same --WorkDir; the one process      */
+  /* started without --Worker merges everybody's output.             */
   /*******************************************************************/
-  if (OmegaKBPoints)
+  int NumPoints = OmegaKBPoints ? OmegaKBPoints->NR : NumFreqs;
+  if ( (FrequencyGroups>1 && NumPoints>1) || WorkDir )
+   { 
+     FrequencyScheduler *FS = new FrequencyScheduler(NumPoints, FrequencyGroups);
+     if (WorkDir)
+      FS->SetWorkDir(WorkDir, !Worker, LeaseTimeout);
+     FreqTaskData MyData, *Data=&MyData;
+     Data->Workspaces    = new SNEQData *[FS->NumGroups];
+     Data->OmegaPoints   = OmegaPoints;
+     Data->OmegaKBPoints = OmegaKBPoints;
+     SNEQD->FS = FS;
+     Data->Workspaces[0] = SNEQD;
+     for(int nGroup=1; nGroup<FS->NumGroups; nGroup++)
+      Data->Workspaces[nGroup] = CloneSNEQData(SNEQD);
+     FS->Run(FreqTask, (void *)Data);
+     delete FS;
+   }
+  else if (OmegaKBPoints)
    { for (int nok=0; nok<OmegaKBPoints->NR; nok++)
       {  
         cdouble Omega; 
@@ -243,12 +328,15 @@ int main(int argc, char *argv[])
         Omega     = OmegaKBPoints->GetEntryD(nok, 0);
         kBloch[0] = OmegaKBPoints->GetEntryD(nok, 1);
         kBloch[1] = OmegaKBPoints->GetEntryD(nok, 2);
+        PrefetchPoint(SNEQD, 0, OmegaKBPoints, nok+1);
         WriteFlux(SNEQD, Omega, kBloch);
       };
    }
   else
    for (int nFreq=0; nFreq<NumFreqs; nFreq++)
-    WriteFlux(SNEQD, OmegaPoints->GetEntry(nFreq));
+    { PrefetchPoint(SNEQD, OmegaPoints, 0, nFreq+1);
+      WriteFlux(SNEQD, OmegaPoints->GetEntry(nFreq));
+    };
 
   /***************************************************************/
   /***************************************************************/
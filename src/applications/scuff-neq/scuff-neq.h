@@ -32,6 +32,7 @@
 #include <libhrutil.h>
 #include <libhmat.h>
 #include <libscuff.h>
+#include <libscuffInternals.h>
 
 using namespace scuff;
 
@@ -98,6 +99,12 @@ typedef struct SNEQData
    int PFTMethods[MAXPFTMETHODS];
    char *SIFluxFileNames[MAXPFTMETHODS];
 
+   // SIFluxStores[npm] checkpoints the data written to
+   // SIFluxFileNames[npm]; if UseExistingData is set, WriteFlux
+   // skips frequencies for which all data are already stored
+   ResultStore *SIFluxStores[MAXPFTMETHODS];
+   bool UseExistingData;
+
    /*--------------------------------------------------------------*/
    /* storage for the BEM matrix and its subblocks.                */
    // Note: Buffer[0..N] are pointers into an internally-allocated */
@@ -108,6 +115,7 @@ typedef struct SNEQData
    HMatrix **TInt;    // TInt[ns], TExt[ns] = interior and exterior
    HMatrix **TExt;    // contributions to BEM block for surface #ns
    HMatrix **U;       // U[nb] = // off-diagonal U-matrix block #nb 
+   BEMBlockTracker *Tracker; // which U blocks need recomputing
 
    /*--------------------------------------------------------------*/
    /*- miscellaneous other options                                -*/
@@ -117,6 +125,14 @@ typedef struct SNEQData
    bool PlotFlux;       // generate flux plots
    bool OmitSelfTerms;
 
+   /*--------------------------------------------------------------*/
+   /*- if several frequencies are processed concurrently, output  -*/
+   /*- for frequency point #nPoint is routed through FS so that it-*/
+   /*- is written in frequency order                              -*/
+   /*--------------------------------------------------------------*/
+   FrequencyScheduler *FS;
+   int nPoint;
+
  } SNEQData;
 
 /*--------------------------------------------------------------*/
@@ -124,7 +140,9 @@ typedef struct SNEQData
 /*--------------------------------------------------------------*/
 SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
                          int *PFTMethods, int NumPFTMethods,
-                         char *EPFile, char *pFileBase);
+                         char *EPFile, char *pFileBase,
+                         bool WritePreambles=true);
+SNEQData *CloneSNEQData(SNEQData *SNEQD);
 
 /*--------------------------------------------------------------*/
 /*- in GetFlux.cc ----------------------------------------------*/
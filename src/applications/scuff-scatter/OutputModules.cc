@@ -39,37 +39,50 @@
 
 /***************************************************************/
 /* compute scattered and total fields at a user-specified list */
-/* of evaluation points                                        */
+/* of evaluation points for all incident fields at once, using */
+/* the KN vectors stored as the columns of SSD->KNMatrix.      */
+/*                                                             */
+/* *pPlan is the field-evaluation plan for this EP file in the */
+/* current geometrical configuration; it is created on the     */
+/* first call and reused at all subsequent frequencies.        */
 /***************************************************************/
-void ProcessEPFile(SSData *SSD, char *EPFileName)
+void ProcessEPFile(SSData *SSD, char *EPFileName, FieldEvaluationPlan **pPlan)
 { 
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   RWGGeometry *G  = SSD->G;
-  IncField *IF    = SSD->IF;
-  HVector  *KN    = SSD->KN;
+  IncField **IFs  = SSD->IFList->IFs;
+  int NumIFs      = SSD->IFList->NumIFs;
   cdouble  Omega  = SSD->Omega;
   double *kBloch  = SSD->kBloch;
   char *FileBase  = SSD->FileBase;
 
   /*--------------------------------------------------------------*/
-  /*- try to read eval points from file --------------------------*/
+  /*- try to read eval points from file and set up the plan ------*/
   /*--------------------------------------------------------------*/
-  HMatrix *XMatrix=new HMatrix(EPFileName,LHM_TEXT,"-ncol 3");
-  if (XMatrix->ErrMsg)
-   { fprintf(stderr,"Error processing EP file: %s\n",XMatrix->ErrMsg);
+  if (*pPlan==0)
+   { HMatrix *XMatrix=new HMatrix(EPFileName,LHM_TEXT,"-ncol 3");
+     if (XMatrix->ErrMsg)
+      { fprintf(stderr,"Error processing EP file: %s\n",XMatrix->ErrMsg);
+        delete XMatrix;
+        return;
+      };
+     *pPlan = new FieldEvaluationPlan(G, XMatrix);
      delete XMatrix;
-     return;
    };
+  FieldEvaluationPlan *Plan = *pPlan;
+  HMatrix *XMatrix = Plan->XMatrix;
 
   /*--------------------------------------------------------------*/
-  /*- get components of scattered and incident fields            -*/
+  /*- get components of scattered fields for all incident fields: */
+  /*- column 6*nIF + Mu of SFMatrix is the Muth component of the  */
+  /*- scattered field due to incident field #nIF                  */
   /*--------------------------------------------------------------*/
   Log("Evaluating fields at points in file %s...",EPFileName);
 
-  HMatrix *SFMatrix = G->GetFields( 0, KN, Omega, kBloch, XMatrix); // scattered
-  HMatrix *IFMatrix = G->GetFields(IF,  0, Omega, kBloch, XMatrix); // incident
+  HMatrix *SFMatrix = Plan->Apply(SSD->KNMatrix, Omega, kBloch);
+  Plan->ReleaseRFMatrix();
 
   /*--------------------------------------------------------------*/
   /*- create .scattered and .total output files and write fields -*/
@@ -78,48 +91,53 @@ void ProcessEPFile(SSData *SSD, char *EPFileName)
   char OmegaStr[100];
   snprintf(OmegaStr,100,"%s",z2s(Omega));
   char *TransformLabel=SSD->TransformLabel;
-  char *IFLabel=SSD->IFLabel;
   const char *Ext[2]={"scattered","total"};
   for(int ST=0; ST<2; ST++)
    { char OutFileName[MAXSTR];
      snprintf(OutFileName,MAXSTR,"%s.%s.%s",FileBase,GetFileBase(EPFileName),Ext[ST]);
      FILE *f=fopen(OutFileName,"a");
-     fprintf(f,"# scuff-scatter run on %s (%s)\n",GetHostName(),GetTimeString());
-     fprintf(f,"# columns: \n");
-     fprintf(f,"# 1,2,3   x,y,z (evaluation point coordinates)\n");
-     fprintf(f,"# 4       omega (angular frequency)\n");
-     int nc=5;
-     if (TransformLabel)
-      fprintf(f,"# %i       geometrical transform\n",nc++);
-     if (IFLabel)
-      fprintf(f,"# %i       incident field\n",nc++);
-     fprintf(f,"# %02i,%02i   real, imag Ex\n",nc,nc+1); nc+=2;
-     fprintf(f,"# %02i,%02i   real, imag Ey\n",nc,nc+1); nc+=2;
-     fprintf(f,"# %02i,%02i   real, imag Ez\n",nc,nc+1); nc+=2;
-     fprintf(f,"# %02i,%02i   real, imag Hx\n",nc,nc+1); nc+=2;
-     fprintf(f,"# %02i,%02i   real, imag Hy\n",nc,nc+1); nc+=2;
-     fprintf(f,"# %02i,%02i   real, imag Hz\n",nc,nc+1); nc+=2;
-     for(int nr=0; nr<SFMatrix->NR; nr++)
-      { double X[3];
-        cdouble EH[6];
-        XMatrix->GetEntriesD(nr,":",X);
-        SFMatrix->GetEntries(nr,":",EH);
-        if (ST==1) 
-         for(int n=0; n<6; n++) 
-          EH[n]+=IFMatrix->GetEntry(nr,n);
-        fprintf(f,"%+.8e %+.8e %+.8e ",X[0],X[1],X[2]);
-        fprintf(f,"%s ",OmegaStr);
-        if (TransformLabel) fprintf(f,"%s ",TransformLabel);
-        if (IFLabel) fprintf(f,"%s ",IFLabel);
-        fprintf(f,"%s %s %s   ",CD2S(EH[0]),CD2S(EH[1]),CD2S(EH[2]));
-        fprintf(f,"%s %s %s\n", CD2S(EH[3]),CD2S(EH[4]),CD2S(EH[5]));
+     for(int nIF=0; nIF<NumIFs; nIF++)
+      { char *IFLabel = SSD->IFLabels ? SSD->IFLabels[nIF] : 0;
+        HMatrix *IFMatrix = 0;
+        if (ST==1)
+         IFMatrix = Plan->Apply((HVector *)0, Omega, kBloch, IFs[nIF]); // incident
+        fprintf(f,"# scuff-scatter run on %s (%s)\n",GetHostName(),GetTimeString());
+        fprintf(f,"# columns: \n");
+        fprintf(f,"# 1,2,3   x,y,z (evaluation point coordinates)\n");
+        fprintf(f,"# 4       omega (angular frequency)\n");
+        int nc=5;
+        if (TransformLabel)
+         fprintf(f,"# %i       geometrical transform\n",nc++);
+        if (IFLabel)
+         fprintf(f,"# %i       incident field\n",nc++);
+        fprintf(f,"# %02i,%02i   real, imag Ex\n",nc,nc+1); nc+=2;
+        fprintf(f,"# %02i,%02i   real, imag Ey\n",nc,nc+1); nc+=2;
+        fprintf(f,"# %02i,%02i   real, imag Ez\n",nc,nc+1); nc+=2;
+        fprintf(f,"# %02i,%02i   real, imag Hx\n",nc,nc+1); nc+=2;
+        fprintf(f,"# %02i,%02i   real, imag Hy\n",nc,nc+1); nc+=2;
+        fprintf(f,"# %02i,%02i   real, imag Hz\n",nc,nc+1); nc+=2;
+        for(int nr=0; nr<SFMatrix->NR; nr++)
+         { double X[3];
+           cdouble EH[6];
+           XMatrix->GetEntriesD(nr,":",X);
+           for(int n=0; n<6; n++) 
+            EH[n]=SFMatrix->GetEntry(nr,6*nIF+n);
+           if (ST==1) 
+            for(int n=0; n<6; n++) 
+             EH[n]+=IFMatrix->GetEntry(nr,n);
+           fprintf(f,"%+.8e %+.8e %+.8e ",X[0],X[1],X[2]);
+           fprintf(f,"%s ",OmegaStr);
+           if (TransformLabel) fprintf(f,"%s ",TransformLabel);
+           if (IFLabel) fprintf(f,"%s ",IFLabel);
+           fprintf(f,"%s %s %s   ",CD2S(EH[0]),CD2S(EH[1]),CD2S(EH[2]));
+           fprintf(f,"%s %s %s\n", CD2S(EH[3]),CD2S(EH[4]),CD2S(EH[5]));
+         };
+        if (IFMatrix) delete IFMatrix;
       };
      fclose(f);
    };
 
-  delete XMatrix;
   delete SFMatrix;
-  delete IFMatrix;
 
 }
 
@@ -115,6 +115,9 @@ int main(int argc, char *argv[])
   char *ReadCache[MAXCACHE];         int nReadCache;
   char *WriteCache=0;
   char *LogLevel=0;
+//
+  double ACATol=0.0;
+  double GMRESTol=1.0e-6;
   /* name               type    #args  max_instances  storage           count         description*/
   OptStruct OSArray[]=
    { 
@@ -169,6 +172,9 @@ int main(int argc, char *argv[])
      {"HDF5File",       PA_STRING,  1, 1,       (void *)&HDF5File,   0,             "name of HDF5 file for BEM matrix/vector export\n"},
 /**/
      {"LogLevel",       PA_STRING,  1, 1,       (void *)&LogLevel,   0,             "none | terse | verbose | verbose2\n"},
+/**/
+     {"ACATol",         PA_DOUBLE,  1, 1,       (void *)&ACATol,     0,             "use compressed BEM matrix with this ACA tolerance"},
+     {"GMRESTol",       PA_DOUBLE,  1, 1,       (void *)&GMRESTol,   0,             "relative residual for GMRES solves of compressed BEM system\n"},
 /**/
      {"Cache",          PA_STRING,  1, 1,       (void *)&Cache,      0,             "read/write cache"},
      {"ReadCache",      PA_STRING,  1, MAXCACHE,(void *)ReadCache,   &nReadCache,   "read cache"},
@@ -284,7 +290,7 @@ int main(int argc, char *argv[])
   SSData MySSData, *SSD=&MySSData;
 
   RWGGeometry *G      = SSD->G   = new RWGGeometry(GeoFile);
-  HMatrix *M          = SSD->M   = G->AllocateBEMMatrix();
+  HMatrix *M          = SSD->M   = ACATol>0.0 ? 0 : G->AllocateBEMMatrix();
   HVector *RHS        = SSD->RHS = G->AllocateRHSVector();
   HVector *KN         = SSD->KN  = G->AllocateRHSVector();
   double *kBloch      = SSD->kBloch = 0;
@@ -292,6 +298,14 @@ int main(int argc, char *argv[])
   SSD->TransformLabel = 0;
   SSD->IFLabel        = 0;
   SSD->FileBase       = FileBase;
+  SSD->IFList         = IFList;
+  SSD->IFLabels       = IFFile ? IFList->Labels : 0;
+  SSD->KNMatrix       = 0;
+  HMatrix *RHSMatrix  = 0;
+
+  // field-evaluation plans for each (transformation, EP file)
+  // pair, created on first use and reused at all frequencies
+  FieldEvaluationPlan **EPPlans = 0;
 
   if (LogLevel) G->SetLogLevel(LogLevel);
 
@@ -308,6 +322,17 @@ int main(int argc, char *argv[])
   if (ErrMsg)
    ErrExit("file %s: %s",TransFile,ErrMsg);
 
+  /*******************************************************************/
+  /* with --ACATol, the BEM matrix is stored in compressed form and  */
+  /* the BEM system is solved by GMRES instead of LU factorization   */
+  /*******************************************************************/
+  if (ACATol>0.0)
+   { if (G->LDim>0)
+      ErrExit("--ACATol is not supported for extended geometries");
+     if (HDF5File)
+      Warn("BEM matrix will not be exported to HDF5 file with --ACATol");
+   };
+
   /*******************************************************************/
   /* for periodic geometries, all incident field sources that are    */
   /* active at a given time must involve  single incident field      */
@@ -347,7 +372,7 @@ int main(int argc, char *argv[])
   /*******************************************************************/
   HMatrix **TBlocks=0, **UBlocks=0;
   int NS=G->NumSurfaces;
-  if (NumTransformations>1)
+  if (NumTransformations>1 && M)
    { int NADB = NS*(NS-1)/2; // number of above-diagonal blocks
      TBlocks  = (HMatrix **)mallocEC(NS*sizeof(HMatrix *));
      UBlocks  = (HMatrix **)mallocEC(NADB*sizeof(HMatrix *));
@@ -398,7 +423,9 @@ int main(int argc, char *argv[])
      /* matrix blocks at this frequency; otherwise just assemble the    */
      /* whole matrix                                                    */
      /*******************************************************************/
-     if (NumTransformations==1)
+     if (M==0)
+      ; // compressed BEM matrix is assembled below for each transformation
+     else if (NumTransformations==1)
       G->AssembleBEMMatrix(Omega, kBloch, M);
      else
       for(int ns=0; ns<G->NumSurfaces; ns++)
@@ -434,7 +461,7 @@ int main(int argc, char *argv[])
         /*******************************************************************/
         /* assemble and insert off-diagonal blocks as necessary ************/
         /*******************************************************************/
-        if (NumTransformations>1)
+        if (NumTransformations>1 && M)
          { for(int ns=0, nb=0; ns<G->NumSurfaces; ns++)
             for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
              G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, UBlocks[nb]);
@@ -453,7 +480,7 @@ int main(int argc, char *argv[])
         /*******************************************************************/
         /* export BEM matrix to a binary .hdf5 file if that was requested  */
         /*******************************************************************/
-        if (HDF5Context)
+        if (HDF5Context && M)
          M->ExportToHDF5(HDF5Context,"M_%s%s",OmegaStr,TransformStr);
 
         /*******************************************************************/
@@ -466,10 +493,44 @@ int main(int argc, char *argv[])
 
         /*******************************************************************/
         /* LU-factorize the BEM matrix to prepare for solving scattering   */
-        /* problems                                                        */
+        /* problems, or assemble the compressed BEM matrix if requested    */
         /*******************************************************************/
-        Log("  LU-factorizing BEM matrix...");
-        M->LUFactorize();
+        ACAMatrix *MC=0;
+        if (M==0)
+         MC=G->AssembleCompressedBEMMatrix(Omega, ACATol);
+        else
+         { Log("  LU-factorizing BEM matrix...");
+           M->LUFactorize();
+         };
+
+        /***************************************************************/
+        /* assemble the RHS vectors for all incident fields and solve  */
+        /* the BEM system for all of them at once                      */
+        /***************************************************************/
+        int NumIFs = IFList->NumIFs;
+        RHSMatrix = G->AssembleRHSVectors(Omega, kBloch, IFList->IFs, NumIFs, RHSMatrix);
+        if (SSD->KNMatrix==0)
+         SSD->KNMatrix = new HMatrix(RHSMatrix->NR, NumIFs, LHM_COMPLEX);
+        SSD->KNMatrix->Copy(RHSMatrix);
+        Log("  Solving the BEM system for %i incident fields...",NumIFs);
+        if (MC)
+         for(int nIF=0; nIF<NumIFs; nIF++)
+          { SSD->KNMatrix->GetEntries(":", nIF, KN->ZV);
+            MC->GMRESSolve(KN, GMRESTol);
+            SSD->KNMatrix->SetEntries(":", nIF, KN->ZV);
+          }
+        else
+         M->LUSolve(SSD->KNMatrix);
+
+        /*--------------------------------------------------------------*/
+        /*- scattered fields at user-specified points, computed for all */
+        /*- incident fields at once                                     */
+        /*--------------------------------------------------------------*/
+        if (nEPFiles>0 && EPPlans==0)
+         EPPlans = (FieldEvaluationPlan **)
+                    mallocEC(NumTransformations*nEPFiles*sizeof(EPPlans[0]));
+        for(int nepf=0; nepf<nEPFiles; nepf++)
+         ProcessEPFile(SSD, EPFiles[nepf], EPPlans + nt*nEPFiles + nepf);
 
         /***************************************************************/
         /* loop over incident fields                                   */
@@ -486,13 +547,10 @@ int main(int argc, char *argv[])
             snprintf(IFStr,100,"_%s",SSD->IFLabel);
    
            /***************************************************************/
-           /* assemble RHS vector and solve BEM system*********************/
+           /* extract the RHS and solution vectors for this incident field */
            /***************************************************************/
-           Log("  Assembling RHS vector...");
-           G->AssembleRHSVector(Omega, kBloch, IF, KN);
-           RHS->Copy(KN); // copy RHS vector for later 
-           Log("  Solving the BEM system...");
-           M->LUSolve(KN);
+           RHSMatrix->GetEntries(":", nIF, RHS->ZV);
+           SSD->KNMatrix->GetEntries(":", nIF, KN->ZV);
    
            if (HDF5Context)
             { RHS->ExportToHDF5(HDF5Context,"RHS_%s%s%s",OmegaStr,TransformStr,IFStr);
@@ -531,13 +589,6 @@ int main(int argc, char *argv[])
            if (PSDFile)
             WritePSDFile(SSD, PSDFile);
        
-           /*--------------------------------------------------------------*/
-           /*- scattered fields at user-specified points ------------------*/
-           /*--------------------------------------------------------------*/
-           int nepf;
-           for(nepf=0; nepf<nEPFiles; nepf++)
-            ProcessEPFile(SSD, EPFiles[nepf]);
-      
            /*--------------------------------------------------------------*/
            /*- induced dipole moments       -------------------------------*/
            /*--------------------------------------------------------------*/
@@ -562,6 +613,7 @@ int main(int argc, char *argv[])
         /*******************************************************************/
         /*******************************************************************/
         /*******************************************************************/
+        if (MC) delete MC;
         G->UnTransform();
 
       }; // for(int nt=0; nt<NumTransformations; nt++)
@@ -571,6 +623,10 @@ int main(int argc, char *argv[])
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
+  if (SSD->KNMatrix) delete SSD->KNMatrix;
+  if (RHSMatrix) delete RHSMatrix;
+  SSD->KNMatrix=0;
+
   if (HDF5Context)
    HMatrix::CloseHDF5Context(HDF5Context);
   printf("Thank you for your support.\n");
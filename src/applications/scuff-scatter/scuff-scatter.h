@@ -47,6 +47,12 @@ typedef struct SSData
    IncField *IF;
    char *TransformLabel, *IFLabel;
    char *FileBase;
+
+   // all incident fields at the current frequency, and the
+   // matrix whose columns are the corresponding KN vectors
+   IncFieldList *IFList;
+   char **IFLabels;
+   HMatrix *KNMatrix;
  } SSData;
  
 
@@ -58,7 +64,8 @@ void WritePFTFile(SSData *SSD, PFTOptions *PFTOpts, int Method,
                   bool PlotFlux, char *FileName);
 void WritePSDFile(SSData *SSD, char *PSDFile);
 void GetMoments(SSData *SSD, char *MomentFile);
-void ProcessEPFile(SSData *SSData, char *EPFileName);
+void ProcessEPFile(SSData *SSData, char *EPFileName,
+                   FieldEvaluationPlan **pPlan);
 void VisualizeFields(SSData *SSData, 
                      char *FVMesh, char *FVMeshTransFile, char *FuncList);
 
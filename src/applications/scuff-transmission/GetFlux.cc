@@ -72,21 +72,27 @@ double SCR9[]={
 /* through the planes at zAbove and zBelow by integrating the      */
 /* poynting vector over the area of the unit cell.                 */
 /*                                                                 */
+/* This is done for both incident polarizations at once: IFs[p]    */
+/* is the incident field for polarization p, and column p of       */
+/* KNMatrix is the corresponding solution vector. The fields at    */
+/* all cubature points on both planes, for both polarizations, are */
+/* obtained from a single call to the batched GetFields().         */
+/*                                                                 */
 /* Note: Flux values are normalized by the flux of an unit-strength*/
 /* plane wave in vacuum.                                           */
 /*                                                                 */
-/* Return values: Flux[0] = upward-traveling flux at ZAbove        */
-/*                Flux[1] = downward-traveling flux at ZBelow      */
+/* Return values: Flux[p][0] = upward-traveling flux at ZAbove     */
+/*                Flux[p][1] = downward-traveling flux at ZBelow   */
 /*                                                                 */
 /*******************************************************************/
-void GetFlux(RWGGeometry *G, IncField *IF, HVector *KN,
+void GetFlux(RWGGeometry *G, IncField *IFs[NUMPOLS], HMatrix *KNMatrix,
              cdouble Omega, double *kBloch, int NQPoints,
              double ZAbove, double ZBelow, bool FromAbove,
              PlaneWave *ReflectedPW[NUMPOLS], 
-             PlaneWave *TransmittedPW[2],
-             double *Flux,
-             cdouble tIntegral[NUMPOLS],
-             cdouble rIntegral[NUMPOLS])
+             PlaneWave *TransmittedPW[NUMPOLS],
+             double Flux[NUMPOLS][NUMREGIONS],
+             cdouble tIntegral[NUMPOLS][NUMPOLS],
+             cdouble rIntegral[NUMPOLS][NUMPOLS])
              
 {
   double *SCR=SCR9;
@@ -103,64 +109,48 @@ void GetFlux(RWGGeometry *G, IncField *IF, HVector *KN,
   /***************************************************************/
   /* on the first invocation we allocate space for the matrices  */
   /* of evaluation points and fields.                            */
+  /* the first NCP points are for the upper surface; the next    */
+  /* NCP points are for the lower surface.                       */
   /***************************************************************/
-  static HMatrix *XMatrixAbove = 0, *XMatrixBelow = 0;
-  static HMatrix *FMatrixAbove = 0, *FMatrixBelow = 0;
-  if (XMatrixAbove==0)
-   { XMatrixAbove = new HMatrix(NCP, 3 );
-     XMatrixBelow = new HMatrix(NCP, 3 );
-     FMatrixAbove = new HMatrix(NCP, 6, LHM_COMPLEX);
-     FMatrixBelow = new HMatrix(NCP, 6, LHM_COMPLEX);
+  static HMatrix *XMatrix = 0, *FMatrix = 0;
+  if (XMatrix==0)
+   { XMatrix = new HMatrix(2*NCP, 3 );
+     FMatrix = new HMatrix(2*NCP, 6*NUMPOLS, LHM_COMPLEX);
    };
 
   /***************************************************************/
   /* fill in coordinates of evaluation points.                   */
-  /* the first NCP points are for the upper surface; the next    */
-  /* NCP points are for the lower surface.                       */
   /***************************************************************/
   double x, y, LBV[2][3];
   for(int nd=0; nd<2; nd++)
    for(int nc=0; nc<3; nc++)
     LBV[nd][nc] = G->LBasis->GetEntryD(nc,nd);
-  if (NQPoints==0)
-   { for(int ncp=0; ncp<NCP; ncp++)
-      { 
-        x=SCR[3*ncp+0];
+  double Delta = (NQPoints==0) ? 0.0 : 1.0 / ( (double)NQPoints );
+  for(int ncp=0; ncp<NCP; ncp++)
+   { 
+     if (NQPoints==0)
+      { x=SCR[3*ncp+0];
         y=SCR[3*ncp+1];
+      }
+     else
+      { x = ((double)(ncp/NQPoints) + 0.5)*Delta;
+        y = ((double)(ncp%NQPoints) + 0.5)*Delta;
+      };
 
-        XMatrixAbove->SetEntry(ncp, 0, x*LBV[0][0] + y*LBV[1][0]);
-        XMatrixAbove->SetEntry(ncp, 1, x*LBV[0][1] + y*LBV[1][1]);
-        XMatrixAbove->SetEntry(ncp, 2, ZAbove);
-
-        XMatrixBelow->SetEntry(ncp, 0, x*LBV[0][0] + y*LBV[1][0]);
-        XMatrixBelow->SetEntry(ncp, 1, x*LBV[0][1] + y*LBV[1][1]);
-        XMatrixBelow->SetEntry(ncp, 2, ZBelow);
+     XMatrix->SetEntry(ncp, 0, x*LBV[0][0] + y*LBV[1][0]);
+     XMatrix->SetEntry(ncp, 1, x*LBV[0][1] + y*LBV[1][1]);
+     XMatrix->SetEntry(ncp, 2, ZAbove);
 
-      };
-   }
-  else
-   { double Delta = 1.0 / ( (double)NQPoints );
-     for(int nqpx=0, ncp=0; nqpx<NQPoints; nqpx++)
-      for(int nqpy=0; nqpy<NQPoints; nqpy++, ncp++)
-       { 
-         x = ((double)nqpx + 0.5)*Delta;
-         y = ((double)nqpy + 0.5)*Delta;
-
-         XMatrixAbove->SetEntry(ncp, 0, x*LBV[0][0] + y*LBV[1][0]);
-         XMatrixAbove->SetEntry(ncp, 1, x*LBV[0][1] + y*LBV[1][1]);
-         XMatrixAbove->SetEntry(ncp, 2, ZAbove);
-
-         XMatrixBelow->SetEntry(ncp, 0, x*LBV[0][0] + y*LBV[1][0]);
-         XMatrixBelow->SetEntry(ncp, 1, x*LBV[0][1] + y*LBV[1][1]);
-         XMatrixBelow->SetEntry(ncp, 2, ZBelow);
-       };
+     XMatrix->SetEntry(NCP+ncp, 0, x*LBV[0][0] + y*LBV[1][0]);
+     XMatrix->SetEntry(NCP+ncp, 1, x*LBV[0][1] + y*LBV[1][1]);
+     XMatrix->SetEntry(NCP+ncp, 2, ZBelow);
    };
 
   /***************************************************************/
-  /* get scattered fields at all cubature points                 */
+  /* get total fields at all cubature points for both            */
+  /* polarizations                                               */
   /***************************************************************/
-  G->GetFields(IF, KN, Omega, kBloch, XMatrixAbove, FMatrixAbove);
-  G->GetFields(IF, KN, Omega, kBloch, XMatrixBelow, FMatrixBelow);
+  G->GetFields(IFs, KNMatrix, Omega, kBloch, XMatrix, FMatrix);
 
   /***************************************************************/
   /* integrate poynting vector over upper and lower surfaces.    */
@@ -169,72 +159,72 @@ void GetFlux(RWGGeometry *G, IncField *IF, HVector *KN,
   /*       dividing the integrated power by the unit-cell area,  */
   /*       which is what we want to do anyway.                   */
   /***************************************************************/
-  double PAbove=0.0, PBelow=0.0;
-  cdouble rDenominator[2]={0.0, 0.0};
-  cdouble tDenominator[2]={0.0, 0.0};
-  tIntegral[0]=tIntegral[1]=rIntegral[0]=rIntegral[1]=0.0;
-  for(int ncp=0; ncp<NCP; ncp++)
-   {
-     double w;
-     if (NQPoints==0) 
-      w=SCR[3*ncp+2];  // cubature weight
-     else
-      w=1.0/((double)(NCP));
-
-     cdouble Ex, Ey, Hx, Hy;
-     Ex=FMatrixAbove->GetEntry(ncp, 0);
-     Ey=FMatrixAbove->GetEntry(ncp, 1);
-     Hx=FMatrixAbove->GetEntry(ncp, 3);
-     Hy=FMatrixAbove->GetEntry(ncp, 4);
-     PAbove += 0.5*w*real( Ex*conj(Hy) - Ey*conj(Hx) );
-
-     Ex=FMatrixBelow->GetEntry(ncp, 0);
-     Ey=FMatrixBelow->GetEntry(ncp, 1);
-     Hx=FMatrixBelow->GetEntry(ncp, 3);
-     Hy=FMatrixBelow->GetEntry(ncp, 4);
-     PBelow -= 0.5*w*real( Ex*conj(Hy) - Ey*conj(Hx) );
-
-     double XSource[3],  XDest[3];
-     cdouble EHSource[6], EHDest[6];
-     cdouble EHTE[6], EHTM[6];
-
-     if (FromAbove)
-      { XMatrixAbove->GetEntriesD(ncp,"0:2",XSource);
-        FMatrixAbove->GetEntries(ncp,"0:5",EHSource);
-        XMatrixBelow->GetEntriesD(ncp,"0:2",XDest);
-        FMatrixBelow->GetEntries(ncp,"0:5",EHDest);
-      }
-     else
-      { XMatrixBelow->GetEntriesD(ncp,"0:2",XSource);
-        FMatrixBelow->GetEntries(ncp,"0:5",EHSource);
-        XMatrixAbove->GetEntriesD(ncp,"0:2",XDest);
-        FMatrixAbove->GetEntries(ncp,"0:5",EHDest);
+  for(int IncPol=0; IncPol<NUMPOLS; IncPol++)
+   { 
+     int Col=6*IncPol;
+     double PAbove=0.0, PBelow=0.0;
+     cdouble rDenominator[2]={0.0, 0.0};
+     cdouble tDenominator[2]={0.0, 0.0};
+     cdouble *tInt=tIntegral[IncPol], *rInt=rIntegral[IncPol];
+     tInt[0]=tInt[1]=rInt[0]=rInt[1]=0.0;
+     for(int ncp=0; ncp<NCP; ncp++)
+      {
+        double w;
+        if (NQPoints==0) 
+         w=SCR[3*ncp+2];  // cubature weight
+        else
+         w=1.0/((double)(NCP));
+
+        cdouble Ex, Ey, Hx, Hy;
+        Ex=FMatrix->GetEntry(ncp, Col+0);
+        Ey=FMatrix->GetEntry(ncp, Col+1);
+        Hx=FMatrix->GetEntry(ncp, Col+3);
+        Hy=FMatrix->GetEntry(ncp, Col+4);
+        PAbove += 0.5*w*real( Ex*conj(Hy) - Ey*conj(Hx) );
+
+        Ex=FMatrix->GetEntry(NCP+ncp, Col+0);
+        Ey=FMatrix->GetEntry(NCP+ncp, Col+1);
+        Hx=FMatrix->GetEntry(NCP+ncp, Col+3);
+        Hy=FMatrix->GetEntry(NCP+ncp, Col+4);
+        PBelow -= 0.5*w*real( Ex*conj(Hy) - Ey*conj(Hx) );
+
+        int nSource = FromAbove ? ncp     : NCP+ncp;
+        int nDest   = FromAbove ? NCP+ncp : ncp;
+        double XSource[3],  XDest[3];
+        cdouble EHSource[6], EHDest[6];
+        cdouble EHTE[6], EHTM[6];
+        XMatrix->GetEntriesD(nSource,"0:2",XSource);
+        XMatrix->GetEntriesD(nDest,"0:2",XDest);
+        for(int Mu=0; Mu<6; Mu++)
+         { EHSource[Mu] = FMatrix->GetEntry(nSource, Col+Mu);
+           EHDest[Mu]   = FMatrix->GetEntry(nDest,   Col+Mu);
+         };
+         
+        ReflectedPW[POL_TE]->GetFields(XSource, EHTE);
+        ReflectedPW[POL_TM]->GetFields(XSource, EHTM);
+        rInt[POL_TE]         += w*VecHDot(EHSource,  EHTE, 3);
+        rInt[POL_TM]         += w*VecHDot(EHSource,  EHTM, 3);
+        rDenominator[POL_TE] += w*VecHDot(EHTE, EHTE, 3);
+        rDenominator[POL_TM] += w*VecHDot(EHTM, EHTM, 3);
+         
+        TransmittedPW[POL_TE]->GetFields(XDest, EHTE);
+        TransmittedPW[POL_TM]->GetFields(XDest, EHTM);
+        tInt[POL_TE]         += w*VecHDot(EHDest,  EHTE, 3);
+        tInt[POL_TM]         += w*VecHDot(EHDest,  EHTM, 3);
+        tDenominator[POL_TE] += w*VecHDot(EHTE, EHTE, 3);
+        tDenominator[POL_TM] += w*VecHDot(EHTM, EHTM, 3);
+
       };
-      
-     ReflectedPW[POL_TE]->GetFields(XSource, EHTE);
-     ReflectedPW[POL_TM]->GetFields(XSource, EHTM);
-     rIntegral[POL_TE]    += w*VecHDot(EHSource,  EHTE, 3);
-     rIntegral[POL_TM]    += w*VecHDot(EHSource,  EHTM, 3);
-     rDenominator[POL_TE] += w*VecHDot(EHTE, EHTE, 3);
-     rDenominator[POL_TM] += w*VecHDot(EHTM, EHTM, 3);
-      
-     TransmittedPW[POL_TE]->GetFields(XDest, EHTE);
-     TransmittedPW[POL_TM]->GetFields(XDest, EHTM);
-     tIntegral[POL_TE]    += w*VecHDot(EHDest,  EHTE, 3);
-     tIntegral[POL_TM]    += w*VecHDot(EHDest,  EHTM, 3);
-     tDenominator[POL_TE] += w*VecHDot(EHTE, EHTE, 3);
-     tDenominator[POL_TM] += w*VecHDot(EHTM, EHTM, 3);
 
+     /***************************************************************/
+     /***************************************************************/
+     /***************************************************************/
+     Flux[IncPol][REGION_UPPER]=PAbove / PWFLUX;
+     Flux[IncPol][REGION_LOWER]=PBelow / PWFLUX;
+     rInt[POL_TE] /= rDenominator[POL_TE];
+     rInt[POL_TM] /= rDenominator[POL_TM];
+     tInt[POL_TE] /= tDenominator[POL_TE];
+     tInt[POL_TM] /= tDenominator[POL_TM];
    };
 
-  /***************************************************************/
-  /***************************************************************/
-  /***************************************************************/
-  Flux[0]=PAbove / PWFLUX;
-  Flux[1]=PBelow / PWFLUX;
-  rIntegral[POL_TE] /= rDenominator[POL_TE];
-  rIntegral[POL_TM] /= rDenominator[POL_TM];
-  tIntegral[POL_TE] /= tDenominator[POL_TE];
-  tIntegral[POL_TM] /= tDenominator[POL_TM];
-
 }
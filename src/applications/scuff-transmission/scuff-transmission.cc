@@ -204,6 +204,9 @@ int main(int argc, char *argv[])
   char *ReadCache[MAXCACHE];         int nReadCache;
   char *WriteCache=0;
   bool FromAbove=false;
+  char *WorkDir=0;
+  bool Worker=false;
+  double LeaseTimeout=FS_DEFAULT_LEASE_TIMEOUT;
   /* name        type    #args  max_instances  storage    count  description*/
   OptStruct OSArray[]=
    { {"geometry",    PA_STRING,  1, 1,       (void *)&GeoFileName,  0,       ".scuffgeo file"},
@@ -231,6 +234,10 @@ int main(int argc, char *argv[])
      {"WriteCache",  PA_STRING,  1, 1,       (void *)&WriteCache,   0,             "write cache"},
 /**/
      {"FromAbove",   PA_BOOL,    0, 1,       (void *)&FromAbove,    0,       "plane wave impinges from above"},
+/**/
+     {"WorkDir",     PA_STRING,  1, 1,       (void *)&WorkDir,      0,       "share frequencies with other processes via this directory"},
+     {"Worker",      PA_BOOL,    0, 1,       (void *)&Worker,       0,       "with --WorkDir: run as worker, not coordinator"},
+     {"LeaseTimeout",PA_DOUBLE,  1, 1,       (void *)&LeaseTimeout, 0,       "with --WorkDir: reassign frequencies whose lease is not renewed for this many seconds (0 = same host only)"},
      {0,0,0,0,0,0,0}
    };
   ProcessOptions(argc, argv, OSArray);
@@ -242,6 +249,8 @@ int main(int argc, char *argv[])
    OSUsage(argv[0], OSArray, "--geometry option is mandatory");
   if (!FileBase)
    FileBase=vstrdup(GetFileBase(GeoFileName));
+  if ( Worker && !WorkDir )
+   OSUsage(argv[0], OSArray, "--Worker requires --WorkDir");
   SetLogFileName("%s.log",FileBase);
   Log("scuff-transmission running on %s",GetHostName());
   
@@ -319,10 +328,13 @@ int main(int argc, char *argv[])
   /*******************************************************************/
   cdouble E0[3]={1.0, 0.0, 0.0};
   double nHat[3]={0.0, 0.0, 1.0};
-  PlaneWave PW(E0, nHat, G->RegionLabels[SourceRegionIndex]);
+  PlaneWave *PW[NUMPOLS];
+  for(int np=0; np<NUMPOLS; np++)
+   PW[np] = new PlaneWave(E0, nHat, G->RegionLabels[SourceRegionIndex]);
 
   HMatrix *M   = G->AllocateBEMMatrix();
   HVector *KN  = G->AllocateRHSVector();
+  HMatrix *KNMatrix = new HMatrix(G->TotalBFs, NUMPOLS, LHM_COMPLEX);
 
   PlaneWave *IncidentPW[2];
   PlaneWave *ReflectedPW[2];
@@ -336,17 +348,35 @@ int main(int argc, char *argv[])
   /*******************************************************************/
   /* set up output files *********************************************/
   /*******************************************************************/
-  FILE *f;
+  FILE *fTrans=0;
   if (!FileBase)
    FileBase=GetFileBase(GeoFileName);
-  f=vfopen("%s.transmission","a",FileBase);
-  if (!f) ErrExit("could not open file %s",f);
-  WriteFilePreamble(f);
+  char *OutFileName=vstrdup("%s.transmission",FileBase);
+  if (!Worker)
+   { fTrans=fopen(OutFileName,"a");
+     if (!fTrans) ErrExit("could not open file %s",OutFileName);
+     WriteFilePreamble(fTrans);
+   };
+
+  /*******************************************************************/
+  /* with --WorkDir, frequencies are shared with all other processes */
+  /* started with the same --WorkDir, and output lines are written   */
+  /* to the .transmission file by the process without --Worker once  */
+  /* all frequencies up to that one are done                         */
+  /*******************************************************************/
+  FrequencyScheduler *FS=0;
+  if (WorkDir)
+   { FS=new FrequencyScheduler(OmegaVector->N, 1);
+     FS->SetWorkDir(WorkDir, !Worker, LeaseTimeout);
+     if (fTrans) fclose(fTrans);
+     fTrans=0;
+   };
 
   /*******************************************************************/
   /* loop over frequencies and incident angles   *********************/
   /*******************************************************************/
-  for(int nOmega=0; nOmega<OmegaVector->N; nOmega++)
+  int nOmega = FS ? FS->ClaimPoint() : 0;
+  for(; nOmega!=-1 && nOmega<OmegaVector->N; nOmega = FS ? FS->ClaimPoint() : nOmega+1)
    for(int nTheta=0; nTheta<ThetaVector->N; nTheta++)
     { 
       /*--------------------------------------------------------------*/
@@ -382,33 +412,36 @@ int main(int argc, char *argv[])
       nHat[0] = SinTheta;
       nHat[1] = 0.0;
       nHat[2] = FromAbove ? -CosTheta : CosTheta;
-      PW.SetnHat(nHat);
       double EpsTE[3]={0.0, 1.0, 0.0}, EpsTM[3], *EpsVectors[2]={EpsTE, EpsTM};
       VecCross(EpsTE, nHat, EpsTM);
 
       /*--------------------------------------------------------------*/
-      /*- loop over the two polarizations of the incident field       */
+      /*- assemble RHS vectors for the two polarizations of the       */
+      /*- incident field and solve for both at once                   */
       /*--------------------------------------------------------------*/
-      double UpperFluxRatio[NUMPOLS], LowerFluxRatio[NUMPOLS];
+      IncField *PolPW[NUMPOLS];
+      for(int IncPol = POL_TE; IncPol<=POL_TM; IncPol++)
+       { E0[0]=EpsVectors[IncPol][0];
+         E0[1]=EpsVectors[IncPol][1];
+         E0[2]=EpsVectors[IncPol][2];
+         PW[IncPol]->SetnHat(nHat);
+         PW[IncPol]->SetE0(E0);
+         PolPW[IncPol]=PW[IncPol];
+       };
+      G->AssembleRHSVectors(Omega, kBloch, PolPW, NUMPOLS, KNMatrix);
+      M->LUSolve(KNMatrix);
+
+      double Flux[NUMPOLS][NUMREGIONS];
       cdouble UpperAmplitude[NUMPOLS][NUMPOLS], LowerAmplitude[NUMPOLS][NUMPOLS];
       cdouble tIntegral[NUMPOLS][NUMPOLS], rIntegral[NUMPOLS][NUMPOLS];
+      GetFlux(G, PolPW, KNMatrix, Omega, kBloch, NQPoints, 
+              ZAbove, ZBelow, FromAbove,
+              ReflectedPW, TransmittedPW, 
+              Flux, tIntegral, rIntegral);
       
       for(int IncPol = POL_TE; IncPol<=POL_TM; IncPol++)
        { 
-         E0[0]=EpsVectors[IncPol][0];
-         E0[1]=EpsVectors[IncPol][1];
-         E0[2]=EpsVectors[IncPol][2];
-         PW.SetE0(E0);
-         G->AssembleRHSVector(Omega, kBloch, &PW, KN);
-         M->LUSolve(KN);
-
-         double Flux[NUMREGIONS];
-         GetFlux(G, &PW, KN, Omega, kBloch, NQPoints, 
-                 ZAbove, ZBelow, FromAbove,
-                 ReflectedPW, TransmittedPW, 
-                 Flux, tIntegral[IncPol], rIntegral[IncPol]);
-         UpperFluxRatio[IncPol] = Flux[REGION_UPPER];
-         LowerFluxRatio[IncPol] = Flux[REGION_LOWER];
+         KNMatrix->GetEntries(":", IncPol, KN->ZV);
 
          cdouble aTETM[2];
          GetPlaneWaveAmplitudes(G, KN, Omega, kBloch, UpperRegionIndex, true, aTETM, true);
@@ -421,10 +454,11 @@ int main(int argc, char *argv[])
        };
 
       // write results to file
+      FILE *f = FS ? FS->OpenOutput(nOmega, OutFileName) : fTrans;
       fprintf(f,"%s %e ", z2s(Omega), Theta*RAD2DEG);
 
-      fprintf(f,"%e %e ", UpperFluxRatio[POL_TE], LowerFluxRatio[POL_TE]);
-      fprintf(f,"%e %e ", UpperFluxRatio[POL_TM], LowerFluxRatio[POL_TM]);
+      fprintf(f,"%e %e ", Flux[POL_TE][REGION_UPPER], Flux[POL_TE][REGION_LOWER]);
+      fprintf(f,"%e %e ", Flux[POL_TM][REGION_UPPER], Flux[POL_TM][REGION_LOWER]);
 
       fprintf(f,"%e %e ", abs(UpperAmplitude[POL_TE][POL_TE]), arg(UpperAmplitude[POL_TE][POL_TE]));
       fprintf(f,"%e %e ", abs(UpperAmplitude[POL_TE][POL_TM]), arg(UpperAmplitude[POL_TE][POL_TM]));
@@ -447,8 +481,11 @@ int main(int argc, char *argv[])
       fprintf(f,"\n");
       fflush(f);
 
+      if (FS && nTheta==ThetaVector->N-1)
+       FS->FinishPoint(nOmega);
+
    }; 
-  fclose(f);
+  if (fTrans) fclose(fTrans);
 
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
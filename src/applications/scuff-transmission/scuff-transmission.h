@@ -29,6 +29,7 @@
 #include <libhrutil.h>
 #include <libhmat.h>
 #include <libscuff.h>
+#include <libscuffInternals.h>
 
 using namespace scuff;
 
@@ -43,11 +44,13 @@ using namespace scuff;
 #define NUMREGIONS   2
 
 // in GetFlux.cc
-void GetFlux(RWGGeometry *G, IncField *IF, HVector *KN,
+void GetFlux(RWGGeometry *G, IncField *IFs[NUMPOLS], HMatrix *KNMatrix,
              cdouble Omega, double *kBloch, int NQPoints,
              double ZAbove, double ZBelow, bool FromAbove,
-             PlaneWave *ReflectedPW[2], PlaneWave *TransmittedPW[2],
-             double *Flux, cdouble tIntegral[2], cdouble rIntegral[2]);
+             PlaneWave *ReflectedPW[NUMPOLS], PlaneWave *TransmittedPW[NUMPOLS],
+             double Flux[NUMPOLS][NUMREGIONS],
+             cdouble tIntegral[NUMPOLS][NUMPOLS],
+             cdouble rIntegral[NUMPOLS][NUMPOLS]);
              
 
 // in GetAmplitudes.cc
@@ -152,3 +152,32 @@ bool FindInterval(double X, double *XPoints, int N, double XMin, double DX,
   return Inside;
 
 }
+
+/***************************************************************/
+/* like FindInterval, but on entry *pn is a guess for the      */
+/* interval, typically the interval found for the previous     */
+/* point in a batch of nearby points. on nonuniform grids we   */
+/* try the guess and its two neighbors before resorting to the */
+/* binary search; on uniform grids the lookup is O(1) anyway   */
+/* and the guess is ignored.                                   */
+/***************************************************************/
+bool FindIntervalNear(double X, double *XPoints, int N, double XMin, double DX,
+                      int *pn, double *pXBar)
+{
+  int n=*pn;
+  if ( XPoints && 0<=n && n<=N-2 )
+   { 
+     if ( X<XPoints[n] && n>0 && X>=XPoints[n-1] )
+      n--;
+     else if ( X>=XPoints[n+1] && n<N-3 && X<XPoints[n+2] )
+      n++;
+
+     if ( XPoints[n]<=X && X<XPoints[n+1] )
+      { *pn=n;
+        *pXBar = (X - XPoints[n]) / (XPoints[n+1]-XPoints[n]);
+        return true;
+      };
+   };
+
+  return FindInterval(X, XPoints, N, XMin, DX, pn, pXBar);
+}
@@ -697,3 +697,26 @@ double Interp1D::Evaluate(double X)
   delete[] Phi;
   return Phi0;
 }
+
+/****************************************************************/
+/* batched version of Evaluate(); see the comments above        */
+/* Interp3D::EvaluateMany                                       */
+/****************************************************************/
+void Interp1D::EvaluateMany(const double *X, int NX, double *Phi)
+{
+  int n=0;
+  for(int nx=0; nx<NX; nx++, Phi+=nFun)
+   { 
+     double XBar;
+     FindIntervalNear(X[nx], XPoints, N, XMin, DX, &n, &XBar);
+
+     double XPowers[4];
+     XPowers[0]=1.0;
+     for(int p=1; p<4; p++)
+      XPowers[p]=XPowers[p-1]*XBar;
+
+     double *C=CTable + GetCTableOffset(0, nFun, n);
+     for(int nf=0; nf<nFun; nf++, C+=NCOEFF)
+      Phi[nf] = (C[0]*XPowers[0] + C[1]*XPowers[1]) + (C[2]*XPowers[2] + C[3]*XPowers[3]);
+   };
+}
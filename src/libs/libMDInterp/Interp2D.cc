@@ -413,52 +413,58 @@ void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData)
    /*--------------------------------------------------------------*/
    /*- now go through and solve a linear system for each grid      */
    /*- cell to compute the coefficients of the interpolating       */
-   /*- polynomial in that cell                                     */
+   /*- polynomial in that cell. the cells are independent and      */
+   /*- share only the factorized matrix M, so they are farmed out  */
+   /*- to the same threads that computed the grid-point data.      */
    /*--------------------------------------------------------------*/
-   // int nPoints=0, TotalPoints=(N1-1)*(N2-1), pc;
-   int n1, dn1, n2, dn2;
-   int nf;
-   double *P;
-   HVector *C = new HVector(NCOEFF);
-
    if (LogLevel>=LMDI_LOGLEVEL_VERBOSE)
     Log("Computing coefficients of interpolating polynomials...");
-   for(n1=0; n1<(N1-1); n1++)
-    for(n2=0; n2<(N2-1); n2++)
-     { 
-       if (X1Points)
-        { DX1=X1Points[n1+1]-X1Points[n1];
-          DX2=X2Points[n2+1]-X2Points[n2];
-        };
-
-       /* separately compute interpolation coefficients for each function  */
-       for(nf=0; nf<nFun; nf++)
-        { 
-          /* construct the RHS vector by extracting from PhiVDTable the 4 data */
-          /* values for each of the 4 corners of this grid cell.               */
-          for(ncp=0, dn1=0; dn1<=1; dn1++)
-           for(dn2=0; dn2<=1; dn2++, ncp++)
-            { P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2);
-              C->SetEntry( NDATA*ncp + 0, P[0]);
-              C->SetEntry( NDATA*ncp + 1, DX1*P[1]);
-              C->SetEntry( NDATA*ncp + 2, DX2*P[2]);
-              C->SetEntry( NDATA*ncp + 3, DX1*DX2*P[3]);
-            };
-
-          /* solve the 16x16 system */
-          M->LUSolve(C);
-
-          /* store the coefficients in the appropriate place in CTable */
-          P=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2);
-          memcpy(P, C->DV, NCOEFF*sizeof(double));
-        };
+   int NumCells=(N1-1)*(N2-1);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,16), num_threads(nThread)
+#endif
+   for(int nc=0; nc<NumCells; nc++)
+    { 
+      int n2 = nc%(N2-1);
+      int n1 = nc/(N2-1);
 
-     };
+      double L1=DX1, L2=DX2;
+      if (X1Points)
+       { L1=X1Points[n1+1]-X1Points[n1];
+         L2=X2Points[n2+1]-X2Points[n2];
+       };
+
+      double CBuffer[NCOEFF];
+      HVector C(NCOEFF, LHM_REAL, CBuffer);
+
+      /* separately compute interpolation coefficients for each function  */
+      for(int nf=0; nf<nFun; nf++)
+       { 
+         /* construct the RHS vector by extracting from PhiVDTable the 4 data */
+         /* values for each of the 4 corners of this grid cell.               */
+         int nCorner=0;
+         for(int dn1=0; dn1<=1; dn1++)
+          for(int dn2=0; dn2<=1; dn2++, nCorner++)
+           { double *P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2);
+             C.SetEntry( NDATA*nCorner + 0, P[0]);
+             C.SetEntry( NDATA*nCorner + 1, L1*P[1]);
+             C.SetEntry( NDATA*nCorner + 2, L2*P[2]);
+             C.SetEntry( NDATA*nCorner + 3, L1*L2*P[3]);
+           };
+
+         /* solve the 16x16 system */
+         M->LUSolve(&C);
+
+         /* store the coefficients in the appropriate place in CTable */
+         double *P=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2);
+         memcpy(P, CBuffer, NCOEFF*sizeof(double));
+       };
+
+    };
 
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
-   delete C;
    delete M;
    free(PhiVDTable);
    if (LogLevel>=LMDI_LOGLEVEL_VERBOSE)
@@ -811,3 +817,89 @@ void Interp2D::EvaluatePlusPlus(double X1, double X2, double *Phi)
    };
 
 }
+
+/****************************************************************/
+/* batched version of Evaluate(); see the comments above        */
+/* Interp3D::EvaluateMany                                       */
+/****************************************************************/
+void Interp2D::EvaluateMany(const double *X, int NX, double *Phi)
+{
+  int n1=0, n2=0;
+  for(int nx=0; nx<NX; nx++, X+=2, Phi+=nFun)
+   { 
+     double X1Bar, X2Bar;
+     FindIntervalNear(X[0], X1Points, N1, X1Min, DX1, &n1, &X1Bar);
+     FindIntervalNear(X[1], X2Points, N2, X2Min, DX2, &n2, &X2Bar);
+
+     double X1Powers[4], X2Powers[4];
+     X1Powers[0]=X2Powers[0]=1.0;
+     for(int np=1; np<4; np++)
+      { X1Powers[np]=X1Powers[np-1]*X1Bar;
+        X2Powers[np]=X2Powers[np-1]*X2Bar;
+      };
+
+     double MV[NCOEFF];
+     for(int nm=0, p=0; p<4; p++)
+      for(int q=0; q<4; q++, nm++)
+       MV[nm]=X1Powers[p]*X2Powers[q];
+
+     double *C=CTable + GetCTableOffset(0, nFun, n1, N1, n2, N2);
+     for(int nf=0; nf<nFun; nf++, C+=NCOEFF)
+      { double P[4]={0.0, 0.0, 0.0, 0.0};
+        for(int nm=0; nm<NCOEFF; nm+=4)
+         for(int j=0; j<4; j++)
+          P[j]+=C[nm+j]*MV[nm+j];
+        Phi[nf]=(P[0]+P[1]) + (P[2]+P[3]);
+      };
+   };
+}
+
+/****************************************************************/
+/* batched version of EvaluatePlus(); see the comments above    */
+/* Interp3D::EvaluatePlusMany                                   */
+/****************************************************************/
+void Interp2D::EvaluatePlusMany(const double *X, int NX, double *Phi)
+{
+  int n1=0, n2=0;
+  for(int nx=0; nx<NX; nx++, X+=2, Phi+=4*nFun)
+   { 
+     double X1Bar, X2Bar;
+     FindIntervalNear(X[0], X1Points, N1, X1Min, DX1, &n1, &X1Bar);
+     FindIntervalNear(X[1], X2Points, N2, X2Min, DX2, &n2, &X2Bar);
+
+     double L1=DX1, L2=DX2;
+     if (X1Points)
+      { L1=X1Points[n1+1]-X1Points[n1];
+        L2=X2Points[n2+1]-X2Points[n2];
+      };
+
+     double X1P[4], X2P[4], dX1P[4], dX2P[4];
+     X1P[0]=X2P[0]=1.0;
+     dX1P[0]=dX2P[0]=0.0;
+     for(int np=1; np<4; np++)
+      { X1P[np]=X1P[np-1]*X1Bar;
+        X2P[np]=X2P[np-1]*X2Bar;
+        dX1P[np]=np*X1P[np-1]/L1;
+        dX2P[np]=np*X2P[np-1]/L2;
+      };
+
+     double MV[4][NCOEFF];
+     for(int nm=0, p=0; p<4; p++)
+      for(int q=0; q<4; q++, nm++)
+       { MV[0][nm] =  X1P[p] *  X2P[q];
+         MV[1][nm] = dX1P[p] *  X2P[q];
+         MV[2][nm] =  X1P[p] * dX2P[q];
+         MV[3][nm] = dX1P[p] * dX2P[q];
+       };
+
+     double *C=CTable + GetCTableOffset(0, nFun, n1, N1, n2, N2);
+     for(int nf=0; nf<nFun; nf++, C+=NCOEFF)
+      for(int nd=0; nd<4; nd++)
+       { double P[4]={0.0, 0.0, 0.0, 0.0};
+         for(int nm=0; nm<NCOEFF; nm+=4)
+          for(int j=0; j<4; j++)
+           P[j]+=C[nm+j]*MV[nd][nm+j];
+         Phi[4*nf+nd]=(P[0]+P[1]) + (P[2]+P[3]);
+       };
+   };
+}
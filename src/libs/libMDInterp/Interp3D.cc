@@ -450,66 +450,65 @@ void Interp3D::InitInterp3D(Phi3D PhiFunc, void *UserData)
    /*--------------------------------------------------------------*/
    /*- now go through and solve a linear system for each grid      */
    /*- cell to compute the coefficients of the interpolating       */
-   /*- polynomial in that cell                                     */
+   /*- polynomial in that cell. the cells are independent and      */
+   /*- share only the factorized matrix M, so they are farmed out  */
+   /*- to the same threads that computed the grid-point data.      */
    /*--------------------------------------------------------------*/
-   //   int nPoints=0, TotalPoints=(N1-1)*(N2-1)*(N3-1), pc;
-   int n1, dn1, n2, dn2, n3, dn3;
-   int nf;
-   double *P;
-   HVector *C = new HVector(NCOEFF);
-
    if (LogLevel >= LMDI_LOGLEVEL_VERBOSE)
     Log("Computing coefficients of interpolating polynomials...");
-   for(n1=0; n1<(N1-1); n1++)
-    for(n2=0; n2<(N2-1); n2++)
-     for(n3=0; n3<(N3-1); n3++)
-      { 
-#if 0  
-        for(pc=10; pc<=90; pc++)
-         if ( nPoints++ == pc*TotalPoints/100 )
-          Log("...%i %%...\n",pc);
+   int NumCells=(N1-1)*(N2-1)*(N3-1);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,16), num_threads(nThread)
 #endif
+   for(int nc=0; nc<NumCells; nc++)
+    { 
+      int n3 = nc%(N3-1);
+      int n2 = (nc/(N3-1))%(N2-1);
+      int n1 = nc/((N3-1)*(N2-1));
+
+      double L1=DX1, L2=DX2, L3=DX3;
+      if (X1Points)
+       { L1=X1Points[n1+1]-X1Points[n1];
+         L2=X2Points[n2+1]-X2Points[n2];
+         L3=X3Points[n3+1]-X3Points[n3];
+       };
+
+      double CBuffer[NCOEFF];
+      HVector C(NCOEFF, LHM_REAL, CBuffer);
+
+      /* separately compute interpolation coefficients for each function  */
+      for(int nf=0; nf<nFun; nf++)
+       { 
+         /* construct the RHS vector by extracting from PhiVDTable the 8 data */
+         /* values for each of the 8 corners of this grid cell                */
+         int nCorner=0;
+         for(int dn1=0; dn1<=1; dn1++)
+          for(int dn2=0; dn2<=1; dn2++)
+           for(int dn3=0; dn3<=1; dn3++, nCorner++)
+            { double *P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2, n3+dn3, N3);
+              C.SetEntry( NDATA*nCorner + 0, P[0]);
+              C.SetEntry( NDATA*nCorner + 1, L1*P[1]);
+              C.SetEntry( NDATA*nCorner + 2, L2*P[2]);
+              C.SetEntry( NDATA*nCorner + 3, L3*P[3]);
+              C.SetEntry( NDATA*nCorner + 4, L1*L2*P[4]);
+              C.SetEntry( NDATA*nCorner + 5, L1*L3*P[5]);
+              C.SetEntry( NDATA*nCorner + 6, L2*L3*P[6]);
+              C.SetEntry( NDATA*nCorner + 7, L1*L2*L3*P[7]);
+            };
+
+         /* solve the 64x64 system */
+         M->LUSolve(&C);
+
+         /* store the coefficients in the appropriate place in CTable */
+         double *P=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2, n3, N3);
+         memcpy(P,CBuffer, NCOEFF*sizeof(double));
+       };
 
-        if (X1Points)
-         { DX1=X1Points[n1+1]-X1Points[n1];
-           DX2=X2Points[n2+1]-X2Points[n2];
-           DX3=X3Points[n3+1]-X3Points[n3];
-         };
-
-        /* separately compute interpolation coefficients for each function  */
-        for(nf=0; nf<nFun; nf++)
-         { 
-           
-           /* construct the RHS vector by extracting from PhiVDTable the 8 data */
-           /* values for each of the 8 corners of this grid cell                */
-           for(ncp=0, dn1=0; dn1<=1; dn1++)
-            for(dn2=0; dn2<=1; dn2++)
-             for(dn3=0; dn3<=1; dn3++, ncp++)
-              { P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2, n3+dn3, N3);
-                C->SetEntry( NDATA*ncp + 0, P[0]);
-                C->SetEntry( NDATA*ncp + 1, DX1*P[1]);
-                C->SetEntry( NDATA*ncp + 2, DX2*P[2]);
-                C->SetEntry( NDATA*ncp + 3, DX3*P[3]);
-                C->SetEntry( NDATA*ncp + 4, DX1*DX2*P[4]);
-                C->SetEntry( NDATA*ncp + 5, DX1*DX3*P[5]);
-                C->SetEntry( NDATA*ncp + 6, DX2*DX3*P[6]);
-                C->SetEntry( NDATA*ncp + 7, DX1*DX2*DX3*P[7]);
-              };
-
-           /* solve the 64x64 system */
-           M->LUSolve(C);
-
-           /* store the coefficients in the appropriate place in CTable */
-           P=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2, n3, N3);
-           memcpy(P,C->DV, NCOEFF*sizeof(double));
-         };
-
-      };
+    };
 
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
-   delete C;
    delete M;
    free(PhiVDTable);
    if (LogLevel >= LMDI_LOGLEVEL_TERSE)
@@ -935,3 +934,117 @@ void Interp3D::EvaluatePlusPlus(double X1, double X2, double X3, double *PhiVD)
    };
 
 }
+
+/****************************************************************/
+/* batched version of Evaluate().                               */
+/*                                                              */
+/* The NCOEFF coefficients of all nFun functions in one grid    */
+/* cell occupy a single contiguous block of CTable (see         */
+/* GetCTableOffset), so each point costs one cell lookup and    */
+/* one sequential sweep over nFun*NCOEFF doubles. The cell of   */
+/* each point is located starting from the cell of the previous */
+/* point, which avoids the binary search on nonuniform grids    */
+/* when successive points are close together (as are the       */
+/* cubature points for a panel pair); on uniform grids the      */
+/* lookup is O(1) in any case. The dot products are accumulated */
+/* in four independent partial sums so that the compiler can    */
+/* vectorize them without reassociating a single running sum.   */
+/****************************************************************/
+void Interp3D::EvaluateMany(const double *X, int NX, double *Phi)
+{
+  int n1=0, n2=0, n3=0;
+  for(int nx=0; nx<NX; nx++, X+=3, Phi+=nFun)
+   { 
+     double X1Bar, X2Bar, X3Bar;
+     FindIntervalNear(X[0], X1Points, N1, X1Min, DX1, &n1, &X1Bar);
+     FindIntervalNear(X[1], X2Points, N2, X2Min, DX2, &n2, &X2Bar);
+     FindIntervalNear(X[2], X3Points, N3, X3Min, DX3, &n3, &X3Bar);
+
+     double X1Powers[4], X2Powers[4], X3Powers[4];
+     X1Powers[0]=X2Powers[0]=X3Powers[0]=1.0;
+     for(int np=1; np<4; np++)
+      { X1Powers[np]=X1Powers[np-1]*X1Bar;
+        X2Powers[np]=X2Powers[np-1]*X2Bar;
+        X3Powers[np]=X3Powers[np-1]*X3Bar;
+      };
+
+     double MV[NCOEFF];
+     for(int nm=0, p=0; p<4; p++)
+      for(int q=0; q<4; q++)
+       for(int r=0; r<4; r++, nm++)
+        MV[nm]=X1Powers[p]*X2Powers[q]*X3Powers[r];
+
+     double *C=CTable + GetCTableOffset(0, nFun, n1, N1, n2, N2, n3, N3);
+     for(int nf=0; nf<nFun; nf++, C+=NCOEFF)
+      { double P[4]={0.0, 0.0, 0.0, 0.0};
+        for(int nm=0; nm<NCOEFF; nm+=4)
+         for(int j=0; j<4; j++)
+          P[j]+=C[nm+j]*MV[nm+j];
+        Phi[nf]=(P[0]+P[1]) + (P[2]+P[3]);
+      };
+   };
+}
+
+/****************************************************************/
+/* batched version of EvaluatePlus(); the cell lookup is done   */
+/* as in EvaluateMany(). The eight monomial vectors for a point */
+/* are tabulated once and shared by all nFun functions, so the  */
+/* cost per point is dominated by a single sweep over the       */
+/* coefficients of its cell.                                    */
+/****************************************************************/
+void Interp3D::EvaluatePlusMany(const double *X, int NX, double *PhiVD)
+{
+  int n1=0, n2=0, n3=0;
+  for(int nx=0; nx<NX; nx++, X+=3, PhiVD+=8*nFun)
+   { 
+     double X1Bar, X2Bar, X3Bar;
+     FindIntervalNear(X[0], X1Points, N1, X1Min, DX1, &n1, &X1Bar);
+     FindIntervalNear(X[1], X2Points, N2, X2Min, DX2, &n2, &X2Bar);
+     FindIntervalNear(X[2], X3Points, N3, X3Min, DX3, &n3, &X3Bar);
+
+     double L1=DX1, L2=DX2, L3=DX3;
+     if (X1Points)
+      { L1=X1Points[n1+1]-X1Points[n1];
+        L2=X2Points[n2+1]-X2Points[n2];
+        L3=X3Points[n3+1]-X3Points[n3];
+      };
+
+     /* powers of the scaled coordinates and their derivatives  */
+     /* with respect to the unscaled coordinates                */
+     double X1P[4], X2P[4], X3P[4], dX1P[4], dX2P[4], dX3P[4];
+     X1P[0]=X2P[0]=X3P[0]=1.0;
+     dX1P[0]=dX2P[0]=dX3P[0]=0.0;
+     for(int np=1; np<4; np++)
+      { X1P[np]=X1P[np-1]*X1Bar;
+        X2P[np]=X2P[np-1]*X2Bar;
+        X3P[np]=X3P[np-1]*X3Bar;
+        dX1P[np]=np*X1P[np-1]/L1;
+        dX2P[np]=np*X2P[np-1]/L2;
+        dX3P[np]=np*X3P[np-1]/L3;
+      };
+
+     double MV[8][NCOEFF];
+     for(int nm=0, p=0; p<4; p++)
+      for(int q=0; q<4; q++)
+       for(int r=0; r<4; r++, nm++)
+        { MV[0][nm] =  X1P[p] *  X2P[q] *  X3P[r];
+          MV[1][nm] = dX1P[p] *  X2P[q] *  X3P[r];
+          MV[2][nm] =  X1P[p] * dX2P[q] *  X3P[r];
+          MV[3][nm] =  X1P[p] *  X2P[q] * dX3P[r];
+          MV[4][nm] = dX1P[p] * dX2P[q] *  X3P[r];
+          MV[5][nm] = dX1P[p] *  X2P[q] * dX3P[r];
+          MV[6][nm] =  X1P[p] * dX2P[q] * dX3P[r];
+          MV[7][nm] = dX1P[p] * dX2P[q] * dX3P[r];
+        };
+
+     double *C=CTable + GetCTableOffset(0, nFun, n1, N1, n2, N2, n3, N3);
+     for(int nf=0; nf<nFun; nf++, C+=NCOEFF)
+      for(int nd=0; nd<8; nd++)
+       { double P[4]={0.0, 0.0, 0.0, 0.0};
+         for(int nm=0; nm<NCOEFF; nm+=4)
+          for(int j=0; j<4; j++)
+           P[j]+=C[nm+j]*MV[nd][nm+j];
+         PhiVD[8*nf+nd]=(P[0]+P[1]) + (P[2]+P[3]);
+       };
+   };
+}
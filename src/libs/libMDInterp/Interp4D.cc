@@ -718,3 +718,45 @@ void Interp4D::Evaluate(double X1, double X2, double X3, double X4, double *Phi)
    };
 
 }
+
+/****************************************************************/
+/* batched version of Evaluate(); see the comments above        */
+/* Interp3D::EvaluateMany                                       */
+/****************************************************************/
+void Interp4D::EvaluateMany(const double *X, int NX, double *Phi)
+{
+  int n1=0, n2=0, n3=0, n4=0;
+  for(int nx=0; nx<NX; nx++, X+=4, Phi+=nFun)
+   { 
+     double X1Bar, X2Bar, X3Bar, X4Bar;
+     FindIntervalNear(X[0], X1Points, N1, X1Min, DX1, &n1, &X1Bar);
+     FindIntervalNear(X[1], X2Points, N2, X2Min, DX2, &n2, &X2Bar);
+     FindIntervalNear(X[2], X3Points, N3, X3Min, DX3, &n3, &X3Bar);
+     FindIntervalNear(X[3], X4Points, N4, X4Min, DX4, &n4, &X4Bar);
+
+     double X1Powers[4], X2Powers[4], X3Powers[4], X4Powers[4];
+     X1Powers[0]=X2Powers[0]=X3Powers[0]=X4Powers[0]=1.0;
+     for(int np=1; np<4; np++)
+      { X1Powers[np]=X1Powers[np-1]*X1Bar;
+        X2Powers[np]=X2Powers[np-1]*X2Bar;
+        X3Powers[np]=X3Powers[np-1]*X3Bar;
+        X4Powers[np]=X4Powers[np-1]*X4Bar;
+      };
+
+     double MV[NCOEFF];
+     for(int nm=0, p=0; p<4; p++)
+      for(int q=0; q<4; q++)
+       for(int r=0; r<4; r++)
+        for(int s=0; s<4; s++, nm++)
+         MV[nm]=X1Powers[p]*X2Powers[q]*X3Powers[r]*X4Powers[s];
+
+     double *C=CTable + GetCTableOffset(0, nFun, n1, N1, n2, N2, n3, N3, n4, N4);
+     for(int nf=0; nf<nFun; nf++, C+=NCOEFF)
+      { double P[4]={0.0, 0.0, 0.0, 0.0};
+        for(int nm=0; nm<NCOEFF; nm+=4)
+         for(int j=0; j<4; j++)
+          P[j]+=C[nm+j]*MV[nm+j];
+        Phi[nf]=(P[0]+P[1]) + (P[2]+P[3]);
+      };
+   };
+}
@@ -222,6 +222,12 @@ class Interp1D
     void Evaluate(double X, double *Phi);
     double Evaluate(double X); // returns Phi[0]
 
+    /*--------------------------------------------------------------*/
+    /*- batched version of Evaluate() for NX points: on return,    -*/
+    /*- Phi[nFun*nx + nf] is the value of function nf at X[nx]     -*/
+    /*--------------------------------------------------------------*/
+    void EvaluateMany(const double *X, int NX, double *Phi);
+
     /*--------------------------------------------------------------*/
     /*- class method that writes all internal data to a binary file */
     /*- that may be subsequently used to reconstruct the class     -*/
@@ -300,6 +306,20 @@ class Interp2D
     void EvaluatePlus(double X1, double X2, double *Phi);
     void EvaluatePlusPlus(double X1, double X2, double *Phi);
 
+    /*--------------------------------------------------------------*/
+    /*- batched version of Evaluate() for NX points: the coordinates*/
+    /*- of point nx are X[2*nx + ...], and on return the values of  */
+    /*- the functions there are Phi[nFun*nx + nf]                   */
+    /*--------------------------------------------------------------*/
+    void EvaluateMany(const double *X, int NX, double *Phi);
+
+    /*--------------------------------------------------------------*/
+    /*- batched version of EvaluatePlus(): on return the values and */
+    /*- derivatives at point nx are Phi[4*nFun*nx + 4*nf + ...],    */
+    /*- in the order of EvaluatePlus()                              */
+    /*--------------------------------------------------------------*/
+    void EvaluatePlusMany(const double *X, int NX, double *Phi);
+
     /*--------------------------------------------------------------*/
     /*- class method that writes all internal data to a binary file */
     /*- that may be subsequently used to reconstruct the class     -*/
@@ -381,6 +401,20 @@ class Interp3D
     void EvaluatePlus(double X1, double X2, double X3, double *PhiVD);
     void EvaluatePlusPlus(double X1, double X2, double X3, double *PhiVD);
 
+    /*--------------------------------------------------------------*/
+    /*- batched version of Evaluate() for NX points: the coordinates*/
+    /*- of point nx are X[3*nx + ...], and on return the values of  */
+    /*- the functions there are Phi[nFun*nx + nf]                   */
+    /*--------------------------------------------------------------*/
+    void EvaluateMany(const double *X, int NX, double *Phi);
+
+    /*--------------------------------------------------------------*/
+    /*- batched version of EvaluatePlus(): on return the values and */
+    /*- derivatives at point nx are PhiVD[8*nFun*nx + 8*nf + ...],  */
+    /*- in the order of EvaluatePlus()                              */
+    /*--------------------------------------------------------------*/
+    void EvaluatePlusMany(const double *X, int NX, double *PhiVD);
+
     /*--------------------------------------------------------------*/
     /*- return true if point lies in the interior or on the boundary*/
     /*- of the interpolation grid; false otherwise.                 */
@@ -469,6 +503,13 @@ class Interp4D
     /*--------------------------------------------------------------*/
     void Evaluate(double X1, double X2, double X3, double X4, double *Phi);
 
+    /*--------------------------------------------------------------*/
+    /*- batched version of Evaluate() for NX points: the coordinates*/
+    /*- of point nx are X[4*nx + ...], and on return the values of  */
+    /*- the functions there are Phi[nFun*nx + nf]                   */
+    /*--------------------------------------------------------------*/
+    void EvaluateMany(const double *X, int NX, double *Phi);
+
     /*--------------------------------------------------------------*/
     /*- class method that writes all internal data to a binary file */
     /*- that may be subsequently used to reconstruct the class     -*/
@@ -495,6 +536,8 @@ void BinSearch(double X, double *XPoints, int N);
 
 bool FindInterval(double X, double *XPoints, int N, double XMin, double DX,
                   int *n, double *XBar);
+bool FindIntervalNear(double X, double *XPoints, int N, double XMin, double DX,
+                      int *n, double *XBar);
 
 /***************************************************************/
 /* a version of fread() with simple error-checking *************/
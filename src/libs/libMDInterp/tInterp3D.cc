@@ -54,6 +54,12 @@ void Phi(double X1, double X2, double X3, void *UserData, double *PhiVD)
 
 }
 
+/***************************************************************/
+/* uniform random number in [A,B]                              */
+/***************************************************************/
+static double RandAB(double A, double B)
+{ return A + (B-A)*drand48(); }
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -78,8 +84,8 @@ int main(int argc, char *argv[])
      {0,0,0,0,0}
    };
   ProcessArguments(argc, argv, ASArray);
-  if (nThread==-1)
-   nThread=GetNumThreads();
+  if (nThread!=-1)
+   SetNumThreads(nThread);
 
   /*--------------------------------------------------------------*/
   /*- if the user specified a binary data file, attempt to read --*/
@@ -121,7 +127,7 @@ int main(int argc, char *argv[])
       X3Points=X3Vec->DV; N3=X3Vec->N;
 
       I3D=new Interp3D(X1Points, N1, X2Points, N2, X3Points, N3, 
-                       NFUN, nThread, Phi, 0);
+                       NFUN, Phi, 0);
 
       I3D->WriteToFile("tInterp3D.dat");
     };
@@ -203,6 +209,68 @@ int main(int argc, char *argv[])
   printf(" Interp = %+17.10e\n",MaxRDPI2);
   printf("\n");
 
+  /*--------------------------------------------------------------*/
+  /*- timing test: Evaluate() vs. EvaluateMany() at a batch of   -*/
+  /*- random points, sorted along X1 as successive cubature      -*/
+  /*- points would be                                            -*/
+  /*--------------------------------------------------------------*/
+#define NXBENCH 100000
+  double *XBench      = (double *)mallocEC(3*NXBENCH*sizeof(double));
+  double *PhiSingle   = (double *)mallocEC(NFUN*NXBENCH*sizeof(double));
+  double *PhiBatch    = (double *)mallocEC(NFUN*NXBENCH*sizeof(double));
+  for(int nx=0; nx<NXBENCH; nx++)
+   { double u = ((double)nx + 0.5*drand48()) / ((double)NXBENCH);
+     XBench[3*nx+0] = X1Points[0] + u*(X1Points[N1-1]-X1Points[0]);
+     XBench[3*nx+1] = RandAB(X2Points[0], X2Points[N2-1]);
+     XBench[3*nx+2] = RandAB(X3Points[0], X3Points[N3-1]);
+   };
+
+  Tic();
+  for(int nx=0; nx<NXBENCH; nx++)
+   I3D->Evaluate(XBench[3*nx+0], XBench[3*nx+1], XBench[3*nx+2], PhiSingle + NFUN*nx);
+  double TSingle=Toc();
+
+  Tic();
+  I3D->EvaluateMany(XBench, NXBENCH, PhiBatch);
+  double TBatch=Toc();
+
+  double MaxDiff=0.0;
+  for(int n=0; n<NFUN*NXBENCH; n++)
+   MaxDiff=fmax(MaxDiff, fabs(PhiSingle[n]-PhiBatch[n]));
+
+  printf("%i points: Evaluate %.3e s, EvaluateMany %.3e s (speedup %.2f)\n",
+          NXBENCH, TSingle, TBatch, TSingle/TBatch);
+  printf("Maximum abs. diff. is %5.2e \n",MaxDiff);
+
+  /*--------------------------------------------------------------*/
+  /*- same for EvaluatePlus() vs. EvaluatePlusMany()             -*/
+  /*--------------------------------------------------------------*/
+  double *PhiVDSingle = (double *)mallocEC(8*NFUN*NXBENCH*sizeof(double));
+  double *PhiVDBatch  = (double *)mallocEC(8*NFUN*NXBENCH*sizeof(double));
+
+  Tic();
+  for(int nx=0; nx<NXBENCH; nx++)
+   I3D->EvaluatePlus(XBench[3*nx+0], XBench[3*nx+1], XBench[3*nx+2], PhiVDSingle + 8*NFUN*nx);
+  TSingle=Toc();
+
+  Tic();
+  I3D->EvaluatePlusMany(XBench, NXBENCH, PhiVDBatch);
+  TBatch=Toc();
+
+  MaxDiff=0.0;
+  for(int n=0; n<8*NFUN*NXBENCH; n++)
+   MaxDiff=fmax(MaxDiff, fabs(PhiVDSingle[n]-PhiVDBatch[n]) / (1.0 + fabs(PhiVDSingle[n])));
+
+  printf("%i points: EvaluatePlus %.3e s, EvaluatePlusMany %.3e s (speedup %.2f)\n",
+          NXBENCH, TSingle, TBatch, TSingle/TBatch);
+  printf("Maximum rel. diff. is %5.2e \n",MaxDiff);
+
+  free(XBench);
+  free(PhiSingle);
+  free(PhiBatch);
+  free(PhiVDSingle);
+  free(PhiVDBatch);
+
   printf("\n");
   printf("Thank you for your support.\n");
 
@@ -69,6 +69,14 @@
 #include <string.h>
 #include <math.h>
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+#  include <pthread.h>
+#endif
+
 #include "libhrutil.h"
 #include "libhmat.h"
 #include "libSpherical.h"
@@ -107,6 +115,119 @@ double ThreeJSymbol(double L1, double L2, double L3,
   return RetVal;
 }   
 
+/***************************************************************/
+/* The entries of the A and B matrices computed below are sums */
+/* over an intermediate index LC of terms of the form          */
+/*                                                             */
+/*  Factor(LA,MA,LB,MB,LC) * R_{LC}(kr) * Y_{LC,MA-MB}(Xij)     */
+/*                                                             */
+/* where Factor involves two 3j symbols and depends only on    */
+/* the indices, not on Xij or k. These factors are tabulated   */
+/* once per LMax and shared by all subsequent calls, which     */
+/* removes the 3j-symbol evaluations (by far the dominant cost */
+/* of the original implementation) from the inner loop.        */
+/*                                                             */
+/* The table for LMax also serves all smaller values of LMax,  */
+/* since the compound index Alpha=(LA,MA) does not depend on   */
+/* LMax. Tables are never freed, so a table pointer, once      */
+/* obtained, remains valid.                                    */
+/***************************************************************/
+typedef struct GauntTable
+ { int LMax, NAlpha;
+   int *Start;       // entries for (Alpha,Beta) are Start[n]...Start[n+1]-1, n=Alpha*NAlpha+Beta
+   int *LC;          // intermediate index
+   cdouble *Factor;  // everything except R[LC]*Ylm[LC,MA-MB]
+ } GauntTable;
+
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+static pthread_mutex_t GauntTableMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static GauntTable *LargestGauntTable=0;
+
+static GauntTable *CreateGauntTable(int LMax)
+{
+  int NAlpha = (LMax+1)*(LMax+1);
+  GauntTable *T = (GauntTable *)mallocEC(sizeof(GauntTable));
+  T->LMax   = LMax;
+  T->NAlpha = NAlpha;
+  T->Start  = (int *)mallocEC( (((size_t)NAlpha)*NAlpha + 1)*sizeof(int) );
+
+  /***************************************************************/
+  /* first pass: count the LC values that contribute to each     */
+  /* (Alpha, Beta) pair: we need |LA-LB| <= LC <= LA+LB,         */
+  /* LC >= |MC|, and LA+LB+LC even (otherwise the 3j symbol with */
+  /* vanishing M values is zero)                                 */
+  /***************************************************************/
+  size_t NumEntries=0;
+  for(int Alpha=0, LA=0; LA<=LMax; LA++)
+   for(int MA=-LA; MA<=LA; MA++, Alpha++)
+    for(int Beta=0, LB=0; LB<=LMax; LB++)
+     for(int MB=-LB; MB<=LB; MB++, Beta++)
+      { T->Start[Alpha*NAlpha + Beta] = NumEntries;
+        int LCMin = abs(LA-LB) > abs(MA-MB) ? abs(LA-LB) : abs(MA-MB);
+        for(int LC=LCMin; LC<=LA+LB; LC++)
+         if ( (LA+LB+LC)%2 == 0 )
+          NumEntries++;
+      };
+  T->Start[NAlpha*NAlpha] = NumEntries;
+  T->LC     = (int *)mallocEC(NumEntries*sizeof(int));
+  T->Factor = (cdouble *)mallocEC(NumEntries*sizeof(cdouble));
+
+  /***************************************************************/
+  /* second pass: fill in the factors. a single call to drc3jm   */
+  /* yields the 3j symbols for all values of MB at fixed         */
+  /* (LA, LB, LC, MA).                                           */
+  /***************************************************************/
+  int *Cursor = (int *)mallocEC( ((size_t)NAlpha)*NAlpha*sizeof(int) );
+  memcpy(Cursor, T->Start, ((size_t)NAlpha)*NAlpha*sizeof(int));
+  double *ThreeJ = new double[2*LMax+2];
+  for(int LA=0; LA<=LMax; LA++)
+   for(int LB=0; LB<=LMax; LB++)
+    for(int LC=abs(LA-LB); LC<=LA+LB; LC++)
+     { 
+       if ( (LA+LB+LC)%2 ) continue;
+       double ThreeJ000=ThreeJSymbol(LA,LB,LC,0,0,0);
+       double Root=sqrt((2*LA+1)*(2*LB+1)*(2*LC+1)/(4.0*M_PI));
+
+       for(int MA=-LA; MA<=LA; MA++)
+        { 
+          double L1=LA, L2=LB, L3=LC, M1=-MA, M2Min, M2Max;
+          int NDim=2*LMax+2, ier;
+          drc3jm_(&L1, &L2, &L3, &M1, &M2Min, &M2Max, ThreeJ, &NDim, &ier);
+          if (ier) continue;
+
+          int Alpha = LM2ALPHA(LA,MA);
+          for(int MB=(int)M2Min; MB<=(int)M2Max; MB++)
+           { int MC = MA-MB;
+             if ( abs(MC)>LC ) continue;
+             int Beta = LM2ALPHA(LB,MB);
+             int n = Cursor[Alpha*NAlpha + Beta]++;
+             T->LC[n]     = LC;
+             T->Factor[n] = 4.0*M_PI*M1POW(MA)*IIPOW(LA-LB+LC)*Root
+                           *ThreeJ000*ThreeJ[MB-(int)M2Min];
+           };
+        };
+     };
+  delete[] ThreeJ;
+  free(Cursor);
+
+  return T;
+}
+
+static GauntTable *GetGauntTable(int LMax)
+{
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  pthread_mutex_lock(&GauntTableMutex);
+#endif
+  if ( LargestGauntTable==0 || LargestGauntTable->LMax < LMax )
+   LargestGauntTable=CreateGauntTable(LMax);
+  GauntTable *T=LargestGauntTable;
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  pthread_mutex_unlock(&GauntTableMutex);
+#endif
+  return T;
+}
+
 /***************************************************************/
 /* Compute the translation matrices that express outgoing      */
 /* Helmholtz solutions emanating from a source point xSource   */
@@ -117,6 +238,11 @@ double ThreeJSymbol(double L1, double L2, double L3,
 /*  PsiOut_a(xDest-XSource)                                    */
 /*   = \sum A_{ab}(XSource) PsiReg_b(xDest)                    */
 /*                                                             */
+/* Here PsiOut_a = h^{(1)}_{l}(kr) Y_{lm} and                  */
+/* PsiReg_a = j_l(kr) Y_{lm} for all complex k, including      */
+/* imaginary k; in that case these are the analytic            */
+/* continuations of the real-frequency functions, not the      */
+/* modified Bessel functions returned by GetRadialFunctions.   */
 /*                                                             */
 /* inputs:                                                     */
 /*                                                             */
@@ -139,17 +265,19 @@ double ThreeJSymbol(double L1, double L2, double L3,
 /* A=new HMatrix(NAlpha, NAlpha, LHM_COMCLEX);                 */
 /* B=new HMatrix(NAlpha, NAlpha, LHM_COMCLEX);                 */
 /* C=new HMatrix(NAlpha, NAlpha, LHM_COMCLEX);                 */
+/*                                                             */
+/* B and C may be NULL if only the scalar matrix is needed.    */
 /***************************************************************/
 void GetTranslationMatrices(double Xij[3], cdouble k, int LMax,
                             HMatrix *A, HMatrix *B, HMatrix *C)
 {
   A->Zero();
-  B->Zero();
-  C->Zero();
+  if (B) B->Zero();
+  if (C) C->Zero();
   if ( abs(k)*VecNorm(Xij) < 1.0e-6 )
    { for(int Alpha=0; Alpha<(LMax+1)*(LMax+1); Alpha++)
       { A->SetEntry(Alpha,Alpha,1.0);
-        B->SetEntry(Alpha,Alpha,1.0);
+        if (B) B->SetEntry(Alpha,Alpha,1.0);
       };
      return;
    };
@@ -164,12 +292,14 @@ void GetTranslationMatrices(double Xij[3], cdouble k, int LMax,
   /***************************************************************/
   double r, Theta, Phi;
   CoordinateC2S(Xij, &r, &Theta, &Phi);
-  GetRadialFunctions(LCMax, k, r, LS_OUTGOING, R, 0);
+  AmosBessel('o', k*r, 0.0, LCMax+1, false, R);
   GetYlmArray(LCMax, Theta, Phi, Ylm);
 
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
+  GauntTable *T=GetGauntTable(LMax);
+  int NAlphaT=T->NAlpha;
   for(int Alpha=0, LA=0; LA<=LMax; LA++)
    for(int MA=-LA; MA<=LA; MA++, Alpha++)
     for(int Beta=0, LB=0; LB<=LMax; LB++)
@@ -177,22 +307,25 @@ void GetTranslationMatrices(double Xij[3], cdouble k, int LMax,
       { 
         int MC = MA-MB;
         cdouble AA=0.0, BB=0.0;
-        for(int LC=abs(LA-LB); LC<=LA+LB; LC++)
-         { 
-           cdouble Factor= 4.0*M_PI*M1POW(MA)*IIPOW(LA-LB+LC)
-                          *sqrt((2*LA+1)*(2*LB+1)*(2*LC+1)/(4.0*M_PI))
-                          *ThreeJSymbol(LA,LB,LC,0,0,0)
-                          *ThreeJSymbol(LA,LB,LC,-MA,MB,MC)
-                          *R[LC]*Ylm[LM2ALPHA(LC,MC)];
+        int nt=Alpha*NAlphaT + Beta;
+        for(int n=T->Start[nt]; n<T->Start[nt+1]; n++)
+         { int LC=T->LC[n];
+           cdouble Factor = T->Factor[n]*R[LC]*Ylm[LM2ALPHA(LC,MC)];
            AA+=Factor;
-           if (LA>0 && LB>0)
+           if (B && LA>0 && LB>0)
             BB += (double)( LA*(LA+1.0) + LB*(LB+1.0) - LC*(LC+1.0)) * Factor;
          };
         A->SetEntry(Alpha,Beta,AA);
-        if (LB>0)
+        if (B && LB>0)
          B->SetEntry(Alpha,Beta,BB/(2.0*sqrt(LA*(LA+1.0)*LB*(LB+1.0))));
       };
 
+  delete[] R;
+  delete[] Ylm;
+
+  if (C==0) 
+   return;
+
   /***************************************************************/
   /* compute the C matrix using the A matrix                     */
   /* Note: My N function = i*Wittman's N function.               */
@@ -218,7 +351,4 @@ void GetTranslationMatrices(double Xij[3], cdouble k, int LMax,
         C->SetEntry(Alpha, Beta, -k*CC / sqrt( LA*(LA+1.0)*LB*(LB+1.0) ) );
       };
 
-  delete[] R;
-  delete[] Ylm;
-
 }
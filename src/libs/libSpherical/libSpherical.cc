@@ -252,7 +252,7 @@ void GetPlm(int lMax, int m, double x, double *Plm, double *PlmPrime)
   for(int np=2, l=m+2; l<=lMax; l++, np++)
    { Factor=sqrt( (4.0*l*l-1.0) / (l*l-m*m) );
      Plm[np]=Factor*(x*Plm[np-1] - Plm[np-2]/OldFactor);
-     Alm=sqrt( (2*l+1)*(l*l-m*m) / (2*l-1) );
+     Alm=sqrt( (2.0*l+1.0)*(l*l-m*m) / (2.0*l-1.0) );
      PlmPrime[np] = (Alm*Plm[np-1] - l*x*Plm[np])/omx2;
      OldFactor=Factor;
    };
@@ -399,8 +399,16 @@ void GetYlmDerivArray(int lMax, double Theta, double Phi,
   /* where P_l^m is the associated legendre function with the     */
   /* correct prefactor for use in spherical harmonics.            */
   /*--------------------------------------------------------------*/
-  if ( Theta < 1.0e-6 ) Theta=1.0e-6;
-  if ( fabs(M_PI-Theta) < 1.0e-6 ) Theta=M_PI-1.0e-6;
+  /* the Ylms themselves are regular at the poles; only the      */
+  /* derivative recurrence in GetPlm divides by sin^2(theta), so  */
+  /* we only move theta off the poles if derivatives are wanted.  */
+  /* (moving it unconditionally spoils the m!=0 Ylms at the poles  */
+  /* by O(l^2 * 1e-6), e.g. in translation matrices along the z   */
+  /* axis.)                                                       */
+  if (dYlmdTheta)
+   { if ( Theta < 1.0e-6 ) Theta=1.0e-6;
+     if ( fabs(M_PI-Theta) < 1.0e-6 ) Theta=M_PI-1.0e-6;
+   };
   ST=sin(Theta);
   CT=cos(Theta);
 
@@ -413,13 +421,16 @@ void GetYlmDerivArray(int lMax, double Theta, double Phi,
      gslP=(double *)realloc(gslP, gslSize*sizeof(double));
      gslPPrime=(double *)realloc(gslPPrime, gslSize*sizeof(double));
    };
-  gsl_sf_legendre_deriv_array(GSL_SF_LEGENDRE_SPHARM, lMax, CT, gslP, gslPPrime);
+  if (dYlmdTheta)
+   gsl_sf_legendre_deriv_array(GSL_SF_LEGENDRE_SPHARM, lMax, CT, gslP, gslPPrime);
+  else
+   gsl_sf_legendre_array(GSL_SF_LEGENDRE_SPHARM, lMax, CT, gslP);
   for(int l=0; l<=lMax; l++)
    for(int m=0; m<=l; m++)
     { int gslIndex=gsl_sf_legendre_array_index(l,m);
       double Sign = (m%2) ? -1.0 : 1.0;
       Plm[m][l] = Sign * gslP[gslIndex];
-      PlmPrime[m][l] = Sign * gslPPrime[gslIndex];
+      PlmPrime[m][l] = dYlmdTheta ? Sign * gslPPrime[gslIndex] : 0.0;
     };
 #else
   for(int m=0; m<=lMax; m++)
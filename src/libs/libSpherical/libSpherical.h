@@ -167,7 +167,8 @@ void GetCurl(double r, double Theta, double Phi,
              cdouble *CurlF, cdouble *CurlF2);
 
 /***************************************************************/
-/***************************************************************/
+/* translation matrices for scalar and vector helmholtz        */
+/* solutions (B and C may be NULL if only A is needed)         */
 /***************************************************************/
 void GetTranslationMatrices(double Xij[3], cdouble k, int lMax, 
                             HMatrix *A, HMatrix *B, HMatrix *C);
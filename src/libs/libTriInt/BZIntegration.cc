@@ -260,10 +260,11 @@ void GetBZIntegral_TC(GetBZIArgStruct *Args, cdouble Omega,
   Args->Omega=Omega;
 
   /*--------------------------------------------------------------*/
+  /*- the DCUTRI workspace is kept per-thread so that several     -*/
+  /*- frequencies may be integrated over the BZ concurrently      -*/
   /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  static int FDimSave=0, MaxEvalsSave=0;
-  static void *Workspace=0;
+  static __thread int FDimSave=0, MaxEvalsSave=0;
+  static __thread void *Workspace=0;
   if (Order==0)
    {
      if (FDimSave!=FDim || MaxEvalsSave!=Args->MaxEvals )
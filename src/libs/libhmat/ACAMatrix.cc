@@ -0,0 +1,590 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * ACAMatrix.cc  -- implementation of the ACAMatrix class, a
+ *               -- hierarchically compressed representation of a
+ *               -- square complex matrix whose rows and columns are
+ *               -- associated with points in 3D space
+ *
+ * The row/column indices are organized into a cluster tree by
+ * recursive bisection of bounding boxes. Pairs of clusters that
+ * are well-separated (the "admissible" blocks) are stored in
+ * low-rank form U*V^T computed by adaptive cross approximation
+ * (ACA) with partial pivoting; all other blocks are stored densely.
+ * Matrix entries are never formed globally; instead, the caller
+ * supplies a routine that computes arbitrary subblocks on demand.
+ *
+ * Linear systems are solved by restarted GMRES with a block-Jacobi
+ * preconditioner built from LU-factorized diagonal blocks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <libhrutil.h>
+
+#include "libhmat.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+/***************************************************************/
+/* node in the cluster tree: a contiguous range of the         */
+/* permuted index list, together with its bounding box         */
+/***************************************************************/
+typedef struct ACACluster
+ { int Start, Len;
+   double BBMin[3], BBMax[3];
+   int Children[2]; // -1 for leaves
+ } ACACluster;
+
+/***************************************************************/
+/* comparison functor used to split clusters along one axis    */
+/***************************************************************/
+struct ACAPointCompare
+ { double *Points; int Axis;
+   bool operator()(int i, int j) const
+    { return Points[3*i+Axis] < Points[3*j+Axis]; }
+ };
+
+/***************************************************************/
+/* recursively subdivide the cluster containing indices        */
+/* Perm[Start..Start+Len-1], appending new nodes to *pClusters */
+/* and returning the index of the new node                     */
+/***************************************************************/
+static int AddCluster(double *Points, int *Perm, int Start, int Len,
+                      int LeafSize, ACACluster **pClusters,
+                      int *NumClusters, int *NumAllocated)
+{
+  if (*NumClusters == *NumAllocated)
+   { *NumAllocated = 2*(*NumAllocated) + 16;
+     *pClusters = (ACACluster *)reallocEC(*pClusters, (*NumAllocated)*sizeof(ACACluster));
+   };
+  int nc = (*NumClusters)++;
+
+  ACACluster *C=(*pClusters) + nc;
+  C->Start=Start;
+  C->Len=Len;
+  C->Children[0]=C->Children[1]=-1;
+  for(int i=0; i<3; i++)
+   { C->BBMin[i]=C->BBMax[i]=Points[3*Perm[Start]+i]; }
+  for(int n=Start+1; n<Start+Len; n++)
+   for(int i=0; i<3; i++)
+    { C->BBMin[i] = fmin(C->BBMin[i], Points[3*Perm[n]+i]);
+      C->BBMax[i] = fmax(C->BBMax[i], Points[3*Perm[n]+i]);
+    };
+
+  if (Len<=LeafSize)
+   return nc;
+
+  // split along the longest side of the bounding box at the median
+  int Axis=0;
+  for(int i=1; i<3; i++)
+   if ( (C->BBMax[i]-C->BBMin[i]) > (C->BBMax[Axis]-C->BBMin[Axis]) )
+    Axis=i;
+
+  // all points coincide: no sensible way to split
+  if ( C->BBMax[Axis]==C->BBMin[Axis] )
+   return nc;
+
+  ACAPointCompare Compare;
+  Compare.Points=Points;
+  Compare.Axis=Axis;
+  int Half=Len/2;
+  std::nth_element(Perm+Start, Perm+Start+Half, Perm+Start+Len, Compare);
+
+  int Child0=AddCluster(Points, Perm, Start, Half, LeafSize,
+                        pClusters, NumClusters, NumAllocated);
+  int Child1=AddCluster(Points, Perm, Start+Half, Len-Half, LeafSize,
+                        pClusters, NumClusters, NumAllocated);
+
+  // note *pClusters may have been reallocated
+  (*pClusters)[nc].Children[0]=Child0;
+  (*pClusters)[nc].Children[1]=Child1;
+  return nc;
+}
+
+/***************************************************************/
+/* geometric quantities used for the admissibility condition   */
+/***************************************************************/
+static double Diameter(ACACluster *C)
+{ double D2=0.0;
+  for(int i=0; i<3; i++)
+   D2 += (C->BBMax[i]-C->BBMin[i])*(C->BBMax[i]-C->BBMin[i]);
+  return sqrt(D2);
+}
+
+static double Distance(ACACluster *C1, ACACluster *C2)
+{ double D2=0.0;
+  for(int i=0; i<3; i++)
+   { double d = fmax(0.0, fmax(C1->BBMin[i]-C2->BBMax[i], C2->BBMin[i]-C1->BBMax[i]));
+     D2 += d*d;
+   };
+  return sqrt(D2);
+}
+
+/***************************************************************/
+/* recursively build the list of matrix blocks                 */
+/***************************************************************/
+static void AddBlocks(ACACluster *Clusters, int ns, int nt, double Eta,
+                      ACABlock **pBlocks, int *NumBlocks, int *NumAllocated)
+{
+  ACACluster *S=Clusters+ns, *T=Clusters+nt;
+
+  double Dist = Distance(S,T);
+  bool Admissible = (Dist>0.0) && ( fmin(Diameter(S),Diameter(T)) <= Eta*Dist );
+  bool SIsLeaf = (S->Children[0]==-1), TIsLeaf = (T->Children[0]==-1);
+
+  if ( Admissible || (SIsLeaf && TIsLeaf) )
+   { if (*NumBlocks == *NumAllocated)
+      { *NumAllocated = 2*(*NumAllocated) + 16;
+        *pBlocks = (ACABlock *)reallocEC(*pBlocks, (*NumAllocated)*sizeof(ACABlock));
+      };
+     ACABlock *B = (*pBlocks) + (*NumBlocks)++;
+     B->RowStart = S->Start;
+     B->NumRows  = S->Len;
+     B->ColStart = T->Start;
+     B->NumCols  = T->Len;
+     B->Rank     = Admissible ? 0 : -1;
+     B->U = B->V = 0;
+     return;
+   };
+
+  if (SIsLeaf)
+   { for(int i=0; i<2; i++)
+      AddBlocks(Clusters, ns, T->Children[i], Eta, pBlocks, NumBlocks, NumAllocated);
+   }
+  else if (TIsLeaf)
+   { for(int i=0; i<2; i++)
+      AddBlocks(Clusters, S->Children[i], nt, Eta, pBlocks, NumBlocks, NumAllocated);
+   }
+  else
+   { for(int i=0; i<2; i++)
+      for(int j=0; j<2; j++)
+       AddBlocks(Clusters, S->Children[i], T->Children[j], Eta,
+                 pBlocks, NumBlocks, NumAllocated);
+   };
+}
+
+/***************************************************************/
+/* collect the largest clusters with at most PCBlockSize       */
+/* indices; these define the diagonal blocks used for the      */
+/* block-Jacobi preconditioner                                 */
+/***************************************************************/
+static void GetPCClusters(ACACluster *Clusters, int nc, int PCBlockSize,
+                          int *PCClusters, int *NumPCClusters)
+{ 
+  ACACluster *C=Clusters+nc;
+  if ( C->Len<=PCBlockSize || C->Children[0]==-1 )
+   PCClusters[(*NumPCClusters)++]=nc;
+  else
+   for(int i=0; i<2; i++)
+    GetPCClusters(Clusters, C->Children[i], PCBlockSize, PCClusters, NumPCClusters);
+}
+
+/***************************************************************/
+/* adaptive cross approximation with partial pivoting of the   */
+/* NR x NC block with the given row and column indices. on     */
+/* success, returns the rank K and allocates U (NR x K) and    */
+/* V (NC x K), both column-major, with Block ~ U*V^T. returns  */
+/* -1 if the approximation did not converge before reaching    */
+/* the rank at which dense storage becomes cheaper.            */
+/***************************************************************/
+static int ACA(ACABlockFunc BlockFunc, void *UserData,
+               int *Rows, int NR, int *Cols, int NC, double Tol,
+               cdouble **pU, cdouble **pV)
+{
+  int MaxRank = (NR*NC) / (NR+NC);
+  if (MaxRank<1) return -1;
+
+  cdouble *U = (cdouble *)mallocEC(((size_t)NR)*MaxRank*sizeof(cdouble));
+  cdouble *V = (cdouble *)mallocEC(((size_t)NC)*MaxRank*sizeof(cdouble));
+  bool *RowUsed = (bool *)mallocEC(NR*sizeof(bool));
+
+  double NormS2=0.0;
+  int K=0, nr=0;
+  bool Converged=false;
+  while(K<MaxRank)
+   {
+     /*--------------------------------------------------------------*/
+     /*- get the residual of row nr and find its largest entry      -*/
+     /*--------------------------------------------------------------*/
+     RowUsed[nr]=true;
+     cdouble *v = V + ((size_t)K)*NC;
+     BlockFunc(UserData, Rows+nr, 1, Cols, NC, v);
+     for(int l=0; l<K; l++)
+      { cdouble Unl = U[((size_t)l)*NR + nr];
+        cdouble *Vl = V + ((size_t)l)*NC;
+        for(int nc=0; nc<NC; nc++)
+         v[nc] -= Unl*Vl[nc];
+      };
+     int ncStar=0;
+     double MaxAbs=0.0;
+     for(int nc=0; nc<NC; nc++)
+      if ( abs(v[nc]) > MaxAbs )
+       { MaxAbs=abs(v[nc]); ncStar=nc; }
+
+     if (MaxAbs==0.0)
+      { // this row is already exactly represented; try another
+        int nrNext=-1;
+        for(int n=0; n<NR && nrNext==-1; n++)
+         if (!RowUsed[n]) nrNext=n;
+        if (nrNext==-1)
+         { Converged=true; break; }
+        nr=nrNext;
+        continue;
+      };
+
+     cdouble Pivot=v[ncStar];
+     for(int nc=0; nc<NC; nc++)
+      v[nc] /= Pivot;
+
+     /*--------------------------------------------------------------*/
+     /*- get the residual of column ncStar                          -*/
+     /*--------------------------------------------------------------*/
+     cdouble *u = U + ((size_t)K)*NR;
+     BlockFunc(UserData, Rows, NR, Cols+ncStar, 1, u);
+     for(int l=0; l<K; l++)
+      { cdouble Vlc = V[((size_t)l)*NC + ncStar];
+        cdouble *Ul = U + ((size_t)l)*NR;
+        for(int n=0; n<NR; n++)
+         u[n] -= Vlc*Ul[n];
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- update the Frobenius norm of the approximation and check   -*/
+     /*- the stopping criterion                                     -*/
+     /*--------------------------------------------------------------*/
+     double u2=0.0, v2=0.0;
+     for(int n=0; n<NR; n++)  u2+=norm(u[n]);
+     for(int nc=0; nc<NC; nc++) v2+=norm(v[nc]);
+     cdouble Cross=0.0;
+     for(int l=0; l<K; l++)
+      { cdouble UU=0.0, VV=0.0;
+        cdouble *Ul = U + ((size_t)l)*NR, *Vl = V + ((size_t)l)*NC;
+        for(int n=0; n<NR; n++)  UU += conj(Ul[n])*u[n];
+        for(int nc=0; nc<NC; nc++) VV += conj(Vl[nc])*v[nc];
+        Cross += UU*VV;
+      };
+     NormS2 += u2*v2 + 2.0*real(Cross);
+     K++;
+
+     if ( sqrt(u2*v2) <= Tol*sqrt(fabs(NormS2)) )
+      { Converged=true; break; }
+
+     /*--------------------------------------------------------------*/
+     /*- next pivot row is the largest entry of u among unused rows -*/
+     /*--------------------------------------------------------------*/
+     int nrNext=-1;
+     MaxAbs=-1.0;
+     for(int n=0; n<NR; n++)
+      if ( !RowUsed[n] && abs(u[n])>MaxAbs )
+       { MaxAbs=abs(u[n]); nrNext=n; }
+     if (nrNext==-1)
+      { Converged=true; break; }
+     nr=nrNext;
+   };
+
+  free(RowUsed);
+  if (!Converged)
+   { free(U);
+     free(V);
+     return -1;
+   };
+
+  *pU = (cdouble *)reallocEC(U, ((size_t)NR)*(K>0 ? K : 1)*sizeof(cdouble));
+  *pV = (cdouble *)reallocEC(V, ((size_t)NC)*(K>0 ? K : 1)*sizeof(cdouble));
+  return K;
+}
+
+/***************************************************************/
+/* ACAMatrix constructor ***************************************/
+/***************************************************************/
+ACAMatrix::ACAMatrix(int pN, double *Points,
+                     ACABlockFunc pBlockFunc, void *pUserData,
+                     double pTol, int LeafSize, double Eta,
+                     int PCBlockSize)
+{
+  N=pN;
+  Tol=pTol;
+  BlockFunc=pBlockFunc;
+  UserData=pUserData;
+
+  /***************************************************************/
+  /* build the cluster tree **************************************/
+  /***************************************************************/
+  Perm = (int *)mallocEC(N*sizeof(int));
+  for(int n=0; n<N; n++)
+   Perm[n]=n;
+
+  ACACluster *Clusters=0;
+  int NumClusters=0, NumClustersAllocated=0;
+  AddCluster(Points, Perm, 0, N, LeafSize, &Clusters, &NumClusters, &NumClustersAllocated);
+
+  /***************************************************************/
+  /* build the block list ****************************************/
+  /***************************************************************/
+  Blocks=0;
+  NumBlocks=0;
+  int NumBlocksAllocated=0;
+  AddBlocks(Clusters, 0, 0, Eta, &Blocks, &NumBlocks, &NumBlocksAllocated);
+
+  /***************************************************************/
+  /* compute block entries; low-rank blocks for which ACA does   */
+  /* not converge are converted to dense blocks                  */
+  /***************************************************************/
+  int NumThreads = GetNumThreads();
+  Log("Compressing %ix%i matrix (%i blocks, %i threads)...",N,N,NumBlocks,NumThreads);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nb=0; nb<NumBlocks; nb++)
+   {
+     ACABlock *B=Blocks+nb;
+     int *Rows = Perm + B->RowStart, *Cols = Perm + B->ColStart;
+     if (B->Rank==0)
+      B->Rank=ACA(BlockFunc, UserData, Rows, B->NumRows, Cols, B->NumCols, Tol, &(B->U), &(B->V));
+     if (B->Rank==-1)
+      { B->U = (cdouble *)mallocEC( ((size_t)B->NumRows)*B->NumCols*sizeof(cdouble) );
+        BlockFunc(UserData, Rows, B->NumRows, Cols, B->NumCols, B->U);
+      };
+   };
+
+  NumDenseBlocks=NumLowRankBlocks=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   { if (Blocks[nb].Rank==-1)
+      NumDenseBlocks++;
+     else
+      NumLowRankBlocks++;
+   };
+  Log("...%i dense, %i low-rank blocks, %.1f%% of dense storage",
+       NumDenseBlocks, NumLowRankBlocks,
+       100.0*((double)GetStorage()) / (((double)N)*((double)N)*sizeof(cdouble)));
+
+  /***************************************************************/
+  /* block-Jacobi preconditioner: the diagonal blocks of the     */
+  /* matrix corresponding to the largest clusters with at most   */
+  /* PCBlockSize indices are assembled from the (dense and       */
+  /* low-rank) matrix blocks they contain and LU-factorized.     */
+  /* note that every matrix block either lies entirely inside    */
+  /* one of these diagonal blocks or does not overlap any of     */
+  /* them.                                                       */
+  /***************************************************************/
+  if (PCBlockSize<LeafSize)
+   PCBlockSize=LeafSize;
+  int *PCClusters = (int *)mallocEC(NumClusters*sizeof(int));
+  NumPCBlocks=0;
+  GetPCClusters(Clusters, 0, PCBlockSize, PCClusters, &NumPCBlocks);
+
+  PCBlocks   = (HMatrix **)mallocEC(NumPCBlocks*sizeof(HMatrix *));
+  PCStart    = (int *)mallocEC(NumPCBlocks*sizeof(int));
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int npc=0; npc<NumPCBlocks; npc++)
+   { 
+     int Start=Clusters[PCClusters[npc]].Start, Len=Clusters[PCClusters[npc]].Len;
+     PCStart[npc]  = Start;
+     PCBlocks[npc] = new HMatrix(Len, Len, LHM_COMPLEX);
+     PCBlocks[npc]->Zero();
+     for(int nb=0; nb<NumBlocks; nb++)
+      { ACABlock *B=Blocks+nb;
+        if (    B->RowStart<Start || B->RowStart+B->NumRows>Start+Len
+             || B->ColStart<Start || B->ColStart+B->NumCols>Start+Len
+           ) continue;
+        int NR=B->NumRows, NC=B->NumCols;
+        for(int nc=0; nc<NC; nc++)
+         for(int nr=0; nr<NR; nr++)
+          { cdouble Entry=0.0;
+            if (B->Rank==-1)
+             Entry=B->U[nr + ((size_t)nc)*NR];
+            else
+             for(int l=0; l<B->Rank; l++)
+              Entry+=B->U[nr + ((size_t)l)*NR] * B->V[nc + ((size_t)l)*NC];
+            PCBlocks[npc]->SetEntry(B->RowStart-Start+nr, B->ColStart-Start+nc, Entry);
+          };
+      };
+     PCBlocks[npc]->LUFactorize();
+   };
+  free(PCClusters);
+  free(Clusters);
+}
+
+/***************************************************************/
+/* ACAMatrix destructor ****************************************/
+/***************************************************************/
+ACAMatrix::~ACAMatrix()
+{
+  for(int nb=0; nb<NumBlocks; nb++)
+   { if (Blocks[nb].U) free(Blocks[nb].U);
+     if (Blocks[nb].V) free(Blocks[nb].V);
+   };
+  free(Blocks);
+  free(Perm);
+  for(int npc=0; npc<NumPCBlocks; npc++)
+   delete PCBlocks[npc];
+  free(PCBlocks);
+  free(PCStart);
+}
+
+/***************************************************************/
+/* storage (in bytes) occupied by the block entries            */
+/***************************************************************/
+size_t ACAMatrix::GetStorage()
+{
+  size_t NumEntries=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   { ACABlock *B=Blocks+nb;
+     if (B->Rank==-1)
+      NumEntries += ((size_t)B->NumRows)*B->NumCols;
+     else
+      NumEntries += ((size_t)B->Rank)*(B->NumRows + B->NumCols);
+   };
+  return NumEntries*sizeof(cdouble);
+}
+
+/***************************************************************/
+/* matrix-vector product in the permuted (cluster) ordering:   */
+/* MX = M*X.                                                   */
+/***************************************************************/
+void ACAMatrix::ApplyPermuted(cdouble *X, cdouble *MX)
+{
+  for(int n=0; n<N; n++)
+   MX[n]=0.0;
+
+  int NumThreads=1;
+#ifdef USE_OPENMP
+  NumThreads=GetNumThreads();
+#endif
+  cdouble *Buffers = NumThreads>1 ? (cdouble *)mallocEC(((size_t)NumThreads)*N*sizeof(cdouble)) : MX;
+  if (NumThreads>1)
+   for(size_t n=0; n<((size_t)NumThreads)*N; n++)
+    Buffers[n]=0.0;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nb=0; nb<NumBlocks; nb++)
+   {
+     int nt=0;
+#ifdef USE_OPENMP
+     nt=omp_get_thread_num();
+#endif
+     ACABlock *B=Blocks+nb;
+     int NR=B->NumRows, NC=B->NumCols;
+     cdouble *x=X + B->ColStart, *y=Buffers + ((size_t)nt)*N + B->RowStart;
+     if (B->Rank==-1)
+      { for(int nc=0; nc<NC; nc++)
+         { cdouble *Col = B->U + ((size_t)nc)*NR;
+           for(int nr=0; nr<NR; nr++)
+            y[nr] += Col[nr]*x[nc];
+         };
+      }
+     else
+      { for(int l=0; l<B->Rank; l++)
+         { cdouble *Ul = B->U + ((size_t)l)*NR, *Vl = B->V + ((size_t)l)*NC;
+           cdouble VX=0.0;
+           for(int nc=0; nc<NC; nc++)
+            VX += Vl[nc]*x[nc];
+           for(int nr=0; nr<NR; nr++)
+            y[nr] += Ul[nr]*VX;
+         };
+      };
+   };
+
+  if (NumThreads>1)
+   { for(int nt=0; nt<NumThreads; nt++)
+      for(int n=0; n<N; n++)
+       MX[n] += Buffers[((size_t)nt)*N + n];
+     free(Buffers);
+   };
+}
+
+/***************************************************************/
+/* matrix-vector product in the original ordering **************/
+/***************************************************************/
+void ACAMatrix::Apply(HVector *X, HVector *MX)
+{
+  if (X->N!=N || MX->N!=N)
+   ErrExit("%s:%i: dimension mismatch in ACAMatrix::Apply",__FILE__,__LINE__);
+
+  cdouble *XP  = (cdouble *)mallocEC(N*sizeof(cdouble));
+  cdouble *MXP = (cdouble *)mallocEC(N*sizeof(cdouble));
+  for(int n=0; n<N; n++)
+   XP[n]=X->GetEntry(Perm[n]);
+  ApplyPermuted(XP, MXP);
+  for(int n=0; n<N; n++)
+   MX->SetEntry(Perm[n], MXP[n]);
+  free(XP);
+  free(MXP);
+}
+
+/***************************************************************/
+/* apply the inverse of the block-Jacobi preconditioner to X   */
+/* (in place, permuted ordering)                               */
+/***************************************************************/
+void ACAMatrix::Precondition(cdouble *X)
+{
+  for(int npc=0; npc<NumPCBlocks; npc++)
+   { int Len=PCBlocks[npc]->NR;
+     HVector XBlock(Len, LHM_COMPLEX, (void *)(X+PCStart[npc]));
+     PCBlocks[npc]->LUSolve(&XBlock);
+   };
+}
+
+/***************************************************************/
+/* GMRES callbacks operating in the permuted ordering          */
+/***************************************************************/
+static void ACAApply(void *UserData, cdouble *X, cdouble *MX)
+{ ((ACAMatrix *)UserData)->ApplyPermuted(X, MX); }
+
+static void ACAPrecondition(void *UserData, cdouble *X)
+{ ((ACAMatrix *)UserData)->Precondition(X); }
+
+/***************************************************************/
+/* solve the system M*X = B by restarted GMRES with right      */
+/* block-Jacobi preconditioning. on entry X contains the RHS   */
+/* vector B; on return it contains the solution (as for        */
+/* HMatrix::LUSolve). the return value is the number of GMRES  */
+/* iterations, or -1 if the iteration did not converge to      */
+/* relative residual RelTol within MaxIters iterations.        */
+/***************************************************************/
+int ACAMatrix::GMRESSolve(HVector *X, double RelTol, int MaxIters, int Restart)
+{
+  if (X->N!=N)
+   ErrExit("%s:%i: dimension mismatch in ACAMatrix::GMRESSolve",__FILE__,__LINE__);
+
+  cdouble *XP = (cdouble *)mallocEC(N*sizeof(cdouble));
+  for(int n=0; n<N; n++)
+   XP[n]=X->GetEntry(Perm[n]);
+  int Iters=GMRES(N, ACAApply, ACAPrecondition, (void *)this,
+                  XP, RelTol, MaxIters, Restart);
+  for(int n=0; n<N; n++)
+   X->SetEntry(Perm[n], XP[n]);
+  free(XP);
+  return Iters;
+}
@@ -0,0 +1,198 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * GMRES.cc  -- restarted GMRES with right preconditioning for
+ *           -- square complex systems whose matrix is available
+ *           -- only through its action on vectors
+ *
+ * This routine is shared by the matrix-free solvers in libhmat
+ * (ACAMatrix) and libscuff (MultipoleBEMOperator).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+
+#include "libhmat.h"
+
+/***************************************************************/
+/* solve the system M*X = B by restarted GMRES with right      */
+/* preconditioning, where M is available only through the      */
+/* user's routine Apply(UserData, X, MX), which sets MX=M*X.   */
+/* if Precondition is non-NULL, Precondition(UserData, X)      */
+/* replaces X with P^{-1}*X in place for some approximation P  */
+/* to M.                                                       */
+/*                                                             */
+/* on entry X contains the RHS vector B; on return it contains */
+/* the solution (as for HMatrix::LUSolve). the return value is */
+/* the number of GMRES iterations, or -1 if the iteration did  */
+/* not converge to relative residual RelTol within MaxIters    */
+/* iterations.                                                 */
+/***************************************************************/
+int GMRES(int N, GMRESApplyFunc Apply, GMRESPrecondFunc Precondition,
+          void *UserData, cdouble *X, double RelTol, int MaxIters, int Restart)
+{
+  if (Restart<1) Restart=1;
+
+  int m=Restart;
+  cdouble *B   = (cdouble *)mallocEC(N*sizeof(cdouble));
+  cdouble *XX  = (cdouble *)mallocEC(N*sizeof(cdouble));
+  cdouble *R   = (cdouble *)mallocEC(N*sizeof(cdouble));
+  cdouble *W   = (cdouble *)mallocEC(N*sizeof(cdouble));
+  cdouble *Vs  = (cdouble *)mallocEC(((size_t)N)*(m+1)*sizeof(cdouble));
+  cdouble *H   = (cdouble *)mallocEC(((size_t)(m+1))*m*sizeof(cdouble));
+  cdouble *g   = (cdouble *)mallocEC((m+1)*sizeof(cdouble));
+  cdouble *y   = (cdouble *)mallocEC(m*sizeof(cdouble));
+  double  *cs  = (double  *)mallocEC(m*sizeof(double));
+  cdouble *sn  = (cdouble *)mallocEC(m*sizeof(cdouble));
+#define HH(i,j) H[(i) + (j)*(m+1)]
+
+  double BNorm=0.0;
+  for(int n=0; n<N; n++)
+   { B[n]=X[n];
+     XX[n]=0.0;
+     BNorm+=norm(B[n]);
+   };
+  BNorm=sqrt(BNorm);
+
+  int Iters=0;
+  bool Converged = (BNorm==0.0);
+  double RelResidual = 0.0;
+  while( !Converged && Iters<MaxIters )
+   {
+     /*--------------------------------------------------------------*/
+     /*- R = B - M*XX -----------------------------------------------*/
+     /*--------------------------------------------------------------*/
+     Apply(UserData, XX, R);
+     double Beta=0.0;
+     for(int n=0; n<N; n++)
+      { R[n] = B[n] - R[n];
+        Beta += norm(R[n]);
+      };
+     Beta=sqrt(Beta);
+     RelResidual = Beta/BNorm;
+     if ( RelResidual < RelTol )
+      { Converged=true; break; }
+
+     for(int n=0; n<N; n++)
+      Vs[n] = R[n]/Beta;
+     g[0]=Beta;
+     for(int i=1; i<=m; i++) g[i]=0.0;
+
+     /*--------------------------------------------------------------*/
+     /*- Arnoldi iteration ------------------------------------------*/
+     /*--------------------------------------------------------------*/
+     int j;
+     for(j=0; j<m && Iters<MaxIters; j++)
+      {
+        Iters++;
+        cdouble *Vj = Vs + ((size_t)j)*N;
+        memcpy(R, Vj, N*sizeof(cdouble));
+        if (Precondition) Precondition(UserData, R);
+        Apply(UserData, R, W);
+
+        // modified Gram-Schmidt
+        for(int i=0; i<=j; i++)
+         { cdouble *Vi = Vs + ((size_t)i)*N;
+           cdouble Dot=0.0;
+           for(int n=0; n<N; n++)
+            Dot += conj(Vi[n])*W[n];
+           HH(i,j)=Dot;
+           for(int n=0; n<N; n++)
+            W[n] -= Dot*Vi[n];
+         };
+        double WNorm=0.0;
+        for(int n=0; n<N; n++)
+         WNorm+=norm(W[n]);
+        WNorm=sqrt(WNorm);
+        HH(j+1,j)=WNorm;
+        if (WNorm!=0.0)
+         { cdouble *Vj1 = Vs + ((size_t)(j+1))*N;
+           for(int n=0; n<N; n++)
+            Vj1[n] = W[n]/WNorm;
+         };
+
+        // apply previous Givens rotations to the new column
+        for(int i=0; i<j; i++)
+         { cdouble h1=HH(i,j), h2=HH(i+1,j);
+           HH(i,j)   =  cs[i]*h1 + sn[i]*h2;
+           HH(i+1,j) = -conj(sn[i])*h1 + cs[i]*h2;
+         };
+
+        // compute and apply a new rotation to zero out HH(j+1,j)
+        cdouble a=HH(j,j), b=HH(j+1,j);
+        double Denom = sqrt(norm(a) + norm(b));
+        if (Denom==0.0)
+         { cs[j]=1.0; sn[j]=0.0; }
+        else if (abs(a)==0.0)
+         { cs[j]=0.0; sn[j]=conj(b)/abs(b); }
+        else
+         { cs[j] = abs(a)/Denom;
+           sn[j] = (a/abs(a))*conj(b)/Denom;
+         };
+        HH(j,j)   = cs[j]*a + sn[j]*b;
+        HH(j+1,j) = 0.0;
+        g[j+1] = -conj(sn[j])*g[j];
+        g[j]   = cs[j]*g[j];
+
+        RelResidual = abs(g[j+1])/BNorm;
+        if ( RelResidual<RelTol || WNorm==0.0 )
+         { Converged=true; j++; break; }
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- solve the upper-triangular least-squares system and update -*/
+     /*- the solution: XX += P^{-1} * (V*y)                         -*/
+     /*--------------------------------------------------------------*/
+     for(int i=j-1; i>=0; i--)
+      { cdouble Sum=g[i];
+        for(int k=i+1; k<j; k++)
+         Sum -= HH(i,k)*y[k];
+        y[i] = Sum / HH(i,i);
+      };
+     for(int n=0; n<N; n++)
+      R[n]=0.0;
+     for(int i=0; i<j; i++)
+      { cdouble *Vi = Vs + ((size_t)i)*N;
+        for(int n=0; n<N; n++)
+         R[n] += y[i]*Vi[n];
+      };
+     if (Precondition) Precondition(UserData, R);
+     for(int n=0; n<N; n++)
+      XX[n] += R[n];
+   };
+#undef HH
+
+  memcpy(X, XX, N*sizeof(cdouble));
+
+  free(B); free(XX); free(R); free(W); free(Vs);
+  free(H); free(g); free(y); free(cs); free(sn);
+
+  if (!Converged)
+   { Warn("GMRES did not converge in %i iterations (relative residual %e)",Iters,RelResidual);
+     return -1;
+   };
+  Log("GMRES converged in %i iterations (relative residual %e)",Iters,RelResidual);
+  return Iters;
+}
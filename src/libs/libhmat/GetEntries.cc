@@ -487,6 +487,8 @@ void HMatrix::DoSetEntries(int RowStart, int RowStop, int RowInc, int RowLen,
                            int ColStart, int ColStop, int ColInc, int ColLen,
                            HMatrix *B, cdouble Entry)
 {
+  Symmetric=false;
+
   /*--------------------------------------------------------------*/
   /*- sanity checks on requested row/column swaths ---------------*/
   /*--------------------------------------------------------------*/
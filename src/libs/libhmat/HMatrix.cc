@@ -36,6 +36,13 @@ extern "C" {
 
 #include "libhmat.h"
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
 /*--------------------------------------------------------------*/
 /*--------------------------------------------------------------*/
 /* implementation of HMatrix class methods    ------------------*/
@@ -76,6 +83,9 @@ void HMatrix::InitHMatrix(int NRows, int NCols, int pRealComplex,
    RealComplex=pRealComplex;
    StorageType=pStorageType;
    ipiv=0;
+   Symmetric=false;
+   SymFactored=false;
+   LeadingBlockDim=0;
    lwork=0;
    work=0;
    liwork=0;
@@ -261,6 +271,7 @@ HMatrix::~HMatrix()
 /***************************************************************/
 void HMatrix::Zero()
 { 
+  Symmetric=false;
   if (RealComplex==LHM_REAL)
    memset(DM,0,NumEntries()*sizeof(double));
   else
@@ -315,6 +326,7 @@ void HMatrix::Copy(HMatrix *M)
        SetEntry(nr,nc,M->GetEntry(nr,nc));
    };
 
+  Symmetric = (StorageType==LHM_NORMAL && M->Symmetric);
 }
 
 /***************************************************************/
@@ -383,6 +395,7 @@ double HMatrix::GetTraceD()
 void HMatrix::SetEntry(size_t nr, size_t nc, cdouble Entry)
 {
   size_t Index, Flipped;
+  if (Symmetric) Symmetric=false;
   
   Flipped=0;
   if (StorageType!=LHM_NORMAL && nr>nc) 
@@ -402,6 +415,7 @@ void HMatrix::SetEntry(size_t nr, size_t nc, cdouble Entry)
 void HMatrix::SetEntry(size_t nr, size_t nc, double Entry)
 {
   size_t Index;
+  if (Symmetric) Symmetric=false;
 
   if (StorageType!=LHM_NORMAL && nr>nc) 
    { Index=nr; nr=nc; nc=Index; }
@@ -421,6 +435,7 @@ void HMatrix::SetEntry(size_t nr, size_t nc, double Entry)
 void HMatrix::AddEntry(size_t nr, size_t nc, cdouble Entry)
 {
   size_t Index, Flipped;
+  if (Symmetric) Symmetric=false;
 
   Flipped=0;
   if (StorageType!=LHM_NORMAL && nr>nc) 
@@ -439,6 +454,7 @@ void HMatrix::AddEntry(size_t nr, size_t nc, cdouble Entry)
 void HMatrix::AddEntry(size_t nr, size_t nc, double Entry)
 {
   size_t Index;
+  if (Symmetric) Symmetric=false;
 
   if (StorageType!=LHM_NORMAL && nr>nc) 
    { Index=nr; nr=nc; nc=Index; }
@@ -609,6 +625,172 @@ void HMatrix::Transpose()
 
 }
 
+/***************************************************************/
+/* true if a square LHM_NORMAL matrix equals its transpose     */
+/***************************************************************/
+bool HMatrix::IsSymmetric()
+{
+  if (StorageType!=LHM_NORMAL || NR!=NC)
+   return false;
+
+  size_t LDA = NR;
+  for(size_t nc=0; nc<LDA; nc++)
+   for(size_t nr=nc+1; nr<LDA; nr++)
+    if ( RealComplex==LHM_REAL ? (DM[nr + nc*LDA] != DM[nc + nr*LDA])
+                               : (ZM[nr + nc*LDA] != ZM[nc + nr*LDA]) )
+     return false;
+  return true;
+}
+
+/***************************************************************/
+/* copy the upper triangle of a square matrix into its lower   */
+/* triangle. we work in square tiles so that both the source   */
+/* rows and the destination columns stay in cache, and hand    */
+/* out block columns of the lower triangle to threads.         */
+/***************************************************************/
+#define FLT_TILESIZE 32
+void HMatrix::FillLowerTriangle()
+{ 
+  if (StorageType!=LHM_NORMAL || NR!=NC)
+   return;
+
+  int NumTiles = (NR + FLT_TILESIZE - 1) / FLT_TILESIZE;
+  size_t LDA = NR;
+#ifdef USE_OPENMP
+  int NumThreads = omp_in_parallel() ? 1 : GetNumThreads();
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int ncTile=0; ncTile<NumTiles; ncTile++)
+   for(int nrTile=ncTile; nrTile<NumTiles; nrTile++)
+    { int ncMin=ncTile*FLT_TILESIZE, ncMax=ncMin+FLT_TILESIZE;
+      int nrMin=nrTile*FLT_TILESIZE, nrMax=nrMin+FLT_TILESIZE;
+      if (ncMax>NC) ncMax=NC;
+      if (nrMax>NR) nrMax=NR;
+      for(int nc=ncMin; nc<ncMax; nc++)
+       for(int nr=(nrMin>nc+1 ? nrMin : nc+1); nr<nrMax; nr++)
+        if (RealComplex==LHM_REAL)
+         DM[nr + nc*LDA] = DM[nc + nr*LDA];
+        else
+         ZM[nr + nc*LDA] = ZM[nc + nr*LDA];
+    };
+}
+
+/***************************************************************/
+/* fast kernel for the block operations below. for matrices in */
+/* normal (unpacked) storage, this computes                    */
+/*                                                             */
+/*  D[nr,nc] (+)= Alpha*S[nr,nc] + Beta*S'[nc,nr]              */
+/*                                                             */
+/* for 0<=nr<NR, 0<=nc<NC, where D and S point to the upper-   */
+/* left corners of the destination and source blocks, LDD and  */
+/* LDS are the leading dimensions, and S' is S or its complex  */
+/* conjugate. the Alpha (Beta) term is omitted if UseAlpha     */
+/* (UseBeta) is false. we work on square tiles so that the     */
+/* transposed term stays in cache, and hand out block columns  */
+/* to threads if the block is large enough to be worth it and  */
+/* we are not already running inside a parallel region (as we  */
+/* are when the SSI assembly threads stamp their row tiles).   */
+/* the innermost loops run down columns of D with no branches, */
+/* so the compiler can vectorize them.                         */
+/***************************************************************/
+#define BLOCKOP_TILESIZE    32
+#define BLOCKOP_MINPARALLEL 65536
+
+static inline double ConjIf(double x, bool Conj)  { (void)Conj; return x; }
+static inline cdouble ConjIf(cdouble z, bool Conj) { return Conj ? conj(z) : z; }
+
+template<typename TD, typename TS>
+static void BlockKernel(TD *D, size_t LDD, TS *S, size_t LDS,
+                        int NR, int NC, TD Alpha, bool UseAlpha,
+                        TD Beta, bool UseBeta, bool Conj, bool Accumulate)
+{
+  int NumRowTiles = (NR + BLOCKOP_TILESIZE - 1) / BLOCKOP_TILESIZE;
+  int NumColTiles = (NC + BLOCKOP_TILESIZE - 1) / BLOCKOP_TILESIZE;
+  bool Parallel   = ( ((size_t)NR)*NC >= BLOCKOP_MINPARALLEL );
+#ifdef USE_OPENMP
+  if (omp_in_parallel()) Parallel=false;
+#endif
+  bool Copy       = !Accumulate && UseAlpha && Alpha==TD(1.0);
+
+#ifdef USE_OPENMP
+  int NumThreads = Parallel ? GetNumThreads() : 1;
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#else
+  (void)Parallel;
+#endif
+  for(int ncTile=0; ncTile<NumColTiles; ncTile++)
+   for(int nrTile=0; nrTile<NumRowTiles; nrTile++)
+    { 
+      int ncMin=ncTile*BLOCKOP_TILESIZE, ncMax=ncMin+BLOCKOP_TILESIZE;
+      int nrMin=nrTile*BLOCKOP_TILESIZE, nrMax=nrMin+BLOCKOP_TILESIZE;
+      if (ncMax>NC) ncMax=NC;
+      if (nrMax>NR) nrMax=NR;
+
+      for(int nc=ncMin; nc<ncMax; nc++)
+       { TD *DCol = D + nc*LDD;
+         TS *SCol = S + nc*LDS;
+         TS *SRow = S + nc;
+
+         if (Copy)
+          for(int nr=nrMin; nr<nrMax; nr++)
+           DCol[nr] = SCol[nr];
+         else if (!Accumulate && UseAlpha)
+          for(int nr=nrMin; nr<nrMax; nr++)
+           DCol[nr] = Alpha*SCol[nr];
+         else if (!Accumulate)
+          for(int nr=nrMin; nr<nrMax; nr++)
+           DCol[nr] = 0.0;
+         else if (UseAlpha)
+          for(int nr=nrMin; nr<nrMax; nr++)
+           DCol[nr] += Alpha*SCol[nr];
+
+         if (UseBeta)
+          for(int nr=nrMin; nr<nrMax; nr++)
+           DCol[nr] += Beta*ConjIf(SRow[nr*LDS], Conj);
+       };
+    };
+}
+
+/***************************************************************/
+/* dispatch a block operation to BlockKernel if the storage    */
+/* types allow it; returns false otherwise, in which case the  */
+/* caller falls back to entry-by-entry operations.             */
+/* (DRow, DCol) and (SRow, SCol) are the upper-left corners of */
+/* the destination and source blocks; NR x NC are the          */
+/* dimensions of the destination block.                        */
+/***************************************************************/
+static bool FastBlockOp(HMatrix *Dst, int DRow, int DCol,
+                        HMatrix *Src, int SRow, int SCol,
+                        int NR, int NC, cdouble Alpha, cdouble Beta,
+                        bool Conj, bool Accumulate)
+{
+  if ( Dst->StorageType!=LHM_NORMAL || Src->StorageType!=LHM_NORMAL )
+   return false;
+  if ( NR<=0 || NC<=0 )
+   return true;
+
+  bool UseAlpha = (Alpha!=0.0), UseBeta = (Beta!=0.0);
+  size_t LDD = Dst->NR, LDS = Src->NR;
+  size_t DOffset = DRow + DCol*LDD, SOffset = SRow + SCol*LDS;
+
+  if ( Dst->RealComplex==LHM_COMPLEX && Src->RealComplex==LHM_COMPLEX )
+   BlockKernel<cdouble, cdouble>(Dst->ZM + DOffset, LDD, Src->ZM + SOffset, LDS,
+                                 NR, NC, Alpha, UseAlpha, Beta, UseBeta,
+                                 Conj, Accumulate);
+  else if ( Dst->RealComplex==LHM_COMPLEX )
+   BlockKernel<cdouble, double>(Dst->ZM + DOffset, LDD, Src->DM + SOffset, LDS,
+                                NR, NC, Alpha, UseAlpha, Beta, UseBeta,
+                                Conj, Accumulate);
+  else if ( Src->RealComplex==LHM_REAL && imag(Alpha)==0.0 && imag(Beta)==0.0 )
+   BlockKernel<double, double>(Dst->DM + DOffset, LDD, Src->DM + SOffset, LDS,
+                               NR, NC, real(Alpha), UseAlpha, real(Beta), UseBeta,
+                               Conj, Accumulate);
+  else
+   return false;
+
+  return true;
+}
+
 /***************************************************************/
 /* stamp the full matrix B into this matrix in such a way that */
 /* the upper-left entry of B goes into slot (RowOffset,ColOffset). */
@@ -616,10 +798,14 @@ void HMatrix::Transpose()
 void HMatrix::InsertBlock(HMatrix *B, int RowOffset, int ColOffset)
 { 
   size_t nr, nc;
+  Symmetric=false;
 
   if ( ((RowOffset + B->NR) > NR) || ((ColOffset + B->NC) > NC) )
    ErrExit("InsertBlock(): block insertion exceeds matrix size");
 
+  if (FastBlockOp(this, RowOffset, ColOffset, B, 0, 0, B->NR, B->NC, 1.0, 0.0, false, false))
+   return;
+
   for (nr=0; nr<B->NR; nr++)
    for (nc=0; nc<B->NC; nc++)
     SetEntry(RowOffset+nr, ColOffset+nc, B->GetEntry(nr,nc) );
@@ -633,12 +819,16 @@ void HMatrix::InsertBlock(HMatrix *B, int RowOffset, int ColOffset,
                           int NRB, int NCB, int BRowOffset, int BColOffset)
 {
   size_t nr, nc;
+  Symmetric=false;
 
   if ( ((RowOffset + NRB) > NR) || ((ColOffset + NCB) > NC) )
    ErrExit("InsertBlock(): block insertion exceeds matrix size");
   if ( ((BRowOffset + NRB) > B->NR) || ((BColOffset + NCB) > B->NC) )
    ErrExit("InsertBlock(): block insertion exceeds block size");
 
+  if (FastBlockOp(this, RowOffset, ColOffset, B, BRowOffset, BColOffset, NRB, NCB, 1.0, 0.0, false, false))
+   return;
+
   for (nr=0; nr<NRB; nr++)
    for (nc=0; nc<NCB; nc++)
     SetEntry(RowOffset+nr, ColOffset+nc, B->GetEntry(BRowOffset+nr,BColOffset+nc) );
@@ -656,10 +846,14 @@ void HMatrix::InsertBlock(HMatrix *B, int RowOffset, int ColOffset,
 void HMatrix::InsertBlockAdjoint(HMatrix *B, int RowOffset, int ColOffset)
 { 
   size_t nr, nc;
+  Symmetric=false;
 
   if ( ((RowOffset + B->NC) > NR) || ((ColOffset + B->NR) > NC) )
    ErrExit("InsertBlockAdjoint(): block insertion exceeds matrix size");
 
+  if (FastBlockOp(this, RowOffset, ColOffset, B, 0, 0, B->NC, B->NR, 0.0, 1.0, true, false))
+   return;
+
   if (B->RealComplex==LHM_COMPLEX)
    { for (nr=0; nr<B->NR; nr++)
       for (nc=0; nc<B->NC; nc++)
@@ -683,10 +877,14 @@ void HMatrix::InsertBlockAdjoint(HMatrix *B, int RowOffset, int ColOffset)
 void HMatrix::InsertBlockTranspose(HMatrix *B, int RowOffset, int ColOffset)
 { 
   size_t nr, nc;
+  Symmetric=false;
 
   if ( ((RowOffset + B->NC) > NR) || ((ColOffset + B->NR) > NC) )
    ErrExit("InsertBlockTranspose(): block insertion exceeds matrix size");
 
+  if (FastBlockOp(this, RowOffset, ColOffset, B, 0, 0, B->NC, B->NR, 0.0, 1.0, false, false))
+   return;
+
   if (B->RealComplex==LHM_COMPLEX)
    { for (nr=0; nr<B->NR; nr++)
       for (nc=0; nc<B->NC; nc++)
@@ -705,9 +903,13 @@ void HMatrix::InsertBlockTranspose(HMatrix *B, int RowOffset, int ColOffset)
 /***************************************************************/
 void HMatrix::AddBlock(HMatrix *B, int RowOffset, int ColOffset)
 { 
+  Symmetric=false;
   if ( ((RowOffset + B->NR) > NR) || ((ColOffset + B->NC) > NC) )
    ErrExit("AddBlock(): block insertion exceeds matrix size");
 
+  if (FastBlockOp(this, RowOffset, ColOffset, B, 0, 0, B->NR, B->NC, 1.0, 0.0, false, true))
+   return;
+
   for (size_t nr=0; nr<B->NR; nr++)
    for (size_t nc=0; nc<B->NC; nc++)
     AddEntry(RowOffset+nr, ColOffset+nc, B->GetEntry(nr,nc) );
@@ -716,10 +918,14 @@ void HMatrix::AddBlock(HMatrix *B, int RowOffset, int ColOffset)
 void HMatrix::AddBlockAdjoint(HMatrix *B, int RowOffset, int ColOffset)
 { 
   size_t nr, nc;
+  Symmetric=false;
 
   if ( ((RowOffset + B->NC) > NR) || ((ColOffset + B->NR) > NC) )
    ErrExit("AddBlockAdjoint(): block addition exceeds matrix size");
 
+  if (FastBlockOp(this, RowOffset, ColOffset, B, 0, 0, B->NC, B->NR, 0.0, 1.0, true, true))
+   return;
+
   if (B->RealComplex==LHM_COMPLEX)
    { for (nr=0; nr<B->NR; nr++)
       for (nc=0; nc<B->NC; nc++)
@@ -732,12 +938,57 @@ void HMatrix::AddBlockAdjoint(HMatrix *B, int RowOffset, int ColOffset)
    };
 }
 
+/***************************************************************/
+/* add Alpha*B + Beta*B^T (non-conjugate transpose) into the   */
+/* block of this matrix whose upper-left corner is at          */
+/* (RowOffset, ColOffset). only the upper-left NRBxNCB block   */
+/* of B (and the NCBxNRB block of B^T) is used; NRB=NCB=-1     */
+/* means all of B, which must then be square if Beta!=0.       */
+/* this is the stamping operation for periodic geometries,     */
+/* where Alpha and Beta are Bloch phase factors.               */
+/***************************************************************/
+static void AddScaledBlock(HMatrix *M, HMatrix *B, int RowOffset, int ColOffset,
+                           cdouble Alpha, cdouble Beta, int NRB, int NCB)
+{
+  if ( ((RowOffset + NRB) > M->NR) || ((ColOffset + NCB) > M->NC) )
+   ErrExit("AddBlockWithTranspose(): block addition exceeds matrix size");
+  if ( NRB>B->NR || NCB>B->NC || (Beta!=0.0 && (NCB>B->NR || NRB>B->NC)) )
+   ErrExit("AddBlockWithTranspose(): block addition exceeds block size");
+
+  if (FastBlockOp(M, RowOffset, ColOffset, B, 0, 0, NRB, NCB, Alpha, Beta, false, true))
+   return;
+
+  // AddEntry() only reads the Symmetric flag once it is clear
+  for(int nr=0; nr<NRB; nr++)
+   for(int nc=0; nc<NCB; nc++)
+    { cdouble Entry = Alpha*B->GetEntry(nr,nc);
+      if (Beta!=0.0) Entry += Beta*B->GetEntry(nc,nr);
+      M->AddEntry(RowOffset+nr, ColOffset+nc, Entry);
+    };
+}
+
+void HMatrix::AddBlockWithTranspose(HMatrix *B, int RowOffset, int ColOffset,
+                                    cdouble Alpha, cdouble Beta,
+                                    int NRB, int NCB)
+{
+  Symmetric=false;
+  if (NRB==-1) NRB=B->NR;
+  if (NCB==-1) NCB=B->NC;
+  AddScaledBlock(this, B, RowOffset, ColOffset, Alpha, Beta, NRB, NCB);
+}
+
+void HMatrix::AddTile(HMatrix *B, int RowOffset, int ColOffset, int NRB, int NCB)
+{
+  AddScaledBlock(this, B, RowOffset, ColOffset, 1.0, 0.0, NRB, NCB);
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
 void HMatrix::AddBlock(SMatrix *B, int RowOffset, int ColOffset,
                        cdouble ScaleFactor)
 { 
+  Symmetric=false;
   if ( ((RowOffset + B->NR) > NR) || ((ColOffset + B->NC) > NC) )
    ErrExit("AddBlock(): block insertion exceeds matrix size");
   
@@ -771,6 +1022,10 @@ void HMatrix::ExtractBlock(int RowOffset, int ColOffset, HMatrix *B)
   if ( ((RowOffset + B->NR) > NR) || ((ColOffset + B->NC) > NC) )
    ErrExit("ExtractBlock(): block extraction exceeds matrix size");
 
+  B->Symmetric=false;
+  if (FastBlockOp(B, 0, 0, this, RowOffset, ColOffset, B->NR, B->NC, 1.0, 0.0, false, false))
+   return;
+
   for (nr=0; nr<B->NR; nr++)
    for (nc=0; nc<B->NC; nc++)
     B->SetEntry(nr, nc, GetEntry(RowOffset+nr,ColOffset+nc) );
@@ -38,6 +38,13 @@ extern "C" {
 
 #include "libhmat.h"
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
 /***************************************************************/
 /* multiply matrix by B on the right to yield C                */
 /* in other words, if this matrix is A, then this operation    */
@@ -146,7 +153,10 @@ void HMatrix::GetMatrixProductDiagonal(HMatrix *B, HVector *DAB)
 }
 
 /***************************************************************/
-/* replace the matrix with its LU factorization ****************/
+/* replace the matrix with its LU factorization.               */
+/* if the Symmetric flag is set, we use the blocked            */
+/* Bunch-Kaufman factorization M = U*D*U^T (xsytrf) in place   */
+/* of xgetrf; only the upper triangle of M is referenced.      */
 /***************************************************************/
 int HMatrix::LUFactorize()
 { 
@@ -155,7 +165,44 @@ int HMatrix::LUFactorize()
   if (ipiv==0)
    ipiv=(int *)mallocEC(NR*sizeof(int));
 
-  if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
+  SymFactored = (Symmetric && StorageType==LHM_NORMAL && NR==NC);
+  Symmetric   = false;
+
+  // the flag is cleared by all HMatrix routines that modify entries,
+  // but not by callers that write DM or ZM directly, so we check that
+  // the lower triangle really mirrors the upper before relying on it
+  // (O(N^2) work against the O(N^3) of the factorization)
+  if (SymFactored && !IsSymmetric())
+   SymFactored=false;
+  LeadingBlockDim = 0;
+
+  if (SymFactored)
+   { 
+     // workspace size query
+     int MinusOne=-1, lworkOptimal;
+     if (RealComplex==LHM_REAL)
+      { double dlworkOptimal;
+        dsytrf_("U", &NR, DM, &NR, ipiv, &dlworkOptimal, &MinusOne, &info);
+        lworkOptimal=(int)dlworkOptimal;
+      }
+     else
+      { cdouble zlworkOptimal;
+        zsytrf_("U", &NR, ZM, &NR, ipiv, &zlworkOptimal, &MinusOne, &info);
+        lworkOptimal=(int)real(zlworkOptimal);
+      };
+
+     if (lworkOptimal > lwork)
+      { if (work) free(work);
+        work=mallocEC(lworkOptimal*(RealComplex==LHM_REAL ? sizeof(double) : sizeof(cdouble)));
+        lwork=lworkOptimal;
+      };
+
+     if (RealComplex==LHM_REAL)
+      dsytrf_("U", &NR, DM, &NR, ipiv, (double *)work, &lwork, &info);
+     else
+      zsytrf_("U", &NR, ZM, &NR, ipiv, (cdouble *)work, &lwork, &info);
+   }
+  else if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    dgetrf_(&NR, &NC, DM, &NR, ipiv, &info); 
   else if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
    dsptrf_("U", &NR, DM, ipiv, &info);
@@ -169,6 +216,134 @@ int HMatrix::LUFactorize()
   return info;
 }
 
+/***************************************************************/
+/* block LU factorization                                      */
+/*                                                             */
+/*  | A  B |   | L11  0  | | U11 U12 |                         */
+/*  | C  D | = | L21 L22 | |  0  U22 |                         */
+/*                                                             */
+/* where A is NAxNA. We factorize P1*A = L11*U11 (xgetrf),     */
+/* then set U12 = L11 \ P1*B, L21 = C / U11, and factorize     */
+/* the Schur complement P2*(D - L21*U12) = L22*U22 (xgetrf).   */
+/* Rows of L21 are swapped by P2 and the pivot indices for the */
+/* trailing block are offset by NA, so the result has exactly  */
+/* the layout of an xgetrf factorization (with pivoting        */
+/* confined to the diagonal blocks) and is understood by       */
+/* LUSolve() and LUInvert().                                   */
+/*                                                             */
+/* If ReuseLeadingBlock is true, the leading block must still  */
+/* hold L11, U11 from a previous call with the same NA; only   */
+/* the B, C, and D blocks are read.                            */
+/***************************************************************/
+int HMatrix::LUFactorizeBlocked(int NA, bool ReuseLeadingBlock)
+{
+  if (NR!=NC || StorageType!=LHM_NORMAL)
+   ErrExit("LUFactorizeBlocked() requires a square matrix with normal storage");
+
+  if (NA<=0 || NA>=NR)
+   { if (ReuseLeadingBlock)
+      ErrExit("LUFactorizeBlocked(): invalid leading block dimension %i",NA);
+     Symmetric=false;
+     return LUFactorize();
+   };
+
+  if ( ReuseLeadingBlock && (ipiv==0 || SymFactored || LeadingBlockDim!=NA) )
+   ErrExit("LUFactorizeBlocked(): no factorization of %ix%i leading block to reuse",NA,NA);
+
+  if (ipiv==0)
+   ipiv=(int *)mallocEC(NR*sizeof(int));
+  Symmetric=SymFactored=false;
+  LeadingBlockDim=0;
+
+  int NB=NR-NA, iOne=1, InfoA=0, InfoS=0;
+  if (RealComplex==LHM_REAL)
+   { double *A=DM, *B=DM + ((size_t)NA)*NR, *C=DM+NA, *D=B+NA;
+     double One=1.0, MinusOne=-1.0;
+     if (!ReuseLeadingBlock)
+      dgetrf_(&NA, &NA, A, &NR, ipiv, &InfoA);
+     dlaswp_(&NB, B, &NR, &iOne, &NA, ipiv, &iOne);
+     dtrsm_("L", "L", "N", "U", &NA, &NB, &One, A, &NR, B, &NR);
+     dtrsm_("R", "U", "N", "N", &NB, &NA, &One, A, &NR, C, &NR);
+     dgemm_("N", "N", &NB, &NB, &NA, &MinusOne, C, &NR, B, &NR, &One, D, &NR);
+     dgetrf_(&NB, &NB, D, &NR, ipiv+NA, &InfoS);
+     dlaswp_(&NA, C, &NR, &iOne, &NB, ipiv+NA, &iOne);
+   }
+  else
+   { cdouble *A=ZM, *B=ZM + ((size_t)NA)*NR, *C=ZM+NA, *D=B+NA;
+     cdouble One=1.0, MinusOne=-1.0;
+     if (!ReuseLeadingBlock)
+      zgetrf_(&NA, &NA, A, &NR, ipiv, &InfoA);
+     zlaswp_(&NB, B, &NR, &iOne, &NA, ipiv, &iOne);
+     ztrsm_("L", "L", "N", "U", &NA, &NB, &One, A, &NR, B, &NR);
+     ztrsm_("R", "U", "N", "N", &NB, &NA, &One, A, &NR, C, &NR);
+     zgemm_("N", "N", &NB, &NB, &NA, &MinusOne, C, &NR, B, &NR, &One, D, &NR);
+     zgetrf_(&NB, &NB, D, &NR, ipiv+NA, &InfoS);
+     zlaswp_(&NA, C, &NR, &iOne, &NB, ipiv+NA, &iOne);
+   };
+
+  for(int n=NA; n<NR; n++)
+   ipiv[n]+=NA;
+  LeadingBlockDim=NA;
+
+  if (InfoA!=0) return InfoA;
+  if (InfoS>0)  return InfoS+NA;
+  return InfoS;
+}
+
+/***************************************************************/
+/* lower-left NBxNA block of the inverse, computed from the    */
+/* factors left by LUFactorizeBlocked(NA):                     */
+/*                                                             */
+/*  (M^{-1})_{21} = -U22^{-1} L22^{-1} L21 L11^{-1} P1         */
+/*                                                             */
+/* which costs O(NB NA^2 + NB^2 NA) instead of the O(NR^2 NA)  */
+/* of LUSolve()ing with NA columns of the identity matrix.     */
+/* The factorization is not modified.                          */
+/***************************************************************/
+int HMatrix::LUInverseLowerLeftBlock(HMatrix *X)
+{
+  int NA=LeadingBlockDim, NB=NR-NA;
+  if (NA==0 || ipiv==0)
+   ErrExit("LUInverseLowerLeftBlock() requires a prior call to LUFactorizeBlocked()");
+  if (X->NR!=NB || X->NC!=NA || X->RealComplex!=RealComplex || X->StorageType!=LHM_NORMAL)
+   ErrExit("LUInverseLowerLeftBlock(): X must be a %ix%i matrix of the same type",NB,NA);
+
+  if (RealComplex==LHM_REAL)
+   { double *L11=DM, *L21=DM+NA, *L22=DM+NA+((size_t)NA)*NR, *XM=X->DM;
+     double One=1.0;
+     for(int nc=0; nc<NA; nc++)
+      for(int nr=0; nr<NB; nr++)
+       XM[nr + ((size_t)nc)*NB] = -L21[nr + ((size_t)nc)*NR];
+     dtrsm_("R", "L", "N", "U", &NB, &NA, &One, L11, &NR, XM, &NB);
+     dtrsm_("L", "L", "N", "U", &NB, &NA, &One, L22, &NR, XM, &NB);
+     dtrsm_("L", "U", "N", "N", &NB, &NA, &One, L22, &NR, XM, &NB);
+   }
+  else
+   { cdouble *L11=ZM, *L21=ZM+NA, *L22=ZM+NA+((size_t)NA)*NR, *XM=X->ZM;
+     cdouble One=1.0;
+     for(int nc=0; nc<NA; nc++)
+      for(int nr=0; nr<NB; nr++)
+       XM[nr + ((size_t)nc)*NB] = -L21[nr + ((size_t)nc)*NR];
+     ztrsm_("R", "L", "N", "U", &NB, &NA, &One, L11, &NR, XM, &NB);
+     ztrsm_("L", "L", "N", "U", &NB, &NA, &One, L22, &NR, XM, &NB);
+     ztrsm_("L", "U", "N", "N", &NB, &NA, &One, L22, &NR, XM, &NB);
+   };
+
+  // undo the row interchanges of the leading block, which act
+  // on the columns of the inverse (as in xgetri)
+  for(int nc=NA-1; nc>=0; nc--)
+   { int ncp=ipiv[nc]-1;
+     if (ncp==nc) continue;
+     for(int nr=0; nr<NB; nr++)
+      { cdouble Temp=X->GetEntry(nr,nc);
+        X->SetEntry(nr, nc, X->GetEntry(nr,ncp));
+        X->SetEntry(nr, ncp, Temp);
+      };
+   };
+
+  return 0;
+}
+
 /***************************************************************/
 /* solve linear system using LU factorization ******************/
 /***************************************************************/
@@ -185,7 +360,11 @@ int HMatrix::LUSolve(HVector *X)
   if (ipiv==0)  
    ErrExit("LUFactorize() must be called before LUSolve()");
 
-  if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
+  if ( SymFactored && RealComplex==LHM_REAL )
+   dsytrs_("U", &NR, &iOne, DM, &NR, ipiv, X->DV, &NR, &info);
+  else if ( SymFactored )
+   zsytrs_("U", &NR, &iOne, ZM, &NR, ipiv, X->ZV, &NR, &info);
+  else if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    dgetrs_("N", &NR, &iOne, DM, &NR, ipiv, X->DV, &NR, &info);
   else if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
    dsptrs_("U", &NR, &iOne, DM, ipiv, X->DV, &NR, &info);
@@ -219,7 +398,39 @@ int HMatrix::LUSolve(HMatrix *X, char Trans, int nrhs)
    ErrExit("LUFactorize() must be called before LUSolve()");
   if ( Trans!='N' && StorageType!=LHM_NORMAL )
    ErrExit("transposed LU-solves not available for packed matrices");
-if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
+
+  /*--------------------------------------------------------------*/
+  /*- for a symmetric factorization, M^T=M, and M^H X = B is     -*/
+  /*- equivalent to M conj(X) = conj(B). we use xsytrs2, which   -*/
+  /*- does the triangular solves with level-3 xtrsm, for more    -*/
+  /*- than one right-hand side.                                  -*/
+  /*--------------------------------------------------------------*/
+  if (SymFactored && nrhs>1)
+   { if (lwork < NR)
+      { if (work) free(work);
+        work=mallocEC(NR*(RealComplex==LHM_REAL ? sizeof(double) : sizeof(cdouble)));
+        lwork=NR;
+      };
+   };
+  if ( SymFactored && RealComplex==LHM_REAL )
+   { if (nrhs>1)
+      dsytrs2_("U", &NR, &nrhs, DM, &NR, ipiv, X->DM, &NR, (double *)work, &info);
+     else
+      dsytrs_("U", &NR, &nrhs, DM, &NR, ipiv, X->DM, &NR, &info);
+   }
+  else if ( SymFactored )
+   { bool Conjugate = (Trans=='C' || Trans=='c');
+     size_t NX = ((size_t)NR)*nrhs;
+     if (Conjugate)
+      for(size_t n=0; n<NX; n++) X->ZM[n]=conj(X->ZM[n]);
+     if (nrhs>1)
+      zsytrs2_("U", &NR, &nrhs, ZM, &NR, ipiv, X->ZM, &NR, (cdouble *)work, &info);
+     else
+      zsytrs_("U", &NR, &nrhs, ZM, &NR, ipiv, X->ZM, &NR, &info);
+     if (Conjugate)
+      for(size_t n=0; n<NX; n++) X->ZM[n]=conj(X->ZM[n]);
+   }
+  else if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    dgetrs_(&Trans, &NR, &nrhs, DM, &NR, ipiv, X->DM, &NR, &info);
   else if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
    dsptrs_("U", &NR, &nrhs, DM, ipiv, X->DM, &NR, &info);
@@ -263,8 +474,27 @@ int HMatrix::LUInvert()
   if (ipiv==0)  
    ErrExit("LUFactorize() must be called before LUInvert()");
 
+  // the inverse overwrites the factors of the leading block
+  LeadingBlockDim=0;
+
   int MinusOne=-1;
-  if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
+  if (SymFactored)
+   { 
+     lworkOptimal = 2*NR;
+     if (lworkOptimal > lwork)
+      { if (work) free(work);
+        work=mallocEC(lworkOptimal*(RealComplex==LHM_REAL ? sizeof(double) : sizeof(cdouble)));
+        lwork=lworkOptimal;
+      };
+     if (RealComplex==LHM_REAL)
+      dsytri_("U", &NR, DM, &NR, ipiv, (double *)work, &info);
+     else
+      zsytri_("U", &NR, ZM, &NR, ipiv, (cdouble *)work, &info);
+
+     // xsytri only computes the upper triangle of the inverse
+     FillLowerTriangle();
+   }
+  else if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    {
      // workspace size query
      dgetri_(&NR, DM, &NR, ipiv, &dlworkOptimal, &MinusOne, &info);
@@ -910,7 +1140,10 @@ double HMatrix::GetRCond(double ANorm, bool UseInfinityNorm)
 
      double *rwork=(double *)work;
      int info;
-     dgecon_(Norm, &NR, DM, &NR, &ANorm, &RCond, rwork, (int *)iwork, &info);
+     if (SymFactored)
+      dsycon_("U", &NR, DM, &NR, ipiv, &ANorm, &RCond, rwork, (int *)iwork, &info);
+     else
+      dgecon_(Norm, &NR, DM, &NR, &ANorm, &RCond, rwork, (int *)iwork, &info);
    }
   else // (RealComplex==LHM_COMPLEX)
    {
@@ -927,7 +1160,10 @@ double HMatrix::GetRCond(double ANorm, bool UseInfinityNorm)
      double *work2  = rwork + 2*NR;
      cdouble *zwork = (cdouble *)work2;
      int info;
-     zgecon_(Norm, &NR, ZM, &NR, &ANorm, &RCond, zwork, rwork, &info);
+     if (SymFactored)
+      zsycon_("U", &NR, ZM, &NR, ipiv, &ANorm, &RCond, zwork, &info);
+     else
+      zgecon_(Norm, &NR, ZM, &NR, &ANorm, &RCond, zwork, rwork, &info);
 
    };
 
@@ -2465,6 +2465,10 @@ cdouble zdotu_(int *N, cdouble *X, int *IncX, cdouble *Y, int *IncY);
 	double *a, int *lda, int *ipiv, double *b, int *
 	ldb, int *info);
  
+/* Subroutine */ int dsytrs2_(const char *uplo, int *n, int *nrhs, 
+	double *a, int *lda, int *ipiv, double *b, int *
+	ldb, double *work, int *info);
+ 
 /* Subroutine */ int dtbcon_(const char *norm, const char *uplo, const char *diag, int *n, 
 	int *kd, double *ab, int *ldab, double *rcond, 
 	double *work, int *iwork, int *info);
@@ -4886,6 +4890,10 @@ int izmax1_(int *n, cdouble *cx, int *incx);
 	cdouble *a, int *lda, int *ipiv, cdouble *b, 
 	int *ldb, int *info);
  
+/* Subroutine */ int zsytrs2_(const char *uplo, int *n, int *nrhs, 
+	cdouble *a, int *lda, int *ipiv, cdouble *b, 
+	int *ldb, cdouble *work, int *info);
+ 
 /* Subroutine */ int ztbcon_(const char *norm, const char *uplo, const char *diag, int *n, 
 	int *kd, cdouble *ab, int *ldab, double *rcond, 
 	cdouble *work, double *rwork, int *info);
@@ -5148,6 +5156,14 @@ void zgemv_(const char *TRANS, int *M, int *N, cdouble *Alpha,
             cdouble *A, int *lda, cdouble *X, int *incx, cdouble *beta,
             cdouble *Y, int *incy);
 
+void dtrsm_(const char *SIDE, const char *UPLO, const char *TRANSA,
+            const char *DIAG, int *M, int *N, double *ALPHA,
+            double *A, int *LDA, double *B, int *LDB);
+
+void ztrsm_(const char *SIDE, const char *UPLO, const char *TRANSA,
+            const char *DIAG, int *M, int *N, cdouble *ALPHA,
+            cdouble *A, int *LDA, cdouble *B, int *LDB);
+
 #endif /* __CLAPACK_H */
 
 #ifdef __cplusplus
@@ -586,6 +586,7 @@
 #define dsytrf_ F77_FUNC(dsytrf,DSYTRF)
 #define dsytri_ F77_FUNC(dsytri,DSYTRI)
 #define dsytrs_ F77_FUNC(dsytrs,DSYTRS)
+#define dsytrs2_ F77_FUNC(dsytrs2,DSYTRS2)
 #define dtbcon_ F77_FUNC(dtbcon,DTBCON)
 #define dtbrfs_ F77_FUNC(dtbrfs,DTBRFS)
 #define dtbtrs_ F77_FUNC(dtbtrs,DTBTRS)
@@ -1172,6 +1173,7 @@
 #define zsytrf_ F77_FUNC(zsytrf,ZSYTRF)
 #define zsytri_ F77_FUNC(zsytri,ZSYTRI)
 #define zsytrs_ F77_FUNC(zsytrs,ZSYTRS)
+#define zsytrs2_ F77_FUNC(zsytrs2,ZSYTRS2)
 #define ztbcon_ F77_FUNC(ztbcon,ZTBCON)
 #define ztbrfs_ F77_FUNC(ztbrfs,ZTBRFS)
 #define ztbtrs_ F77_FUNC(ztbtrs,ZTBTRS)
@@ -1229,4 +1231,6 @@
 #define dgemv_ F77_FUNC(dgemv,DGEMV)
 #define zgemm_ F77_FUNC(zgemm,ZGEMM)
 #define zgemv_ F77_FUNC(zgemv,ZGEMV)
+#define dtrsm_ F77_FUNC(dtrsm,DTRSM)
+#define ztrsm_ F77_FUNC(ztrsm,ZTRSM)
 #endif
@@ -265,6 +265,15 @@ class HMatrix
    // like InsertBlock, but addition rather than replacement
    void AddBlock(HMatrix *B, int RowOffset, int ColOffset);
    void AddBlockAdjoint(HMatrix *B, int RowOffset, int ColOffset);
+   // add Alpha*B + Beta*B^T (e.g. with Bloch phase factors)
+   void AddBlockWithTranspose(HMatrix *B, int RowOffset, int ColOffset,
+                              cdouble Alpha, cdouble Beta=0.0,
+                              int NRB=-1, int NCB=-1);
+   // add the upper-left NRBxNCB block of B without touching the
+   // Symmetric flag, so that several threads may add disjoint tiles
+   // into the same matrix at once; the caller must clear Symmetric
+   // before the threads start
+   void AddTile(HMatrix *B, int RowOffset, int ColOffset, int NRB, int NCB);
    void AddBlock(SMatrix *B, int RowOffset, int ColOffset,
                  cdouble ScaleFactor=1.0);
 
@@ -297,8 +306,26 @@ class HMatrix
    void Apply(HVector *X, HVector *Y, char Trans=0);
    
    /* routines for LU-factorizing, solving, inverting */
-   /* (xgetrf, xgetrs, xgetri) */
+   /* (xgetrf, xgetrs, xgetri, or xsytrf, xsytrs,     */
+   /*  xsytri if the Symmetric flag is set; see below) */
    int LUFactorize();
+
+   /* LU factorization in which the leading NAxNA block is     */
+   /* factorized on its own (pivoting confined to its rows),   */
+   /* followed by an LU factorization of the Schur complement. */
+   /* The result may be used with LUSolve() and LUInvert() as  */
+   /* usual. If only the trailing rows and columns of the      */
+   /* matrix change (e.g. because only the last few surfaces   */
+   /* of a geometry have moved), restamp those rows and        */
+   /* columns and call again with ReuseLeadingBlock=true to    */
+   /* reuse the factors of the leading block, at a cost of     */
+   /* O(NA^2 NB + NB^3) instead of O((NA+NB)^3) for NB=NR-NA.  */
+   int LUFactorizeBlocked(int NA, bool ReuseLeadingBlock=false);
+
+   /* lower-left (NR-NA)xNA block of the inverse of a matrix   */
+   /* factorized by LUFactorizeBlocked(NA), computed without   */
+   /* solving against the full identity.                       */
+   int LUInverseLowerLeftBlock(HMatrix *X);
    int LUSolve(HVector *X);
    int LUSolve(HMatrix *X);
    int LUSolve(HMatrix *X, int nrhs);
@@ -306,6 +333,14 @@ class HMatrix
    int LUSolve(HMatrix *X, char Trans, int nrhs);
    int LUInvert();
 
+   /* copy the upper triangle of a square matrix into its lower */
+   /* triangle                                                  */
+   void FillLowerTriangle();
+
+   /* true if the matrix is square, LHM_NORMAL and equal to its */
+   /* transpose                                                 */
+   bool IsSymmetric();
+
    /* routines for cholesky-factorizing, solving, inverting */
    /* (xpotrf, xpotrs, xpotri) */
    int CholFactorize();
@@ -344,6 +379,27 @@ class HMatrix
    int StorageType;
    int *ipiv;
 
+   // the caller may set this flag to indicate that a square
+   // LHM_NORMAL matrix is (non-conjugate) symmetric, in which case
+   // LUFactorize() uses the blocked Bunch-Kaufman factorization
+   // (xsytrf) instead of xgetrf. this reads only the upper
+   // triangle and costs half as many flops. the flag describes the
+   // current contents of the matrix, so it is cleared by
+   // LUFactorize() itself and by every routine that modifies
+   // entries (SetEntry, AddEntry, Zero, the block insertion
+   // routines, ...); LUFactorize() also verifies it with
+   // IsSymmetric() to catch direct writes to DM/ZM.
+   bool Symmetric;
+
+   // true if the current factorization came from xsytrf; in this
+   // case the diagonal of the factored matrix is NOT the diagonal
+   // of an LU factor (D may have 2x2 blocks).
+   bool SymFactored;
+
+   // dimension of the leading block whose factors were computed
+   // separately by the last call to LUFactorizeBlocked(), or 0
+   int LeadingBlockDim;
+
    // pointers to the actual data storage. only one of these is 
    // used in a given instance so if i wanted to save 8 bytes i 
    // could put them into a union
@@ -456,4 +512,88 @@ class SMatrix
     int MakeEntry(int nr, int nc, bool force_new); // internal function to allocate entries
  };
 
+/***************************************************************/
+/* restarted GMRES with right preconditioning for square       */
+/* complex systems available only through matrix-vector        */
+/* products (GMRES.cc). Apply(UserData,X,MX) sets MX=M*X;      */
+/* Precondition(UserData,X), if non-NULL, replaces X with      */
+/* P^{-1}*X in place. on entry X is the RHS, on return the     */
+/* solution. returns the number of iterations, or -1 if the    */
+/* iteration did not converge.                                 */
+/***************************************************************/
+typedef void (*GMRESApplyFunc)(void *UserData, cdouble *X, cdouble *MX);
+typedef void (*GMRESPrecondFunc)(void *UserData, cdouble *X);
+
+int GMRES(int N, GMRESApplyFunc Apply, GMRESPrecondFunc Precondition,
+          void *UserData, cdouble *X, double RelTol=1.0e-6,
+          int MaxIters=1000, int Restart=100);
+
+/***************************************************************/
+/* ACAMatrix class definition: hierarchically compressed       */
+/* representation of an NxN complex matrix whose rows and      */
+/* columns are associated with points in 3D space. matrix      */
+/* entries are supplied on demand by a user routine that fills */
+/* in the NumRows x NumCols block (column-major) with the      */
+/* given row and column indices.                               */
+/***************************************************************/
+typedef void (*ACABlockFunc)(void *UserData,
+                             int *Rows, int NumRows,
+                             int *Cols, int NumCols,
+                             cdouble *Block);
+
+typedef struct ACABlock
+ { int RowStart, NumRows, ColStart, NumCols; // in permuted ordering
+   int Rank;      // -1 for dense blocks
+   cdouble *U;    // NumRows x Rank (or NumRows x NumCols if dense)
+   cdouble *V;    // NumCols x Rank (unused if dense)
+ } ACABlock;
+
+class ACAMatrix
+ { 
+  public:  
+
+    // Points[3*n + i] = ith coordinate of the point associated
+    // with row/column n. Tol is the relative accuracy of the
+    // low-rank approximations; blocks of size <= LeafSize are
+    // not subdivided further; pairs of clusters with
+    // min(diameter) <= Eta*distance are compressed; diagonal
+    // blocks of size <= PCBlockSize are LU-factorized for use
+    // as a block-Jacobi preconditioner in GMRESSolve.
+    ACAMatrix(int N, double *Points,
+              ACABlockFunc BlockFunc, void *UserData,
+              double Tol=1.0e-4, int LeafSize=32, double Eta=2.0,
+              int PCBlockSize=512);
+    ~ACAMatrix();
+
+    // MX = this * X
+    void Apply(HVector *X, HVector *MX);
+
+    // solve this*X = B by preconditioned restarted GMRES; on
+    // entry X contains B, on return the solution. returns the
+    // number of iterations, or -1 if not converged.
+    int GMRESSolve(HVector *X, double RelTol=1.0e-6,
+                   int MaxIters=1000, int Restart=100);
+
+    // bytes of storage occupied by matrix blocks
+    size_t GetStorage();
+
+ // private:
+    int N;
+    double Tol;
+    ACABlockFunc BlockFunc;
+    void *UserData;
+
+    int *Perm; // Perm[n] = original index of nth permuted index
+    ACABlock *Blocks;
+    int NumBlocks, NumDenseBlocks, NumLowRankBlocks;
+
+    // LU-factorized diagonal blocks for block-Jacobi preconditioning
+    HMatrix **PCBlocks;
+    int *PCStart;
+    int NumPCBlocks;
+
+    void ApplyPermuted(cdouble *X, cdouble *MX);
+    void Precondition(cdouble *X);
+ };
+
 #endif
@@ -0,0 +1,157 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tACAMatrix.cc -- test of the ACAMatrix class: compress a
+ *               -- Helmholtz-kernel matrix on a random point cloud
+ *               -- and compare matrix-vector products and GMRES
+ *               -- solutions against the dense matrix
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+#define II cdouble(0.0,1.0)
+
+/***************************************************************/
+/* kernel e^{ikr}/(4*pi*r) regularized on the diagonal         */
+/***************************************************************/
+typedef struct KernelData
+ { double *Points;
+   double k;
+ } KernelData;
+
+cdouble Kernel(KernelData *KD, int m, int n)
+{ 
+  if (m==n) return 10.0;
+  double *X=KD->Points + 3*m, *Y=KD->Points + 3*n;
+  double r=sqrt( (X[0]-Y[0])*(X[0]-Y[0]) + (X[1]-Y[1])*(X[1]-Y[1]) + (X[2]-Y[2])*(X[2]-Y[2]) );
+  return exp(II*KD->k*r) / (4.0*M_PI*r);
+}
+
+void KernelBlock(void *UserData, int *Rows, int NumRows,
+                 int *Cols, int NumCols, cdouble *Block)
+{ 
+  KernelData *KD=(KernelData *)UserData;
+  for(int nc=0; nc<NumCols; nc++)
+   for(int nr=0; nr<NumRows; nr++)
+    Block[nr + nc*NumRows] = Kernel(KD, Rows[nr], Cols[nc]);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{ 
+  int N=2000;
+  double k=1.0;
+  double Tol=1.0e-6;
+  /* name               type    #args  max_instances  storage           count         description*/
+  OptStruct OSArray[]=
+   { {"N",       PA_INT,     1, 1, (void *)&N,       0, "dimension "},
+     {"k",       PA_DOUBLE,  1, 1, (void *)&k,       0, "wavenumber"},
+     {"Tol",     PA_DOUBLE,  1, 1, (void *)&Tol,     0, "ACA tolerance"},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+
+  /*--------------------------------------------------------------*/
+  /*- random points on the surface of a unit sphere ---------------*/
+  /*--------------------------------------------------------------*/
+  srand48(0);
+  double *Points=(double *)mallocEC(3*N*sizeof(double));
+  for(int n=0; n<N; n++)
+   { double CosTheta=2.0*drand48()-1.0, SinTheta=sqrt(1.0-CosTheta*CosTheta);
+     double Phi=2.0*M_PI*drand48();
+     Points[3*n+0]=SinTheta*cos(Phi);
+     Points[3*n+1]=SinTheta*sin(Phi);
+     Points[3*n+2]=CosTheta;
+   };
+  KernelData MyKD, *KD=&MyKD;
+  KD->Points=Points;
+  KD->k=k;
+
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  printf("Assembling dense %ix%i matrix...",N,N);
+  Tic();
+  HMatrix *M=new HMatrix(N, N, LHM_COMPLEX);
+  for(int m=0; m<N; m++)
+   for(int n=0; n<N; n++)
+    M->SetEntry(m,n,Kernel(KD,m,n));
+  printf("...%.3f s\n",Toc());
+
+  printf("Assembling compressed matrix...");
+  Tic();
+  ACAMatrix *MC=new ACAMatrix(N, Points, KernelBlock, (void *)KD, Tol);
+  printf("...%.3f s (%i dense, %i low-rank blocks, %.1f%% storage)\n",Toc(),
+          MC->NumDenseBlocks, MC->NumLowRankBlocks,
+          100.0*((double)MC->GetStorage())/(16.0*N*N));
+
+  /*--------------------------------------------------------------*/
+  /*- compare matrix-vector products ------------------------------*/
+  /*--------------------------------------------------------------*/
+  HVector *X=new HVector(N, LHM_COMPLEX);
+  HVector *MX=new HVector(N, LHM_COMPLEX);
+  HVector *MCX=new HVector(N, LHM_COMPLEX);
+  for(int n=0; n<N; n++)
+   X->SetEntry(n, drand48() + II*drand48());
+  M->Apply(X, MX);
+  MC->Apply(X, MCX);
+  double Num=0.0, Denom=0.0;
+  for(int n=0; n<N; n++)
+   { Num   += norm(MX->GetEntry(n) - MCX->GetEntry(n));
+     Denom += norm(MX->GetEntry(n));
+   };
+  double MatVecError=sqrt(Num/Denom);
+  printf("Relative matrix-vector product error: %e\n",MatVecError);
+
+  /*--------------------------------------------------------------*/
+  /*- compare GMRES solution to LU solution -----------------------*/
+  /*--------------------------------------------------------------*/
+  HVector *XLU=new HVector(MX);
+  HVector *XGMRES=new HVector(MX);
+  printf("LU-solving...");
+  Tic();
+  M->LUFactorize();
+  M->LUSolve(XLU);
+  printf("...%.3f s\n",Toc());
+
+  printf("GMRES-solving...");
+  Tic();
+  int Iters=MC->GMRESSolve(XGMRES, 1.0e-8);
+  printf("...%.3f s (%i iterations)\n",Toc(),Iters);
+
+  Num=Denom=0.0;
+  for(int n=0; n<N; n++)
+   { Num   += norm(XLU->GetEntry(n) - XGMRES->GetEntry(n));
+     Denom += norm(XLU->GetEntry(n));
+   };
+  double SolveError=sqrt(Num/Denom);
+  printf("Relative GMRES/LU solution difference: %e\n",SolveError);
+
+  bool Success = (MatVecError < 10.0*Tol) && (SolveError < 100.0*Tol) && (Iters>0);
+  printf("%s\n",Success ? "PASSED" : "FAILED");
+  return Success ? 0 : 1;
+}
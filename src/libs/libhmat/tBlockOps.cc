@@ -0,0 +1,198 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tBlockOps.cc -- check and time the HMatrix block-stamping routines
+ *              -- against entry-by-entry reference loops
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "libhrutil.h"
+#include "libhmat.h"
+
+#if defined(_WIN32)
+#  define srand48 srand
+#  define drand48 my_drand48
+static double my_drand48(void) {
+  return rand() * 1.0 / RAND_MAX;
+}
+#endif
+
+#define II cdouble(0.0,1.0)
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+double MaxRelDiff(HMatrix *A, HMatrix *B)
+{
+  double MaxDiff=0.0, MaxEntry=0.0;
+  for(int nr=0; nr<A->NR; nr++)
+   for(int nc=0; nc<A->NC; nc++)
+    { MaxDiff=fmax(MaxDiff, abs(A->GetEntry(nr,nc)-B->GetEntry(nr,nc)));
+      MaxEntry=fmax(MaxEntry, abs(A->GetEntry(nr,nc)));
+    };
+  return MaxEntry==0.0 ? MaxDiff : MaxDiff/MaxEntry;
+}
+
+void Report(const char *Op, double TRef, double TFast, double RelDiff)
+{
+  printf("%-22s  %8.3f s  %8.3f s  %6.1fx  %.1e  %s\n",
+          Op, TRef, TFast, TFast>0.0 ? TRef/TFast : 0.0, RelDiff,
+          RelDiff<1.0e-14 ? "PASSED" : "FAILED");
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  /*--------------------------------------------------------------*/
+  /*- process command-line arguments -----------------------------*/
+  /*--------------------------------------------------------------*/
+  int N=4000;
+  int NB=1500;
+  ArgStruct ASArray[]=
+   { {"N",          PA_INT,  (void *)&N,        "4000", "matrix dimension"},
+     {"NB",         PA_INT,  (void *)&NB,       "1500", "block dimension"},
+     {0,0,0,0,0}
+   };
+  ProcessArguments(argc, argv, ASArray);
+
+  HMatrix *M    = new HMatrix(N, N, LHM_COMPLEX);
+  HMatrix *MRef = new HMatrix(N, N, LHM_COMPLEX);
+  HMatrix *B    = new HMatrix(NB, NB, LHM_COMPLEX);
+  HMatrix *BRef = new HMatrix(NB, NB, LHM_COMPLEX);
+
+  srand48(time(0));
+  for(int nr=0; nr<N; nr++)
+   for(int nc=0; nc<N; nc++)
+    M->SetEntry(nr, nc, drand48() + II*drand48());
+  for(int nr=0; nr<NB; nr++)
+   for(int nc=0; nc<NB; nc++)
+    B->SetEntry(nr, nc, drand48() + II*drand48());
+
+  int RowOffset = N/7, ColOffset = N/3;
+  if (RowOffset+NB>N || ColOffset+NB>N)
+   ErrExit("block too large for matrix");
+  cdouble BPF = exp(0.3*II);
+
+  printf("%-22s  %10s  %10s  %7s  %7s\n",
+         "# operation","reference","fast","speedup","diff");
+
+  /*--------------------------------------------------------------*/
+  /*- InsertBlock ------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  MRef->Copy(M);
+  Tic();
+  for(int nr=0; nr<NB; nr++)
+   for(int nc=0; nc<NB; nc++)
+    MRef->SetEntry(RowOffset+nr, ColOffset+nc, B->GetEntry(nr,nc));
+  double TRef=Toc();
+  Tic();
+  M->InsertBlock(B, RowOffset, ColOffset);
+  double TFast=Toc();
+  Report("InsertBlock", TRef, TFast, MaxRelDiff(M, MRef));
+
+  /*--------------------------------------------------------------*/
+  /*- AddBlock ---------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  MRef->Copy(M);
+  Tic();
+  for(int nr=0; nr<NB; nr++)
+   for(int nc=0; nc<NB; nc++)
+    MRef->AddEntry(RowOffset+nr, ColOffset+nc, B->GetEntry(nr,nc));
+  TRef=Toc();
+  Tic();
+  M->AddBlock(B, RowOffset, ColOffset);
+  TFast=Toc();
+  Report("AddBlock", TRef, TFast, MaxRelDiff(M, MRef));
+
+  /*--------------------------------------------------------------*/
+  /*- ExtractBlock -----------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  Tic();
+  for(int nr=0; nr<NB; nr++)
+   for(int nc=0; nc<NB; nc++)
+    BRef->SetEntry(nr, nc, M->GetEntry(ColOffset+nr, RowOffset+nc));
+  TRef=Toc();
+  Tic();
+  M->ExtractBlock(ColOffset, RowOffset, B);
+  TFast=Toc();
+  Report("ExtractBlock", TRef, TFast, MaxRelDiff(B, BRef));
+
+  /*--------------------------------------------------------------*/
+  /*- InsertBlockTranspose, InsertBlockAdjoint -------------------*/
+  /*--------------------------------------------------------------*/
+  MRef->Copy(M);
+  Tic();
+  for(int nr=0; nr<NB; nr++)
+   for(int nc=0; nc<NB; nc++)
+    MRef->SetEntry(RowOffset+nc, ColOffset+nr, B->GetEntry(nr,nc));
+  TRef=Toc();
+  Tic();
+  M->InsertBlockTranspose(B, RowOffset, ColOffset);
+  TFast=Toc();
+  Report("InsertBlockTranspose", TRef, TFast, MaxRelDiff(M, MRef));
+
+  MRef->Copy(M);
+  Tic();
+  for(int nr=0; nr<NB; nr++)
+   for(int nc=0; nc<NB; nc++)
+    MRef->SetEntry(RowOffset+nc, ColOffset+nr, conj(B->GetEntry(nr,nc)));
+  TRef=Toc();
+  Tic();
+  M->InsertBlockAdjoint(B, RowOffset, ColOffset);
+  TFast=Toc();
+  Report("InsertBlockAdjoint", TRef, TFast, MaxRelDiff(M, MRef));
+
+  /*--------------------------------------------------------------*/
+  /*- AddBlockWithTranspose (bloch-phase stamping) ---------------*/
+  /*--------------------------------------------------------------*/
+  MRef->Copy(M);
+  Tic();
+  for(int nr=0; nr<NB; nr++)
+   for(int nc=0; nc<NB; nc++)
+    MRef->AddEntry(RowOffset+nr, ColOffset+nc,
+                   BPF*B->GetEntry(nr,nc) + conj(BPF)*B->GetEntry(nc,nr));
+  TRef=Toc();
+  Tic();
+  M->AddBlockWithTranspose(B, RowOffset, ColOffset, BPF, conj(BPF));
+  TFast=Toc();
+  Report("AddBlockWithTranspose", TRef, TFast, MaxRelDiff(M, MRef));
+
+  /*--------------------------------------------------------------*/
+  /*- FillLowerTriangle ------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  MRef->Copy(M);
+  Tic();
+  for(int nr=1; nr<N; nr++)
+   for(int nc=0; nc<nr; nc++)
+    MRef->SetEntry(nr, nc, MRef->GetEntry(nc, nr) );
+  TRef=Toc();
+  Tic();
+  M->FillLowerTriangle();
+  TFast=Toc();
+  Report("FillLowerTriangle", TRef, TFast, MaxRelDiff(M, MRef));
+
+}
@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <math.h>
 
 #include <libhrutil.h>
 #include "libhmat.h"
@@ -46,12 +47,16 @@ int main(int argc, char *argv[])
   /*--------------------------------------------------------------*/
   int N=1000;
   int Complex=0;
+  bool Symmetric=false;
+  int Blocked=0;
   char *Flag=0;
   /* name               type    #args  max_instances  storage           count         description*/
   OptStruct OSArray[]=
    { {"N",       PA_INT,     1, 1, (void *)&N,       0, "dimension "},
      {"Complex", PA_BOOL,    0, 1, (void *)&Complex, 0, "complex-valued matrix"},
      {"Flag",    PA_STRING,  1, 1, (void *)&Flag,    0, "either N, C, or T"},
+     {"Symmetric", PA_BOOL,  0, 1, (void *)&Symmetric, 0, "symmetric M1 (Bunch-Kaufman factorization)"},
+     {"Blocked",   PA_INT,   1, 1, (void *)&Blocked,   0, "block-factorize M1 with leading block of this size, then change the trailing rows and columns and refactorize"},
      {0,0,0,0,0,0,0}
    };
   ProcessOptions(argc, argv, OSArray);
@@ -80,15 +85,63 @@ int main(int argc, char *argv[])
   Elapsed=Toc();
   printf("...%.3f s\n",Elapsed);
 
+  if (Symmetric)
+   { M1->FillLowerTriangle();
+     M1->Symmetric=true;
+   };
+  HMatrix *M1Copy=new HMatrix(M1);
+  HMatrix *M2Copy=new HMatrix(M2);
+
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   printf("LU-factorizing M1...");
   Tic();
-  M1->LUFactorize();
+  if (Blocked)
+   M1->LUFactorizeBlocked(Blocked);
+  else
+   M1->LUFactorize();
   Elapsed=Toc();
   printf("...%.3f s\n",Elapsed);
 
+  /*--------------------------------------------------------------*/
+  /*- with --Blocked, replace the trailing rows and columns of M1 */
+  /*- with new random entries and update the factorization        */
+  /*--------------------------------------------------------------*/
+  if (Blocked)
+   { for(m=0; m<N; m++)
+      for(n=(m<Blocked ? Blocked : 0); n<N; n++)
+       { cdouble Entry = drand48() + II*drand48();
+         M1->SetEntry(m, n, Entry);
+         M1Copy->SetEntry(m, n, Entry);
+       };
+     printf("Updating factorization of M1...");
+     Tic();
+     M1->LUFactorizeBlocked(Blocked, true);
+     Elapsed=Toc();
+     printf("...%.3f s\n",Elapsed);
+
+     printf("Lower-left block of inverse...");
+     HMatrix *W21=new HMatrix(N-Blocked, Blocked, M1->RealComplex);
+     Tic();
+     M1->LUInverseLowerLeftBlock(W21);
+     Elapsed=Toc();
+     printf("...%.3f s\n",Elapsed);
+
+     HMatrix *M1Inv=new HMatrix(M1Copy);
+     M1Inv->LUFactorize();
+     M1Inv->LUInvert();
+     double MaxErr=0.0, MaxEntry=0.0;
+     for(m=Blocked; m<N; m++)
+      for(n=0; n<Blocked; n++)
+       { MaxErr=fmax(MaxErr, abs(W21->GetEntry(m-Blocked,n) - M1Inv->GetEntry(m,n)));
+         MaxEntry=fmax(MaxEntry, abs(M1Inv->GetEntry(m,n)));
+       };
+     printf("max error / max entry = %.2e\n",MaxErr/MaxEntry);
+     delete M1Inv;
+     delete W21;
+   };
+
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
@@ -106,9 +159,17 @@ int main(int argc, char *argv[])
    { 
      printf("Multiplying M1*M2 ...\n");
      Tic();
-     M1->Multiply(M2,M3);
+     M1Copy->Multiply(M2,M3,Flag[0]=='N' ? 0 : Flag[0]=='T' ? "--transA T" : "--transA C");
      Elapsed=Toc();
      printf("...%.3f s\n",Elapsed);
+
+     double MaxErr=0.0, MaxEntry=0.0;
+     for(m=0; m<N; m++)
+      for(n=0; n<N; n++)
+       { MaxErr=fmax(MaxErr, abs(M3->GetEntry(m,n) - M2Copy->GetEntry(m,n)));
+         MaxEntry=fmax(MaxEntry, abs(M2Copy->GetEntry(m,n)));
+       };
+     printf("max residual / max RHS entry = %.2e\n",MaxErr/MaxEntry);
    };
 
 }
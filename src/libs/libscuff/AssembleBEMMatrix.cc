@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <algorithm>
 #include <libhmat.h>
 #include <libhrutil.h>
 #include <sys/stat.h>
@@ -99,208 +100,11 @@ void StampInNeighborBlock(HMatrix *B, HMatrix **GradB,
      if ( !BList[n] || !MList[n] )
       continue;
      
-     if (UseSymmetry)
-      { for(int nr=0; nr<NR; nr++)
-         for(int nc=0; nc<NC; nc++)
-          MM->AddEntry(RowOffset + nr, ColOffset + nc,
-                       BPF*BB->GetEntry(nr,nc) + conj(BPF)*BB->GetEntry(nc,nr));
-      }
-     else
-      { for(int nr=0; nr<NR; nr++)
-         for(int nc=0; nc<NC; nc++)
-          MM->AddEntry(RowOffset + nr, ColOffset + nc, 
-                       BPF*BB->GetEntry(nr,nc));
-      };
-   };
-}
-
-/***************************************************************/
-/* this is a simple quick-and-dirty mechanism for saving       */
-/* and retrieving diagonal T-matrix blocks to disk.            */
-/***************************************************************/
-#define TBCOP_READ  0
-#define TBCOP_WRITE 1
-bool TBlockCacheOp(int Op, RWGGeometry *G, int ns,
-                   cdouble Omega, double *kBloch,
-                   HMatrix *M, int RowOffset, int ColOffset)
-{
-  char *Dir = getenv("SCUFF_TBLOCK_PATH");
-  if (Dir==0 && Op==TBCOP_READ)
-   Dir = getenv("SCUFF_TBLOCK_READPATH");
-  if (!Dir) return false;
-
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  char K4VStr[50];
-  if (imag(Omega)==0.0)
-   sprintf(K4VStr,"%.6e",real(Omega));
-  else if (real(Omega)==0.0)
-   sprintf(K4VStr,"%.6eI",imag(Omega));
-  else 
-   sprintf(K4VStr,"%.6e+%.6eI",real(Omega),imag(Omega));
-  if (G->LDim>=1)
-   vstrappend(K4VStr,"_%.6e",kBloch[0]);
-  if (G->LDim>=2)
-   vstrappend(K4VStr,"_%.6e",kBloch[1]);
-
-  int nr1=G->Surfaces[ns]->RegionIndices[0];
-  int nr2=G->Surfaces[ns]->RegionIndices[1];
-  if (G->RegionMPs[nr1]->Zeroed)
-   strcat(K4VStr,"_Interior");
-  else if (nr2!=-1 && G->RegionMPs[nr2]->Zeroed)
-   strcat(K4VStr,"_Exterior");
-    
-  char *FileBase = GetFileBase(G->Surfaces[ns]->MeshFileName); 
-  const char *Addendum = G->TBlockCacheNameAddendum;
-  if (Addendum==0) Addendum="";
-  char FileName[200];
-  snprintf(FileName,200,"%s/%s%s_%s.hdf5",Dir,FileBase,Addendum,K4VStr);
-
-  /***************************************************************/
-  /***************************************************************/
-  /***************************************************************/
-  int NBF        = G->Surfaces[ns]->NumBFs;
-  bool IsComplex = (M->RealComplex==LHM_COMPLEX);
-  off_t DataSize = NBF*NBF*(IsComplex ? sizeof(double) : sizeof(cdouble) );
-
-  /***************************************************************/
-  /* if the block we are reading/writing is a proper subblock of */
-  /* M, then we will need to allocate an HMatrix for just that   */
-  /* block, but we hold off on doing that until necessary        */
-  /***************************************************************/
-  HMatrix *B=0;
-  bool OwnsB=false;
-  if ( RowOffset==0 && ColOffset==0 && (M->NR==NBF) && (M->NC==NBF) )
-   B=M;
-
-  bool Success=false;
-  FILE *f=0;
-  if (Op==TBCOP_READ)	
-   {
-     Log("Attempting to read T-block (%s,%s) from file %s...",FileBase,z2s(Omega),FileName);
-     struct stat st;
-     int Status=stat(FileName, &st);
-     f=fopen(FileName,"r");
-     if (Status!=0 || f==0)
-      Log("...could not access file");
-     else if (st.st_size!=DataSize)
-      Log("...file had incorrect size %lu (should be %lu)",st.st_size,DataSize);
-     else 
-      { 
-        if (B==0)
-         { OwnsB=true;
-           B=new HMatrix(NBF,NBF,M->RealComplex);
-           if (B->ErrMsg)
-            { Log("...could not allocate matrix (%s)",B->ErrMsg);
-              delete B;
-              fclose(f);
-              return false;
-            };
-         };
-
-        void *DataBuffer = (IsComplex ? ((void *)(B->ZM)) : ((void *)(B->DM)));
-        ssize_t SizeToRead = (ssize_t)DataSize;
-        ssize_t SizeRead = read(fileno(f), DataBuffer, SizeToRead);
-        Success = (SizeRead==SizeToRead);
-        if (Success)
-         { Log("...success!");
-           if (OwnsB)
-            M->InsertBlock(B, RowOffset, ColOffset);
-         }
-        else
-         Log("...failed to read full size (%lu)",SizeToRead);
-      };
-   }
-  else //(Op==TBCOP_WRITE)
-   { 
-     Log("Attempting to write T-block (%s,%s) to file %s...",FileBase,z2s(Omega),FileName);
-     if (B==0)
-      { OwnsB=true;
-        B=new HMatrix(NBF,NBF,M->RealComplex);
-        if (B->ErrMsg)
-         { Log("...could not allocate matrix (%s)",B->ErrMsg);
-           delete B;
-           return false;
-         };
-        M->ExtractBlock(RowOffset, ColOffset, B);
-      };
-     void *DataBuffer = (IsComplex ? ((void *)(B->ZM)) : ((void *)(B->DM)));
-     f=fopen(FileName,"w");
-     if (!f) 
-      Log("...could not access file");
-     else if (DataSize != write(fileno(f), DataBuffer, DataSize))
-      Log("...failed to write full file");
-     else
-      { Log("...success!");
-        Success=true;
-      };
+     MM->AddBlockWithTranspose(BB, RowOffset, ColOffset,
+                               BPF, UseSymmetry ? conj(BPF) : 0.0, NR, NC);
    };
-
-  if (B && OwnsB) delete B;
-  if (f) fclose(f);
-  return Success; 
 }
 
-
-#if 0 // old HDF5 approach which is memory-inefficient
-  if (Op==TBCOP_READ)
-{
-     bool AbortOnIOErrorSave=HMatrix::AbortOnIOError;
-     HMatrix::AbortOnIOError=false;
-
-     HMatrix *MFile=M;
-     bool OwnsMFile=false;
-     if (RowOffset==0 && ColOffset==0 && M->NR==NBFs && M->NC==NBFs)
-      M->ImportFromHDF5(FileName,"T",false);
-     else
-      { MFile=new HMatrix(FileName,LHM_HDF5,"T");
-        OwnsMFile=true;
-      };
-     bool Success = (MFile->ErrMsg == 0);
-     if (Success)
-      { Log("...success!");
-        if (OwnsMFile)
-         M->InsertBlock(MFile, RowOffset, ColOffset);
-      }
-     else 
-      { Log("...failed: %s",MFile->ErrMsg);
-        if (!OwnsMFile) 
-         { free(M->ErrMsg);
-           M->ErrMsg=0;
-         };
-      };
-     if (OwnsMFile) delete MFile;
-     HMatrix::AbortOnIOError=AbortOnIOErrorSave;
-     return Success;
-   }
-  else if (Op==TBCOP_WRITE)
-   { 
-      HMatrix *MFile;
-      bool OwnsMFile=false;
-      bool AbortOnIOErrorSave=HMatrix::AbortOnIOError;
-      HMatrix::AbortOnIOError=false;
-      if (RowOffset==0 && ColOffset==0 && M->NR==NBFs && M->NC==NBFs)
-       MFile=M;
-      else
-       { MFile = new HMatrix(NBFs, NBFs, M->RealComplex);
-         OwnsMFile=true;
-         M->ExtractBlock(RowOffset, ColOffset, MFile);
-       };
-      MFile->ExportToHDF5(FileName,"T");
-      Log("Writing T-block (%s,%s) to file %s...",FileBase,z2s(Omega),FileName);
-      if (MFile->ErrMsg)
-       { Log("...failed! %s",MFile->ErrMsg);
-         free(MFile->ErrMsg);
-         MFile->ErrMsg=0;
-       };
-      if (OwnsMFile) delete MFile;
-      HMatrix::AbortOnIOError=AbortOnIOErrorSave;
-   };
-  return false; // never get here 
-}
-#endif
-
 /***************************************************************/
 /* KBIMBCache = 'kBloch-independent matrix-block cache.'       */
 /***************************************************************/
@@ -422,6 +226,14 @@ void RWGGeometry::AssembleBEMMatrixBlock(int nsa, int nsb,
   if (LogLevel>=SCUFF_VERBOSELOGGING)
    Log("Assembling BEM matrix block (%i,%i)",nsa,nsb);
 
+  if (    FreqInterpTol>0.0 && GradM==0 && NumTorqueAxes==0
+       && InterpolateBEMMatrixBlock(this, nsa, nsb, Omega, M, RowOffset, ColOffset)
+     )
+   { if (nsa==nsb)
+      TBlockCacheOp(TBCOP_WRITE, this, nsa, Omega, kBloch, M, RowOffset, ColOffset);
+     return;
+   };
+
   /***************************************************************/
   /* handle the compact-object case first since it is so simple  */
   /***************************************************************/
@@ -729,6 +541,288 @@ void RWGGeometry::ApplyMMJTransformation(HMatrix *M, HVector *RHS)
 
 }
 
+/***************************************************************/
+/* Global block scheduler for compact geometries.              */
+/*                                                             */
+/* Instead of assembling the surface-pair blocks of the BEM    */
+/* matrix one after another (with threads synchronizing at the */
+/* end of each block) we chop every block that needs computing */
+/* into tiles of consecutive row edges and put all tiles from  */
+/* all blocks into a single queue, from which idle threads     */
+/* fetch the next unclaimed tile. Tiles are sorted in order of */
+/* decreasing estimated cost, so that expensive tiles (rows    */
+/* of self-interaction blocks with many singular panel pairs)  */
+/* are started early and cheap far-field tiles fill in the     */
+/* gaps at the end.                                            */
+/*                                                             */
+/* The cost of a tile is estimated by classifying the panel    */
+/* pairs formed by a representative panel of the tile against  */
+/* all panels of the column surface via AssessPanelPair():     */
+/* pairs with common vertices are handled by Taylor-Duffy or   */
+/* the FIPPI cache, nearby pairs by desingularized high-order  */
+/* cubature, and distant pairs by low-order cubature.          */
+/***************************************************************/
+#define TILE_EDGES          32
+#define TILECOST_COMMON     20.0
+#define TILECOST_NEAR       4.0
+#define TILECOST_FAR        1.0
+#define TILECOST_NEARRADIUS 4.0
+
+typedef struct SSITile
+ {
+   int nb;                 // index of block to which tile belongs
+   int neaMin, neaMax;     // range of row edges
+   double Cost;            // estimated cost
+   double Start, Stop;     // wall-clock times
+   unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];
+ } SSITile;
+
+static bool CompareTileCosts(const SSITile *T1, const SSITile *T2)
+{ return T1->Cost > T2->Cost; }
+
+static double EstimateTileCost(GetSSIArgStruct *Args, int neaMin, int neaMax)
+{
+  RWGSurface *Sa = Args->Sa, *Sb = Args->Sb;
+  int NEb = Sb->NumEdges, NPb = Sb->NumPanels;
+
+  int neaMid = (neaMin + neaMax)/2;
+  int npa    = Sa->Edges[neaMid]->iPPanel;
+  double rRel, PanelCost=0.0;
+  for(int npb=0; npb<NPb; npb++)
+   {
+     int ncv=AssessPanelPair(Sa, npa, Sb, npb, &rRel);
+     if (ncv>0)
+      PanelCost+=TILECOST_COMMON;
+     else if (rRel<TILECOST_NEARRADIUS)
+      PanelCost+=TILECOST_NEAR;
+     else
+      PanelCost+=TILECOST_FAR;
+   };
+
+  // each row edge interacts with NEb column edges, each of which
+  // involves a few of the panel pairs sampled above
+  double RowCost = PanelCost * ((double)NEb) / ((double)NPb);
+  if (Args->Symmetric)
+   RowCost *= ((double)(NEb - neaMid)) / ((double)NEb);
+  if (Args->EpsA!=0.0 && Args->EpsB!=0.0)
+   RowCost *= 2.0;
+
+  return RowCost * (neaMax - neaMin);
+}
+
+static void RunSSITile(GetSSIArgStruct *ArgsList, SSITile *Tile)
+{
+  Tile->Start=Secs();
+  memset(Tile->PPIAlgorithmCount, 0, NUMPPIALGORITHMS*sizeof(unsigned));
+  GetSSIRowRange(ArgsList + Tile->nb, Tile->neaMin, Tile->neaMax,
+                 Tile->PPIAlgorithmCount);
+  Tile->Stop=Secs();
+}
+
+#ifdef USE_PTHREAD
+typedef struct TileQueue
+ { GetSSIArgStruct *ArgsList;
+   SSITile **SortedTiles;
+   int NumTiles, NextTile;
+   pthread_mutex_t Mutex;
+ } TileQueue;
+
+static void *TileThread(void *data)
+{
+  TileQueue *Q = (TileQueue *)data;
+  while(1)
+   { pthread_mutex_lock(&(Q->Mutex));
+     int nt = Q->NextTile++;
+     pthread_mutex_unlock(&(Q->Mutex));
+     if (nt>=Q->NumTiles) break;
+     RunSSITile(Q->ArgsList, Q->SortedTiles[nt]);
+   };
+  return 0;
+}
+#endif
+
+/***************************************************************/
+/* assemble the diagonal and above-diagonal blocks of the BEM  */
+/* matrix for a compact geometry using the global scheduler.   */
+/* On return, the lower triangles of the diagonal blocks have  */
+/* been filled in, but the below-diagonal blocks have not.     */
+/***************************************************************/
+void AssembleBEMMatrixByTiles(RWGGeometry *G, cdouble Omega, HMatrix *M)
+{
+  int NS = G->NumSurfaces;
+  int *BFIndexOffset = G->BFIndexOffset;
+  G->UpdateCachedEpsMuValues(Omega);
+
+  /***************************************************************/
+  /* make a list of the blocks that need computing, skipping     */
+  /* diagonal blocks that can be read from the T-block cache or  */
+  /* copied from an identical previous surface, and off-diagonal */
+  /* blocks that can be copied from a congruent surface pair     */
+  /***************************************************************/
+  int *CongruentBlocks = GetCongruentBlockTable(G);
+  int MaxBlocks = NS*(NS+1)/2;
+  GetSSIArgStruct *ArgsList = new GetSSIArgStruct[MaxBlocks];
+  int NumBlocks=0;
+  for(int nsa=0; nsa<NS; nsa++)
+   for(int nsb=nsa; nsb<NS; nsb++)
+    {
+      if (nsa==nsb && G->Mate[nsa]!=-1)
+       continue;
+      if (CongruentBlocks && nsa<nsb && CongruentBlocks[nsa*NS+nsb]!=-1)
+       continue;
+      if (nsa==nsb && TBlockCacheOp(TBCOP_READ, G, nsa, Omega, 0, M,
+                                    BFIndexOffset[nsa], BFIndexOffset[nsa]))
+       continue;
+
+      GetSSIArgStruct *Args = ArgsList + NumBlocks;
+      InitGetSSIArgs(Args);
+      Args->G=G;
+      Args->Sa=G->Surfaces[nsa];
+      Args->Sb=G->Surfaces[nsb];
+      Args->Omega=Omega;
+      Args->Symmetric = (nsa==nsb);
+      Args->B=M;
+      Args->RowOffset=BFIndexOffset[nsa];
+      Args->ColOffset=BFIndexOffset[nsb];
+      if (InitSSIBlock(Args))
+       NumBlocks++;
+    };
+
+  /***************************************************************/
+  /* chop blocks into tiles and sort tiles by estimated cost     */
+  /***************************************************************/
+  int NumTiles=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   NumTiles += (ArgsList[nb].Sa->NumEdges + TILE_EDGES - 1) / TILE_EDGES;
+
+  SSITile *Tiles = new SSITile[NumTiles];
+  SSITile **SortedTiles = new SSITile *[NumTiles];
+  for(int nb=0, nt=0; nb<NumBlocks; nb++)
+   { int NEa = ArgsList[nb].Sa->NumEdges;
+     for(int neaMin=0; neaMin<NEa; neaMin+=TILE_EDGES, nt++)
+      { Tiles[nt].nb     = nb;
+        Tiles[nt].neaMin = neaMin;
+        Tiles[nt].neaMax = (neaMin+TILE_EDGES < NEa) ? neaMin+TILE_EDGES : NEa;
+        Tiles[nt].Cost   = EstimateTileCost(ArgsList+nb, Tiles[nt].neaMin, Tiles[nt].neaMax);
+        SortedTiles[nt]  = Tiles + nt;
+      };
+   };
+  std::stable_sort(SortedTiles, SortedTiles + NumTiles, CompareTileCosts);
+
+  /***************************************************************/
+  /* process tiles *************************************************/
+  /***************************************************************/
+  GlobalFIPPICache.Stats.Reset();
+  int NumThreads = GetNumThreads();
+  if (G->LogLevel>=SCUFF_VERBOSE2)
+   Log(" scheduling %i tiles from %i blocks on %i threads",NumTiles,NumBlocks,NumThreads);
+  double T0=Secs();
+#ifdef USE_PTHREAD
+  TileQueue Q;
+  Q.ArgsList=ArgsList;
+  Q.SortedTiles=SortedTiles;
+  Q.NumTiles=NumTiles;
+  Q.NextTile=0;
+  pthread_mutex_init(&(Q.Mutex), 0);
+  pthread_t *Threads = new pthread_t[NumThreads];
+  for(int nt=0; nt<NumThreads-1; nt++)
+   pthread_create( &(Threads[nt]), 0, TileThread, (void *)&Q);
+  TileThread((void *)&Q);
+  for(int nt=0; nt<NumThreads-1; nt++)
+   pthread_join(Threads[nt],0);
+  pthread_mutex_destroy(&(Q.Mutex));
+  delete[] Threads;
+#else
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nt=0; nt<NumTiles; nt++)
+   RunSSITile(ArgsList, SortedTiles[nt]);
+#endif
+  double WallTime=Secs()-T0;
+
+  /***************************************************************/
+  /* finish up blocks and report per-block timing statistics      */
+  /***************************************************************/
+  unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];
+  memset(PPIAlgorithmCount, 0, NUMPPIALGORITHMS*sizeof(unsigned));
+  for(int nt=0; nt<NumTiles; nt++)
+   for(int n=0; n<NUMPPIALGORITHMS; n++)
+    PPIAlgorithmCount[n] += Tiles[nt].PPIAlgorithmCount[n];
+
+  double TotalTileTime=0.0;
+  for(int nb=0, nt=0; nb<NumBlocks; nb++)
+   {
+     GetSSIArgStruct *Args = ArgsList + nb;
+     FinishSSIBlock(Args);
+
+     int NumBlockTiles=0;
+     double BlockCost=0.0, BlockTime=0.0, Start=HUGE_VAL, Stop=-HUGE_VAL;
+     for(; nt<NumTiles && Tiles[nt].nb==nb; nt++, NumBlockTiles++)
+      { BlockCost += Tiles[nt].Cost;
+        BlockTime += Tiles[nt].Stop - Tiles[nt].Start;
+        if (Tiles[nt].Start < Start) Start=Tiles[nt].Start;
+        if (Tiles[nt].Stop  > Stop)  Stop =Tiles[nt].Stop;
+      };
+     TotalTileTime+=BlockTime;
+
+     int nsa = Args->Sa->Index, nsb = Args->Sb->Index;
+     if (G->LogLevel>=SCUFF_VERBOSELOGGING)
+      Log(" block (%i,%i): %i tiles, cost %.2e, %.3f s thread time, "
+          "active %.3f-%.3f s",nsa,nsb,NumBlockTiles,BlockCost,BlockTime,
+           Start-T0, Stop-T0);
+
+     if (nsa==nsb)
+      TBlockCacheOp(TBCOP_WRITE, G, nsa, Omega, 0, M, Args->RowOffset, Args->ColOffset);
+   };
+
+  if (G->LogLevel>=SCUFF_VERBOSELOGGING)
+   Log(" %i tiles: %.3f s thread time, %.3f s wall time (%.0f%% efficiency)",
+       NumTiles, TotalTileTime, WallTime,
+       WallTime>0.0 ? 100.0*TotalTileTime/(NumThreads*WallTime) : 100.0);
+
+  if (G->LogLevel>=SCUFF_VERBOSE2)
+   { GlobalFIPPICache.LogStatistics();
+     Log("  PPIs: LOC(%u), HOC(%u), TD(%u), HK(%u), D(%u)",
+            PPIAlgorithmCount[PPIALG_LOCUBATURE],
+            PPIAlgorithmCount[PPIALG_HOCUBATURE],
+            PPIAlgorithmCount[PPIALG_TD],
+            PPIAlgorithmCount[PPIALG_HKTD],
+            PPIAlgorithmCount[PPIALG_DESING]);
+   };
+
+  /***************************************************************/
+  /* copy diagonal blocks of surfaces with identical mates; the  */
+  /* mate always has a smaller index, so its diagonal block is   */
+  /* complete at this point.                                     */
+  /***************************************************************/
+  for(int ns=0; ns<NS; ns++)
+   { int nsm=G->Mate[ns];
+     if (nsm==-1) continue;
+     int ThisOffset = BFIndexOffset[ns];
+     int MateOffset = BFIndexOffset[nsm];
+     int Dim = G->Surfaces[ns]->NumBFs;
+     Log("Block(%i,%i) is identical to block (%i,%i) (reusing)",ns,ns,nsm,nsm);
+     M->InsertBlock(M, ThisOffset, ThisOffset, Dim, Dim, MateOffset, MateOffset);
+   };
+
+  /***************************************************************/
+  /* copy off-diagonal blocks of congruent surface pairs; source */
+  /* blocks were all computed above.                             */
+  /***************************************************************/
+  if (CongruentBlocks)
+   { for(int nsa=0; nsa<NS; nsa++)
+      for(int nsb=nsa+1; nsb<NS; nsb++)
+       CopyCongruentBlock(G, CongruentBlocks, nsa, nsb, M,
+                          BFIndexOffset[nsa], BFIndexOffset[nsb]);
+     free(CongruentBlocks);
+   };
+
+  delete[] SortedTiles;
+  delete[] Tiles;
+  delete[] ArgsList;
+}
+
 /***************************************************************/
 /* this is the actual API-exposed routine for assembling the   */
 /* BEM matrix, which is pretty simple and really just calls    */
@@ -774,25 +868,42 @@ HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *
 
   /***************************************************************/
   /* loop over all pairs of objects to assemble the diagonal and */
-  /* above-diagonal blocks of the matrix                         */
+  /* above-diagonal blocks of the matrix. for compact geometries */
+  /* with more than one surface, all blocks are handed at once   */
+  /* to the global block scheduler.                              */
   /***************************************************************/
+  bool UseBlockScheduler =    LBasis==0 && NumSurfaces>1
+                           && !DisableBlockScheduler
+                           && !UsePanelPairAssembly
+                           && FreqInterpTol==0.0;
   int nsm; // 'number of surface mate'
   int nspStart = MatrixIsSymmetric ? 1 : 0;
-  for(int ns=0; ns<NumSurfaces; ns++)
-   for(int nsp=nspStart*ns; nsp<NumSurfaces; nsp++)
-    { 
-      // attempt to reuse the diagonal block of an identical previous object
-      if (ns==nsp && (nsm=Mate[ns])!=-1)
-       { int ThisOffset = BFIndexOffset[ns];
-         int MateOffset = BFIndexOffset[nsm];
-         int Dim = Surfaces[ns]->NumBFs;
-         Log("Block(%i,%i) is identical to block (%i,%i) (reusing)",ns,ns,nsm,nsm);
-         M->InsertBlock(M, ThisOffset, ThisOffset, Dim, Dim, MateOffset, MateOffset);
-       }
-      else
-       AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, M, 0,
-                              BFIndexOffset[ns], BFIndexOffset[nsp]);
-    };
+  if (UseBlockScheduler)
+   AssembleBEMMatrixByTiles(this, Omega, M);
+  else
+   { int *CongruentBlocks = GetCongruentBlockTable(this);
+     for(int ns=0; ns<NumSurfaces; ns++)
+      for(int nsp=nspStart*ns; nsp<NumSurfaces; nsp++)
+       { 
+         // attempt to reuse the diagonal block of an identical previous object
+         if (ns==nsp && (nsm=Mate[ns])!=-1)
+          { int ThisOffset = BFIndexOffset[ns];
+            int MateOffset = BFIndexOffset[nsm];
+            int Dim = Surfaces[ns]->NumBFs;
+            Log("Block(%i,%i) is identical to block (%i,%i) (reusing)",ns,ns,nsm,nsm);
+            M->InsertBlock(M, ThisOffset, ThisOffset, Dim, Dim, MateOffset, MateOffset);
+          }
+         // or the block of a congruent previous pair of objects
+         else if (CopyCongruentBlock(this, CongruentBlocks, ns, nsp, M,
+                                     BFIndexOffset[ns], BFIndexOffset[nsp]))
+          continue;
+         else
+          AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, M, 0,
+                                 BFIndexOffset[ns], BFIndexOffset[nsp]);
+       };
+     if (CongruentBlocks)
+      free(CongruentBlocks);
+   };
 
   /***************************************************************/
   /* if the matrix is symmetric, then the computations above have*/
@@ -800,20 +911,27 @@ HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *
   /* fill in the lower triangle. (The exception is if the matrix */
   /* is defined to use packed storage, in which case only the    */
   /* upper triangle is needed anyway.)                           */
-  /* Note: Technically the lower-triangular parts of the diagonal*/
-  /* blocks should already have been filled in, so this code is  */
-  /* slightly redundant because it re-fills-in those entries.    */
+  /* We also flag the matrix as symmetric so that LUFactorize()  */
+  /* can use the Bunch-Kaufman factorization, which needs half   */
+  /* the flops of a general LU factorization; this is not valid  */
+  /* if the MMJ transformation below adds rows to one another.   */
   /***************************************************************/
   if (MatrixIsSymmetric && M->StorageType==LHM_NORMAL)
-   { 
-     for(int nr=1; nr<TotalBFs; nr++)
-      for(int nc=0; nc<nr; nc++)
-       M->SetEntry(nr, nc, M->GetEntry(nc, nr) );
+   { M->FillLowerTriangle();
+     M->Symmetric = !(UseHRWGFunctions && NumMMJs>0);
    };
 
   if (UseHRWGFunctions && NumMMJs>0 )
    ApplyMMJTransformation(M, 0);
 
+  /***************************************************************/
+  /* if requested, compute the EMTPFT integrals at this frequency*/
+  /* now, so that PFT computations after the solve only need to  */
+  /* contract them with the surface currents                     */
+  /***************************************************************/
+  if (PrecomputeEMTPFT && LBasis==0)
+   PrecomputeEMTPFTIntegrals(this, Omega, false, SCUFF_EMTPFTI_DEFAULT);
+
   return M;
 
 }
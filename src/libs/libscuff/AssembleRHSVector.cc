@@ -421,6 +421,104 @@ HVector *RWGGeometry::AssembleRHSVector(cdouble Omega, double *kBloch,
   return RHS;
 }
 
+/***************************************************************/
+/* Assemble RHS vectors for NumIFs independent incident fields */
+/* at once. IFs[nif] is the (possibly chained) incident field  */
+/* for the nifth RHS, whose RHS vector is stored as the nifth  */
+/* column of the TotalBFs x NumIFs matrix RHS. Parallelization */
+/* is over (incident field, edge) pairs, so a long list of     */
+/* incident fields keeps all threads busy even for small       */
+/* geometries.                                                 */
+/***************************************************************/
+HMatrix *RWGGeometry::AssembleRHSVectors(cdouble Omega, double *kBloch,
+                                         IncField **IFs, int NumIFs,
+                                         HMatrix *RHS)
+{ 
+  if ( RHS==0 || RHS->NR!=TotalBFs || RHS->NC!=NumIFs )
+   { if (RHS)
+      { Warn("wrong-size RHS matrix passed to AssembleRHSVectors; reallocating");
+        delete RHS;
+      };
+     RHS=new HMatrix(TotalBFs, NumIFs, LHM_COMPLEX);
+   };
+  RHS->Zero();
+
+  /*--------------------------------------------------------------*/
+  /*- sort the incident fields for each (RHS, surface) pair into  */
+  /*- those contributing with positive and negative signs, as in  */
+  /*- AssembleRHS_Thread                                          */
+  /*--------------------------------------------------------------*/
+  int NS=NumSurfaces;
+  int MaxChain=1;
+  for(int nif=0; nif<NumIFs; nif++)
+   { int NIF=UpdateIncFields(IFs[nif], Omega, kBloch);
+     if (NIF>MaxChain) MaxChain=NIF;
+   };
+  IncField **PositiveIFs = new IncField *[NumIFs*NS*MaxChain];
+  IncField **NegativeIFs = new IncField *[NumIFs*NS*MaxChain];
+  int *NPositiveIFs = new int[NumIFs*NS];
+  int *NNegativeIFs = new int[NumIFs*NS];
+  for(int nif=0; nif<NumIFs; nif++)
+   for(int ns=0; ns<NS; ns++)
+    { int n=nif*NS + ns;
+      NPositiveIFs[n]=NNegativeIFs[n]=0;
+      for(IncField *IF=IFs[nif]; IF; IF=IF->Next)
+       { if (Surfaces[ns]->RegionIndices[0]==IF->RegionIndex)
+          NegativeIFs[n*MaxChain + NNegativeIFs[n]++] = IF;
+         else if (Surfaces[ns]->RegionIndices[1]==IF->RegionIndex)
+          PositiveIFs[n*MaxChain + NPositiveIFs[n]++] = IF;
+       };
+    };
+
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  int NE=TotalEdges;
+  int NumTasks=NumIFs*NE;
+#ifdef USE_OPENMP
+  int NumThreads=GetNumThreads();
+  Log("Assembling %i RHS vectors (%i threads)",NumIFs,NumThreads);
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#else
+  Log("Assembling %i RHS vectors",NumIFs);
+#endif
+  for(int nTask=0; nTask<NumTasks; nTask++)
+   { 
+     int nif    = nTask / NE;
+     int neFull = nTask % NE;
+     int ns, ne, nbf;
+     RWGSurface *S = ResolveEdge(neFull, &ns, &ne, &nbf);
+     int n = nif*NS + ns;
+     if ( NPositiveIFs[n]==0 && NNegativeIFs[n]==0 )
+      continue;
+
+     cdouble EProd, HProd;
+     GetInnerProducts(S, ne,
+                      PositiveIFs + n*MaxChain, NPositiveIFs[n],
+                      NegativeIFs + n*MaxChain, NNegativeIFs[n],
+                      &EProd, S->IsPEC ? 0 : &HProd );
+     RHS->SetEntry(nbf, nif, EProd / ZVAC);
+     if ( !(S->IsPEC) )
+      RHS->SetEntry(nbf+1, nif, HProd);
+   };
+
+  delete[] PositiveIFs;
+  delete[] NegativeIFs;
+  delete[] NPositiveIFs;
+  delete[] NNegativeIFs;
+
+  if (UseHRWGFunctions && NumMMJs>0 )
+   { HVector Column(TotalBFs, LHM_COMPLEX);
+     for(int nif=0; nif<NumIFs; nif++)
+      { RHS->GetEntries(":", nif, Column.ZV);
+        ApplyMMJTransformation(0, &Column);
+        RHS->SetEntries(":", nif, Column.ZV);
+      };
+   };
+
+  return RHS;
+}
+
 /***************************************************************/
 /* non-PBC entry point for AssembleRHSVector                   */
 /***************************************************************/
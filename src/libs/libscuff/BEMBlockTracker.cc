@@ -0,0 +1,250 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * BEMBlockTracker.cc -- incremental update of BEM matrix blocks and
+ *                    -- of the LU factorization of the BEM matrix
+ *                    -- under geometrical transformations
+ *
+ * Codes like scuff-cas3D and scuff-neq compute the BEM matrix for a
+ * long list of geometrical transformations at each frequency. The
+ * (a,b) block of the matrix depends only on the relative position of
+ * surfaces a and b (for compact geometries), so after a call to
+ * RWGGeometry::Transform() the only blocks that need recomputing are
+ * those for which
+ *
+ *   Rel_{ab} = GT_a^{-1} * GT_b
+ *
+ * differs from its value when the block was last computed; here GT_a
+ * is the transformation currently applied to surface a (RWGSurface::GT).
+ * For PBC geometries the Bloch-periodic Green's function is not
+ * invariant under rotations, so there we require GT_a and GT_b
+ * themselves to be unchanged.
+ *
+ * The tracker also remembers which blocks were recomputed since the
+ * last LU factorization. If all of them have at least one index >= k,
+ * then the leading block of M comprising surfaces 0..k-1 is unchanged,
+ * and if M was factorized with HMatrix::LUFactorizeBlocked() with that
+ * leading block, only the Schur complement of the trailing surfaces
+ * needs to be refactorized. For a small surface moving near a large
+ * one (a tip over a substrate) this replaces an O(N^3) factorization
+ * by a few matrix-matrix products of size O(NA^2 NB).
+ *
+ * Note that this only helps if the moving surfaces come last in the
+ * .scuffgeo file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+#define POSE_TOL 1.0e-10
+
+/***************************************************************/
+/* identity if the surface has never been transformed          */
+/***************************************************************/
+static GTransformation GetPose(RWGSurface *S)
+{
+  if (S->GT) return GTransformation(S->GT);
+  return GTransformation();
+}
+
+static bool SamePose(const GTransformation &G1, const GTransformation &G2)
+{
+  for(int i=0; i<3; i++)
+   for(int j=0; j<3; j++)
+    if ( fabs(G1.M[i][j] - G2.M[i][j]) > POSE_TOL )
+     return false;
+
+  double Scale = fmax(1.0, fmax(VecNorm(G1.DX), VecNorm(G2.DX)));
+  for(int i=0; i<3; i++)
+   if ( fabs(G1.DX[i] - G2.DX[i]) > POSE_TOL*Scale )
+    return false;
+
+  return true;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+BEMBlockTracker::BEMBlockTracker(RWGGeometry *pG)
+{
+  G  = pG;
+  NS = G->NumSurfaces;
+  PoseA = new GTransformation[NS*NS];
+  PoseB = new GTransformation[NS*NS];
+  Current = (bool *)mallocEC(NS*NS*sizeof(bool));
+  Dirty   = (bool *)mallocEC(NS*NS*sizeof(bool));
+  LeadingHint = 0;
+  Reset();
+}
+
+BEMBlockTracker::~BEMBlockTracker()
+{
+  delete[] PoseA;
+  delete[] PoseB;
+  free(Current);
+  free(Dirty);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void BEMBlockTracker::Reset()
+{
+  memset(Current, 0, NS*NS*sizeof(bool));
+  memset(Dirty,   0, NS*NS*sizeof(bool));
+  AllDirty = true;
+  FactorizedM = 0;
+  LeadingSurfaces = 0;
+}
+
+/***************************************************************/
+/* choose the leading block for the first factorization after  */
+/* Reset(): all surfaces before the first one that any of the  */
+/* transformations moves                                       */
+/***************************************************************/
+void BEMBlockTracker::SetLeadingSurfaces(GTComplex **GTCList, int NumGTCs)
+{
+  int FirstMoved=NS;
+  GTransformation Identity;
+  for(int ngtc=0; ngtc<NumGTCs; ngtc++)
+   for(int nsa=0; nsa<GTCList[ngtc]->NumSurfacesAffected; nsa++)
+    { int ns;
+      if (    G->GetSurfaceByLabel(GTCList[ngtc]->SurfaceLabel[nsa], &ns)
+           && !SamePose(GTCList[ngtc]->GT[nsa], Identity)
+           && ns<FirstMoved
+         ) FirstMoved=ns;
+    };
+
+  LeadingHint = (FirstMoved<NS) ? FirstMoved : 0;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+bool BEMBlockTracker::BlockIsStale(int nsa, int nsb, bool AbsolutePose)
+{
+  int nb = nsa*NS + nsb;
+  if (!Current[nb])
+   return true;
+
+  GTransformation GA=GetPose(G->Surfaces[nsa]);
+  GTransformation GB=GetPose(G->Surfaces[nsb]);
+  if (G->LBasis || AbsolutePose)
+   return !SamePose(GA, PoseA[nb]) || !SamePose(GB, PoseB[nb]);
+
+  if (nsa==nsb)
+   return false;
+
+  return !SamePose( GA.Inverse() + GB, PoseA[nb].Inverse() + PoseB[nb] );
+}
+
+void BEMBlockTracker::MarkBlockCurrent(int nsa, int nsb)
+{
+  int nb = nsa*NS + nsb;
+  PoseA[nb] = GetPose(G->Surfaces[nsa]);
+  PoseB[nb] = GetPose(G->Surfaces[nsb]);
+  Current[nb] = Dirty[nb] = true;
+}
+
+/***************************************************************/
+/* lowest surface index k such that no block among surfaces    */
+/* 0..k-1 was recomputed since the last factorization          */
+/***************************************************************/
+int BEMBlockTracker::GetFirstDirtySurface()
+{
+  if (AllDirty)
+   return 0;
+
+  int k=NS;
+  for(int nsa=0; nsa<NS; nsa++)
+   for(int nsb=0; nsb<NS; nsb++)
+    if ( Dirty[nsa*NS+nsb] && (nsa>nsb ? nsa : nsb)<k )
+     k=(nsa>nsb ? nsa : nsb);
+  return k;
+}
+
+/***************************************************************/
+/* returns the index of the first surface whose rows and       */
+/* columns the caller must restamp into M before calling       */
+/* LUFactorize(M): 0 if the whole matrix must be restamped,    */
+/* NS if M is still factorized and up to date.                 */
+/***************************************************************/
+int BEMBlockTracker::FirstSurfaceToRestamp(HMatrix *M)
+{
+  if (M!=FactorizedM)
+   return 0;
+
+  int k=GetFirstDirtySurface();
+  if (k==NS)
+   return NS;
+
+  if (    LeadingSurfaces>0 && k>=LeadingSurfaces
+       && M->LeadingBlockDim==G->BFIndexOffset[LeadingSurfaces]
+     ) return LeadingSurfaces;
+
+  return 0;
+}
+
+/***************************************************************/
+/* LU-factorize M, which the caller has restamped from surface */
+/* FirstSurfaceToRestamp(M) onwards.                           */
+/***************************************************************/
+int BEMBlockTracker::LUFactorize(HMatrix *M)
+{
+  int k=FirstSurfaceToRestamp(M);
+  int info=0;
+
+  if (k==NS)
+   Log("BEM matrix unchanged since last factorization (reusing)");
+  else if (k>0)
+   { Log("Updating LU factorization for surfaces %i--%i",k,NS-1);
+     info=M->LUFactorizeBlocked(G->BFIndexOffset[k], true);
+   }
+  else
+   {
+     // leading block for future updates: the caller's choice,
+     // unless it would have prevented an update this time
+     int kd=GetFirstDirtySurface();
+     LeadingSurfaces = LeadingHint;
+     if ( 0<kd && kd<NS && (LeadingSurfaces==0 || kd<LeadingSurfaces) )
+      LeadingSurfaces=kd;
+     if (LeadingSurfaces>0 && LeadingSurfaces<NS)
+      info=M->LUFactorizeBlocked(G->BFIndexOffset[LeadingSurfaces]);
+     else
+      { LeadingSurfaces=0;
+        info=M->LUFactorize();
+      };
+   };
+
+  FactorizedM = M;
+  AllDirty = false;
+  memset(Dirty, 0, NS*NS*sizeof(bool));
+  return info;
+}
+
+} // namespace scuff
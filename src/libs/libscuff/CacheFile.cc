@@ -0,0 +1,413 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * CacheFile.cc -- indexed on-disk format for FIPPI and FIBBI cache
+ *              -- files, designed to be mmap()ed read-only and
+ *              -- queried in place
+ *
+ * File layout:
+ *
+ *  offset 0:             CacheFileHeader (see below)
+ *  offset RecordOffset:  NumRecords records; each record is a key
+ *                        (KeySize bytes, zero-padded to a multiple
+ *                        of 8 bytes) followed by a data block
+ *                        (DataSize bytes)
+ *  offset IndexOffset:   open-addressing hash index: NumSlots
+ *                        (a power of 2) 64-bit entries, each either
+ *                        0 (empty) or 1 + the index of a record.
+ *                        a key with hash h is looked up by linear
+ *                        probing starting at slot h & (NumSlots-1).
+ *
+ * All header fields, keys, and data are stored in the byte order of
+ * the machine that wrote the file, which is recorded in the header
+ * via ByteOrderMark. Files with the opposite byte order can still be
+ * read (see ByteSwapped below) but can't be queried in place.
+ *
+ * The header contains an FNV-1a checksum of the header itself, which
+ * is always verified, and a checksum of the records and index, which
+ * is verified only if SCUFF_CACHE_VERIFY=1 since doing so requires
+ * reading the entire file. The (much smaller) index is always checked
+ * for entries pointing past the last record when the file is mapped.
+ *
+ * Files are written to a temporary file which is then renamed into
+ * place, so processes that have the old version of the file mapped
+ * are unaffected.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+#define CACHEFILE_MAGIC    "SCUFFCF"
+#define CACHEFILE_VERSION  1
+#define CACHEFILE_BOM      0x01020304U
+
+typedef struct CacheFileHeader
+ { char     Magic[8];        // "SCUFFCF" + 0
+   char     Kind[8];         // "FIPPI", "FIBBI", ...
+   uint32_t ByteOrderMark;   // CACHEFILE_BOM in the writer's byte order
+   uint32_t Version;
+   uint32_t KeySize;         // bytes per key (before padding)
+   uint32_t DataSize;        // bytes per data block
+   uint64_t NumRecords;
+   uint64_t NumSlots;
+   uint64_t RecordOffset;
+   uint64_t IndexOffset;
+   uint64_t DataChecksum;    // checksum of records and index
+   uint64_t HeaderChecksum;  // checksum of all preceding header bytes
+ } CacheFileHeader;
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+
+static uint64_t FNV1a(const void *Buffer, size_t Size, uint64_t h=FNV_OFFSET)
+{ const unsigned char *p=(const unsigned char *)Buffer;
+  for(size_t n=0; n<Size; n++)
+   { h ^= p[n];
+     h *= FNV_PRIME;
+   };
+  return h;
+}
+
+uint64_t CacheKeyHash(const void *Key, size_t KeySize)
+{ return FNV1a(Key, KeySize); }
+
+static size_t PaddedKeySize(size_t KeySize)
+{ return (KeySize + 7) & ~((size_t)7); }
+
+static void SwapBytes(void *Buffer, size_t ItemSize)
+{ unsigned char *p=(unsigned char *)Buffer;
+  for(size_t i=0, j=ItemSize-1; i<j; i++, j--)
+   { unsigned char Temp=p[i]; p[i]=p[j]; p[j]=Temp; }
+}
+
+void SwapCacheItems(void *Buffer, size_t ItemSize, size_t NumItems)
+{ for(size_t n=0; n<NumItems; n++)
+   SwapBytes( ((char *)Buffer) + n*ItemSize, ItemSize);
+}
+
+static void SwapHeader(CacheFileHeader *H)
+{ SwapBytes(&(H->ByteOrderMark),  4);
+  SwapBytes(&(H->Version),        4);
+  SwapBytes(&(H->KeySize),        4);
+  SwapBytes(&(H->DataSize),       4);
+  SwapBytes(&(H->NumRecords),     8);
+  SwapBytes(&(H->NumSlots),       8);
+  SwapBytes(&(H->RecordOffset),   8);
+  SwapBytes(&(H->IndexOffset),    8);
+  SwapBytes(&(H->DataChecksum),   8);
+  SwapBytes(&(H->HeaderChecksum), 8);
+}
+
+/***************************************************************/
+/* return true if FileName begins with the signature of the    */
+/* indexed cache-file format                                   */
+/***************************************************************/
+bool IsIndexedCacheFile(const char *FileName)
+{
+  FILE *f=fopen(FileName,"r");
+  if (!f) return false;
+  char Magic[8];
+  bool Status = (fread(Magic, 8, 1, f)==1) && !strcmp(Magic, CACHEFILE_MAGIC);
+  fclose(f);
+  return Status;
+}
+
+/***************************************************************/
+/* MappedCacheFile *********************************************/
+/***************************************************************/
+MappedCacheFile::MappedCacheFile(const char *pFileName, const char *Kind,
+                                 size_t pKeySize, size_t pDataSize)
+{
+  ErrMsg=0;
+  FileName=strdupEC(pFileName);
+  Map=0;
+  MapSize=0;
+  NumRecords=0;
+  NumSlots=0;
+  ByteSwapped=false;
+  KeySize=pKeySize;
+  DataSize=pDataSize;
+  RecordSize=PaddedKeySize(KeySize) + DataSize;
+
+  int fd=open(FileName, O_RDONLY);
+  if (fd<0)
+   { ErrMsg=vstrdup("could not open file %s",FileName);
+     return;
+   };
+  struct stat st;
+  if ( fstat(fd, &st)!=0 || ((size_t)st.st_size) < sizeof(CacheFileHeader) )
+   { close(fd);
+     ErrMsg=vstrdup("%s: invalid cache file",FileName);
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- read and sanity-check the header ---------------------------*/
+  /*--------------------------------------------------------------*/
+  CacheFileHeader H;
+  if ( pread(fd, &H, sizeof(H), 0) != (ssize_t)sizeof(H) )
+   { close(fd);
+     ErrMsg=vstrdup("%s: invalid cache file",FileName);
+     return;
+   };
+  uint64_t HeaderChecksum=FNV1a(&H, offsetof(CacheFileHeader, HeaderChecksum));
+  if (H.ByteOrderMark!=CACHEFILE_BOM)
+   { SwapHeader(&H);
+     ByteSwapped=true;
+   };
+
+  if ( strcmp(H.Magic, CACHEFILE_MAGIC) || H.ByteOrderMark!=CACHEFILE_BOM )
+   ErrMsg=vstrdup("%s: invalid cache file",FileName);
+  else if ( H.Version!=CACHEFILE_VERSION )
+   ErrMsg=vstrdup("%s: unsupported cache file version %u",FileName,H.Version);
+  else if ( strncmp(H.Kind, Kind, 8) )
+   ErrMsg=vstrdup("%s: not a %s cache file",FileName,Kind);
+  else if ( H.HeaderChecksum!=HeaderChecksum )
+   ErrMsg=vstrdup("%s: header checksum mismatch",FileName);
+  else if ( H.KeySize!=KeySize || H.DataSize!=DataSize )
+   ErrMsg=vstrdup("%s: incompatible record size",FileName);
+  else if (    H.RecordOffset!=sizeof(CacheFileHeader)
+            || H.IndexOffset!=H.RecordOffset + H.NumRecords*RecordSize
+            || ((uint64_t)st.st_size)!=H.IndexOffset + H.NumSlots*sizeof(uint64_t)
+            || (H.NumSlots & (H.NumSlots-1))!=0
+          )
+   ErrMsg=vstrdup("%s: cache file has incorrect size",FileName);
+  if (ErrMsg)
+   { close(fd);
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- map the file -----------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  MapSize=st.st_size;
+  Map=(char *)mmap(0, MapSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (Map==MAP_FAILED)
+   { Map=0;
+     ErrMsg=vstrdup("%s: could not map file",FileName);
+     return;
+   };
+  madvise(Map, MapSize, MADV_RANDOM);
+
+  NumRecords = H.NumRecords;
+  NumSlots   = H.NumSlots;
+  Records    = Map + H.RecordOffset;
+  Index      = (const uint64_t *)(Map + H.IndexOffset);
+
+  // the index is not covered by the header checksum, so make sure
+  // every entry points at a record before Lookup() follows them
+  // (byte-swapped files are never queried in place)
+  for(uint64_t Slot=0; !ByteSwapped && Slot<NumSlots; Slot++)
+   if (Index[Slot]>NumRecords)
+    { munmap(Map, MapSize);
+      Map=0;
+      ErrMsg=vstrdup("%s: corrupt index",FileName);
+      return;
+    };
+
+  char *s=getenv("SCUFF_CACHE_VERIFY");
+  if (s && s[0]=='1')
+   { Log("Verifying checksum of cache file %s...",FileName);
+     uint64_t DataChecksum=FNV1a(Records, MapSize - H.RecordOffset);
+     if (DataChecksum!=H.DataChecksum)
+      { munmap(Map, MapSize);
+        Map=0;
+        ErrMsg=vstrdup("%s: data checksum mismatch",FileName);
+        return;
+      };
+   };
+}
+
+MappedCacheFile::~MappedCacheFile()
+{
+  if (Map) munmap(Map, MapSize);
+  if (FileName) free(FileName);
+  if (ErrMsg) free(ErrMsg);
+}
+
+const void *MappedCacheFile::GetKey(uint64_t nr)
+{ return Records + nr*RecordSize; }
+
+const void *MappedCacheFile::GetData(uint64_t nr)
+{ return Records + nr*RecordSize + PaddedKeySize(KeySize); }
+
+/***************************************************************/
+/* look up Key and return a pointer to its data block within   */
+/* the mapping, or 0 if the key is not present. this routine   */
+/* touches only read-only memory and requires no locking.      */
+/***************************************************************/
+const void *MappedCacheFile::Lookup(const void *Key)
+{
+  if (Map==0 || ByteSwapped || NumSlots==0)
+   return 0;
+
+  // a damaged index may have no empty slots, so give up after
+  // probing every slot once
+  uint64_t Mask=NumSlots-1;
+  uint64_t Slot=CacheKeyHash(Key, KeySize) & Mask;
+  for(uint64_t NumProbes=0; NumProbes<NumSlots; NumProbes++, Slot=(Slot+1) & Mask)
+   { uint64_t Entry=Index[Slot];
+     if (Entry==0)
+      return 0;
+     const char *Record = Records + (Entry-1)*RecordSize;
+     if ( !memcmp(Record, Key, KeySize) )
+      return Record + PaddedKeySize(KeySize);
+   };
+  return 0;
+}
+
+/***************************************************************/
+/* CacheFileWriter *********************************************/
+/***************************************************************/
+CacheFileWriter::CacheFileWriter(const char *pFileName, const char *pKind,
+                                 size_t pKeySize, size_t pDataSize)
+{
+  ErrMsg=0;
+  NumRecords=0;
+  FileName=strdupEC(pFileName);
+  TempFileName=vstrdup("%s.tmp.%i",pFileName,(int)getpid());
+  memset(Kind, 0, 8);
+  strncpy(Kind, pKind, 7);
+  KeySize=pKeySize;
+  DataSize=pDataSize;
+  Checksum=FNV_OFFSET;
+
+  f=fopen(TempFileName,"w");
+  if (!f)
+   { ErrMsg=vstrdup("could not open file %s",TempFileName);
+     return;
+   };
+
+  // the header is filled in by Close()
+  CacheFileHeader H;
+  memset(&H, 0, sizeof(H));
+  if ( fwrite(&H, sizeof(H), 1, f)!=1 )
+   ErrMsg=vstrdup("could not write to file %s",TempFileName);
+}
+
+CacheFileWriter::~CacheFileWriter()
+{
+  if (f)
+   { fclose(f);
+     unlink(TempFileName);
+   };
+  free(FileName);
+  free(TempFileName);
+  if (ErrMsg) free(ErrMsg);
+}
+
+bool CacheFileWriter::AddRecord(const void *Key, const void *Data)
+{
+  if (ErrMsg) return false;
+
+  char Padding[8]={0,0,0,0,0,0,0,0};
+  size_t PadSize=PaddedKeySize(KeySize) - KeySize;
+  if (    fwrite(Key, KeySize, 1, f)!=1
+       || (PadSize>0 && fwrite(Padding, PadSize, 1, f)!=1)
+       || fwrite(Data, DataSize, 1, f)!=1
+     )
+   { ErrMsg=vstrdup("could not write to file %s",TempFileName);
+     return false;
+   };
+  Checksum=FNV1a(Key,     KeySize,  Checksum);
+  Checksum=FNV1a(Padding, PadSize,  Checksum);
+  Checksum=FNV1a(Data,    DataSize, Checksum);
+  Hashes.push_back( CacheKeyHash(Key, KeySize) );
+  NumRecords++;
+  return true;
+}
+
+/***************************************************************/
+/* write the index and header and move the file into place.    */
+/***************************************************************/
+bool CacheFileWriter::Close()
+{
+  if (ErrMsg) return false;
+
+  /*--------------------------------------------------------------*/
+  /*- build the index with load factor at most 1/2 ---------------*/
+  /*--------------------------------------------------------------*/
+  uint64_t NumSlots=16;
+  while (NumSlots < 2*NumRecords)
+   NumSlots*=2;
+  uint64_t Mask=NumSlots-1;
+  uint64_t *Index=(uint64_t *)mallocEC(NumSlots*sizeof(uint64_t));
+  memset(Index, 0, NumSlots*sizeof(uint64_t));
+  for(uint64_t nr=0; nr<NumRecords; nr++)
+   { uint64_t Slot=Hashes[nr] & Mask;
+     while(Index[Slot]!=0)
+      Slot=(Slot+1) & Mask;
+     Index[Slot]=nr+1;
+   };
+  Checksum=FNV1a(Index, NumSlots*sizeof(uint64_t), Checksum);
+  bool Status = (fwrite(Index, sizeof(uint64_t), NumSlots, f)==NumSlots);
+  free(Index);
+
+  /*--------------------------------------------------------------*/
+  /*- fill in the header -----------------------------------------*/
+  /*--------------------------------------------------------------*/
+  CacheFileHeader H;
+  memset(&H, 0, sizeof(H));
+  strcpy(H.Magic, CACHEFILE_MAGIC);
+  strncpy(H.Kind, Kind, 8);
+  H.ByteOrderMark = CACHEFILE_BOM;
+  H.Version       = CACHEFILE_VERSION;
+  H.KeySize       = KeySize;
+  H.DataSize      = DataSize;
+  H.NumRecords    = NumRecords;
+  H.NumSlots      = NumSlots;
+  H.RecordOffset  = sizeof(CacheFileHeader);
+  H.IndexOffset   = H.RecordOffset + NumRecords*(PaddedKeySize(KeySize) + DataSize);
+  H.DataChecksum  = Checksum;
+  H.HeaderChecksum= FNV1a(&H, offsetof(CacheFileHeader, HeaderChecksum));
+
+  if (Status)
+   Status = ( fseek(f, 0, SEEK_SET)==0 && fwrite(&H, sizeof(H), 1, f)==1 );
+  if ( fclose(f)!=0 )
+   Status=false;
+  f=0;
+
+  if ( Status && rename(TempFileName, FileName)!=0 )
+   Status=false;
+  if (!Status)
+   { ErrMsg=vstrdup("could not write cache file %s",FileName);
+     unlink(TempFileName);
+   };
+  return Status;
+}
+
+} // namespace scuff
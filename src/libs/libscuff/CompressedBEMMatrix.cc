@@ -0,0 +1,215 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * CompressedBEMMatrix.cc -- assembly of the BEM matrix in the
+ *                        -- hierarchically compressed (ACAMatrix)
+ *                        -- format provided by libhmat
+ *
+ * Instead of computing all TotalBFs^2 matrix entries, we hand
+ * libhmat a routine that computes arbitrary subblocks of the BEM
+ * matrix on demand; libhmat organizes the basis functions into a
+ * cluster tree over the edge centroids and calls this routine to
+ * compute dense near-field blocks and the rows and columns needed
+ * to build low-rank approximations of far-field blocks.
+ *
+ * The resulting matrix is used with ACAMatrix::GMRESSolve()
+ * in place of HMatrix::LUFactorize() / LUSolve().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <libhmat.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+#define II cdouble(0,1)
+
+/***************************************************************/
+/* data passed to the block routine called by libhmat          */
+/***************************************************************/
+typedef struct CBMData
+ { RWGGeometry *G;
+   cdouble Omega;
+ } CBMData;
+
+/***************************************************************/
+/* compute the (up to 2x2) block of BEM matrix entries for the */
+/* interaction of edge nea on surface nsa with edge neb on     */
+/* surface nsb: MEE[Ma][Mb] is the entry for the electric      */
+/* (Ma=0) or magnetic (Ma=1) BF on edge nea and the electric   */
+/* or magnetic BF on edge neb, with the same prefactors as in  */
+/* GSSIThread.                                                 */
+/***************************************************************/
+void GetEdgePairBEMEntries(RWGGeometry *G, cdouble Omega,
+                           int nsa, int nea, int nsb, int neb,
+                           cdouble MEE[2][2])
+{
+  MEE[0][0]=MEE[0][1]=MEE[1][0]=MEE[1][1]=0.0;
+
+  RWGSurface *Sa=G->Surfaces[nsa], *Sb=G->Surfaces[nsb];
+  double Signs[2];
+  int CommonRegions[2];
+  int NumCommonRegions=CountCommonRegions(Sa, Sb, CommonRegions, Signs);
+
+  GetEEIArgStruct MyGetEEIArgs, *GetEEIArgs=&MyGetEEIArgs;
+  InitGetEEIArgs(GetEEIArgs);
+  GetEEIArgs->Sa  = Sa;
+  GetEEIArgs->Sb  = Sb;
+  GetEEIArgs->nea = nea;
+  GetEEIArgs->neb = neb;
+
+  for(int nr=0; nr<NumCommonRegions; nr++)
+   {
+     cdouble Eps=G->EpsTF[ CommonRegions[nr] ];
+     cdouble Mu=G->MuTF[ CommonRegions[nr] ];
+     if (Eps==0.0) continue;
+     cdouble k=csqrt2(Eps*Mu)*Omega;
+     if (k==0.0) continue;
+
+     GetEEIArgs->k = k;
+     GetEdgeEdgeInteractions(GetEEIArgs);
+     cdouble G0=GetEEIArgs->GC[0], C0=GetEEIArgs->GC[1];
+
+     MEE[0][0] +=  Signs[nr]*II*Mu*Omega*G0;
+     MEE[0][1] += -Signs[nr]*II*k*C0;
+     MEE[1][0] += -Signs[nr]*II*k*C0;
+     MEE[1][1] += -Signs[nr]*II*Eps*Omega*G0;
+   };
+}
+
+/***************************************************************/
+/* block routine called by libhmat: fill in the NumRows x      */
+/* NumCols block (column-major) of BEM matrix entries for the  */
+/* given BF indices. each edge-edge interaction contributes to */
+/* up to four BF pairs, so we first identify the distinct      */
+/* edges and compute each edge-pair interaction only once.     */
+/***************************************************************/
+static void GetBEMMatrixBlock(void *UserData,
+                              int *Rows, int NumRows,
+                              int *Cols, int NumCols,
+                              cdouble *Block)
+{
+  CBMData *Data  = (CBMData *)UserData;
+  RWGGeometry *G = Data->G;
+
+  // global index of the first BF on each row/column edge
+  int *RowEdges  = new int[NumRows];
+  int *ColEdges  = new int[NumCols];
+  bool *RowIsMag = new bool[NumRows];
+  bool *ColIsMag = new bool[NumCols];
+  for(int nr=0; nr<NumRows; nr++)
+   { G->ResolveBF(Rows[nr], 0, 0, RowIsMag + nr);
+     RowEdges[nr] = Rows[nr] - (RowIsMag[nr] ? 1 : 0);
+   };
+  for(int nc=0; nc<NumCols; nc++)
+   { G->ResolveBF(Cols[nc], 0, 0, ColIsMag + nc);
+     ColEdges[nc] = Cols[nc] - (ColIsMag[nc] ? 1 : 0);
+   };
+
+  int *URowEdges = new int[NumRows];
+  int *UColEdges = new int[NumCols];
+  memcpy(URowEdges, RowEdges, NumRows*sizeof(int));
+  memcpy(UColEdges, ColEdges, NumCols*sizeof(int));
+  std::sort(URowEdges, URowEdges+NumRows);
+  std::sort(UColEdges, UColEdges+NumCols);
+  int NUR = std::unique(URowEdges, URowEdges+NumRows) - URowEdges;
+  int NUC = std::unique(UColEdges, UColEdges+NumCols) - UColEdges;
+
+  cdouble (*MEE)[2][2] = new cdouble[((size_t)NUR)*NUC][2][2];
+  for(int nur=0; nur<NUR; nur++)
+   { int nsa, nea, nsb, neb;
+     G->ResolveBF(URowEdges[nur], &nsa, &nea);
+     for(int nuc=0; nuc<NUC; nuc++)
+      { G->ResolveBF(UColEdges[nuc], &nsb, &neb);
+        GetEdgePairBEMEntries(G, Data->Omega, nsa, nea, nsb, neb,
+                              MEE[((size_t)nur)*NUC + nuc]);
+      };
+   };
+
+  for(int nc=0; nc<NumCols; nc++)
+   { int nuc = std::lower_bound(UColEdges, UColEdges+NUC, ColEdges[nc]) - UColEdges;
+     for(int nr=0; nr<NumRows; nr++)
+      { int nur = std::lower_bound(URowEdges, URowEdges+NUR, RowEdges[nr]) - URowEdges;
+        Block[nr + ((size_t)nc)*NumRows]
+         = MEE[((size_t)nur)*NUC + nuc][RowIsMag[nr]?1:0][ColIsMag[nc]?1:0];
+      };
+   };
+
+  delete[] MEE;
+  delete[] URowEdges;
+  delete[] UColEdges;
+  delete[] RowEdges;
+  delete[] ColEdges;
+  delete[] RowIsMag;
+  delete[] ColIsMag;
+}
+
+/***************************************************************/
+/* assemble the BEM matrix at frequency Omega in compressed    */
+/* form. ACATol is the relative accuracy of the low-rank       */
+/* approximations to far-field blocks.                         */
+/***************************************************************/
+ACAMatrix *RWGGeometry::AssembleCompressedBEMMatrix(cdouble Omega,
+                                                    double ACATol)
+{
+  if (LDim!=0)
+   ErrExit("compressed BEM matrices are not yet supported for periodic geometries");
+  if (UseHRWGFunctions && NumMMJs>0)
+   ErrExit("compressed BEM matrices are not supported for multi-material junctions");
+  for(int ns=0; ns<NumSurfaces; ns++)
+   if (Surfaces[ns]->SurfaceZeta)
+    ErrExit("compressed BEM matrices are not supported for surfaces with finite conductivity");
+
+  Log("Assembling compressed BEM matrix at Omega=%s",z2s(Omega));
+  UpdateCachedEpsMuValues(Omega);
+
+  /*--------------------------------------------------------------*/
+  /*- each BF is associated with the centroid of its edge --------*/
+  /*--------------------------------------------------------------*/
+  double *Points = new double[3*TotalBFs];
+  for(int nbf=0; nbf<TotalBFs; nbf++)
+   { int ns, ne;
+     RWGSurface *S=ResolveBF(nbf, &ns, &ne);
+     memcpy(Points + 3*nbf, S->Edges[ne]->Centroid, 3*sizeof(double));
+   };
+
+  CBMData *Data = new CBMData;
+  Data->G       = this;
+  Data->Omega   = Omega;
+
+  ACAMatrix *M=new ACAMatrix(TotalBFs, Points, GetBEMMatrixBlock, (void *)Data, ACATol);
+
+  // the block routine is not called after construction
+  delete Data;
+  M->UserData=0;
+  delete[] Points;
+
+  return M;
+}
+
+} // namespace scuff
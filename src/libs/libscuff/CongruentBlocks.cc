@@ -0,0 +1,386 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * CongruentBlocks.cc -- detection of off-diagonal BEM matrix blocks
+ *                    -- that couple congruent pairs of surfaces
+ *
+ * The Mate[] array identifies surfaces that were read from the same
+ * mesh and bound regions with the same material properties; the
+ * diagonal blocks of such surfaces are identical and are only
+ * computed once. The same is true of off-diagonal blocks: if surfaces
+ * a and b are copies of surfaces c and d, and the rigid motion that
+ * carries a into c also carries b into d, then the (a,b) block is
+ * identical to the (c,d) block. This happens all the time in practice
+ * (arrays of identical particles, dimers displaced along an axis,
+ * etc.), so AssembleBEMMatrix() only computes one representative
+ * block for each class of congruent pairs and copies the rest.
+ *
+ * How it works: each surface is assigned to the class of its mate
+ * (or to its own class if it has no mate), and we determine the
+ * proper rigid motion {R,t} that maps each vertex of the class
+ * representative onto the corresponding vertex of the surface. (The
+ * motion is computed from three vertices and then checked on all
+ * vertices; surfaces for which this fails, e.g. because they were
+ * mirrored, are put in classes of their own.) The pair (a,b) is then
+ * characterized by the classes of a and b, the regions through which
+ * they interact, and the pose of b relative to a,
+ *
+ *   Q_{ab} = R_a^T R_b,     u_{ab} = R_a^T (t_b - t_a),
+ *
+ * which is unchanged by any rigid motion of the pair. Pairs with the
+ * same characteristics have the same block; pairs with the roles of
+ * the two surfaces interchanged have transposed blocks.
+ *
+ * To avoid comparing every pair with every representative pair
+ * found so far (which costs O(NS^4) for arrays of NS particles), the
+ * representatives are filed under a hash of their classes, regions
+ * and quantized relative pose, and each pair is compared only with
+ * the representatives filed under the same hash. Two congruent pairs
+ * whose pose components happen to straddle a quantization boundary
+ * are simply not recognized as such, which costs a block computation
+ * but never gives a wrong block.
+ *
+ * Only the vertex positions enter, so the table is recomputed at every
+ * assembly and follows the surfaces through RWGGeometry::Transform().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <map>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+// relative tolerance for comparing vertex positions and poses
+#define CONGRUENCE_TOL 1.0e-8
+
+// relative quantum for hashing poses; much larger than the
+// tolerance, so that congruent pairs rarely fall into different
+// quanta
+#define CONGRUENCE_QUANTUM 1.0e-5
+
+typedef struct SurfacePose
+ { int Class;         // index of class representative
+   double R[3][3];    // rotation from class representative
+   double t[3];       // translation from class representative
+ } SurfacePose;
+
+/***************************************************************/
+/* construct a right-handed orthonormal frame from the vertices*/
+/* with indices iV[0..2]; the frame vectors are the columns of */
+/* F.                                                          */
+/***************************************************************/
+static bool GetFrame(double *Vertices, int iV[3], double F[3][3])
+{
+  double *V0=Vertices + 3*iV[0];
+  double *V1=Vertices + 3*iV[1];
+  double *V2=Vertices + 3*iV[2];
+  double E1[3], E2[3], E3[3];
+  VecSub(V1, V0, E1);
+  VecSub(V2, V0, E2);
+  if ( VecNormalize(E1)==0.0 ) return false;
+  VecPlusEquals(E2, -VecDot(E1,E2), E1);
+  if ( VecNormalize(E2)==0.0 ) return false;
+  VecCross(E1, E2, E3);
+  for(int i=0; i<3; i++)
+   { F[i][0]=E1[i]; F[i][1]=E2[i]; F[i][2]=E3[i]; }
+  return true;
+}
+
+/***************************************************************/
+/* determine the proper rigid motion {R,t} that maps each      */
+/* vertex of S0 onto the corresponding vertex of S, i.e.       */
+/* V_S[n] = R*V_{S0}[n] + t for all n, to within Tol.          */
+/***************************************************************/
+static bool GetRigidMotion(RWGSurface *S0, RWGSurface *S, double Tol,
+                           double R[3][3], double t[3])
+{
+  int NV=S0->NumVertices;
+  if (NV<3 || S->NumVertices!=NV) return false;
+  double *V0=S0->Vertices, *V=S->Vertices;
+
+  // choose three well-separated vertices of S0
+  int iV[3]={0,0,0};
+  double MaxD2=0.0;
+  for(int nv=1; nv<NV; nv++)
+   { double D2=VecDistance2(V0+3*nv, V0);
+     if (D2>MaxD2) { MaxD2=D2; iV[1]=nv; }
+   };
+  double MaxA2=0.0, E1[3], E2[3], X[3];
+  VecSub(V0+3*iV[1], V0, E1);
+  for(int nv=1; nv<NV; nv++)
+   { VecSub(V0+3*nv, V0, E2);
+     double A2=VecNorm2(VecCross(E1, E2, X));
+     if (A2>MaxA2) { MaxA2=A2; iV[2]=nv; }
+   };
+  if ( MaxA2 < 1.0e-6*MaxD2*MaxD2 ) return false;
+
+  // R = F * F0^T, where F0 and F are the frames defined by the
+  // same three vertices on the two surfaces
+  double F0[3][3], F[3][3];
+  if ( !GetFrame(V0, iV, F0) || !GetFrame(V, iV, F) )
+   return false;
+  for(int i=0; i<3; i++)
+   for(int j=0; j<3; j++)
+    R[i][j] = F[i][0]*F0[j][0] + F[i][1]*F0[j][1] + F[i][2]*F0[j][2];
+  for(int i=0; i<3; i++)
+   t[i] = V[i] - (R[i][0]*V0[0] + R[i][1]*V0[1] + R[i][2]*V0[2]);
+
+  // check the motion on all vertices
+  for(int nv=0; nv<NV; nv++)
+   { double *P0=V0+3*nv, *P=V+3*nv;
+     for(int i=0; i<3; i++)
+      { double Pi = R[i][0]*P0[0] + R[i][1]*P0[1] + R[i][2]*P0[2] + t[i];
+        if ( fabs(Pi-P[i]) > Tol )
+         return false;
+      };
+   };
+
+  return true;
+}
+
+/***************************************************************/
+/* pose of surface b relative to surface a                     */
+/***************************************************************/
+static void GetRelativePose(SurfacePose *Pa, SurfacePose *Pb,
+                            double Q[3][3], double u[3])
+{
+  double dt[3];
+  VecSub(Pb->t, Pa->t, dt);
+  for(int i=0; i<3; i++)
+   { u[i]=0.0;
+     for(int k=0; k<3; k++)
+      u[i] += Pa->R[k][i]*dt[k];
+     for(int j=0; j<3; j++)
+      { Q[i][j]=0.0;
+        for(int k=0; k<3; k++)
+         Q[i][j] += Pa->R[k][i]*Pb->R[k][j];
+      };
+   };
+}
+
+/***************************************************************/
+/* index of the region through which side n of surface a faces */
+/* side m of surface b, or -1                                  */
+/***************************************************************/
+static int GetCommonRegion(RWGSurface **S, int a, int b, int n, int m)
+{
+  return S[a]->RegionIndices[n]==S[b]->RegionIndices[m] ? S[a]->RegionIndices[n] : -1;
+}
+
+/***************************************************************/
+/* hash of the characteristics of the pair (a,b); congruent    */
+/* pairs have the same hash unless their poses straddle a      */
+/* quantization boundary                                       */
+/***************************************************************/
+static uint64_t GetPairHash(RWGGeometry *G, SurfacePose *Poses,
+                            int a, int b, double Tol)
+{
+  int64_t Key[18];
+  Key[0]=Poses[a].Class;
+  Key[1]=Poses[b].Class;
+  for(int n=0; n<2; n++)
+   for(int m=0; m<2; m++)
+    Key[2+2*n+m]=GetCommonRegion(G->Surfaces, a, b, n, m);
+
+  double Q[3][3], u[3];
+  GetRelativePose(Poses+a, Poses+b, Q, u);
+  double uQuantum = Tol*CONGRUENCE_QUANTUM/CONGRUENCE_TOL;
+  for(int i=0; i<3; i++)
+   { Key[6+i]=llround(u[i]/uQuantum);
+     for(int j=0; j<3; j++)
+      Key[9+3*i+j]=llround(Q[i][j]/CONGRUENCE_QUANTUM);
+   };
+  return CacheKeyHash(Key, sizeof(Key));
+}
+
+/***************************************************************/
+/* return true if the pair (a,b) is congruent to the pair (c,d)*/
+/***************************************************************/
+static bool PairsAreCongruent(RWGGeometry *G, SurfacePose *Poses,
+                              int a, int b, int c, int d, double Tol)
+{
+  if ( Poses[a].Class!=Poses[c].Class || Poses[b].Class!=Poses[d].Class )
+   return false;
+
+  // the surfaces must interact through the same regions, with
+  // the same sides of each surface facing each region
+  RWGSurface **S=G->Surfaces;
+  for(int n=0; n<2; n++)
+   for(int m=0; m<2; m++)
+    if ( GetCommonRegion(S, a, b, n, m)!=GetCommonRegion(S, c, d, n, m) )
+     return false;
+
+  double Qab[3][3], uab[3], Qcd[3][3], ucd[3];
+  GetRelativePose(Poses+a, Poses+b, Qab, uab);
+  GetRelativePose(Poses+c, Poses+d, Qcd, ucd);
+  for(int i=0; i<3; i++)
+   { if ( fabs(uab[i]-ucd[i]) > Tol )
+      return false;
+     for(int j=0; j<3; j++)
+      if ( fabs(Qab[i][j]-Qcd[i][j]) > CONGRUENCE_TOL )
+       return false;
+   };
+  return true;
+}
+
+/***************************************************************/
+/* Identify the above-diagonal blocks of the BEM matrix for a  */
+/* compact geometry that can be copied from other blocks. The  */
+/* return value is an NSxNS table in which, for nsa<nsb,       */
+/*                                                             */
+/*  Table[nsa*NS+nsb] = -1                                     */
+/*                                                             */
+/* if the (nsa,nsb) block must be computed, and otherwise      */
+/*                                                             */
+/*  Table[nsa*NS+nsb] = 2*(nsc*NS+nsd) + Transpose             */
+/*                                                             */
+/* where nsc<nsd and the (nsa,nsb) block is the (nsc,nsd) block*/
+/* (Transpose=0) or its transpose (Transpose=1). Source blocks */
+/* are always blocks that must be computed, and they precede   */
+/* the blocks that copy them in the usual row-major ordering.  */
+/*                                                             */
+/* Returns 0 if there are no congruent blocks. The caller must */
+/* free() the table.                                           */
+/***************************************************************/
+int *GetCongruentBlockTable(RWGGeometry *G)
+{
+  int NS=G->NumSurfaces;
+  if (NS<3 || G->LBasis || RWGGeometry::DisableCongruentBlocks)
+   return 0;
+
+  // length scale for tolerances
+  double Scale=0.0;
+  for(int ns=0; ns<NS; ns++)
+   { RWGSurface *S=G->Surfaces[ns];
+     for(int n=0; n<3*S->NumVertices; n++)
+      Scale = fmax(Scale, fabs(S->Vertices[n]));
+   };
+  double Tol = CONGRUENCE_TOL*(Scale>0.0 ? Scale : 1.0);
+
+  /***************************************************************/
+  /* get rigid motion of each surface relative to its mate       */
+  /***************************************************************/
+  SurfacePose *Poses = new SurfacePose[NS];
+  int NumNontrivial=0;
+  for(int ns=0; ns<NS; ns++)
+   { SurfacePose *P=Poses+ns;
+     int nsm=G->Mate[ns];
+     if (    nsm!=-1
+          && GetRigidMotion(G->Surfaces[nsm], G->Surfaces[ns], Tol, P->R, P->t)
+        )
+      { P->Class=nsm;
+        NumNontrivial++;
+      }
+     else
+      { P->Class=ns;
+        memset(P->R, 0, 9*sizeof(double));
+        memset(P->t, 0, 3*sizeof(double));
+        P->R[0][0]=P->R[1][1]=P->R[2][2]=1.0;
+      };
+   };
+  if (NumNontrivial==0)
+   { delete[] Poses;
+     return 0;
+   };
+
+  /***************************************************************/
+  /* compare each above-diagonal pair, and the same pair with    */
+  /* the roles of the surfaces interchanged, to the              */
+  /* representative pairs found so far with the same hash        */
+  /***************************************************************/
+  typedef std::multimap<uint64_t, int> RepMap;
+  RepMap Reps;
+  int *Table = (int *)mallocEC(NS*NS*sizeof(int));
+  int NumCopies=0;
+  for(int nsa=0; nsa<NS; nsa++)
+   for(int nsb=nsa+1; nsb<NS; nsb++)
+    { int Source=-1;
+      uint64_t Hash=GetPairHash(G, Poses, nsa, nsb, Tol);
+      for(int Transpose=0; Transpose<2 && Source==-1; Transpose++)
+       { int a = Transpose ? nsb : nsa, b = Transpose ? nsa : nsb;
+         uint64_t abHash = Transpose ? GetPairHash(G, Poses, a, b, Tol) : Hash;
+         std::pair<RepMap::iterator, RepMap::iterator> Range=Reps.equal_range(abHash);
+         for(RepMap::iterator it=Range.first; it!=Range.second && Source==-1; it++)
+          { int nsc = it->second / NS, nsd = it->second % NS;
+            if ( PairsAreCongruent(G, Poses, a, b, nsc, nsd, Tol) )
+             Source = 2*it->second + Transpose;
+          };
+       };
+      Table[nsa*NS+nsb]=Source;
+      if (Source==-1)
+       Reps.insert( std::make_pair(Hash, nsa*NS+nsb) );
+      else
+       NumCopies++;
+    };
+
+  delete[] Poses;
+  if (NumCopies==0)
+   { free(Table);
+     return 0;
+   };
+  if (G->LogLevel>=SCUFF_VERBOSE2)
+   Log(" %i of %i off-diagonal blocks couple congruent surface pairs",
+       NumCopies,NS*(NS-1)/2);
+  return Table;
+}
+
+/***************************************************************/
+/* copy the (nsa,nsb) block of M from its source as recorded   */
+/* in a table returned by GetCongruentBlockTable(); returns    */
+/* false if the block has no source.                           */
+/***************************************************************/
+bool CopyCongruentBlock(RWGGeometry *G, int *Table, int nsa, int nsb,
+                        HMatrix *M, int RowOffset, int ColOffset)
+{
+  if (Table==0 || nsa>=nsb)
+   return false;
+  int NS=G->NumSurfaces;
+  int Source = Table[nsa*NS+nsb];
+  if (Source==-1)
+   return false;
+
+  int Transpose = Source%2;
+  int nsc = (Source/2) / NS, nsd = (Source/2) % NS;
+  int NRa = G->Surfaces[nsa]->NumBFs, NCb = G->Surfaces[nsb]->NumBFs;
+  int SourceRowOffset = G->BFIndexOffset[nsc];
+  int SourceColOffset = G->BFIndexOffset[nsd];
+  if (G->LogLevel>=SCUFF_VERBOSE2)
+   Log("Block(%i,%i) is congruent to block (%i,%i)%s (reusing)",
+        nsa,nsb,nsc,nsd,Transpose ? "^T" : "");
+
+  if (Transpose==0)
+   M->InsertBlock(M, RowOffset, ColOffset, NRa, NCb,
+                  SourceRowOffset, SourceColOffset);
+  else
+   { HMatrix B(NCb, NRa, M->RealComplex);
+     M->ExtractBlock(SourceRowOffset, SourceColOffset, &B);
+     M->InsertBlockTranspose(&B, RowOffset, ColOffset);
+   };
+  return true;
+}
+
+} // namespace scuff
@@ -95,14 +95,17 @@ HMatrix *GetSRFluxTrace(RWGGeometry *G, HMatrix *XMatrix, cdouble Omega,
   /***************************************************************/
   /***************************************************************/
   int NBF = G->TotalBFs;
-  static int NBFSave = 0, NXSave=0;
-  static HMatrix *RFMatrix=0;
+  // buffers are per-thread so that several frequency points
+  // may be processed concurrently (cf. FrequencyScheduler.cc)
+  static __thread int NBFSave = 0, NXSave=0;
+  static __thread HMatrix *RFMatrixBuffer=0;
   if (NBFSave!=NBF || NXSave<NX)
    { NBFSave = NBF;
      NXSave  = NX;
-     if (RFMatrix) delete RFMatrix;
-     RFMatrix = new HMatrix(NBF, 6*NX, LHM_COMPLEX);
+     if (RFMatrixBuffer) delete RFMatrixBuffer;
+     RFMatrixBuffer = new HMatrix(NBF, 6*NX, LHM_COMPLEX);
    };
+  HMatrix *RFMatrix=RFMatrixBuffer;
   G->GetRFMatrix(Omega, 0, XMatrix, RFMatrix);
 
   /***************************************************************/
@@ -116,13 +119,14 @@ HMatrix *GetSRFluxTrace(RWGGeometry *G, HMatrix *XMatrix, cdouble Omega,
 #endif
 
   size_t DeltaSRFluxSize = NumThreads*NX*NUMSRFLUX*sizeof(cdouble);
-  static size_t DeltaSRFluxSizeSave=0;
-  static cdouble *DeltaSRFlux = 0;
+  static __thread size_t DeltaSRFluxSizeSave=0;
+  static __thread cdouble *DeltaSRFluxBuffer = 0;
   if (DeltaSRFluxSizeSave<DeltaSRFluxSize)
    { 
      DeltaSRFluxSizeSave=DeltaSRFluxSize;
-     DeltaSRFlux=(cdouble *)reallocEC(DeltaSRFlux,DeltaSRFluxSize);
+     DeltaSRFluxBuffer=(cdouble *)reallocEC(DeltaSRFluxBuffer,DeltaSRFluxSize);
    };
+  cdouble *DeltaSRFlux=DeltaSRFluxBuffer;
   memset(DeltaSRFlux, 0, DeltaSRFluxSize);
 
   /***************************************************************/
@@ -23,6 +23,20 @@
  *               -- problems using the "energy/momentum-transfer" method
  *
  * homer reid    -- 10/2015
+ *
+ * The PFT integrals between pairs of RWG basis functions depend on
+ * the geometry and the frequency but not on the surface currents.
+ * Applications that compute PFTs for several current vectors at the
+ * same frequency (scuff-neq computes one per source surface, and
+ * GetPFT() calls GetEMTPFTMatrix() once per destination surface)
+ * would otherwise repeat the full O(N^2) sweep of pair integrals each
+ * time. The integrals computed at the most recent frequency are
+ * therefore kept in an EMTPFTIStore attached to the RWGGeometry, up
+ * to SCUFF_EMTPFTI_MB megabytes (default 512; 0 disables the store),
+ * and later calls at the same frequency only contract them with the
+ * KN bilinears. With SCUFF_EMTPFT_PRECOMPUTE=1 the store is filled
+ * by AssembleBEMMatrix(), so that the PFT computation after the solve
+ * is a matrix-free contraction even the first time.
  */
 
 #include <stdio.h>
@@ -32,6 +46,8 @@
 #include <ctype.h>
 #include <fenv.h>
 
+#include <pthread.h>
+
 #include <libhrutil.h>
 
 #include "libscuff.h"
@@ -358,7 +374,8 @@ void GetScatteredPFTIntegrals(RWGGeometry *G,
         QNN[PFT_XFORCE+Mu]    = FTPreFac*EpsR*GabArray[0][GCME_FX + Mu];
         QKNmNK[PFT_XFORCE+Mu] = FTPreFac*ikCabArray[0][GCME_FX + Mu]/Omega;
       };
-     for(int nq=PFT_XTORQUE1+6; nq<PFT_ZTORQUE2+6; nq++)
+     QKK[PFT_PABS]=QNN[PFT_PABS]=QKNmNK[PFT_PABS]=0.0;
+     for(int nq=PFT_XTORQUE2; nq<NUMPFTQ; nq++)
       QKK[nq]=QNN[nq]=QKNmNK[nq]=0.0;
    }
   else 
@@ -481,12 +498,15 @@ void GetExtinctionPFTT(RWGGeometry *G, HVector *KN,
   int NQ=NUMPFTT;
   int NTNSNQ=NT*NS*NQ;
 
-  static int DeltaPFTTSize=0;
-  static double *DeltaPFTT=0;
+  // the buffer is per-thread so that several frequency points
+  // may be processed concurrently (cf. FrequencyScheduler.cc)
+  static __thread int DeltaPFTTSize=0;
+  static __thread double *DeltaPFTTBuffer=0;
   if (DeltaPFTTSize < NTNSNQ)
    { DeltaPFTTSize=NTNSNQ;
-     DeltaPFTT=(double *)reallocEC(DeltaPFTT, DeltaPFTTSize*sizeof(double));
+     DeltaPFTTBuffer=(double *)reallocEC(DeltaPFTTBuffer, DeltaPFTTSize*sizeof(double));
    };
+  double *DeltaPFTT=DeltaPFTTBuffer;
   memset(DeltaPFTT, 0, NTNSNQ*sizeof(double));
 
 #ifdef USE_OPENMP
@@ -538,6 +558,290 @@ void GetExtinctionPFTT(RWGGeometry *G, HVector *KN,
      };
 }
 
+/***************************************************************/
+/* Store of PFT integrals for all basis-function pairs at one  */
+/* frequency. For each pair (neaTot,nebTot) handled by the     */
+/* loop in GetEMTPFTMatrix we keep the first NQS entries of    */
+/* each of QKK, QNN, QKNmNK; the remaining entries are zero    */
+/* for the EHDERIVATIVES2 method, which has no term-2 torques. */
+/*                                                             */
+/* The store is invalidated by a change of frequency, of the   */
+/* integration method or the interior/exterior flag, or by     */
+/* motion of any surface, detected as in FrequencyInterpolation*/
+/* by comparing the centroids of a few edges of each surface.  */
+/***************************************************************/
+typedef struct EMTPFTIStore
+ { cdouble Omega;
+   bool Interior, UseSymmetry;
+   int Method;
+   int NS, TotalEdges, NQS;
+   double *Signature;
+   size_t NumPairs;
+   cdouble *Data;  // Data[ 3*NQS*PairIndex + NQS*nm + nq ]
+   bool Valid;     // Data are complete for the key above
+   bool Busy;      // Data are being filled by some thread
+   int Readers;    // number of threads reading Data
+   bool WarnedBudget;
+ } EMTPFTIStore;
+
+double RWGGeometry::EMTPFTIMaxMB=512.0;
+bool RWGGeometry::PrecomputeEMTPFT=false;
+
+static pthread_mutex_t EMTPFTIStoreMutex=PTHREAD_MUTEX_INITIALIZER;
+
+void DestroyEMTPFTIStore(void *pStore)
+{
+  EMTPFTIStore *Store=(EMTPFTIStore *)pStore;
+  if (!Store) return;
+  if (Store->Signature) free(Store->Signature);
+  if (Store->Data) free(Store->Data);
+  free(Store);
+}
+
+static double *GetEMTPFTISignature(RWGGeometry *G)
+{
+  double *Signature=(double *)mallocEC(9*G->NumSurfaces*sizeof(double));
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   GetEdgeCentroidSignature(G->Surfaces[ns], Signature + 9*ns);
+  return Signature;
+}
+
+static size_t GetEMTPFTIPairIndex(EMTPFTIStore *Store, int neaTot, int nebTot)
+{
+  size_t a=neaTot, b=nebTot, T=Store->TotalEdges;
+  if (Store->UseSymmetry)
+   return a*T - a*(a-1)/2 + (b-a);
+  return a*T + b;
+}
+
+/***************************************************************/
+/* Look up the store for the given parameters. On return,      */
+/*  (a) if the stored integrals may be used, the return value  */
+/*      is the store and *Fill=false;                          */
+/*  (b) if the caller should compute the integrals and file    */
+/*      them in the store, the return value is the store and  */
+/*      *Fill=true;                                            */
+/*  (c) otherwise (store disabled, over budget, or in use by   */
+/*      another thread) the return value is 0.                 */
+/* In cases (a) and (b) the caller must call                   */
+/* ReleaseEMTPFTIStore() when it is done with the store.       */
+/***************************************************************/
+static EMTPFTIStore *GetEMTPFTIStore(RWGGeometry *G, cdouble Omega,
+                                     bool Interior, int Method,
+                                     bool UseSymmetry, bool *Fill)
+{
+  *Fill=false;
+  if (RWGGeometry::EMTPFTIMaxMB<=0.0)
+   return 0;
+
+  int NQS = (Method==SCUFF_EMTPFTI_EHDERIVATIVES2) ? PFT_XTORQUE2 : NUMPFTQ;
+  size_t T=G->TotalEdges;
+  size_t NumPairs = UseSymmetry ? T*(T+1)/2 : T*T;
+  double MB = ((double)NumPairs)*3.0*NQS*sizeof(cdouble) / 1048576.0;
+
+  double *Signature=GetEMTPFTISignature(G);
+
+  pthread_mutex_lock(&EMTPFTIStoreMutex);
+  EMTPFTIStore *Store=(EMTPFTIStore *)G->EMTPFTIStore;
+  if (!Store)
+   { Store=(EMTPFTIStore *)mallocEC(sizeof(EMTPFTIStore));
+     Store->Signature=0;
+     Store->Data=0;
+     Store->NumPairs=0;
+     Store->Valid=Store->Busy=Store->WarnedBudget=false;
+     Store->Readers=0;
+     Store->NQS=0;
+     G->EMTPFTIStore=(void *)Store;
+   };
+
+  if (Store->Busy)
+   { pthread_mutex_unlock(&EMTPFTIStoreMutex);
+     free(Signature);
+     return 0;
+   };
+
+  if (    Store->Valid
+       && Store->Omega==Omega
+       && Store->Interior==Interior
+       && Store->Method==Method
+       && Store->UseSymmetry==UseSymmetry
+       && Store->NS==G->NumSurfaces
+       && Store->TotalEdges==G->TotalEdges
+       && !memcmp(Store->Signature, Signature, 9*G->NumSurfaces*sizeof(double))
+     )
+   { Store->Readers++;
+     pthread_mutex_unlock(&EMTPFTIStoreMutex);
+     free(Signature);
+     return Store;
+   };
+
+  if (Store->Readers>0)
+   { pthread_mutex_unlock(&EMTPFTIStoreMutex);
+     free(Signature);
+     return 0;
+   };
+
+  Store->Valid=false;
+  if ( MB > RWGGeometry::EMTPFTIMaxMB )
+   { if (!Store->WarnedBudget)
+      Log("EMTPFT integrals need %g MB > SCUFF_EMTPFTI_MB=%g (not storing)",
+           MB, RWGGeometry::EMTPFTIMaxMB);
+     Store->WarnedBudget=true;
+     if (Store->Data) free(Store->Data);
+     Store->Data=0;
+     Store->NumPairs=0;
+     pthread_mutex_unlock(&EMTPFTIStoreMutex);
+     free(Signature);
+     return 0;
+   };
+
+  if (Store->NumPairs*Store->NQS != NumPairs*NQS)
+   { if (Store->Data) free(Store->Data);
+     Store->Data=(cdouble *)mallocEC(NumPairs*3*NQS*sizeof(cdouble));
+   };
+  if (Store->Signature) free(Store->Signature);
+  Store->Signature   = Signature;
+  Store->Omega       = Omega;
+  Store->Interior    = Interior;
+  Store->Method      = Method;
+  Store->UseSymmetry = UseSymmetry;
+  Store->NS          = G->NumSurfaces;
+  Store->TotalEdges  = G->TotalEdges;
+  Store->NQS         = NQS;
+  Store->NumPairs    = NumPairs;
+  Store->Busy        = true;
+  pthread_mutex_unlock(&EMTPFTIStoreMutex);
+
+  *Fill=true;
+  return Store;
+}
+
+static void ReleaseEMTPFTIStore(EMTPFTIStore *Store, bool Fill)
+{
+  pthread_mutex_lock(&EMTPFTIStoreMutex);
+  if (Fill)
+   { Store->Valid=true;
+     Store->Busy=false;
+   }
+  else
+   Store->Readers--;
+  pthread_mutex_unlock(&EMTPFTIStoreMutex);
+}
+
+/***************************************************************/
+/* Determine whether surface B contributes to the PFT on       */
+/* surface A through the medium on the exterior (or interior)  */
+/* side of A. Returns the sign of the contribution, or 0.      */
+/***************************************************************/
+static double GetEMTPFTPairSign(RWGGeometry *G, bool Interior,
+                                int neaTot, int *nsa, int *nea, int *KNIndexA,
+                                int nebTot, int *nsb, int *neb, int *KNIndexB,
+                                int *RegionIndex)
+{
+  RWGSurface *SA = G->ResolveEdge(neaTot, nsa, nea, KNIndexA);
+  *RegionIndex = SA->RegionIndices[Interior ? 1 : 0];
+  if (*RegionIndex==-1) return 0.0; // no interior PFT for PEC bodies
+
+  RWGSurface *SB = G->ResolveEdge(nebTot, nsb, neb, KNIndexB);
+
+  double Sign=0.0;
+  if (*nsa==*nsb)
+   Sign = Interior ? -1.0 : +1.0;
+  else if (SA->RegionIndices[0] == SB->RegionIndices[0]) // A, B live in same region
+   Sign = (Interior ? 0.0 : 1.0);
+  else if (SA->RegionIndices[0] == SB->RegionIndices[1]) // A contained in B
+   Sign = Interior ? 0.0 : -1.0;
+  else if (SA->RegionIndices[1] == SB->RegionIndices[0]) // B contained in A
+   Sign = Interior ? 1.0 : 0.0;
+  return Sign;
+}
+
+/***************************************************************/
+/* get the PFT integrals for a single basis-function pair,     */
+/* from the store if possible, and file them in the store if   */
+/* requested                                                   */
+/***************************************************************/
+static void GetEMTPFTPairIntegrals(RWGGeometry *G, EMTPFTIStore *Store, bool Fill,
+                                   int neaTot, int nebTot,
+                                   int nsa, int nea, int nsb, int neb,
+                                   int RegionIndex, cdouble Omega,
+                                   int EMTPFTIMethod, cdouble PFTIs[NUMPFTIS])
+{
+  cdouble *Slot=0;
+  int NQS=0;
+  if (Store)
+   { NQS  = Store->NQS;
+     Slot = Store->Data + 3*NQS*GetEMTPFTIPairIndex(Store, neaTot, nebTot);
+   };
+
+  if (Store && !Fill)
+   { for(int n=0; n<NUMPFTIS; n++)
+      PFTIs[n]=0.0;
+     for(int nm=0; nm<3; nm++)
+      memcpy(PFTIs + nm*NUMPFTQ, Slot + nm*NQS, NQS*sizeof(cdouble));
+     return;
+   };
+
+  cdouble EpsR, MuR;
+  G->RegionMPs[RegionIndex]->GetEpsMu(Omega, &EpsR, &MuR);
+  cdouble k = Omega*sqrt(EpsR*MuR);
+  GetScatteredPFTIntegrals(G, nsa, nea, nsb, neb,
+                           Omega, k, EpsR, MuR, EMTPFTIMethod, PFTIs);
+
+  if (Store)
+   for(int nm=0; nm<3; nm++)
+    memcpy(Slot + nm*NQS, PFTIs + nm*NUMPFTQ, NQS*sizeof(cdouble));
+}
+
+/***************************************************************/
+/* compute and store the PFT integrals for all basis-function  */
+/* pairs at the given frequency, without contracting them with */
+/* any surface currents; called by AssembleBEMMatrix() if      */
+/* RWGGeometry::PrecomputeEMTPFT is set                        */
+/***************************************************************/
+void PrecomputeEMTPFTIntegrals(RWGGeometry *G, cdouble Omega,
+                               bool Interior, int EMTPFTIMethod)
+{
+  bool UseSymmetry=true;
+  char *s=getenv("SCUFF_EMTPFT_SYMMETRY");
+  if (s && s[0]=='0')
+   UseSymmetry=false;
+
+  bool Fill;
+  EMTPFTIStore *Store
+   = GetEMTPFTIStore(G, Omega, Interior, EMTPFTIMethod, UseSymmetry, &Fill);
+  if (Store==0)
+   return;
+  if (Fill==false)
+   { ReleaseEMTPFTIStore(Store, false);
+     return;
+   };
+
+  Log("Precomputing EMTPFT integrals at Omega=%s",z2s(Omega));
+  int TotalEdges = G->TotalEdges;
+#ifdef USE_OPENMP
+  int NT = GetNumThreads();
+#pragma omp parallel for schedule(dynamic,1), num_threads(NT)
+#endif
+  for(int neaTot=0; neaTot<TotalEdges; neaTot++)
+   for(int nebTot=(UseSymmetry ? neaTot : 0); nebTot<TotalEdges; nebTot++)
+    { 
+      int nsa, nea, KNIndexA, nsb, neb, KNIndexB, RegionIndex;
+      double Sign=GetEMTPFTPairSign(G, Interior,
+                                    neaTot, &nsa, &nea, &KNIndexA,
+                                    nebTot, &nsb, &neb, &KNIndexB,
+                                    &RegionIndex);
+      if (Sign==0.0) continue;
+
+      cdouble PFTIs[NUMPFTIS];
+      GetEMTPFTPairIntegrals(G, Store, true, neaTot, nebTot,
+                             nsa, nea, nsb, neb, RegionIndex,
+                             Omega, EMTPFTIMethod, PFTIs);
+    };
+
+  ReleaseEMTPFTIStore(Store, true);
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -569,8 +873,8 @@ HMatrix *GetEMTPFTMatrix(RWGGeometry *G, cdouble Omega, IncField *IF,
   /* ScatteredPFTT[ns] = contributions of surface #ns to         */
   /*                     scattered PFTT                          */
   /***************************************************************/
-  static int NSSave=0;
-  static HMatrix **ScatteredPFTT=0, *ExtinctionPFTT=0;
+  static __thread int NSSave=0;
+  static __thread HMatrix **ScatteredPFTT=0, *ExtinctionPFTT=0;
   if (NSSave!=NS)
    { if (ScatteredPFTT)
       { for(int ns=0; ns<NSSave; ns++)
@@ -587,16 +891,6 @@ HMatrix *GetEMTPFTMatrix(RWGGeometry *G, cdouble Omega, IncField *IF,
      ExtinctionPFTT=new HMatrix(NS, NUMPFTT);
    };
 
-  /***************************************************************/
-  /***************************************************************/
-  /***************************************************************/
-  static int init=0;
-  if (init==0)
-   { init=1;
-     GetGCMEArgStruct MyArgs;
-     InitGetGCMEArgs(&MyArgs);
-   };
-
   /*--------------------------------------------------------------*/
   /*- loop over all edge pairs to get scattered PFT contributions */
   /*- of all surfaces                                             */
@@ -610,14 +904,15 @@ HMatrix *GetEMTPFTMatrix(RWGGeometry *G, cdouble Omega, IncField *IF,
   int NQ      = NUMPFTT;
   int NS2NQ   = NS*NS*NQ;
   int NTNS2NQ = NT*NS*NS*NQ; 
-  static int DeltaPFTTSize=0;
-  static double *DeltaPFTT=0;
+  static __thread int DeltaPFTTSize=0;
+  static __thread double *DeltaPFTTBuffer=0;
   if ( DeltaPFTTSize < NTNS2NQ )
    { Log("(re)allocating DeltaPFTT (%i,%i)",DeltaPFTTSize,NTNS2NQ);
      DeltaPFTTSize=NTNS2NQ;
-     if (DeltaPFTT) free(DeltaPFTT);
-     DeltaPFTT = (double *)mallocEC(DeltaPFTTSize*sizeof(double));
+     if (DeltaPFTTBuffer) free(DeltaPFTTBuffer);
+     DeltaPFTTBuffer = (double *)mallocEC(DeltaPFTTSize*sizeof(double));
    };
+  double *DeltaPFTT=DeltaPFTTBuffer;
   memset(DeltaPFTT, 0, NTNS2NQ*sizeof(double));
 
   /*--------------------------------------------------------------*/
@@ -632,6 +927,12 @@ HMatrix *GetEMTPFTMatrix(RWGGeometry *G, cdouble Omega, IncField *IF,
    };
   //TODO insert here a check for any nested objects and automatically 
   //     disable symmetry if present
+
+  bool FillStore;
+  EMTPFTIStore *Store
+   = GetEMTPFTIStore(G, Omega, Interior, EMTPFTIMethod, UseSymmetry, &FillStore);
+  if (Store && !FillStore)
+   Log("Using stored EMTPFT integrals at Omega=%s",z2s(Omega));
     
 #ifdef USE_OPENMP
   Log("EMT OpenMP multithreading (%i threads)",NT);
@@ -643,37 +944,22 @@ HMatrix *GetEMTPFTMatrix(RWGGeometry *G, cdouble Omega, IncField *IF,
       if (nebTot==(UseSymmetry ? neaTot : 0)) 
        LogPercent(neaTot, TotalEdges, 10);
 
-      int nsa, nea, KNIndexA;
-      RWGSurface *SA = G->ResolveEdge(neaTot, &nsa, &nea, &KNIndexA);
-      int RegionIndex = SA->RegionIndices[Interior ? 1 : 0];
-      if (RegionIndex==-1) continue; // no interior PFT for PEC bodies
-
-      int nsb, neb, KNIndexB;
-      RWGSurface *SB = G->ResolveEdge(nebTot, &nsb, &neb, &KNIndexB);
-   
-      double Sign=0.0;
-      if (nsa==nsb)
-       Sign = Interior ? -1.0 : +1.0;
-      else if (SA->RegionIndices[0] == SB->RegionIndices[0]) // A, B live in same region
-       Sign = (Interior ? 0.0 : 1.0);
-      else if (SA->RegionIndices[0] == SB->RegionIndices[1]) // A contained in B
-       Sign = Interior ? 0.0 : -1.0;
-      else if (SA->RegionIndices[1] == SB->RegionIndices[0]) // B contained in A
-       Sign = Interior ? 1.0 : 0.0;
-
+      int nsa, nea, KNIndexA, nsb, neb, KNIndexB, RegionIndex;
+      double Sign=GetEMTPFTPairSign(G, Interior,
+                                    neaTot, &nsa, &nea, &KNIndexA,
+                                    nebTot, &nsb, &neb, &KNIndexB,
+                                    &RegionIndex);
       if ( Sign==0.0 ) // B does not contribute to PFT on A
        continue;
-
-      cdouble EpsR, MuR;
-      G->RegionMPs[RegionIndex]->GetEpsMu(Omega, &EpsR, &MuR);
-      cdouble k = Omega*sqrt(EpsR*MuR);
+      RWGSurface *SA = G->Surfaces[nsa], *SB = G->Surfaces[nsb];
 
       cdouble PFTIs[NUMPFTIS];
       cdouble *QKK    = PFTIs + 0*NUMPFTQ;
       cdouble *QNN    = PFTIs + 1*NUMPFTQ;
       cdouble *QKNmNK = PFTIs + 2*NUMPFTQ;
-      GetScatteredPFTIntegrals(G, nsa, nea, nsb, neb,
-                               Omega, k, EpsR, MuR, EMTPFTIMethod, PFTIs);
+      GetEMTPFTPairIntegrals(G, Store, FillStore, neaTot, nebTot,
+                             nsa, nea, nsb, neb, RegionIndex,
+                             Omega, EMTPFTIMethod, PFTIs);
 
       cdouble KNBab[4];
       GetKNBilinears(KNVector, DRMatrix,
@@ -769,6 +1055,9 @@ HMatrix *GetEMTPFTMatrix(RWGGeometry *G, cdouble Omega, IncField *IF,
       VecPlusEquals(DeltaPFTT + Offset, 0.5*Sign, dPFTT, NUMPFTT);
  
     }; // end of multithreaded loop
+
+  if (Store)
+   ReleaseEMTPFTIStore(Store, FillStore);
   
   /*--------------------------------------------------------------*/
   /*- accumulate contributions of all threads                     */
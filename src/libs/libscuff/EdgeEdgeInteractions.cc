@@ -38,11 +38,6 @@ namespace scuff {
 
 #define II cdouble(0,1)
 
-// the 'distant basis function' threshold: two basis functions are
-// 'distant' if their midpoint--midpoint distance is greater than 
-// DBFTHRESHOLD * the larger of the radii of the two basis functions
-#define DBFTHRESHOLD 10.0
-
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -78,39 +73,17 @@ void GetEdgeEdgeInteractions(GetEEIArgStruct *Args)
    };
 
   /***************************************************************/
-  /* figure out which method to use, as follows:                 */
-  /*  a) if the Args->Force flag was set to force a specific     */
-  /*     method, use that method                                 */
-  /*  b) otherwise, use spherical multipoles if the relative     */
-  /*     distance between the edges exceeds the DBFTHRESHOLD,    */
-  /*     and otherwise use the panel-panel integral method       */
-  /* // FIXME to take into account the possibility of nonzero    */
-  /* displacement when figuring the distance between edge centroids */
-  /***************************************************************/
-#if 0
-  bool UseSMMethod=false;
-  if (Args->Force==EEI_FORCE_SM)
-   UseSMMethod=true;
-  else if (Args->Force==EEI_FORCE_PP)
-   UseSMMethod=false;
-  else
-   { 
-     double RMax=fmax(Ea->Radius, Eb->Radius);
-     if (VecDistance(Ea->Centroid, Eb->Centroid) > DBFTHRESHOLD*RMax )
-      UseSMMethod=true;
-   };
-#endif
-
-  /***************************************************************/
-  /* get edge-edge interactions by spherical multipole method if */
-  /* that was the verdict of the above                           */
+  /* use the spherical-multipole method if the caller asked for  */
+  /* it and the edges are far enough apart for the expansion to  */
+  /* converge to the accuracy set by RWGGeometry::MultipoleTol   */
+  /* (GetEEIMultipole() returns false otherwise). this is not    */
+  /* done by default: for a single pair of edges it costs more   */
+  /* than the four panel-panel integrals. during BEM matrix      */
+  /* assembly, well-separated edges are instead handled a whole  */
+  /* cluster at a time (MultipoleInteractions.cc).               */
   /***************************************************************/
-  #if 0
-  if ( UseSMMethod )
-   { GetEEIMultipole(Args);
-     return;
-   };
-  #endif
+  if ( Args->Force==EEI_FORCE_SM && GetEEIMultipole(Args) )
+   return;
 
   /***************************************************************/
   /* otherwise, obtain the edge-edge interactions as a sum of    */
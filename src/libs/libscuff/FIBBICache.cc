@@ -38,15 +38,10 @@
 #elif defined(HAVE_TR1)
 #include <tr1/unordered_map>
 #endif
-#ifdef USE_PTHREAD
-#include <pthread.h> // needed for rwlock
-#endif
-#ifdef USE_OPENMP
-#include <omp.h> // needed for rwlock
-#endif
 
 #include <libhrutil.h>
 #include "libscuff.h"
+#include "libscuffInternals.h"
 
 namespace scuff {
 
@@ -64,6 +59,8 @@ void ComputeFIBBIData(RWGSurface *Sa, int nea,
 
 #define SUFFIX "scuffcache"
 
+#define NUMFIBBISHARDS 64
+
 /*--------------------------------------------------------------*/
 /*- note: i found this on wikipedia ... ------------------------*/
 /*--------------------------------------------------------------*/
@@ -125,6 +122,16 @@ typedef std::tr1::unordered_map< KeyStruct,
                                  KeyCmp> KDMap;
 #endif
 
+/*--------------------------------------------------------------*/
+/*- as in FIPPICache, the table is split into independent shards */
+/*- selected by the high-order bits of the key hash, each with   */
+/*- its own lock.                                                */
+/*--------------------------------------------------------------*/
+static inline int GetShardIndex(const KeyStruct &K)
+{ unsigned long h = (unsigned long)HashFunction(K.Key);
+  return (int)( ((h ^ (h>>23)) >> 9) % NUMFIBBISHARDS );
+}
+
 /*--------------------------------------------------------------*/
 /*--------------------------------------------------------------*/
 /*--------------------------------------------------------------*/
@@ -140,13 +147,16 @@ public:
                      RWGSurface *SB, int neB, double *FIBBIs);
    void Store(const char *MeshFileName);
    int PreLoad(const char *FileName);
+   int PreLoadIndexed(const char *FileName);
    int Size(int *pHits, int *pMisses);
+   unsigned int MemoryRecords();
 
    // data
-   int Hits, Misses;
-   void *opTable;
+   CacheStatistics Stats;
+   MappedCacheFile *MappedFile;
+   void *opTables[NUMFIBBISHARDS];
 
-   pthread_rwlock_t lock;
+   rwlock ShardLocks[NUMFIBBISHARDS];
 
    char *LastFileName;
    unsigned int NumRecordsInFile;
@@ -158,12 +168,9 @@ public:
 /*--------------------------------------------------------------*/
 FIBBICache::FIBBICache(char *MeshFileName)
 {
-  KDMap *KDM=new KDMap;
-  opTable = (void *)KDM;
-
-  pthread_rwlock_init(&lock,0);
-
-  Hits=Misses=0;
+  for(int ns=0; ns<NUMFIBBISHARDS; ns++)
+   opTables[ns] = (void *)(new KDMap);
+  MappedFile=0;
 
   /*--------------------------------------------------------------*/
   /*- attempt to preload cache                                   -*/
@@ -197,12 +204,11 @@ FIBBICache::FIBBICache(char *MeshFileName)
 /*--------------------------------------------------------------*/
 FIBBICache::~FIBBICache()
 {
-  pthread_rwlock_destroy(&lock);
-
   if (LastFileName) free(LastFileName);
+  if (MappedFile) delete MappedFile;
 
-  KDMap *KDM = (KDMap *)opTable;
-  delete KDM;
+  for(int ns=0; ns<NUMFIBBISHARDS; ns++)
+   delete (KDMap *)opTables[ns];
 
 } 
 
@@ -283,16 +289,24 @@ void FIBBICache::GetFIBBIData(RWGSurface *SA, int neA,
   KeyStruct Key;
   GetFIBBICacheKey(SA, neA, SB, neB, Key.Key);
 
-  KDMap *KDM    = (KDMap *)opTable;
+  const void *MappedData = MappedFile ? MappedFile->Lookup(Key.Key) : 0;
+  if (MappedData)
+   { memcpy(FIBBIs, MappedData, DATASIZE);
+     Stats.Hit();
+     return;
+   };
+
+  int ns        = GetShardIndex(Key);
+  KDMap *KDM    = (KDMap *)opTables[ns];
   bool Found;
-  pthread_rwlock_rdlock(&lock);
+  ShardLocks[ns].read_lock();
   KDMap::iterator p=KDM->find(Key);
   Found = (p != (KDM->end()) );
   if (Found) memcpy(FIBBIs, p->second.Data, DATASIZE);
-  pthread_rwlock_unlock(&lock);
+  ShardLocks[ns].read_unlock();
 
   if ( Found )
-   { Hits++;
+   { Stats.Hit();
      return;
    };
   
@@ -300,13 +314,13 @@ void FIBBICache::GetFIBBIData(RWGSurface *SA, int neA,
   /* if it was not found, compute a new FIBBI data record and add*/
   /* it to the cache                                             */
   /***************************************************************/
-  Misses++;
+  Stats.Miss();
   ComputeFIBBIData(SA, neA, SB, neB, FIBBIs);
   DataStruct DS;
   memcpy(DS.Data, FIBBIs, DATASIZE);
-  pthread_rwlock_wrlock(&lock);
+  ShardLocks[ns].write_lock();
   KDM->insert( KDPair(Key,DS) );
-  pthread_rwlock_unlock(&lock);
+  ShardLocks[ns].write_unlock();
 }
 
 /***************************************************************/
@@ -322,21 +336,35 @@ void FIBBICache::GetFIBBIData(RWGSurface *SA, int neA,
 /* if that environment variable is defined, and otherwise to   */
 /* the current working directory.                              */
 /*                                                             */
-/* the file format is pretty simple (and non-portable w.r.t.   */
-/* endianness):                                                */
+/* Cache files are written in the indexed format implemented   */
+/* in CacheFile.cc, in which each record consists of a search  */
+/* key (KEYLEN float values) followed by the content of the    */
+/* FIBBI data record for that search key. Preloading such a    */
+/* file simply maps it into memory.                            */
+/*                                                             */
+/* PreLoad() also accepts files in the older unindexed format: */
 /*  bytes 0--11:   'FIBBI_CACHE' + 0                           */
 /*  next xx bytes:  first record                               */ 
 /*  next xx bytes:  second record                              */
 /*  ...             ...                                        */
-/*                                                             */
-/* where xx is the size of the record; each record consists of */
-/* a search key (KEYLEN float values) followed by the content  */
-/* of the FIBBI data record for that search key.               */
+/* whose records are copied into the in-memory tables.         */
 /*                                                             */
 /* note: FIBBICF = 'FIBBI cache file'                          */
 /***************************************************************/
 const char FIBBICF_GSignature[]  = "FIBBI_CACHE";
 #define FIBBICF_SIGSIZE (sizeof(FIBBICF_GSignature))
+#define FIBBICF_KIND    "FIBBI"
+
+unsigned int FIBBICache::MemoryRecords()
+{
+  unsigned int NumRecords=0;
+  for(int ns=0; ns<NUMFIBBISHARDS; ns++)
+   { ShardLocks[ns].read_lock();
+     NumRecords += ((KDMap *)opTables[ns])->size();
+     ShardLocks[ns].read_unlock();
+   };
+  return NumRecords;
+}
 
 void FIBBICache::Store(const char *MeshFileName)
 {
@@ -353,12 +381,11 @@ void FIBBICache::Store(const char *MeshFileName)
   else
    snprintf(FileName,MAXSTR,"%s/%s.%s",s,GetFileBase(MFNCopy),SUFFIX);
 
-  KDMap *KDM = (KDMap *)opTable;
-
-  /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
+  /*- NumRecordsInFile is the number of in-memory records at the  */
+  /*- time of the last preload or store operation.                */
   /*--------------------------------------------------------------*/
-  unsigned int NumRecords = KDM->size();
+  unsigned int NumRecords = MemoryRecords();
   if (    NumRecords==NumRecordsInFile
        && LastFileName 
        && !strcmp(FileName, LastFileName)
@@ -366,7 +393,6 @@ void FIBBICache::Store(const char *MeshFileName)
    { Log("FC::S FIBBI cache unchanged since last disk operation (skipping cache dump)");
      return;
    };
-Log("I checked and: (%i,%i), (%s,%s)",NumRecords,NumRecordsInFile,FileName,(LastFileName ? "" : LastFileName));
   if (LastFileName) free(LastFileName);
   LastFileName=strdup(FileName);
 
@@ -374,42 +400,75 @@ Log("I checked and: (%i,%i), (%s,%s)",NumRecords,NumRecordsInFile,FileName,(Last
   /*- i assume that Preload() and Store() won't be called from    */
   /*- multithreaded code sections.                                */
   /*--------------------------------------------------------------*/
-  //FCLock.read_lock();
-
-  FILE *f=fopen(FileName,"w");
-  if (!f)
-   { Log("FC::S warning: could not open file %s (aborting cache dump)...",FileName);
-     return;
-   };
   Log("FC::S Writing FIBBI cache to file %s...",FileName);
+  CacheFileWriter Writer(FileName, FIBBICF_KIND, KEYSIZE, DATASIZE);
 
-  /*---------------------------------------------------------------------*/
-  /*- write file signature ----------------------------------------------*/
-  /*---------------------------------------------------------------------*/
-  fwrite(FIBBICF_GSignature, FIBBICF_SIGSIZE,1,f);
+  if (MappedFile)
+   for(uint64_t nr=0; nr<MappedFile->NumRecords; nr++)
+    Writer.AddRecord(MappedFile->GetKey(nr), MappedFile->GetData(nr));
 
-  /*---------------------------------------------------------------------*/
-  /*- iterate through the table and write entries to the file one-by-one */
-  /*---------------------------------------------------------------------*/
-  NumRecordsInFile=0;
   KDMap::iterator it;
-  for ( it = KDM->begin(); it != KDM->end(); it++ )
-   { 
-     const float *Key   = it->first.Key;
-     double *Data = it->second.Data;
-     if (    (1 != fwrite(Key,  KEYSIZE,  1, f )) 
-          || (1 != fwrite(Data, DATASIZE, 1, f ))
-        ) break;
-     NumRecordsInFile++;
+  for(int ns=0; ns<NUMFIBBISHARDS; ns++)
+   { KDMap *KDM = (KDMap *)opTables[ns];
+     for ( it = KDM->begin(); it != KDM->end(); it++ )
+      Writer.AddRecord(it->first.Key, it->second.Data);
    };
 
   /*---------------------------------------------------------------------*/
   /*- and that's it -----------------------------------------------------*/
   /*---------------------------------------------------------------------*/
-  fclose(f);
-  Log("FC::S ...wrote %i/%i FIBBI records.",NumRecordsInFile,NumRecords);
+  if (Writer.Close())
+   { NumRecordsInFile=NumRecords;
+     Log("FC::S ...wrote %lu FIBBI records.",(unsigned long)Writer.NumRecords);
+   }
+  else
+   { NumRecordsInFile=0;
+     Log("FC::S warning: %s (aborting cache dump)...",Writer.ErrMsg);
+   };
+}
 
-  //FCLock.read_unlock();
+/***************************************************************/
+/* preload from a file in the indexed format, mapping it if    */
+/* possible and otherwise copying its records into memory.     */
+/* return 0 on success, nonzero on failure.                    */
+/***************************************************************/
+int FIBBICache::PreLoadIndexed(const char *FileName)
+{
+  MappedCacheFile *MCF
+   = new MappedCacheFile(FileName, FIBBICF_KIND, KEYSIZE, DATASIZE);
+  if (MCF->ErrMsg)
+   { Log("FC::P warning: %s (skipping cache preload)",MCF->ErrMsg);
+     delete MCF;
+     return 1;
+   };
+
+  if (MappedFile==0 && !(MCF->ByteSwapped))
+   { MappedFile=MCF;
+     Log("FC::P Mapped %lu FIBBI records from file %s.",
+          (unsigned long)MCF->NumRecords,FileName);
+   }
+  else
+   { Log("FC::P Preloading %lu FIBBI records from file %s%s...",
+          (unsigned long)MCF->NumRecords,FileName,
+          MCF->ByteSwapped ? " (converting byte order)" : "");
+     for(uint64_t nr=0; nr<MCF->NumRecords; nr++)
+      { KeyStruct Key;
+        DataStruct Data; 
+        memcpy(Key.Key,   MCF->GetKey(nr),  KEYSIZE);
+        memcpy(Data.Data, MCF->GetData(nr), DATASIZE);
+        if (MCF->ByteSwapped)
+         { SwapCacheItems(Key.Key,   sizeof(float),  KEYLEN);
+           SwapCacheItems(Data.Data, sizeof(double), DATALEN);
+         };
+        ((KDMap *)opTables[GetShardIndex(Key)])->insert( KDPair(Key,Data) );
+      };
+     delete MCF;
+   };
+
+  if (LastFileName) free(LastFileName);
+  LastFileName=strdupEC(FileName);
+  NumRecordsInFile=MemoryRecords();
+  return 0;
 }
 
 /***************************************************************/
@@ -417,6 +476,9 @@ Log("I checked and: (%i,%i), (%s,%s)",NumRecords,NumRecordsInFile,FileName,(Last
 /***************************************************************/
 int FIBBICache::PreLoad(const char *FileName)
 {
+  if (IsIndexedCacheFile(FileName))
+   return PreLoadIndexed(FileName);
+
   /*--------------------------------------------------------------*/
   /*- try to open the file ---------------------------------------*/
   /*--------------------------------------------------------------*/
@@ -426,7 +488,6 @@ int FIBBICache::PreLoad(const char *FileName)
      return 1;
    };
 
-  KDMap *KDM       = (KDMap *)opTable;
   int RecordSize   = KEYSIZE + DATASIZE;
   int NumRecords   = 0; 
   int RecordsRead  = 0;
@@ -489,7 +550,7 @@ int FIBBICache::PreLoad(const char *FileName)
 	return 1;
       };
   
-     KDM->insert( KDPair(Key,Data) );
+     ((KDMap *)opTables[GetShardIndex(Key)])->insert( KDPair(Key,Data) );
      RecordsRead++;
    };
 
@@ -523,11 +584,11 @@ int FIBBICache::PreLoad(const char *FileName)
 /*--------------------------------------------------------------*/
 int FIBBICache::Size(int *pHits, int *pMisses)
 { 
-  if (pHits) *pHits=Hits;
-  if (pMisses) *pMisses=Misses;
-  if (opTable==0) return -1;
-  KDMap *KDM = (KDMap *)opTable;
-  return KDM->size();
+  Stats.Get(pHits, pMisses);
+  int NumRecords = MemoryRecords();
+  if (MappedFile)
+   NumRecords += MappedFile->NumRecords;
+  return NumRecords;
 
 }
 
@@ -556,6 +617,11 @@ void StoreFIBBICache(void *pCache, const char *MeshFileName)
   Cache->Store(MeshFileName);
 }
 
+void LogFIBBICacheStatistics(void *pCache, const char *Label)
+{ FIBBICache *Cache = (FIBBICache *)pCache;
+  Cache->Stats.LogStatistics(Label);
+}
+
 void GetFIBBIData(void *pCache,
                   RWGSurface *SA, int neA,
                   RWGSurface *SB, int neB,
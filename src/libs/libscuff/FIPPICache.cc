@@ -32,6 +32,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <vector>
 #ifdef HAVE_CXX11
 #include <unordered_map>
 #elif defined(HAVE_TR1)
@@ -78,7 +79,9 @@ typedef struct
  { float Key[KEYLEN];
  } KeyStruct;
 
-typedef std::pair<KeyStruct, QIFIPPIData *> KeyValuePair;
+// the value associated with each key is the index of the slot
+// holding its record within the shard (see below)
+typedef std::pair<KeyStruct, int> KeyValuePair;
 
 struct KeyHash
  {
@@ -98,25 +101,203 @@ typedef struct
 
 #ifdef HAVE_CXX11
 typedef std::unordered_map< KeyStruct,
-                            QIFIPPIData *,
+                            int,
                             KeyHash,
                             KeyCmp> KeyValueMap;
 #elif defined(HAVE_TR1)
 typedef std::tr1::unordered_map< KeyStruct,
-                                 QIFIPPIData *, 
+                                 int, 
                                  KeyHash, 
                                  KeyCmp> KeyValueMap;
 #endif
 
+/*--------------------------------------------------------------*/
+/*- the shard for a given key is chosen using the high-order    */
+/*- bits of its hash; the low-order bits are left for bucket    */
+/*- selection within each shard's table.                        */
+/*--------------------------------------------------------------*/
+static inline int GetShardIndex(const KeyStruct &K)
+{ unsigned long h = (unsigned long)HashFunction(K.Key);
+  return (int)( ((h ^ (h>>23)) >> 9) % NUMFIPPISHARDS );
+}
+
+/*--------------------------------------------------------------*/
+/*- per-thread cache statistics: each thread is assigned a slot -*/
+/*- index the first time it touches any cache. if there are     -*/
+/*- more than MAXCACHETHREADS threads, slots are shared, which  -*/
+/*- is why the counters are still updated atomically.           -*/
+/*--------------------------------------------------------------*/
+static int NextCacheThreadIndex=0;
+static __thread int CacheThreadIndex=-1;
+
+int GetCacheThreadIndex()
+{ if (CacheThreadIndex==-1)
+   CacheThreadIndex
+    = __sync_fetch_and_add(&NextCacheThreadIndex,1) % MAXCACHETHREADS;
+  return CacheThreadIndex;
+}
+
+CacheStatistics::CacheStatistics()
+{ Reset(); }
+
+void CacheStatistics::Hit()
+{ __sync_fetch_and_add( &(Slots[GetCacheThreadIndex()].Hits), 1); }
+
+void CacheStatistics::Miss()
+{ __sync_fetch_and_add( &(Slots[GetCacheThreadIndex()].Misses), 1); }
+
+void CacheStatistics::Reset()
+{ for(int nt=0; nt<MAXCACHETHREADS; nt++)
+   Slots[nt].Hits=Slots[nt].Misses=0;
+}
+
+void CacheStatistics::GetThread(int nt, int *pHits, int *pMisses)
+{ if (pHits)   *pHits   = (int)Slots[nt].Hits;
+  if (pMisses) *pMisses = (int)Slots[nt].Misses;
+}
+
+void CacheStatistics::Get(int *pHits, int *pMisses)
+{ unsigned long Hits=0, Misses=0;
+  for(int nt=0; nt<MAXCACHETHREADS; nt++)
+   { Hits   += Slots[nt].Hits;
+     Misses += Slots[nt].Misses;
+   };
+  if (pHits)   *pHits   = (int)Hits;
+  if (pMisses) *pMisses = (int)Misses;
+}
+
+void CacheStatistics::LogStatistics(const char *Label)
+{ int Hits, Misses;
+  Get(&Hits, &Misses);
+  Log("  %s: %i/%i cache hits/misses",Label,Hits,Misses);
+  for(int nt=0; nt<MAXCACHETHREADS; nt++)
+   if (Slots[nt].Hits || Slots[nt].Misses)
+    Log("   thread slot %i: %lu/%lu hits/misses",nt,Slots[nt].Hits,Slots[nt].Misses);
+}
+
+/*--------------------------------------------------------------*/
+/*- storage for cache records.                                  -*/
+/*-                                                             -*/
+/*- each shard stores its records in fixed-size slabs of        -*/
+/*- RECORDS_PER_SLAB records, addressed by a slot index, so     -*/
+/*- records are not individually malloc'ed. if the cache has a  -*/
+/*- memory budget, each shard holds at most MaxRecordsPerShard  -*/
+/*- records; when a new record arrives at a full shard, a       -*/
+/*- victim is chosen by the CLOCK algorithm: the clock hand     -*/
+/*- sweeps over the slots, clearing the reference bit of        -*/
+/*- records that have been used since the last sweep and        -*/
+/*- evicting the first record whose bit is already clear.       -*/
+/*- evicted slots go on a free list and are reused.             -*/
+/*-                                                             -*/
+/*- lookups set the reference bit while holding only the read  -*/
+/*- lock, so several threads may store to it at once; those     -*/
+/*- stores are atomic (relaxed ordering suffices, since the bit -*/
+/*- is only a hint and is read back under the write lock).      -*/
+/*--------------------------------------------------------------*/
+typedef struct FIPPIRecord
+ { KeyStruct K;
+   QIFIPPIData QIFD;
+   bool InUse;
+   bool Referenced;
+ } FIPPIRecord;
+
+#define RECORDS_PER_SLAB 32
+
+typedef struct FIPPIShard
+ { KeyValueMap Map;
+   std::vector<FIPPIRecord *> Slabs;
+   std::vector<int> FreeSlots;
+   int NumSlots;
+   int ClockHand;
+   unsigned long Evictions;
+ } FIPPIShard;
+
+// estimated memory footprint of the hash-table entry for a record
+#define MAPENTRY_BYTES (sizeof(KeyValuePair) + 4*sizeof(void *))
+#define RECORD_BYTES   (sizeof(FIPPIRecord) + MAPENTRY_BYTES)
+
+static inline FIPPIRecord *GetRecord(FIPPIShard *S, int Slot)
+{ return S->Slabs[Slot / RECORDS_PER_SLAB] + (Slot % RECORDS_PER_SLAB); }
+
+static size_t GetShardBytes(FIPPIShard *S)
+{ return   S->Slabs.size()*RECORDS_PER_SLAB*sizeof(FIPPIRecord)
+         + S->Map.size()*MAPENTRY_BYTES;
+}
+
+/*--------------------------------------------------------------*/
+/*- evict one record from a shard, which must contain at least -*/
+/*- one record, and return its slot index. the caller must hold-*/
+/*- the write lock for the shard.                               -*/
+/*--------------------------------------------------------------*/
+static int EvictRecord(FIPPIShard *S)
+{
+  while(1)
+   { int Slot = S->ClockHand;
+     S->ClockHand = (S->ClockHand + 1) % S->NumSlots;
+     FIPPIRecord *R = GetRecord(S, Slot);
+     if (!R->InUse)
+      continue;
+     if (R->Referenced)
+      { R->Referenced=false;
+        continue;
+      };
+     S->Map.erase(R->K);
+     R->InUse=false;
+     S->Evictions++;
+     return Slot;
+   };
+}
+
+/*--------------------------------------------------------------*/
+/*- add a record to a shard, evicting older records if the      -*/
+/*- shard is full. MaxRecords=0 means no limit. the caller must -*/
+/*- hold the write lock for the shard.                          -*/
+/*--------------------------------------------------------------*/
+static void InsertRecord(FIPPIShard *S, int MaxRecords,
+                         const KeyStruct &K, const QIFIPPIData *QIFD)
+{
+  if ( S->Map.find(K) != S->Map.end() )
+   return;
+
+  while ( MaxRecords>0 && ((int)S->Map.size()) >= MaxRecords )
+   S->FreeSlots.push_back( EvictRecord(S) );
+
+  int Slot;
+  if ( S->FreeSlots.size() > 0 )
+   { Slot=S->FreeSlots.back();
+     S->FreeSlots.pop_back();
+   }
+  else
+   { Slot=S->NumSlots++;
+     if ( (Slot % RECORDS_PER_SLAB) == 0 )
+      S->Slabs.push_back( (FIPPIRecord *)mallocEC(RECORDS_PER_SLAB*sizeof(FIPPIRecord)) );
+   };
+
+  FIPPIRecord *R=GetRecord(S, Slot);
+  memcpy(R->K.Key, K.Key, KEYSIZE);
+  memcpy(&(R->QIFD), QIFD, sizeof(QIFIPPIData));
+  R->InUse=true;
+  R->Referenced=true;
+  S->Map.insert( KeyValuePair(K, Slot) );
+}
+
 /*--------------------------------------------------------------*/
 /*- class constructor ------------------------------------------*/
 /*--------------------------------------------------------------*/
 FIPPICache::FIPPICache()
 {
-  KeyValueMap *KVM=new KeyValueMap;
-  opTable = (void *)KVM;
+  for(int ns=0; ns<NUMFIPPISHARDS; ns++)
+   { FIPPIShard *S = new FIPPIShard;
+     S->NumSlots=S->ClockHand=0;
+     S->Evictions=0;
+     opShards[ns] = (void *)S;
+   };
+  MaxBytes=0;
+  MaxRecordsPerShard=0;
+  MappedFile=0;
   PreloadFileName=0;
   RecordsPreloaded=0;
+  EvictionsAtPreload=0;
 }
 
 /*--------------------------------------------------------------*/
@@ -127,10 +308,97 @@ FIPPICache::~FIPPICache()
   if (PreloadFileName) 
    free(PreloadFileName);
 
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
-  delete KVM;
+  if (MappedFile)
+   delete MappedFile;
+
+  for(int ns=0; ns<NUMFIPPISHARDS; ns++)
+   { FIPPIShard *S = (FIPPIShard *)opShards[ns];
+     for(unsigned n=0; n<S->Slabs.size(); n++)
+      free(S->Slabs[n]);
+     delete S;
+   };
 } 
 
+/*--------------------------------------------------------------*/
+/*- set the memory budget. if the cache is already larger than  */
+/*- the new budget, records are evicted immediately; note that  */
+/*- slab memory is retained for reuse by later records.         */
+/*--------------------------------------------------------------*/
+void FIPPICache::SetMaxBytes(size_t NewMaxBytes)
+{
+  for(int ns=0; ns<NUMFIPPISHARDS; ns++)
+   ShardLocks[ns].write_lock();
+
+  MaxBytes=NewMaxBytes;
+  MaxRecordsPerShard=0;
+  if (MaxBytes>0)
+   { // whole slabs only, at least one per shard
+     size_t MaxSlabsPerShard
+      = MaxBytes / (NUMFIPPISHARDS*RECORDS_PER_SLAB*RECORD_BYTES);
+     if (MaxSlabsPerShard<1) MaxSlabsPerShard=1;
+     MaxRecordsPerShard = MaxSlabsPerShard * RECORDS_PER_SLAB;
+   };
+
+  for(int ns=0; ns<NUMFIPPISHARDS; ns++)
+   { FIPPIShard *S = (FIPPIShard *)opShards[ns];
+     while ( MaxRecordsPerShard>0 && ((int)S->Map.size()) > MaxRecordsPerShard )
+      S->FreeSlots.push_back( EvictRecord(S) );
+     ShardLocks[ns].write_unlock();
+   };
+}
+
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+unsigned long FIPPICache::Size()
+{
+  unsigned long NumRecords=0;
+  for(int ns=0; ns<NUMFIPPISHARDS; ns++)
+   { ShardLocks[ns].read_lock();
+     NumRecords += ((FIPPIShard *)opShards[ns])->Map.size();
+     ShardLocks[ns].read_unlock();
+   };
+  return NumRecords;
+}
+
+size_t FIPPICache::ResidentBytes()
+{
+  size_t Bytes=0;
+  for(int ns=0; ns<NUMFIPPISHARDS; ns++)
+   { ShardLocks[ns].read_lock();
+     Bytes += GetShardBytes( (FIPPIShard *)opShards[ns] );
+     ShardLocks[ns].read_unlock();
+   };
+  return Bytes;
+}
+
+unsigned long FIPPICache::Evictions()
+{
+  unsigned long NumEvictions=0;
+  for(int ns=0; ns<NUMFIPPISHARDS; ns++)
+   { ShardLocks[ns].read_lock();
+     NumEvictions += ((FIPPIShard *)opShards[ns])->Evictions;
+     ShardLocks[ns].read_unlock();
+   };
+  return NumEvictions;
+}
+
+void FIPPICache::LogStatistics()
+{
+  Stats.LogStatistics("FIPPI cache");
+#define ONEMEG (1<<20)
+  if (MappedFile)
+   Log("  FIPPI cache: %lu records in mapped file %s",
+        (unsigned long)MappedFile->NumRecords, MappedFile->FileName);
+  if (MaxBytes>0)
+   Log("  FIPPI cache: %lu records resident (%.1f/%.1f MB), %lu evictions",
+        Size(), ((double)ResidentBytes())/ONEMEG, ((double)MaxBytes)/ONEMEG,
+        Evictions());
+  else
+   Log("  FIPPI cache: %lu records resident (%.1f MB, no budget)",
+        Size(), ((double)ResidentBytes())/ONEMEG);
+}
+
 static void inline VecSubFloat(double *V1, double *V2, float *V1mV2)
 { V1mV2[0] = ((float)V1[0]) - ((float)V2[0]);
   V1mV2[1] = ((float)V1[1]) - ((float)V2[1]);
@@ -140,13 +408,16 @@ static void inline VecSubFloat(double *V1, double *V2, float *V1mV2)
 /*--------------------------------------------------------------*/
 /*- routine for fetching a FIPPI data record from a FIPPIDT:    */
 /*- we look through our table to see if we have a record for    */
-/*- this panel pair, we return it if we do, and otherwise we    */
-/*- compute a new FIPPI data record for this panel pair and     */
+/*- this panel pair, we copy it to QIFD if we do, and otherwise */
+/*- we compute a new FIPPI data record for this panel pair and  */
 /*- add it to the table.                                        */
+/*- (the record is copied, rather than returned by pointer, to  */
+/*- allow it to be evicted while the caller is using it.)       */
 /*- important note: the vertices are assumed to be canonically  */
 /*- ordered on entry.                                           */
 /*--------------------------------------------------------------*/
-QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
+void FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv,
+                                QIFIPPIData *QIFD)
 {
   /***************************************************************/
   /* construct a search key from the canonically-ordered panel   */
@@ -170,34 +441,46 @@ QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
   VecSubFloat(OVb[2], OVa[0], K.Key+12 );
 
   /***************************************************************/
-  /* look for this key in the cache ******************************/
+  /* look for this key first in the mapped cache file (which     */
+  /* requires no locking) and then in the in-memory tables       */
   /***************************************************************/
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
+  const void *MappedData = MappedFile ? MappedFile->Lookup(K.Key) : 0;
+  if (MappedData)
+   { memcpy(QIFD, MappedData, sizeof(QIFIPPIData));
+     Stats.Hit();
+     return;
+   };
 
-  FCLock.read_lock();
-  KeyValueMap::iterator p=KVM->find(K);
-  FCLock.read_unlock();
+  int ns=GetShardIndex(K);
+  FIPPIShard *S=(FIPPIShard *)opShards[ns];
+
+  bool Found=false;
+  ShardLocks[ns].read_lock();
+  KeyValueMap::iterator p=S->Map.find(K);
+  if ( p != (S->Map.end()) )
+   { FIPPIRecord *R=GetRecord(S, p->second);
+     memcpy(QIFD, &(R->QIFD), sizeof(QIFIPPIData));
+     __atomic_store_n( &(R->Referenced), true, __ATOMIC_RELAXED);
+     Found=true;
+   };
+  ShardLocks[ns].read_unlock();
 
-  if ( p != (KVM->end()) )
-   { Hits++;
-     return (QIFIPPIData *)(p->second);
+  if (Found)
+   { Stats.Hit();
+     return;
    };
   
   /***************************************************************/
-  /* if it was not found, allocate and compute a new QIFIPPIData */
-  /* structure, then add this structure to the cache             */
+  /* if it was not found, compute a new QIFIPPIData record, then */
+  /* add it to the cache (unless another thread added a record   */
+  /* for the same key in the meantime)                           */
   /***************************************************************/
-  Misses++;
-  KeyStruct *K2 = (KeyStruct *)mallocEC(sizeof(*K2));
-  memcpy(K2->Key, K.Key, KEYSIZE);
-  QIFIPPIData *QIFD=(QIFIPPIData *)mallocEC(sizeof *QIFD);
+  Stats.Miss();
   ComputeQIFIPPIData(OVa, OVb, ncv, QIFD);
    
-  FCLock.write_lock();
-  KVM->insert( KeyValuePair(*K2, QIFD) );
-  FCLock.write_unlock();
-
-  return QIFD;
+  ShardLocks[ns].write_lock();
+  InsertRecord(S, MaxRecordsPerShard, K, QIFD);
+  ShardLocks[ns].write_unlock();
 }
 
 /***************************************************************/
@@ -206,27 +489,26 @@ QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
 /* and subsequently pre-loading a FIPPI cache with the content */
 /* of a file created by this storage operation.                */
 /*                                                             */
-/* the file format is pretty simple (and non-portable w.r.t.   */
-/* endianness):                                                */
+/* cache files are written in the indexed format implemented   */
+/* in CacheFile.cc, in which each record consists of a search  */
+/* key (KEYLEN float values) followed by the content of the    */
+/* QIFIPPIData structure for that search key. preloading such  */
+/* a file simply maps it into memory.                          */
+/*                                                             */
+/* PreLoad() also accepts files in the older unindexed format: */
 /*  bytes 0--10:   'FIPPICACHE' + 0 (a file signature used as  */
 /*                                   a simple sanity check)    */
 /*  next xx bytes:  first record                               */
 /*  next xx bytes:  second record                              */
 /*  ...             ...                                        */
-/*                                                             */
-/* where xx is the size of the record; each record consists of */
-/* a search key (15 double values) followed by the content     */
-/* of the QIFIPPIDataRecord for that search key.               */
+/* whose records are copied into the in-memory tables.         */
 /*                                                             */
 /* note: FIPPICF = 'FIPPI cache file'                          */
 /***************************************************************/
 const char FIPPICF_Signature[]="FIPPICACHE";
 #define FIPPICF_SIGSIZE sizeof(FIPPICF_Signature)
+#define FIPPICF_KIND    "FIPPI"
 
-// note that this structure differs from the KeyValuePair structure 
-// defined above in that it contains the actual contents of 
-// QIFIPPIData structure, whereas KeyValuePair contains just a 
-// pointer to such a structure.
 typedef struct FIPPICF_Record
  { KeyStruct K;
    QIFIPPIData QIFDBuffer;
@@ -235,8 +517,6 @@ typedef struct FIPPICF_Record
 
 void FIPPICache::Store(const char *FileName)
 {
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
-
   if (FileName==0) return;
 
   /*--------------------------------------------------------------*/
@@ -244,7 +524,7 @@ void FIPPICache::Store(const char *FileName)
   /*-  (1) the FIPPI cache was preloaded from an input file whose-*/
   /*-      name matches the name of the output file to which we  -*/
   /*-      are being asked to dump the cache                     -*/
-  /*-  (2) the number of cache records hasn't changed since we   -*/
+  /*-  (2) no cache records have been added or evicted since we  -*/
   /*-      preloaded from the input file.                        -*/
   /*- if both conditions are satisfied, we don't bother to dump  -*/
   /*- the cache since the operation would result in a cache dump -*/
@@ -252,68 +532,107 @@ void FIPPICache::Store(const char *FileName)
   /*--------------------------------------------------------------*/
   if (     PreloadFileName 
        && !strcmp(PreloadFileName, FileName) 
-       && RecordsPreloaded==(KVM->size())
+       && RecordsPreloaded==Size()
+       && EvictionsAtPreload==Evictions()
      )  
    { Log("FIPPI cache unchanged since reading from %s (skipping cache dump)",FileName);
      return;
    };
 
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  FCLock.read_lock();
-
-  KeyValueMap::iterator it;
-  int NumRecords=0;
-
-  /*--------------------------------------------------------------*/
-  /*- try to open the file ---------------------------------------*/
-  /*--------------------------------------------------------------*/
-  FILE *f=fopen(FileName,"w");
-  if (!f)
-   { fprintf(stderr,"warning: could not open file %s (aborting cache dump)...",FileName);
-     goto done;
-   };
   Log("Writing FIPPI cache to file %s...",FileName);
+  CacheFileWriter Writer(FileName, FIPPICF_KIND, KEYSIZE, sizeof(QIFIPPIData));
 
   /*---------------------------------------------------------------------*/
-  /*- write file signature ----------------------------------------------*/
+  /*- records from the mapped cache file, if any ------------------------*/
   /*---------------------------------------------------------------------*/
-  fwrite(FIPPICF_Signature,FIPPICF_SIGSIZE,1,f);
+  if (MappedFile)
+   for(uint64_t nr=0; nr<MappedFile->NumRecords; nr++)
+    Writer.AddRecord(MappedFile->GetKey(nr), MappedFile->GetData(nr));
 
   /*---------------------------------------------------------------------*/
-  /*- iterate through the table and write entries to the file one-by-one */
+  /*- records from the in-memory tables ---------------------------------*/
   /*---------------------------------------------------------------------*/
-  KeyStruct K;
-  QIFIPPIData *QIFD;
-  FIPPICF_Record MyRecord;
-  for ( it = KVM->begin(); it != KVM->end(); it++ ) 
-   { 
-     K=it->first;
-     QIFD=it->second;
-     memcpy(&(MyRecord.K.Key),       K.Key, sizeof(MyRecord.K.Key ));
-     memcpy(&(MyRecord.QIFDBuffer),  QIFD,  sizeof(MyRecord.QIFDBuffer));
-     if ( 1 != fwrite(&(MyRecord),sizeof(MyRecord),1,f ) )
-      break;
-     NumRecords++;
+  for(int ns=0; ns<NUMFIPPISHARDS; ns++)
+   { FIPPIShard *S=(FIPPIShard *)opShards[ns];
+     ShardLocks[ns].read_lock();
+     KeyValueMap::iterator it;
+     for ( it = S->Map.begin(); it != S->Map.end(); it++ ) 
+      { FIPPIRecord *R=GetRecord(S, it->second);
+        Writer.AddRecord(R->K.Key, &(R->QIFD));
+      };
+     ShardLocks[ns].read_unlock();
    };
 
   /*---------------------------------------------------------------------*/
   /*- and that's it -----------------------------------------------------*/
   /*---------------------------------------------------------------------*/
-  fclose(f);
-  Log(" ...wrote %i FIPPI records.",NumRecords);
+  if (Writer.Close())
+   Log(" ...wrote %lu FIPPI records.",(unsigned long)Writer.NumRecords);
+  else
+   { fprintf(stderr,"warning: %s (aborting cache dump)\n",Writer.ErrMsg);
+     Log(" ...failed: %s",Writer.ErrMsg);
+   };
+}
 
- done:
-  FCLock.read_unlock();
+/***************************************************************/
+/* preload from a file in the indexed format. if no file is    */
+/* mapped yet and the byte order of the file matches ours, the */
+/* file is mapped and used in place; otherwise its records are */
+/* copied into the in-memory tables.                           */
+/***************************************************************/
+void FIPPICache::PreLoadIndexed(const char *FileName)
+{
+  MappedCacheFile *MCF
+   = new MappedCacheFile(FileName, FIPPICF_KIND, KEYSIZE, sizeof(QIFIPPIData));
+  if (MCF->ErrMsg)
+   { fprintf(stderr,"warning: %s (skipping cache preload)\n",MCF->ErrMsg);
+     Log("%s (skipping cache preload)",MCF->ErrMsg);
+     delete MCF;
+     return;
+   };
+
+  if (MappedFile==0 && !(MCF->ByteSwapped))
+   { MappedFile=MCF;
+     Log("Mapped %lu FIPPI records from file %s.",(unsigned long)MCF->NumRecords,FileName);
+   }
+  else
+   { Log("Preloading %lu FIPPI records from file %s%s...",
+          (unsigned long)MCF->NumRecords,FileName,
+          MCF->ByteSwapped ? " (converting byte order)" : "");
+     FIPPICF_Record Record;
+     for(uint64_t nr=0; nr<MCF->NumRecords; nr++)
+      { memcpy(&(Record.K), MCF->GetKey(nr), KEYSIZE);
+        memcpy(&(Record.QIFDBuffer), MCF->GetData(nr), sizeof(QIFIPPIData));
+        if (MCF->ByteSwapped)
+         { SwapCacheItems(Record.K.Key, sizeof(float), KEYLEN);
+           SwapCacheItems(&(Record.QIFDBuffer), sizeof(double),
+                          sizeof(QIFIPPIData)/sizeof(double));
+         };
+        int ns=GetShardIndex(Record.K);
+        ShardLocks[ns].write_lock();
+        InsertRecord( (FIPPIShard *)opShards[ns], MaxRecordsPerShard,
+                      Record.K, &(Record.QIFDBuffer));
+        ShardLocks[ns].write_unlock();
+      };
+     delete MCF;
+   };
+
+  if (PreloadFileName)
+   free(PreloadFileName);
+  PreloadFileName=strdupEC(FileName);
+  RecordsPreloaded=Size();
+  EvictionsAtPreload=Evictions();
 }
 
 void FIPPICache::PreLoad(const char *FileName)
 {
+  if (IsIndexedCacheFile(FileName))
+   { PreLoadIndexed(FileName);
+     return;
+   };
 
-  FCLock.write_lock();
-
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
+  for(int ns=0; ns<NUMFIPPISHARDS; ns++)
+   ShardLocks[ns].write_lock();
 
   /*--------------------------------------------------------------*/
   /*- try to open the file ---------------------------------------*/
@@ -353,19 +672,8 @@ void FIPPICache::PreLoad(const char *FileName)
   if ( ErrMsg==0 && (FileSize % FIPPICF_RECSIZE)!=0 )
    ErrMsg="cache file has incorrect size";
 
-  /*--------------------------------------------------------------*/
-  /*- allocate memory to store cache entries read from the file. -*/
-  /*- for now, we abort if there is not enough memory to store   -*/
-  /*- the full cache; TODO explore schemes for partial preload.  -*/
-  /*--------------------------------------------------------------*/
   unsigned int NumRecords;
-  FIPPICF_Record *Records;
   NumRecords = FileSize / FIPPICF_RECSIZE;
-  if ( ErrMsg==0 )
-   { Records=(FIPPICF_Record *)mallocEC(NumRecords*FIPPICF_RECSIZE);
-     if ( !Records)
-      ErrMsg="insufficient memory to preload cache";
-   };
 
   /*--------------------------------------------------------------*/
   /*- pause here to clean up if anything went wrong --------------*/
@@ -379,19 +687,23 @@ void FIPPICache::PreLoad(const char *FileName)
 
   /*--------------------------------------------------------------*/
   /*- now just read records from the file one at a time and add   */
-  /*- them to the table.                                          */
+  /*- them to the table. if the cache has a memory budget, older  */
+  /*- records may be evicted to make room for later ones.         */
   /*--------------------------------------------------------------*/
   unsigned int nr;
+  FIPPICF_Record Record;
   Log("Preloading FIPPI records from file %s...",FileName);
   for(nr=0; nr<NumRecords; nr++)
    { 
-     if ( fread(Records+nr, FIPPICF_RECSIZE,1,f) != 1 )
+     if ( fread(&Record, FIPPICF_RECSIZE,1,f) != 1 )
       { fprintf(stderr,"warning: file %s: read only %i of %i records",FileName,nr+1,NumRecords);
         fclose(f);
 	goto done;
       };
 
-     KVM->insert( KeyValuePair(Records[nr].K, &(Records[nr].QIFDBuffer)) );
+     int ns=GetShardIndex(Record.K);
+     InsertRecord( (FIPPIShard *)opShards[ns], MaxRecordsPerShard,
+                   Record.K, &(Record.QIFDBuffer));
    };
 
   /*--------------------------------------------------------------*/
@@ -407,10 +719,15 @@ void FIPPICache::PreLoad(const char *FileName)
   if (PreloadFileName)
    free(PreloadFileName);
   PreloadFileName=strdupEC(FileName);
-  RecordsPreloaded=NumRecords;
+  RecordsPreloaded=EvictionsAtPreload=0;
+  for(int ns=0; ns<NUMFIPPISHARDS; ns++)
+   { RecordsPreloaded   += ((FIPPIShard *)opShards[ns])->Map.size();
+     EvictionsAtPreload += ((FIPPIShard *)opShards[ns])->Evictions;
+   };
 
  done:
-  FCLock.write_unlock();
+  for(int ns=0; ns<NUMFIPPISHARDS; ns++)
+   ShardLocks[ns].write_unlock();
 }
 
 /***************************************************************/
@@ -428,5 +745,10 @@ void StoreCache(const char *FileName)
   GlobalFIPPICache.Store(FileName);
 }
 
+void SetFIPPICacheBudget(double MegaBytes)
+{ 
+  GlobalFIPPICache.SetMaxBytes( (size_t)(MegaBytes*1048576.0) );
+}
+
 
 } // namespace scuff
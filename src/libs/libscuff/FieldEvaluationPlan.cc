@@ -0,0 +1,718 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * FieldEvaluationPlan.cc -- reusable precomputation for evaluating
+ *                        -- scattered fields at a fixed set of points
+ *
+ * Computing the RFMatrix ('reduced fields', see GetRFMatrix) at NX
+ * points involves three kinds of frequency-independent work that
+ * used to be redone on every call, and for every (edge, point) pair:
+ *
+ *  (a) locating the region that contains each point (a point-in-
+ *      object test, which was repeated NE times per point);
+ *  (b) deciding from the point-edge distance which cubature rule
+ *      (low order, high order, or the near-field routine) to use;
+ *  (c) finding the bounding box of the points in each region, used
+ *      to size the periodic-GF accelerators for PBC geometries.
+ *
+ * A FieldEvaluationPlan does (a) and (c) once when it is created and
+ * (b) once the first time an RFMatrix is needed. Pairs in (b) are
+ * stored sparsely: only pairs closer than the outer threshold, and
+ * only for edges on surfaces that bound the point's region, are
+ * recorded.
+ *
+ * The plan also keeps the RFMatrix computed at the most recent
+ * (Omega, kBloch), so evaluating fields for further KN vectors at the
+ * same frequency is just a matrix-matrix product.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+#include "PanelCubature.h"
+
+#define NUMFIELDS 6 // Ex, Ey, Ez, Hx, Hy, Hz
+#define II cdouble(0,1)
+
+#define RULE_HIGHORDER 1
+#define RULE_NEARBY    2
+
+namespace scuff {
+
+cdouble GetG(double R[3], cdouble k, cdouble *dG, cdouble *ddG=0);
+
+void GetReducedFields_Nearby(RWGSurface *S, const int ne,
+                             const double X0[3], const cdouble k,
+                             cdouble e[3], cdouble h[3]);
+
+/***************************************************************/
+/* integrand for computation of reduced fields                 */
+/***************************************************************/
+void GetGCBar2D_Fourier(cdouble k, double *kBloch,
+                        HMatrix *RLBasis, double RLVolume,
+                        double *XDest, double *XSource,
+                        cdouble G[3][3], cdouble C[3][3]);
+
+typedef struct RFIData
+ { cdouble k;
+   double *X0;
+   GBarAccelerator *GBA;
+   HMatrix *RLBasis;
+   double RLVolume;
+   bool NewMethod;
+ } RFIData;
+
+void RFIntegrand(double X[3], double b[3], double Divb,
+                 void *UserData, double W, double *Integral)
+{
+  RFIData *Data       = (RFIData *)UserData;
+  cdouble k            = Data->k;
+  double *X0           = Data->X0;
+  GBarAccelerator *GBA = Data->GBA;
+
+  cdouble *GC = (cdouble *)Integral;
+
+  // Fourier-space evaluation of the periodic dyadic GFs
+  if (Data->NewMethod)
+   { cdouble GG[3][3], CC[3][3];
+     GetGCBar2D_Fourier(k, GBA->kBloch, Data->RLBasis, Data->RLVolume, X, X0, GG, CC);
+     for(int Mu=0; Mu<3; Mu++)
+      for(int Nu=0; Nu<3; Nu++)
+       { GC[0 + Mu] += W*GG[Mu][Nu]*b[Nu];
+         GC[3 + Mu] -= W*CC[Mu][Nu]*b[Nu];
+       };
+     return;
+   };
+
+  double XmX0[3];
+  XmX0[0] = X[0] - X0[0];
+  XmX0[1] = X[1] - X0[1];
+  XmX0[2] = X[2] - X0[2];
+
+  cdouble G0, dG[3];
+  if (GBA)
+   G0=GetGBar(XmX0, GBA, dG);
+  else
+   G0=GetG(XmX0, k, dG);
+
+  cdouble k2=k*k, ik=II*k;
+  for(int i=0; i<3; i++)
+   GC[i] += W*(G0*b[i] - Divb*dG[i]/k2);
+
+  GC[3+0] += W*(b[1]*dG[2] - b[2]*dG[1]) / (-1.0*ik);
+  GC[3+1] += W*(b[2]*dG[0] - b[0]*dG[2]) / (-1.0*ik);
+  GC[3+2] += W*(b[0]*dG[1] - b[1]*dG[0]) / (-1.0*ik);
+}
+
+/***************************************************************/
+/* Sign with which edges on surface #ns contribute to fields   */
+/* in region #nr, or 0 if the surface does not bound region nr.*/
+/***************************************************************/
+static double GetRegionSign(RWGSurface *S, int nr)
+{
+  if (nr==-1) return 0.0;
+  if (S->RegionIndices[0]==nr) return +1.0;
+  if (S->RegionIndices[1]==nr) return -1.0;
+  return 0.0;
+}
+
+/***************************************************************/
+/* class constructor: copy the evaluation points, locate them  */
+/* in the geometry, and (for PBC geometries) get per-region    */
+/* bounding boxes                                              */
+/***************************************************************/
+FieldEvaluationPlan::FieldEvaluationPlan(RWGGeometry *pG,
+                                         HMatrix *pXMatrix,
+                                         int ColumnOffset)
+{
+  G=pG;
+  if ( pXMatrix==0 || pXMatrix->NR==0 || pXMatrix->NC<ColumnOffset+3 )
+   ErrExit("invalid XMatrix passed to FieldEvaluationPlan");
+
+  NX=pXMatrix->NR;
+  XMatrix = new HMatrix(NX, 3, LHM_REAL);
+  for(int nx=0; nx<NX; nx++)
+   for(int i=0; i<3; i++)
+    XMatrix->SetEntry(nx, i, pXMatrix->GetEntryD(nx, ColumnOffset+i));
+
+  /*--------------------------------------------------------------*/
+  /*- region lookup, once per point ------------------------------*/
+  /*--------------------------------------------------------------*/
+  RegionIndices = (int *)mallocEC(NX*sizeof(int));
+#ifdef USE_OPENMP
+  int NumThreads=GetNumThreads();
+#pragma omp parallel for schedule(dynamic,64), num_threads(NumThreads)
+#endif
+  for(int nx=0; nx<NX; nx++)
+   { double X[3];
+     XMatrix->GetEntriesD(nx, "0:2", X);
+     RegionIndices[nx] = G->GetRegionIndex(X);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- bounding boxes of the points in each region; these are only */
+  /*- used to size GBarAccelerators for PBC geometries            */
+  /*--------------------------------------------------------------*/
+  int NR = G->NumRegions;
+  RegionXMin = (double *)mallocEC(3*NR*sizeof(double));
+  RegionXMax = (double *)mallocEC(3*NR*sizeof(double));
+  RegionNumPoints = (int *)mallocEC(NR*sizeof(int));
+  for(int nr=0; nr<NR; nr++)
+   for(int i=0; i<3; i++)
+    { RegionXMin[3*nr+i] = +1.0e89;
+      RegionXMax[3*nr+i] = -1.0e89;
+    };
+  for(int nx=0; nx<NX; nx++)
+   { int nr=RegionIndices[nx];
+     if (nr==-1) continue;
+     RegionNumPoints[nr]++;
+     for(int i=0; i<3; i++)
+      { double Xi=XMatrix->GetEntryD(nx,i);
+        RegionXMin[3*nr+i] = fmin(RegionXMin[3*nr+i], Xi);
+        RegionXMax[3*nr+i] = fmax(RegionXMax[3*nr+i], Xi);
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- cubature thresholds (the pairs themselves are classified   -*/
+  /*- lazily, since incident-field-only evaluations never need  -*/
+  /*- them)                                                      -*/
+  /*--------------------------------------------------------------*/
+  rRelOuterThreshold=4.0;
+  rRelInnerThreshold=1.0;
+  LowOrder=7;
+  HighOrder=20;
+  char *s1=getenv("SCUFF_RREL_OUTER_THRESHOLD");
+  char *s2=getenv("SCUFF_RREL_INNER_THRESHOLD");
+  char *s3=getenv("SCUFF_LOWORDER");
+  char *s4=getenv("SCUFF_HIGHORDER");
+  if (s1) sscanf(s1,"%le",&rRelOuterThreshold);
+  if (s2) sscanf(s2,"%le",&rRelInnerThreshold);
+  if (s3) sscanf(s3,"%i",&LowOrder);
+  if (s4) sscanf(s4,"%i",&HighOrder);
+  if ( (s1||s2||s3||s4) && G->LogLevel>=SCUFF_VERBOSELOGGING )
+   Log("({O,I}rRelThreshold | LowOrder | HighOrder)=(%e,%e,%i,%i)",
+       rRelOuterThreshold,rRelInnerThreshold,LowOrder,HighOrder);
+
+  Classified=false;
+  NearOffsets=NearEdges=0;
+  NearRules=0;
+
+  RFMatrix=0;
+  RFValid=false;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+FieldEvaluationPlan::~FieldEvaluationPlan()
+{
+  delete XMatrix;
+  free(RegionIndices);
+  free(RegionXMin);
+  free(RegionXMax);
+  free(RegionNumPoints);
+  if (NearOffsets) free(NearOffsets);
+  if (NearEdges) free(NearEdges);
+  if (NearRules) free(NearRules);
+  if (RFMatrix) delete RFMatrix;
+}
+
+/***************************************************************/
+/* build the sparse per-point lists of edges that need more    */
+/* than low-order cubature. Two passes over the (point, edge)  */
+/* pairs: the first counts, the second fills.                  */
+/***************************************************************/
+void FieldEvaluationPlan::ClassifyPairs()
+{
+  if (Classified) return;
+
+  int NE = G->TotalEdges;
+  NearOffsets = (int *)mallocEC((NX+1)*sizeof(int));
+
+#ifdef USE_OPENMP
+  int NumThreads=GetNumThreads();
+#endif
+  for(int Pass=0; Pass<2; Pass++)
+   {
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,64), num_threads(NumThreads)
+#endif
+     for(int nx=0; nx<NX; nx++)
+      {
+        int nr=RegionIndices[nx];
+        if (nr==-1)
+         { if (Pass==0) NearOffsets[nx+1]=0;
+           continue;
+         };
+
+        double X[3];
+        XMatrix->GetEntriesD(nx, "0:2", X);
+        int Count=0, Offset = (Pass==0 ? 0 : NearOffsets[nx]);
+        for(int neFull=0; neFull<NE; neFull++)
+         { int ns, ne;
+           RWGSurface *S = G->ResolveEdge(neFull, &ns, &ne);
+           if ( GetRegionSign(S, nr)==0.0 ) continue;
+           RWGEdge *E = S->Edges[ne];
+           double rRel = VecDistance(X, E->Centroid) / E->Radius;
+           if (rRel >= rRelOuterThreshold) continue;
+           if (Pass==1)
+            { NearEdges[Offset+Count] = neFull;
+              NearRules[Offset+Count]
+               = (rRel>=rRelInnerThreshold) ? RULE_HIGHORDER : RULE_NEARBY;
+            };
+           Count++;
+         };
+        if (Pass==0) NearOffsets[nx+1]=Count;
+      };
+
+     if (Pass==0)
+      { NearOffsets[0]=0;
+        for(int nx=0; nx<NX; nx++)
+         NearOffsets[nx+1] += NearOffsets[nx];
+        int NumNear = NearOffsets[NX];
+        NearEdges = (int *)mallocEC((NumNear+1)*sizeof(int));
+        NearRules = (char *)mallocEC((NumNear+1)*sizeof(char));
+      };
+   };
+
+  if (G->LogLevel>=SCUFF_VERBOSELOGGING)
+   Log("Field evaluation plan: %i points, %i near (point,edge) pairs",
+        NX,NearOffsets[NX]);
+
+  Classified=true;
+}
+
+/***************************************************************/
+/* cubature rule for (point, edge) pair: 0 for low order, or   */
+/* one of the RULE_xx constants. NearEdges[...] is sorted      */
+/* within each point's range since it is filled in edge order. */
+/***************************************************************/
+static int LookupRule(int *NearEdges, char *NearRules,
+                      int Start, int Stop, int neFull)
+{
+  while(Start<Stop)
+   { int Mid=(Start+Stop)/2;
+     if (NearEdges[Mid]==neFull)
+      return NearRules[Mid];
+     else if (NearEdges[Mid]<neFull)
+      Start=Mid+1;
+     else
+      Stop=Mid;
+   };
+  return 0;
+}
+
+/***************************************************************/
+/* RFMatrix is a matrix of "reduced fields", i.e. a matrix     */
+/* whose columns may be dot-producted with the KN vector (BEM  */
+/* system solution vector) to yield components of the          */
+/* scattered E and H fields.                                   */
+/* More specifically, for Mu=0...5, the (6*nx + Mu)th column   */
+/* of RFMatrix is dotted into KN to yield the Muth component   */
+/* of the field six-vector F=\{ E \choose H \}.                */
+/***************************************************************/
+HMatrix *FieldEvaluationPlan::FillRFMatrix(cdouble Omega, double *kBloch0,
+                                           bool MinuskBloch,
+                                           HMatrix *RFM)
+{
+  int LDim = G->LDim;
+  double *kBloch=kBloch0;
+  double kBlochBuffer[3];
+  if (kBloch && MinuskBloch)
+   { kBloch = kBlochBuffer;
+     kBloch[0] = kBloch[1] = kBloch[2] = 0.0;
+     for(int d=0; d<LDim; d++)
+      kBloch[d] = -1.0*kBloch0[d];
+   };
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  int NE  = G->TotalEdges;
+  int NBF = G->TotalBFs;
+  if (     RFM==0
+       || (RFM->NR != NBF)
+       || (RFM->NC != 6*NX)
+     )
+   { if (RFM)
+      { Warn("wrong-size RFMatrix passed to GetRFMatrix; reallocating");
+        delete RFM;
+      };
+     RFM = new HMatrix(NBF, 6*NX, LHM_COMPLEX);
+   };
+  RFM->Zero();
+
+  ClassifyPairs();
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  int NumRegions = G->NumRegions;
+  cdouble *ZRels   = new cdouble[NumRegions];
+  cdouble *ks      = new cdouble[NumRegions];
+  for(int nr=0; nr<NumRegions; nr++)
+   { cdouble EpsRel, MuRel;
+     G->RegionMPs[nr]->GetEpsMu(Omega, &EpsRel, &MuRel);
+     ZRels[nr] = sqrt(MuRel/EpsRel);
+     ks[nr]    = sqrt(MuRel*EpsRel) * Omega;
+   };
+
+  /***************************************************************/
+  /* For the periodic-boundary-condition case, we need to        */
+  /* initialize accelerator objects to accelerate computation of */
+  /* the periodic Green's function in each extended region of    */
+  /* the geometry. The extent of the tables is determined by the */
+  /* surfaces bounding each region and the bounding box of the   */
+  /* evaluation points in that region.                           */
+  /***************************************************************/
+  GBarAccelerator **RegionGBAs=0;
+  if (G->LBasis)
+   { RegionGBAs=
+      (GBarAccelerator **)mallocEC(NumRegions*sizeof(RegionGBAs[0]));
+     for(int nr=0; nr<NumRegions; nr++)
+      { if ( G->RegionMPs[nr]->IsPEC() || RegionNumPoints[nr]==0 )
+         continue;
+        int NumBoundingSurfaces=0;
+        for(int ns=0; ns<G->NumSurfaces; ns++)
+         if ( GetRegionSign(G->Surfaces[ns], nr)!=0.0 )
+          NumBoundingSurfaces++;
+        if (NumBoundingSurfaces==0)
+         continue; // no edges contribute to fields in this region
+
+        double RMin[3]={1.0, 1.0, 1.0};
+        double RMax[3]={0.0, 0.0, 0.0};
+        if (NX>=8)
+         { double *PointXMin=RegionXMin+3*nr, *PointXMax=RegionXMax+3*nr;
+           for(int i=0; i<3; i++)
+            { RMin[i]=+1.0e89;
+              RMax[i]=-1.0e89;
+            };
+           for(int ns=0; ns<G->NumSurfaces; ns++)
+            { RWGSurface *S=G->Surfaces[ns];
+              if ( GetRegionSign(S, nr)==0.0 ) continue;
+              for(int i=0; i<3; i++)
+               { RMax[i] = fmax(RMax[i], S->RMax[i] - PointXMin[i]);
+                 RMin[i] = fmin(RMin[i], S->RMin[i] - PointXMax[i]);
+               };
+            };
+         };
+        RegionGBAs[nr]=G->CreateRegionGBA(nr, Omega, kBloch, RMin, RMax, false);
+      };
+   };
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  // SCUFF_NEW_RFMETHOD=1 selects the Fourier-space evaluation of
+  // the periodic reduced fields
+  char *s = getenv("SCUFF_NEW_RFMETHOD");
+  bool UseNewMethod = (s && s[0]=='1');
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  int NENX=NE*NX;
+#ifndef USE_OPENMP
+  if (G->LogLevel>SCUFF_VERBOSELOGGING)
+   Log("Computing RFMatrix entries at %i points",NX);
+#else
+  int NumThreads=GetNumThreads();
+  if (G->LogLevel>SCUFF_VERBOSELOGGING)
+   Log("Computing RFMatrix entries (%i threads) at %i points",NumThreads,NX);
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nenx=0; nenx<NENX; nenx++)
+   {
+     int nx     = nenx / NE;
+     int neFull = nenx % NE;
+
+     int RegionIndex = RegionIndices[nx];
+     if (RegionIndex==-1) continue; // inside a closed PEC surface
+
+     int ns, ne, nbf;
+     RWGSurface *S = G->ResolveEdge(neFull, &ns, &ne, &nbf);
+     double Sign = GetRegionSign(S, RegionIndex);
+     if (Sign==0.0) continue;
+
+     double X[3];
+     XMatrix->GetEntriesD(nx, "0:2", X);
+
+     cdouble k    = ks[RegionIndex];
+     cdouble ZRel = ZRels[RegionIndex];
+
+     /*--------------------------------------------------------------*/
+     /*--------------------------------------------------------------*/
+     /*--------------------------------------------------------------*/
+     cdouble GC[6];
+     RFIData MyData, *Data=&MyData;
+     Data->X0  = X;
+     Data->k   = ks[RegionIndex];
+     Data->GBA = RegionGBAs ? RegionGBAs[RegionIndex] : 0;
+     Data->RLBasis = G->RLBasis;
+     Data->RLVolume= G->RLVolume;
+     Data->NewMethod = UseNewMethod;
+
+     int Rule = LookupRule(NearEdges, NearRules,
+                           NearOffsets[nx], NearOffsets[nx+1], neFull);
+     const int IDim=12;
+     if (Rule==0)
+      {
+        GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                       IDim, LowOrder, (double *)GC);
+      }
+     else if (Rule==RULE_HIGHORDER)
+      {
+        GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                       IDim, HighOrder, (double *)GC);
+      }
+     else
+      {
+        GetReducedFields_Nearby(S, ne, X, k, GC+0, GC+3);
+        GC[3] /= (-II*k);
+        GC[4] /= (-II*k);
+        GC[5] /= (-II*k);
+
+        if (RegionGBAs)
+         { cdouble GC1[6], GC2[6];
+           int Order=4;
+           GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                          IDim, Order, (double *)GC1);
+           Data->GBA = 0;
+           GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                          IDim, Order, (double *)GC2);
+           for(int Mu=0; Mu<6; Mu++)
+            GC[Mu] += (GC1[Mu] - GC2[Mu]);
+         };
+      };
+
+     /***************************************************/
+     /*                                                 */
+     /* E = ik*Z0 * Zr * k*g + ik*n*c                   */
+     /*   = ik*Z0 * Zr * k*g - ik*Z0*nScuff*c           */
+     /* H =        -ik * k*c + (ik/(Z0*Zr)) * n*c       */
+     /*   =        -ik * k*c - (ik/Zr) *nScuff*c        */
+     /***************************************************/
+     cdouble *GG=GC+0, *CC=GC+3;
+     cdouble EKFactor =      Sign*II*k*ZRel*ZVAC;
+     cdouble HKFactor = -1.0*Sign*II*k;
+     cdouble ENFactor = -1.0*Sign*II*k*ZVAC;
+     cdouble HNFactor = -1.0*Sign*II*k/ZRel;
+
+     RFM->SetEntry(nbf, 6*nx + 0, EKFactor * GG[0] );
+     RFM->SetEntry(nbf, 6*nx + 1, EKFactor * GG[1] );
+     RFM->SetEntry(nbf, 6*nx + 2, EKFactor * GG[2] );
+     RFM->SetEntry(nbf, 6*nx + 3, HKFactor * CC[0] );
+     RFM->SetEntry(nbf, 6*nx + 4, HKFactor * CC[1] );
+     RFM->SetEntry(nbf, 6*nx + 5, HKFactor * CC[2] );
+
+     if ( !(S->IsPEC) )
+      { RFM->SetEntry(nbf+1, 6*nx + 0, ENFactor * CC[0] );
+        RFM->SetEntry(nbf+1, 6*nx + 1, ENFactor * CC[1] );
+        RFM->SetEntry(nbf+1, 6*nx + 2, ENFactor * CC[2] );
+        RFM->SetEntry(nbf+1, 6*nx + 3, HNFactor * GG[0] );
+        RFM->SetEntry(nbf+1, 6*nx + 4, HNFactor * GG[1] );
+        RFM->SetEntry(nbf+1, 6*nx + 5, HNFactor * GG[2] );
+      };
+
+   }; // for(int nenx=0; nenx<NENX; nenx++)
+
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  if (RegionGBAs)
+   { for(int nr=0; nr<NumRegions; nr++)
+      if (RegionGBAs[nr])
+       DestroyGBarAccelerator(RegionGBAs[nr]);
+     free(RegionGBAs);
+   };
+
+  delete[] ZRels;
+  delete[] ks;
+
+  return RFM;
+}
+
+/***************************************************************/
+/* cached version of the above                                 */
+/***************************************************************/
+HMatrix *FieldEvaluationPlan::GetRFMatrix(cdouble Omega, double *kBloch,
+                                          bool MinuskBloch)
+{
+  double kEffective[3]={0.0, 0.0, 0.0};
+  if (kBloch)
+   for(int d=0; d<G->LDim; d++)
+    kEffective[d] = (MinuskBloch ? -1.0 : 1.0)*kBloch[d];
+
+  if (    RFValid && RFOmega==Omega
+       && RFkBloch[0]==kEffective[0]
+       && RFkBloch[1]==kEffective[1]
+       && RFkBloch[2]==kEffective[2]
+     )
+   return RFMatrix;
+
+  RFMatrix = FillRFMatrix(Omega, kEffective, false, RFMatrix);
+  RFOmega  = Omega;
+  memcpy(RFkBloch, kEffective, 3*sizeof(double));
+  RFValid  = true;
+  return RFMatrix;
+}
+
+void FieldEvaluationPlan::ReleaseRFMatrix()
+{
+  if (RFMatrix) delete RFMatrix;
+  RFMatrix=0;
+  RFValid=false;
+}
+
+/***************************************************************/
+/* add the fields of the incident-field chain IF to columns    */
+/* ColumnOffset...ColumnOffset+5 of FMatrix                    */
+/***************************************************************/
+void FieldEvaluationPlan::AddIncidentFields(IncField *IF, cdouble Omega,
+                                            double *kBloch,
+                                            HMatrix *FMatrix,
+                                            int ColumnOffset)
+{
+  if (IF==0) return;
+
+  /***************************************************************/
+  /* the incident fields will most likely have been updated at   */
+  /* the current frequency already by an earlier call to         */
+  /* AssembleRHSVector(), but someone might call GetFields()     */
+  /* to get information on just the incident fields before       */
+  /* before setting up and solving the BEM problem, so we should */
+  /* do this just to make sure.                                  */
+  /***************************************************************/
+  G->UpdateIncFields(IF, Omega, kBloch);
+
+  for(int nx=0; nx<NX; nx++)
+   {
+     int RegionIndex = RegionIndices[nx];
+     if (RegionIndex==-1) continue; // inside a closed PEC surface
+
+     double X[3];
+     XMatrix->GetEntriesD(nx,"0:2",X);
+     for(IncField *IFP=IF; IFP; IFP=IFP->Next)
+      if ( IFP->RegionIndex == RegionIndex )
+       { cdouble EH[6];
+         IFP->GetFields(X, EH);
+         for(int Mu=0; Mu<6; Mu++)
+          FMatrix->AddEntry(nx, ColumnOffset + Mu, EH[Mu]);
+       };
+   };
+}
+
+/***************************************************************/
+/* fields due to the surface currents in all columns of KN,    */
+/* plus the fields of IFs[nrhs] (if present) added to the      */
+/* nrhs-th group of six columns.                               */
+/***************************************************************/
+HMatrix *FieldEvaluationPlan::Apply(HMatrix *KN, cdouble Omega,
+                                    double *kBloch, IncField **IFs,
+                                    HMatrix *FMatrix)
+{
+  if ( KN==0 || KN->NR!=G->TotalBFs )
+   ErrExit("wrong-size KN matrix passed to FieldEvaluationPlan::Apply");
+
+  int NRHS=KN->NC;
+  if (G->LogLevel >= SCUFF_VERBOSELOGGING)
+   Log("Computing fields at %i evaluation points for %i RHSs...",NX,NRHS);
+
+  if (FMatrix==0 || FMatrix->NR!=NX || FMatrix->NC!=NUMFIELDS*NRHS)
+   { if (FMatrix)
+      { Warn(" ** warning: wrong-size FMatrix passed to GetFields(); reallocating");
+        delete FMatrix;
+      };
+     FMatrix=new HMatrix(NX, NUMFIELDS*NRHS, LHM_COMPLEX);
+   };
+
+  /***************************************************************/
+  /* scattered fields: FMatrixT = RFMatrix^T * KN                */
+  /***************************************************************/
+  HMatrix *RF = GetRFMatrix(Omega, kBloch, true);
+  HMatrix *KNZ = KN;
+  if (KN->RealComplex==LHM_REAL)
+   { KNZ = new HMatrix(KN->NR, KN->NC, LHM_COMPLEX);
+     for(int nr=0; nr<KN->NR; nr++)
+      for(int nc=0; nc<KN->NC; nc++)
+       KNZ->SetEntry(nr, nc, KN->GetEntryD(nr,nc));
+   };
+  HMatrix *FMatrixT = new HMatrix(6*NX, NRHS, LHM_COMPLEX);
+  RF->Multiply(KNZ, FMatrixT, "--transA T");
+  for(int nrhs=0; nrhs<NRHS; nrhs++)
+   for(int nx=0; nx<NX; nx++)
+    for(int Mu=0; Mu<6; Mu++)
+     FMatrix->SetEntry(nx, 6*nrhs + Mu, FMatrixT->GetEntry(6*nx + Mu, nrhs));
+  if (KNZ!=KN) delete KNZ;
+  delete FMatrixT;
+
+  /***************************************************************/
+  /* add contributions of incident fields if present *************/
+  /***************************************************************/
+  if (IFs)
+   for(int nrhs=0; nrhs<NRHS; nrhs++)
+    AddIncidentFields(IFs[nrhs], Omega, kBloch, FMatrix, 6*nrhs);
+
+  return FMatrix;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+HMatrix *FieldEvaluationPlan::Apply(HVector *KN, cdouble Omega,
+                                    double *kBloch, IncField *IF,
+                                    HMatrix *FMatrix)
+{
+  if (G->LogLevel >= SCUFF_VERBOSELOGGING)
+   Log("Computing fields at %i evaluation points...",NX);
+
+  if (FMatrix==0 || FMatrix->NR!=NX || FMatrix->NC!=NUMFIELDS)
+   { if (FMatrix)
+      { Warn(" ** warning: wrong-size FMatrix passed to GetFields(); reallocating");
+        delete FMatrix;
+      };
+     FMatrix=new HMatrix(NX, NUMFIELDS, LHM_COMPLEX);
+   };
+  FMatrix->Zero();
+
+  if (KN)
+   { HMatrix *RF = GetRFMatrix(Omega, kBloch, true);
+     HMatrix KNMatrix(1, G->TotalBFs, LHM_COMPLEX, LHM_NORMAL, (void *)KN->ZV);
+     HMatrix *FMatrixT = new HMatrix(1, 6*NX, LHM_COMPLEX);
+     KNMatrix.Multiply(RF, FMatrixT);
+     for(int nx=0; nx<NX; nx++)
+      for(int Mu=0; Mu<6; Mu++)
+       FMatrix->SetEntry(nx, Mu, FMatrixT->GetEntry(0, 6*nx + Mu));
+     delete FMatrixT;
+   };
+
+  AddIncidentFields(IF, Omega, kBloch, FMatrix, 0);
+
+  return FMatrix;
+}
+
+} // namespace scuff
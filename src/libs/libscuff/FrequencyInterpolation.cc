@@ -0,0 +1,483 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * FrequencyInterpolation.cc -- interpolation of BEM matrix blocks in
+ *                           -- frequency, for dense frequency sweeps
+ *
+ * Applications like scuff-neq, scuff-heat and scuff-cas3D assemble
+ * the same surface-pair blocks at hundreds of closely-spaced
+ * frequencies. When RWGGeometry::FreqInterpTol is nonzero (or the
+ * environment variable SCUFF_FREQINTERP_TOL is set),
+ * AssembleBEMMatrixBlock() instead obtains each block by interpolating
+ * in frequency between blocks assembled at a few anchor frequencies.
+ *
+ * The entry of the (a,b) block coupling edges ea and eb is written
+ *
+ *  B_{ab}(Omega) = sum_r exp(i*k_r*R_{ab}) * S^r_{ab}(Omega)
+ *
+ * where the sum runs over the (one or two) regions r through which
+ * the surfaces interact, k_r is the wavenumber in region r, and
+ * R_{ab} is the distance between the edge centroids. The smooth parts
+ * S^r, which are assembled separately for each region, are
+ * interpolated in |Omega| by barycentric Chebyshev interpolation on
+ * 'panels' that span a fixed fraction of an octave in |Omega|, so
+ * requests may arrive in any order (as they do for adaptive frequency
+ * integrations).
+ *
+ * Error control: each new panel is checked against a full assembly
+ * at the first FI_NUMCHECKS distinct requested frequencies that do
+ * not coincide with an anchor. If the relative (Frobenius-norm) error
+ * exceeds the tolerance, the panel is discarded and subsequent panels
+ * for that block are built at a finer level, chosen from the observed
+ * error assuming the usual (width)^N convergence of N-point
+ * interpolation; blocks that cannot meet the tolerance at the finest
+ * level are simply assembled exactly in that frequency range.
+ *
+ * Blocks coupling surfaces that have since been displaced or rotated
+ * are keyed by a signature of the current surface positions, so
+ * geometrical transformations (as in scuff-cas3D) simply select a
+ * different set of stored panels.
+ *
+ * Only compact geometries are handled; PBC geometries, requests for
+ * derivatives of the BEM matrix, and diagonal blocks of surfaces with
+ * finite surface conductivity (whose local term does not split by
+ * region) always go through the usual assembly path.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <libhmat.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+#define II cdouble(0,1)
+
+// panels at level L span a factor of 2^(1/2^L) in |Omega|
+#define FI_MAXLEVEL 6
+#define FI_NODETOL  1.0e-10
+#define FI_MAXNODES 16
+
+// number of distinct off-anchor frequencies at which each panel
+// is checked against the exact block before it is trusted
+#define FI_NUMCHECKS 2
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+typedef struct FIPanel
+ { int Level;
+   double Index;
+   double tMin, tMax;
+   int NumChecks;      // number of successful checks so far
+   double tChecked;    // |Omega| at the most recent check
+   bool ExactOnly;
+   int NumS;
+   HMatrix **S; // S[nr*N + n] = smooth part of the region-#nr
+                // contribution to the block at anchor #n
+ } FIPanel;
+
+typedef struct FIBlock
+ { int nsa, nsb;
+   int NumRegions;     // number of regions through which Sa, Sb interact
+   int RegionIndices[2];
+   double Signature[18];
+   cdouble Phase;      // Omega / |Omega|
+   int Level;          // level at which new panels are created
+   std::vector<FIPanel *> Panels;
+ } FIBlock;
+
+typedef struct FIBlockStore
+ { std::vector<FIBlock *> Blocks;
+   size_t Bytes;
+   bool WarnedBudget;
+   unsigned long Interpolated, Exact;
+ } FIBlockStore;
+
+double RWGGeometry::FreqInterpTol=0.0;
+int RWGGeometry::FreqInterpNodes=5;
+double RWGGeometry::FreqInterpMaxMB=0.0;
+
+/***************************************************************/
+/* the signature of a block is the list of centroids of three  */
+/* edges on each surface; it changes whenever either surface   */
+/* is moved relative to the other. diagonal blocks are         */
+/* unaffected by rigid motions, so their signature is zero.    */
+/***************************************************************/
+static void GetBlockSignature(RWGGeometry *G, int nsa, int nsb, double Signature[18])
+{
+  memset(Signature, 0, 18*sizeof(double));
+  if (nsa==nsb)
+   return;
+  GetEdgeCentroidSignature(G->Surfaces[nsa], Signature + 0);
+  GetEdgeCentroidSignature(G->Surfaces[nsb], Signature + 9);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static void DestroyFIPanel(FIPanel *P)
+{
+  if (P->S)
+   { for(int n=0; n<P->NumS; n++)
+      if (P->S[n]) delete P->S[n];
+     free(P->S);
+   };
+  free(P);
+}
+
+void DestroyFIBlockStore(void *pStore)
+{
+  FIBlockStore *Store=(FIBlockStore *)pStore;
+  if (!Store) return;
+  for(size_t nb=0; nb<Store->Blocks.size(); nb++)
+   { FIBlock *B=Store->Blocks[nb];
+     for(size_t np=0; np<B->Panels.size(); np++)
+      DestroyFIPanel(B->Panels[np]);
+     delete B;
+   };
+  delete Store;
+}
+
+/***************************************************************/
+/* assemble the exact (nsa,nsb) block into B. if WhichRegion   */
+/* is 0 or 1, only the contribution of the first or second     */
+/* common region is included.                                  */
+/***************************************************************/
+static void AssembleExactBlock(RWGGeometry *G, int nsa, int nsb,
+                               cdouble Omega, HMatrix *B,
+                               int WhichRegion=-1)
+{
+  GetSSIArgStruct GetSSIArgs, *Args=&GetSSIArgs;
+  InitGetSSIArgs(Args);
+  Args->G=G;
+  Args->Sa=G->Surfaces[nsa];
+  Args->Sb=G->Surfaces[nsb];
+  Args->Omega=Omega;
+  Args->Symmetric = (nsa==nsb);
+  Args->OmitRegion1 = (WhichRegion==1);
+  Args->OmitRegion2 = (WhichRegion==0);
+  Args->B=B;
+  GetSurfaceSurfaceInteractions(Args);
+}
+
+/***************************************************************/
+/* multiply (Sign=+1) or divide (Sign=-1) the entries of B by  */
+/* the phase factors exp(i*k*R_{ab}), with k the wavenumber in */
+/* region #nr of the geometry.                                 */
+/***************************************************************/
+static void ApplyPhase(RWGGeometry *G, int nsa, int nsb, int nr,
+                       cdouble Omega, HMatrix *B, int Sign)
+{
+  RWGSurface *Sa=G->Surfaces[nsa], *Sb=G->Surfaces[nsb];
+  cdouble Eps, Mu;
+  G->RegionMPs[nr]->GetEpsMu(Omega, &Eps, &Mu);
+  cdouble ik = ((double)Sign)*II*Omega*sqrt(Eps*Mu);
+
+  int aStride = Sa->IsPEC ? 1 : 2, bStride = Sb->IsPEC ? 1 : 2;
+  for(int nea=0; nea<Sa->NumEdges; nea++)
+   for(int neb=0; neb<Sb->NumEdges; neb++)
+    { cdouble Factor=exp(ik*VecDistance(Sa->Edges[nea]->Centroid,
+                                        Sb->Edges[neb]->Centroid));
+      for(int i=0; i<aStride; i++)
+       for(int j=0; j<bStride; j++)
+        { int nRow=aStride*nea+i, nCol=bStride*neb+j;
+          B->SetEntry(nRow, nCol, Factor*B->GetEntry(nRow,nCol));
+        };
+    };
+}
+
+/***************************************************************/
+/* Chebyshev anchors (points of the first kind) on a panel and */
+/* the barycentric interpolation weights at t; returns the     */
+/* index of the anchor that coincides with t, or -1.           */
+/***************************************************************/
+static double GetAnchor(FIPanel *P, int n, int N)
+{
+  double Mid=0.5*(P->tMax + P->tMin), Half=0.5*(P->tMax - P->tMin);
+  return Mid - Half*cos( (2.0*n+1.0)*M_PI / (2.0*N) );
+}
+
+static int GetWeights(FIPanel *P, int N, double t, double *Lambda)
+{
+  double Sum=0.0;
+  for(int n=0; n<N; n++)
+   { double tn=GetAnchor(P, n, N);
+     if ( fabs(t-tn) < FI_NODETOL*t )
+      return n;
+     double w = ( (n%2) ? -1.0 : 1.0 ) * sin( (2.0*n+1.0)*M_PI / (2.0*N) );
+     Lambda[n] = w / (t-tn);
+     Sum += Lambda[n];
+   };
+  for(int n=0; n<N; n++)
+   Lambda[n]/=Sum;
+  return -1;
+}
+
+/***************************************************************/
+/* evaluate the interpolant on panel P at Omega into B.        */
+/***************************************************************/
+static void Interpolate(RWGGeometry *G, FIBlock *FIB, FIPanel *P,
+                        cdouble Omega, HMatrix *B)
+{
+  int N = RWGGeometry::FreqInterpNodes;
+  double Lambda[FI_MAXNODES];
+  int nAnchor = GetWeights(P, N, abs(Omega), Lambda);
+  int NR=B->NR, NC=B->NC;
+
+  // the contributions of the two regions are interpolated
+  // separately, each with its own phase
+  HMatrix *BR = (FIB->NumRegions==1) ? B : new HMatrix(NR, NC, LHM_COMPLEX);
+  if (BR!=B) B->Zero();
+  for(int ncr=0; ncr<FIB->NumRegions; ncr++)
+   { HMatrix **S = P->S + ncr*N;
+     if (nAnchor!=-1)
+      BR->Copy(S[nAnchor]);
+     else
+      { BR->Zero();
+        for(int n=0; n<N; n++)
+         for(int nc=0; nc<NC; nc++)
+          for(int nr=0; nr<NR; nr++)
+           BR->AddEntry(nr, nc, Lambda[n]*S[n]->GetEntry(nr,nc));
+      };
+     ApplyPhase(G, FIB->nsa, FIB->nsb, FIB->RegionIndices[ncr], Omega, BR, +1);
+     if (BR!=B)
+      for(int nc=0; nc<NC; nc++)
+       for(int nr=0; nr<NR; nr++)
+        B->AddEntry(nr, nc, BR->GetEntry(nr,nc));
+   };
+  if (BR!=B) delete BR;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static double RelativeDifference(HMatrix *A, HMatrix *B)
+{
+  double Diff2=0.0, Norm2=0.0;
+  for(int nr=0; nr<A->NR; nr++)
+   for(int nc=0; nc<A->NC; nc++)
+    { cdouble b=B->GetEntry(nr,nc);
+      Diff2 += norm(A->GetEntry(nr,nc) - b);
+      Norm2 += norm(b);
+    };
+  return Norm2==0.0 ? sqrt(Diff2) : sqrt(Diff2/Norm2);
+}
+
+/***************************************************************/
+/* find or create the panel of FIB covering |Omega|. returns 0 */
+/* if the panel could not be created because the memory budget */
+/* is exhausted.                                               */
+/***************************************************************/
+static FIPanel *GetPanel(RWGGeometry *G, FIBlockStore *Store, FIBlock *FIB,
+                         cdouble Omega, HMatrix *B)
+{
+  double t=abs(Omega);
+
+  // prefer the finest existing panel covering t
+  FIPanel *Best=0;
+  for(size_t np=0; np<FIB->Panels.size(); np++)
+   { FIPanel *P=FIB->Panels[np];
+     if ( P->tMin<=t && t<=P->tMax && (!Best || P->Level>Best->Level) )
+      Best=P;
+   };
+  if (Best) return Best;
+
+  int N = RWGGeometry::FreqInterpNodes;
+  int NumS = N * FIB->NumRegions;
+  size_t PanelBytes = NumS * B->NR * B->NC * sizeof(cdouble);
+  double MaxMB = RWGGeometry::FreqInterpMaxMB;
+  if ( MaxMB>0.0 && (Store->Bytes + PanelBytes) > MaxMB*1048576.0 )
+   { if (!Store->WarnedBudget)
+      Warn("frequency-interpolation store reached %g MB (assembling remaining blocks exactly)",MaxMB);
+     Store->WarnedBudget=true;
+     return 0;
+   };
+
+  FIPanel *P=(FIPanel *)mallocEC(sizeof(FIPanel));
+  P->Level = FIB->Level;
+  double h = M_LN2 / ((double)(1<<P->Level));
+  P->Index = floor( log(t) / h );
+  P->tMin  = exp( P->Index * h );
+  P->tMax  = exp( (P->Index+1.0) * h );
+  P->NumChecks = 0;
+  P->tChecked = 0.0;
+  P->ExactOnly = (FIB->Level > FI_MAXLEVEL);
+  P->NumS = 0;
+  P->S = 0;
+  if (P->ExactOnly)
+   { P->Level=FI_MAXLEVEL;
+     h = M_LN2 / ((double)(1<<FI_MAXLEVEL));
+     P->Index = floor( log(t) / h );
+     P->tMin  = exp( P->Index * h );
+     P->tMax  = exp( (P->Index+1.0) * h );
+   }
+  else
+   { Log("Assembling (%i,%i) block at %i anchors on [%g,%g]",
+          FIB->nsa, FIB->nsb, N, P->tMin, P->tMax);
+     P->NumS=NumS;
+     P->S=(HMatrix **)mallocEC(NumS*sizeof(HMatrix *));
+     for(int ncr=0; ncr<FIB->NumRegions; ncr++)
+      for(int n=0; n<N; n++)
+       { cdouble OmegaN = GetAnchor(P, n, N) * FIB->Phase;
+         HMatrix *S = P->S[ncr*N + n] = new HMatrix(B->NR, B->NC, LHM_COMPLEX);
+         AssembleExactBlock(G, FIB->nsa, FIB->nsb, OmegaN, S,
+                            FIB->NumRegions==1 ? -1 : ncr);
+         ApplyPhase(G, FIB->nsa, FIB->nsb, FIB->RegionIndices[ncr], OmegaN, S, -1);
+       };
+     Store->Bytes += PanelBytes;
+   };
+  FIB->Panels.push_back(P);
+  return P;
+}
+
+/***************************************************************/
+/* entry point called from AssembleBEMMatrixBlock. returns     */
+/* true if the (nsa,nsb) block was stamped into M, or false if */
+/* the caller should assemble it by the usual means.           */
+/***************************************************************/
+bool InterpolateBEMMatrixBlock(RWGGeometry *G, int nsa, int nsb,
+                               cdouble Omega, HMatrix *M,
+                               int RowOffset, int ColOffset)
+{
+  double t=abs(Omega);
+  if (t==0.0 || G->LBasis!=0)
+   return false;
+
+  RWGSurface *Sa=G->Surfaces[nsa], *Sb=G->Surfaces[nsb];
+  int CommonRegionIndices[2];
+  double Signs[2];
+  int NumCommonRegions=CountCommonRegions(Sa, Sb, CommonRegionIndices, Signs);
+  if (NumCommonRegions==0)
+   return false;
+  if (nsa==nsb && Sa->SurfaceZeta!=0)
+   return false;
+
+  /***************************************************************/
+  /* look up the stored block with matching surfaces, position   */
+  /* signature and phase of Omega                                */
+  /***************************************************************/
+  FIBlockStore *Store=(FIBlockStore *)G->FIBlockStore;
+  if (!Store)
+   { Store = new FIBlockStore;
+     Store->Bytes=0;
+     Store->WarnedBudget=false;
+     Store->Interpolated=Store->Exact=0;
+     G->FIBlockStore=(void *)Store;
+   };
+
+  double Signature[18];
+  GetBlockSignature(G, nsa, nsb, Signature);
+  cdouble Phase = Omega / t;
+  FIBlock *FIB=0;
+  for(size_t nb=0; FIB==0 && nb<Store->Blocks.size(); nb++)
+   { FIBlock *B=Store->Blocks[nb];
+     if (    B->nsa==nsa && B->nsb==nsb
+          && abs(B->Phase - Phase) < 1.0e-12
+          && !memcmp(B->Signature, Signature, 18*sizeof(double))
+        ) FIB=B;
+   };
+  if (!FIB)
+   { FIB=new FIBlock;
+     FIB->nsa=nsa;
+     FIB->nsb=nsb;
+     FIB->NumRegions=NumCommonRegions;
+     FIB->RegionIndices[0]=CommonRegionIndices[0];
+     FIB->RegionIndices[1]=CommonRegionIndices[1];
+     memcpy(FIB->Signature, Signature, 18*sizeof(double));
+     FIB->Phase=Phase;
+     FIB->Level=0;
+     Store->Blocks.push_back(FIB);
+   };
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  HMatrix *B = new HMatrix(Sa->NumBFs, Sb->NumBFs, LHM_COMPLEX);
+  FIPanel *P = GetPanel(G, Store, FIB, Omega, B);
+  if (P==0 || P->ExactOnly)
+   { delete B;
+     Store->Exact++;
+     return false;
+   };
+
+  int N = RWGGeometry::FreqInterpNodes;
+  double Lambda[FI_MAXNODES];
+  bool AtAnchor = ( GetWeights(P, N, t, Lambda) != -1 );
+  if ( P->NumChecks>=FI_NUMCHECKS || AtAnchor )
+   { Interpolate(G, FIB, P, Omega, B);
+     Store->Interpolated++;
+   }
+  else
+   {
+     // one of the first off-anchor requests on this panel: check
+     // the interpolant against the exact block
+     HMatrix *BI = new HMatrix(Sa->NumBFs, Sb->NumBFs, LHM_COMPLEX);
+     Interpolate(G, FIB, P, Omega, BI);
+     AssembleExactBlock(G, nsa, nsb, Omega, B);
+     Store->Exact++;
+     double RelErr = RelativeDifference(BI, B);
+     delete BI;
+     if (RelErr <= RWGGeometry::FreqInterpTol)
+      { // a repeated request at the same frequency is no new check
+        if ( P->NumChecks==0 || fabs(t-P->tChecked) > FI_NODETOL*t )
+         { P->NumChecks++;
+           P->tChecked=t;
+         };
+        if (P->NumChecks==FI_NUMCHECKS)
+         Log(" block (%i,%i) interpolant on [%g,%g] validated (rel err %.1e)",
+              nsa, nsb, P->tMin, P->tMax, RelErr);
+      }
+     else
+      { Log(" block (%i,%i) interpolant on [%g,%g] rejected (rel err %.1e); refining",
+             nsa, nsb, P->tMin, P->tMax, RelErr);
+        for(size_t np=0; np<FIB->Panels.size(); np++)
+         if (FIB->Panels[np]==P)
+          FIB->Panels.erase(FIB->Panels.begin() + np);
+        Store->Bytes -= P->NumS * B->NR * B->NC * sizeof(cdouble);
+        // the interpolation error scales like (panel width)^N, so
+        // jump directly to the level expected to meet the tolerance
+        int Jump = (int)ceil( log2(RelErr/RWGGeometry::FreqInterpTol) / N );
+        FIB->Level = P->Level + (Jump<1 ? 1 : Jump);
+        DestroyFIPanel(P);
+      };
+   };
+
+  /***************************************************************/
+  /* stamp the block into M **************************************/
+  /***************************************************************/
+  for(int nr=0; nr<B->NR; nr++)
+   for(int nc=0; nc<B->NC; nc++)
+    M->SetEntry(RowOffset+nr, ColOffset+nc, B->GetEntry(nr,nc));
+  delete B;
+
+  if (G->LogLevel>=SCUFF_VERBOSELOGGING)
+   Log(" frequency-interpolation store: %lu interpolated, %lu exact, %lu MB",
+        Store->Interpolated, Store->Exact, (unsigned long)(Store->Bytes/1048576));
+  return true;
+}
+
+} // namespace scuff
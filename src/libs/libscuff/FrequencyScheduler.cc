@@ -0,0 +1,740 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * FrequencyScheduler.cc -- run several independent frequency points
+ *                       -- of an application code concurrently
+ *
+ * For mid-sized problems the threaded BEM-matrix assembly and the
+ * LAPACK factorization stop scaling well beyond a handful of cores.
+ * Application codes that sweep over a list of frequencies can then
+ * get better throughput by splitting the available threads into
+ * NumGroups groups and handing each group its own frequency point.
+ *
+ * Each group works in its own application workspace (in particular
+ * its own RWGGeometry, since transformations and cached material
+ * properties make geometries stateful); the FIPPI cache is global and
+ * thread-safe and is shared by all groups. Points are handed out in
+ * increasing order as groups become free.
+ *
+ * Output that must appear in frequency order goes through
+ * OpenOutput(), which returns a temporary stream for the given
+ * (point, file) pair. When a point finishes, the output of all points
+ * finished so far without gaps is appended to the real files, so the
+ * output files are the same as those of a serial run.
+ *
+ * With OpenMP, groups run as an outer parallel region with nested
+ * parallelism enabled, and each group sets its own thread count, which
+ * GetNumThreads() then returns inside that group. With pthreads,
+ * GetNumThreads() returns a single global value, which is set to the
+ * per-group thread count for the duration of the run.
+ *
+ * Sharing points between processes (SetWorkDir):
+ *
+ * To spread a sweep over several processes or machines, all of them
+ * are started with the same arguments and the same work directory
+ * on a shared filesystem; one of them is the coordinator, the others
+ * are workers. Points are handed out through lease files in the
+ * work directory:
+ *
+ *  queue                the number of points (checked by every process)
+ *  <n>.lease            created with O_EXCL by the process that claims
+ *                       point n; contains "host pid attempt"
+ *  <n>.<k>.<host>.<pid> output of point n for its k-th output file
+ *  <n>.done             published with link() when point n is finished;
+ *                       lists the output files of the point
+ *  <n>.failed           point n was given up after MaxAttempts leases
+ *  committed            number of points merged by the coordinator
+ *
+ * A lease is considered stale if the holder is a process on this
+ * host that no longer exists, or (if LeaseTimeout>0) if it has not
+ * been renewed for LeaseTimeout seconds; this includes leases whose
+ * holder died before writing them. While a process holds leases, a
+ * background thread renews them every LeaseTimeout/3 seconds, so
+ * LeaseTimeout need not exceed the time taken by a single point.
+ * Stale leases are broken with an atomic rename(); the breaker then
+ * checks that the file it renamed is the stale lease it examined
+ * (and not a lease just taken out by another breaker, or renewed by
+ * its holder), putting it back if not. The point is then handed out
+ * again, up to MaxAttempts times in all. If a reassigned
+ * point is finished twice, the first published result is kept.
+ *
+ * Workers exit when no points are left to claim. The coordinator
+ * waits until every point is done or has failed, appending finished
+ * points to the real output files in point order as it goes; since
+ * the number of points merged so far is recorded in the work
+ * directory, an interrupted coordinator can simply be restarted.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+#  include <pthread.h>
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+namespace scuff {
+
+// seconds the coordinator sleeps while waiting for other processes
+#define FS_POLL_INTERVAL 2
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+FrequencyScheduler::FrequencyScheduler(int pNumPoints, int pNumGroups)
+{
+  NumPoints = pNumPoints;
+  NumGroups = pNumGroups;
+  if (NumGroups>NumPoints) NumGroups=NumPoints;
+  if (NumGroups<1) NumGroups=1;
+#if !defined(USE_OPENMP) && !defined(USE_PTHREAD)
+  NumGroups=1;
+#endif
+
+  ThreadsPerGroup = GetNumThreads() / NumGroups;
+  if (ThreadsPerGroup<1) ThreadsPerGroup=1;
+
+  WorkDir=0;
+  Coordinator=true;
+  LeaseTimeout=FS_DEFAULT_LEASE_TIMEOUT;
+  MaxAttempts=3;
+
+  Task=0;
+  UserData=0;
+  NextPoint=NextCommit=0;
+  Finished=(bool *)mallocEC(NumPoints*sizeof(bool));
+  Held=(bool *)mallocEC(NumPoints*sizeof(bool));
+  Outputs=new std::vector<FSOutput>[NumPoints>0 ? NumPoints : 1];
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  RenewalRunning=StopRenewal=false;
+#endif
+}
+
+FrequencyScheduler::~FrequencyScheduler()
+{
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  if (RenewalRunning)
+   { pthread_mutex_lock(&RenewalMutex);
+     StopRenewal=true;
+     pthread_cond_signal(&RenewalCond);
+     pthread_mutex_unlock(&RenewalMutex);
+     pthread_join(RenewalThread, 0);
+     pthread_cond_destroy(&RenewalCond);
+     pthread_mutex_destroy(&RenewalMutex);
+   };
+#endif
+  for(int nPoint=0; nPoint<NumPoints; nPoint++)
+   for(size_t no=0; no<Outputs[nPoint].size(); no++)
+    { if (Outputs[nPoint][no].f) fclose(Outputs[nPoint][no].f);
+      free(Outputs[nPoint][no].FileName);
+      if (Outputs[nPoint][no].PartName) free(Outputs[nPoint][no].PartName);
+    };
+  delete[] Outputs;
+  free(Finished);
+  free(Held);
+  if (WorkDir) free(WorkDir);
+}
+
+/***************************************************************/
+/* append the contents of stream fSrc to the file FileName     */
+/***************************************************************/
+static void AppendToFile(FILE *fSrc, const char *FileName)
+{
+  char Buffer[65536];
+  FILE *f=fopen(FileName,"a");
+  if (!f)
+   { Warn("could not open file %s (output lost)",FileName);
+     return;
+   };
+  fflush(fSrc);
+  rewind(fSrc);
+  size_t NumBytes;
+  while( (NumBytes=fread(Buffer, 1, 65536, fSrc)) > 0 )
+   fwrite(Buffer, 1, NumBytes, f);
+  fclose(f);
+}
+
+static bool FileExists(const char *FileName)
+{
+  struct stat st;
+  return stat(FileName, &st)==0;
+}
+
+/***************************************************************/
+/* renew our lease on point #nPoint, unless it has been broken */
+/* and handed to another process in the meantime               */
+/***************************************************************/
+void FrequencyScheduler::RenewLease(int nPoint)
+{
+  char LeaseFile[1024], Host[1024]="";
+  int PID=0;
+  snprintf(LeaseFile, 1024, "%s/%i.lease", WorkDir, nPoint);
+  FILE *f=fopen(LeaseFile,"r");
+  if (!f) return;
+  int NumRead=fscanf(f,"%1023s %i",Host,&PID);
+  fclose(f);
+  if ( NumRead==2 && PID==(int)getpid() && !strcmp(Host,GetHostName()) )
+   utime(LeaseFile, 0);
+}
+
+/***************************************************************/
+/* renew all leases held by this process every LeaseTimeout/3  */
+/* seconds until the scheduler is destroyed                    */
+/***************************************************************/
+void FrequencyScheduler::RenewLeases()
+{
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  double Interval = LeaseTimeout / 3.0;
+  pthread_mutex_lock(&RenewalMutex);
+  while(!StopRenewal)
+   { 
+     struct timespec Deadline;
+     clock_gettime(CLOCK_REALTIME, &Deadline);
+     Deadline.tv_sec  += (time_t)Interval;
+     Deadline.tv_nsec += (long)(1.0e9*(Interval - (double)((time_t)Interval)));
+     if (Deadline.tv_nsec >= 1000000000L)
+      { Deadline.tv_sec++;
+        Deadline.tv_nsec -= 1000000000L;
+      };
+     while( !StopRenewal
+            && pthread_cond_timedwait(&RenewalCond, &RenewalMutex, &Deadline)!=ETIMEDOUT )
+      ;
+     if (StopRenewal) break;
+
+     for(int nPoint=0; nPoint<NumPoints; nPoint++)
+      { Lock.read_lock();
+        bool Mine=Held[nPoint];
+        Lock.read_unlock();
+        if (Mine) RenewLease(nPoint);
+      };
+   };
+  pthread_mutex_unlock(&RenewalMutex);
+#endif
+}
+
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+static void *FSRenewalThread(void *data)
+{
+  ((FrequencyScheduler *)data)->RenewLeases();
+  return 0;
+}
+#endif
+
+/***************************************************************/
+/* prepare to share the points with other processes using the  */
+/* same work directory                                         */
+/***************************************************************/
+void FrequencyScheduler::SetWorkDir(const char *pWorkDir,
+                                    bool pCoordinator,
+                                    double pLeaseTimeout)
+{
+  WorkDir=strdupEC(pWorkDir);
+  Coordinator=pCoordinator;
+  LeaseTimeout=pLeaseTimeout;
+
+  if ( mkdir(WorkDir, 0755)!=0 && errno!=EEXIST )
+   ErrExit("could not create work directory %s: %s",WorkDir,strerror(errno));
+
+  // the first process to get here records the number of points;
+  // all others check that they are working on the same list
+  char *QueueFile=vstrdup("%s/queue",WorkDir);
+  int fd=open(QueueFile, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd>=0)
+   { char Line[32];
+     int Len=snprintf(Line, 32, "%i\n", NumPoints);
+     if ( write(fd, Line, Len)!=Len )
+      ErrExit("could not write %s",QueueFile);
+     close(fd);
+   }
+  else
+   { int QueuePoints=-1;
+     FILE *f=0;
+     // the creating process may not have written the count yet
+     for(int Try=0; Try<10 && QueuePoints==-1; Try++)
+      { if ( (f=fopen(QueueFile,"r")) )
+         { if (fscanf(f, "%i", &QueuePoints)!=1) QueuePoints=-1;
+           fclose(f);
+         };
+        if (QueuePoints==-1) sleep(1);
+      };
+     if (QueuePoints!=NumPoints)
+      ErrExit("work directory %s was set up for %i points, not %i",
+               WorkDir,QueuePoints,NumPoints);
+   };
+  free(QueueFile);
+
+  // a restarted coordinator resumes merging where it left off
+  NextCommit=0;
+  if (Coordinator)
+   { FILE *f=vfopen("%s/committed","r",WorkDir);
+     if (f)
+      { if (fscanf(f,"%i",&NextCommit)!=1) NextCommit=0;
+        fclose(f);
+      };
+   };
+
+  Log("Sharing %i points via work directory %s (%s)",
+       NumPoints, WorkDir, Coordinator ? "coordinator" : "worker");
+
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+  if (LeaseTimeout>0.0 && !RenewalRunning)
+   { pthread_mutex_init(&RenewalMutex, 0);
+     pthread_cond_init(&RenewalCond, 0);
+     StopRenewal=false;
+     if ( pthread_create(&RenewalThread, 0, FSRenewalThread, (void *)this) )
+      ErrExit("could not start lease renewal thread");
+     RenewalRunning=true;
+   };
+#endif
+}
+
+/***************************************************************/
+/* read the holder, process ID and attempt number recorded in  */
+/* a lease file, together with its inode and modification      */
+/* time; returns the number of fields read (0 for an empty     */
+/* file), or -1 if the file could not be opened.               */
+/***************************************************************/
+static int ReadLease(const char *FileName, char *Host, int *PID,
+                     int *Attempt, struct stat *st)
+{
+  Host[0]=0;
+  *PID=*Attempt=0;
+  FILE *f=fopen(FileName,"r");
+  if (!f) return -1;
+  int NumRead=-1;
+  if ( fstat(fileno(f), st)==0 )
+   { NumRead=fscanf(f,"%1023s %i %i",Host,PID,Attempt);
+     if (NumRead==EOF) NumRead=0;
+   };
+  fclose(f);
+  return NumRead;
+}
+
+/***************************************************************/
+/* try to take out a lease on point #nPoint, breaking any      */
+/* stale lease on it; returns true if the lease was obtained.  */
+/***************************************************************/
+bool FrequencyScheduler::TryLease(int nPoint)
+{
+  char LeaseFile[1024], DoneFile[1024], FailedFile[1024];
+  snprintf(LeaseFile,  1024, "%s/%i.lease",  WorkDir, nPoint);
+  snprintf(DoneFile,   1024, "%s/%i.done",   WorkDir, nPoint);
+  snprintf(FailedFile, 1024, "%s/%i.failed", WorkDir, nPoint);
+
+  int Attempt=1;
+  for(;;)
+   { 
+     int fd=open(LeaseFile, O_WRONLY | O_CREAT | O_EXCL, 0644);
+     if (fd>=0)
+      { char Line[1024];
+        int Len=snprintf(Line, 1024, "%s %i %i\n",
+                         GetHostName(), (int)getpid(), Attempt);
+        if ( write(fd, Line, Len)!=Len )
+         ErrExit("could not write %s",LeaseFile);
+        close(fd);
+        return true;
+      };
+     if (errno!=EEXIST)
+      ErrExit("could not create %s: %s",LeaseFile,strerror(errno));
+
+     /*--------------------------------------------------------------*/
+     /*- the point is leased; see if the lease is stale. note that  -*/
+     /*- the done file must be checked only after this, since the   -*/
+     /*- holder may have finished the point and exited meanwhile.   -*/
+     /*--------------------------------------------------------------*/
+     char Host[1024];
+     int PID, HolderAttempt;
+     struct stat st;
+     int NumRead=ReadLease(LeaseFile, Host, &PID, &HolderAttempt, &st);
+     if (NumRead<0)
+      return false;
+
+     // a lease that is still empty (or truncated) after LeaseTimeout
+     // seconds belongs to a process that died between creating it
+     // and writing it, and is stale like any other expired lease
+     bool Stale=false;
+     if ( NumRead==3 && !strcmp(Host, GetHostName()) && PID!=(int)getpid() )
+      Stale = ( kill(PID,0)!=0 && errno==ESRCH );
+     if ( LeaseTimeout>0.0 && difftime(time(0), st.st_mtime) > LeaseTimeout )
+      Stale=true;
+     if ( !Stale || FileExists(DoneFile) || FileExists(FailedFile) )
+      return false;
+
+     if (HolderAttempt>=MaxAttempts)
+      { fd=open(FailedFile, O_WRONLY | O_CREAT, 0644);
+        if (fd>=0) close(fd);
+        Warn("giving up on point %i after %i attempts",nPoint,HolderAttempt);
+        return false;
+      };
+
+     // only one of several processes breaking the lease at the
+     // same time succeeds in renaming it. the file it renames may
+     // nonetheless not be the lease examined above: another process
+     // may have broken that lease and taken out a new one of its
+     // own, or the holder may have renewed it, in the meantime. so
+     // the renamed file is compared with the stale lease and put
+     // back if it differs.
+     char *BrokenFile=vstrdup("%s.broken.%s.%i",
+                              LeaseFile, GetHostName(), (int)getpid());
+     bool Broken = ( rename(LeaseFile, BrokenFile)==0 );
+     if (Broken)
+      { char BrokenHost[1024];
+        int BrokenPID, BrokenAttempt;
+        struct stat BrokenSt;
+        int BrokenNumRead=ReadLease(BrokenFile, BrokenHost, &BrokenPID,
+                                    &BrokenAttempt, &BrokenSt);
+        if (    BrokenNumRead!=NumRead
+             || BrokenSt.st_ino!=st.st_ino
+             || BrokenSt.st_mtime!=st.st_mtime
+             || strcmp(BrokenHost, Host)
+             || BrokenPID!=PID
+             || BrokenAttempt!=HolderAttempt
+           )
+         { if ( link(BrokenFile, LeaseFile)!=0 )
+            Warn("could not restore lease on point %i: %s",nPoint,strerror(errno));
+           Broken=false;
+         };
+        unlink(BrokenFile);
+      };
+     free(BrokenFile);
+     if (!Broken)
+      return false;
+     Log("Reassigning point %i (lease of %s:%i is stale)",
+          nPoint, NumRead==3 ? Host : "?", NumRead==3 ? PID : 0);
+     Attempt=HolderAttempt+1;
+   };
+}
+
+/***************************************************************/
+/* return the index of the next point to be processed by the   */
+/* caller, or -1 if there are no points left. in a coordinator */
+/* process, this waits for points being processed by other     */
+/* processes to finish (or be reassigned to the caller).       */
+/***************************************************************/
+int FrequencyScheduler::ClaimPoint()
+{
+  if (!WorkDir)
+   { int nPoint = __sync_fetch_and_add(&NextPoint, 1);
+     return nPoint<NumPoints ? nPoint : -1;
+   };
+
+  char DoneFile[1024], FailedFile[1024];
+  for(;;)
+   { 
+     bool Pending=false;
+     for(int nPoint=0; nPoint<NumPoints; nPoint++)
+      { 
+        Lock.read_lock();
+        bool Skip=Finished[nPoint];
+        Lock.read_unlock();
+        if (Skip) continue;
+
+        snprintf(DoneFile,   1024, "%s/%i.done",   WorkDir, nPoint);
+        snprintf(FailedFile, 1024, "%s/%i.failed", WorkDir, nPoint);
+        bool Claimed = !FileExists(DoneFile) && !FileExists(FailedFile)
+                        && TryLease(nPoint);
+
+        // with several groups, another thread of this process may
+        // have claimed or finished the point in the meantime
+        Lock.write_lock();
+        bool Mine = Claimed && !Finished[nPoint];
+        if (Claimed || FileExists(DoneFile) || FileExists(FailedFile))
+         Finished[nPoint]=true;
+        if (Mine)
+         Held[nPoint]=true;
+        Lock.write_unlock();
+        if (Mine)
+         return nPoint;
+        if (!Finished[nPoint])
+         Pending=true;
+      };
+
+     if (Coordinator)
+      CommitPublishedPoints();
+     if (!Coordinator || !Pending)
+      return -1;
+     sleep(FS_POLL_INTERVAL);
+   };
+}
+
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+FILE *FrequencyScheduler::OpenOutput(int nPoint, const char *FileName)
+{
+  if (nPoint<0 || nPoint>=NumPoints)
+   ErrExit("%s:%i: internal error",__FILE__,__LINE__);
+
+  // only the group processing point #nPoint touches Outputs[nPoint]
+  // before the point is finished, so no locking is needed here
+  std::vector<FSOutput> &O = Outputs[nPoint];
+  for(size_t no=0; no<O.size(); no++)
+   if (!strcmp(O[no].FileName, FileName))
+    return O[no].f;
+
+  FSOutput NewOutput;
+  NewOutput.PartName=0;
+  if (WorkDir)
+   { 
+     RenewLease(nPoint);
+
+     NewOutput.PartName=vstrdup("%i.%i.%s.%i",nPoint,(int)O.size(),
+                                GetHostName(),(int)getpid());
+     NewOutput.f=vfopen("%s/%s","w",WorkDir,NewOutput.PartName);
+   }
+  else
+   NewOutput.f=tmpfile();
+  if (NewOutput.f==0)
+   ErrExit("could not create temporary file for output to %s",FileName);
+  NewOutput.FileName=strdupEC(FileName);
+  O.push_back(NewOutput);
+  return NewOutput.f;
+}
+
+/***************************************************************/
+/* append the deferred output of point #nPoint to its files    */
+/***************************************************************/
+void FrequencyScheduler::CommitPoint(int nPoint)
+{
+  std::vector<FSOutput> &O = Outputs[nPoint];
+  for(size_t no=0; no<O.size(); no++)
+   { AppendToFile(O[no].f, O[no].FileName);
+     fclose(O[no].f);
+     free(O[no].FileName);
+   };
+  O.clear();
+}
+
+/***************************************************************/
+/* make the output of point #nPoint, which has been written to */
+/* files in WorkDir, visible to the coordinator                */
+/***************************************************************/
+void FrequencyScheduler::PublishPoint(int nPoint)
+{
+  std::vector<FSOutput> &O = Outputs[nPoint];
+
+  char *TempFile=vstrdup("%s/%i.done.%s.%i",WorkDir,nPoint,
+                          GetHostName(),(int)getpid());
+  FILE *f=fopen(TempFile,"w");
+  if (!f)
+   ErrExit("could not create %s",TempFile);
+  for(size_t no=0; no<O.size(); no++)
+   { fclose(O[no].f);
+     O[no].f=0;
+     fprintf(f,"%s %s\n",O[no].PartName,O[no].FileName);
+   };
+  fclose(f);
+
+  // link() fails if the point has already been published by a
+  // process that was wrongly presumed dead; its result stands
+  char *DoneFile=vstrdup("%s/%i.done",WorkDir,nPoint);
+  bool Published = (link(TempFile, DoneFile)==0);
+  unlink(TempFile);
+  free(TempFile);
+  free(DoneFile);
+
+  for(size_t no=0; no<O.size(); no++)
+   { if (!Published)
+      { char *PartFile=vstrdup("%s/%s",WorkDir,O[no].PartName);
+        unlink(PartFile);
+        free(PartFile);
+      };
+     free(O[no].PartName);
+     free(O[no].FileName);
+   };
+  O.clear();
+}
+
+/***************************************************************/
+/* (coordinator only) append the output of published points to */
+/* the output files, in point order                            */
+/***************************************************************/
+void FrequencyScheduler::CommitPublishedPoints()
+{
+  Lock.write_lock();
+  int NumCommitted=NextCommit;
+  char Line[2048], PartName[1024], FileName[1024];
+  while( NextCommit<NumPoints )
+   { 
+     char *DoneFile=vstrdup("%s/%i.done",WorkDir,NextCommit);
+     FILE *fDone=fopen(DoneFile,"r");
+     free(DoneFile);
+     if (!fDone)
+      { char *FailedFile=vstrdup("%s/%i.failed",WorkDir,NextCommit);
+        bool Failed=FileExists(FailedFile);
+        free(FailedFile);
+        if (!Failed) break;
+        Warn("no output for point %i (failed repeatedly)",NextCommit);
+        NextCommit++;
+        continue;
+      };
+
+     while( fgets(Line, 2048, fDone) )
+      { if ( sscanf(Line, "%1023s %1023[^\n]", PartName, FileName)!=2 )
+         continue;
+        char *PartFile=vstrdup("%s/%s",WorkDir,PartName);
+        FILE *fPart=fopen(PartFile,"r");
+        if (fPart)
+         { AppendToFile(fPart, FileName);
+           fclose(fPart);
+           unlink(PartFile);
+         }
+        else
+         Warn("output file %s for point %i is missing",PartFile,NextCommit);
+        free(PartFile);
+      };
+     fclose(fDone);
+     NextCommit++;
+   };
+
+  if (NextCommit>NumCommitted)
+   { char *TempFile=vstrdup("%s/committed.tmp",WorkDir);
+     char *CommittedFile=vstrdup("%s/committed",WorkDir);
+     FILE *f=fopen(TempFile,"w");
+     if (f)
+      { fprintf(f,"%i\n",NextCommit);
+        fclose(f);
+        rename(TempFile, CommittedFile);
+      };
+     free(TempFile);
+     free(CommittedFile);
+   };
+  Lock.write_unlock();
+}
+
+/***************************************************************/
+/* mark point #nPoint finished and write out the output of all */
+/* points that are now finished with no unfinished predecessor */
+/***************************************************************/
+void FrequencyScheduler::FinishPoint(int nPoint)
+{
+  if (WorkDir)
+   { PublishPoint(nPoint);
+     Lock.write_lock();
+     Held[nPoint]=false;
+     Lock.write_unlock();
+     if (Coordinator)
+      CommitPublishedPoints();
+     return;
+   };
+
+  Lock.write_lock();
+  Finished[nPoint]=true;
+  while( NextCommit<NumPoints && Finished[NextCommit] )
+   CommitPoint(NextCommit++);
+  Lock.write_unlock();
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void FrequencyScheduler::RunGroup(int nGroup)
+{
+  int nPoint;
+  while( (nPoint=ClaimPoint()) != -1 )
+   { Task(UserData, nGroup, nPoint);
+     FinishPoint(nPoint);
+   };
+}
+
+#ifdef USE_PTHREAD
+typedef struct FSThreadData
+ { FrequencyScheduler *FS;
+   int nGroup;
+ } FSThreadData;
+
+static void *FSThread(void *data)
+{
+  FSThreadData *TD=(FSThreadData *)data;
+  TD->FS->RunGroup(TD->nGroup);
+  return 0;
+}
+#endif
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void FrequencyScheduler::Run(FSTask pTask, void *pUserData)
+{
+  Task=pTask;
+  UserData=pUserData;
+
+  Log("Processing %i frequency points in %i groups of %i threads",
+       NumPoints, NumGroups, ThreadsPerGroup);
+
+  if (NumGroups==1)
+   RunGroup(0);
+  else
+   { 
+#ifdef USE_OPENMP
+     int SavedLevels=omp_get_max_active_levels();
+     if (SavedLevels<2)
+      omp_set_max_active_levels(2);
+#pragma omp parallel num_threads(NumGroups)
+      { omp_set_num_threads(ThreadsPerGroup);
+        RunGroup(omp_get_thread_num());
+      }
+     omp_set_max_active_levels(SavedLevels);
+#elif defined(USE_PTHREAD)
+     int SavedThreads=GetNumThreads();
+     SetNumThreads(ThreadsPerGroup);
+     pthread_t *Threads = new pthread_t[NumGroups];
+     FSThreadData *TDs  = new FSThreadData[NumGroups];
+     for(int nGroup=0; nGroup<NumGroups; nGroup++)
+      { TDs[nGroup].FS=this;
+        TDs[nGroup].nGroup=nGroup;
+        pthread_create( &(Threads[nGroup]), 0, FSThread, (void *)(TDs + nGroup));
+      };
+     for(int nGroup=0; nGroup<NumGroups; nGroup++)
+      pthread_join(Threads[nGroup],0);
+     delete[] TDs;
+     delete[] Threads;
+     SetNumThreads(SavedThreads);
+#endif
+   };
+
+  // groups of the coordinator may have stopped waiting while other
+  // groups were still busy with the last points
+  if (WorkDir && Coordinator)
+   CommitPublishedPoints();
+}
+
+} // namespace scuff
@@ -31,6 +31,13 @@
 
 #include "GBarAccelerator.h"
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
 #define II cdouble(0,1)
 
 namespace scuff{
@@ -101,6 +108,102 @@ void GBarVDPhi3D(double X1, double X2, double X3, void *UserData, double *PhiVD)
 
 } 
 
+/***************************************************************/
+/* Tabulation of GBar on the uniform grid of a 3D table. The   */
+/* grid points are handed to GBarVDEwaldMany in batches, each  */
+/* batch consisting of a few rows of points at the same height */
+/* z=X3, which share most of the reciprocal-space work, and    */
+/* the batches are distributed over threads (unless we are     */
+/* already inside a parallel region, as when frequency groups  */
+/* run concurrently, in which case the calling thread does all */
+/* the batches itself). The Interp3D constructor then reads    */
+/* the values back from the table via GBarVDPhi3DTable, which  */
+/* is called with exactly the grid coordinates                 */
+/* X_{i}Min + n_{i}*DX_{i} that were tabulated.                */
+/***************************************************************/
+typedef struct GBarTable3D
+ { double XMin[3], DX[3];
+   int N[3];
+   cdouble *GBarVD; // GBarVD[8*( (n1*N2 + n2)*N3 + n3 ) + ns]
+ } GBarTable3D;
+
+static void GetGBarTable3D(GBarAccelerator *GBA, GBarTable3D *Table,
+                           double X1Min, double X1Max, int N1,
+                           double X2Min, double X2Max, int N2,
+                           double X3Min, double X3Max, int N3)
+{
+  Table->XMin[0]=X1Min; Table->DX[0]=(X1Max-X1Min)/((double)(N1-1)); Table->N[0]=N1;
+  Table->XMin[1]=X2Min; Table->DX[1]=(X2Max-X2Min)/((double)(N2-1)); Table->N[1]=N2;
+  Table->XMin[2]=X3Min; Table->DX[2]=(X3Max-X3Min)/((double)(N3-1)); Table->N[2]=N3;
+  Table->GBarVD = (cdouble *)mallocEC(8*N1*N2*N3*sizeof(cdouble));
+
+  // split each plane of constant X3 into enough chunks of rows
+  // to keep all threads busy
+  int NumThreads = GetNumThreads();
+#ifdef USE_OPENMP
+  if (omp_in_parallel()) NumThreads=1;
+#endif
+  int NumChunks = (4*NumThreads + N3 - 1) / N3;
+  if (NumChunks>N1) NumChunks=N1;
+  int RowsPerChunk = (N1 + NumChunks - 1) / NumChunks;
+  NumChunks = (N1 + RowsPerChunk - 1) / RowsPerChunk;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nb=0; nb<N3*NumChunks; nb++)
+   { 
+     int n3  = nb / NumChunks;
+     int n1a = (nb % NumChunks) * RowsPerChunk;
+     int n1b = n1a + RowsPerChunk;
+     if (n1b>N1) n1b=N1;
+     int NR = (n1b-n1a)*N2;
+
+     double *R = new double[3*NR];
+     cdouble *GBarVD = new cdouble[8*NR];
+     for(int n1=n1a, nr=0; n1<n1b; n1++)
+      for(int n2=0; n2<N2; n2++, nr++)
+       { R[3*nr + 0] = X1Min + n1*Table->DX[0];
+         R[3*nr + 1] = X2Min + n2*Table->DX[1];
+         R[3*nr + 2] = X3Min + n3*Table->DX[2];
+       };
+
+     GBarVDEwaldMany(R, NR, GBA->k, GBA->kBloch, GBA->LBV, GBA->LDim,
+                     -1.0, GBA->ExcludeInnerCells, GBarVD);
+
+     for(int n1=n1a, nr=0; n1<n1b; n1++)
+      for(int n2=0; n2<N2; n2++, nr++)
+       memcpy(Table->GBarVD + 8*((n1*N2 + n2)*N3 + n3), GBarVD + 8*nr,
+              8*sizeof(cdouble));
+
+     delete[] R;
+     delete[] GBarVD;
+   };
+}
+
+void GBarVDPhi3DTable(double X1, double X2, double X3, void *UserData, double *PhiVD)
+{
+  GBarTable3D *Table = (GBarTable3D *)UserData;
+
+  double X[3];
+  X[0]=X1;
+  X[1]=X2;
+  X[2]=X3;
+  int n[3];
+  for(int i=0; i<3; i++)
+   { n[i] = (int)lround( (X[i] - Table->XMin[i]) / Table->DX[i] );
+     if (n[i]<0 || n[i]>=Table->N[i])
+      ErrExit("%s:%i: internal error (point not in table)",__FILE__,__LINE__);
+   };
+
+  int N2=Table->N[1], N3=Table->N[2];
+  cdouble *GBarVD = Table->GBarVD + 8*((n[0]*N2 + n[1])*N3 + n[2]);
+  for(int ns=0; ns<8; ns++)
+   { PhiVD[ns]   = real(GBarVD[ns]);
+     PhiVD[8+ns] = imag(GBarVD[ns]);
+   };
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -278,7 +381,7 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
                                        double RhoMin, double RhoMax,
                                        cdouble k, double *kBloch,
                                        double RelTol, bool ExcludeInnerCells,
-                                       int LMDILogLevel)
+                                       int LMDILogLevel, GBAGrid *Grid)
 {
   CheckLattice(LBasis);
 
@@ -330,51 +433,76 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
   if (GBA->ForceFullEwald)
    return GBA;
 
+  /***************************************************************/
+  /* if the caller passed a grid chosen for an earlier call with */
+  /* the same lattice, wavenumber, and range of Rho, we can skip */
+  /* straight to tabulating GBar                                 */
+  /***************************************************************/
+  GBAGrid LocalGrid;
+  if (Grid==0)
+   { LocalGrid.nx=0;
+     LocalGrid.RhoPoints=0;
+     Grid=&LocalGrid;
+   };
+  bool HaveGrid = (Grid->nx > 0);
+
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
   if (LDim==1)
    {
-      // sample the optimal grid spacing at a few points
-      // in the domain of interest and take the smallest
-      double L0 = GBA->LBV[0][0], MinDelta[2], Delta[2];
-      if ( L0 > LMax )
-       { L0=LMax;
-         Log("  Cutting off interpolation table at L=LMax=%e.",LMax);
-       };
-      GetOptimalGridSpacing1D(GBA,  0.0*L0, RhoMin, RelTol, MinDelta, 0);
-      GetOptimalGridSpacing1D(GBA, -0.5*L0, RhoMin, RelTol, Delta, MinDelta);
-      GetOptimalGridSpacing1D(GBA,  0.0*L0, RhoMax, RelTol, Delta, MinDelta);
-      GetOptimalGridSpacing1D(GBA, -0.5*L0, RhoMax, RelTol, Delta, MinDelta);
-
-      double DeltaX = MinDelta[0];
-      int nx = ceil( L0 / DeltaX );
-      if (nx<2) nx=2;
-      DeltaX = L0 / ((double)(nx-1));
+     if (!HaveGrid)
+      { 
+        // sample the optimal grid spacing at a few points
+        // in the domain of interest and take the smallest
+        double L0 = GBA->LBV[0][0], MinDelta[2], Delta[2];
+        if ( L0 > LMax )
+         { L0=LMax;
+           Log("  Cutting off interpolation table at L=LMax=%e.",LMax);
+         };
+        GetOptimalGridSpacing1D(GBA,  0.0*L0, RhoMin, RelTol, MinDelta, 0);
+        GetOptimalGridSpacing1D(GBA, -0.5*L0, RhoMin, RelTol, Delta, MinDelta);
+        GetOptimalGridSpacing1D(GBA,  0.0*L0, RhoMax, RelTol, Delta, MinDelta);
+        GetOptimalGridSpacing1D(GBA, -0.5*L0, RhoMax, RelTol, Delta, MinDelta);
+
+        int nx = ceil( L0 / MinDelta[0] );
+        if (nx<2) nx=2;
+
+        #define MAXRHOPOINTS 1000
+        double *RhoPoints = (double *)mallocEC((MAXRHOPOINTS+2)*sizeof(double));
+        double MinDeltaRho = (RhoMax-RhoMin) / MAXRHOPOINTS;
+        RhoPoints[0]=RhoMin;
+        int nRho=0;
+        bool Done=false;
+        while(!Done)
+         { 
+           double Rho = RhoPoints[nRho];
+           GetOptimalGridSpacing1D(GBA,  0.0*L0, Rho, RelTol, MinDelta, 0);
+           GetOptimalGridSpacing1D(GBA, -0.5*L0, Rho, RelTol, Delta, MinDelta);
+           double DeltaRho = fmax(MinDeltaRho,MinDelta[1]);
+           if (Rho + DeltaRho >= RhoMax || nRho==MAXRHOPOINTS)
+            { DeltaRho = RhoMax - Rho;
+              Done=true;
+            };
+           RhoPoints[++nRho] = Rho + DeltaRho;
+         };
+        nRho++; 
+
+        Grid->nx        = nx;
+        Grid->Lx        = L0;
+        Grid->nRho      = nRho;
+        Grid->RhoMax    = RhoMax;
+        Grid->RhoPoints = RhoPoints;
+      };
+
+      int nx = Grid->nx, nRho=Grid->nRho;
+      double L0 = Grid->Lx;
+      double *RhoPoints = Grid->RhoPoints;
+      double DeltaX = L0 / ((double)(nx-1));
       double *XPoints = new double[nx];
       for(int n=0; n<nx; n++)
        XPoints[n] = ((double)n)*DeltaX - 0.5*L0;
 
-      #define MAXRHOPOINTS 1000
-      double RhoPoints[MAXRHOPOINTS];
-      double MinDeltaRho = (RhoMax-RhoMin) / MAXRHOPOINTS;
-      RhoPoints[0]=RhoMin;
-      int nRho=0;
-      bool Done=false;
-      while(!Done)
-       { 
-         double Rho = RhoPoints[nRho];
-         GetOptimalGridSpacing1D(GBA,  0.0*L0, Rho, RelTol, MinDelta, 0);
-         GetOptimalGridSpacing1D(GBA, -0.5*L0, Rho, RelTol, Delta, MinDelta);
-         double DeltaRho = fmax(MinDeltaRho,MinDelta[1]);
-         if (Rho + DeltaRho >= RhoMax)
-          { DeltaRho = RhoMax - Rho;
-            Done=true;
-          };
-         RhoPoints[++nRho] = Rho + DeltaRho;
-       };
-      nRho++; 
-
       Log("  Initializing %ix%i interpolation table with ",nx,nRho);
       Log("  X points at [%g:%g:%g] ",0.0,DeltaX,L0);
       Log("  Rho points at (");
@@ -387,54 +515,75 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
                             2, GBarVDPhi2D, (void *)GBA, LMDILogLevel);
 
       delete[] XPoints;
+      if (Grid==&LocalGrid)
+       free(LocalGrid.RhoPoints);
 
    }
   else // LDim==2
    {
-      double Lx = GBA->LBV[0][0], Ly=GBA->LBV[1][1];
-      if ( LMax<Lx ) 
-       { Lx=LMax;
-         Log("  Cutting off interpolation table at Lx=LMax=%e.",LMax);
-       };
-      if ( LMax<Ly ) 
-       { Ly=LMax;
-         Log("  Cutting off interpolation table at Ly=LMax=%e.",LMax);
-       };
+     if (!HaveGrid)
+      {
+        double Lx = GBA->LBV[0][0], Ly=GBA->LBV[1][1];
+        if ( LMax<Lx ) 
+         { Lx=LMax;
+           Log("  Cutting off interpolation table at Lx=LMax=%e.",LMax);
+         };
+        if ( LMax<Ly ) 
+         { Ly=LMax;
+           Log("  Cutting off interpolation table at Ly=LMax=%e.",LMax);
+         };
 
-      // estimate the optimal grid spacings at a few points
-      // in the domain of interest and take the smallest
-      double MinDelta[3], Delta[3];
-      GetOptimalGridSpacing2D(GBA,  0.0*Lx,  0.0*Ly, RhoMin, RelTol, MinDelta, 0);
-      GetOptimalGridSpacing2D(GBA,  0.0*Lx, -0.5*Ly, RhoMin, RelTol, Delta, MinDelta);
-      GetOptimalGridSpacing2D(GBA, -0.5*Lx,  0.0*Ly, RhoMin, RelTol, Delta, MinDelta);
-      GetOptimalGridSpacing2D(GBA, -0.5*Lx, -0.5*Ly, RhoMin, RelTol, Delta, MinDelta);
-      if (RhoMax!=RhoMin)
-       { GetOptimalGridSpacing2D(GBA,  0.0*Lx,  0.0*Ly, RhoMax, RelTol, Delta, MinDelta);
-         GetOptimalGridSpacing2D(GBA,  0.0*Lx, -0.5*Ly, RhoMax, RelTol, Delta, MinDelta);
-         GetOptimalGridSpacing2D(GBA, -0.5*Lx,  0.0*Ly, RhoMax, RelTol, Delta, MinDelta);
-         GetOptimalGridSpacing2D(GBA, -0.5*Lx, -0.5*Ly, RhoMax, RelTol, Delta, MinDelta);
-       };
+        // estimate the optimal grid spacings at a few points
+        // in the domain of interest and take the smallest
+        double MinDelta[3], Delta[3];
+        GetOptimalGridSpacing2D(GBA,  0.0*Lx,  0.0*Ly, RhoMin, RelTol, MinDelta, 0);
+        GetOptimalGridSpacing2D(GBA,  0.0*Lx, -0.5*Ly, RhoMin, RelTol, Delta, MinDelta);
+        GetOptimalGridSpacing2D(GBA, -0.5*Lx,  0.0*Ly, RhoMin, RelTol, Delta, MinDelta);
+        GetOptimalGridSpacing2D(GBA, -0.5*Lx, -0.5*Ly, RhoMin, RelTol, Delta, MinDelta);
+        if (RhoMax!=RhoMin)
+         { GetOptimalGridSpacing2D(GBA,  0.0*Lx,  0.0*Ly, RhoMax, RelTol, Delta, MinDelta);
+           GetOptimalGridSpacing2D(GBA,  0.0*Lx, -0.5*Ly, RhoMax, RelTol, Delta, MinDelta);
+           GetOptimalGridSpacing2D(GBA, -0.5*Lx,  0.0*Ly, RhoMax, RelTol, Delta, MinDelta);
+           GetOptimalGridSpacing2D(GBA, -0.5*Lx, -0.5*Ly, RhoMax, RelTol, Delta, MinDelta);
+         };
 
-      int nx   = ceil( Lx / MinDelta[0] );
-      if (nx<2) nx=2;
+        int nx   = ceil( Lx / MinDelta[0] );
+        if (nx<2) nx=2;
 
-      int ny   = ceil( Ly / MinDelta[1] );
-      if (ny<2) ny=2;
+        int ny   = ceil( Ly / MinDelta[1] );
+        if (ny<2) ny=2;
 
-      int nRho; 
-      if (RhoMax<=RhoMin)
-       { RhoMax = RhoMin + MinDelta[0];
-         nRho=2;
-       }
-      else
-       { nRho = ceil( (RhoMax-RhoMin) / MinDelta[1] );
-         if (nRho<2) nRho=2;
-       };
+        int nRho; 
+        if (RhoMax<=RhoMin)
+         { RhoMax = RhoMin + MinDelta[0];
+           nRho=2;
+         }
+        else
+         { nRho = ceil( (RhoMax-RhoMin) / MinDelta[1] );
+           if (nRho<2) nRho=2;
+         };
+
+        Grid->nx        = nx;
+        Grid->ny        = ny;
+        Grid->nRho      = nRho;
+        Grid->Lx        = Lx;
+        Grid->Ly        = Ly;
+        Grid->RhoMax    = RhoMax;
+        Grid->RhoPoints = 0;
+      };
 
+      double Lx=Grid->Lx, Ly=Grid->Ly;
+      GBarTable3D Table;
+      GetGBarTable3D(GBA, &Table,
+                     -0.5*Lx, 0.5*Lx, Grid->nx,
+                     -0.5*Ly, 0.5*Ly, Grid->ny,
+                     RhoMin, Grid->RhoMax, Grid->nRho);
       GBA->I2D=0;
-      GBA->I3D=new Interp3D(-0.5*Lx, 0.5*Lx, nx, -0.5*Ly, 0.5*Ly, ny,
-                            RhoMin, RhoMax, nRho,
-                            2, GBarVDPhi3D, (void *)GBA, LMDILogLevel);
+      GBA->I3D=new Interp3D(-0.5*Lx, 0.5*Lx, Grid->nx,
+                            -0.5*Ly, 0.5*Ly, Grid->ny,
+                            RhoMin, Grid->RhoMax, Grid->nRho,
+                            2, GBarVDPhi3DTable, (void *)&Table, LMDILogLevel);
+      free(Table.GBarVD);
    };
 
   return GBA;
@@ -446,6 +595,10 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
 /***************************************************************/
 void DestroyGBarAccelerator(GBarAccelerator *GBA)
 { 
+  if (GBA->Pooled)
+   { ReleasePooledGBarAccelerator(GBA);
+     return;
+   };
   if (GBA->I2D) delete GBA->I2D;
   if (GBA->I3D) delete GBA->I3D;
   free(GBA);
@@ -514,7 +667,26 @@ cdouble GetGBarFullEwald(double R[3], GBarAccelerator *GBA,
   int LDim               = GBA->LDim;
   bool ExcludeInnerCells = GBA->ExcludeInnerCells;
 
-  GBarVDEwald(R, k, kBloch, GBA->LBV, LDim, -1.0, ExcludeInnerCells, G);
+  // if unmixed second partials are requested, the 6 displaced
+  // points used to finite-difference them are evaluated together
+  // with R in a single batch
+  double RR[7][3];
+  cdouble GG[7][8];
+  double Delta[3];
+  if (ddGBar)
+   { for(int Mu=0; Mu<3; Mu++)
+      Delta[Mu] = (R[Mu]==0.0) ? 1.0e-4 : 1.0e-4*fabs(R[Mu]);
+     for(int np=0; np<7; np++)
+      { RR[np][0]=R[0]; RR[np][1]=R[1]; RR[np][2]=R[2];
+        if (np>0) 
+         RR[np][(np-1)/2] += ( (np%2) ? 1.0 : -1.0 ) * Delta[(np-1)/2];
+      };
+     GBarVDEwaldMany(RR[0], 7, k, kBloch, GBA->LBV, LDim, -1.0,
+                     ExcludeInnerCells, GG[0]);
+     memcpy(G, GG[0], 8*sizeof(cdouble));
+   }
+  else
+   GBarVDEwald(R, k, kBloch, GBA->LBV, LDim, -1.0, ExcludeInnerCells, G);
 
   if (dGBar) 
    { dGBar[0]=G[1];
@@ -531,19 +703,8 @@ cdouble GetGBarFullEwald(double R[3], GBarAccelerator *GBA,
      // finite-differencing to get unmixed second partials
      for(int Mu=0; Mu<3; Mu++)
       { 
-         double Delta = (R[Mu]==0.0) ? 1.0e-4 : 1.0e-4*fabs(R[Mu]);
-         double RR[3];
-         RR[0]=R[0]; RR[1]=R[1]; RR[2]=R[2]; 
-
-         RR[Mu] += Delta;
-         cdouble Gp[8];
-         GBarVDEwald(RR, k, kBloch, GBA->LBV, LDim, -1.0, ExcludeInnerCells, Gp);
-
-         RR[Mu] -= 2.0*Delta;
-         cdouble Gm[8];
-         GBarVDEwald(RR, k, kBloch, GBA->LBV, LDim, -1.0, ExcludeInnerCells, Gm);
-
-         ddGBar[3*Mu + Mu] = (Gp[0] + Gm[0] - 2.0*G[0]) / (Delta*Delta);
+         cdouble Gp = GG[1+2*Mu][0], Gm = GG[2+2*Mu][0];
+         ddGBar[3*Mu + Mu] = (Gp + Gm - 2.0*G[0]) / (Delta[Mu]*Delta[Mu]);
       };
 
    };
@@ -557,66 +718,84 @@ cdouble GetGBarFullEwald(double R[3], GBarAccelerator *GBA,
 bool InM101(int x) { return (-1<=x) && (x<=1); }
 
 /***************************************************************/
+/* classify the evaluation point R with respect to the         */
+/* interpolation table of a 1D or 2D accelerator:              */
+/*                                                             */
+/*  GBACELL_EWALD:  there is no table, or the transverse       */
+/*                  coordinate Rho lies outside it; GBar must  */
+/*                  be computed by full Ewald summation.       */
+/*                                                             */
+/*  GBACELL_ZERO:   the image of R in the Wigner-Seitz cell    */
+/*                  lies outside the table, and GBar is taken  */
+/*                  to vanish.                                 */
+/*                                                             */
+/*  GBACELL_INTERP: GBar may be interpolated. On return, m[]   */
+/*                  are the lattice indices of the translation */
+/*                  that takes R into the Wigner-Seitz cell,   */
+/*                  and XBar[] are the table coordinates       */
+/*                  (xBar, Rho) (1D) or (xBar, yBar, Rho) (2D) */
+/*                  of the translated point.                   */
 /***************************************************************/
+#define GBACELL_EWALD  0
+#define GBACELL_ZERO   1
+#define GBACELL_INTERP 2
+static int GetGBarCell(double R[3], GBarAccelerator *GBA,
+                       int m[2], double *XBar)
+{
+  if (GBA->LDim==1)
+   { 
+     double Rho = sqrt(R[1]*R[1] + R[2]*R[2]);
+     if (GBA->I2D==0 || Rho<GBA->RhoMin || Rho>GBA->RhoMax)
+      return GBACELL_EWALD;
+
+     double L0 = GBA->LBV[0][0];
+     m[0] = (int)(lround( R[0] / L0 ));
+     XBar[0] = R[0] - m[0]*L0;
+     XBar[1] = Rho;
+     return fabs(XBar[0])>GBA->LMax ? GBACELL_ZERO : GBACELL_INTERP;
+   };
+
+  double Rho = fabs(R[2]);
+  if (GBA->I3D==0 || Rho<GBA->RhoMin || Rho>GBA->RhoMax)
+   return GBACELL_EWALD;
+
+  if (GBA->LBV[0][1]!=0.0 || GBA->LBV[1][0]!=0.0)
+   ErrExit("%s:%i: non-square lattice not yet supported",__FILE__,__LINE__);
+
+  double L0x = GBA->LBV[0][0];
+  m[0] = (int)(lround( R[0] / L0x ));
+  XBar[0] = R[0] - m[0]*L0x;
+
+  double L0y = GBA->LBV[1][1];
+  m[1] = (int)(lround( R[1] / L0y ));
+  XBar[1] = R[1] - m[1]*L0y;
+
+  XBar[2] = Rho;
+
+  if ( fabs(XBar[0])>GBA->LMax || fabs(XBar[1])>GBA->LMax )
+   return GBACELL_ZERO;
+  return GBACELL_INTERP;
+}
+
 /***************************************************************/
-cdouble GetGBar_1D(double R[3], GBarAccelerator *GBA,
-                   cdouble *dGBar, cdouble *ddGBar)
+/* given the interpolated values GVD = {G, dG/dx, dG/dRho,     */
+/* d2G/dx2, d2G/dxdRho, d2G/dRho2} at the image (xBar, Rho) of */
+/* R in the Wigner-Seitz cell of a 1D lattice, translated by m */
+/* lattice vectors, return GBar(R) and its derivatives.        */
+/***************************************************************/
+static cdouble GetGBarFromCell_1D(double R[3], GBarAccelerator *GBA,
+                                  int m, double xBar, double Rho,
+                                  cdouble GVD[6],
+                                  cdouble *dGBar, cdouble *ddGBar)
 {
   cdouble k              = GBA->k;
   double *kBloch         = GBA->kBloch;
   bool ExcludeInnerCells = GBA->ExcludeInnerCells;
+  double L0              = GBA->LBV[0][0];
+  double Rho2            = Rho*Rho;
 
-  /*--------------------------------------------------------------*/
-  /* if we have no interpolation grid, or we have one but the     */
-  /* transverse coordinate lies outside it, or if the caller      */
-  /* requested that we do the calculation directly, then we just  */
-  /* do the calculation directly via Ewald summation, skipping    */
-  /* the interpolation step                                       */
-  /*--------------------------------------------------------------*/
-  double Rho2 = R[1]*R[1] + R[2]*R[2];
-  double Rho = sqrt(Rho2);
-  if (GBA->I2D==0 || Rho<GBA->RhoMin || Rho>GBA->RhoMax)
-   return GetGBarFullEwald(R, GBA, dGBar, ddGBar);
-
-  /*--------------------------------------------------------------*/
-  /* get xBar, which is the periodic image of the x-coordinate    */
-  /* lying within the Wigner-Seitz cell of the 1D lattice         */
-  /*--------------------------------------------------------------*/
-  double L0 = GBA->LBV[0][0];
-  int m = (int)(lround( R[0] / L0 ));
-  double xBar = R[0] - m*L0;
-
-  if ( fabs(xBar) > GBA->LMax )
-   { if (dGBar) memset(dGBar, 0, 3*sizeof(cdouble));
-     if (ddGBar) memset(ddGBar, 0, 9*sizeof(cdouble));
-     return 0.0;
-   };
-
-  /*--------------------------------------------------------------*/
-  /* get GBar(xBar, Rho) and as many derivatives as necessary     */
-  /*--------------------------------------------------------------*/
-  cdouble G, dGdx=0, dGdRho=0.0, d2Gdx2=0.0, d2GdxdRho=0.0, d2GdRho2=0.0;
-  if (ddGBar)
-   { 
-     double Phi[12];
-     GBA->I2D->EvaluatePlusPlus(xBar, Rho, Phi);
-     G         = cdouble(Phi[0], Phi[ 6]);
-     dGdx      = cdouble(Phi[1], Phi[ 7]);
-     dGdRho    = cdouble(Phi[2], Phi[ 8]);
-     d2Gdx2    = cdouble(Phi[3], Phi[ 9]);
-     d2GdxdRho = cdouble(Phi[4], Phi[10]);
-     d2GdRho2  = cdouble(Phi[5], Phi[11]);
-   }
-  else if (dGBar)
-   { 
-     double Phi[8];
-     GBA->I2D->EvaluatePlus(xBar, Rho, Phi);
-     G         = cdouble(Phi[0], Phi[4]);
-     dGdx      = cdouble(Phi[1], Phi[5]);
-     dGdRho    = cdouble(Phi[2], Phi[6]);
-   }
-  else
-   GBA->I2D->Evaluate(xBar, Rho, (double *)&G);
+  cdouble G=GVD[0], dGdx=GVD[1], dGdRho=GVD[2];
+  cdouble d2Gdx2=GVD[3], d2GdxdRho=GVD[4], d2GdRho2=GVD[5];
 
   /*--------------------------------------------------------------*/
   /* correct for the fact that we may have needed to              */
@@ -700,13 +879,9 @@ cdouble GetGBar_1D(double R[3], GBarAccelerator *GBA,
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
-cdouble GetGBar_2D(double R[3], GBarAccelerator *GBA,
+cdouble GetGBar_1D(double R[3], GBarAccelerator *GBA,
                    cdouble *dGBar, cdouble *ddGBar)
 {
-  cdouble k              = GBA->k;
-  double *kBloch         = GBA->kBloch;
-  bool ExcludeInnerCells = GBA->ExcludeInnerCells;
-
   /*--------------------------------------------------------------*/
   /* if we have no interpolation grid, or we have one but the     */
   /* transverse coordinate lies outside it, or if the caller      */
@@ -714,61 +889,68 @@ cdouble GetGBar_2D(double R[3], GBarAccelerator *GBA,
   /* do the calculation directly via Ewald summation, skipping    */
   /* the interpolation step                                       */
   /*--------------------------------------------------------------*/
-  double Rho = fabs(R[2]);
-  if (GBA->I3D==0 || Rho<GBA->RhoMin || Rho>GBA->RhoMax)
+  int m[2];
+  double XBar[2];
+  int Cell=GetGBarCell(R, GBA, m, XBar);
+  if (Cell==GBACELL_EWALD)
    return GetGBarFullEwald(R, GBA, dGBar, ddGBar);
- 
-  /*--------------------------------------------------------------*/
-  /* get (xBar, yBar) = representative of (x,y) in the Wigner-    */
-  /* Seitz cell                                                   */
-  /*--------------------------------------------------------------*/
-  if (GBA->LBV[0][1]!=0.0 || GBA->LBV[1][0]!=0.0)
-   ErrExit("%s:%i: non-square lattice not yet supported",__FILE__,__LINE__);
-  
-  double L0x = GBA->LBV[0][0];
-  int mx = (int)(lround( R[0] / L0x ));
-  double xBar = R[0] - mx*L0x;
 
-  double L0y = GBA->LBV[1][1];
-  int my = (int)(lround( R[1] / L0y ));
-  double yBar = R[1] - my*L0y;
-
-  if ( fabs(xBar)>GBA->LMax || fabs(yBar)>GBA->LMax )
+  if (Cell==GBACELL_ZERO)
    { if (dGBar) memset(dGBar, 0, 3*sizeof(cdouble));
      if (ddGBar) memset(ddGBar, 0, 9*sizeof(cdouble));
      return 0.0;
    };
 
+  double xBar=XBar[0], Rho=XBar[1];
+
   /*--------------------------------------------------------------*/
-  /* get GBar(RBar, Rho) and as many derivatives as necessary     */
+  /* get GBar(xBar, Rho) and as many derivatives as necessary     */
   /*--------------------------------------------------------------*/
-  cdouble GBar;
+  cdouble G, dGdx=0, dGdRho=0.0, d2Gdx2=0.0, d2GdxdRho=0.0, d2GdRho2=0.0;
   if (ddGBar)
    { 
-     double Phi[20];
-     GBA->I3D->EvaluatePlusPlus(xBar, yBar, Rho, Phi);
-     GBar            = cdouble(Phi[0], Phi[10]);
-     dGBar[0]        = cdouble(Phi[1], Phi[11]);
-     dGBar[1]        = cdouble(Phi[2], Phi[12]);
-     dGBar[2]        = cdouble(Phi[3], Phi[13]);
-     ddGBar[3*0 + 0] = cdouble(Phi[4], Phi[14]);
-     ddGBar[3*0 + 1] = cdouble(Phi[5], Phi[15]);
-     ddGBar[3*0 + 2] = cdouble(Phi[6], Phi[16]);
-     ddGBar[3*1 + 1] = cdouble(Phi[7], Phi[17]);
-     ddGBar[3*1 + 2] = cdouble(Phi[8], Phi[18]);
-     ddGBar[3*2 + 2] = cdouble(Phi[9], Phi[19]);
+     double Phi[12];
+     GBA->I2D->EvaluatePlusPlus(xBar, Rho, Phi);
+     G         = cdouble(Phi[0], Phi[ 6]);
+     dGdx      = cdouble(Phi[1], Phi[ 7]);
+     dGdRho    = cdouble(Phi[2], Phi[ 8]);
+     d2Gdx2    = cdouble(Phi[3], Phi[ 9]);
+     d2GdxdRho = cdouble(Phi[4], Phi[10]);
+     d2GdRho2  = cdouble(Phi[5], Phi[11]);
    }
   else if (dGBar)
    { 
-     double Phi[16];
-     GBA->I3D->EvaluatePlus(xBar, yBar, Rho, Phi);
-     GBar      = cdouble(Phi[0], Phi[8]);
-     dGBar[0]  = cdouble(Phi[1], Phi[9]);
-     dGBar[1]  = cdouble(Phi[2], Phi[10]);
-     dGBar[2]  = cdouble(Phi[3], Phi[11]);
+     double Phi[8];
+     GBA->I2D->EvaluatePlus(xBar, Rho, Phi);
+     G         = cdouble(Phi[0], Phi[4]);
+     dGdx      = cdouble(Phi[1], Phi[5]);
+     dGdRho    = cdouble(Phi[2], Phi[6]);
    }
   else
-   GBA->I3D->Evaluate(xBar, yBar, Rho, (double *)&GBar);
+   GBA->I2D->Evaluate(xBar, Rho, (double *)&G);
+
+  cdouble GVD[6]={G, dGdx, dGdRho, d2Gdx2, d2GdxdRho, d2GdRho2};
+  return GetGBarFromCell_1D(R, GBA, m[0], xBar, Rho, GVD, dGBar, ddGBar);
+}
+
+/***************************************************************/
+/* given the interpolated value GBar and derivatives dGBar     */
+/* (with respect to x, y, Rho) at the image (xBar, yBar, Rho)  */
+/* of R in the Wigner-Seitz cell of a 2D lattice, translated   */
+/* by (mx, my) lattice vectors, return GBar(R) and convert the */
+/* derivatives in place to those of GBar(R).                   */
+/***************************************************************/
+static cdouble GetGBarFromCell_2D(double R[3], GBarAccelerator *GBA,
+                                  int mx, int my,
+                                  double xBar, double yBar, double Rho,
+                                  cdouble GBar,
+                                  cdouble *dGBar, cdouble *ddGBar)
+{
+  cdouble k              = GBA->k;
+  double *kBloch         = GBA->kBloch;
+  bool ExcludeInnerCells = GBA->ExcludeInnerCells;
+  double L0x             = GBA->LBV[0][0];
+  double L0y             = GBA->LBV[1][1];
 
   /*--------------------------------------------------------------*/
   /* correct for the fact that we may have needed to              */
@@ -835,6 +1017,69 @@ cdouble GetGBar_2D(double R[3], GBarAccelerator *GBA,
   
 }
 
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+cdouble GetGBar_2D(double R[3], GBarAccelerator *GBA,
+                   cdouble *dGBar, cdouble *ddGBar)
+{
+  /*--------------------------------------------------------------*/
+  /* if we have no interpolation grid, or we have one but the     */
+  /* transverse coordinate lies outside it, or if the caller      */
+  /* requested that we do the calculation directly, then we just  */
+  /* do the calculation directly via Ewald summation, skipping    */
+  /* the interpolation step. otherwise get (xBar, yBar) =         */
+  /* representative of (x,y) in the Wigner-Seitz cell             */
+  /*--------------------------------------------------------------*/
+  int m[2];
+  double XBar[3];
+  int Cell=GetGBarCell(R, GBA, m, XBar);
+  if (Cell==GBACELL_EWALD)
+   return GetGBarFullEwald(R, GBA, dGBar, ddGBar);
+
+  if (Cell==GBACELL_ZERO)
+   { if (dGBar) memset(dGBar, 0, 3*sizeof(cdouble));
+     if (ddGBar) memset(ddGBar, 0, 9*sizeof(cdouble));
+     return 0.0;
+   };
+
+  double xBar=XBar[0], yBar=XBar[1], Rho=XBar[2];
+
+  /*--------------------------------------------------------------*/
+  /* get GBar(RBar, Rho) and as many derivatives as necessary     */
+  /*--------------------------------------------------------------*/
+  cdouble GBar;
+  if (ddGBar)
+   { 
+     double Phi[20];
+     GBA->I3D->EvaluatePlusPlus(xBar, yBar, Rho, Phi);
+     GBar            = cdouble(Phi[0], Phi[10]);
+     dGBar[0]        = cdouble(Phi[1], Phi[11]);
+     dGBar[1]        = cdouble(Phi[2], Phi[12]);
+     dGBar[2]        = cdouble(Phi[3], Phi[13]);
+     ddGBar[3*0 + 0] = cdouble(Phi[4], Phi[14]);
+     ddGBar[3*0 + 1] = cdouble(Phi[5], Phi[15]);
+     ddGBar[3*0 + 2] = cdouble(Phi[6], Phi[16]);
+     ddGBar[3*1 + 1] = cdouble(Phi[7], Phi[17]);
+     ddGBar[3*1 + 2] = cdouble(Phi[8], Phi[18]);
+     ddGBar[3*2 + 2] = cdouble(Phi[9], Phi[19]);
+   }
+  else if (dGBar)
+   { 
+     double Phi[16];
+     GBA->I3D->EvaluatePlus(xBar, yBar, Rho, Phi);
+     GBar      = cdouble(Phi[0], Phi[8]);
+     dGBar[0]  = cdouble(Phi[1], Phi[9]);
+     dGBar[1]  = cdouble(Phi[2], Phi[10]);
+     dGBar[2]  = cdouble(Phi[3], Phi[11]);
+   }
+  else
+   GBA->I3D->Evaluate(xBar, yBar, Rho, (double *)&GBar);
+
+  return GetGBarFromCell_2D(R, GBA, m[0], m[1], xBar, yBar, Rho,
+                            GBar, dGBar, ddGBar);
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -862,6 +1107,85 @@ cdouble GetGBar(double R[3], GBarAccelerator *GBA,
    return GetGBar_2D(R, GBA, dGBar, ddGBar);
 }
 
+/***************************************************************/
+/* batched version of GetGBar() for callers that need GBar and */
+/* its first derivatives at many points: the points are        */
+/* R[3*nr + 0..2], and on return GBar[nr] and dGBar[3*nr+0..2] */
+/* are the results for point nr, nr=0..NR-1.                   */
+/*                                                             */
+/* The points are processed in groups of GBARBATCH; the points */
+/* of each group that lie within the interpolation table are   */
+/* handed to the interpolator in a single EvaluatePlusMany()   */
+/* call, and the remainder are treated as in GetGBar().        */
+/***************************************************************/
+#define GBARBATCH 32
+void GetGBarMany(double *R, int NR, GBarAccelerator *GBA,
+                 cdouble *GBar, cdouble *dGBar, bool ForceFullEwald)
+{
+  if (ForceFullEwald || GBA->ForceFullEwald)
+   { for(int nr=0; nr<NR; nr++)
+      GBar[nr]=GetGBarFullEwald(R+3*nr, GBA, dGBar+3*nr, 0);
+     return;
+   };
+
+  int NDim = (GBA->LDim==1) ?  2 :  3; // table coordinates per point
+  int NPhi = (GBA->LDim==1) ?  8 : 16; // EvaluatePlusMany outputs per point
+  for(int nr0=0; nr0<NR; nr0+=GBARBATCH)
+   { 
+     /*--------------------------------------------------------------*/
+     /* sort the points of this group into those we interpolate and  */
+     /* those we handle directly                                     */
+     /*--------------------------------------------------------------*/
+     int NB=0, Index[GBARBATCH], m[2*GBARBATCH];
+     double XBar[3*GBARBATCH];
+     int nrMax = (nr0+GBARBATCH < NR) ? nr0+GBARBATCH : NR;
+     for(int nr=nr0; nr<nrMax; nr++)
+      { int Cell=GetGBarCell(R+3*nr, GBA, m+2*NB, XBar+NDim*NB);
+        if (Cell==GBACELL_INTERP)
+         Index[NB++]=nr;
+        else if (Cell==GBACELL_EWALD)
+         GBar[nr]=GetGBarFullEwald(R+3*nr, GBA, dGBar+3*nr, 0);
+        else
+         { GBar[nr]=0.0;
+           for(int Mu=0; Mu<3; Mu++) dGBar[3*nr+Mu]=0.0;
+         };
+      };
+     if (NB==0) continue;
+
+     /*--------------------------------------------------------------*/
+     /* interpolate at all remaining points at once, then translate  */
+     /* the results back from the Wigner-Seitz cell                  */
+     /*--------------------------------------------------------------*/
+     double Phi[16*GBARBATCH];
+     if (GBA->LDim==1)
+      GBA->I2D->EvaluatePlusMany(XBar, NB, Phi);
+     else
+      GBA->I3D->EvaluatePlusMany(XBar, NB, Phi);
+
+     for(int nb=0; nb<NB; nb++)
+      { int nr=Index[nb];
+        double *P=Phi + NPhi*nb, *X=XBar + NDim*nb;
+        if (GBA->LDim==1)
+         { cdouble GVD[6];
+           GVD[0] = cdouble(P[0], P[4]);
+           GVD[1] = cdouble(P[1], P[5]);
+           GVD[2] = cdouble(P[2], P[6]);
+           GVD[3] = GVD[4] = GVD[5] = 0.0;
+           GBar[nr]=GetGBarFromCell_1D(R+3*nr, GBA, m[2*nb], X[0], X[1],
+                                       GVD, dGBar+3*nr, 0);
+         }
+        else
+         { dGBar[3*nr+0] = cdouble(P[1], P[ 9]);
+           dGBar[3*nr+1] = cdouble(P[2], P[10]);
+           dGBar[3*nr+2] = cdouble(P[3], P[11]);
+           GBar[nr]=GetGBarFromCell_2D(R+3*nr, GBA, m[2*nb], m[2*nb+1],
+                                       X[0], X[1], X[2], cdouble(P[0], P[8]),
+                                       dGBar+3*nr, 0);
+         };
+      };
+   };
+}
+
 /***************************************************************/
 /* Create a GBar accelerator suitable for computing GBar at    */
 /* points R in the three-dimensional box with corners RMin and */
@@ -975,6 +1299,10 @@ GBarAccelerator *RWGGeometry::CreateRegionGBA(int nr, cdouble Omega, double *kBl
   int LMDILogLevel = LMDI_LOGLEVEL_TERSE;
   if (LogLevel>=SCUFF_VERBOSE2)
    LMDILogLevel = LMDI_LOGLEVEL_VERBOSE;
+  if (GBAPoolEnabled())
+   return GetPooledGBarAccelerator(GBA_LBasis, RhoMin, RhoMax,
+                                   k, kBloch, LDim, RelTol, ExcludeInnerCells,
+                                   LMDILogLevel);
   return CreateGBarAccelerator(GBA_LBasis, RhoMin, RhoMax,
                                k, kBloch, RelTol, ExcludeInnerCells,
                                LMDILogLevel);
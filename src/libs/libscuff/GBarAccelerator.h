@@ -39,6 +39,12 @@ void GBarVDEwald(double *R, cdouble k, double *kBloch,
                  double (*LBV)[3], int LDim,
                  double E, bool ExcludeInnerCells, cdouble *GBarVD);
 
+// batched version: the points are R[3*nr + 0..2] and on return
+// GBarVD[8*nr + 0..7] are the results for point nr, nr=0..NR-1
+void GBarVDEwaldMany(double *R, int NR, cdouble k, double *kBloch,
+                     double (*LBV)[3], int LDim,
+                     double E, bool ExcludeInnerCells, cdouble *GBarVD);
+
 /***************************************************************/
 /* interpolation-based acceleration of periodic GF evaluation  */
 /***************************************************************/
@@ -57,8 +63,29 @@ typedef struct GBarAccelerator
    Interp2D *I2D;
    Interp3D *I3D;
 
+   // accelerators handed out by the pool (GBarAcceleratorPool.cc)
+   // keep their own copy of kBloch and are returned to the pool,
+   // not freed, by DestroyGBarAccelerator
+   bool Pooled;
+   double kBlochBuffer[3];
+
  } GBarAccelerator;
 
+/***************************************************************/
+/* the grid on which an accelerator tabulates GBar. choosing   */
+/* it requires sampling the interpolation error at a few       */
+/* points; the choice depends only weakly on kBloch, so it is  */
+/* reused for all bloch vectors at a given frequency.          */
+/***************************************************************/
+typedef struct GBAGrid
+ { 
+   int nx, ny, nRho;       // nx==0 if the grid has not been chosen
+   double Lx, Ly;
+   double RhoMax;
+   double *RhoPoints;      // nRho points, 1D lattices only
+
+ } GBAGrid;
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -66,14 +93,35 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
                                        double RhoMin, double RhoMax,
                                        cdouble k, double *kBloch,
                                        double RelTol, bool ExcludeInnerCells,
-                                       int LMDILogLevel=LMDI_LOGLEVEL_TERSE);
+                                       int LMDILogLevel=LMDI_LOGLEVEL_TERSE,
+                                       GBAGrid *Grid=0);
 
 void DestroyGBarAccelerator(GBarAccelerator *GBA);
 
+/***************************************************************/
+/* pool of accelerators shared among calls with the same       */
+/* lattice, wavenumber, bloch vector and range of Rho          */
+/* (GBarAcceleratorPool.cc)                                    */
+/***************************************************************/
+GBarAccelerator *GetPooledGBarAccelerator(HMatrix *LBasis,
+                                          double RhoMin, double RhoMax,
+                                          cdouble k, double *kBloch, int kBlochDim,
+                                          double RelTol, bool ExcludeInnerCells,
+                                          int LMDILogLevel=LMDI_LOGLEVEL_TERSE);
+void ReleasePooledGBarAccelerator(GBarAccelerator *GBA);
+bool GBAPoolEnabled();
+
 cdouble GetGBar(double R[3], GBarAccelerator *GBA,
                 cdouble *dGBar=0, cdouble *ddGBar=0,
                 bool ForceFullEwald=false);
 
+// batched version for GBar and its first derivatives: the points
+// are R[3*nr + 0..2] and on return GBar[nr], dGBar[3*nr + 0..2]
+// are the results for point nr, nr=0..NR-1
+void GetGBarMany(double *R, int NR, GBarAccelerator *GBA,
+                 cdouble *GBar, cdouble *dGBar,
+                 bool ForceFullEwald=false);
+
 } // namespace scuff 
 
 #endif // #ifndef GBARACCELERATOR_H
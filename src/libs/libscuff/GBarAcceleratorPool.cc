@@ -0,0 +1,329 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * GBarAcceleratorPool.cc -- reuse of GBarAccelerator interpolation
+ *                        -- tables and grid choices
+ *
+ * AssembleBEMMatrixBlock(), GetRFMatrix(), and the field-evaluation
+ * routines create a GBarAccelerator for each region and each call,
+ * and destroy it when they are done. Building an accelerator means
+ * sampling the interpolation error to choose a grid (a few dozen
+ * full Ewald sums) and then tabulating GBar on that grid (thousands
+ * of them), which for Brillouin-zone integrations with many bloch
+ * vectors per frequency is a large fraction of the total run time.
+ *
+ * RWGGeometry::CreateRegionGBA() therefore obtains its accelerators
+ * from a pool, which keeps
+ *
+ *  (a) the tables themselves, keyed by lattice basis, wavenumber,
+ *      bloch vector, Rho range, tolerance and ExcludeInnerCells,
+ *      so that e.g. the several BEM matrix blocks with the same
+ *      surface-pair bounding box, or the BEM matrix and a
+ *      subsequent field evaluation, share one table;
+ *
+ *  (b) the grids chosen for each key with the bloch vector omitted,
+ *      so that only the first of the bloch vectors at a given
+ *      frequency pays for the error sampling.
+ *
+ * Tables that are not in use are freed in least-recently-used order
+ * when the pool exceeds SCUFF_GBA_POOL_MB megabytes (default 256).
+ * Setting SCUFF_GBA_POOL_MB=0 disables the pool, in which case each
+ * call creates its own accelerator with its own choice of grid, as
+ * before.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <string>
+#include <list>
+#include <map>
+#include <set>
+
+#include <libhmat.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+#include "GBarAccelerator.h"
+
+namespace scuff {
+
+#define GBAPOOL_DEFAULTMB 256.0
+#define GBAPOOL_MAXGRIDS  1000
+
+/***************************************************************/
+/* a pooled accelerator                                        */
+/***************************************************************/
+typedef struct GBAPoolEntry
+ { std::string Key;
+   GBarAccelerator *GBA;
+   size_t Bytes;
+   int RefCount;
+ } GBAPoolEntry;
+
+static size_t GBABytes(GBarAccelerator *GBA)
+{
+  size_t Bytes=sizeof(GBarAccelerator);
+  if (GBA->I2D)
+   Bytes += ((size_t)GBA->I2D->N1 - 1) * ((size_t)GBA->I2D->N2 - 1)
+            * GBA->I2D->nFun * 16 * sizeof(double);
+  if (GBA->I3D)
+   Bytes += ((size_t)GBA->I3D->N1 - 1) * ((size_t)GBA->I3D->N2 - 1)
+            * ((size_t)GBA->I3D->N3 - 1) * GBA->I3D->nFun * 64 * sizeof(double);
+  return Bytes;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+class GBAPool
+ {
+  public:
+    GBAPool();
+
+    GBarAccelerator *Get(const std::string &GridKey,
+                         const std::string &Key,
+                         HMatrix *LBasis, double RhoMin, double RhoMax,
+                         cdouble k, double *kBloch, int kBlochDim,
+                         double RelTol, bool ExcludeInnerCells,
+                         int LMDILogLevel);
+    void Release(GBarAccelerator *GBA);
+    size_t GetMaxBytes();
+
+    double BudgetMB;     // <0 means default
+
+  private:
+    void Trim();
+
+    // all of the following are protected by Mutex
+    std::map<std::string, std::list<GBAPoolEntry *>::iterator> Index;
+    std::map<GBarAccelerator *, GBAPoolEntry *> InUse; // all entries, by GBA
+    std::list<GBAPoolEntry *> LRU;   // most recently used first
+    std::map<std::string, GBAGrid> Grids;
+    std::set<std::string> Building;
+    size_t Bytes;
+    pthread_mutex_t Mutex;
+    pthread_cond_t BuildDone;
+ };
+
+GBAPool::GBAPool()
+{
+  BudgetMB=-1.0;
+  Bytes=0;
+  pthread_mutex_init(&Mutex, 0);
+  pthread_cond_init(&BuildDone, 0);
+}
+
+static GBAPool GlobalGBAPool;
+
+void SetGBAPoolBudget(double MegaBytes)
+{
+  GlobalGBAPool.BudgetMB = MegaBytes;
+}
+
+size_t GBAPool::GetMaxBytes()
+{
+  double MB = (BudgetMB<0.0) ? GBAPOOL_DEFAULTMB : BudgetMB;
+  return (size_t)(MB*1048576.0);
+}
+
+bool GBAPoolEnabled()
+{
+  return GlobalGBAPool.GetMaxBytes() > 0;
+}
+
+/***************************************************************/
+/* free unused tables, oldest first, until the pool fits in    */
+/* its budget; the caller must hold Mutex                      */
+/***************************************************************/
+void GBAPool::Trim()
+{
+  size_t MaxBytes=GetMaxBytes();
+  std::list<GBAPoolEntry *>::iterator it=LRU.end();
+  while( Bytes>MaxBytes && it!=LRU.begin() )
+   { --it;
+     GBAPoolEntry *E=*it;
+     if (E->RefCount>0)
+      continue;
+     it=LRU.erase(it);
+     Index.erase(E->Key);
+     InUse.erase(E->GBA);
+     Bytes-=E->Bytes;
+     E->GBA->Pooled=false;
+     DestroyGBarAccelerator(E->GBA);
+     delete E;
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+GBarAccelerator *GBAPool::Get(const std::string &GridKey,
+                              const std::string &Key,
+                              HMatrix *LBasis, double RhoMin, double RhoMax,
+                              cdouble k, double *kBloch, int kBlochDim,
+                              double RelTol, bool ExcludeInnerCells,
+                              int LMDILogLevel)
+{
+  pthread_mutex_lock(&Mutex);
+
+  // wait for another thread that is building the same table
+  while( Building.count(Key) )
+   pthread_cond_wait(&BuildDone, &Mutex);
+
+  std::map<std::string, std::list<GBAPoolEntry *>::iterator>::iterator
+   it=Index.find(Key);
+  if (it!=Index.end())
+   { LRU.splice(LRU.begin(), LRU, it->second);
+     GBAPoolEntry *E=*(it->second);
+     E->RefCount++;
+     pthread_mutex_unlock(&Mutex);
+     if (LMDILogLevel>=LMDI_LOGLEVEL_VERBOSE)
+      Log("Reusing GBar accelerator %s",Key.c_str());
+     return E->GBA;
+   };
+
+  // the grid is copied out of the map, RhoPoints included, since
+  // another thread may clear the map while we build the table
+  GBAGrid Grid;
+  Grid.nx=0;
+  Grid.RhoPoints=0;
+  std::map<std::string, GBAGrid>::iterator git=Grids.find(GridKey);
+  bool HaveGrid = (git!=Grids.end());
+  if (HaveGrid)
+   { Grid=git->second;
+     if (Grid.RhoPoints)
+      { double *RhoPoints=(double *)mallocEC(Grid.nRho*sizeof(double));
+        memcpy(RhoPoints, Grid.RhoPoints, Grid.nRho*sizeof(double));
+        Grid.RhoPoints=RhoPoints;
+      };
+   };
+
+  Building.insert(Key);
+  pthread_mutex_unlock(&Mutex);
+
+  if (HaveGrid && LMDILogLevel>=LMDI_LOGLEVEL_VERBOSE)
+   Log("Reusing GBar accelerator grid %s",GridKey.c_str());
+  GBarAccelerator *GBA=CreateGBarAccelerator(LBasis, RhoMin, RhoMax, k, kBloch,
+                                             RelTol, ExcludeInnerCells,
+                                             LMDILogLevel, &Grid);
+
+  // the pooled accelerator may outlive the caller's kBloch array
+  for(int n=0; n<kBlochDim && n<3; n++)
+   GBA->kBlochBuffer[n]=kBloch[n];
+  GBA->kBloch=GBA->kBlochBuffer;
+  GBA->Pooled=true;
+
+  GBAPoolEntry *E=new GBAPoolEntry;
+  E->Key=Key;
+  E->GBA=GBA;
+  E->Bytes=GBABytes(GBA);
+  E->RefCount=1;
+
+  pthread_mutex_lock(&Mutex);
+  if (!HaveGrid && Grid.nx>0)
+   { if (Grids.size() >= GBAPOOL_MAXGRIDS)
+      { for(git=Grids.begin(); git!=Grids.end(); git++)
+         if (git->second.RhoPoints) free(git->second.RhoPoints);
+        Grids.clear();
+      };
+     Grids[GridKey]=Grid;
+   }
+  else if (Grid.RhoPoints)
+   free(Grid.RhoPoints);
+  LRU.push_front(E);
+  Index[Key]=LRU.begin();
+  InUse[GBA]=E;
+  Bytes+=E->Bytes;
+  Trim();
+  Building.erase(Key);
+  pthread_cond_broadcast(&BuildDone);
+  pthread_mutex_unlock(&Mutex);
+
+  return GBA;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void GBAPool::Release(GBarAccelerator *GBA)
+{
+  pthread_mutex_lock(&Mutex);
+  std::map<GBarAccelerator *, GBAPoolEntry *>::iterator it=InUse.find(GBA);
+  if (it==InUse.end())
+   ErrExit("%s:%i: internal error (unknown GBar accelerator)",__FILE__,__LINE__);
+  it->second->RefCount--;
+  Trim();
+  pthread_mutex_unlock(&Mutex);
+}
+
+/***************************************************************/
+/* keys under which tables and grids are filed                 */
+/***************************************************************/
+static std::string GetGBAKey(HMatrix *LBasis, double RhoMin, double RhoMax,
+                             cdouble k, double *kBloch, int kBlochDim,
+                             double RelTol, bool ExcludeInnerCells)
+{
+  char Buffer[100];
+  std::string Key;
+  for(int nc=0; nc<LBasis->NC; nc++)
+   for(int j=0; j<3; j++)
+    { snprintf(Buffer,100,"%.16e_",LBasis->GetEntryD(j,nc));
+      Key+=Buffer;
+    };
+  snprintf(Buffer,100,"R%.16e_%.16e_",RhoMin,RhoMax);
+  Key+=Buffer;
+  snprintf(Buffer,100,"k%.16e_%.16e_",real(k),imag(k));
+  Key+=Buffer;
+  snprintf(Buffer,100,"T%.6e_%i",RelTol,ExcludeInnerCells ? 1 : 0);
+  Key+=Buffer;
+  for(int n=0; n<kBlochDim; n++)
+   { snprintf(Buffer,100,"_P%.16e",kBloch[n]);
+     Key+=Buffer;
+   };
+  return Key;
+}
+
+/***************************************************************/
+/* entry points                                                */
+/***************************************************************/
+GBarAccelerator *GetPooledGBarAccelerator(HMatrix *LBasis,
+                                          double RhoMin, double RhoMax,
+                                          cdouble k, double *kBloch, int kBlochDim,
+                                          double RelTol, bool ExcludeInnerCells,
+                                          int LMDILogLevel)
+{
+  std::string GridKey=GetGBAKey(LBasis, RhoMin, RhoMax, k, kBloch, 0,
+                                RelTol, ExcludeInnerCells);
+  std::string Key=GetGBAKey(LBasis, RhoMin, RhoMax, k, kBloch, kBlochDim,
+                            RelTol, ExcludeInnerCells);
+  return GlobalGBAPool.Get(GridKey, Key, LBasis, RhoMin, RhoMax, k,
+                           kBloch, kBlochDim, RelTol, ExcludeInnerCells,
+                           LMDILogLevel);
+}
+
+void ReleasePooledGBarAccelerator(GBarAccelerator *GBA)
+{
+  GlobalGBAPool.Release(GBA);
+}
+
+} // namespace scuff
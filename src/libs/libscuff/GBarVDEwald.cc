@@ -290,6 +290,27 @@ void GetEEF(double z, double E, cdouble Q, cdouble *EEF, cdouble *EEFPrime)
 
 }
 
+/***************************************************************/
+/* the part of AddGLong2D that remains once the R-independent  */
+/* quantities PmG and Q, the phase factor exp(i*PmG*R), and    */
+/* the exp*erfc factors (which depend on R only through R[2])  */
+/* have been computed.                                         */
+/***************************************************************/
+static void AddGLong2DTerm(double PmG[2], cdouble Q, cdouble Phase,
+                           cdouble EEF, cdouble EEFPrime, cdouble *GBarVD)
+{ 
+  cdouble PreFactor = Phase / Q;
+
+  GBarVD[0] += PreFactor * EEF;
+  GBarVD[1] += II*PmG[0]*PreFactor*EEF;
+  GBarVD[2] += II*PmG[1]*PreFactor*EEF;
+  GBarVD[3] += PreFactor*EEFPrime;
+  GBarVD[4] += -PmG[0]*PmG[1]*PreFactor*EEF;
+  GBarVD[5] += II*PmG[0]*PreFactor*EEFPrime;
+  GBarVD[6] += II*PmG[1]*PreFactor*EEFPrime;
+  GBarVD[7] += -PmG[0]*PmG[1]*PreFactor*EEFPrime;
+}
+
 /***************************************************************/
 /* add the contribution of a single reciprocal-lattice vector  */
 /* G = n1*Gamma1 + n2*Gamma2 to the reciprocal-lattice sum     */
@@ -300,26 +321,17 @@ void AddGLong2D(double R[3], cdouble k, double P[2],
                 double E, cdouble *GBarVD)
 { 
   double PmG[2];
-  cdouble PreFactor, Q, EEF, EEFPrime;
+  cdouble Q, EEF, EEFPrime;
    
   PmG[0] = P[0] - n1*Gamma[0][0] - n2*Gamma[1][0];
   PmG[1] = P[1] - n1*Gamma[0][1] - n2*Gamma[1][1];
 
   Q = sqrt ( PmG[0]*PmG[0] + PmG[1]*PmG[1] - k*k );
 
-  PreFactor = exp( II * (PmG[0]*R[0] + PmG[1]*R[1]) ) / Q;
-
   GetEEF(R[2], E, Q, &EEF, &EEFPrime);
 
-  GBarVD[0] += PreFactor * EEF;
-  GBarVD[1] += II*PmG[0]*PreFactor*EEF;
-  GBarVD[2] += II*PmG[1]*PreFactor*EEF;
-  GBarVD[3] += PreFactor*EEFPrime;
-  GBarVD[4] += -PmG[0]*PmG[1]*PreFactor*EEF;
-  GBarVD[5] += II*PmG[0]*PreFactor*EEFPrime;
-  GBarVD[6] += II*PmG[1]*PreFactor*EEFPrime;
-  GBarVD[7] += -PmG[0]*PmG[1]*PreFactor*EEFPrime;
-
+  AddGLong2DTerm(PmG, Q, exp( II * (PmG[0]*R[0] + PmG[1]*R[1]) ),
+                 EEF, EEFPrime, GBarVD);
 }
 
 /*****************************************************/
@@ -607,6 +619,9 @@ void AddGFull(double R[3], cdouble k, double kBloch[2],
 /* where g4 = (-4E/sqrt(pi)) * exp( -(E)^2R^2 + k^2/(4(E)^2).  */
 /*                                                             */
 /***************************************************************/
+static void AddGShortTerm(double *R, cdouble k, double L[2],
+                          cdouble PhaseFactor, double E, cdouble *Sum);
+
 void AddGShort(double *R, cdouble k, double *kBloch,
                int n1, int n2, double (*LBV)[3], int LDim,
                double E, cdouble *Sum)
@@ -634,6 +649,16 @@ void AddGShort(double *R, cdouble k, double *kBloch,
 
   cdouble PhaseFactor=exp( II * (kBloch[0]*L[0] + kBloch[1]*L[1]) ) / (8.0*M_PI);
 
+  AddGShortTerm(R, k, L, PhaseFactor, E, Sum);
+}
+
+/***************************************************************/
+/* the part of AddGShort that depends on R, given the lattice  */
+/* vector L and PhaseFactor = exp(i kBloch*L) / (8*pi).        */
+/***************************************************************/
+static void AddGShortTerm(double *R, cdouble k, double L[2],
+                          cdouble PhaseFactor, double E, cdouble *Sum)
+{
   double RmL[3], rml2, rml, rml3, rml4, rml5, rml6, rml7;
   cdouble g2p, g3p, g2m, g3m, g4, ggPgg, ggMgg, Term;
 
@@ -958,4 +983,304 @@ void GBarVDEwald(double *R, cdouble k, double *kBloch,
 
 } 
 
+/***************************************************************/
+/* Batched version of GBarVDEwald: on return, GBarVD[8*nr + ns]*/
+/* is GBarVD[ns] for the point R[3*nr + 0..2], nr=0..NR-1.     */
+/*                                                             */
+/* The real-space and reciprocal-space sums run over the same  */
+/* lattice vectors, in the same order, as for a single point,  */
+/* and each point stops accumulating once it has converged, so */
+/* the results agree with NR separate calls to GBarVDEwald.    */
+/* What is shared among the points is                          */
+/*                                                             */
+/*  (a) the lattice vector L and bloch phase exp(i kBloch*L)   */
+/*      of each real-space term;                               */
+/*                                                             */
+/*  (b) the reciprocal-lattice vector P-G and Q=|P-G|^2-k^2    */
+/*      of each reciprocal-space term, and the exp*erfc        */
+/*      factors of GetEEF (two complex erfcs per term, by far  */
+/*      the most expensive part of the reciprocal-space sum),  */
+/*      which depend on R only through R[2] and are computed   */
+/*      once for each distinct value of R[2] in the batch;     */
+/*                                                             */
+/*  (c) nothing else, but the phase factors exp(i(P-G)*R) are  */
+/*      obtained for each point by multiplying precomputed     */
+/*      powers of exp(-i Gamma_{1,2}*R) instead of calling     */
+/*      exp() for each term.                                   */
+/*                                                             */
+/* Batches whose points share R[2] (rows and planes of the     */
+/* interpolation grids in GBarAccelerator.cc) benefit most.    */
+/* Only 2D lattices are batched; for 1D lattices the Ewald     */
+/* parameter and reciprocal-space sum depend on each point's   */
+/* distance from the lattice axis, and the points are simply   */
+/* handed to GBarVDEwald one at a time.                        */
+/***************************************************************/
+#define NPOWERS 64
+
+typedef struct EwaldBatch
+ { 
+   int NR;
+   double *R;
+   cdouble k;
+   double E;
+
+   cdouble *Sum, *LastSum;
+   int *ConvergedIters;
+   int NumActive;
+
+   // reciprocal-space sum only
+   double *P, (*Gamma)[3];
+   int NumZ, *ZIndex, *ZActive;
+   double *ZValues;
+   cdouble *EEF, *EEFPrime;
+   cdouble *PR, *Pow1, *Pow2;
+
+ } EwaldBatch;
+
+/***************************************************************/
+/* exp(-i*m*Gamma_{1,2}*R) for point #nr                       */
+/***************************************************************/
+static cdouble GetPower(EwaldBatch *B, cdouble *Pow, int nr, int nWhich, int m)
+{ 
+  if ( abs(m)<=NPOWERS )
+   return Pow[nr*(2*NPOWERS+1) + NPOWERS + m];
+  double *R=B->R + 3*nr;
+  double GR=B->Gamma[nWhich][0]*R[0] + B->Gamma[nWhich][1]*R[1];
+  return exp(-II*((double)m)*GR);
+}
+
+/***************************************************************/
+/* convergence check after a shell of lattice vectors has been */
+/* added, as in GetGBarNearby and GetGBarDistant               */
+/***************************************************************/
+static void UpdateConvergence(EwaldBatch *B)
+{
+  for(int nr=0; nr<B->NR; nr++)
+   { 
+     if (B->ConvergedIters[nr]>=3) continue;
+
+     cdouble *Sum=B->Sum + NSUM*nr, *LastSum=B->LastSum + NSUM*nr;
+     double MaxAbsDelta=0.0, MaxRelDelta=0.0;
+     for(int ns=0; ns<NSUM; ns++)
+      { double Delta=abs(Sum[ns]-LastSum[ns]);
+        if ( Delta>MaxAbsDelta )
+         MaxAbsDelta=Delta;
+        double AbsSum=abs(Sum[ns]);
+        if ( AbsSum>0.0 && (Delta > MaxRelDelta*AbsSum) )
+         MaxRelDelta=Delta/AbsSum;
+      };
+     if ( MaxAbsDelta<ABSTOL || MaxRelDelta<RELTOL )
+      B->ConvergedIters[nr]++;
+     else
+      B->ConvergedIters[nr]=0;
+
+     if (B->ConvergedIters[nr]==3)
+      { B->NumActive--;
+        if (B->ZActive) B->ZActive[B->ZIndex[nr]]--;
+      };
+
+     memcpy(LastSum,Sum,NSUM*sizeof(cdouble));
+   };
+}
+
+static void ResetConvergence(EwaldBatch *B)
+{
+  memcpy(B->LastSum, B->Sum, B->NR*NSUM*sizeof(cdouble));
+  memset(B->ConvergedIters, 0, B->NR*sizeof(int));
+  B->NumActive=B->NR;
+  if (B->ZActive)
+   { memset(B->ZActive, 0, B->NumZ*sizeof(int));
+     for(int nr=0; nr<B->NR; nr++)
+      B->ZActive[B->ZIndex[nr]]++;
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static void AddGShortBatch(EwaldBatch *B, double *kBloch,
+                           int n1, int n2, double (*LBV)[3])
+{
+  double L[2];
+  L[0] = n1*LBV[0][0] + n2*LBV[1][0];
+  L[1] = n1*LBV[0][1] + n2*LBV[1][1];
+  cdouble PhaseFactor=exp( II * (kBloch[0]*L[0] + kBloch[1]*L[1]) ) / (8.0*M_PI);
+
+  for(int nr=0; nr<B->NR; nr++)
+   if (B->ConvergedIters[nr]<3)
+    AddGShortTerm(B->R + 3*nr, B->k, L, PhaseFactor, B->E, B->Sum + NSUM*nr);
+}
+
+static void AddGLong2DBatch(EwaldBatch *B, int n1, int n2)
+{
+  double PmG[2];
+  PmG[0] = B->P[0] - n1*B->Gamma[0][0] - n2*B->Gamma[1][0];
+  PmG[1] = B->P[1] - n1*B->Gamma[0][1] - n2*B->Gamma[1][1];
+
+  cdouble Q = sqrt ( PmG[0]*PmG[0] + PmG[1]*PmG[1] - B->k*B->k );
+
+  for(int nz=0; nz<B->NumZ; nz++)
+   if (B->ZActive[nz]>0)
+    GetEEF(B->ZValues[nz], B->E, Q, B->EEF + nz, B->EEFPrime + nz);
+
+  for(int nr=0; nr<B->NR; nr++)
+   if (B->ConvergedIters[nr]<3)
+    { int nz=B->ZIndex[nr];
+      cdouble Phase = B->PR[nr]
+                       * GetPower(B, B->Pow1, nr, 0, n1)
+                       * GetPower(B, B->Pow2, nr, 1, n2);
+      AddGLong2DTerm(PmG, Q, Phase, B->EEF[nz], B->EEFPrime[nz],
+                     B->Sum + NSUM*nr);
+    };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void GBarVDEwaldMany(double *R, int NR, cdouble k, double *kBloch,
+                     double (*LBV)[3], int LDim,
+                     double E, bool ExcludeInnerCells,
+                     cdouble *GBarVD)
+{
+  if (k==0.0)
+   { for(int n=0; n<8*NR; n++)
+      GBarVD[n]=0.0;
+     return;
+   };
+
+  double Gamma[3][3], EOpt=0.0;
+  if (LDim==2)
+   { GetRLBasis(LDim, LBV, Gamma, k, &EOpt, R, 0);
+     if (E==-1.0) E=EOpt;
+   };
+  if (LDim!=2 || E==0.0 || NR==1)
+   { for(int nr=0; nr<NR; nr++)
+      GBarVDEwald(R+3*nr, k, kBloch, LBV, LDim, E, ExcludeInnerCells, GBarVD+8*nr);
+     return;
+   };
+
+  EwaldBatch MyB, *B=&MyB;
+  B->NR      = NR;
+  B->R       = R;
+  B->k       = k;
+  B->E       = E;
+  B->LastSum = new cdouble[NR*NSUM];
+  B->ConvergedIters = new int[NR];
+  B->ZActive = 0;
+
+  /***************************************************************/
+  /* real-space ('nearby') sum, accumulated directly in GBarVD   */
+  /***************************************************************/
+  B->Sum = GBarVD;
+  for(int n=0; n<NR*NSUM; n++)
+   B->Sum[n]=0.0;
+  memset(B->ConvergedIters, 0, NR*sizeof(int));
+  for (int n1=-NFIRSTROUND; n1<=NFIRSTROUND; n1++)
+   for (int n2=-NFIRSTROUND; n2<=NFIRSTROUND; n2++)
+    if ( !ExcludeInnerCells || abs(n1)>1 || abs(n2)>1 )
+     AddGShortBatch(B, kBloch, n1, n2, LBV);
+
+  ResetConvergence(B);
+  for(int NN=NFIRSTROUND+1; B->NumActive>0 && NN<=NMAX; NN++)
+   { for(int n=-NN; n<NN; n++)
+      { AddGShortBatch(B, kBloch,   n,  NN, LBV);
+        AddGShortBatch(B, kBloch,  NN,  -n, LBV);
+        AddGShortBatch(B, kBloch,  -n, -NN, LBV);
+        AddGShortBatch(B, kBloch, -NN,   n, LBV);
+      };
+     UpdateConvergence(B);
+   };
+
+  /***************************************************************/
+  /* reciprocal-space ('distant') sum                            */
+  /***************************************************************/
+  cdouble *Distant = new cdouble[NR*NSUM];
+  B->Sum      = Distant;
+  B->P        = kBloch;
+  B->Gamma    = Gamma;
+  B->ZIndex   = new int[NR];
+  B->ZValues  = new double[NR];
+  B->ZActive  = new int[NR];
+  B->EEF      = new cdouble[NR];
+  B->EEFPrime = new cdouble[NR];
+  B->PR       = new cdouble[NR];
+  B->Pow1     = new cdouble[NR*(2*NPOWERS+1)];
+  B->Pow2     = new cdouble[NR*(2*NPOWERS+1)];
+
+  B->NumZ=0;
+  for(int nr=0; nr<NR; nr++)
+   { 
+     double *RR=R+3*nr;
+     int nz;
+     for(nz=0; nz<B->NumZ && B->ZValues[nz]!=RR[2]; nz++)
+      ;
+     if (nz==B->NumZ)
+      B->ZValues[B->NumZ++]=RR[2];
+     B->ZIndex[nr]=nz;
+
+     B->PR[nr] = exp( II * (kBloch[0]*RR[0] + kBloch[1]*RR[1]) );
+     for(int nWhich=0; nWhich<2; nWhich++)
+      { cdouble *Pow = (nWhich==0 ? B->Pow1 : B->Pow2) + nr*(2*NPOWERS+1) + NPOWERS;
+        cdouble e = exp( -II*(Gamma[nWhich][0]*RR[0] + Gamma[nWhich][1]*RR[1]) );
+        Pow[0]=1.0;
+        for(int m=1; m<=NPOWERS; m++)
+         { Pow[m]  = Pow[m-1]*e;
+           Pow[-m] = conj(Pow[m]);
+         };
+      };
+   };
+
+  for(int n=0; n<NR*NSUM; n++)
+   B->Sum[n]=0.0;
+  memset(B->ConvergedIters, 0, NR*sizeof(int));
+  for(int nz=0; nz<B->NumZ; nz++)
+   B->ZActive[nz]=1;
+  for (int m1=-NFIRSTROUND; m1<=NFIRSTROUND; m1++)
+   for (int m2=-NFIRSTROUND; m2<=NFIRSTROUND; m2++)
+    AddGLong2DBatch(B, m1, m2);
+
+  ResetConvergence(B);
+  for(int NN=NFIRSTROUND+1; B->NumActive>0 && NN<=NMAX; NN++)
+   { for(int m=-NN; m<NN; m++)
+      { AddGLong2DBatch(B,   m,  NN);
+        AddGLong2DBatch(B,  NN,  -m);
+        AddGLong2DBatch(B,  -m, -NN);
+        AddGLong2DBatch(B, -NN,   m);
+      };
+     UpdateConvergence(B);
+   };
+
+  double PreFactor = (Gamma[0][0]*Gamma[1][1] - Gamma[0][1]*Gamma[1][0])/(16.0*M_PI*M_PI);
+  for(int n=0; n<NR*NSUM; n++)
+   GBarVD[n] += PreFactor*Distant[n];
+
+  /***************************************************************/
+  /* subtract off the contributions to the 'distant' sum coming  */
+  /* from the inner grid cells in real space                     */
+  /***************************************************************/
+  if (ExcludeInnerCells)
+   for(int nr=0; nr<NR; nr++)
+    { cdouble GLongInner[NSUM];
+      for(int ns=0; ns<NSUM; ns++)
+       GLongInner[ns]=0.0;
+      for(int n1=-1; n1<=1; n1++)
+       for(int n2=-1; n2<=1; n2++)
+        AddGLongRealSpace(R+3*nr, k, kBloch, n1, n2, LBV, LDim, E, GLongInner);
+      for(int ns=0; ns<NSUM; ns++)
+       GBarVD[NSUM*nr + ns] -= GLongInner[ns];
+    };
+
+  delete[] Distant;
+  delete[] B->LastSum;
+  delete[] B->ConvergedIters;
+  delete[] B->ZIndex;
+  delete[] B->ZValues;
+  delete[] B->ZActive;
+  delete[] B->EEF;
+  delete[] B->EEFPrime;
+  delete[] B->PR;
+  delete[] B->Pow1;
+  delete[] B->Pow2;
+}
+
 } // namespace scuff
@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <libhrutil.h>
 
@@ -390,6 +391,14 @@ static int TDMaxEval=1000;
 /*!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
 /*!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
 /*!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+static pthread_once_t TDMaxEvalOnce = PTHREAD_ONCE_INIT;
+static void ReadTDMaxEval()
+{ char *s=getenv("SCUFF_TDMAXEVAL");
+  if (s)
+   { sscanf(s,"%i",&TDMaxEval);
+     Log("Setting TDMaxEval=%i.",TDMaxEval);
+   };
+}
 
 /***************************************************************/
 /***************************************************************/
@@ -682,17 +691,8 @@ void InitGetGCMEArgs(GetGCMEArgStruct *Args)
   Args->ForceDeSingularize=false;
   Args->DoNotDeSingularize=false;
   Args->ForceOrder=-1;
-/*!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
-static int init=0;
-if (init==0)
- { init=1;
-   char *s=getenv("SCUFF_TDMAXEVAL");
-   if (s)
-    { sscanf(s,"%i",&TDMaxEval);
-      Log("Setting TDMaxEval=%i.");
-    };
- };
-/*!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+  // InitGetGCMEArgs may be called from several threads at once
+  pthread_once(&TDMaxEvalOnce, ReadTDMaxEval);
 
 }
 
@@ -69,9 +69,10 @@ HMatrix *RWGGeometry::GetDyadicGFs(cdouble Omega, double *kBloch,
   /* on hand as statically-allocated buffers on the assumption    */
   /* that the routine will be called many times with the same     */
   /* number of evaluation points, for example in Brillouin-zone   */
-  /* integrations                                                 */
+  /* integrations. (the buffers are per-thread so that several    */
+  /* frequency points may be processed concurrently.)             */
   /*--------------------------------------------------------------*/
-  static HMatrix *RFSource=0, *RFDest=0;
+  static __thread HMatrix *RFSource=0, *RFDest=0;
   if ( RFSource==0 || RFSource->NR!=NBF || RFSource->NC!=(6*NX) )
    { 
      if (RFSource) delete RFSource;
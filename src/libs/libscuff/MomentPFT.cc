@@ -211,9 +211,9 @@ HMatrix *GetMomentPFTMatrix(RWGGeometry *G, cdouble Omega, IncField *IF,
   /* ScatteredPFT[ns] = contributions of surface #ns to          */
   /*                    scattered PFT                            */
   /***************************************************************/
-  static int NSSave=0;
-  static HMatrix **ScatteredPFT=0, *ExtinctionPFT=0;
-  static HMatrix *PM;
+  static __thread int NSSave=0;
+  static __thread HMatrix **ScatteredPFT=0, *ExtinctionPFT=0;
+  static __thread HMatrix *PM=0;
   if (NSSave!=NS)
    { if (ScatteredPFT)
       { for(int ns=0; ns<NSSave; ns++)
@@ -0,0 +1,814 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * MultipoleBEMOperator.cc -- matrix-free application of the BEM
+ *                         -- matrix using spherical-multipole
+ *                         -- expansions for well-separated edges
+ *
+ * The interactions of each pair of surfaces are split into
+ * well-separated cluster pairs and nearby leaf pairs exactly as
+ * in MultipoleInteractions.cc (PartitionClusterPairs). Near pairs
+ * are stored as dense blocks of BEM matrix entries. For a far
+ * pair (A,B) in a region with wavenumber k, the block of BEM
+ * matrix entries is (see the header of MultipoleInteractions.cc)
+ *
+ *  M_EE = f1 ik E0,  M_EM = M_ME = f2 E1,  M_MM = f3 ik E0,
+ *  E0 = Row0_A * (Col_B * T)^T,  E1 = Row1_A * (Col_B * T)^T
+ *
+ * with f1=iMu*Omega, f2=-ik, f3=-iEps*Omega times the region sign,
+ * T the translation matrix from the center of A to that of B,
+ * and Row0/Row1 the Vec/Div and Curl rows of the row moments.
+ * Apply() never forms these blocks; instead it
+ *
+ *  (1) contracts the input vector with the moments of each
+ *      cluster to get its outgoing coefficients,
+ *  (2) translates the outgoing coefficients of each cluster to
+ *      the centers of all clusters with which it is paired,
+ *  (3) contracts the accumulated incoming coefficients with the
+ *      moments of each cluster to get the output vector.
+ *
+ * Since the BEM matrix is symmetric, each far or near pair also
+ * supplies the transposed block, so every unordered pair of
+ * surfaces and clusters is visited once. A far pair is only
+ * handled by multipoles if its translation matrices are smaller
+ * than the dense block they replace; otherwise it is stored
+ * densely like a near pair.
+ *
+ * This is a single-level scheme: translations go directly
+ * between the clusters of each far pair, without the
+ * upward/downward passes of a full multilevel FMM.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+
+#include <libhrutil.h>
+#include <libhmat.h>
+#include <libSpherical.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace scuff {
+
+#define II cdouble(0,1)
+
+// largest number of edges in a diagonal block of the preconditioner
+#define MP_PCBLOCKEDGES 256
+
+/***************************************************************/
+/* dense block of BEM matrix entries between two lists of BFs; */
+/* if Transpose is true the block also contributes its         */
+/* transpose to the (Cols, Rows) block of the matrix.          */
+/***************************************************************/
+typedef struct MPDenseBlock
+ { int NumRows, NumCols;
+   int *Rows, *Cols;
+   HMatrix *M;
+   bool Transpose;
+ } MPDenseBlock;
+
+/***************************************************************/
+/* moments of one cluster of edges in one region, together     */
+/* with its outgoing (P, Q) and incoming (Loc, LocT)           */
+/* coefficients for the current Apply(). each coefficient      */
+/* array has length 8*NA: entry [Side*4*NA + 4*Alpha + i] is   */
+/* for electric (Side=0) or magnetic (Side=1) currents.        */
+/*  P   : Col^T x  (cluster as source of forward blocks)       */
+/*  Q   : Row^T x with prefactors (source of transposed ones)  */
+/*  Loc : incoming through forward blocks, evaluated with Row  */
+/*  LocT: incoming through transposed blocks, evaluated w/ Col */
+/***************************************************************/
+typedef struct MPClusterSlot
+ { int ns, nr, nc;          // surface, region, cluster
+   int L, NA;
+   int NE, *BFE, *BFM;      // BF indices of the electric and magnetic
+                            // currents on the cluster edges (BFM=-1 if PEC)
+   cdouble k, f1, f2, f3;
+   HMatrix *Row, *Col;      // RowMoments, ColMoments, or 0
+   cdouble *P, *Q, *Loc, *LocT;
+ } MPClusterSlot;
+
+/***************************************************************/
+/* translation between the clusters of a far pair in a single  */
+/* region                                                      */
+/***************************************************************/
+typedef struct MPFarPair
+ { int SlotA, SlotB;
+   int NA;
+   double Sign;
+   HMatrix *T;
+ } MPFarPair;
+
+/***************************************************************/
+/* BF indices of the edges in a list                           */
+/***************************************************************/
+static int GetBFList(RWGGeometry *G, int ns, int *Edges, int NE, int *BFs)
+{
+  RWGSurface *S=G->Surfaces[ns];
+  int Offset=G->BFIndexOffset[ns];
+  int NBF=0;
+  for(int n=0; n<NE; n++)
+   if (S->IsPEC)
+    BFs[NBF++] = Offset + Edges[n];
+   else
+    { BFs[NBF++] = Offset + 2*Edges[n];
+      BFs[NBF++] = Offset + 2*Edges[n] + 1;
+    };
+  return NBF;
+}
+
+static int GetNumBFs(RWGGeometry *G, int ns, int NE)
+{ return G->Surfaces[ns]->IsPEC ? NE : 2*NE; }
+
+/***************************************************************/
+/* allocate (but don't compute) a dense block between two      */
+/* lists of edges                                              */
+/***************************************************************/
+static void InitDenseBlock(RWGGeometry *G,
+                           int nsa, int *EdgesA, int NEa,
+                           int nsb, int *EdgesB, int NEb,
+                           bool Transpose, MPDenseBlock *B)
+{
+  B->Rows      = new int[ GetNumBFs(G, nsa, NEa) ];
+  B->Cols      = new int[ GetNumBFs(G, nsb, NEb) ];
+  B->NumRows   = GetBFList(G, nsa, EdgesA, NEa, B->Rows);
+  B->NumCols   = GetBFList(G, nsb, EdgesB, NEb, B->Cols);
+  B->Transpose = Transpose;
+  B->M         = 0;
+}
+
+/***************************************************************/
+/* fill in the entries of a dense block                        */
+/***************************************************************/
+static void ComputeDenseBlock(RWGGeometry *G, cdouble Omega, MPDenseBlock *B)
+{
+  B->M = new HMatrix(B->NumRows, B->NumCols, LHM_COMPLEX);
+
+  int nsa, nea, nsb, neb;
+  bool aIsPEC = G->ResolveBF(B->Rows[0])->IsPEC;
+  bool bIsPEC = G->ResolveBF(B->Cols[0])->IsPEC;
+  int da = aIsPEC ? 1 : 2, db = bIsPEC ? 1 : 2;
+
+  for(int nr=0; nr<B->NumRows; nr+=da)
+   { G->ResolveBF(B->Rows[nr], &nsa, &nea);
+     for(int nc=0; nc<B->NumCols; nc+=db)
+      { G->ResolveBF(B->Cols[nc], &nsb, &neb);
+        cdouble MEE[2][2];
+        GetEdgePairBEMEntries(G, Omega, nsa, nea, nsb, neb, MEE);
+        for(int Ma=0; Ma<da; Ma++)
+         for(int Mb=0; Mb<db; Mb++)
+          B->M->SetEntry(nr+Ma, nc+Mb, MEE[Ma][Mb]);
+      };
+   };
+}
+
+/***************************************************************/
+/* highest tree nodes with at most MaxEdges edges              */
+/***************************************************************/
+static void GetPCNodes(EdgeClusterTree *CT, int nc, int MaxEdges,
+                       std::vector<int> &Nodes)
+{
+  if ( CT->Length[nc]<=MaxEdges || CT->Children[2*nc]==-1 )
+   Nodes.push_back(nc);
+  else
+   { GetPCNodes(CT, CT->Children[2*nc+0], MaxEdges, Nodes);
+     GetPCNodes(CT, CT->Children[2*nc+1], MaxEdges, Nodes);
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+MultipoleBEMOperator::MultipoleBEMOperator(RWGGeometry *pG, cdouble pOmega,
+                                           double pTol)
+{
+  G=pG;
+  Omega=pOmega;
+  Tol=pTol;
+  N=G->TotalBFs;
+
+  if (G->LDim!=0)
+   ErrExit("multipole BEM operators are not supported for periodic geometries");
+  if (G->UseHRWGFunctions && G->NumMMJs>0)
+   ErrExit("multipole BEM operators are not supported for multi-material junctions");
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   if (G->Surfaces[ns]->SurfaceZeta)
+    ErrExit("multipole BEM operators are not supported for surfaces with finite conductivity");
+
+  Log("Assembling multipole BEM operator at Omega=%s (tolerance %g)",z2s(Omega),Tol);
+  G->UpdateCachedEpsMuValues(Omega);
+  double T0=Secs();
+
+  int NS=G->NumSurfaces;
+  EdgeClusterTree **Trees=new EdgeClusterTree *[NS];
+  for(int ns=0; ns<NS; ns++)
+   Trees[ns]=CreateEdgeClusterTree(G->Surfaces[ns], MP_LEAFSIZE);
+
+  /*--------------------------------------------------------------*/
+  /*- partition the interactions of all surface pairs ------------*/
+  /*--------------------------------------------------------------*/
+  std::vector<MPDenseBlock> DBList;
+  std::vector<MPFarPair> FPList;
+  std::vector<MPClusterSlot> SlotList;
+  std::map<long, int> SlotIndex; // (ns, nr, nc) -> slot
+
+  for(int nsa=0; nsa<NS; nsa++)
+   for(int nsb=nsa; nsb<NS; nsb++)
+    {
+      RWGSurface *Sa=G->Surfaces[nsa], *Sb=G->Surfaces[nsb];
+      EdgeClusterTree *CTa=Trees[nsa], *CTb=Trees[nsb];
+      bool Symmetric = (nsa==nsb);
+
+      int CommonRegions[2];
+      double Signs[2];
+      int NCR=CountCommonRegions(Sa, Sb, CommonRegions, Signs);
+      if (NCR==0) continue;
+
+      cdouble k[2]={0.0, 0.0};
+      bool Active[2]={false, false};
+      for(int ncr=0; ncr<NCR; ncr++)
+       { int nr=CommonRegions[ncr];
+         k[ncr]=csqrt2(G->EpsTF[nr]*G->MuTF[nr])*Omega;
+         Active[ncr] = (G->EpsTF[nr]!=0.0 && k[ncr]!=0.0);
+       };
+
+      ClusterPartition CP;
+      PartitionClusterPairs(CTa, CTb, 0, Symmetric, k, Active, Tol, &CP);
+
+      for(size_t nnp=0; nnp<CP.NearA.size(); nnp++)
+       { int nca=CP.NearA[nnp], ncb=CP.NearB[nnp];
+         MPDenseBlock DB;
+         InitDenseBlock(G, nsa, CTa->Edges + CTa->Start[nca], CTa->Length[nca],
+                           nsb, CTb->Edges + CTb->Start[ncb], CTb->Length[ncb],
+                           !(Symmetric && nca==ncb), &DB);
+         DBList.push_back(DB);
+       };
+
+      for(size_t nfp=0; nfp<CP.FarA.size(); nfp++)
+       {
+         int nca=CP.FarA[nfp], ncb=CP.FarB[nfp];
+
+         // use multipoles only if the translation matrices take
+         // less work than the dense block they replace
+         double MPCost=0.0;
+         for(int ncr=0; ncr<NCR; ncr++)
+          if (Active[ncr])
+           { double NA=(CP.Orders[2*nfp+ncr]+1)*(CP.Orders[2*nfp+ncr]+1);
+             MPCost += 8.0*NA*NA;
+           };
+         double DenseCost = ((double)GetNumBFs(G, nsa, CTa->Length[nca]))
+                           *GetNumBFs(G, nsb, CTb->Length[ncb]);
+         if (MPCost >= DenseCost)
+          { MPDenseBlock DB;
+            InitDenseBlock(G, nsa, CTa->Edges + CTa->Start[nca], CTa->Length[nca],
+                              nsb, CTb->Edges + CTb->Start[ncb], CTb->Length[ncb],
+                              true, &DB);
+            DBList.push_back(DB);
+            continue;
+          };
+
+         for(int ncr=0; ncr<NCR; ncr++)
+          {
+            if (!Active[ncr]) continue;
+            int nr=CommonRegions[ncr], L=CP.Orders[2*nfp+ncr];
+
+            int Slot[2];
+            int nsab[2]={nsa, nsb}, ncab[2]={nca, ncb};
+            for(int ab=0; ab<2; ab++)
+             { long Key = (((long)nsab[ab])*G->NumRegions + nr)*( (long)(2*G->TotalEdges+1) ) + ncab[ab];
+               std::map<long,int>::iterator it=SlotIndex.find(Key);
+               if (it==SlotIndex.end())
+                { MPClusterSlot CS;
+                  CS.Row=CS.Col=0;
+                  CS.P=CS.Q=CS.Loc=CS.LocT=0;
+                  CS.NE=CS.NA=0;
+                  CS.BFE=CS.BFM=0;
+                  CS.ns=nsab[ab];
+                  CS.nr=nr;
+                  CS.nc=ncab[ab];
+                  CS.L=-1;
+                  CS.k=k[ncr];
+                  CS.f1=II*G->MuTF[nr]*Omega;
+                  CS.f2=-1.0*II*k[ncr];
+                  CS.f3=-1.0*II*G->EpsTF[nr]*Omega;
+                  SlotIndex[Key]=SlotList.size();
+                  Slot[ab]=SlotList.size();
+                  SlotList.push_back(CS);
+                }
+               else
+                Slot[ab]=it->second;
+               SlotList[Slot[ab]].L = std::max(SlotList[Slot[ab]].L, L);
+             };
+
+            MPFarPair FP;
+            FP.SlotA = Slot[0];
+            FP.SlotB = Slot[1];
+            FP.NA    = (L+1)*(L+1);
+            FP.Sign  = Signs[ncr];
+            FP.T     = 0;
+            FPList.push_back(FP);
+          };
+       };
+    };
+
+  /*--------------------------------------------------------------*/
+  /*- preconditioner blocks: the diagonal blocks of the largest   */
+  /*- tree nodes with at most MP_PCBLOCKEDGES edges. these are    */
+  /*- filled in below from the dense blocks they contain.         */
+  /*--------------------------------------------------------------*/
+  std::vector<MPDenseBlock> PCList;
+  for(int ns=0; ns<NS; ns++)
+   { std::vector<int> Nodes;
+     GetPCNodes(Trees[ns], 0, MP_PCBLOCKEDGES, Nodes);
+     for(size_t n=0; n<Nodes.size(); n++)
+      { EdgeClusterTree *CT=Trees[ns];
+        int *Edges=CT->Edges + CT->Start[Nodes[n]];
+        MPDenseBlock PCB;
+        InitDenseBlock(G, ns, Edges, CT->Length[Nodes[n]],
+                          ns, Edges, CT->Length[Nodes[n]], false, &PCB);
+        PCList.push_back(PCB);
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- copy the lists into the class arrays -----------------------*/
+  /*--------------------------------------------------------------*/
+  NumDenseBlocks=DBList.size();
+  DenseBlocks=new MPDenseBlock[NumDenseBlocks];
+  for(int n=0; n<NumDenseBlocks; n++) DenseBlocks[n]=DBList[n];
+
+  NumSlots=SlotList.size();
+  Slots=new MPClusterSlot[NumSlots];
+  for(int n=0; n<NumSlots; n++) Slots[n]=SlotList[n];
+
+  NumFarPairs=FPList.size();
+  FarPairs=new MPFarPair[NumFarPairs];
+  for(int n=0; n<NumFarPairs; n++) FarPairs[n]=FPList[n];
+
+  NumPCBlocks=PCList.size();
+  PCBlocks=new MPDenseBlock[NumPCBlocks];
+  for(int n=0; n<NumPCBlocks; n++) PCBlocks[n]=PCList[n];
+
+  /*--------------------------------------------------------------*/
+  /*- group far pairs by row and column slot ---------------------*/
+  /*--------------------------------------------------------------*/
+  AStart   = new int[NumSlots+1];
+  BStart   = new int[NumSlots+1];
+  PairsByA = new int[NumFarPairs];
+  PairsByB = new int[NumFarPairs];
+  memset(AStart, 0, (NumSlots+1)*sizeof(int));
+  memset(BStart, 0, (NumSlots+1)*sizeof(int));
+  for(int nfp=0; nfp<NumFarPairs; nfp++)
+   { AStart[FarPairs[nfp].SlotA+1]++;
+     BStart[FarPairs[nfp].SlotB+1]++;
+   };
+  for(int n=0; n<NumSlots; n++)
+   { AStart[n+1]+=AStart[n];
+     BStart[n+1]+=BStart[n];
+   };
+  int *AFill=new int[NumSlots], *BFill=new int[NumSlots];
+  memcpy(AFill, AStart, NumSlots*sizeof(int));
+  memcpy(BFill, BStart, NumSlots*sizeof(int));
+  for(int nfp=0; nfp<NumFarPairs; nfp++)
+   { PairsByA[ AFill[FarPairs[nfp].SlotA]++ ] = nfp;
+     PairsByB[ BFill[FarPairs[nfp].SlotB]++ ] = nfp;
+   };
+  delete[] AFill;
+  delete[] BFill;
+
+  /*--------------------------------------------------------------*/
+  /*- compute moments, translations, dense and PC blocks. the     */
+  /*- three loops below are independent and each is parallel.    */
+  /*--------------------------------------------------------------*/
+  int NumThreads=GetNumThreads();
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int n=0; n<NumSlots; n++)
+   { MPClusterSlot *CS=Slots+n;
+     EdgeClusterTree *CT=Trees[CS->ns];
+     int NE=CT->Length[CS->nc];
+     CS->NA=(CS->L+1)*(CS->L+1);
+     CS->Row=0;
+     CS->Col=0;
+     if (AStart[n+1]>AStart[n])
+      CS->Row=new HMatrix(2*NE, 4*CS->NA, LHM_COMPLEX);
+     if (BStart[n+1]>BStart[n])
+      CS->Col=new HMatrix(4*NE, CS->NA, LHM_COMPLEX);
+     int *Edges=CT->Edges + CT->Start[CS->nc];
+     GetEdgeClusterMoments(G->Surfaces[CS->ns], Edges, NE,
+                           CT->Centers + 3*CS->nc, CS->k, CS->L, CS->Row, CS->Col);
+
+     bool IsPEC=G->Surfaces[CS->ns]->IsPEC;
+     int Offset=G->BFIndexOffset[CS->ns];
+     CS->NE  = NE;
+     CS->BFE = new int[2*NE];
+     CS->BFM = CS->BFE + NE;
+     for(int ne=0; ne<NE; ne++)
+      { CS->BFE[ne] = Offset + (IsPEC ? Edges[ne] : 2*Edges[ne]);
+        CS->BFM[ne] = IsPEC ? -1 : Offset + 2*Edges[ne] + 1;
+      };
+     CS->P = new cdouble[32*CS->NA];
+     CS->Q = CS->P + 8*CS->NA;
+     CS->Loc = CS->Q + 8*CS->NA;
+     CS->LocT = CS->Loc + 8*CS->NA;
+   };
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nfp=0; nfp<NumFarPairs; nfp++)
+   { MPFarPair *FP=FarPairs+nfp;
+     MPClusterSlot *A=Slots+FP->SlotA, *B=Slots+FP->SlotB;
+     double Xij[3];
+     VecSub(Trees[B->ns]->Centers + 3*B->nc, Trees[A->ns]->Centers + 3*A->nc, Xij);
+     int L=(int)lround(sqrt((double)FP->NA)) - 1;
+     FP->T=new HMatrix(FP->NA, FP->NA, LHM_COMPLEX);
+     GetTranslationMatrices(Xij, A->k, L, FP->T, 0, 0);
+   };
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int n=0; n<NumDenseBlocks; n++)
+   ComputeDenseBlock(G, Omega, DenseBlocks + n);
+
+  /*--------------------------------------------------------------*/
+  /*- preconditioner: copy each dense block that lies within a    */
+  /*- diagonal block into it; interactions of well-separated      */
+  /*- clusters within a diagonal block are omitted.               */
+  /*--------------------------------------------------------------*/
+  int *PCOf  = new int[N];
+  int *PCPos = new int[N];
+  for(int npc=0; npc<NumPCBlocks; npc++)
+   { MPDenseBlock *PCB=PCBlocks+npc;
+     PCB->M=new HMatrix(PCB->NumRows, PCB->NumCols, LHM_COMPLEX);
+     for(int n=0; n<PCB->NumRows; n++)
+      { PCOf[PCB->Rows[n]]=npc;
+        PCPos[PCB->Rows[n]]=n;
+      };
+   };
+  for(int n=0; n<NumDenseBlocks; n++)
+   { MPDenseBlock *DB=DenseBlocks+n;
+     // leaf clusters lie entirely within a single diagonal block
+     int npc=PCOf[DB->Rows[0]];
+     if ( PCOf[DB->Cols[0]]!=npc ) continue;
+     HMatrix *M=PCBlocks[npc].M;
+     for(int nr=0; nr<DB->NumRows; nr++)
+      for(int nc=0; nc<DB->NumCols; nc++)
+       { cdouble Entry=DB->M->GetEntry(nr, nc);
+         M->AddEntry(PCPos[DB->Rows[nr]], PCPos[DB->Cols[nc]], Entry);
+         if (DB->Transpose)
+          M->AddEntry(PCPos[DB->Cols[nc]], PCPos[DB->Rows[nr]], Entry);
+       };
+   };
+  delete[] PCOf;
+  delete[] PCPos;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int npc=0; npc<NumPCBlocks; npc++)
+   PCBlocks[npc].M->LUFactorize();
+
+  for(int ns=0; ns<NS; ns++)
+   DestroyEdgeClusterTree(Trees[ns]);
+  delete[] Trees;
+
+  Log(" %i dense blocks, %i far translations, %i clusters, %.1f MB (%.2f s)",
+      NumDenseBlocks,NumFarPairs,NumSlots,((double)GetStorage())/1048576.0,Secs()-T0);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+MultipoleBEMOperator::~MultipoleBEMOperator()
+{
+  for(int n=0; n<NumDenseBlocks; n++)
+   { delete DenseBlocks[n].M;
+     delete[] DenseBlocks[n].Rows;
+     delete[] DenseBlocks[n].Cols;
+   };
+  delete[] DenseBlocks;
+
+  for(int n=0; n<NumPCBlocks; n++)
+   { delete PCBlocks[n].M;
+     delete[] PCBlocks[n].Rows;
+     delete[] PCBlocks[n].Cols;
+   };
+  delete[] PCBlocks;
+
+  for(int n=0; n<NumSlots; n++)
+   { if (Slots[n].Row) delete Slots[n].Row;
+     if (Slots[n].Col) delete Slots[n].Col;
+     delete[] Slots[n].P;
+     delete[] Slots[n].BFE;
+   };
+  delete[] Slots;
+
+  for(int n=0; n<NumFarPairs; n++)
+   delete FarPairs[n].T;
+  delete[] FarPairs;
+
+  delete[] PairsByA;
+  delete[] PairsByB;
+  delete[] AStart;
+  delete[] BStart;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+size_t MultipoleBEMOperator::GetStorage()
+{
+  size_t Entries=0;
+  for(int n=0; n<NumDenseBlocks; n++)
+   Entries += ((size_t)DenseBlocks[n].NumRows)*DenseBlocks[n].NumCols;
+  for(int n=0; n<NumPCBlocks; n++)
+   Entries += ((size_t)PCBlocks[n].NumRows)*PCBlocks[n].NumCols;
+  for(int n=0; n<NumSlots; n++)
+   { if (Slots[n].Row) Entries += ((size_t)Slots[n].Row->NR)*Slots[n].Row->NC;
+     if (Slots[n].Col) Entries += ((size_t)Slots[n].Col->NR)*Slots[n].Col->NC;
+     Entries += 32*Slots[n].NA;
+   };
+  for(int n=0; n<NumFarPairs; n++)
+   Entries += ((size_t)FarPairs[n].NA)*FarPairs[n].NA;
+  return Entries*sizeof(cdouble);
+}
+
+/***************************************************************/
+/* MX = M*X for raw arrays of length N                         */
+/***************************************************************/
+void MultipoleBEMOperator::ApplyRaw(cdouble *X, cdouble *MX)
+{
+  int NumThreads=1;
+#ifdef USE_OPENMP
+  NumThreads=GetNumThreads();
+#endif
+
+  /*--------------------------------------------------------------*/
+  /*- (1) outgoing coefficients of each cluster:                  */
+  /*-  P(s,beta,i) = \sum_b Col(4b+i, beta) x_s(b)                */
+  /*-  Q_E = f1 ik Row0^T x_E + f2 Row1^T x_M                     */
+  /*-  Q_M = f2 Row1^T x_E + f3 ik Row0^T x_M                     */
+  /*--------------------------------------------------------------*/
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int n=0; n<NumSlots; n++)
+   {
+     MPClusterSlot *CS=Slots+n;
+     int NE=CS->NE, NA=CS->NA, NA4=4*NA;
+     for(int np=0; np<32*NA; np++)
+      CS->P[np]=0.0;
+
+     for(int ne=0; ne<NE; ne++)
+      { cdouble x[2];
+        x[0] = X[CS->BFE[ne]];
+        x[1] = CS->BFM[ne]==-1 ? 0.0 : X[CS->BFM[ne]];
+
+        if (CS->Col)
+         for(int Side=0; Side<2; Side++)
+          { if (x[Side]==0.0) continue;
+            cdouble *ColZM=CS->Col->ZM;
+            size_t NE4=4*NE;
+            cdouble *P=CS->P + Side*NA4;
+            for(int Beta=0; Beta<NA; Beta++)
+             for(int i=0; i<4; i++)
+              P[4*Beta+i] += ColZM[4*ne+i + NE4*Beta] * x[Side];
+          };
+
+        if (CS->Row)
+         { cdouble ik=II*CS->k;
+           cdouble c00 = CS->f1*ik*x[0], c01 = CS->f2*x[1]; // Q_E
+           cdouble c10 = CS->f2*x[0],    c11 = CS->f3*ik*x[1]; // Q_M
+           cdouble *QE=CS->Q, *QM=CS->Q + NA4;
+           cdouble *RowZM=CS->Row->ZM;
+           size_t NE2=2*NE;
+           for(int c=0; c<NA4; c++)
+            { cdouble R0=RowZM[ne + NE2*c], R1=RowZM[NE+ne + NE2*c];
+              QE[c] += c00*R0 + c01*R1;
+              QM[c] += c10*R1 + c11*R0;
+            };
+         };
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- (2) translations:                                           */
+  /*-  Loc_A(s,gamma,i)  += Sign \sum_beta T(beta,gamma) P_B(s,beta,i) */
+  /*-  LocT_B(s,beta,i)  += Sign \sum_gamma T(beta,gamma) Q_A(s,gamma,i) */
+  /*--------------------------------------------------------------*/
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int n=0; n<NumSlots; n++)
+   {
+     MPClusterSlot *CS=Slots+n;
+     int NA4=4*CS->NA;
+
+     for(int np=AStart[n]; np<AStart[n+1]; np++)
+      { MPFarPair *FP=FarPairs + PairsByA[np];
+        MPClusterSlot *B=Slots + FP->SlotB;
+        int NAp=FP->NA;
+        for(int Side=0; Side<2; Side++)
+         { cdouble *Loc=CS->Loc + Side*NA4, *P=B->P + Side*4*B->NA;
+           for(int Gamma=0; Gamma<NAp; Gamma++)
+            { cdouble Sum[4]={0.0,0.0,0.0,0.0};
+              cdouble *TCol=FP->T->ZM + ((size_t)Gamma)*NAp;
+              for(int Beta=0; Beta<NAp; Beta++)
+               for(int i=0; i<4; i++)
+                Sum[i] += TCol[Beta]*P[4*Beta+i];
+              for(int i=0; i<4; i++)
+               Loc[4*Gamma+i] += FP->Sign*Sum[i];
+            };
+         };
+      };
+
+     for(int np=BStart[n]; np<BStart[n+1]; np++)
+      { MPFarPair *FP=FarPairs + PairsByB[np];
+        MPClusterSlot *A=Slots + FP->SlotA;
+        int NAp=FP->NA;
+        for(int Side=0; Side<2; Side++)
+         { cdouble *LocT=CS->LocT + Side*NA4, *Q=A->Q + Side*4*A->NA;
+           for(int Gamma=0; Gamma<NAp; Gamma++)
+            { cdouble *TCol=FP->T->ZM + ((size_t)Gamma)*NAp;
+              cdouble SQ[4];
+              for(int i=0; i<4; i++)
+               SQ[i] = FP->Sign*Q[4*Gamma+i];
+              for(int Beta=0; Beta<NAp; Beta++)
+               for(int i=0; i<4; i++)
+                LocT[4*Beta+i] += TCol[Beta]*SQ[i];
+            };
+         };
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- (3) evaluation, plus the dense blocks; each thread adds     */
+  /*- into its own output buffer                                  */
+  /*--------------------------------------------------------------*/
+  // (mallocEC returns zeroed memory)
+  cdouble *Buffers = (cdouble *)mallocEC(((size_t)NumThreads)*N*sizeof(cdouble));
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int n=0; n<NumSlots+NumDenseBlocks; n++)
+   {
+     int nt=0;
+#ifdef USE_OPENMP
+     nt=omp_get_thread_num();
+#endif
+     cdouble *Y=Buffers + ((size_t)nt)*N;
+
+     if (n<NumSlots)
+      { MPClusterSlot *CS=Slots+n;
+        int NE=CS->NE, NA=CS->NA, NA4=4*NA;
+        cdouble ik=II*CS->k;
+        for(int ne=0; ne<NE; ne++)
+         { cdouble y[2]={0.0, 0.0};
+           if (CS->Row)
+            { cdouble *LocE=CS->Loc, *LocM=CS->Loc + NA4;
+              cdouble u0E=0.0, u1E=0.0, u0M=0.0, u1M=0.0;
+              cdouble *RowZM=CS->Row->ZM;
+              size_t NE2=2*NE;
+              for(int c=0; c<NA4; c++)
+               { cdouble R0=RowZM[ne + NE2*c], R1=RowZM[NE+ne + NE2*c];
+                 u0E+=R0*LocE[c]; u1E+=R1*LocE[c];
+                 u0M+=R0*LocM[c]; u1M+=R1*LocM[c];
+               };
+              y[0] += CS->f1*ik*u0E + CS->f2*u1M;
+              y[1] += CS->f2*u1E + CS->f3*ik*u0M;
+            };
+           if (CS->Col)
+            for(int Side=0; Side<2; Side++)
+             { cdouble *LocT=CS->LocT + Side*NA4;
+               cdouble *ColZM=CS->Col->ZM;
+               size_t NE4=4*NE;
+               for(int Beta=0; Beta<NA; Beta++)
+                for(int i=0; i<4; i++)
+                 y[Side] += ColZM[4*ne+i + NE4*Beta]*LocT[4*Beta+i];
+             };
+           Y[CS->BFE[ne]] += y[0];
+           if (CS->BFM[ne]!=-1)
+            Y[CS->BFM[ne]] += y[1];
+         };
+      }
+     else
+      { MPDenseBlock *DB=DenseBlocks + (n-NumSlots);
+        int NR=DB->NumRows, NC=DB->NumCols;
+        for(int nc=0; nc<NC; nc++)
+         { cdouble *Col=DB->M->ZM + ((size_t)nc)*NR;
+           cdouble xc=X[DB->Cols[nc]], yc=0.0;
+           for(int nr=0; nr<NR; nr++)
+            { Y[DB->Rows[nr]] += Col[nr]*xc;
+              if (DB->Transpose)
+               yc += Col[nr]*X[DB->Rows[nr]];
+            };
+           if (DB->Transpose)
+            Y[DB->Cols[nc]] += yc;
+         };
+      };
+   };
+
+  for(int n=0; n<N; n++)
+   MX[n]=0.0;
+  for(int nt=0; nt<NumThreads; nt++)
+   for(int n=0; n<N; n++)
+    MX[n] += Buffers[((size_t)nt)*N + n];
+  free(Buffers);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void MultipoleBEMOperator::Apply(HVector *X, HVector *MX)
+{
+  if (X->N!=N || MX->N!=N)
+   ErrExit("%s:%i: dimension mismatch in MultipoleBEMOperator::Apply",__FILE__,__LINE__);
+
+  cdouble *XX  = (cdouble *)mallocEC(N*sizeof(cdouble));
+  cdouble *MXX = (cdouble *)mallocEC(N*sizeof(cdouble));
+  for(int n=0; n<N; n++)
+   XX[n]=X->GetEntry(n);
+  ApplyRaw(XX, MXX);
+  for(int n=0; n<N; n++)
+   MX->SetEntry(n, MXX[n]);
+  free(XX);
+  free(MXX);
+}
+
+/***************************************************************/
+/* apply the inverse of the block-Jacobi preconditioner to X   */
+/* (in place)                                                  */
+/***************************************************************/
+void MultipoleBEMOperator::Precondition(cdouble *X)
+{
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(GetNumThreads())
+#endif
+  for(int npc=0; npc<NumPCBlocks; npc++)
+   { MPDenseBlock *PCB=PCBlocks+npc;
+     int Len=PCB->NumRows;
+     HVector XBlock(Len, LHM_COMPLEX);
+     for(int n=0; n<Len; n++)
+      XBlock.SetEntry(n, X[PCB->Rows[n]]);
+     PCB->M->LUSolve(&XBlock);
+     for(int n=0; n<Len; n++)
+      X[PCB->Rows[n]] = XBlock.GetEntry(n);
+   };
+}
+
+/***************************************************************/
+/* GMRES callbacks                                             */
+/***************************************************************/
+static void MPApply(void *UserData, cdouble *X, cdouble *MX)
+{ ((MultipoleBEMOperator *)UserData)->ApplyRaw(X, MX); }
+
+static void MPPrecondition(void *UserData, cdouble *X)
+{ ((MultipoleBEMOperator *)UserData)->Precondition(X); }
+
+int MultipoleBEMOperator::GMRESSolve(HVector *X, double RelTol,
+                                     int MaxIters, int Restart)
+{
+  if (X->N!=N)
+   ErrExit("%s:%i: dimension mismatch in MultipoleBEMOperator::GMRESSolve",__FILE__,__LINE__);
+
+  cdouble *XX = (cdouble *)mallocEC(N*sizeof(cdouble));
+  for(int n=0; n<N; n++)
+   XX[n]=X->GetEntry(n);
+  int Iters=GMRES(N, MPApply, MPPrecondition, (void *)this,
+                  XX, RelTol, MaxIters, Restart);
+  for(int n=0; n<N; n++)
+   X->SetEntry(n, XX[n]);
+  free(XX);
+  return Iters;
+}
+
+} // namespace scuff
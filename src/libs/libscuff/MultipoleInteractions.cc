@@ -0,0 +1,899 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * MultipoleInteractions.cc -- spherical-multipole evaluation of the
+ *                          -- interactions of well-separated RWG
+ *                          -- basis functions
+ *
+ * For x near a center cA and y near a center cB, the addition
+ * theorem for the scalar helmholtz kernel reads
+ *
+ *  G(x-y) = ik \sum_{\beta,\gamma} \tilde R_\beta(y-cB)
+ *                                  A_{\beta\gamma}(cB-cA)
+ *                                  R_\gamma(x-cA)
+ *
+ * with R_{lm}(r)=j_l(kr) Y_{lm}, \tilde R_{lm} = (-1)^m R_{l,-m},
+ * and A the scalar translation matrix of GetTranslationMatrices().
+ * Inserting this into the definitions of the G and C integrals
+ * (GetEdgeEdgeInteractions) factorizes them into
+ * translation matrices sandwiched between 'moments' of the
+ * individual basis functions about their cluster centers:
+ *
+ *  Vec_\gamma  = \int f R_\gamma,  Div_\gamma = \int (\nabla \cdot f) R_\gamma,
+ *  Curl_\gamma = \int \nabla R_\gamma \times f,
+ *
+ *  GC0 = ik \sum A_{\beta\gamma} [ Vec^a_\gamma \cdot \tilde Vec^b_\beta
+ *                                  - Div^a_\gamma \tilde Div^b_\beta / k^2 ]
+ *  GC1 =    \sum A_{\beta\gamma} Curl^a_\gamma \cdot \tilde Vec^b_\beta
+ *
+ * The moments of all edges in a cluster are packed into matrices
+ * (GetEdgeClusterMoments) so that the interactions of all edge
+ * pairs in a pair of clusters are two matrix-matrix products
+ * (GetClusterPairInteractions):
+ *
+ *  RowMoments (2NE x 4NA): row a, column 4*\gamma+i is Vec^a_\gamma[i]
+ *                          (i<3) or -Div^a_\gamma/k^2 (i=3); row
+ *                          NE+a holds Curl^a_\gamma[i] and 0.
+ *  ColMoments (4NE x NA) : row 4*b+i, column \beta is \tilde Vec^b_\beta[i]
+ *                          or \tilde Div^b_\beta.
+ *
+ * The truncation order L is chosen per cluster pair from the
+ * requested accuracy (GetMultipoleOrder); since both layouts
+ * order the multipoles by \alpha=l*l+l+m along their columns,
+ * moments computed at a higher order may be used at any lower
+ * order by just dropping trailing columns.
+ *
+ * During BEM matrix assembly, the edges of each surface are
+ * organized into a cluster tree, and the interactions in each
+ * block of the matrix are split into the largest possible pairs
+ * of well-separated clusters plus pairs of nearby leaf clusters
+ * (InitMultipoleBlock). GSSIThread skips the edge pairs in
+ * well-separated clusters (IsMultipolePair), and
+ * AddMultipoleInteractions fills in those entries afterwards.
+ * This is enabled by setting RWGGeometry::MultipoleTol (or the
+ * environment variable SCUFF_MULTIPOLE_TOL) to a nonzero value.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <libhrutil.h>
+#include <libhmat.h>
+#include <libSpherical.h>
+#include <libTriInt.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace scuff {
+
+#define II cdouble(0,1)
+
+// cubature order for moments; same as the order used for
+// well-separated panel pairs in GetPanelPanelInteractions
+#define MP_TCRORDER 4
+
+// default accuracy for GetEEIMultipole if MultipoleTol is not set
+#define MP_DEFAULTTOL 1.0e-6
+
+// minimum distance between far clusters in units of the largest
+// panel radius; this is DESINGULARIZATION_RADIUS in
+// PanelPanelInteractions.cc, beyond which GetPanelPanelInteractions
+// also uses MP_TCRORDER cubature
+#define MP_MINGAP 4.0
+
+// rough costs of one entry of a translation matrix and of one
+// moment of one edge, relative to one edge-pair interaction
+// computed by GetEdgeEdgeInteractions
+#define MP_TRANSLATIONCOST 0.003
+#define MP_MOMENTCOST      0.05
+
+double RWGGeometry::MultipoleTol=0.0;
+
+/***************************************************************/
+/* cluster tree over the edges of a surface, built by          */
+/* recursive bisection of the list of edge centroids along the */
+/* longest axis of their bounding box. each node is a          */
+/* contiguous range of the reordered edge list, so the edges   */
+/* of a node are the union of the edges of its children.       */
+/***************************************************************/
+typedef struct CentroidLess
+ { RWGSurface *S;
+   int Axis;
+   bool operator()(int ne1, int ne2) const
+    { return S->Edges[ne1]->Centroid[Axis] < S->Edges[ne2]->Centroid[Axis]; }
+ } CentroidLess;
+
+static int AddClusterNode(EdgeClusterTree *ECT, RWGSurface *S,
+                          int Start, int Length, int MaxLeafSize)
+{
+  int nc = ECT->NumClusters++;
+  ECT->Start[nc]=Start;
+  ECT->Length[nc]=Length;
+  ECT->Children[2*nc+0]=ECT->Children[2*nc+1]=-1;
+
+  /*--------------------------------------------------------------*/
+  /*- bounding sphere: the center is the center of the bounding   */
+  /*- box of the edge centroids, and the sphere encloses the      */
+  /*- supports of all basis functions                             */
+  /*--------------------------------------------------------------*/
+  int *Edges=ECT->Edges + Start;
+  double XMin[3], XMax[3];
+  VecCopy(S->Edges[Edges[0]]->Centroid, XMin);
+  VecCopy(S->Edges[Edges[0]]->Centroid, XMax);
+  for(int n=1; n<Length; n++)
+   for(int i=0; i<3; i++)
+    { double X=S->Edges[Edges[n]]->Centroid[i];
+      XMin[i] = fmin(XMin[i], X);
+      XMax[i] = fmax(XMax[i], X);
+    };
+
+  double *Center = ECT->Centers + 3*nc;
+  for(int i=0; i<3; i++)
+   Center[i] = 0.5*(XMin[i] + XMax[i]);
+
+  double Radius=0.0;
+  for(int n=0; n<Length; n++)
+   { RWGEdge *E=S->Edges[Edges[n]];
+     Radius = fmax(Radius, VecDistance(E->Centroid, Center) + E->Radius);
+   };
+  ECT->Radii[nc]=Radius;
+
+  if (Length<=MaxLeafSize)
+   { for(int n=0; n<Length; n++)
+      ECT->LeafOf[ Edges[n] ] = nc;
+     return nc;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- split at the median along the longest axis ------------------*/
+  /*--------------------------------------------------------------*/
+  CentroidLess Less;
+  Less.S=S;
+  Less.Axis=0;
+  for(int i=1; i<3; i++)
+   if ( (XMax[i]-XMin[i]) > (XMax[Less.Axis]-XMin[Less.Axis]) )
+    Less.Axis=i;
+
+  int Length1=Length/2;
+  std::nth_element(Edges, Edges+Length1, Edges+Length, Less);
+  int Child0 = AddClusterNode(ECT, S, Start, Length1, MaxLeafSize);
+  int Child1 = AddClusterNode(ECT, S, Start+Length1, Length-Length1, MaxLeafSize);
+  ECT->Children[2*nc+0]=Child0;
+  ECT->Children[2*nc+1]=Child1;
+  return nc;
+}
+
+EdgeClusterTree *CreateEdgeClusterTree(RWGSurface *S, int MaxLeafSize)
+{
+  int NE=S->NumEdges;
+  int MaxNodes=2*NE;
+  EdgeClusterTree *ECT=(EdgeClusterTree *)mallocEC(sizeof(EdgeClusterTree));
+  ECT->Edges    = (int *)mallocEC(NE*sizeof(int));
+  ECT->LeafOf   = (int *)mallocEC(NE*sizeof(int));
+  ECT->Start    = (int *)mallocEC(MaxNodes*sizeof(int));
+  ECT->Length   = (int *)mallocEC(MaxNodes*sizeof(int));
+  ECT->Children = (int *)mallocEC(2*MaxNodes*sizeof(int));
+  ECT->Centers  = (double *)mallocEC(3*MaxNodes*sizeof(double));
+  ECT->Radii    = (double *)mallocEC(MaxNodes*sizeof(double));
+
+  for(int ne=0; ne<NE; ne++)
+   ECT->Edges[ne]=ne;
+  ECT->MaxPanelRadius=0.0;
+  for(int np=0; np<S->NumPanels; np++)
+   ECT->MaxPanelRadius=fmax(ECT->MaxPanelRadius, S->Panels[np]->Radius);
+  ECT->NumClusters=0;
+  if (NE>0)
+   AddClusterNode(ECT, S, 0, NE, MaxLeafSize);
+
+  return ECT;
+}
+
+void DestroyEdgeClusterTree(EdgeClusterTree *ECT)
+{
+  if (!ECT) return;
+  free(ECT->Edges);
+  free(ECT->LeafOf);
+  free(ECT->Start);
+  free(ECT->Length);
+  free(ECT->Children);
+  free(ECT->Centers);
+  free(ECT->Radii);
+  free(ECT);
+}
+
+/***************************************************************/
+/* truncation order needed to evaluate the interaction of two  */
+/* clusters with radii summing to RSum and centers separated   */
+/* by Distance to relative accuracy Tol.                       */
+/* the l-th term of the addition theorem for e^{ikr}/r is      */
+/* bounded by (2l+1) |j_l(kRSum) h_l(kD)|, which we normalize  */
+/* by |h_0(kD)| ~ 1/kD; this reduces to (RSum/D)^l in the      */
+/* static limit and falls off rapidly once l exceeds kRSum,    */
+/* so it covers both the geometric and the oscillatory regime. */
+/* we return the smallest L for which the first neglected      */
+/* term is below Tol, or -1 if that would take more than       */
+/* MP_MAXL terms, i.e. if the clusters are not well-separated. */
+/***************************************************************/
+int GetMultipoleOrder(cdouble k, double RSum, double Distance, double Tol)
+{
+  if ( Distance <= RSum || Tol<=0.0 )
+   return -1;
+
+  double Kappa=abs(k);
+  double Term[MP_MAXL+2];
+  if ( Kappa*Distance < 1.0e-3 )
+   { for(int l=0; l<=MP_MAXL+1; l++)
+      Term[l] = pow(RSum/Distance, l);
+   }
+  else
+   { cdouble jl[MP_MAXL+2], hl[MP_MAXL+2];
+     AmosBessel('j', Kappa*RSum, 0.0, MP_MAXL+2, false, jl, 0);
+     AmosBessel('o', Kappa*Distance, 0.0, MP_MAXL+2, false, hl, 0);
+     for(int l=0; l<=MP_MAXL+1; l++)
+      Term[l] = (2.0*l+1.0)*Kappa*Distance*abs(jl[l]*hl[l]);
+   };
+
+  for(int L=1; L<=MP_MAXL; L++)
+   if ( Term[L+1] < Tol )
+    return L;
+  return -1;
+}
+
+/***************************************************************/
+/* regular scalar helmholtz solutions R_{lm}=j_l(kr)Y_{lm}     */
+/* and their cartesian gradients at X for all l<=L.            */
+/* we evaluate j_l(kr) with complex argument directly rather   */
+/* than through GetRadialFunctions, which switches to          */
+/* modified bessel functions for imaginary k; the translation  */
+/* matrices use h_l^(1) and j_l for all complex k, so this     */
+/* keeps the addition theorem consistent at imaginary          */
+/* frequencies.                                                */
+/* Work must have space for 2*(L+1)^2 + L+3 cdoubles.          */
+/***************************************************************/
+static void GetRegularSolutions(int L, cdouble k, double X[3],
+                                cdouble *R, cdouble *GradR, cdouble *Work)
+{
+  int NA=(L+1)*(L+1);
+  cdouble *Ylm=Work, *dYlm=Work+NA, *jl=Work+2*NA;
+
+  double r, Theta, Phi;
+  CoordinateC2S(X, &r, &Theta, &Phi);
+
+  // the expansion center may coincide with a cubature point
+  if (r==0.0) r=1.0e-12;
+
+  // the Ylm are smooth at the poles, but the phi component of
+  // the gradient below involves 1/sin(theta)
+  if (Theta<1.0e-6) Theta=1.0e-6;
+  if (Theta>M_PI-1.0e-6) Theta=M_PI-1.0e-6;
+
+  AmosBessel('j', k*r, 0.0, L+2, false, jl, 0);
+  GetYlmDerivArray(L, Theta, Phi, Ylm, dYlm);
+
+  // rows of the spherical-to-cartesian rotation (see VectorS2C)
+  double CT=cos(Theta), ST=sin(Theta), CP=cos(Phi), SP=sin(Phi);
+  double M[3][3]={ {ST*CP, CT*CP, -SP}, {ST*SP, CT*SP, CP}, {CT, -ST, 0.0} };
+
+  for(int l=0, Alpha=0; l<=L; l++)
+   {
+     cdouble dRdr = k*( ((double)l)*jl[l]/(k*r) - jl[l+1] );
+     for(int m=-l; m<=l; m++, Alpha++)
+      { R[Alpha] = jl[l]*Ylm[Alpha];
+        cdouble GS[3];
+        GS[0] = dRdr*Ylm[Alpha];
+        GS[1] = jl[l]*dYlm[Alpha]/r;
+        GS[2] = II*((double)m)*jl[l]*Ylm[Alpha]/(r*ST);
+        cdouble *G = GradR + 3*Alpha;
+        for(int i=0; i<3; i++)
+         G[i] = M[i][0]*GS[0] + M[i][1]*GS[1] + M[i][2]*GS[2];
+      };
+   };
+}
+
+/***************************************************************/
+/* fill in the moments (see the file header) of the NE RWG     */
+/* functions Edges[0..NE-1] on surface S about Center. the     */
+/* moments do not change if the surface and the center are     */
+/* displaced together, so displacements only enter through the */
+/* translation matrices. either RowMoments (2NE x 4NA) or      */
+/* ColMoments (4NE x NA) may be 0.                             */
+/***************************************************************/
+void GetEdgeClusterMoments(RWGSurface *S, int *Edges, int NE,
+                           double *Center, cdouble k, int L,
+                           HMatrix *RowMoments, HMatrix *ColMoments)
+{
+  int NA=(L+1)*(L+1);
+  if (RowMoments) RowMoments->Zero();
+  if (ColMoments) ColMoments->Zero();
+
+  cdouble *R     = new cdouble[4*NA];
+  cdouble *GradR = R + NA;
+  cdouble *Work  = new cdouble[2*NA + L + 3];
+  cdouble *Vec   = new cdouble[8*NA];
+  cdouble *Div   = Vec + 3*NA;
+  cdouble *Curl  = Vec + 4*NA;
+  cdouble k2=k*k;
+
+  int NCP;
+  double *TCR=GetTCR(MP_TCRORDER, &NCP);
+
+  for(int n=0; n<NE; n++)
+   {
+     int ne=Edges[n];
+     RWGEdge *E=S->Edges[ne];
+     for(int n8=0; n8<8*NA; n8++)
+      Vec[n8]=0.0;
+
+     /*--------------------------------------------------------------*/
+     /*- integrate over the positive and negative panels -------------*/
+     /*--------------------------------------------------------------*/
+     for(int PM=0; PM<2; PM++)
+      {
+        int np    = (PM==0) ? E->iPPanel : E->iMPanel;
+        int iQ    = (PM==0) ? E->iQP     : E->iQM;
+        double Sign = (PM==0) ? 1.0 : -1.0;
+        if (np==-1) continue;
+
+        RWGPanel *P = S->Panels[np];
+        double *V0  = S->Vertices + 3*P->VI[0];
+        double *V1  = S->Vertices + 3*P->VI[1];
+        double *V2  = S->Vertices + 3*P->VI[2];
+        double *Q   = S->Vertices + 3*iQ;
+        double Area = P->Area;
+        double PreFac = Sign*E->Length/(2.0*Area);
+        double DivF   = Sign*E->Length/Area;
+
+        for(int ncp=0; ncp<NCP; ncp++)
+         {
+           double u=TCR[3*ncp+0], v=TCR[3*ncp+1], w=TCR[3*ncp+2]*2.0*Area;
+
+           double X[3], F[3], XmC[3];
+           for(int i=0; i<3; i++)
+            { X[i]   = V0[i] + u*(V1[i]-V0[i]) + v*(V2[i]-V0[i]);
+              F[i]   = PreFac*(X[i]-Q[i]);
+              XmC[i] = X[i] - Center[i];
+            };
+
+           GetRegularSolutions(L, k, XmC, R, GradR, Work);
+
+           for(int Alpha=0; Alpha<NA; Alpha++)
+            { cdouble wR=w*R[Alpha];
+              cdouble *G=GradR + 3*Alpha;
+              Vec[3*Alpha+0] += wR*F[0];
+              Vec[3*Alpha+1] += wR*F[1];
+              Vec[3*Alpha+2] += wR*F[2];
+              Div[Alpha]     += wR*DivF;
+              Curl[3*Alpha+0] += w*(G[1]*F[2] - G[2]*F[1]);
+              Curl[3*Alpha+1] += w*(G[2]*F[0] - G[0]*F[2]);
+              Curl[3*Alpha+2] += w*(G[0]*F[1] - G[1]*F[0]);
+            };
+         };
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- pack into the moment matrices -------------------------------*/
+     /*--------------------------------------------------------------*/
+     if (RowMoments)
+      for(int Alpha=0; Alpha<NA; Alpha++)
+       { for(int i=0; i<3; i++)
+          { RowMoments->SetEntry(n,    4*Alpha+i, Vec[3*Alpha+i]);
+            RowMoments->SetEntry(NE+n, 4*Alpha+i, Curl[3*Alpha+i]);
+          };
+         RowMoments->SetEntry(n, 4*Alpha+3, -1.0*Div[Alpha]/k2);
+       };
+
+     if (ColMoments)
+      for(int l=0, Alpha=0; l<=L; l++)
+       for(int m=-l; m<=l; m++, Alpha++)
+        { int AlphaTilde = LM2ALPHA(l,-m);
+          double Sign = (m%2) ? -1.0 : 1.0;
+          for(int i=0; i<3; i++)
+           ColMoments->SetEntry(4*n+i, Alpha, Sign*Vec[3*AlphaTilde+i]);
+          ColMoments->SetEntry(4*n+3, Alpha, Sign*Div[AlphaTilde]);
+        };
+   };
+
+  delete[] Vec;
+  delete[] Work;
+  delete[] R;
+}
+
+/***************************************************************/
+/* interactions of all edges a in cluster A with all edges b   */
+/* in cluster B at truncation order L (which may be lower than */
+/* the order at which the moments were computed):              */
+/*  E(a,b)    = GC0(a,b) / (ik)                                */
+/*  E(NEa+a,b)= GC1(a,b)                                       */
+/* CenterB includes any displacement of surface B.             */
+/***************************************************************/
+void GetClusterPairInteractions(HMatrix *RowMomentsA,
+                                HMatrix *ColMomentsB,
+                                double *CenterA, double *CenterB,
+                                cdouble k, int L, HMatrix *E)
+{
+  int NA   = (L+1)*(L+1);
+  int NEa2 = RowMomentsA->NR;
+  int NEb4 = ColMomentsB->NR;
+  int NEb  = NEb4/4;
+  if ( RowMomentsA->NC<4*NA || ColMomentsB->NC<NA || E->NR!=NEa2 || E->NC!=NEb )
+   ErrExit("%s:%i: internal error",__FILE__,__LINE__);
+
+  double Xij[3];
+  VecSub(CenterB, CenterA, Xij);
+  HMatrix *A = new HMatrix(NA, NA, LHM_COMPLEX);
+  GetTranslationMatrices(Xij, k, L, A, 0, 0);
+
+  // leading columns of the moment matrices, which are contiguous
+  HMatrix RowA(NEa2, 4*NA, LHM_COMPLEX, RowMomentsA->ZM);
+  HMatrix ColB(NEb4, NA,   LHM_COMPLEX, ColMomentsB->ZM);
+
+  // ZT(4b+i, gamma) = \sum_beta ColB(4b+i, beta) A(beta, gamma)
+  HMatrix *ZT = new HMatrix(NEb4, NA, LHM_COMPLEX);
+  ColB.Multiply(A, ZT);
+
+  // Z(4gamma+i, b) = ZT(4b+i, gamma)
+  HMatrix *Z = new HMatrix(4*NA, NEb, LHM_COMPLEX);
+  for(int Gamma=0; Gamma<NA; Gamma++)
+   for(int b=0; b<NEb; b++)
+    memcpy(Z->ZM + 4*Gamma + 4*NA*b, ZT->ZM + 4*b + NEb4*Gamma, 4*sizeof(cdouble));
+  RowA.Multiply(Z, E);
+
+  delete Z;
+  delete ZT;
+  delete A;
+}
+
+/***************************************************************/
+/* split the interactions between the edges of two cluster     */
+/* trees into well-separated ('far') cluster pairs, which are  */
+/* as large as possible, and pairs of leaf clusters that are   */
+/* not well-separated ('near'). a cluster pair is far if the   */
+/* multipole expansion converges to accuracy Tol in all active */
+/* regions (Active[nr]) with wavenumbers k[nr], and if this is */
+/* cheaper than computing its interactions directly; the       */
+/* orders are stored in Orders[2*nfp + nr] (-1 for inactive    */
+/* regions).                                                   */
+/* if Symmetric is true, then the two trees are the same and   */
+/* each unordered pair of edges is covered only once.          */
+/* CentersB are the centers of tree B including displacement. */
+/***************************************************************/
+static void PartitionClusterPair(EdgeClusterTree *CTa, EdgeClusterTree *CTb,
+                                 double *CentersB, int nca, int ncb,
+                                 bool Symmetric, cdouble k[2], bool Active[2],
+                                 double Tol, ClusterPartition *CP)
+{
+  int *ChildrenA=CTa->Children + 2*nca;
+  int *ChildrenB=CTb->Children + 2*ncb;
+  bool LeafA = (ChildrenA[0]==-1), LeafB = (ChildrenB[0]==-1);
+
+  if (Symmetric && nca==ncb)
+   { if (LeafA)
+      { CP->NearA.push_back(nca);
+        CP->NearB.push_back(ncb);
+      }
+     else
+      { PartitionClusterPair(CTa, CTb, CentersB, ChildrenA[0], ChildrenA[0], Symmetric, k, Active, Tol, CP);
+        PartitionClusterPair(CTa, CTb, CentersB, ChildrenA[0], ChildrenA[1], Symmetric, k, Active, Tol, CP);
+        PartitionClusterPair(CTa, CTb, CentersB, ChildrenA[1], ChildrenA[1], Symmetric, k, Active, Tol, CP);
+      };
+     return;
+   };
+
+  double RSum = CTa->Radii[nca] + CTb->Radii[ncb];
+  double D    = VecDistance(CTa->Centers + 3*nca, CentersB + 3*ncb);
+  int Orders[2]={-1,-1};
+
+  // all panel pairs must be far enough apart for the direct
+  // calculation to use the same low-order cubature as the moments
+  double RMax = fmax(CTa->MaxPanelRadius, CTb->MaxPanelRadius);
+  bool Far = ( D-RSum >= MP_MINGAP*RMax );
+  double NEa=CTa->Length[nca], NEb=CTb->Length[ncb];
+  double MPCost=0.0, DirectCost=0.0;
+  for(int nr=0; nr<2 && Far; nr++)
+   if (Active[nr])
+    { Orders[nr]=GetMultipoleOrder(k[nr], RSum, D, Tol);
+      Far = (Orders[nr]>=0);
+      double NA=(Orders[nr]+1)*(Orders[nr]+1);
+      MPCost += MP_TRANSLATIONCOST*NA*NA + MP_MOMENTCOST*NA*(NEa+NEb);
+      DirectCost += NEa*NEb;
+    };
+
+  // small, nearby cluster pairs are cheaper to handle directly
+  if ( Far && MPCost>=DirectCost )
+   Far=false;
+
+  if (Far)
+   { CP->FarA.push_back(nca);
+     CP->FarB.push_back(ncb);
+     CP->Orders.push_back(Orders[0]);
+     CP->Orders.push_back(Orders[1]);
+   }
+  else if (LeafA && LeafB)
+   { CP->NearA.push_back(nca);
+     CP->NearB.push_back(ncb);
+   }
+  else if ( LeafB || (!LeafA && CTa->Radii[nca]>=CTb->Radii[ncb]) )
+   { PartitionClusterPair(CTa, CTb, CentersB, ChildrenA[0], ncb, Symmetric, k, Active, Tol, CP);
+     PartitionClusterPair(CTa, CTb, CentersB, ChildrenA[1], ncb, Symmetric, k, Active, Tol, CP);
+   }
+  else
+   { PartitionClusterPair(CTa, CTb, CentersB, nca, ChildrenB[0], Symmetric, k, Active, Tol, CP);
+     PartitionClusterPair(CTa, CTb, CentersB, nca, ChildrenB[1], Symmetric, k, Active, Tol, CP);
+   };
+}
+
+void PartitionClusterPairs(EdgeClusterTree *CTa, EdgeClusterTree *CTb,
+                           double *Displacement, bool Symmetric,
+                           cdouble k[2], bool Active[2], double Tol,
+                           ClusterPartition *CP)
+{
+  CP->FarA.clear();  CP->FarB.clear();  CP->Orders.clear();
+  CP->NearA.clear(); CP->NearB.clear();
+  if (CTa->NumClusters==0 || CTb->NumClusters==0)
+   return;
+
+  int NCb=CTb->NumClusters;
+  double *CentersB=CTb->Centers;
+  if (Displacement)
+   { CentersB = new double[3*NCb];
+     for(int ncb=0; ncb<NCb; ncb++)
+      VecAdd(CTb->Centers + 3*ncb, Displacement, CentersB + 3*ncb);
+   };
+
+  PartitionClusterPair(CTa, CTb, CentersB, 0, 0, Symmetric, k, Active, Tol, CP);
+
+  if (Displacement)
+   delete[] CentersB;
+}
+
+/***************************************************************/
+/* data on one block of the BEM matrix: the cluster trees of   */
+/* the two surfaces, their partition into near and far pairs,  */
+/* and a table of leaf pairs (Far[ncla*NCb+nclb]) whose edge   */
+/* pairs are handled by AddMultipoleInteractions.              */
+/***************************************************************/
+typedef struct MultipoleBlock
+ { EdgeClusterTree *CTa, *CTb; // CTb==CTa if Sa==Sb
+   ClusterPartition CP;
+   bool *Far;
+ } MultipoleBlock;
+
+static bool MultipoleRegionActive(GetSSIArgStruct *Args, int nr)
+{ return nr==0 ? (Args->EpsA!=0.0) : (Args->EpsB!=0.0); }
+
+static cdouble MultipoleRegionk(GetSSIArgStruct *Args, int nr)
+{ return nr==0 ? csqrt2(Args->EpsA*Args->MuA)*Args->Omega
+               : csqrt2(Args->EpsB*Args->MuB)*Args->Omega;
+}
+
+// mark all pairs of leaves below clusters nca, ncb as far
+static void MarkFarLeaves(MultipoleBlock *MPB, int nca, int ncb, bool Symmetric)
+{
+  int *ChildrenA=MPB->CTa->Children + 2*nca;
+  int *ChildrenB=MPB->CTb->Children + 2*ncb;
+  if (ChildrenA[0]!=-1)
+   { MarkFarLeaves(MPB, ChildrenA[0], ncb, Symmetric);
+     MarkFarLeaves(MPB, ChildrenA[1], ncb, Symmetric);
+   }
+  else if (ChildrenB[0]!=-1)
+   { MarkFarLeaves(MPB, nca, ChildrenB[0], Symmetric);
+     MarkFarLeaves(MPB, nca, ChildrenB[1], Symmetric);
+   }
+  else
+   { int NCb=MPB->CTb->NumClusters;
+     MPB->Far[nca*NCb + ncb]=true;
+     if (Symmetric)
+      MPB->Far[ncb*NCb + nca]=true;
+   };
+}
+
+/***************************************************************/
+/* decide whether the multipole method applies to this block   */
+/* and, if so, set up Args->MPBlock. called from InitSSIBlock. */
+/***************************************************************/
+bool InitMultipoleBlock(GetSSIArgStruct *Args)
+{
+  Args->MPBlock=0;
+
+  double Tol=RWGGeometry::MultipoleTol;
+  if ( Tol<=0.0 )
+   return false;
+  if ( Args->GBA1 || Args->GBA2 || Args->GradB || Args->NumTorqueAxes>0 )
+   return false;
+  if ( RWGGeometry::UsePanelPairAssembly )
+   return false;
+
+  RWGSurface *Sa=Args->Sa, *Sb=Args->Sb;
+  MultipoleBlock *MPB=new MultipoleBlock;
+  MPB->CTa = CreateEdgeClusterTree(Sa, MP_LEAFSIZE);
+  MPB->CTb = (Sa==Sb) ? MPB->CTa : CreateEdgeClusterTree(Sb, MP_LEAFSIZE);
+  MPB->Far = 0;
+  Args->MPBlock=MPB;
+
+  cdouble k[2];
+  bool Active[2];
+  for(int nr=0; nr<2; nr++)
+   { k[nr]=MultipoleRegionk(Args, nr);
+     Active[nr]=MultipoleRegionActive(Args, nr);
+   };
+  PartitionClusterPairs(MPB->CTa, MPB->CTb, Args->Displacement,
+                        Args->Symmetric && Sa==Sb, k, Active, Tol, &(MPB->CP));
+
+  int NumFarPairs=MPB->CP.FarA.size();
+  if (NumFarPairs==0)
+   { DestroyMultipoleBlock(Args);
+     return false;
+   };
+
+  int NCa=MPB->CTa->NumClusters, NCb=MPB->CTb->NumClusters;
+  MPB->Far = (bool *)mallocEC(((size_t)NCa)*NCb*sizeof(bool));
+  for(int nfp=0; nfp<NumFarPairs; nfp++)
+   MarkFarLeaves(MPB, MPB->CP.FarA[nfp], MPB->CP.FarB[nfp], Args->Symmetric);
+
+  if (Args->G->LogLevel>=SCUFF_VERBOSE2)
+   { size_t NumFarEntries=0;
+     for(int nfp=0; nfp<NumFarPairs; nfp++)
+      NumFarEntries += ((size_t)MPB->CTa->Length[MPB->CP.FarA[nfp]])
+                       *MPB->CTb->Length[MPB->CP.FarB[nfp]];
+     Log(" multipole: %i far cluster pairs covering %lu edge pairs, %i near leaf pairs",
+         NumFarPairs,(unsigned long)NumFarEntries,(int)MPB->CP.NearA.size());
+   };
+
+  return true;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+bool IsMultipolePair(MultipoleBlock *MPB, int nea, int neb)
+{
+  int NCb=MPB->CTb->NumClusters;
+  return MPB->Far[ MPB->CTa->LeafOf[nea]*NCb + MPB->CTb->LeafOf[neb] ];
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void DestroyMultipoleBlock(GetSSIArgStruct *Args)
+{
+  MultipoleBlock *MPB=Args->MPBlock;
+  if (!MPB) return;
+  if (MPB->CTb!=MPB->CTa)
+   DestroyEdgeClusterTree(MPB->CTb);
+  DestroyEdgeClusterTree(MPB->CTa);
+  if (MPB->Far) free(MPB->Far);
+  delete MPB;
+  Args->MPBlock=0;
+}
+
+/***************************************************************/
+/* stamp the contributions of one region to the BEM matrix     */
+/* entries for edges nea, neb, with the same layout and        */
+/* prefactors as in GSSIThread.                                */
+/***************************************************************/
+static void AddEdgePairEntries(GetSSIArgStruct *Args, int nea, int neb,
+                               cdouble PreFac1, cdouble PreFac2, cdouble PreFac3,
+                               cdouble G0, cdouble C0)
+{
+  HMatrix *B=Args->B;
+
+  // symmetric blocks are stored in the upper triangle
+  if ( Args->Symmetric && nea>neb )
+   std::swap(nea, neb);
+
+  if ( Args->SaIsPEC && Args->SbIsPEC )
+   B->AddEntry(Args->RowOffset + nea, Args->ColOffset + neb, PreFac1*G0);
+  else if ( Args->SaIsPEC && !Args->SbIsPEC )
+   { int X=Args->RowOffset + nea, Y=Args->ColOffset + 2*neb;
+     B->AddEntry(X, Y,   PreFac1*G0);
+     B->AddEntry(X, Y+1, PreFac2*C0);
+   }
+  else if ( !Args->SaIsPEC && Args->SbIsPEC )
+   { int X=Args->RowOffset + 2*nea, Y=Args->ColOffset + neb;
+     B->AddEntry(X,   Y, PreFac1*G0);
+     B->AddEntry(X+1, Y, PreFac2*C0);
+   }
+  else
+   { int X=Args->RowOffset + 2*nea, Y=Args->ColOffset + 2*neb;
+     B->AddEntry(X,   Y,   PreFac1*G0);
+     B->AddEntry(X,   Y+1, PreFac2*C0);
+     B->AddEntry(X+1, Y,   PreFac2*C0);
+     B->AddEntry(X+1, Y+1, PreFac3*G0);
+   };
+}
+
+/***************************************************************/
+/* fill in the BEM matrix entries for all edge pairs skipped   */
+/* by GSSIThread. called from FinishSSIBlock.                  */
+/***************************************************************/
+void AddMultipoleInteractions(GetSSIArgStruct *Args)
+{
+  MultipoleBlock *MPB=Args->MPBlock;
+  if (!MPB) return;
+
+  RWGSurface *Sa=Args->Sa, *Sb=Args->Sb;
+  EdgeClusterTree *CTa=MPB->CTa, *CTb=MPB->CTb;
+  ClusterPartition *CP=&(MPB->CP);
+  int NCa=CTa->NumClusters, NCb=CTb->NumClusters;
+  int NumFarPairs=CP->FarA.size();
+  double *DB=Args->Displacement;
+  double T0=Secs();
+
+  // far pairs sorted by row cluster; the row moments of each
+  // cluster are only needed by the thread handling that cluster
+  int *SortedPairs=new int[NumFarPairs];
+  int *PairStart=new int[NCa+1];
+  memset(PairStart, 0, (NCa+1)*sizeof(int));
+  for(int nfp=0; nfp<NumFarPairs; nfp++)
+   PairStart[ CP->FarA[nfp]+1 ]++;
+  for(int nca=0; nca<NCa; nca++)
+   PairStart[nca+1]+=PairStart[nca];
+  int *Fill=new int[NCa];
+  memcpy(Fill, PairStart, NCa*sizeof(int));
+  for(int nfp=0; nfp<NumFarPairs; nfp++)
+   SortedPairs[ Fill[CP->FarA[nfp]]++ ] = nfp;
+  delete[] Fill;
+
+  for(int nr=0; nr<2; nr++)
+   {
+     if (!MultipoleRegionActive(Args, nr)) continue;
+
+     cdouble Eps  = nr==0 ? Args->EpsA  : Args->EpsB;
+     cdouble Mu   = nr==0 ? Args->MuA   : Args->MuB;
+     double  Sign = nr==0 ? Args->SignA : Args->SignB;
+     cdouble Omega= Args->Omega;
+     cdouble k    = MultipoleRegionk(Args, nr);
+     cdouble PreFac1 =  Sign*II*Mu*Omega;
+     cdouble PreFac2 = -Sign*II*k;
+     cdouble PreFac3 = -Sign*II*Eps*Omega;
+
+     /*--------------------------------------------------------------*/
+     /*- orders needed for the moments of each cluster --------------*/
+     /*--------------------------------------------------------------*/
+     int *LRow=new int[NCa], *LCol=new int[NCb];
+     for(int nca=0; nca<NCa; nca++) LRow[nca]=-1;
+     for(int ncb=0; ncb<NCb; ncb++) LCol[ncb]=-1;
+     for(int nfp=0; nfp<NumFarPairs; nfp++)
+      { int L=CP->Orders[2*nfp+nr];
+        LRow[CP->FarA[nfp]] = std::max(LRow[CP->FarA[nfp]], L);
+        LCol[CP->FarB[nfp]] = std::max(LCol[CP->FarB[nfp]], L);
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- column moments of all b clusters in a far pair --------------*/
+     /*--------------------------------------------------------------*/
+     HMatrix **ColMoments=new HMatrix *[NCb];
+     for(int ncb=0; ncb<NCb; ncb++)
+      ColMoments[ncb] = LCol[ncb]<0 ? 0 :
+       new HMatrix(4*CTb->Length[ncb], (LCol[ncb]+1)*(LCol[ncb]+1), LHM_COMPLEX);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(GetNumThreads())
+#endif
+     for(int ncb=0; ncb<NCb; ncb++)
+      if (ColMoments[ncb])
+       GetEdgeClusterMoments(Sb, CTb->Edges + CTb->Start[ncb], CTb->Length[ncb],
+                             CTb->Centers + 3*ncb, k, LCol[ncb], 0, ColMoments[ncb]);
+
+     /*--------------------------------------------------------------*/
+     /*- loop over row clusters --------------------------------------*/
+     /*--------------------------------------------------------------*/
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(GetNumThreads())
+#endif
+     for(int nca=0; nca<NCa; nca++)
+      {
+        if (PairStart[nca]==PairStart[nca+1]) continue;
+
+        int *EdgesA=CTa->Edges + CTa->Start[nca];
+        int NEa=CTa->Length[nca];
+        int NAa=(LRow[nca]+1)*(LRow[nca]+1);
+        HMatrix *RowMoments=new HMatrix(2*NEa, 4*NAa, LHM_COMPLEX);
+        GetEdgeClusterMoments(Sa, EdgesA, NEa, CTa->Centers + 3*nca,
+                              k, LRow[nca], RowMoments, 0);
+
+        for(int np=PairStart[nca]; np<PairStart[nca+1]; np++)
+         {
+           int nfp=SortedPairs[np];
+           int ncb=CP->FarB[nfp];
+           int *EdgesB=CTb->Edges + CTb->Start[ncb];
+           int NEb=CTb->Length[ncb];
+
+           double CenterB[3];
+           VecCopy(CTb->Centers + 3*ncb, CenterB);
+           if (DB) VecPlusEquals(CenterB, 1.0, DB);
+
+           HMatrix *E=new HMatrix(2*NEa, NEb, LHM_COMPLEX);
+           GetClusterPairInteractions(RowMoments, ColMoments[ncb],
+                                      CTa->Centers + 3*nca, CenterB,
+                                      k, CP->Orders[2*nfp+nr], E);
+
+           for(int b=0; b<NEb; b++)
+            for(int a=0; a<NEa; a++)
+             AddEdgePairEntries(Args, EdgesA[a], EdgesB[b],
+                                PreFac1, PreFac2, PreFac3,
+                                II*k*E->GetEntry(a,b), E->GetEntry(NEa+a,b));
+           delete E;
+         };
+        delete RowMoments;
+      };
+
+     for(int ncb=0; ncb<NCb; ncb++)
+      if (ColMoments[ncb]) delete ColMoments[ncb];
+     delete[] ColMoments;
+     delete[] LRow;
+     delete[] LCol;
+   };
+
+  delete[] SortedPairs;
+  delete[] PairStart;
+
+  if (Args->G->LogLevel>=SCUFF_VERBOSE2)
+   Log(" multipole: block (%i,%i) far field in %.3f s",Sa->Index,Sb->Index,Secs()-T0);
+}
+
+/***************************************************************/
+/* multipole evaluation of the G and C integrals for a single  */
+/* pair of edges, taken as one-edge clusters about their       */
+/* centroids. returns false (leaving Args->GC untouched) if    */
+/* the edges are too close for the expansion to converge to    */
+/* the requested accuracy, or if the caller wants derivatives  */
+/* or the periodic kernel, which are not implemented.          */
+/***************************************************************/
+bool GetEEIMultipole(GetEEIArgStruct *Args)
+{
+  if ( Args->GBA || Args->NumGradientComponents>0 || Args->NumTorqueAxes>0 )
+   return false;
+
+  RWGSurface *Sa=Args->Sa, *Sb=Args->Sb;
+  RWGEdge *Ea=Sa->Edges[Args->nea], *Eb=Sb->Edges[Args->neb];
+  cdouble k=Args->k;
+  double *DB=Args->Displacement;
+
+  double CB[3];
+  for(int i=0; i<3; i++)
+   CB[i] = Eb->Centroid[i] + (DB ? DB[i] : 0.0);
+
+  double Tol = RWGGeometry::MultipoleTol>0.0 ? RWGGeometry::MultipoleTol : MP_DEFAULTTOL;
+  int L=GetMultipoleOrder(k, Ea->Radius + Eb->Radius,
+                          VecDistance(Ea->Centroid, CB), Tol);
+  if (L<0)
+   return false;
+  int NA=(L+1)*(L+1);
+
+  HMatrix RowMoments(2, 4*NA, LHM_COMPLEX);
+  HMatrix ColMoments(4, NA, LHM_COMPLEX);
+  HMatrix E(2, 1, LHM_COMPLEX);
+  GetEdgeClusterMoments(Sa, &(Args->nea), 1, Ea->Centroid, k, L, &RowMoments, 0);
+  GetEdgeClusterMoments(Sb, &(Args->neb), 1, Eb->Centroid, k, L, 0, &ColMoments);
+  GetClusterPairInteractions(&RowMoments, &ColMoments, Ea->Centroid, CB, k, L, &E);
+
+  Args->GC[0] = II*k*E.GetEntry(0,0);
+  Args->GC[1] = E.GetEntry(1,0);
+  return true;
+}
+
+} // namespace scuff
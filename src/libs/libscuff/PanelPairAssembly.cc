@@ -0,0 +1,371 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * PanelPairAssembly.cc -- panel-pair-centric assembly of the matrix
+ *                      -- block describing the interactions of two
+ *                      -- surfaces
+ *
+ * The usual assembly path (GSSIThread in SurfaceSurfaceInteractions.cc)
+ * loops over pairs of RWG edges and computes each edge-edge interaction
+ * as a sum of four panel-panel integrals (PPIs). Since each panel has
+ * three edges, each panel pair is thus integrated once for every edge
+ * pair to which it contributes, i.e. up to nine times.
+ *
+ * The routines in this file instead loop over panel pairs, compute
+ * the PPIs for all nine (iQa, iQb) vertex combinations at once using
+ * GetPanelPanelInteractionsAllQ(), and scatter the results to the
+ * affected edge pairs.
+ *
+ * This path is selected by setting RWGGeometry::UsePanelPairAssembly
+ * (or the environment variable SCUFF_PANEL_PAIR_ASSEMBLY=1).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <libhmat.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#ifdef USE_PTHREAD
+#  include <pthread.h>
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+namespace scuff {
+
+#define II cdouble(0,1)
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+typedef struct PPThreadData
+ {
+   GetSSIArgStruct *Args;
+   rwlock *RowLocks;
+   unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];
+   int nt, NumTasks;
+
+ } PPThreadData;
+
+/***************************************************************/
+/* add the contributions of a single edge-edge interaction     */
+/* (G, C) in a single medium to the (X,Y) block of B, with the */
+/* same conventions as in GSSIThread. SkipLower is set for     */
+/* diagonal edge pairs of symmetric blocks, for which only the */
+/* upper triangle is computed.                                 */
+/***************************************************************/
+static void StampGC(HMatrix *B, int X, int Y,
+                    bool SaIsPEC, bool SbIsPEC, bool SkipLower,
+                    cdouble PreFac1, cdouble PreFac2, cdouble PreFac3,
+                    cdouble G, cdouble C)
+{
+  if ( SaIsPEC && SbIsPEC )
+   B->AddEntry(X, Y, PreFac1*G);
+  else if ( SaIsPEC && !SbIsPEC )
+   { B->AddEntry(X, Y,   PreFac1*G);
+     B->AddEntry(X, Y+1, PreFac2*C);
+   }
+  else if ( !SaIsPEC && SbIsPEC )
+   { B->AddEntry(X,   Y, PreFac1*G);
+     B->AddEntry(X+1, Y, PreFac2*C);
+   }
+  else
+   { B->AddEntry(X,   Y,   PreFac1*G);
+     B->AddEntry(X,   Y+1, PreFac2*C);
+     if (!SkipLower)
+      B->AddEntry(X+1, Y,   PreFac2*C);
+     B->AddEntry(X+1, Y+1, PreFac3*G);
+   };
+}
+
+/***************************************************************/
+/* Each task handles a subset of the panels on surface Sa.     */
+/* For each such panel npa, we compute the PPIs with all       */
+/* panels npb on Sb (or with panels npb>=npa in the symmetric  */
+/* case) and then scatter the results into the matrix entries  */
+/* for the edge pairs to which they contribute. Since each     */
+/* edge is shared by two panels, the scattering step is        */
+/* guarded by a per-row-edge lock.                             */
+/***************************************************************/
+static void *GSSIPPThread(void *data)
+{
+  /***************************************************************/
+  /* extract local copies of fields in argument structure        */
+  /***************************************************************/
+  PPThreadData *TD     = (PPThreadData *)data;
+  GetSSIArgStruct *Args= TD->Args;
+  RWGGeometry *G       = Args->G;
+  RWGSurface *Sa       = Args->Sa;
+  RWGSurface *Sb       = Args->Sb;
+  cdouble Omega        = Args->Omega;
+  int NumTorqueAxes    = Args->NumTorqueAxes;
+  int RowOffset        = Args->RowOffset;
+  int ColOffset        = Args->ColOffset;
+  bool Symmetric       = Args->Symmetric;
+  HMatrix *B           = Args->B;
+  HMatrix **GradB      = Args->GradB;
+  HMatrix **dBdTheta   = Args->dBdTheta;
+  bool SaIsPEC         = Args->SaIsPEC;
+  bool SbIsPEC         = Args->SbIsPEC;
+
+#ifdef USE_PTHREAD
+  SetCPUAffinity(TD->nt);
+#endif
+
+  memset(TD->PPIAlgorithmCount, 0, NUMPPIALGORITHMS*sizeof(unsigned));
+
+  /***************************************************************/
+  /* precompute the constant prefactors for each medium; a       */
+  /* medium with vanishing wavenumber contributes nothing        */
+  /***************************************************************/
+  cdouble Eps[2], Mu[2], Sign[2];
+  GBarAccelerator *GBA[2];
+  Eps[0]=Args->EpsA; Mu[0]=Args->MuA; Sign[0]=Args->SignA; GBA[0]=Args->GBA1;
+  Eps[1]=Args->EpsB; Mu[1]=Args->MuB; Sign[1]=Args->SignB; GBA[1]=Args->GBA2;
+
+  int NumMedia=0;
+  cdouble k[2], PreFac1[2], PreFac2[2], PreFac3[2];
+  GBarAccelerator *MediumGBA[2];
+  for(int nm=0; nm<2; nm++)
+   { cdouble kk=csqrt2(Eps[nm]*Mu[nm])*Omega;
+     if (kk==0.0) continue;
+     k[NumMedia]         = kk;
+     PreFac1[NumMedia]   =  Sign[nm]*II*Mu[nm]*Omega;
+     PreFac2[NumMedia]   = -Sign[nm]*II*kk;
+     PreFac3[NumMedia]   = -Sign[nm]*II*Eps[nm]*Omega;
+     MediumGBA[NumMedia] = GBA[nm];
+     NumMedia++;
+   };
+  if (NumMedia==0) return 0;
+
+  /***************************************************************/
+  /* initialize an argument structure to be passed to            */
+  /* GetPanelPanelInteractionsAllQ() below                       */
+  /***************************************************************/
+  int NumGradientComponents = GradB ? 3 : 0;
+  GetPPIArgStruct MyGetPPIArgs, *GetPPIArgs=&MyGetPPIArgs;
+  InitGetPPIArgs(GetPPIArgs);
+  GetPPIArgs->Sa                    = Sa;
+  GetPPIArgs->Sb                    = Sb;
+  GetPPIArgs->NumGradientComponents = NumGradientComponents;
+  GetPPIArgs->NumTorqueAxes         = NumTorqueAxes;
+  GetPPIArgs->GammaMatrix           = Args->GammaMatrix;
+  GetPPIArgs->Displacement          = Args->Displacement;
+
+  /***************************************************************/
+  /* buffers for the PPIs of a single panel npa with all panels  */
+  /* npb on surface Sb                                           */
+  /***************************************************************/
+  int NPa=Sa->NumPanels, NPb=Sb->NumPanels;
+  size_t BufSize = ((size_t)NumMedia)*NPb;
+  cdouble *H9Buffer     = new cdouble[18*BufSize];
+  cdouble *GradH9Buffer = NumGradientComponents ? new cdouble[54*BufSize] : 0;
+  cdouble *dHdT9Buffer  = NumTorqueAxes ? new cdouble[54*BufSize] : 0;
+
+  /***************************************************************/
+  /* loop over panels on surface Sa ******************************/
+  /***************************************************************/
+  for(int npa=TD->nt; npa<NPa; npa+=TD->NumTasks)
+   {
+     if (G->LogLevel>=SCUFF_VERBOSE2 && TD->NumTasks==1)
+      LogPercent(npa, NPa);
+
+     RWGPanel *Pa = Sa->Panels[npa];
+     GetPPIArgs->npa = npa;
+
+     /*--------------------------------------------------------------*/
+     /*- compute PPIs for all panel pairs (npa, npb)                 */
+     /*--------------------------------------------------------------*/
+     int npbStart = Symmetric ? npa : 0;
+     for(int npb=npbStart; npb<NPb; npb++)
+      for(int nm=0; nm<NumMedia; nm++)
+       { size_t nBuf = nm*NPb + npb;
+         GetPPIArgs->npb = npb;
+         GetPPIArgs->k   = k[nm];
+         GetPPIArgs->GBA = MediumGBA[nm];
+         GetPanelPanelInteractionsAllQ(GetPPIArgs, H9Buffer + 18*nBuf,
+                                       GradH9Buffer ? GradH9Buffer + 54*nBuf : 0,
+                                       dHdT9Buffer ? dHdT9Buffer + 54*nBuf : 0,
+                                       TD->PPIAlgorithmCount);
+       };
+
+     /*--------------------------------------------------------------*/
+     /*- scatter the PPIs into the affected edge-edge matrix entries -*/
+     /*--------------------------------------------------------------*/
+     for(int npb=npbStart; npb<NPb; npb++)
+      {
+        RWGPanel *Pb = Sb->Panels[npb];
+        for(int iQa=0; iQa<3; iQa++)
+         for(int iQb=0; iQb<3; iQb++)
+          {
+            int nea = Pa->EI[iQa];
+            int neb = Pb->EI[iQb];
+            if (nea<0 || neb<0) continue;
+
+            RWGEdge *Ea  = Sa->Edges[nea];
+            RWGEdge *Eb  = Sb->Edges[neb];
+            double SignA = (Ea->iPPanel==npa) ? 1.0 : -1.0;
+            double SignB = (Eb->iPPanel==npb) ? 1.0 : -1.0;
+            double GPreFac = SignA*SignB*Ea->Length*Eb->Length;
+            int nq = 3*iQa + iQb;
+
+            /*--------------------------------------------------------------*/
+            /*- in the non-symmetric case the panel pair (npa,npb)         -*/
+            /*- contributes only to the (nea,neb) entry. in the symmetric  -*/
+            /*- case we only visit npb>=npa, so for npb>npa we also stamp  -*/
+            /*- the transposed contribution of the pair (npb,npa), and in  -*/
+            /*- both cases we only keep contributions to the upper         -*/
+            /*- triangle, as in GSSIThread.                                -*/
+            /*--------------------------------------------------------------*/
+            int NumStamps=0, RowEdges[2], ColEdges[2];
+            if (!Symmetric || neb>=nea)
+             { RowEdges[NumStamps]=nea; ColEdges[NumStamps]=neb; NumStamps++; };
+            if (Symmetric && npb!=npa && nea>=neb)
+             { RowEdges[NumStamps]=neb; ColEdges[NumStamps]=nea; NumStamps++; };
+
+            for(int ns=0; ns<NumStamps; ns++)
+             {
+               int ner = RowEdges[ns], nec=ColEdges[ns];
+               int X = RowOffset + (SaIsPEC ? 1 : 2)*ner;
+               int Y = ColOffset + (SbIsPEC ? 1 : 2)*nec;
+               bool SkipLower = Symmetric && (ner==nec);
+
+               TD->RowLocks[ner].write_lock();
+               for(int nm=0; nm<NumMedia; nm++)
+                {
+                  size_t nBuf = nm*NPb + npb;
+                  cdouble CPreFac = GPreFac / (II*k[nm]);
+
+                  cdouble *H = H9Buffer + 18*nBuf + 2*nq;
+                  StampGC(B, X, Y, SaIsPEC, SbIsPEC, SkipLower,
+                          PreFac1[nm], PreFac2[nm], PreFac3[nm],
+                          GPreFac*H[0], CPreFac*H[1]);
+
+                  for(int nMu=0; nMu<NumGradientComponents; nMu++)
+                   { if (!GradB[nMu]) continue;
+                     cdouble *GradH = GradH9Buffer + 54*nBuf + 6*nq;
+                     StampGC(GradB[nMu], X, Y, SaIsPEC, SbIsPEC, false,
+                             PreFac1[nm], PreFac2[nm], PreFac3[nm],
+                             GPreFac*GradH[2*nMu+0], CPreFac*GradH[2*nMu+1]);
+                   };
+
+                  for(int nMu=0; nMu<NumTorqueAxes; nMu++)
+                   { cdouble *dHdT = dHdT9Buffer + 54*nBuf + 6*nq;
+                     StampGC(dBdTheta[nMu], X, Y, SaIsPEC, SbIsPEC, false,
+                             PreFac1[nm], PreFac2[nm], PreFac3[nm],
+                             GPreFac*dHdT[2*nMu+0], CPreFac*dHdT[2*nMu+1]);
+                   };
+                }; // for(int nm=0; nm<NumMedia; nm++)
+               TD->RowLocks[ner].write_unlock();
+             }; // for(int ns=0; ns<NumStamps; ns++)
+
+          }; // for(int iQa=0 ...) for(int iQb=0 ...)
+      }; // for(int npb=npbStart; npb<NPb; npb++)
+
+   }; // for(int npa=TD->nt; npa<NPa; npa+=TD->NumTasks)
+
+  delete[] H9Buffer;
+  if (GradH9Buffer) delete[] GradH9Buffer;
+  if (dHdT9Buffer) delete[] dHdT9Buffer;
+
+  return 0;
+}
+
+/***************************************************************/
+/* entry point called from GetSurfaceSurfaceInteractions()     */
+/* after the fields EpsA, MuA, SignA, ... of Args have been    */
+/* filled in. As for the edge-pair path, for symmetric blocks  */
+/* only the upper triangle is computed, and the caller fills   */
+/* in the lower triangle. Derivatives (GradB, dBdTheta) are    */
+/* supported only for non-symmetric blocks.                    */
+/***************************************************************/
+void GetSSIsByPanelPair(GetSSIArgStruct *Args, unsigned *PPIAlgorithmCount)
+{
+  RWGGeometry *G = Args->G;
+  RWGSurface *Sa = Args->Sa;
+
+  if ( Args->Symmetric && (Args->GradB || Args->NumTorqueAxes>0) )
+   ErrExit("%s:%i: derivatives not supported for symmetric panel-pair assembly",__FILE__,__LINE__);
+
+  rwlock *RowLocks = new rwlock[Sa->NumEdges];
+
+  int nt, NumTasks, NumThreads = GetNumThreads();
+#ifdef USE_PTHREAD
+  PPThreadData *TDs = new PPThreadData[NumThreads], *TD;
+  pthread_t *Threads = new pthread_t[NumThreads];
+  for(nt=0; nt<NumThreads; nt++)
+   {
+     TD=&(TDs[nt]);
+     TD->nt=nt;
+     TD->NumTasks=NumThreads;
+     TD->Args=Args;
+     TD->RowLocks=RowLocks;
+     if (nt+1 == NumThreads)
+       GSSIPPThread((void *)TD);
+     else
+       pthread_create( &(Threads[nt]), 0, GSSIPPThread, (void *)TD);
+   }
+  for(nt=0; nt<NumThreads-1; nt++)
+   pthread_join(Threads[nt],0);
+  for(nt=0; nt<NumThreads; nt++)
+   for(int n=0; n<NUMPPIALGORITHMS; n++)
+    PPIAlgorithmCount[n] += TDs[nt].PPIAlgorithmCount[n];
+  delete[] Threads;
+  delete[] TDs;
+#else
+#ifndef USE_OPENMP
+  NumTasks=NumThreads=1;
+  if (G->LogLevel>=SCUFF_VERBOSE2)
+   Log(" no multithreading...");
+#else
+  NumTasks=NumThreads*100;
+  if (NumTasks>Sa->NumPanels)
+   NumTasks=Sa->NumPanels;
+  if (G->LogLevel>=SCUFF_VERBOSE2)
+   Log(" OpenMP multithreading (%i threads,%i panel-pair tasks)...",NumThreads,NumTasks);
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(nt=0; nt<NumTasks; nt++)
+   {
+     PPThreadData TD1;
+     TD1.nt=nt;
+     TD1.NumTasks=NumTasks;
+     TD1.Args=Args;
+     TD1.RowLocks=RowLocks;
+     GSSIPPThread((void *)&TD1);
+#ifdef USE_OPENMP
+#pragma omp critical
+#endif
+     for(int n=0; n<NUMPPIALGORITHMS; n++)
+      PPIAlgorithmCount[n] += TD1.PPIAlgorithmCount[n];
+   };
+#endif
+
+  delete[] RowLocks;
+
+}
+
+} // namespace scuff
@@ -65,6 +65,12 @@ namespace scuff {
 /**********************************************************************/
 #define DESINGULARIZATION_RADIUS 4.0
 
+/**********************************************************************/
+/* number of inner cubature points for which the periodic Green's    */
+/* function is fetched at once (GetGBarMany) in the PBC case          */
+/**********************************************************************/
+#define PPIBATCH 32
+
 #define AA0 1.0
 #define AA1 1.0
 #define AA2 (1.0/2.0)
@@ -110,7 +116,8 @@ void AssembleInnerPPIIntegrand(double wp, double *R, double *X,
                                GBarAccelerator *GBA, bool ForceFullEwald,
                                int DeSingularize,
                                int NumTorqueAxes, double *GammaMatrix,
-                               cdouble *HInner, cdouble *GradHInner, cdouble *dHdTInner)
+                               cdouble *HInner, cdouble *GradHInner, cdouble *dHdTInner,
+                               cdouble *GBarIn, cdouble *dGBarIn)
 { 
   /* compute polynomial factors */
   cdouble ik=II*k, ik2=ik*ik;
@@ -120,11 +127,17 @@ void AssembleInnerPPIIntegrand(double wp, double *R, double *X,
 
   /* compute the Helmholtz Green's function and its derivatives */
   /* either directly (non-PBC case) or via Ewald summation or   */
-  /* interpolation (PBC case)                                   */
+  /* interpolation (PBC case); in the latter case the caller    */
+  /* may have fetched GBar and its gradient already             */
   if (GBA)
    { 
      cdouble G, dG[3], ddG[9];
-     G=GetGBar(R, GBA, dG, (GradHInner ? ddG : 0 ), ForceFullEwald );
+     if (GBarIn)
+      { G=GBarIn[0];
+        for(int Mu=0; Mu<3; Mu++) dG[Mu]=dGBarIn[Mu];
+      }
+     else
+      G=GetGBar(R, GBA, dG, (GradHInner ? ddG : 0 ), ForceFullEwald );
 
      HInner[0] += wp * hPlus*G;
      HInner[1] += wp * (FxFP[0]*dG[0] + FxFP[1]*dG[1] + FxFP[2]*dG[2]);
@@ -304,27 +317,40 @@ void GetPPIs_Cubature(GetPPIArgStruct *Args,
      memset(HInner,0,2*sizeof(cdouble));
      if (GradH) memset(GradHInner,0,6*sizeof(cdouble));
      if (dHdT) memset(dHdTInner,0,2*NumTorqueAxes*sizeof(cdouble));
-     for(int npp=0, ncpp=0; npp<NumPts; npp++)
+     for(int npp0=0; npp0<NumPts; npp0+=PPIBATCH)
       { 
-        double up=TCR[ncpp++];
-        double vp=TCR[ncpp++];
-        double wp=TCR[ncpp++];
-
         /***************************************************************/ 
-        /* set XP and FP=XP-QP *****************************************/
+        /* set XP, FP=XP-QP and R=X-XP for a group of inner points     */
         /***************************************************************/
-        double XP[3], FP[3], R[3];
-        for(int Mu=0; Mu<3; Mu++)
-         { XP[Mu] = V0P[Mu] + up*AP[Mu] + vp*BP[Mu];
-           FP[Mu] = XP[Mu] - QP[Mu];
-           R[Mu] = X[Mu] - XP[Mu];
+        int NB = (npp0+PPIBATCH < NumPts) ? PPIBATCH : NumPts-npp0;
+        double FP[PPIBATCH][3], R[PPIBATCH][3];
+        for(int nb=0; nb<NB; nb++)
+         { double up=TCR[3*(npp0+nb)+0];
+           double vp=TCR[3*(npp0+nb)+1];
+           for(int Mu=0; Mu<3; Mu++)
+            { double XP = V0P[Mu] + up*AP[Mu] + vp*BP[Mu];
+              FP[nb][Mu] = XP - QP[Mu];
+              R[nb][Mu]  = X[Mu] - XP;
+            };
          };
 
-        AssembleInnerPPIIntegrand(wp, R, X, F, FP, k, Args->GBA, Args->ForceFullEwald,
-                                  DeSingularize, NumTorqueAxes, GammaMatrix,
-                                  HInner, GradHInner, dHdTInner);
+        /***************************************************************/ 
+        /* in the PBC case without gradients, fetch GBar and its first */
+        /* derivatives at all points of the group at once              */
+        /***************************************************************/
+        cdouble GBar[PPIBATCH], dGBar[3*PPIBATCH];
+        bool Batched = (Args->GBA!=0 && GradHInner==0);
+        if (Batched)
+         GetGBarMany(R[0], NB, Args->GBA, GBar, dGBar, Args->ForceFullEwald);
+
+        for(int nb=0; nb<NB; nb++)
+         AssembleInnerPPIIntegrand(TCR[3*(npp0+nb)+2], R[nb], X, F, FP[nb], k,
+                                   Args->GBA, Args->ForceFullEwald,
+                                   DeSingularize, NumTorqueAxes, GammaMatrix,
+                                   HInner, GradHInner, dHdTInner,
+                                   Batched ? GBar+nb : 0, Batched ? dGBar+3*nb : 0);
 
-      }; /* for(npp=ncpp=0; npp<NumPts; npp++) */
+      }; /* for(npp0=0; npp0<NumPts; npp0+=PPIBATCH) */
 
      /*--------------------------------------------------------------*/
      /*- accumulate contributions to outer integral                  */
@@ -349,6 +375,259 @@ void GetPPIs_Cubature(GetPPIArgStruct *Args,
 
 }
 
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*- PART 1B: Same as PART 1, but computing the panel-panel      -*/
+/*-          integrals for all nine (iQa, iQb) combinations in  -*/
+/*-          a single pass over the cubature points, so that    -*/
+/*-          the kernel is evaluated only once per point pair.  -*/
+/*-                                                             -*/
+/*- Output layout: for nq = 3*iQa + iQb,                        -*/
+/*-  H9[2*nq + 0,1]            = H[0,1]                         -*/
+/*-  GradH9[6*nq + 2*Mu + 0,1] = GradH[2*Mu + 0,1]              -*/
+/*-  dHdT9[6*nq + 2*Mu + 0,1]  = dHdT[2*Mu + 0,1]               -*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+void AssembleInnerPPIIntegrandAllQ(double wp, double *R, double *X,
+                                   double F[3][3], double FP[3][3], cdouble k,
+                                   GBarAccelerator *GBA, bool ForceFullEwald,
+                                   int DeSingularize,
+                                   int NumTorqueAxes, double *GammaMatrix,
+                                   cdouble *HInner, cdouble *GradHInner,
+                                   cdouble *dHdTInner,
+                                   cdouble *GBarIn, cdouble *dGBarIn)
+{ 
+  cdouble ik=II*k, ik2=ik*ik;
+
+  /* kernel quantities shared by all (iQa, iQb) combinations */
+  cdouble G=0.0, dG[3], ddG[9];
+  cdouble Phi=0.0, Psi=0.0, Zeta=0.0;
+  if (GBA)
+   { if (GBarIn)
+      { G=GBarIn[0];
+        for(int Mu=0; Mu<3; Mu++) dG[Mu]=dGBarIn[Mu];
+      }
+     else
+      G=GetGBar(R, GBA, dG, (GradHInner ? ddG : 0 ), ForceFullEwald );
+     G*=wp;
+     for(int Mu=0; Mu<3; Mu++) dG[Mu]*=wp;
+     if (GradHInner)
+      for(int Mu=0; Mu<9; Mu++) ddG[Mu]*=wp;
+   }
+  else
+   { double r2=VecNorm2(R), r=sqrt(r2);
+     if (DeSingularize)
+      Phi = ExpRel(ik*r,4) / (4.0*M_PI*r);
+     else
+      Phi = exp(ik*r) / (4.0*M_PI*r);
+     if ( !IsFinite(real(Phi)) ) Phi=0.0;
+     Phi*=wp; 
+     Psi  = Phi * (ik - 1.0/r) / r;
+     Zeta = Phi * (ik2 - 3.0*ik/r + 3.0/r2) / r2;
+   };
+
+  double dX[3][3]; // at most 3 torque axes
+  bool NeedTorque = (GBA==0 && dHdTInner && NumTorqueAxes>0 && GammaMatrix!=0);
+  if (NeedTorque)
+   for(int nta=0; nta<NumTorqueAxes; nta++)
+    { memset(dX[nta],0,3*sizeof(double));
+      for(int Mu=0; Mu<3; Mu++)
+       for(int Nu=0; Nu<3; Nu++)
+        dX[nta][Mu]+=GammaMatrix[9*nta + Mu + 3*Nu]*X[Nu];
+    };
+
+  for(int iQa=0; iQa<3; iQa++)
+   for(int iQb=0; iQb<3; iQb++)
+    { 
+      int nq=3*iQa + iQb;
+      cdouble *HI = HInner + 2*nq;
+      cdouble *GHI = GradHInner ? GradHInner + 6*nq : 0;
+      cdouble *dHI = dHdTInner ? dHdTInner + 6*nq : 0;
+
+      cdouble hPlus = VecDot(F[iQa],FP[iQb]) + 4.0/ik2;
+      double FxFP[3];
+      VecCross(F[iQa], FP[iQb], FxFP);
+
+      if (GBA)
+       { HI[0] += hPlus*G;
+         HI[1] += FxFP[0]*dG[0] + FxFP[1]*dG[1] + FxFP[2]*dG[2];
+         if (GHI)
+          for(int Mu=0; Mu<3; Mu++)
+           { GHI[ 2*Mu + 0 ] += hPlus * dG[Mu];
+             GHI[ 2*Mu + 1 ] +=  FxFP[0]*ddG[3*Mu + 0] 
+                               + FxFP[1]*ddG[3*Mu + 1] 
+                               + FxFP[2]*ddG[3*Mu + 2];
+           };
+         continue;
+       };
+
+      double hTimes=VecDot(FxFP, R);
+      HI[0] += hPlus * Phi;
+      HI[1] += hTimes * Psi;
+
+      if (GHI)
+       for(int Mu=0; Mu<3; Mu++)
+        { GHI[2*Mu + 0] += R[Mu]*hPlus*Psi;
+          GHI[2*Mu + 1] += R[Mu]*hTimes*Zeta + FxFP[Mu]*Psi;
+        };
+
+      if (NeedTorque)
+       for(int nta=0; nta<NumTorqueAxes; nta++)
+        { double dF[3], dFxFP[3];
+          memset(dF,0,3*sizeof(double));
+          for(int Mu=0; Mu<3; Mu++)
+           for(int Nu=0; Nu<3; Nu++)
+            dF[Mu]+=GammaMatrix[9*nta + Mu + 3*Nu]*F[iQa][Nu];
+          double Puv=VecDot(R,dX[nta]);
+          dHI[2*nta + 0] += hPlus*Puv*Psi + VecDot(dF,FP[iQb])*Phi;
+          dHI[2*nta + 1] += hTimes*Puv*Zeta 
+                          + (  VecDot(VecCross(dF,FP[iQb],dFxFP),R) 
+                             + VecDot(FxFP,dX[nta]) 
+                            )*Psi;
+        };
+    };
+}
+
+void GetPPIs_CubatureAllQ(GetPPIArgStruct *Args,
+                          int DeSingularize, int HighOrder,
+                          double **Va, double **Qa,
+                          double **Vb, double **Qb,
+                          cdouble *H9, cdouble *GradH9, cdouble *dHdT9)
+{ 
+  double *V0, A[3], B[3];
+  V0=Va[0];
+  VecSub(Va[1], Va[0], A);
+  VecSub(Va[2], Va[0], B);
+
+  double *V0P, AP[3], BP[3];
+  V0P=Vb[0];
+  VecSub(Vb[1], Vb[0], AP);
+  VecSub(Vb[2], Vb[0], BP);
+
+  int NumTorqueAxes=Args->NumTorqueAxes;
+  double *GammaMatrix=Args->GammaMatrix;
+  if (Args->NumGradientComponents==0) GradH9=0;
+  if (NumTorqueAxes==0 || GammaMatrix==0) dHdT9=0;
+
+  cdouble HInner[18], GradHInnerBuffer[54], dHdTInnerBuffer[54];
+  cdouble *GradHInner = GradH9 ? GradHInnerBuffer : 0;
+  cdouble *dHdTInner  = dHdT9  ? dHdTInnerBuffer  : 0;
+
+  double *TCR;
+  int NumPts;
+  if (HighOrder)
+   TCR=GetTCR(20, &NumPts);
+  else
+   TCR=GetTCR(4, &NumPts);
+
+  cdouble k = Args->k;
+  for(int n=0; n<18; n++) H9[n]=0.0;
+  if (GradH9) for(int n=0; n<54; n++) GradH9[n]=0.0;
+  if (dHdT9) for(int n=0; n<54; n++) dHdT9[n]=0.0;
+  for(int np=0, ncp=0; np<NumPts; np++)
+   { 
+     double u=TCR[ncp++];
+     double v=TCR[ncp++];
+     double w=TCR[ncp++];
+
+     double X[3], F[3][3];
+     for(int Mu=0; Mu<3; Mu++)
+      X[Mu] = V0[Mu] + u*A[Mu] + v*B[Mu];
+     for(int iQ=0; iQ<3; iQ++)
+      VecSub(X, Qa[iQ], F[iQ]);
+
+     for(int n=0; n<18; n++) HInner[n]=0.0;
+     if (GradHInner) for(int n=0; n<54; n++) GradHInner[n]=0.0;
+     if (dHdTInner) for(int n=0; n<54; n++) dHdTInner[n]=0.0;
+     for(int npp0=0; npp0<NumPts; npp0+=PPIBATCH)
+      { 
+        int NB = (npp0+PPIBATCH < NumPts) ? PPIBATCH : NumPts-npp0;
+        double FP[PPIBATCH][3][3], R[PPIBATCH][3];
+        for(int nb=0; nb<NB; nb++)
+         { double up=TCR[3*(npp0+nb)+0];
+           double vp=TCR[3*(npp0+nb)+1];
+           double XP[3];
+           for(int Mu=0; Mu<3; Mu++)
+            { XP[Mu] = V0P[Mu] + up*AP[Mu] + vp*BP[Mu];
+              R[nb][Mu] = X[Mu] - XP[Mu];
+            };
+           for(int iQ=0; iQ<3; iQ++)
+            VecSub(XP, Qb[iQ], FP[nb][iQ]);
+         };
+
+        // as in GetPPIs_Cubature
+        cdouble GBar[PPIBATCH], dGBar[3*PPIBATCH];
+        bool Batched = (Args->GBA!=0 && GradHInner==0);
+        if (Batched)
+         GetGBarMany(R[0], NB, Args->GBA, GBar, dGBar, Args->ForceFullEwald);
+
+        for(int nb=0; nb<NB; nb++)
+         AssembleInnerPPIIntegrandAllQ(TCR[3*(npp0+nb)+2], R[nb], X, F, FP[nb], k,
+                                       Args->GBA, Args->ForceFullEwald,
+                                       DeSingularize, NumTorqueAxes, GammaMatrix,
+                                       HInner, GradHInner, dHdTInner,
+                                       Batched ? GBar+nb : 0, Batched ? dGBar+3*nb : 0);
+      };
+
+     for(int n=0; n<18; n++)
+      H9[n]+=w*HInner[n];
+     if (GradH9)
+      for(int n=0; n<54; n++)
+       GradH9[n]+=w*GradHInner[n];
+     if (dHdT9)
+      for(int n=0; n<54; n++)
+       dHdT9[n]+=w*dHdTInner[n];
+   };
+}
+
+/***************************************************************/
+/* extract panel vertices, detect common vertices, and measure */
+/* the relative distance between the two panels, taking into   */
+/* account the optional displacement of panel b. On return,    */
+/* Va and Vb point to the (possibly reordered) panel vertices; */
+/* if there is a displacement, the displaced vertices of panel */
+/* b (in their original order) are stored in VbDisplaced.      */
+/***************************************************************/
+static int AssessPPIPanelPair(GetPPIArgStruct *Args,
+                              double **Va, double **Vb,
+                              double VbDisplaced[3][3], double *rRel)
+{
+  RWGSurface *Sa       = Args->Sa;
+  RWGSurface *Sb       = Args->Sb;
+  int npa              = Args->npa;
+  int npb              = Args->npb;
+  double *Displacement = Args->Displacement;
+
+  if (Displacement==0)
+   return AssessPanelPair(Sa,npa,Sb,npb,rRel,Va,Vb);
+
+  RWGPanel *Pa = Sa->Panels[npa];
+  RWGPanel *Pb = Sb->Panels[npb];
+
+  Va[0] = Sa->Vertices + 3*Pa->VI[0];
+  Va[1] = Sa->Vertices + 3*Pa->VI[1];
+  Va[2] = Sa->Vertices + 3*Pa->VI[2];
+
+  VecScaleAdd(Sb->Vertices + 3*Pb->VI[0], 1.0, Displacement, VbDisplaced[0]);
+  VecScaleAdd(Sb->Vertices + 3*Pb->VI[1], 1.0, Displacement, VbDisplaced[1]);
+  VecScaleAdd(Sb->Vertices + 3*Pb->VI[2], 1.0, Displacement, VbDisplaced[2]);
+  Vb[0] = VbDisplaced[0];
+  Vb[1] = VbDisplaced[1];
+  Vb[2] = VbDisplaced[2];
+
+  double DC[3]; // 'delta centroid' 
+  DC[0] = Pa->Centroid[0] - Pb->Centroid[0] - Displacement[0];
+  DC[1] = Pa->Centroid[1] - Pb->Centroid[1] - Displacement[1];
+  DC[2] = Pa->Centroid[2] - Pb->Centroid[2] - Displacement[2];
+
+  double rMax = fmax(Pa->Radius, Pb->Radius);
+  *rRel = VecNorm(DC) / rMax; 
+
+  return AssessPanelPair(Va, Vb, rMax);
+}
+
 /***************************************************************/
 /* calculate integrals over a single pair of triangles using   */
 /* one of several different methods based on how near the two  */
@@ -379,39 +658,12 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args)
   /***************************************************************/
   RWGPanel *Pa = Sa->Panels[npa];
   RWGPanel *Pb = Sb->Panels[npb];
-  double *Qa   = Sa->Vertices + 3*Pa->VI[iQa];
-  double *Qb   = Sb->Vertices + 3*Pb->VI[iQb];
   double *Va[3], *Vb[3];
   double VbDisplaced[3][3];
   double rRel; 
-  int ncv;
-
-  if (Displacement==0)
-   ncv=AssessPanelPair(Sa,npa,Sb,npb,&rRel,Va,Vb);
-  else 
-   { 
-     Va[0] = Sa->Vertices + 3*Pa->VI[0];
-     Va[1] = Sa->Vertices + 3*Pa->VI[1];
-     Va[2] = Sa->Vertices + 3*Pa->VI[2];
-
-     VecScaleAdd(Sb->Vertices + 3*Pb->VI[0], 1.0, Displacement, VbDisplaced[0]);
-     VecScaleAdd(Sb->Vertices + 3*Pb->VI[1], 1.0, Displacement, VbDisplaced[1]);
-     VecScaleAdd(Sb->Vertices + 3*Pb->VI[2], 1.0, Displacement, VbDisplaced[2]);
-     Vb[0] = VbDisplaced[0];
-     Vb[1] = VbDisplaced[1];
-     Vb[2] = VbDisplaced[2];
-     Qb    = VbDisplaced[iQb];
-
-     double DC[3]; // 'delta centroid' 
-     DC[0] = Pa->Centroid[0] - Pb->Centroid[0] - Displacement[0];
-     DC[1] = Pa->Centroid[1] - Pb->Centroid[1] - Displacement[1];
-     DC[2] = Pa->Centroid[2] - Pb->Centroid[2] - Displacement[2];
-
-     double rMax = fmax(Pa->Radius, Pb->Radius);
-     rRel = VecNorm(DC) / rMax; 
-
-     ncv=AssessPanelPair(Va, Vb, rMax);
-   };
+  int ncv=AssessPPIPanelPair(Args, Va, Vb, VbDisplaced, &rRel);
+  double *Qa   = Sa->Vertices + 3*Pa->VI[iQa];
+  double *Qb   = Displacement ? VbDisplaced[iQb] : Sb->Vertices + 3*Pb->VI[iQb];
 
   /***************************************************************/
   /* if the panels are far apart, or if we have an interpolator, */
@@ -579,6 +831,130 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args,
    memcpy(dHdT, Args->dHdT, 2*Args->NumTorqueAxes*sizeof(cdouble));
 }
 
+/***************************************************************/
+/* compute the panel-panel integrals for all nine combinations */
+/* of source/destination vertices (iQa, iQb) for the panel pair*/
+/* (Args->npa, Args->npb) (the iQa and iQb fields in Args are  */
+/* ignored on input).                                          */
+/*                                                             */
+/* In the regimes in which the PPIs are computed by fixed-order*/
+/* cubature, the kernel is evaluated only once per pair of     */
+/* cubature points and shared among all nine combinations.     */
+/* In the remaining (near-field) regimes we simply make nine   */
+/* calls to GetPanelPanelInteractions(); in the               */
+/* desingularization regime the Q-independent FIPPI data for   */
+/* the panel pair is then fetched from the cache only once.    */
+/*                                                             */
+/* The output arrays are laid out as described above           */
+/* GetPPIs_CubatureAllQ; GradH9 and dHdT9 may be NULL.         */
+/* On return, Args->PPIAlgorithmCount has been incremented to  */
+/* reflect the number of PPIs (not kernel evaluations) computed*/
+/* by each algorithm.                                          */
+/***************************************************************/
+void GetPanelPanelInteractionsAllQ(GetPPIArgStruct *Args,
+                                   cdouble *H9, cdouble *GradH9,
+                                   cdouble *dHdT9,
+                                   unsigned *PPIAlgorithmCount)
+{
+  RWGSurface *Sa = Args->Sa;
+  RWGSurface *Sb = Args->Sb;
+  RWGPanel *Pa   = Sa->Panels[Args->npa];
+  RWGPanel *Pb   = Sb->Panels[Args->npb];
+
+  if (Args->NumGradientComponents==0) GradH9=0;
+  if (Args->NumTorqueAxes==0 || Args->GammaMatrix==0) dHdT9=0;
+
+  double *Va[3], *Vb[3];
+  double VbDisplaced[3][3];
+  double rRel; 
+  int ncv=AssessPPIPanelPair(Args, Va, Vb, VbDisplaced, &rRel);
+
+  double kR=abs(Args->k*fmax(Pa->Radius, Pb->Radius));
+  bool InSWRegime = kR > SWTHRESHOLD;
+
+  bool FarField   = ( Args->GBA || (rRel > DESINGULARIZATION_RADIUS) );
+  if ( FarField || (InSWRegime && ncv==0) )
+   { 
+     double *Qa[3], *Qb[3];
+     for(int iQ=0; iQ<3; iQ++)
+      { Qa[iQ] = Sa->Vertices + 3*Pa->VI[iQ];
+        Qb[iQ] = Args->Displacement ? VbDisplaced[iQ] : Sb->Vertices + 3*Pb->VI[iQ];
+      };
+     Args->WhichAlgorithm = FarField ? PPIALG_LOCUBATURE : PPIALG_HOCUBATURE;
+     GetPPIs_CubatureAllQ(Args, 0, FarField ? 0 : 1, Va, Qa, Vb, Qb, H9, GradH9, dHdT9);
+     if (PPIAlgorithmCount) PPIAlgorithmCount[Args->WhichAlgorithm]+=9;
+     return;
+   };
+
+  /***************************************************************/
+  /* in the Taylor-Duffy regime, the nine (iQa,iQb) combinations */
+  /* share the case, kernels and panel geometry, so we integrate */
+  /* them in a single batch that evaluates the kernel once per   */
+  /* cubature point                                              */
+  /***************************************************************/
+  bool UseTD = ( ncv==3 || ( ncv>0 && (InSWRegime || Args->ForceTaylorDuffy) ) );
+  if ( UseTD && !RWGGeometry::DisableBatchedTaylorDuffy )
+   {
+     bool InVerySWRegime = kR > VERYSWTHRESHOLD;
+     bool HighK = InVerySWRegime && RWGGeometry::UseHighKTaylorDuffy;
+     Args->WhichAlgorithm = HighK ? PPIALG_HKTD : PPIALG_TD;
+
+     cdouble k=Args->k;
+     int PIndex[3]={TD_UNITY, TD_PMCHWG1, TD_PMCHWC};
+     int KIndex[3]={TD_HELMHOLTZ, TD_HELMHOLTZ, TD_GRADHELMHOLTZ};
+     if (HighK)
+      { KIndex[0]=TD_HIGHK_HELMHOLTZ;
+        KIndex[1]=TD_HIGHK_HELMHOLTZ;
+        KIndex[2]=TD_HIGHK_GRADHELMHOLTZ;
+      };
+     cdouble KParam[3]={k,k,k};
+     cdouble Result[9][3], Error[9][3];
+
+     TaylorDuffyArgStruct TDArgs[9];
+     for(int iQa=0; iQa<3; iQa++)
+      for(int iQb=0; iQb<3; iQb++)
+       { int nq=3*iQa + iQb;
+         InitTaylorDuffyArgs(TDArgs+nq);
+         TDArgs[nq].WhichCase=ncv;
+         TDArgs[nq].NumPKs = (ncv==3) ? 2 : 3;
+         TDArgs[nq].PIndex=PIndex;
+         TDArgs[nq].KIndex=KIndex;
+         TDArgs[nq].KParam=KParam;
+         TDArgs[nq].V1=Va[0];
+         TDArgs[nq].V2=Va[1];
+         TDArgs[nq].V3=Va[2];
+         TDArgs[nq].V2P=Vb[1];
+         TDArgs[nq].V3P=Vb[2];
+         TDArgs[nq].Q=Sa->Vertices + 3*Pa->VI[iQa];
+         TDArgs[nq].QP=Args->Displacement ? VbDisplaced[iQb] : Sb->Vertices + 3*Pb->VI[iQb];
+         TDArgs[nq].Result=Result[nq];
+         TDArgs[nq].Error=Error[nq];
+       };
+
+     TaylorDuffyBatch(TDArgs, 9);
+
+     for(int nq=0; nq<9; nq++)
+      { H9[2*nq+0] = Result[nq][1] - 4.0*Result[nq][0]/(k*k);
+        H9[2*nq+1] = (ncv==3) ? 0.0 : Result[nq][2];
+      };
+     if (GradH9) for(int n=0; n<54; n++) GradH9[n]=0.0;
+     if (dHdT9)  for(int n=0; n<54; n++) dHdT9[n]=0.0;
+     if (PPIAlgorithmCount) PPIAlgorithmCount[Args->WhichAlgorithm]+=9;
+     return;
+   };
+
+  for(int iQa=0; iQa<3; iQa++)
+   for(int iQb=0; iQb<3; iQb++)
+    { int nq=3*iQa + iQb;
+      Args->iQa=iQa;
+      Args->iQb=iQb;
+      GetPanelPanelInteractions(Args, H9 + 2*nq,
+                                GradH9 ? GradH9 + 6*nq : 0,
+                                dHdT9  ? dHdT9  + 6*nq : 0);
+      if (PPIAlgorithmCount) PPIAlgorithmCount[Args->WhichAlgorithm]++;
+    };
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
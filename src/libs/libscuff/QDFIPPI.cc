@@ -84,7 +84,8 @@ void GetQDFIPPIData(double **Va, double *Qa,
      else
       { OQa=Qa; OQb=Qb; };
 
-     QIFD=((FIPPICache *)opFC)->GetQIFIPPIData(OVa, OVb, ncv);
+     ((FIPPICache *)opFC)->GetQIFIPPIData(OVa, OVb, ncv, &MyQIFD);
+     QIFD=&MyQIFD;
    }
   else
    { 
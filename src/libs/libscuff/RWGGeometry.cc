@@ -30,6 +30,7 @@
 #include <math.h>
 #include <ctype.h>
 #include <fenv.h>
+#include <pthread.h>
 
 #include <libhrutil.h>
 #include <BZIntegration.h> // needed for GetRLBasis
@@ -50,6 +51,10 @@ bool RWGGeometry::UseHighKTaylorDuffy=true;
 bool RWGGeometry::UseTaylorDuffyV2P0=true;
 bool RWGGeometry::UseGetFieldsV2P0=false;
 bool RWGGeometry::DisableCache=false;
+bool RWGGeometry::UsePanelPairAssembly=false;
+bool RWGGeometry::DisableBlockScheduler=false;
+bool RWGGeometry::DisableCongruentBlocks=false;
+bool RWGGeometry::DisableBatchedTaylorDuffy=false;
 int RWGGeometry::NumMeshDirs=0;
 char **RWGGeometry::MeshDirs=0;
 
@@ -366,6 +371,148 @@ void RWGGeometry::DetectMultiMaterialJunctions()
 
 }
 
+/***************************************************************/
+/* process environment variables that set static class         */
+/* variables; called once per process from the RWGGeometry     */
+/* constructor.                                                */
+/***************************************************************/
+static pthread_once_t StaticEnvOnce = PTHREAD_ONCE_INIT;
+static void ProcessStaticEnvironmentVariables()
+{
+  char *s;
+  if ( RWGGeometry::NumMeshDirs==0 && (s=getenv("SCUFF_MESH_PATH")) )
+   { char MeshPathCopy[1000];
+     strncpy(MeshPathCopy, s, 1000);
+     char *Tokens[10];
+     int NumTokens=Tokenize(MeshPathCopy, Tokens, 10, ":");
+     RWGGeometry::NumMeshDirs=NumTokens;
+     RWGGeometry::MeshDirs = (char **)malloc(NumTokens * sizeof(char *));
+     for(int nt=0; nt<NumTokens; nt++)
+      { RWGGeometry::MeshDirs[nt] = strdup(Tokens[nt]);
+        Log("Added %s to mesh search path.",RWGGeometry::MeshDirs[nt]);
+      };
+   };
+
+  if ( (s=getenv("SCUFF_DISABLE_CACHE")) && (s[0]=='1') )
+   { Log("Disabling caching of frequency-independent panel-panel integrals.");
+     RWGGeometry::DisableCache=true;
+   };
+
+  if ( (s= getenv("SCUFF_HALF_RWG")) && (s[0]=='1') )
+   { Log("Assigning half-RWG basis functions to exterior edges.");
+     RWGGeometry::UseHRWGFunctions=true;
+   };
+
+  if ( (s=getenv("SCUFF_ABORT_ON_FPE")) && (s[0]=='1') )
+   {
+#ifndef __APPLE__
+     feenableexcept(FE_INVALID | FE_OVERFLOW);
+     Log("Enabling abort-on-floating-point-exception.");
+#else
+     Log("Can not enable abort-on-floating-point-exception on OS X because feenableexcept is not available.");
+#endif
+   };
+
+  if ( (s=getenv("SCUFF_GETFIELDSV2P0")) && (s[0]=='1') )
+   { Log("Using V2P0 field calculation.");
+     RWGGeometry::UseGetFieldsV2P0=true;
+   };
+
+  if ( (s=getenv("SCUFF_PANEL_PAIR_ASSEMBLY")) && (s[0]=='1') )
+   { Log("Using panel-pair-centric BEM matrix assembly.");
+     RWGGeometry::UsePanelPairAssembly=true;
+   };
+
+  if ( (s=getenv("SCUFF_DISABLE_BLOCK_SCHEDULER")) && (s[0]=='1') )
+   { Log("Disabling global block scheduler for BEM matrix assembly.");
+     RWGGeometry::DisableBlockScheduler=true;
+   };
+
+  if ( (s=getenv("SCUFF_DISABLE_CONGRUENT_BLOCKS")) && (s[0]=='1') )
+   { Log("Disabling reuse of BEM matrix blocks for congruent surface pairs.");
+     RWGGeometry::DisableCongruentBlocks=true;
+   };
+
+  if ( (s=getenv("SCUFF_DISABLE_BATCHED_TD")) && (s[0]=='1') )
+   { Log("Disabling batched Taylor-Duffy integration of panel pairs.");
+     RWGGeometry::DisableBatchedTaylorDuffy=true;
+   };
+
+  if ( (s=getenv("SCUFF_FIPPI_CACHE_MB")) )
+   { double MaxMB=0.0;
+     if ( 1==sscanf(s,"%le",&MaxMB) && MaxMB>=0.0 )
+      { Log("Limiting FIPPI cache to %g MB.",MaxMB);
+        SetFIPPICacheBudget(MaxMB);
+      }
+     else
+      Warn("invalid value %s for SCUFF_FIPPI_CACHE_MB (ignoring)",s);
+   };
+
+  if ( (s=getenv("SCUFF_TBLOCK_MB")) )
+   { double MaxMB=0.0;
+     if ( 1==sscanf(s,"%le",&MaxMB) && MaxMB>=0.0 )
+      { Log("Keeping up to %g MB of T-blocks in memory.",MaxMB);
+        SetTBlockStoreBudget(MaxMB);
+      }
+     else
+      Warn("invalid value %s for SCUFF_TBLOCK_MB (ignoring)",s);
+   };
+
+  if ( (s=getenv("SCUFF_GBA_POOL_MB")) )
+   { double MaxMB=0.0;
+     if ( 1==sscanf(s,"%le",&MaxMB) && MaxMB>=0.0 )
+      { Log("Keeping up to %g MB of GBar interpolation tables in memory.",MaxMB);
+        SetGBAPoolBudget(MaxMB);
+      }
+     else
+      Warn("invalid value %s for SCUFF_GBA_POOL_MB (ignoring)",s);
+   };
+
+  if ( (s=getenv("SCUFF_FREQINTERP_TOL")) )
+   { double Tol=0.0;
+     if ( 1==sscanf(s,"%le",&Tol) && Tol>=0.0 )
+      { RWGGeometry::FreqInterpTol=Tol;
+        if ( (s=getenv("SCUFF_FREQINTERP_NODES")) )
+         RWGGeometry::FreqInterpNodes=atoi(s);
+        if ( RWGGeometry::FreqInterpNodes<2 || RWGGeometry::FreqInterpNodes>16 )
+         { Warn("SCUFF_FREQINTERP_NODES must lie in [2,16] (using 5)");
+           RWGGeometry::FreqInterpNodes=5;
+         };
+        if ( (s=getenv("SCUFF_FREQINTERP_MB")) )
+         sscanf(s,"%le",&RWGGeometry::FreqInterpMaxMB);
+        Log("Interpolating BEM matrix blocks in frequency (%i anchors, tolerance %g).",
+             RWGGeometry::FreqInterpNodes,RWGGeometry::FreqInterpTol);
+      }
+     else
+      Warn("invalid value %s for SCUFF_FREQINTERP_TOL (ignoring)",s);
+   };
+
+  if ( (s=getenv("SCUFF_EMTPFTI_MB")) )
+   { double MaxMB=0.0;
+     if ( 1==sscanf(s,"%le",&MaxMB) && MaxMB>=0.0 )
+      { Log("Keeping up to %g MB of EMTPFT integrals in memory.",MaxMB);
+        RWGGeometry::EMTPFTIMaxMB=MaxMB;
+      }
+     else
+      Warn("invalid value %s for SCUFF_EMTPFTI_MB (ignoring)",s);
+   };
+
+  if ( (s=getenv("SCUFF_EMTPFT_PRECOMPUTE")) && (s[0]=='1') )
+   { Log("Computing EMTPFT integrals during BEM matrix assembly.");
+     RWGGeometry::PrecomputeEMTPFT=true;
+   };
+
+  if ( (s=getenv("SCUFF_MULTIPOLE_TOL")) )
+   { double Tol=0.0;
+     if ( 1==sscanf(s,"%le",&Tol) && Tol>=0.0 )
+      { RWGGeometry::MultipoleTol=Tol;
+        Log("Using multipole expansions for well-separated edges (tolerance %g).",Tol);
+      }
+     else
+      Warn("invalid value %s for SCUFF_MULTIPOLE_TOL (ignoring)",s);
+   };
+}
+
 /***********************************************************************/
 /***********************************************************************/
 /***********************************************************************/
@@ -397,6 +544,8 @@ RWGGeometry::RWGGeometry(const char *pGeoFileName, int pLogLevel)
    };
   tolVecClose=0.0; // to be updated once mesh is read in
   TBlockCacheNameAddendum=0;
+  FIBlockStore=0;
+  EMTPFTIStore=0;
 
   // we always start with a single Region, for the exterior,
   // taken to be vacuum by default
@@ -407,22 +556,15 @@ RWGGeometry::RWGGeometry(const char *pGeoFileName, int pLogLevel)
   RegionMPs[0] = new MatProp("VACUUM");
 
   /***************************************************************/
-  /* check for various environment variables *********************/
+  /* check for various environment variables. the settings that  */
+  /* live in static class variables are processed only once per  */
+  /* process, so that geometries constructed while others are    */
+  /* in use (for example, the per-thread workspace copies made   */
+  /* by FrequencyScheduler clients) never rewrite them.          */
   /***************************************************************/
-  char *s;
-  if ( NumMeshDirs==0 && (s=getenv("SCUFF_MESH_PATH")) )
-   { char MeshPathCopy[1000];
-     strncpy(MeshPathCopy, s, 1000);
-     char *Tokens[10];
-     int NumTokens=Tokenize(MeshPathCopy, Tokens, 10, ":");
-     NumMeshDirs=NumTokens;
-     MeshDirs = (char **)malloc(NumTokens * sizeof(char *));
-     for(int nt=0; nt<NumTokens; nt++)
-      { MeshDirs[nt] = strdup(Tokens[nt]);
-        Log("Added %s to mesh search path.",MeshDirs[nt]);
-      };
-   };
+  pthread_once(&StaticEnvOnce, ProcessStaticEnvironmentVariables);
 
+  char *s;
   if ( (s=getenv("SCUFF_LOGLEVEL")) )
    {      if ( !strcasecmp(s, "NONE"     ) ) LogLevel=SCUFF_NOLOGGING;
      else if ( !strcasecmp(s, "TERSE"    ) ) LogLevel=SCUFF_TERSELOGGING;
@@ -430,31 +572,6 @@ RWGGeometry::RWGGeometry(const char *pGeoFileName, int pLogLevel)
      else if ( !strcasecmp(s, "VERBOSE2" ) ) LogLevel=SCUFF_VERBOSE2;
    };
 
-  if ( (s=getenv("SCUFF_DISABLE_CACHE")) && (s[0]=='1') )
-   { Log("Disabling caching of frequency-independent panel-panel integrals.");
-     RWGGeometry::DisableCache=true;
-   };
-
-  if ( (s= getenv("SCUFF_HALF_RWG")) && (s[0]=='1') )
-   { Log("Assigning half-RWG basis functions to exterior edges.");
-     RWGGeometry::UseHRWGFunctions=true;
-   };
-
-  if ( (s=getenv("SCUFF_ABORT_ON_FPE")) && (s[0]=='1') )
-   {
-#ifndef __APPLE__
-     feenableexcept(FE_INVALID | FE_OVERFLOW);
-     Log("Enabling abort-on-floating-point-exception.");
-#else
-     Log("Can not enable abort-on-floating-point-exception on OS X because feenableexcept is not available.");
-#endif
-   };
-
-  if ( (s=getenv("SCUFF_GETFIELDSV2P0")) && (s[0]=='1') )
-   { Log("Using V2P0 field calculation.");
-     UseGetFieldsV2P0=true;
-   };
-
   /***************************************************************/
   /* try to open input file **************************************/
   /***************************************************************/
@@ -867,13 +984,18 @@ RWGGeometry::~RWGGeometry()
   free(PanelIndexOffset);
   free(EpsTF);
   free(MuTF);
-  free(Mate);
   free(SurfaceMoved);
   free(GeoFileName);
 
+  // surfaces share the FIBBI cache of their mates
   for(int ns=0; ns<NumSurfaces; ns++)
-   DestroyFIBBICache(FIBBICaches[ns]);
+   if (Mate[ns]==-1)
+    DestroyFIBBICache(FIBBICaches[ns]);
   free(FIBBICaches);
+  free(Mate);
+
+  DestroyFIBlockStore(FIBlockStore);
+  DestroyEMTPFTIStore(EMTPFTIStore);
 
 }
 
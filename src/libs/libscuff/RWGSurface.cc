@@ -34,6 +34,7 @@
 #include <libhrutil.h>
 
 #include "libscuff.h"
+#include "libscuffInternals.h"
 #include "cmatheval.h"
 
 namespace scuff {
@@ -673,6 +674,20 @@ void RWGSurface::UnTransform()
 
 }
 
+/*-----------------------------------------------------------------*/
+/*- cheap fingerprint of the current position and orientation of  */
+/*- a surface: the centroids of its first, middle, and last edges. */
+/*- Stores keyed by geometry compare these to detect that surfaces */
+/*- have been transformed since the stored data were computed.     */
+/*-----------------------------------------------------------------*/
+void GetEdgeCentroidSignature(RWGSurface *S, double Signature[9])
+{
+  int NE=S->NumEdges;
+  int neList[3]={0, NE/2, NE-1};
+  for(int m=0; m<3; m++)
+   memcpy(Signature + 3*m, S->Edges[neList[m]]->Centroid, 3*sizeof(double));
+}
+
 /*-----------------------------------------------------------------*/
 /*- initialize geometric quantities stored within an RWGPanel      */
 /*-----------------------------------------------------------------*/
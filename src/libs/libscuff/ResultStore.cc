@@ -0,0 +1,371 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * ResultStore.cc -- append-only, indexed binary store for checkpointing
+ *                -- frequency-resolved results of application codes
+ *                -- (scuff-cas3D, scuff-neq, scuff-heat) so that
+ *                -- restarted runs can skip calculations already done
+ *
+ * File layout:
+ *
+ *  offset 0:                ResultStoreHeader (see below)
+ *  offset sizeof(Header):   a sequence of fixed-size records, each
+ *                           consisting of
+ *                            char     Tag[RESULTSTORE_TAGSIZE]
+ *                            double   Keys[NumKeys]
+ *                            double   Values[NumValues]
+ *                            uint64_t Checksum
+ *                           where Checksum is an FNV-1a hash of the
+ *                           preceding bytes of the record.
+ *
+ * A record is identified by its (Tag, Keys) pair, where Tag is
+ * typically the tag of a geometrical transformation and Keys are
+ * frequency and bloch-vector components. If KeyDigits>0, keys are
+ * rounded to KeyDigits digits after the decimal point in scientific
+ * notation before storage and lookup, so that e.g. a frequency
+ * recomputed as 0.1*3 finds the record stored for 0.3.
+ *
+ * Each process keeps an in-memory copy of all records together
+ * with an open-addressing hash index, so lookups are O(1) and do
+ * not touch the file. A lookup that misses first picks up any records
+ * appended by other processes since the file was last read.
+ *
+ * Concurrent writers serialize on an exclusive flock() of the file,
+ * and readers take a shared flock() while picking up new records.
+ * Each record is written with a single pwrite() at the end of the last
+ * complete record and (by default) flushed to disk before the lock
+ * is released. A process that dies mid-write leaves at most one
+ * partial record at the end of the file; readers do not read past
+ * it, and the next writer discards it. Records whose checksums do not
+ * match are skipped if they are followed by good records. Threads
+ * within one process serialize on an internal lock, since flock()
+ * does not distinguish them.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+#define RESULTSTORE_MAGIC    "SCUFFRS"
+#define RESULTSTORE_VERSION  1
+#define RESULTSTORE_BOM      0x01020304U
+
+typedef struct ResultStoreHeader
+ { char     Magic[8];        // "SCUFFRS" + 0
+   char     Kind[8];         // "CAS3D", "NEQ", "HEAT", ...
+   uint32_t ByteOrderMark;   // RESULTSTORE_BOM in the writer's byte order
+   uint32_t Version;
+   uint32_t NumKeys;
+   uint32_t NumValues;
+   uint64_t HeaderChecksum;  // checksum of all preceding header bytes
+ } ResultStoreHeader;
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+ResultStore::ResultStore(const char *pFileName, const char *pKind,
+                         int pNumKeys, int pNumValues, int pKeyDigits)
+{
+  ErrMsg=0;
+  NumRecords=0;
+  Durable=true;
+  FileName=strdupEC(pFileName);
+  NumKeys=pNumKeys;
+  NumValues=pNumValues;
+  KeyDigits=pKeyDigits;
+  KeySize=RESULTSTORE_TAGSIZE + NumKeys*sizeof(double);
+  RecordSize=KeySize + NumValues*sizeof(double) + sizeof(uint64_t);
+  FileSize=sizeof(ResultStoreHeader);
+  NumSlots=0;
+  Scratch=(char *)mallocEC(RecordSize);
+
+  fd=open(FileName, O_RDWR | O_CREAT, 0644);
+  if (fd<0)
+   { ErrMsg=vstrdup("could not open file %s",FileName);
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- write the header if we are creating the file, otherwise    -*/
+  /*- check that the existing file is compatible                 -*/
+  /*--------------------------------------------------------------*/
+  ResultStoreHeader H;
+  memset(&H, 0, sizeof(H));
+  strcpy(H.Magic, RESULTSTORE_MAGIC);
+  strncpy(H.Kind, pKind, 7);
+  H.ByteOrderMark = RESULTSTORE_BOM;
+  H.Version       = RESULTSTORE_VERSION;
+  H.NumKeys       = NumKeys;
+  H.NumValues     = NumValues;
+  H.HeaderChecksum= CacheKeyHash(&H, offsetof(ResultStoreHeader, HeaderChecksum));
+
+  flock(fd, LOCK_EX);
+  struct stat st;
+  if ( fstat(fd, &st)!=0 )
+   ErrMsg=vstrdup("could not stat file %s",FileName);
+  else if ( st.st_size==0 )
+   { if ( pwrite(fd, &H, sizeof(H), 0)!=(ssize_t)sizeof(H) )
+      ErrMsg=vstrdup("could not write to file %s",FileName);
+   }
+  else
+   { ResultStoreHeader FileH;
+     if (    ((size_t)st.st_size) < sizeof(FileH)
+          || pread(fd, &FileH, sizeof(FileH), 0)!=(ssize_t)sizeof(FileH)
+          || strcmp(FileH.Magic, RESULTSTORE_MAGIC)
+        )
+      ErrMsg=vstrdup("%s: not a result-store file",FileName);
+     else if ( FileH.ByteOrderMark!=RESULTSTORE_BOM )
+      ErrMsg=vstrdup("%s: written on a machine of opposite endianness",FileName);
+     else if ( FileH.HeaderChecksum!=CacheKeyHash(&FileH, offsetof(ResultStoreHeader, HeaderChecksum)) )
+      ErrMsg=vstrdup("%s: header checksum mismatch",FileName);
+     else if ( FileH.Version!=RESULTSTORE_VERSION )
+      ErrMsg=vstrdup("%s: unsupported result-store version %u",FileName,FileH.Version);
+     else if ( strncmp(FileH.Kind, H.Kind, 8) )
+      ErrMsg=vstrdup("%s: not a %s result store",FileName,H.Kind);
+     else if ( FileH.NumKeys!=H.NumKeys || FileH.NumValues!=H.NumValues )
+      ErrMsg=vstrdup("%s: incompatible record size (%u keys, %u values)",
+                     FileName,FileH.NumKeys,FileH.NumValues);
+   };
+  flock(fd, LOCK_UN);
+
+  if (ErrMsg)
+   { close(fd);
+     fd=-1;
+     return;
+   };
+
+  Refresh();
+}
+
+ResultStore::~ResultStore()
+{
+  if (fd>=0) close(fd);
+  free(FileName);
+  free(Scratch);
+  if (ErrMsg) free(ErrMsg);
+}
+
+/***************************************************************/
+/* fill in the first KeySize bytes of Record from (Tag, Keys)  */
+/***************************************************************/
+void ResultStore::PackKey(const char *Tag, const double *Keys, char *Record)
+{
+  memset(Record, 0, RESULTSTORE_TAGSIZE);
+  if (Tag)
+   strncpy(Record, Tag, RESULTSTORE_TAGSIZE-1);
+
+  double *RKeys=(double *)(Record + RESULTSTORE_TAGSIZE);
+  for(int nk=0; nk<NumKeys; nk++)
+   { double Key=Keys[nk];
+     if (KeyDigits>0)
+      { char Buffer[40];
+        snprintf(Buffer, 40, "%.*e", KeyDigits, Key);
+        Key=strtod(Buffer, 0);
+      };
+     RKeys[nk] = (Key==0.0) ? 0.0 : Key; // fold -0 into +0
+   };
+}
+
+/***************************************************************/
+/* add record #nr to the hash index, replacing any older       */
+/* record with the same key, growing the index if necessary    */
+/***************************************************************/
+void ResultStore::IndexRecord(uint64_t nr)
+{
+  if ( 2*(nr+1) > NumSlots )
+   { uint64_t NewNumSlots = NumSlots ? 2*NumSlots : 1024;
+     Index.assign(NewNumSlots, 0);
+     NumSlots=NewNumSlots;
+     for(uint64_t n=0; n<nr; n++)
+      IndexRecord(n);
+   };
+
+  const char *Record = &(Records[nr*RecordSize]);
+  uint64_t Mask=NumSlots-1;
+  for(uint64_t Slot=CacheKeyHash(Record, KeySize) & Mask; ; Slot=(Slot+1) & Mask)
+   { uint64_t Entry=Index[Slot];
+     if ( Entry==0 || !memcmp(&(Records[(Entry-1)*RecordSize]), Record, KeySize) )
+      { Index[Slot]=nr+1;
+        return;
+      };
+   };
+}
+
+/***************************************************************/
+/* read and index any complete records that were appended to   */
+/* the file since the last call. returns true if any new       */
+/* records were found.                                         */
+/*                                                             */
+/* bad records after the last good one are not consumed: they  */
+/* are either a partial record left by a crashed writer, which */
+/* the next writer truncates, or (if some writer ignored the   */
+/* lock) a record still being written.                         */
+/***************************************************************/
+bool ResultStore::Refresh(bool HaveLock)
+{
+  if (fd<0) return false;
+
+  if (!HaveLock)
+   flock(fd, LOCK_SH);
+
+  struct stat st;
+  char *Buffer=0;
+  size_t NewRecords=0, NewBytes=0;
+  if ( fstat(fd, &st)==0 && ((size_t)st.st_size) >= FileSize + RecordSize )
+   { NewRecords = (st.st_size - FileSize) / RecordSize;
+     NewBytes   = NewRecords*RecordSize;
+     Buffer=(char *)mallocEC(NewBytes);
+     if ( pread(fd, Buffer, NewBytes, FileSize)!=(ssize_t)NewBytes )
+      NewRecords=0;
+   };
+
+  if (!HaveLock)
+   flock(fd, LOCK_UN);
+
+  int NumBad=0, NumGood=0;
+  size_t GoodBytes=0; // through the end of the last good record
+  for(size_t n=0; n<NewRecords; n++)
+   { char *Record = Buffer + n*RecordSize;
+     uint64_t Checksum;
+     memcpy(&Checksum, Record + RecordSize - sizeof(uint64_t), sizeof(uint64_t));
+     if ( Checksum!=CacheKeyHash(Record, RecordSize - sizeof(uint64_t)) )
+      { NumBad++;
+        continue;
+      };
+     Records.insert(Records.end(), Record, Record + RecordSize);
+     IndexRecord(NumRecords++);
+     NumGood++;
+     GoodBytes=(n+1)*RecordSize;
+     if (NumBad>0)
+      { Warn("%s: skipped %i corrupted records",FileName,NumBad);
+        NumBad=0;
+      };
+   };
+  if (Buffer) free(Buffer);
+  FileSize += GoodBytes;
+
+  return (NumGood>0);
+}
+
+/***************************************************************/
+/* return the index of the record with the given key or -1     */
+/***************************************************************/
+int64_t ResultStore::FindRecord(const char *Key)
+{
+  if (NumSlots==0) return -1;
+  uint64_t Mask=NumSlots-1;
+  for(uint64_t Slot=CacheKeyHash(Key, KeySize) & Mask; ; Slot=(Slot+1) & Mask)
+   { uint64_t Entry=Index[Slot];
+     if (Entry==0)
+      return -1;
+     if ( !memcmp(&(Records[(Entry-1)*RecordSize]), Key, KeySize) )
+      return (int64_t)(Entry-1);
+   };
+}
+
+/***************************************************************/
+/* look up the values stored for (Tag, Keys). returns true and */
+/* fills in Values on success, or returns false if no such     */
+/* record exists.                                              */
+/***************************************************************/
+bool ResultStore::Lookup(const char *Tag, const double *Keys, double *Values)
+{
+  if (fd<0) return false;
+
+  Lock.write_lock();
+  PackKey(Tag, Keys, Scratch);
+  int64_t nr=FindRecord(Scratch);
+  if ( nr==-1 && Refresh() )
+   nr=FindRecord(Scratch);
+  if ( nr!=-1 )
+   memcpy(Values, &(Records[nr*RecordSize + KeySize]), NumValues*sizeof(double));
+  Lock.write_unlock();
+
+  return (nr!=-1);
+}
+
+/***************************************************************/
+/* append a record to the file and to the in-memory index.     */
+/***************************************************************/
+bool ResultStore::Add(const char *Tag, const double *Keys, const double *Values)
+{
+  if (fd<0) return false;
+
+  Lock.write_lock();
+  char *Record=Scratch;
+  PackKey(Tag, Keys, Record);
+  memcpy(Record + KeySize, Values, NumValues*sizeof(double));
+  uint64_t Checksum=CacheKeyHash(Record, RecordSize - sizeof(uint64_t));
+  memcpy(Record + RecordSize - sizeof(uint64_t), &Checksum, sizeof(uint64_t));
+
+  flock(fd, LOCK_EX);
+
+  // pick up records written by other processes, then discard
+  // any partial record left behind by a writer that crashed
+  Refresh(true);
+  bool Status=true;
+  struct stat st;
+  if ( fstat(fd, &st)!=0 )
+   Status=false;
+  else if ( ((size_t)st.st_size)!=FileSize && ftruncate(fd, FileSize)!=0 )
+   Status=false;
+  if (Status)
+   Status = ( pwrite(fd, Record, RecordSize, FileSize) == (ssize_t)RecordSize );
+  if (Status && Durable)
+   Status = ( fsync(fd)==0 );
+
+  flock(fd, LOCK_UN);
+
+  if (Status)
+   { FileSize += RecordSize;
+     Records.insert(Records.end(), Record, Record + RecordSize);
+     IndexRecord(NumRecords++);
+   };
+  Lock.write_unlock();
+
+  if (!Status)
+   Warn("could not write to result store %s",FileName);
+  return Status;
+}
+
+/***************************************************************/
+/* flush records added with Durable=false to disk.             */
+/***************************************************************/
+void ResultStore::Flush()
+{
+  if (fd>=0) fsync(fd);
+}
+
+} // namespace scuff
@@ -52,6 +52,10 @@ namespace scuff {
 
 #define II cdouble(0,1)
 
+// maximum number of cdoubles in the private buffers used by
+// each thread in GSSIThread (summed over all output matrices)
+#define GSSI_TILEENTRIES (1<<17)
+
 /***************************************************************/
 /* Given two surfaces, identify whether they bound zero, one,  */
 /* or two common regions. If there are any common regions,     */
@@ -97,6 +101,8 @@ typedef struct ThreadData
    GetSSIArgStruct *Args;
    unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];
    int nt, NumTasks;
+   int neaMin, neaMax; // range of row edges handled by all tasks
+   int TileEdges;      // row edges per tile (0 = as many as fit)
 
  } ThreadData;
 
@@ -176,157 +182,217 @@ void *GSSIThread(void *data)
    };
 
   /***************************************************************/
-  /* loop over all internal edges on both objects.               */
+  /* the rows handled by this thread are processed in tiles of   */
+  /* at most TileEdges row edges. the contributions of each tile */
+  /* are accumulated in a private column-major buffer (one slab  */
+  /* for B and one for each nonzero derivative matrix) and added */
+  /* to the shared output matrices in bulk once the tile is      */
+  /* done, so threads never write to the shared matrices         */
+  /* entry-by-entry and only touch their own rows of them.       */
   /***************************************************************/
   int nea, NEa=Sa->NumEdges;
   int neb, NEb=Sb->NumEdges;
-  int X, Y, Mu, nt=0;
+  int X, Y, Mu;
   int NumGradientComponents = GradB ? 3 : 0;
   int nebStart = Symmetric ? 1 : 0;
-  for(nea=0; nea<NEa; nea++)
-   for(neb=nebStart*nea; neb<NEb; neb++)
-    { 
-      nt++;
-      if (nt==TD->NumTasks) nt=0;
-      if (nt!=TD->nt) continue;
-
-      if (G->LogLevel>=SCUFF_VERBOSE2 && (neb==nebStart*nea) )
-       LogPercent(nea, NEa);
-
-      /*--------------------------------------------------------------*/
-      /*- contributions of first medium (EpsA, MuA)  -----------------*/
-      /*--------------------------------------------------------------*/
-      GetEEIArgs->nea  = nea;
-      GetEEIArgs->neb  = neb;
-      GetEEIArgs->k    = kA;
-      GetEEIArgs->GBA  = Args->GBA1;
-      GetEdgeEdgeInteractions(GetEEIArgs);
-
-      if ( SaIsPEC && SbIsPEC )
-       { 
-         X=RowOffset + nea;
-         Y=ColOffset + neb;  
-
-         B->AddEntry( X, Y, PreFac1A*GC[0] );
+  MultipoleBlock *MPBlock = Args->MPBlock;
+
+  HMatrix *OutMats[7];
+  int NumOutMats=0;
+  OutMats[NumOutMats++]=B;
+  for(Mu=0; Mu<NumGradientComponents; Mu++)
+   if (GradB[Mu]) OutMats[NumOutMats++]=GradB[Mu];
+  for(Mu=0; Mu<NumTorqueAxes; Mu++)
+   OutMats[NumOutMats++]=dBdTheta[Mu];
+
+  int BFPerEdgeA = SaIsPEC ? 1 : 2;
+  int NCols      = Sb->NumBFs;
+  int TileEdges  = GSSI_TILEENTRIES / (BFPerEdgeA*NCols*NumOutMats);
+  if (TD->TileEdges>0 && TileEdges>TD->TileEdges) TileEdges=TD->TileEdges;
+  if (TileEdges > TD->neaMax - TD->neaMin) TileEdges = TD->neaMax - TD->neaMin;
+  if (TileEdges<1) TileEdges=1;
+  int LDT        = BFPerEdgeA*TileEdges; // leading dimension of tile buffers
+  size_t SlabSize = ((size_t)LDT)*NCols;
+
+  cdouble *TileBuffer = new cdouble[NumOutMats*SlabSize];
+  HMatrix *TileMats[7];
+  cdouble *BBuf, *GradBBuf[3]={0,0,0}, *dBdThetaBuf[3]={0,0,0};
+  for(int nm=0; nm<NumOutMats; nm++)
+   TileMats[nm] = new HMatrix(LDT, NCols, LHM_COMPLEX, TileBuffer + nm*SlabSize);
+  int ns=0;
+  BBuf=TileBuffer + (ns++)*SlabSize;
+  for(Mu=0; Mu<NumGradientComponents; Mu++)
+   if (GradB[Mu]) GradBBuf[Mu] = TileBuffer + (ns++)*SlabSize;
+  for(Mu=0; Mu<NumTorqueAxes; Mu++)
+   dBdThetaBuf[Mu] = TileBuffer + (ns++)*SlabSize;
 
-         for(Mu=0; Mu<NumGradientComponents; Mu++)
-          if (GradB[Mu]) GradB[Mu]->AddEntry( X, Y, PreFac1A*GradGC[2*Mu+0]);
-
-         for(Mu=0; Mu<NumTorqueAxes; Mu++)
-          dBdTheta[Mu]->AddEntry( X, Y, PreFac1A*dGCdT[2*Mu+0]);
+  /***************************************************************/
+  /* tiles are dealt out round-robin to the NumTasks tasks       */
+  /***************************************************************/
+  for(int neaTile =  TD->neaMin + TD->nt*TileEdges;
+          neaTile <  TD->neaMax;
+          neaTile += TD->NumTasks*TileEdges)
+   { 
+     int neaTileMax = neaTile + TileEdges;
+     if (neaTileMax > TD->neaMax) neaTileMax = TD->neaMax;
+     for(size_t n=0; n<NumOutMats*SlabSize; n++)
+      TileBuffer[n]=0.0;
 
-       }
-      else if ( SaIsPEC && !SbIsPEC )
+     for(nea=neaTile; nea<neaTileMax; nea++)
+      for(neb=nebStart*nea; neb<NEb; neb++)
        { 
-         X=RowOffset + nea;
-         Y=ColOffset + 2*neb;  
-
-         B->AddEntry( X, Y,   PreFac1A*GC[0] );
-         B->AddEntry( X, Y+1, PreFac2A*GC[1] );
-
-         for(Mu=0; Mu<NumGradientComponents; Mu++)
-          { if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1A*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X, Y+1, PreFac2A*GradGC[2*Mu+1]);
-          };
-
-         for(Mu=0; Mu<NumTorqueAxes; Mu++)
-          { dBdTheta[Mu]->AddEntry( X, Y, PreFac1A*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X, Y+1, PreFac2A*dGCdT[2*Mu+1]);
-          };
-       }
-      else if ( !SaIsPEC && SbIsPEC )
-       {
-         X=RowOffset + 2*nea;
-         Y=ColOffset + neb;  
-
-         B->AddEntry( X,   Y, PreFac1A*GC[0] );
-         B->AddEntry( X+1, Y, PreFac2A*GC[1] );
-
-         for(Mu=0; Mu<NumGradientComponents; Mu++)
-          { if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1A*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X+1, Y, PreFac2A*GradGC[2*Mu+1]);
-          };
-
-         for(Mu=0; Mu<NumTorqueAxes; Mu++)
-          { dBdTheta[Mu]->AddEntry( X, Y,   PreFac1A*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X+1, Y, PreFac2A*dGCdT[2*Mu+1]);
-          };
-       }
-      else if ( !SaIsPEC && !SbIsPEC )
-       { 
-         X=RowOffset + 2*nea;
-         Y=ColOffset + 2*neb;
+         // pairs of edges in well-separated clusters are
+         // handled by AddMultipoleInteractions()
+         if ( MPBlock && IsMultipolePair(MPBlock, nea, neb) )
+          continue;
+
+         if (G->LogLevel>=SCUFF_VERBOSE2 && (neb==nebStart*nea) )
+          LogPercent(nea, NEa);
+
+         /*--------------------------------------------------------------*/
+         /*- contributions of first medium (EpsA, MuA)  -----------------*/
+         /*--------------------------------------------------------------*/
+         GetEEIArgs->nea  = nea;
+         GetEEIArgs->neb  = neb;
+         GetEEIArgs->k    = kA;
+         GetEEIArgs->GBA  = Args->GBA1;
+         GetEdgeEdgeInteractions(GetEEIArgs);
 
-         B->AddEntry( X, Y,   PreFac1A*GC[0]);
-         B->AddEntry( X, Y+1, PreFac2A*GC[1]);
-         if ( !Symmetric || (nea!=neb) )
-          B->AddEntry( X+1, Y, PreFac2A*GC[1]);
-         B->AddEntry( X+1, Y+1, PreFac3A*GC[0]);
+         // index of the (X,Y) entry in the tile buffers; X+1 is the
+         // next row, X+LDT the next column
+         X=BFPerEdgeA*(nea-neaTile) + LDT*(SbIsPEC ? neb : 2*neb);
 
-         for(Mu=0; Mu<NumGradientComponents; Mu++)
-          { 
-            if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1A*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X, Y+1, PreFac2A*GradGC[2*Mu+1]);
-            if ( !Symmetric || (nea!=neb) )
-             GradB[Mu]->AddEntry( X+1, Y, PreFac2A*GradGC[2*Mu+1]);
-            GradB[Mu]->AddEntry( X+1, Y+1, PreFac3A*GradGC[2*Mu+0]);
-          };
-
-         for(Mu=0; Mu<NumTorqueAxes; Mu++)
+         if ( SaIsPEC && SbIsPEC )
           { 
-            dBdTheta[Mu]->AddEntry( X, Y,   PreFac1A*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X, Y+1, PreFac2A*dGCdT[2*Mu+1]);
-            if ( !Symmetric || (nea!=neb) )
-             dBdTheta[Mu]->AddEntry( X+1, Y, PreFac2A*dGCdT[2*Mu+1]);
-            dBdTheta[Mu]->AddEntry( X+1, Y+1, PreFac3A*dGCdT[2*Mu+0]);
-          };
-
-       }; // if ( OaIsPEC && ObIsPEC ) ... else ... 
-
-      /*--------------------------------------------------------------*/
-      /*- contributions of second medium if present.                  */
-      /*- note this case we already know we are in the fourth case    */
-      /*- of the above if...else statement.                           */
-      /*--------------------------------------------------------------*/
-      if (EpsB!=0.0)
-       { 
-         GetEEIArgs->k   = kB;
-         GetEEIArgs->GBA = Args->GBA2;
-         GetEdgeEdgeInteractions(GetEEIArgs);
+            BBuf[X] += PreFac1A*GC[0];
 
-         X=RowOffset + 2*nea;
-         Y=ColOffset + 2*neb;
+            for(Mu=0; Mu<NumGradientComponents; Mu++)
+             if (GradB[Mu]) GradBBuf[Mu][X] += PreFac1A*GradGC[2*Mu+0];
 
-         B->AddEntry( X, Y,   PreFac1B*GC[0]);
-         B->AddEntry( X, Y+1, PreFac2B*GC[1]);
-         if ( !Symmetric || (nea!=neb) )
-          B->AddEntry( X+1, Y, PreFac2B*GC[1]);
-         B->AddEntry( X+1, Y+1, PreFac3B*GC[0]);
-
-         for(Mu=0; Mu<NumGradientComponents; Mu++)
+            for(Mu=0; Mu<NumTorqueAxes; Mu++)
+             dBdThetaBuf[Mu][X] += PreFac1A*dGCdT[2*Mu+0];
+          }
+         else if ( SaIsPEC && !SbIsPEC )
           { 
-            if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1B*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X, Y+1, PreFac2B*GradGC[2*Mu+1]);
-            if ( !Symmetric || (nea!=neb) )
-             GradB[Mu]->AddEntry( X+1, Y, PreFac2B*GradGC[2*Mu+1]);
-            GradB[Mu]->AddEntry( X+1, Y+1, PreFac3B*GradGC[2*Mu+0]);
-          };
-
-         for(Mu=0; Mu<NumTorqueAxes; Mu++)
+            Y=X+LDT;
+            BBuf[X] += PreFac1A*GC[0];
+            BBuf[Y] += PreFac2A*GC[1];
+
+            for(Mu=0; Mu<NumGradientComponents; Mu++)
+             { if (!GradB[Mu]) continue;
+               GradBBuf[Mu][X] += PreFac1A*GradGC[2*Mu+0];
+               GradBBuf[Mu][Y] += PreFac2A*GradGC[2*Mu+1];
+             };
+
+            for(Mu=0; Mu<NumTorqueAxes; Mu++)
+             { dBdThetaBuf[Mu][X] += PreFac1A*dGCdT[2*Mu+0];
+               dBdThetaBuf[Mu][Y] += PreFac2A*dGCdT[2*Mu+1];
+             };
+          }
+         else if ( !SaIsPEC && SbIsPEC )
+          {
+            BBuf[X]   += PreFac1A*GC[0];
+            BBuf[X+1] += PreFac2A*GC[1];
+
+            for(Mu=0; Mu<NumGradientComponents; Mu++)
+             { if (!GradB[Mu]) continue;
+               GradBBuf[Mu][X]   += PreFac1A*GradGC[2*Mu+0];
+               GradBBuf[Mu][X+1] += PreFac2A*GradGC[2*Mu+1];
+             };
+
+            for(Mu=0; Mu<NumTorqueAxes; Mu++)
+             { dBdThetaBuf[Mu][X]   += PreFac1A*dGCdT[2*Mu+0];
+               dBdThetaBuf[Mu][X+1] += PreFac2A*dGCdT[2*Mu+1];
+             };
+          }
+         else if ( !SaIsPEC && !SbIsPEC )
           { 
-            dBdTheta[Mu]->AddEntry( X, Y,   PreFac1B*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X, Y+1, PreFac2B*dGCdT[2*Mu+1]);
-            if ( !Symmetric || (nea!=neb) )
-             dBdTheta[Mu]->AddEntry( X+1, Y, PreFac2B*dGCdT[2*Mu+1]);
-            dBdTheta[Mu]->AddEntry( X+1, Y+1, PreFac3B*dGCdT[2*Mu+0]);
-          };
-       }; // if (EpsB!=0.0)
-
-    }; // for(nea=0; nea<NEa; nea++), for(neb=nebStart*nea; neb<NEb; neb++) ... 
+            Y=X+LDT;
+            bool LowerOffDiagonal = ( !Symmetric || (nea!=neb) );
+
+            BBuf[X]   += PreFac1A*GC[0];
+            BBuf[Y]   += PreFac2A*GC[1];
+            if (LowerOffDiagonal)
+             BBuf[X+1] += PreFac2A*GC[1];
+            BBuf[Y+1] += PreFac3A*GC[0];
+
+            for(Mu=0; Mu<NumGradientComponents; Mu++)
+             { 
+               if (!GradB[Mu]) continue;
+               GradBBuf[Mu][X]   += PreFac1A*GradGC[2*Mu+0];
+               GradBBuf[Mu][Y]   += PreFac2A*GradGC[2*Mu+1];
+               if (LowerOffDiagonal)
+                GradBBuf[Mu][X+1] += PreFac2A*GradGC[2*Mu+1];
+               GradBBuf[Mu][Y+1] += PreFac3A*GradGC[2*Mu+0];
+             };
+
+            for(Mu=0; Mu<NumTorqueAxes; Mu++)
+             { 
+               dBdThetaBuf[Mu][X]   += PreFac1A*dGCdT[2*Mu+0];
+               dBdThetaBuf[Mu][Y]   += PreFac2A*dGCdT[2*Mu+1];
+               if (LowerOffDiagonal)
+                dBdThetaBuf[Mu][X+1] += PreFac2A*dGCdT[2*Mu+1];
+               dBdThetaBuf[Mu][Y+1] += PreFac3A*dGCdT[2*Mu+0];
+             };
+
+          }; // if ( OaIsPEC && ObIsPEC ) ... else ... 
+
+         /*--------------------------------------------------------------*/
+         /*- contributions of second medium if present.                  */
+         /*- note this case we already know we are in the fourth case    */
+         /*- of the above if...else statement.                           */
+         /*--------------------------------------------------------------*/
+         if (EpsB!=0.0)
+          { 
+            GetEEIArgs->k   = kB;
+            GetEEIArgs->GBA = Args->GBA2;
+            GetEdgeEdgeInteractions(GetEEIArgs);
+
+            Y=X+LDT;
+            bool LowerOffDiagonal = ( !Symmetric || (nea!=neb) );
+
+            BBuf[X]   += PreFac1B*GC[0];
+            BBuf[Y]   += PreFac2B*GC[1];
+            if (LowerOffDiagonal)
+             BBuf[X+1] += PreFac2B*GC[1];
+            BBuf[Y+1] += PreFac3B*GC[0];
+
+            for(Mu=0; Mu<NumGradientComponents; Mu++)
+             { 
+               if (!GradB[Mu]) continue;
+               GradBBuf[Mu][X]   += PreFac1B*GradGC[2*Mu+0];
+               GradBBuf[Mu][Y]   += PreFac2B*GradGC[2*Mu+1];
+               if (LowerOffDiagonal)
+                GradBBuf[Mu][X+1] += PreFac2B*GradGC[2*Mu+1];
+               GradBBuf[Mu][Y+1] += PreFac3B*GradGC[2*Mu+0];
+             };
+
+            for(Mu=0; Mu<NumTorqueAxes; Mu++)
+             { 
+               dBdThetaBuf[Mu][X]   += PreFac1B*dGCdT[2*Mu+0];
+               dBdThetaBuf[Mu][Y]   += PreFac2B*dGCdT[2*Mu+1];
+               if (LowerOffDiagonal)
+                dBdThetaBuf[Mu][X+1] += PreFac2B*dGCdT[2*Mu+1];
+               dBdThetaBuf[Mu][Y+1] += PreFac3B*dGCdT[2*Mu+0];
+             };
+          }; // if (EpsB!=0.0)
+
+       }; // for(nea=...; nea<neaTileMax; nea++), for(neb=nebStart*nea; neb<NEb; neb++) ... 
+
+     /*--------------------------------------------------------------*/
+     /*- add the finished tile into the output matrices. the rows   -*/
+     /*- of this tile belong to no other thread.                    -*/
+     /*--------------------------------------------------------------*/
+     int TileRows = BFPerEdgeA*(neaTileMax-neaTile);
+     int TileRowOffset = RowOffset + BFPerEdgeA*neaTile;
+     for(int nm=0; nm<NumOutMats; nm++)
+      OutMats[nm]->AddTile(TileMats[nm], TileRowOffset, ColOffset, TileRows, NCols);
+
+   }; // for(int neaTile=...)
+
+  for(int nm=0; nm<NumOutMats; nm++)
+   delete TileMats[nm];
+  delete[] TileBuffer;
 
   memcpy(TD->PPIAlgorithmCount, GetEEIArgs->PPIAlgorithmCount, NUMPPIALGORITHMS*sizeof(unsigned));
   return 0;
@@ -420,10 +486,28 @@ void AddSurfaceZetaContributionToBEMMatrix(GetSSIArgStruct *Args)
 
 }
 
-/***************************************************************/  
-/***************************************************************/  
 /***************************************************************/
-void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
+/* GetSurfaceSurfaceInteractions proceeds in three stages,     */
+/* which are also exported separately for use by the global    */
+/* block scheduler in AssembleBEMMatrix.cc:                    */
+/*                                                             */
+/*  (1) InitSSIBlock() zeroes the block (unless Accumulate is  */
+/*      set) and fills in the material-property fields of Args.*/
+/*      It returns false if the two surfaces do not interact.  */
+/*      It also clears the Symmetric flags of the output       */
+/*      matrices, which the threads of stage 2 then leave      */
+/*      alone.                                                 */
+/*                                                             */
+/*  (2) GetSSIRowRange() computes the contributions of row     */
+/*      edges neaMin <= nea < neaMax on a single thread.       */
+/*      Calls for disjoint row ranges may run concurrently.    */
+/*                                                             */
+/*  (3) FinishSSIBlock() adds multipole contributions of       */
+/*      well-separated edge clusters and surface-conductivity  */
+/*      terms, and fills in the lower triangle of symmetric    */
+/*      blocks.                                                */
+/***************************************************************/
+bool InitSSIBlock(GetSSIArgStruct *Args)
 { 
   RWGGeometry *G = Args->G;
   cdouble Omega = Args->Omega;
@@ -436,6 +520,22 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
   /*--------------------------------------------------------------*/
   G->UpdateCachedEpsMuValues(Omega);
 
+  /*--------------------------------------------------------------*/
+  /*- the block is about to change, so the output matrices are   -*/
+  /*- no longer known to be symmetric. the flag is cleared here, -*/
+  /*- before any threads start, since the row-range threads of   -*/
+  /*- GetSurfaceSurfaceInteractions and AssembleBEMMatrixByTiles -*/
+  /*- add their tiles with HMatrix::AddTile(), which does not    -*/
+  /*- touch it.                                                  -*/
+  /*--------------------------------------------------------------*/
+  Args->B->Symmetric=false;
+  for(int Mu=0; Mu<3; Mu++)
+   { if (Args->GradB && Args->GradB[Mu])
+      Args->GradB[Mu]->Symmetric=false;
+     if (Args->dBdTheta && Args->dBdTheta[Mu])
+      Args->dBdTheta[Mu]->Symmetric=false;
+   };
+
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
@@ -463,7 +563,7 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
   int CommonRegions[2]; 
   int NumCommonRegions=CountCommonRegions(Sa, Sb, CommonRegions, Signs);
   if (NumCommonRegions==0)
-   return;
+   return false;
 
   Args->EpsA  = G->EpsTF[ CommonRegions[0] ];
   Args->MuA   = G->MuTF[  CommonRegions[0] ];
@@ -489,17 +589,128 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
    Args->EpsB=Args->MuB=Args->SignB=0.0;
 
   if ( Args->EpsA==0.0 && Args->EpsB==0.0 )
+   return false;
+
+  /***************************************************************/
+  /* set up the multipole treatment of well-separated edge pairs */
+  /* if it was requested                                         */
+  /***************************************************************/
+  InitMultipoleBlock(Args);
+
+  return true;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void GetSSIRowRange(GetSSIArgStruct *Args, int neaMin, int neaMax,
+                    unsigned *PPIAlgorithmCount)
+{
+  ThreadData TD1;
+  TD1.nt=0;
+  TD1.NumTasks=1;
+  TD1.Args=Args;
+  TD1.neaMin=neaMin;
+  TD1.neaMax=neaMax;
+  TD1.TileEdges=0;
+  GSSIThread((void *)&TD1);
+  if (PPIAlgorithmCount)
+   for(int n=0; n<NUMPPIALGORITHMS; n++)
+    PPIAlgorithmCount[n] += TD1.PPIAlgorithmCount[n];
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void FinishSSIBlock(GetSSIArgStruct *Args)
+{
+  RWGGeometry *G = Args->G;
+
+  /***************************************************************/
+  /* fill in the entries skipped by GSSIThread                   */
+  /***************************************************************/
+  if (Args->MPBlock)
+   { AddMultipoleInteractions(Args);
+     DestroyMultipoleBlock(Args);
+   };
+
+  /***************************************************************/
+  /* 20120526 handle objects with finite surface conductivity    */
+  /***************************************************************/
+  if ( (Args->Sa == Args->Sb) && Args->Sa->SurfaceZeta!=0)
+   AddSurfaceZetaContributionToBEMMatrix(Args);
+
+  /***************************************************************/
+  /* if the caller specified the matrix as symmetric, then so far*/
+  /* we have only computed the upper triangle, so now we need to */
+  /* fill in the lower triangle. The exception is if the matrix  */
+  /* uses packed storage, in which case only the upper triangle  */
+  /* is stored anyway. Only the block itself is touched, since   */
+  /* other blocks of the matrix may be under construction on    */
+  /* other threads.                                              */
+  /***************************************************************/
+  if ( Args->Symmetric && (Args->B->StorageType==LHM_NORMAL) )
+   { 
+     if (G->LogLevel>=SCUFF_VERBOSE2)
+      Log("Handling symmetry...");
+     int Offset=Args->RowOffset, NBF=Args->Sa->NumBFs;
+     for(int nr=1; nr<NBF; nr++)
+      for(int nc=0; nc<nr; nc++)
+       Args->B->SetEntry(Offset+nr,Offset+nc,Args->B->GetEntry(Offset+nc,Offset+nr));
+     if (G->LogLevel>=SCUFF_VERBOSE2)
+      Log("...done with symmetry...");
+   };
+}
+
+/***************************************************************/  
+/***************************************************************/  
+/***************************************************************/
+void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
+{ 
+  RWGGeometry *G = Args->G;
+  RWGSurface  *Sa = Args->Sa;
+
+  if ( !InitSSIBlock(Args) )
    return;
 
   /***************************************************************/
   /* fire off threads ********************************************/
   /***************************************************************/
-  GlobalFIPPICache.Hits=GlobalFIPPICache.Misses=0;
+  GlobalFIPPICache.Stats.Reset();
 
   int nt, NumTasks, NumThreads = GetNumThreads();
+  int NEa = Sa->NumEdges;
   unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];  
   memset(PPIAlgorithmCount, 0, NUMPPIALGORITHMS*sizeof(unsigned));
 
+  /***************************************************************/
+  /* panel-pair-centric assembly (see PanelPairAssembly.cc); for */
+  /* symmetric blocks this path handles only the matrix itself,  */
+  /* not its derivatives.                                        */
+  /***************************************************************/
+  bool ByPanelPair = RWGGeometry::UsePanelPairAssembly;
+  if ( Args->Symmetric && (Args->GradB || Args->NumTorqueAxes>0) )
+   ByPanelPair=false;
+
+  if (ByPanelPair)
+   GetSSIsByPanelPair(Args, PPIAlgorithmCount);
+  else
+   {
+  /***************************************************************/
+  /* each task computes a contiguous range of rows of the block  */
+  /* in a private buffer (see GSSIThread). there are several     */
+  /* tasks per thread to even out the load, since in symmetric   */
+  /* blocks the rows near the top carry more work than the rows  */
+  /* near the bottom.                                            */
+  /***************************************************************/
+  NumTasks = 16*NumThreads;
+  if (NumTasks>NEa) 
+   NumTasks=NEa;
+  if (NumTasks<1)
+   NumTasks=1;
+  int TaskEdges = (NEa + NumTasks - 1) / NumTasks;
+  NumTasks = (NEa + TaskEdges - 1) / TaskEdges;
+
 #ifdef USE_PTHREAD
   ThreadData *TDs = new ThreadData[NumThreads], *TD;
   pthread_t *Threads = new pthread_t[NumThreads];
@@ -509,28 +720,29 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
      TD->nt=nt;
      TD->NumTasks=NumThreads;
      TD->Args=Args;
+     TD->neaMin=0;
+     TD->neaMax=NEa;
+     TD->TileEdges=TaskEdges;
      if (nt+1 == NumThreads)
        GSSIThread((void *)TD);
      else
        pthread_create( &(Threads[nt]), 0, GSSIThread, (void *)TD);
    }
-  for(nt=0; nt<NumThreads-1; nt++)
-   { pthread_join(Threads[nt],0);
+  for(nt=0; nt<NumThreads; nt++)
+   { if (nt+1 < NumThreads)
+      pthread_join(Threads[nt],0);
      for(int n=0; n<NUMPPIALGORITHMS; n++)
-      PPIAlgorithmCount[n] += TD->PPIAlgorithmCount[n];
+      PPIAlgorithmCount[n] += TDs[nt].PPIAlgorithmCount[n];
    };
   delete[] Threads;
   delete[] TDs;
 
 #else 
 #ifndef USE_OPENMP
-  NumTasks=NumThreads=1;
+  NumThreads=1;
   if (G->LogLevel>=SCUFF_VERBOSE2)
    Log(" no multithreading...");
 #else
-  NumTasks=NumThreads*100;
-  if (NumTasks>Sa->NumEdges) 
-   NumTasks=Sa->NumEdges;
   if (G->LogLevel>=SCUFF_VERBOSE2)
    Log(" OpenMP multithreading (%i threads,%i tasks)...",NumThreads,NumTasks);
 #pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
@@ -538,17 +750,24 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
   for(nt=0; nt<NumTasks; nt++)
    { 
      ThreadData TD1;
-     TD1.nt=nt;
-     TD1.NumTasks=NumTasks;
+     TD1.nt=0;
+     TD1.NumTasks=1;
      TD1.Args=Args;
+     TD1.neaMin=nt*TaskEdges;
+     TD1.neaMax=(nt+1)*TaskEdges < NEa ? (nt+1)*TaskEdges : NEa;
+     TD1.TileEdges=0;
      GSSIThread((void *)&TD1);
+#ifdef USE_OPENMP
+#pragma omp critical
+#endif
      for(int n=0; n<NUMPPIALGORITHMS; n++)
       PPIAlgorithmCount[n] += TD1.PPIAlgorithmCount[n];
    };
 #endif
+   }; // if (ByPanelPair) ... else ...
 
   if (G->LogLevel>=SCUFF_VERBOSE2)
-   { Log("  %i/%i cache hits/misses",GlobalFIPPICache.Hits,GlobalFIPPICache.Misses);
+   { GlobalFIPPICache.LogStatistics();
      Log("  PPIs: LOC(%u), HOC(%u), TD(%u), HK(%u), D(%u)",
             PPIAlgorithmCount[PPIALG_LOCUBATURE],
             PPIAlgorithmCount[PPIALG_HOCUBATURE],
@@ -557,30 +776,7 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
             PPIAlgorithmCount[PPIALG_DESING]);
    };
 
-  /***************************************************************/
-  /* 20120526 handle objects with finite surface conductivity    */
-  /***************************************************************/
-  if ( (Args->Sa == Args->Sb) && Args->Sa->SurfaceZeta!=0)
-   AddSurfaceZetaContributionToBEMMatrix(Args);
-
-  /***************************************************************/
-  /* if the caller specified the matrix as symmetric, then so far*/
-  /* we have only computed the upper triangle, so now we need to */
-  /* fill in the lower triangle. The exception is if the matrix  */
-  /* uses packed storage, in which case only the upper triangle  */
-  /* is stored anyway.                                           */
-  /***************************************************************/
-  if ( Args->Symmetric && (Args->B->StorageType==LHM_NORMAL) )
-   { 
-     if (G->LogLevel>=SCUFF_VERBOSE2)
-      Log("Handling symmetry...");
-     int N=Args->B->NR;
-     for(int nr=1; nr<N; nr++)
-      for(int nc=0; nc<nr; nc++)
-       Args->B->SetEntry(nr,nc,Args->B->GetEntry(nc,nr));
-     if (G->LogLevel>=SCUFF_VERBOSE2)
-      Log("...done with symmetry...");
-   };
+  FinishSSIBlock(Args);
 
 }
 
@@ -619,6 +815,8 @@ void InitGetSSIArgs(GetSSIArgStruct *Args)
 
   Args->Displacement = 0;
 
+  Args->MPBlock = 0;
+
   Args->GradB=0;
   Args->dBdTheta=0;
 
@@ -0,0 +1,585 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * TBlockStore.cc -- storage and retrieval of diagonal ("T") blocks
+ *                -- of the BEM matrix, in memory and on disk
+ *
+ * Applications that sweep frequency for geometries built from the
+ * same body meshes (scuff-neq, scuff-cas3D, ...) spend much of their
+ * time assembling the same self-interaction blocks over and over.
+ * AssembleBEMMatrixBlock() therefore looks up each diagonal block in
+ * a two-level store before assembling it, and files each newly
+ * assembled diagonal block there:
+ *
+ *  (a) an in-memory LRU store, limited to SCUFF_TBLOCK_MB megabytes
+ *      (default 1024 if a T-block directory is set, otherwise 0);
+ *
+ *  (b) one file per block in the directory SCUFF_TBLOCK_PATH (read
+ *      and write) or SCUFF_TBLOCK_READPATH (read only).
+ *
+ * A block is identified by a key built from the mesh file name, the
+ * geometry's TBlockCacheNameAddendum, the frequency and bloch vector,
+ * a suffix indicating whether the interior or exterior medium was
+ * zeroed, and the names of the materials on either side of the
+ * surface; the same string serves as the file name. Each file consists
+ * of a TBlockFileHeader, the key, and the raw matrix data. The header
+ * records the matrix dimension and type and FNV-1a checksums of the
+ * header and data, all of which are checked on reading, so a file
+ * that was truncated or written for a different block is ignored.
+ * Files are written to a temporary file which is then renamed into
+ * place. Raw-data files written by earlier versions of the code
+ * (with extension .hdf5) are still read; since those versions did
+ * not put material names in their file names, such files are looked
+ * up under the old form of the key (see GetTBlockKey()), and it is
+ * up to the user not to mix blocks for different materials in one
+ * directory of old files.
+ *
+ * RWGGeometry::PrefetchTBlocks() queues the blocks for a given
+ * frequency to be read from disk into memory by a background thread,
+ * so that an application can fetch the blocks for its next frequency
+ * while it is computing at the current one. A lookup of a block that
+ * is being read in the background waits for the read to complete.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <libhmat.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+#define TBLOCK_MAGIC     "SCUFFTB"
+#define TBLOCK_VERSION   1
+#define TBLOCK_DEFAULTMB 1024.0
+
+typedef struct TBlockFileHeader
+ { char     Magic[8];        // "SCUFFTB" + 0
+   uint32_t Version;
+   uint32_t RealComplex;     // LHM_REAL or LHM_COMPLEX
+   uint64_t NBF;             // block is NBF x NBF
+   uint64_t KeyLength;       // key follows header (no terminator)
+   uint64_t DataChecksum;    // checksum of matrix data
+   uint64_t HeaderChecksum;  // checksum of key and preceding header bytes
+ } TBlockFileHeader;
+
+/***************************************************************/
+/* a T-block held in memory                                    */
+/***************************************************************/
+typedef struct TBlock
+ { std::string Key;
+   int NBF;
+   int RealComplex;
+   size_t Bytes;
+   void *Data;
+ } TBlock;
+
+static void DestroyTBlock(TBlock *B)
+{ free(B->Data);
+  delete B;
+}
+
+static size_t TBlockBytes(int NBF, int RealComplex)
+{ return ((size_t)NBF)*((size_t)NBF)
+          *(RealComplex==LHM_COMPLEX ? sizeof(cdouble) : sizeof(double));
+}
+
+typedef struct TBlockRequest
+ { std::string Key;
+   std::string LegacyKey;
+   int NBF;
+ } TBlockRequest;
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+class TBlockStore
+ {
+  public:
+    TBlockStore();
+
+    bool Read(const std::string &Key, const std::string &LegacyKey,
+              int NBF, HMatrix *M, int RowOffset, int ColOffset);
+    void Write(const std::string &Key, HMatrix *B);
+    void Prefetch(std::vector<TBlockRequest> &Requests);
+    void PrefetchLoop();
+    size_t GetMaxBytes();
+
+    double BudgetMB;     // <0 means default
+
+  private:
+    TBlock *FindInMemory(const std::string &Key);
+    bool AddToMemory(TBlock *B);
+    TBlock *Load(const std::string &Key, const std::string &LegacyKey, int NBF);
+
+    // all of the following are protected by Mutex
+    std::map<std::string, std::list<TBlock *>::iterator> Index;
+    std::list<TBlock *> LRU;   // most recently used first
+    size_t Bytes;
+    std::set<std::string> Loading;
+    std::vector<TBlockRequest> Queue;
+    bool PrefetchThreadStarted;
+    pthread_mutex_t Mutex;
+    pthread_cond_t LoadDone, QueueNonEmpty;
+ };
+
+TBlockStore::TBlockStore()
+{
+  BudgetMB=-1.0;
+  Bytes=0;
+  PrefetchThreadStarted=false;
+  pthread_mutex_init(&Mutex, 0);
+  pthread_cond_init(&LoadDone, 0);
+  pthread_cond_init(&QueueNonEmpty, 0);
+}
+
+static TBlockStore GlobalTBlockStore;
+
+void SetTBlockStoreBudget(double MegaBytes)
+{
+  GlobalTBlockStore.BudgetMB = MegaBytes;
+}
+
+/***************************************************************/
+/* directory in which T-block files are read or written        */
+/***************************************************************/
+static const char *GetTBlockDir(bool ForWriting)
+{
+  const char *Dir = getenv("SCUFF_TBLOCK_PATH");
+  if (Dir==0 && !ForWriting)
+   Dir = getenv("SCUFF_TBLOCK_READPATH");
+  return Dir;
+}
+
+size_t TBlockStore::GetMaxBytes()
+{
+  double MB = BudgetMB;
+  if (MB<0.0)
+   MB = GetTBlockDir(false) ? TBLOCK_DEFAULTMB : 0.0;
+  return (size_t)(MB*1048576.0);
+}
+
+/***************************************************************/
+/* the caller must hold Mutex for the following two routines   */
+/***************************************************************/
+TBlock *TBlockStore::FindInMemory(const std::string &Key)
+{
+  std::map<std::string, std::list<TBlock *>::iterator>::iterator
+   it=Index.find(Key);
+  if (it==Index.end())
+   return 0;
+  LRU.splice(LRU.begin(), LRU, it->second);
+  return *(it->second);
+}
+
+// returns false if B is not retained, in which case the caller
+// remains responsible for it
+bool TBlockStore::AddToMemory(TBlock *B)
+{
+  size_t MaxBytes=GetMaxBytes();
+  if (B->Bytes > MaxBytes || Index.find(B->Key)!=Index.end())
+   return false;
+  while( Bytes + B->Bytes > MaxBytes )
+   { TBlock *Oldest=LRU.back();
+     LRU.pop_back();
+     Index.erase(Oldest->Key);
+     Bytes-=Oldest->Bytes;
+     DestroyTBlock(Oldest);
+   };
+  LRU.push_front(B);
+  Index[B->Key]=LRU.begin();
+  Bytes+=B->Bytes;
+  return true;
+}
+
+/***************************************************************/
+/* read a T-block file, returning 0 if there is no valid file  */
+/* for the given key; LegacyKey is the name under which earlier */
+/* versions filed the same block                               */
+/***************************************************************/
+TBlock *TBlockStore::Load(const std::string &Key, const std::string &LegacyKey,
+                          int NBF)
+{
+  const char *Dir=GetTBlockDir(false);
+  if (!Dir) return 0;
+
+  char *FileName=vstrdup("%s/%s.tblock",Dir,Key.c_str());
+  FILE *f=fopen(FileName,"r");
+  TBlock *B=0;
+  if (f)
+   {
+     TBlockFileHeader Header;
+     std::vector<char> FileKey(Key.size()+1);
+     const char *ErrMsg=0;
+     if ( fread(&Header, sizeof(Header), 1, f)!=1 )
+      ErrMsg="file too short";
+     else if ( strcmp(Header.Magic, TBLOCK_MAGIC) || Header.Version!=TBLOCK_VERSION )
+      ErrMsg="not a T-block file";
+     else if ( Header.KeyLength!=Key.size() || Header.NBF!=(uint64_t)NBF )
+      ErrMsg="file is for a different block";
+     else if ( fread(&(FileKey[0]), 1, Key.size(), f)!=Key.size() )
+      ErrMsg="file too short";
+     else if ( memcmp(&(FileKey[0]), Key.c_str(), Key.size()) )
+      ErrMsg="file is for a different block";
+     else
+      { uint64_t Checksum = CacheKeyHash(&Header, offsetof(TBlockFileHeader, HeaderChecksum));
+        Checksum ^= CacheKeyHash(Key.c_str(), Key.size());
+        if (Checksum!=Header.HeaderChecksum)
+         ErrMsg="header checksum mismatch";
+      };
+
+     if (!ErrMsg)
+      { B=new TBlock;
+        B->Key=Key;
+        B->NBF=NBF;
+        B->RealComplex=Header.RealComplex;
+        B->Bytes=TBlockBytes(NBF, B->RealComplex);
+        B->Data=mallocEC(B->Bytes);
+        if ( fread(B->Data, 1, B->Bytes, f)!=B->Bytes )
+         ErrMsg="file too short";
+        else if ( CacheKeyHash(B->Data, B->Bytes)!=Header.DataChecksum )
+         ErrMsg="data checksum mismatch";
+        if (ErrMsg)
+         { DestroyTBlock(B);
+           B=0;
+         };
+      };
+     if (ErrMsg)
+      Warn("ignoring T-block file %s (%s)",FileName,ErrMsg);
+     fclose(f);
+   }
+  else
+   {
+     // raw-data file written by an earlier version; the type of
+     // the matrix is inferred from the file size
+     free(FileName);
+     FileName=vstrdup("%s/%s.hdf5",Dir,LegacyKey.c_str());
+     struct stat st;
+     if ( stat(FileName, &st)==0 && (f=fopen(FileName,"r")) )
+      { int RealComplex = -1;
+        if ( (size_t)st.st_size == TBlockBytes(NBF, LHM_COMPLEX) )
+         RealComplex=LHM_COMPLEX;
+        else if ( (size_t)st.st_size == TBlockBytes(NBF, LHM_REAL) )
+         RealComplex=LHM_REAL;
+        if (RealComplex!=-1)
+         { B=new TBlock;
+           B->Key=Key;
+           B->NBF=NBF;
+           B->RealComplex=RealComplex;
+           B->Bytes=TBlockBytes(NBF, RealComplex);
+           B->Data=mallocEC(B->Bytes);
+           if ( fread(B->Data, 1, B->Bytes, f)!=B->Bytes )
+            { DestroyTBlock(B);
+              B=0;
+            };
+         };
+        fclose(f);
+      };
+   };
+
+  if (B)
+   Log("Read T-block %s from file %s",Key.c_str(),FileName);
+  free(FileName);
+  return B;
+}
+
+/***************************************************************/
+/* look up the T-block for the given key and, if found, stamp  */
+/* it into M at the given offsets                              */
+/***************************************************************/
+bool TBlockStore::Read(const std::string &Key, const std::string &LegacyKey,
+                       int NBF, HMatrix *M, int RowOffset, int ColOffset)
+{
+  pthread_mutex_lock(&Mutex);
+
+  // wait for a background read of this block to complete
+  while( Loading.count(Key) )
+   pthread_cond_wait(&LoadDone, &Mutex);
+
+  TBlock *B=FindInMemory(Key);
+  bool Owned=false;
+  if (!B)
+   { Loading.insert(Key);
+     pthread_mutex_unlock(&Mutex);
+     B=Load(Key, LegacyKey, NBF);
+     pthread_mutex_lock(&Mutex);
+     Loading.erase(Key);
+     pthread_cond_broadcast(&LoadDone);
+     if (B && !AddToMemory(B))
+      Owned=true;
+   };
+
+  bool Success = ( B && B->NBF==NBF && B->RealComplex==M->RealComplex );
+  if (Success)
+   { HMatrix BlockMatrix(NBF, NBF, B->RealComplex, B->Data);
+     M->InsertBlock(&BlockMatrix, RowOffset, ColOffset);
+   };
+  pthread_mutex_unlock(&Mutex);
+
+  if (Owned)
+   DestroyTBlock(B);
+  return Success;
+}
+
+/***************************************************************/
+/* file the T-block B in memory and, if a T-block directory is */
+/* set, on disk                                                */
+/***************************************************************/
+void TBlockStore::Write(const std::string &Key, HMatrix *BMatrix)
+{
+  TBlock *B=new TBlock;
+  B->Key=Key;
+  B->NBF=BMatrix->NR;
+  B->RealComplex=BMatrix->RealComplex;
+  B->Bytes=TBlockBytes(B->NBF, B->RealComplex);
+  B->Data=mallocEC(B->Bytes);
+  memcpy(B->Data,
+         B->RealComplex==LHM_COMPLEX ? (void *)BMatrix->ZM : (void *)BMatrix->DM,
+         B->Bytes);
+
+  const char *Dir=GetTBlockDir(true);
+  if (Dir)
+   {
+     TBlockFileHeader Header;
+     memset(&Header, 0, sizeof(Header));
+     strcpy(Header.Magic, TBLOCK_MAGIC);
+     Header.Version=TBLOCK_VERSION;
+     Header.RealComplex=B->RealComplex;
+     Header.NBF=B->NBF;
+     Header.KeyLength=Key.size();
+     Header.DataChecksum=CacheKeyHash(B->Data, B->Bytes);
+     Header.HeaderChecksum
+      = CacheKeyHash(&Header, offsetof(TBlockFileHeader, HeaderChecksum))
+         ^ CacheKeyHash(Key.c_str(), Key.size());
+
+     char *FileName=vstrdup("%s/%s.tblock",Dir,Key.c_str());
+     static int NumTempFiles=0;
+     char *TempFileName=vstrdup("%s.%s.%i.%i",FileName,GetHostName(),(int)getpid(),
+                                __sync_fetch_and_add(&NumTempFiles,1));
+     FILE *f=fopen(TempFileName,"w");
+     bool Success = f
+                    && fwrite(&Header, sizeof(Header), 1, f)==1
+                    && fwrite(Key.c_str(), 1, Key.size(), f)==Key.size()
+                    && fwrite(B->Data, 1, B->Bytes, f)==B->Bytes;
+     if (f && fclose(f)!=0)
+      Success=false;
+     if (Success && rename(TempFileName, FileName)==0)
+      Log("Wrote T-block %s to file %s",Key.c_str(),FileName);
+     else
+      { Warn("could not write T-block file %s",FileName);
+        unlink(TempFileName);
+      };
+     free(TempFileName);
+     free(FileName);
+   };
+
+  pthread_mutex_lock(&Mutex);
+  bool Retained=AddToMemory(B);
+  pthread_mutex_unlock(&Mutex);
+  if (!Retained)
+   DestroyTBlock(B);
+}
+
+/***************************************************************/
+/* background thread that reads queued T-blocks into memory    */
+/***************************************************************/
+static void *TBlockPrefetchThread(void *Store)
+{
+  ((TBlockStore *)Store)->PrefetchLoop();
+  return 0;
+}
+
+void TBlockStore::PrefetchLoop()
+{
+  pthread_mutex_lock(&Mutex);
+  for(;;)
+   {
+     while( Queue.size()==0 )
+      pthread_cond_wait(&QueueNonEmpty, &Mutex);
+     TBlockRequest Request=Queue.front();
+     Queue.erase(Queue.begin());
+
+     if ( Loading.count(Request.Key) || Index.count(Request.Key) )
+      continue;
+
+     Loading.insert(Request.Key);
+     pthread_mutex_unlock(&Mutex);
+     TBlock *B=Load(Request.Key, Request.LegacyKey, Request.NBF);
+     pthread_mutex_lock(&Mutex);
+     Loading.erase(Request.Key);
+     if (B && !AddToMemory(B))
+      DestroyTBlock(B);
+     pthread_cond_broadcast(&LoadDone);
+   };
+}
+
+void TBlockStore::Prefetch(std::vector<TBlockRequest> &Requests)
+{
+  if ( GetTBlockDir(false)==0 || GetMaxBytes()==0 )
+   return;
+
+  pthread_mutex_lock(&Mutex);
+  if (!PrefetchThreadStarted)
+   { pthread_t Thread;
+     if ( pthread_create(&Thread, 0, TBlockPrefetchThread, (void *)this) )
+      { pthread_mutex_unlock(&Mutex);
+        Warn("could not start T-block prefetch thread");
+        return;
+      };
+     pthread_detach(Thread);
+     PrefetchThreadStarted=true;
+   };
+  // requests for an earlier frequency that have not been served
+  // yet are no longer of interest
+  Queue=Requests;
+  pthread_cond_signal(&QueueNonEmpty);
+  pthread_mutex_unlock(&Mutex);
+}
+
+/***************************************************************/
+/* key under which the diagonal block for surface #ns is filed;*/
+/* if Legacy is true, the key under which versions of the code */
+/* that wrote raw .hdf5 files filed it, which omits the        */
+/* material names and the interpolation tolerance              */
+/***************************************************************/
+static std::string GetTBlockKey(RWGGeometry *G, int ns,
+                                cdouble Omega, double *kBloch,
+                                const char *Suffix, bool Legacy=false)
+{
+  char K4VStr[200];
+  if (imag(Omega)==0.0)
+   snprintf(K4VStr,200,"%.6e",real(Omega));
+  else if (real(Omega)==0.0)
+   snprintf(K4VStr,200,"%.6eI",imag(Omega));
+  else
+   snprintf(K4VStr,200,"%.6e+%.6eI",real(Omega),imag(Omega));
+  std::string Key(K4VStr);
+  if (G->LDim>=1)
+   { snprintf(K4VStr,200,"_%.6e",kBloch ? kBloch[0] : 0.0);
+     Key+=K4VStr;
+   };
+  if (G->LDim>=2)
+   { snprintf(K4VStr,200,"_%.6e",kBloch ? kBloch[1] : 0.0);
+     Key+=K4VStr;
+   };
+  Key+=Suffix;
+
+  // the block depends on the materials on either side of the
+  // surface, which the mesh file name says nothing about
+  for(int n=0; n<2 && !Legacy; n++)
+   { int nr=G->Surfaces[ns]->RegionIndices[n];
+     if (nr==-1) continue;
+     Key+="_";
+     for(const char *c=G->RegionMPs[nr]->Name; c && *c; c++)
+      Key+= (isalnum((unsigned char)*c) || *c=='.' || *c=='-') ? *c : '_';
+   };
+
+  // blocks interpolated in frequency (FrequencyInterpolation.cc)
+  // are filed separately from exact blocks
+  if (RWGGeometry::FreqInterpTol>0.0 && !Legacy)
+   { snprintf(K4VStr,200,"_FI%.0e",RWGGeometry::FreqInterpTol);
+     Key+=K4VStr;
+   };
+
+  const char *Addendum = G->TBlockCacheNameAddendum;
+  return   std::string(GetFileBase(G->Surfaces[ns]->MeshFileName))
+         + std::string(Addendum ? Addendum : "") + "_" + Key;
+}
+
+/***************************************************************/
+/* look up (Op==TBCOP_READ) or file (Op==TBCOP_WRITE) the      */
+/* diagonal block for surface #ns, which sits at the given     */
+/* offsets within M.                                           */
+/***************************************************************/
+bool TBlockCacheOp(int Op, RWGGeometry *G, int ns,
+                   cdouble Omega, double *kBloch,
+                   HMatrix *M, int RowOffset, int ColOffset)
+{
+  if ( GetTBlockDir(Op==TBCOP_WRITE)==0 && GlobalTBlockStore.GetMaxBytes()==0 )
+   return false;
+
+  // blocks with multipole-approximated entries are not stored,
+  // since later exact calculations would pick them up
+  if (Op==TBCOP_WRITE && RWGGeometry::MultipoleTol>0.0)
+   return false;
+
+  int nr1=G->Surfaces[ns]->RegionIndices[0];
+  int nr2=G->Surfaces[ns]->RegionIndices[1];
+  const char *Suffix="";
+  if (G->RegionMPs[nr1]->Zeroed)
+   Suffix="_Interior";
+  else if (nr2!=-1 && G->RegionMPs[nr2]->Zeroed)
+   Suffix="_Exterior";
+  std::string Key=GetTBlockKey(G, ns, Omega, kBloch, Suffix);
+
+  int NBF = G->Surfaces[ns]->NumBFs;
+  if (Op==TBCOP_READ)
+   return GlobalTBlockStore.Read(Key, GetTBlockKey(G, ns, Omega, kBloch, Suffix, true),
+                                 NBF, M, RowOffset, ColOffset);
+
+  if ( RowOffset==0 && ColOffset==0 && M->NR==NBF && M->NC==NBF )
+   GlobalTBlockStore.Write(Key, M);
+  else
+   { HMatrix *B=new HMatrix(NBF, NBF, M->RealComplex);
+     M->ExtractBlock(RowOffset, ColOffset, B);
+     GlobalTBlockStore.Write(Key, B);
+     delete B;
+   };
+  return true;
+}
+
+/***************************************************************/
+/* start reading the stored diagonal blocks for the given      */
+/* frequency and bloch vector into memory in the background    */
+/***************************************************************/
+void RWGGeometry::PrefetchTBlocks(cdouble Omega, double *kBloch)
+{
+  const char *Suffixes[3]={"", "_Interior", "_Exterior"};
+  std::vector<TBlockRequest> Requests;
+  for(int ns=0; ns<NumSurfaces; ns++)
+   { if (Mate[ns]!=-1) continue;
+     for(int n=0; n<3; n++)
+      { TBlockRequest Request;
+        Request.Key=GetTBlockKey(this, ns, Omega, kBloch, Suffixes[n]);
+        Request.LegacyKey=GetTBlockKey(this, ns, Omega, kBloch, Suffixes[n], true);
+        Request.NBF=Surfaces[ns]->NumBFs;
+        Requests.push_back(Request);
+      };
+   };
+  GlobalTBlockStore.Prefetch(Requests);
+}
+
+} // namespace scuff
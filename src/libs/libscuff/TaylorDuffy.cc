@@ -33,6 +33,7 @@
 
 #include <libhrutil.h>
 #include <libSGJC.h>
+#include <libTriInt.h>
 
 #include "libscuff.h"
 #include "libscuffInternals.h"
@@ -147,9 +148,38 @@ void ComputeGeometricParameters(TaylorDuffyArgStruct *Args,
                                 TDWorkspace *TDW);
 
 /***************************************************************/
+/* number of subregions, offset of the n index into the K/J/L  */
+/* vectors, innermost integration variable, and jacobian at a  */
+/* given cubature point                                        */
 /***************************************************************/
+static void GetSubregionData(int WhichCase, int TwiceIntegrable,
+                             const double *yVector, int *NumRegions,
+                             int *nOffset, double *y, double *Jacobian)
+{
+  if (WhichCase==TD_COMMONTRIANGLE)
+   { *NumRegions=3;
+     *nOffset=1;
+     *y = (TwiceIntegrable ? 0.0 : yVector[0]);
+     *Jacobian=1.0;
+   }
+  else if (WhichCase==TD_COMMONEDGE)
+   { *NumRegions=6;
+     *nOffset=2;
+     *y = yVector[1];
+     *Jacobian=yVector[0];
+   }
+  else // (WhichCase==TD_COMMONVERTEX)
+   { *NumRegions=2;
+     *nOffset=3;
+     *y = yVector[2];
+     *Jacobian=yVector[1];
+   };
+}
+
 /***************************************************************/
-int TaylorDuffySum(unsigned ndim, const double *yVector, void *parms, 
+/***************************************************************/
+/***************************************************************/
+int TaylorDuffySum(unsigned ndim, const double *yVector, void *parms,
                    unsigned nfun, double *f)
 {
   (void) ndim; // unused
@@ -171,24 +201,8 @@ int TaylorDuffySum(unsigned ndim, const double *yVector, void *parms,
   /*--------------------------------------------------------------*/
   int NumRegions, nOffset;
   double y, Jacobian;
-  if (WhichCase==TD_COMMONTRIANGLE)
-   { NumRegions=3;
-     nOffset=1;
-     y = (TwiceIntegrable ? 0.0 : yVector[0]);
-     Jacobian=1.0;
-   }
-  else if (WhichCase==TD_COMMONEDGE)
-   { NumRegions=6;
-     nOffset=2;
-     y = yVector[1];
-     Jacobian=yVector[0];
-   }
-  else // (WhichCase==TD_COMMONVERTEX)
-   { NumRegions=2;
-     nOffset=3;
-     y = yVector[2];
-     Jacobian=yVector[1];
-   };
+  GetSubregionData(WhichCase, TwiceIntegrable, yVector,
+                   &NumRegions, &nOffset, &y, &Jacobian);
 
   if (Jacobian==0.0)
    { memset(f,0,nfun*sizeof(double));
@@ -269,28 +283,17 @@ void InitTaylorDuffyArgs(TaylorDuffyArgStruct *Args)
 }
 
 /***************************************************************/
+/* initialize the fields of a TDWorkspace that depend only on  */
+/* the case and the kernel set, not on the panel geometry      */
 /***************************************************************/
-/***************************************************************/
-void TaylorDuffy(TaylorDuffyArgStruct *Args)
+static void InitTDWorkspace(TaylorDuffyArgStruct *Args, TDWorkspace *TDW)
 {
-  /***************************************************************/
-  /* unpack fields from argument structure ***********************/
-  /***************************************************************/
   int WhichCase    = Args->WhichCase;
-
   int NumPKs       = Args->NumPKs;
   int *PIndex      = Args->PIndex;
   int *KIndex      = Args->KIndex;
   cdouble *KParam  = Args->KParam;
 
-  double AbsTol    = Args->AbsTol;
-  double RelTol    = Args->RelTol;
-  double MaxEval   = Args->MaxEval;
-
-  /***************************************************************/
-  /* initialize TDW structure to pass data to integrand routines */
-  /***************************************************************/
-  TDWorkspace MyTDW, *TDW=&MyTDW;
   TDW->WhichCase = WhichCase;
   TDW->NumPKs    = NumPKs;
   TDW->PIndex    = PIndex;
@@ -316,13 +319,8 @@ void TaylorDuffy(TaylorDuffyArgStruct *Args)
                   || TDW->NeedP[TD_NMULLERG2]
                   || TDW->NeedP[TD_NMULLERC];
   if ( NeednHat && (Args->nHat)==0 )
-   ErrExit("TaylorDuffy() called with nHat unspecified"); 
+   ErrExit("TaylorDuffy() called with nHat unspecified");
 
-  /***************************************************************/
-  /***************************************************************/
-  /***************************************************************/
-  ComputeGeometricParameters(Args,TDW);
-  
   /***************************************************************/
   /* assume we are twice integrable and check for otherwise      */
   /***************************************************************/
@@ -332,6 +330,30 @@ void TaylorDuffy(TaylorDuffyArgStruct *Args)
    if (KIndex[npk]==TD_HELMHOLTZ || KIndex[npk]==TD_GRADHELMHOLTZ)
     TwiceIntegrable=0;
   TDW->TwiceIntegrable=TwiceIntegrable;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void TaylorDuffy(TaylorDuffyArgStruct *Args)
+{
+  /***************************************************************/
+  /* unpack fields from argument structure ***********************/
+  /***************************************************************/
+  int WhichCase    = Args->WhichCase;
+  int NumPKs       = Args->NumPKs;
+
+  double AbsTol    = Args->AbsTol;
+  double RelTol    = Args->RelTol;
+  double MaxEval   = Args->MaxEval;
+
+  /***************************************************************/
+  /* initialize TDW structure to pass data to integrand routines */
+  /***************************************************************/
+  TDWorkspace MyTDW, *TDW=&MyTDW;
+  InitTDWorkspace(Args, TDW);
+  ComputeGeometricParameters(Args,TDW);
+  int TwiceIntegrable=TDW->TwiceIntegrable;
 
   /***************************************************************/
   /* evaluate the 1-, 2-, or 3- dimensional cubature (for once-  */
@@ -357,6 +379,369 @@ void TaylorDuffy(TaylorDuffyArgStruct *Args)
 
 }
 
+/***************************************************************/
+/* Batched Taylor-Duffy integration.                           */
+/*                                                             */
+/* TaylorDuffyBatch() evaluates the TD integrals for NumPairs  */
+/* argument structures that share the same case and the same   */
+/* {P,K} set (WhichCase, NumPKs, PIndex, KIndex, KParam,       */
+/* ForceOnceIntegrable). Instead of running a separate         */
+/* adaptive cubature for each pair, all pairs are integrated   */
+/* together by a fixed tensor-product Clenshaw-Curtis rule,    */
+/* using a vector-valued integrand in the libSGJC integrand_v  */
+/* layout. The error in each pair is estimated by comparison   */
+/* with the embedded half-order rule (the same estimate used   */
+/* by pcubature). Pairs that fail their own AbsTol/RelTol are  */
+/* recomputed individually with TaylorDuffy(); if that stops  */
+/* at MaxEval with a larger error estimate than the fixed rule */
+/* (common for the 2D and 3D rules, which already exceed the   */
+/* default MaxEval=1000), the fixed-rule result is kept.       */
+/*                                                             */
+/* The kernel factors (the K, or J and L, functions) depend on */
+/* the panel geometry but not on the source/destination        */
+/* vertices Q, QP, so consecutive pairs with identical         */
+/* geometry (e.g. the nine (Q,QP) combinations of one panel    */
+/* pair) form a group that shares a single kernel evaluation   */
+/* per cubature point; only the cheap polynomial P factors are */
+/* evaluated per pair.                                         */
+/***************************************************************/
+
+// number of 1D cubature points per dimension in the fixed rule,
+// indexed by the dimension of the integral; must be odd and such
+// that (N+1)/2 is also supported by GetCCRule
+static const int TDBatchOrder[4]={1, 65, 33, 17};
+
+#define TDBATCH_CHUNK 32
+
+typedef struct TDBatchRule
+ { int NumPts;
+   double *y;     // y[ndim*np + nd] = coordinate nd of point np
+   double *w;     // full-rule weights
+   double *wEmb;  // embedded-rule weights (zero for non-embedded points)
+ } TDBatchRule;
+
+typedef struct TDBatchData
+ { int NumPairs;
+   TDWorkspace *TDWs;
+   int *GroupLeader;          // first pair with the same geometry
+   int *GroupnMin, *GroupnMax;// [NumPairs*NUMPS], valid for leaders
+   cdouble *KBuffer;          // [3*NumPKs*NUMREGIONS*7]
+ } TDBatchData;
+
+/***************************************************************/
+/* tensor-product rules on [0,1]^ndim for ndim=0,1,2,3,        */
+/* tabulated once on first use                                 */
+/***************************************************************/
+static TDBatchRule *CreateTDBatchRules()
+{
+  TDBatchRule *Rules=(TDBatchRule *)mallocEC(4*sizeof(TDBatchRule));
+  for(int ndim=0; ndim<4; ndim++)
+   {
+     int N=TDBatchOrder[ndim];
+     double *Full = (ndim==0) ? 0 : GetCCRule(N);
+     double *Emb  = (ndim==0) ? 0 : GetCCRule((N+1)/2);
+     if ( ndim>0 && (Full==0 || Emb==0) )
+      ErrExit("%s:%i: internal error",__FILE__,__LINE__);
+
+     int NumPts=1;
+     for(int nd=0; nd<ndim; nd++)
+      NumPts*=N;
+
+     TDBatchRule *R=Rules+ndim;
+     R->NumPts = NumPts;
+     R->y      = (double *)mallocEC((ndim*NumPts+1)*sizeof(double));
+     R->w      = (double *)mallocEC(NumPts*sizeof(double));
+     R->wEmb   = (double *)mallocEC(NumPts*sizeof(double));
+     for(int np=0; np<NumPts; np++)
+      { double w=1.0, wEmb=1.0;
+        for(int nd=0, Index=np; nd<ndim; nd++, Index/=N)
+         { int i = Index%N;
+           R->y[ndim*np + nd] = 0.5 - 0.5*Full[2*i];
+           w   *= 0.5*Full[2*i+1];
+           wEmb = (i%2) ? 0.0 : wEmb*0.5*Emb[2*(i/2)+1];
+         };
+        R->w[np]=w;
+        R->wEmb[np]=wEmb;
+      };
+   };
+  return Rules;
+}
+
+/***************************************************************/
+/* integrand_v-style integrand for all pairs in a batch: the   */
+/* value for pair p at point np is stored in                   */
+/* fval[np*fdim + 2*NumPKs*p + ...].                           */
+/***************************************************************/
+static int TaylorDuffySum_v(unsigned ndim, size_t npt, const double *x,
+                            void *parms, unsigned fdim, double *fval)
+{
+  TDBatchData *Data   = (TDBatchData *)parms;
+  int NumPairs        = Data->NumPairs;
+  TDWorkspace *TDWs   = Data->TDWs;
+  int WhichCase       = TDWs[0].WhichCase;
+  int TwiceIntegrable = TDWs[0].TwiceIntegrable;
+  int NumPKs          = TDWs[0].NumPKs;
+  int *PIndex         = TDWs[0].PIndex;
+  int *KIndex         = TDWs[0].KIndex;
+  cdouble *KParam     = TDWs[0].KParam;
+
+  typedef cdouble KVector[NUMREGIONS][7];
+  KVector *J = (KVector *)(Data->KBuffer);
+  KVector *L = J + NumPKs;
+  KVector *K = L + NumPKs;
+
+  for(size_t nPt=0; nPt<npt; nPt++)
+   {
+     const double *yVector = x + ndim*nPt;
+     double *f = fval + nPt*fdim;
+
+     int NumRegions, nOffset;
+     double y, Jacobian;
+     GetSubregionData(WhichCase, TwiceIntegrable, yVector,
+                      &NumRegions, &nOffset, &y, &Jacobian);
+     if (Jacobian==0.0)
+      { memset(f, 0, fdim*sizeof(double));
+        continue;
+      };
+
+     double X[NUMREGIONS], A[NUMREGIONS], B[NUMREGIONS], G2[NUMREGIONS];
+     double P[NUMPS][NUMREGIONS][NUMWPOWERS][NUMYPOWERS];
+     for(int p=0; p<NumPairs; p++)
+      {
+        TDWorkspace *TDW = TDWs + p;
+
+        /*--------------------------------------------------------------*/
+        /*- kernel factors: once per group of pairs with equal geometry */
+        /*--------------------------------------------------------------*/
+        if (Data->GroupLeader[p]==p)
+         { if (TwiceIntegrable)
+            GetAlphaBetaGamma2(TDW, yVector, A, B, G2);
+           else
+            GetX(TDW, yVector, X);
+
+           for(int npk=0; npk<NumPKs; npk++)
+            { int np   = PIndex[npk];
+              int nMin = Data->GroupnMin[p*NUMPS + np];
+              int nMax = Data->GroupnMax[p*NUMPS + np];
+              if (TwiceIntegrable)
+               for(int d=0; d<NumRegions; d++)
+                GetScriptJL( KIndex[npk], KParam[npk], A[d], B[d], G2[d],
+                             nMin+nOffset, nMax+nOffset, J[npk][d], L[npk][d]);
+              else
+               for(int d=0; d<NumRegions; d++)
+                GetScriptK( KIndex[npk], KParam[npk], X[d],
+                            nMin+nOffset, nMax+nOffset, K[npk][d]);
+            };
+         };
+
+        /*--------------------------------------------------------------*/
+        /*- polynomial factors and sum for this pair                   -*/
+        /*--------------------------------------------------------------*/
+        for(int np=0; np<NUMPS; np++)
+         if (TDW->NeedP[np])
+          GetScriptP(TDW, np, yVector, P[np]);
+
+        cdouble *Sum = (cdouble *)(f + 2*NumPKs*p);
+        for(int npk=0; npk<NumPKs; npk++)
+         {
+           int np   = PIndex[npk];
+           int nMin = TDW->nMin[np];
+           int nMax = TDW->nMax[np];
+
+           Sum[npk]=0.0;
+           if (TwiceIntegrable)
+            for(int n=nMin; n<=nMax; n++)
+             for(int d=0; d<NumRegions; d++)
+              Sum[npk] += P[np][d][n][0]*J[npk][d][n+nOffset] + P[np][d][n][1]*L[npk][d][n+nOffset];
+           else
+            for(int n=nMin; n<=nMax; n++)
+             for(int d=0; d<NumRegions; d++)
+              Sum[npk] += (P[np][d][n][0] + y*P[np][d][n][1]) * K[npk][d][n+nOffset];
+
+           Sum[npk] *= Jacobian/(4.0*M_PI);
+         };
+      };
+   };
+
+  return 0;
+}
+
+/***************************************************************/
+/* true if the X functions (and hence the kernel factors) of   */
+/* two workspaces coincide                                     */
+/***************************************************************/
+static bool SameTDGeometry(TDWorkspace *T1, TDWorkspace *T2)
+{
+  return    T1->A2==T2->A2     && T1->B2==T2->B2     && T1->AP2==T2->AP2
+         && T1->BP2==T2->BP2   && T1->L2==T2->L2     && T1->AdB==T2->AdB
+         && T1->AdAP==T2->AdAP && T1->AdBP==T2->AdBP && T1->AdL==T2->AdL
+         && T1->BdAP==T2->BdAP && T1->BdBP==T2->BdBP && T1->APdBP==T2->APdBP
+         && T1->BPdL==T2->BPdL;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void TaylorDuffyBatch(TaylorDuffyArgStruct *Args, int NumPairs)
+{
+  if (NumPairs<=0)
+   return;
+
+  /***************************************************************/
+  /* check that all pairs share the case and the {P,K} set       */
+  /***************************************************************/
+  TaylorDuffyArgStruct *A0 = Args + 0;
+  int NumPKs = A0->NumPKs;
+  for(int p=1; p<NumPairs; p++)
+   { TaylorDuffyArgStruct *Ap = Args + p;
+     bool Match = (    Ap->WhichCase==A0->WhichCase
+                    && Ap->NumPKs==NumPKs
+                    && Ap->ForceOnceIntegrable==A0->ForceOnceIntegrable
+                  );
+     for(int npk=0; Match && npk<NumPKs; npk++)
+      Match = (    Ap->PIndex[npk]==A0->PIndex[npk]
+                && Ap->KIndex[npk]==A0->KIndex[npk]
+                && Ap->KParam[npk]==A0->KParam[npk]
+              );
+     if (!Match)
+      ErrExit("TaylorDuffyBatch() called with mismatched kernel sets");
+   };
+
+  /***************************************************************/
+  /* case- and kernel-dependent setup once for the whole batch,  */
+  /* geometric parameters once per pair                          */
+  /***************************************************************/
+  TDWorkspace *TDWs=(TDWorkspace *)mallocEC(NumPairs*sizeof(TDWorkspace));
+  InitTDWorkspace(A0, TDWs + 0);
+  for(int p=0; p<NumPairs; p++)
+   { TDWorkspace *TDW = TDWs + p;
+     if (p>0)
+      { TDW->WhichCase       = TDWs[0].WhichCase;
+        TDW->NumPKs          = TDWs[0].NumPKs;
+        TDW->PIndex          = TDWs[0].PIndex;
+        TDW->KIndex          = TDWs[0].KIndex;
+        TDW->KParam          = TDWs[0].KParam;
+        TDW->TwiceIntegrable = TDWs[0].TwiceIntegrable;
+        memcpy(TDW->NeedP, TDWs[0].NeedP, NUMPS*sizeof(bool));
+        memcpy(TDW->NeedK, TDWs[0].NeedK, NUMKS*sizeof(bool));
+        if ( A0->nHat && Args[p].nHat==0 )
+         ErrExit("TaylorDuffyBatch() called with nHat unspecified for pair %i",p);
+      };
+     ComputeGeometricParameters(Args + p, TDW);
+   };
+
+  /***************************************************************/
+  /* group consecutive pairs with identical geometry; the group  */
+  /* leader evaluates the kernel factors over the union of the   */
+  /* n-ranges of all group members                               */
+  /***************************************************************/
+  TDBatchData MyData, *Data=&MyData;
+  Data->NumPairs    = NumPairs;
+  Data->TDWs        = TDWs;
+  Data->GroupLeader = (int *)mallocEC(NumPairs*sizeof(int));
+  Data->GroupnMin   = (int *)mallocEC(2*NumPairs*NUMPS*sizeof(int));
+  Data->GroupnMax   = Data->GroupnMin + NumPairs*NUMPS;
+  Data->KBuffer     = (cdouble *)mallocEC(3*NumPKs*NUMREGIONS*7*sizeof(cdouble));
+  for(int p=0; p<NumPairs; p++)
+   {
+     int Leader = p;
+     if ( p>0 && SameTDGeometry(TDWs + Data->GroupLeader[p-1], TDWs + p) )
+      Leader = Data->GroupLeader[p-1];
+     Data->GroupLeader[p] = Leader;
+
+     for(int np=0; np<NUMPS; np++)
+      { int nMin = TDWs[p].nMin[np], nMax=TDWs[p].nMax[np];
+        int *GnMin = Data->GroupnMin + Leader*NUMPS + np;
+        int *GnMax = Data->GroupnMax + Leader*NUMPS + np;
+        if (Leader==p)
+         { *GnMin=nMin; *GnMax=nMax; }
+        else
+         { if (nMin < *GnMin) *GnMin=nMin;
+           if (nMax > *GnMax) *GnMax=nMax;
+         };
+      };
+   };
+
+  /***************************************************************/
+  /* integrate all pairs with the fixed rule and its embedded    */
+  /* half-order rule                                             */
+  /***************************************************************/
+  static TDBatchRule *Rules = CreateTDBatchRules();
+  int IntegralDimension = 4 - A0->WhichCase - TDWs[0].TwiceIntegrable;
+  TDBatchRule *R = Rules + IntegralDimension;
+
+  int PairDim = 2*NumPKs;
+  int fDim    = PairDim*NumPairs;
+  double *IFull = (double *)mallocEC( (2+TDBATCH_CHUNK)*fDim*sizeof(double));
+  double *IEmb  = IFull + fDim;
+  double *fval  = IEmb  + fDim;
+  for(int np0=0; np0<R->NumPts; np0+=TDBATCH_CHUNK)
+   {
+     int npt = R->NumPts - np0;
+     if (npt>TDBATCH_CHUNK) npt=TDBATCH_CHUNK;
+     TaylorDuffySum_v(IntegralDimension, npt, R->y + IntegralDimension*np0,
+                      (void *)Data, fDim, fval);
+     for(int n=0; n<npt; n++)
+      { double w=R->w[np0+n], wEmb=R->wEmb[np0+n];
+        double *f=fval + n*fDim;
+        for(int nf=0; nf<fDim; nf++)
+         { IFull[nf] += w*f[nf];
+           IEmb[nf]  += wEmb*f[nf];
+         };
+      };
+   };
+
+  /***************************************************************/
+  /* accept or recompute each pair                               */
+  /***************************************************************/
+  cdouble *FixedResult = (cdouble *)mallocEC(2*NumPKs*sizeof(cdouble));
+  cdouble *FixedError  = FixedResult + NumPKs;
+  for(int p=0; p<NumPairs; p++)
+   {
+     TaylorDuffyArgStruct *Ap = Args + p;
+     double *dResult = (double *)(Ap->Result);
+     double *dError  = (double *)(Ap->Error);
+     bool Converged=true;
+     for(int nf=0; nf<PairDim; nf++)
+      { double Val = IFull[p*PairDim + nf];
+        double Err = fabs(Val - IEmb[p*PairDim + nf]);
+        dResult[nf] = Val;
+        dError[nf]  = Err;
+        if ( Err>Ap->AbsTol && Err>Ap->RelTol*fabs(Val) )
+         Converged=false;
+      };
+
+     Ap->nCalls = R->NumPts;
+     if (Converged) continue;
+
+     /*--------------------------------------------------------------*/
+     /*- redo the pair adaptively; if the adaptive cubature stops at */
+     /*- MaxEval with a larger error estimate than the fixed rule,   */
+     /*- keep the fixed-rule result                                  */
+     /*--------------------------------------------------------------*/
+     memcpy(FixedResult, Ap->Result, NumPKs*sizeof(cdouble));
+     memcpy(FixedError,  Ap->Error,  NumPKs*sizeof(cdouble));
+     TaylorDuffy(Ap);
+     double MaxFixedErr=0.0, MaxAdaptiveErr=0.0;
+     for(int nf=0; nf<PairDim; nf++)
+      { MaxFixedErr    = fmax(MaxFixedErr,    ((double *)FixedError)[nf]);
+        MaxAdaptiveErr = fmax(MaxAdaptiveErr, dError[nf]);
+      };
+     if (MaxAdaptiveErr > MaxFixedErr)
+      { memcpy(Ap->Result, FixedResult, NumPKs*sizeof(cdouble));
+        memcpy(Ap->Error,  FixedError,  NumPKs*sizeof(cdouble));
+      };
+     Ap->nCalls += R->NumPts;
+   };
+
+  free(FixedResult);
+  free(IFull);
+  free(Data->KBuffer);
+  free(Data->GroupnMin);
+  free(Data->GroupLeader);
+  free(TDWs);
+}
+
 /***************************************************************/
 /* convert a one-variable quadratic expression into a new form:*/
 /*  Px^2 + 2Qx + R -> A^2 [ (x+B)^2 + G^2 ]                    */
@@ -98,6 +98,11 @@ typedef struct TaylorDuffyArgStruct
 void TaylorDuffy(TaylorDuffyArgStruct *Args);
 void InitTaylorDuffyArgs(TaylorDuffyArgStruct *Args);
 
+// batched version for NumPairs argument structures sharing
+// WhichCase, NumPKs, PIndex, KIndex, KParam, ForceOnceIntegrable;
+// pairs with identical panel geometry should be consecutive
+void TaylorDuffyBatch(TaylorDuffyArgStruct *Args, int NumPairs);
+
 } // namespace scuff
 
 #endif
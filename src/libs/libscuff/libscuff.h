@@ -331,10 +331,15 @@ class RWGGeometry
    HMatrix *AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *M = NULL);
    HMatrix *AssembleBEMMatrix(cdouble Omega, HMatrix *M = NULL);
 
+   // compressed (H-matrix) BEM matrix for use with ACAMatrix::GMRESSolve
+   ACAMatrix *AssembleCompressedBEMMatrix(cdouble Omega, double ACATol=1.0e-4);
+
    HVector *AllocateRHSVector(bool PureImagFreq = false );
    HVector *AssembleRHSVector(cdouble Omega, double *kBloch,
                               IncField *IF, HVector *RHS = NULL);
    HVector *AssembleRHSVector(cdouble Omega, IncField *IF, HVector *RHS = NULL);
+   HMatrix *AssembleRHSVectors(cdouble Omega, double *kBloch,
+                               IncField **IFs, int NumIFs, HMatrix *RHS = NULL);
 
    /*--------------------------------------------------------------*/
    /*- post-processing routines for computing fields               */
@@ -351,6 +356,12 @@ class RWGGeometry
    void GetFields(IncField *IF, HVector *KN, cdouble Omega,
                   double *X, cdouble *EH);
 
+   // batched version: the columns of KN are the solution vectors for
+   // the incident fields IFs[0..KN->NC-1]; on return, entry (nx, 6*nrhs+Mu)
+   // of FMatrix is the Muth field component at point nx for the nrhsth column
+   HMatrix *GetFields(IncField **IFs, HMatrix *KN, cdouble Omega,
+                      double *kBloch, HMatrix *XMatrix, HMatrix *FMatrix=NULL);
+
    /*--------------------------------------------------------------*/
    /*- post-processing routine for dyadic green's functions -------*/
    /*--------------------------------------------------------------*/
@@ -457,6 +468,7 @@ class RWGGeometry
    void *CreateABMBAccelerator(int nsa, int nsb, bool PureImagFreq=false,
                                bool NeedZDerivative=false);
    void DestroyABMBAccelerator(void *Accelerator);
+   void PrefetchTBlocks(cdouble Omega, double *kBloch=0);
    void ApplyMMJTransformation(HMatrix *M, HVector *RHS);
 
    // helper function for GetFields, GetDyadicGFs, GetSRFluxTrace
@@ -580,6 +592,209 @@ class RWGGeometry
    static bool UseGetFieldsV2P0;
    static bool UseTaylorDuffyV2P0;
    static bool DisableCache;
+   static bool UsePanelPairAssembly;
+   static bool DisableBlockScheduler;
+   static bool DisableCongruentBlocks;
+   static bool DisableBatchedTaylorDuffy;
+
+   // frequency interpolation of BEM matrix blocks (FrequencyInterpolation.cc)
+   static double FreqInterpTol;
+   static int FreqInterpNodes;
+   static double FreqInterpMaxMB;
+   void *FIBlockStore;
+
+   // relative accuracy of the multipole treatment of well-separated
+   // edge pairs (MultipoleInteractions.cc); 0 to disable
+   static double MultipoleTol;
+
+   // storage of EMTPFT pair integrals at the most recent frequency
+   // (EMTPFT.cc); if PrecomputeEMTPFT is set, AssembleBEMMatrix()
+   // fills the store for the exterior PFT with the default method
+   static double EMTPFTIMaxMB;
+   static bool PrecomputeEMTPFT;
+   void *EMTPFTIStore;
+ };
+
+/***************************************************************/
+/* a FieldEvaluationPlan stores everything about the          */
+/* computation of scattered fields at a fixed set of           */
+/* evaluation points that does not depend on frequency or on   */
+/* the surface currents: the region containing each point,    */
+/* the (point, edge) pairs that need high-order or near-field  */
+/* treatment, and bounding boxes for periodic accelerators.    */
+/* The RFMatrix at the most recent (Omega, kBloch) is cached,  */
+/* so Apply() for further KN vectors at the same frequency is  */
+/* a single matrix-matrix product.                             */
+/*                                                             */
+/* A plan is only valid for the geometry configuration in      */
+/* which it was created; create a new plan after calling       */
+/* RWGGeometry::Transform() or UnTransform().                  */
+/***************************************************************/
+class FieldEvaluationPlan
+ {
+public:
+   FieldEvaluationPlan(RWGGeometry *G, HMatrix *XMatrix, int ColumnOffset=0);
+   ~FieldEvaluationPlan();
+
+   // RFMatrix at (Omega, kBloch), owned by the plan and reused
+   // until it is requested at a different frequency or kBloch
+   HMatrix *GetRFMatrix(cdouble Omega, double *kBloch=0,
+                        bool MinuskBloch=true);
+   // free the cached RFMatrix (the rest of the plan is kept)
+   void ReleaseRFMatrix();
+
+   // fill a caller-supplied RFMatrix without caching it
+   HMatrix *FillRFMatrix(cdouble Omega, double *kBloch, bool MinuskBloch,
+                         HMatrix *RFM=0);
+
+   // fields for all columns of KN (NX x 6*NRHS) or for a single
+   // KN vector (NX x 6); either KN or the incident fields may be 0
+   HMatrix *Apply(HMatrix *KN, cdouble Omega, double *kBloch=0,
+                  IncField **IFs=0, HMatrix *FMatrix=0);
+   HMatrix *Apply(HVector *KN, cdouble Omega, double *kBloch=0,
+                  IncField *IF=0, HMatrix *FMatrix=0);
+
+//private:
+   void ClassifyPairs();
+   void AddIncidentFields(IncField *IF, cdouble Omega, double *kBloch,
+                          HMatrix *FMatrix, int ColumnOffset);
+
+   RWGGeometry *G;
+   int NX;
+   HMatrix *XMatrix;    // NX x 3 copy of the evaluation points
+   int *RegionIndices;  // RegionIndices[nx]=-1 inside closed PEC bodies
+
+   // near[nx] = edges (sorted) for which point #nx needs high-order
+   // cubature (NearRules=1) or the near-field routine (NearRules=2);
+   // all other pairs use low-order cubature
+   bool Classified;
+   int *NearOffsets, *NearEdges;
+   char *NearRules;
+   double rRelOuterThreshold, rRelInnerThreshold;
+   int LowOrder, HighOrder;
+
+   // per-region bounding boxes of the evaluation points (PBC only)
+   double *RegionXMin, *RegionXMax;
+   int *RegionNumPoints;
+
+   // RFMatrix cached at the most recent frequency
+   HMatrix *RFMatrix;
+   cdouble RFOmega;
+   double RFkBloch[3];
+   bool RFValid;
+ };
+
+/***************************************************************/
+/* matrix-free representation of the BEM matrix at a single    */
+/* frequency (MultipoleBEMOperator.cc). the edges of each      */
+/* surface are organized into cluster trees; interactions of   */
+/* well-separated clusters are applied through spherical       */
+/* multipole moments and translation matrices, and all other   */
+/* interactions through dense blocks. storage and the cost of  */
+/* Apply() grow roughly like N log N instead of N^2.           */
+/***************************************************************/
+struct MPDenseBlock;
+struct MPClusterSlot;
+struct MPFarPair;
+
+class MultipoleBEMOperator
+ {
+public:
+   // Tol is the relative accuracy of the multipole expansions
+   MultipoleBEMOperator(RWGGeometry *G, cdouble Omega, double Tol=1.0e-6);
+   ~MultipoleBEMOperator();
+
+   // MX = M*X, where M is the BEM matrix at Omega
+   void Apply(HVector *X, HVector *MX);
+
+   // solve M*X = B by GMRES with a block-Jacobi preconditioner;
+   // on entry X contains B, on return the solution. returns the
+   // number of iterations, or -1 if not converged.
+   int GMRESSolve(HVector *X, double RelTol=1.0e-6,
+                  int MaxIters=1000, int Restart=100);
+
+   // bytes of storage occupied by blocks, moments and translations
+   size_t GetStorage();
+
+//private:
+   void ApplyRaw(cdouble *X, cdouble *MX);
+   void Precondition(cdouble *X);
+
+   RWGGeometry *G;
+   cdouble Omega;
+   double Tol;
+   int N;
+
+   int NumDenseBlocks;
+   MPDenseBlock *DenseBlocks;
+
+   int NumSlots;
+   MPClusterSlot *Slots;
+   int NumFarPairs;
+   MPFarPair *FarPairs;
+   int *PairsByA, *PairsByB; // far pairs grouped by slot
+   int *AStart, *BStart;
+
+   // LU-factorized diagonal blocks for block-Jacobi preconditioning
+   int NumPCBlocks;
+   MPDenseBlock *PCBlocks;
+ };
+
+/***************************************************************/
+/* a BEMBlockTracker keeps track of which blocks of the BEM    */
+/* matrix are invalidated by RWGGeometry::Transform() and     */
+/* UnTransform() (BEMBlockTracker.cc). Callers that keep their */
+/* own storage for the (nsa,nsb) blocks recompute only those   */
+/* for which BlockIsStale() is true and then call             */
+/* MarkBlockCurrent(). When only the rows and columns of the   */
+/* last few surfaces changed, LUFactorize() updates the        */
+/* existing factorization through a Schur complement instead  */
+/* of refactorizing the whole matrix; the caller restamps only */
+/* the rows and columns of surfaces FirstSurfaceToRestamp(M)   */
+/* and beyond, and otherwise leaves M alone between calls.     */
+/*                                                             */
+/* Call Reset() whenever the frequency or Bloch vector changes.*/
+/***************************************************************/
+class BEMBlockTracker
+ {
+public:
+   BEMBlockTracker(RWGGeometry *G);
+   ~BEMBlockTracker();
+
+   // forget all blocks and the factorization
+   void Reset();
+
+   // use the surfaces before the first one moved by any of the
+   // transformations as the leading block of the factorization
+   void SetLeadingSurfaces(GTComplex **GTCList, int NumGTCs);
+
+   // a block is stale if the relative pose of the two surfaces
+   // changed since it was computed; with AbsolutePose=true, if
+   // either surface moved at all (needed for derivative blocks,
+   // which refer to fixed lab-frame axes and torque centers)
+   bool BlockIsStale(int nsa, int nsb, bool AbsolutePose=false);
+   void MarkBlockCurrent(int nsa, int nsb);
+
+   // 0 = restamp all of M; NumSurfaces = M is still up to date
+   int FirstSurfaceToRestamp(HMatrix *M);
+   int LUFactorize(HMatrix *M);
+
+//private:
+   int GetFirstDirtySurface();
+
+   RWGGeometry *G;
+   int NS;
+
+   // surface poses at the time block (nsa,nsb) was last computed,
+   // indexed by nsa*NS + nsb
+   GTransformation *PoseA, *PoseB;
+   bool *Current;   // block computed since Reset()
+   bool *Dirty;     // block computed since the last LUFactorize()
+   bool AllDirty;
+
+   HMatrix *FactorizedM;
+   int LeadingSurfaces; // leading block of FactorizedM's factorization
+   int LeadingHint;
  };
 
 /***************************************************************/
@@ -603,6 +818,7 @@ void *CreateFIBBICache(char *MeshFileName);
 void DestroyFIBBICache(void *pCache);
 int GetFIBBICacheSize(void *pCache, int *pHits, int *pMisses);
 void StoreFIBBICache(void *pCache, const char *MeshFileName);
+void LogFIBBICacheStatistics(void *pCache, const char *Label);
 void GetFIBBIData(void *pCache,
                   RWGSurface *SA, int neA, RWGSurface *SB, int neB,
                   double *FIBBIs);
@@ -612,6 +828,11 @@ void GetFIBBIData(void *pCache,
 /*--------------------------------------------------------------*/
 void PreloadCache(const char *FileName);
 void StoreCache(const char *FileName);
+void SetFIPPICacheBudget(double MegaBytes);
+void SetTBlockStoreBudget(double MegaBytes);
+void SetGBAPoolBudget(double MegaBytes);
+void DestroyFIBlockStore(void *Store);
+void DestroyEMTPFTIStore(void *Store);
 void CheckLattice(HMatrix *LBasis);
 
 /***************************************************************/
@@ -28,6 +28,9 @@
 #ifndef LIBSCUFFINTERNALS_H 
 #define LIBSCUFFINTERNALS_H
 
+#include <stdint.h>
+#include <vector>
+
 #include "libscuff.h"
 #include "rwlock.h"
 #include "GBarAccelerator.h"
@@ -111,6 +114,14 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args,
                                cdouble *GradH,
                                cdouble *dHdT);
 
+// PPIs for all nine (iQa,iQb) combinations at once; on return
+// H9[2*(3*iQa+iQb) + 0,1] = H[0,1] for that combination, and
+// similarly GradH9, dHdT9 with stride 6 
+void GetPanelPanelInteractionsAllQ(GetPPIArgStruct *Args,
+                                   cdouble *H9, cdouble *GradH9=0,
+                                   cdouble *dHdT9=0,
+                                   unsigned *PPIAlgorithmCount=0);
+
 /*--------------------------------------------------------------*/
 /*- GetEdgeEdgeInteractions() ----------------------------------*/
 /*--------------------------------------------------------------*/
@@ -254,12 +265,108 @@ typedef struct GetSSIArgStruct
    cdouble MuA, MuB;
    bool SaIsPEC, SbIsPEC;
 
+   // cluster-pair data for the multipole treatment of
+   // well-separated edges (MultipoleInteractions.cc), or 0
+   struct MultipoleBlock *MPBlock;
+
  } GetSSIArgStruct;
 
 void InitGetSSIArgs(GetSSIArgStruct *Args);
 void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args);
+bool InitSSIBlock(GetSSIArgStruct *Args);
+void GetSSIRowRange(GetSSIArgStruct *Args, int neaMin, int neaMax,
+                    unsigned *PPIAlgorithmCount);
+void FinishSSIBlock(GetSSIArgStruct *Args);
+void GetSSIsByPanelPair(GetSSIArgStruct *Args, unsigned *PPIAlgorithmCount);
+
+// frequency interpolation of BEM matrix blocks (FrequencyInterpolation.cc)
+bool InterpolateBEMMatrixBlock(RWGGeometry *G, int nsa, int nsb,
+                               cdouble Omega, HMatrix *M,
+                               int RowOffset, int ColOffset);
+
+// in-memory and on-disk storage of diagonal BEM matrix blocks (TBlockStore.cc)
+#define TBCOP_READ  0
+#define TBCOP_WRITE 1
+bool TBlockCacheOp(int Op, RWGGeometry *G, int ns,
+                   cdouble Omega, double *kBloch,
+                   HMatrix *M, int RowOffset, int ColOffset);
+
+// reuse of off-diagonal blocks coupling congruent surface pairs (CongruentBlocks.cc)
+int *GetCongruentBlockTable(RWGGeometry *G);
+bool CopyCongruentBlock(RWGGeometry *G, int *Table, int nsa, int nsb,
+                        HMatrix *M, int RowOffset, int ColOffset);
+
+// storage of EMTPFT pair integrals at one frequency (EMTPFT.cc)
+void PrecomputeEMTPFTIntegrals(RWGGeometry *G, cdouble Omega,
+                               bool Interior, int EMTPFTIMethod);
+
 void AddSurfaceZetaContributionToBEMMatrix(GetSSIArgStruct *Args);
 
+/*--------------------------------------------------------------*/
+/*- spherical-multipole treatment of well-separated edges       */
+/*- (MultipoleInteractions.cc)                                  */
+/*--------------------------------------------------------------*/
+// highest multipole order; limited by GetYlmDerivArray, which
+// the translation matrices call with 2*MP_MAXL
+#define MP_MAXL 15
+
+// largest number of edges in a leaf of the cluster tree
+#define MP_LEAFSIZE 16
+
+// binary tree of spatially compact clusters of the edges of a
+// surface: the edges of cluster nc are Edges[Start[nc]] ...
+// Edges[Start[nc]+Length[nc]-1], its children are Children[2*nc+0,1]
+// (-1 for leaves), and the supports of its basis functions all lie
+// inside the sphere of radius Radii[nc] about Centers + 3*nc.
+// cluster 0 is the root.
+typedef struct EdgeClusterTree
+ { int NumClusters;
+   int *Edges, *Start, *Length, *Children;
+   int *LeafOf;          // LeafOf[ne] = leaf cluster containing edge ne
+   double *Centers, *Radii;
+   double MaxPanelRadius;
+ } EdgeClusterTree;
+
+EdgeClusterTree *CreateEdgeClusterTree(RWGSurface *S, int MaxLeafSize);
+void DestroyEdgeClusterTree(EdgeClusterTree *ECT);
+
+int GetMultipoleOrder(cdouble k, double RSum, double Distance, double Tol);
+
+// moments of the RWG functions in a cluster (see the file header)
+void GetEdgeClusterMoments(RWGSurface *S, int *Edges, int NE,
+                           double *Center, cdouble k, int L,
+                           HMatrix *RowMoments, HMatrix *ColMoments);
+
+// GC0/(ik) and GC1 for all edge pairs in two clusters
+void GetClusterPairInteractions(HMatrix *RowMomentsA,
+                                HMatrix *ColMomentsB,
+                                double *CenterA, double *CenterB,
+                                cdouble k, int L, HMatrix *E);
+
+// partition of the interactions between two cluster trees
+typedef struct ClusterPartition
+ { std::vector<int> FarA, FarB;   // well-separated cluster pairs
+   std::vector<int> Orders;       // orders in up to 2 regions per far pair
+   std::vector<int> NearA, NearB; // remaining pairs of leaves
+ } ClusterPartition;
+
+void PartitionClusterPairs(EdgeClusterTree *CTa, EdgeClusterTree *CTb,
+                           double *Displacement, bool Symmetric,
+                           cdouble k[2], bool Active[2], double Tol,
+                           ClusterPartition *CP);
+
+// BEM matrix entries for a single edge pair (CompressedBEMMatrix.cc)
+void GetEdgePairBEMEntries(RWGGeometry *G, cdouble Omega,
+                           int nsa, int nea, int nsb, int neb,
+                           cdouble MEE[2][2]);
+
+bool InitMultipoleBlock(GetSSIArgStruct *Args);
+bool IsMultipolePair(struct MultipoleBlock *MPB, int nea, int neb);
+void AddMultipoleInteractions(GetSSIArgStruct *Args);
+void DestroyMultipoleBlock(GetSSIArgStruct *Args);
+
+bool GetEEIMultipole(GetEEIArgStruct *Args);
+
 /***************************************************************/
 /* 2. definition of data structures and methods for working    */
 /*    with frequency-independent panel-panel integrals (FIPPIs)*/
@@ -307,12 +414,258 @@ void ComputeQIFIPPIData(double **Va, double **Vb, int ncv, QIFIPPIData *QIFD);
 void GetQDFIPPIData(double **Va, double *Qa, double **Vb, double *Qb, 
                     int ncv, void *opFC, QDFIPPIData *QDFD);
 
+/*--------------------------------------------------------------*/
+/* 'CacheStatistics' keeps per-thread counts of cache hits and  */
+/* misses. each thread increments counters in its own slot      */
+/* (padded to a cache line) so that threads do not contend for  */
+/* a shared counter.                                            */
+/*--------------------------------------------------------------*/
+#define MAXCACHETHREADS 256
+class CacheStatistics
+ {
+  public:
+    CacheStatistics();
+
+    void Hit();
+    void Miss();
+    void Reset();
+
+    // totals over all threads 
+    void Get(int *pHits, int *pMisses);
+
+    // counts for the thread with index nt (0 <= nt < MAXCACHETHREADS)
+    void GetThread(int nt, int *pHits, int *pMisses);
+
+    // write totals and nonzero per-thread counts to the log file
+    void LogStatistics(const char *Label);
+
+  private:
+    typedef struct
+     { unsigned long Hits, Misses;
+       char Padding[64 - 2*sizeof(unsigned long)];
+     } CounterSlot;
+    CounterSlot Slots[MAXCACHETHREADS];
+ };
+
+int GetCacheThreadIndex();
+
+/*--------------------------------------------------------------*/
+/* indexed cache files (CacheFile.cc). a MappedCacheFile maps a */
+/* file read-only and answers lookups directly from the mapping;*/
+/* a CacheFileWriter writes such a file record by record.       */
+/*--------------------------------------------------------------*/
+class MappedCacheFile
+ {
+  public:
+    MappedCacheFile(const char *FileName, const char *Kind,
+                    size_t KeySize, size_t DataSize);
+    ~MappedCacheFile();
+
+    // pointer to the data block for Key, or 0 if not present
+    const void *Lookup(const void *Key);
+
+    // pointers to the key and data block of record #nr
+    const void *GetKey(uint64_t nr);
+    const void *GetData(uint64_t nr);
+
+    char *FileName;
+    char *ErrMsg;          // nonzero if the file could not be mapped
+    uint64_t NumRecords;
+
+    // true if the file was written on a machine of opposite
+    // endianness; in this case Lookup() always fails, and callers
+    // must instead read (and byte-swap) all records via GetKey()
+    // and GetData()
+    bool ByteSwapped;
+
+  private:
+    char *Map;
+    size_t MapSize;
+    const char *Records;
+    const uint64_t *Index;
+    uint64_t NumSlots;
+    size_t KeySize, DataSize, RecordSize;
+ };
+
+class CacheFileWriter
+ {
+  public:
+    CacheFileWriter(const char *FileName, const char *Kind,
+                    size_t KeySize, size_t DataSize);
+    ~CacheFileWriter();
+
+    bool AddRecord(const void *Key, const void *Data);
+    bool Close();
+
+    char *ErrMsg;
+    uint64_t NumRecords;
+
+  private:
+    FILE *f;
+    char *FileName, *TempFileName;
+    char Kind[8];
+    size_t KeySize, DataSize;
+    uint64_t Checksum;
+    std::vector<uint64_t> Hashes;
+ };
+
+bool IsIndexedCacheFile(const char *FileName);
+void SwapCacheItems(void *Buffer, size_t ItemSize, size_t NumItems);
+uint64_t CacheKeyHash(const void *Key, size_t KeySize);
+
+/*--------------------------------------------------------------*/
+/* append-only, indexed store of checkpointed results, keyed by */
+/* a tag (e.g. a transformation tag) and NumKeys doubles (e.g.  */
+/* frequency and bloch vector), shared by application codes to  */
+/* resume interrupted runs (ResultStore.cc). several processes  */
+/* may read and append to the same file concurrently, and the   */
+/* methods may be called from concurrent threads.               */
+/*--------------------------------------------------------------*/
+#define RESULTSTORE_TAGSIZE 32
+class ResultStore
+ {
+  public:
+    // if KeyDigits>0, keys are rounded to that many digits after
+    // the decimal point (in %e format) before storage and lookup
+    ResultStore(const char *FileName, const char *Kind,
+                int NumKeys, int NumValues, int KeyDigits=0);
+    ~ResultStore();
+
+    bool Lookup(const char *Tag, const double *Keys, double *Values);
+    bool Add(const char *Tag, const double *Keys, const double *Values);
+    void Flush();
+
+    char *FileName;
+    char *ErrMsg;          // nonzero if the file could not be opened
+    uint64_t NumRecords;
+    bool Durable;          // fsync() after each Add() (default true)
+
+  private:
+    void PackKey(const char *Tag, const double *Keys, char *Record);
+    void IndexRecord(uint64_t nr);
+    int64_t FindRecord(const char *Key);
+    // HaveLock=true if the caller already holds a flock()
+    bool Refresh(bool HaveLock=false);
+
+    int fd;
+    int NumKeys, NumValues, KeyDigits;
+    size_t KeySize, RecordSize;
+    size_t FileSize;       // bytes of the file read so far, up to
+                           // the end of the last good record
+    std::vector<char> Records;
+    std::vector<uint64_t> Index;
+    uint64_t NumSlots;
+    char *Scratch;
+    rwlock Lock;           // serializes threads of this process
+ };
+
+/*--------------------------------------------------------------*/
+/* FrequencyScheduler processes a list of independent frequency */
+/* points on NumGroups concurrent groups of threads, each of    */
+/* which gets an equal share of the available threads and works */
+/* in its own application workspace (FrequencyScheduler.cc).    */
+/* output routed through OpenOutput() is written to disk in     */
+/* point order, so output files are the same as for a serial    */
+/* run regardless of which group finishes first.                */
+/*                                                              */
+/* after SetWorkDir(), the points are shared with any other     */
+/* processes (possibly on other machines) using the same work   */
+/* directory on a shared filesystem; the coordinator process    */
+/* merges the output of all processes into the output files.    */
+/*--------------------------------------------------------------*/
+typedef void (*FSTask)(void *UserData, int nGroup, int nPoint);
+
+// seconds after which a lease that is not renewed is considered stale
+#define FS_DEFAULT_LEASE_TIMEOUT 300.0
+
+typedef struct FSOutput
+ { char *FileName;
+   char *PartName;   // name of per-point file in WorkDir, if any
+   FILE *f;
+ } FSOutput;
+
+class FrequencyScheduler
+ {
+  public:
+    FrequencyScheduler(int NumPoints, int NumGroups);
+    ~FrequencyScheduler();
+
+    // share points with other processes through WorkDir. a lease
+    // held by a dead process on this host, or (if LeaseTimeout>0)
+    // not renewed for LeaseTimeout seconds, is reassigned; leases
+    // are renewed every LeaseTimeout/3 seconds while held
+    void SetWorkDir(const char *WorkDir, bool Coordinator,
+                    double LeaseTimeout=FS_DEFAULT_LEASE_TIMEOUT);
+
+    // call Task(UserData, nGroup, nPoint) once for each point
+    // 0<=nPoint<NumPoints; concurrent calls have distinct nGroup
+    void Run(FSTask Task, void *UserData);
+
+    // alternative to Run() for callers with their own loop:
+    // ClaimPoint() returns the next point to process, or -1 if
+    // there is none left, and each claimed point must be passed
+    // to FinishPoint() once its output has been written
+    int ClaimPoint();
+    void FinishPoint(int nPoint);
+
+    // returns a stream whose contents are appended to FileName
+    // once all points up to and including nPoint are finished.
+    // the stream belongs to the scheduler; do not fclose() it.
+    FILE *OpenOutput(int nPoint, const char *FileName);
+
+    int NumPoints, NumGroups, ThreadsPerGroup;
+    char *WorkDir;
+    bool Coordinator;
+    double LeaseTimeout;
+    int MaxAttempts;       // give up on a point after this many leases
+
+    // internal use (FSThread, FSRenewalThread)
+    void RunGroup(int nGroup);
+    void RenewLeases();
+
+  private:
+    void CommitPoint(int nPoint);
+    bool TryLease(int nPoint);
+    void RenewLease(int nPoint);
+    void PublishPoint(int nPoint);
+    void CommitPublishedPoints();
+
+    FSTask Task;
+    void *UserData;
+    int NextPoint, NextCommit;
+    bool *Finished;        // finished, or (with WorkDir) no longer open
+    bool *Held;            // (with WorkDir) leased by this process
+    std::vector<FSOutput> *Outputs;
+    rwlock Lock;
+
+#if defined(USE_OPENMP) || defined(USE_PTHREAD)
+    // background thread renewing the leases in Held[]
+    pthread_t RenewalThread;
+    pthread_mutex_t RenewalMutex;
+    pthread_cond_t RenewalCond;
+    bool RenewalRunning, StopRenewal;
+#endif
+ };
+
 /*--------------------------------------------------------------*/
 /* 'FIPPICache' is a class that implements efficient storage    */
 /* and retrieval of QIFIPPIData structures for many panel pairs.*/
 /* i am encapsulating this as its own separate class to allow   */
 /* easy experimentation with various implementations.           */
+/*                                                              */
+/* the table is split into NUMFIPPISHARDS independent shards,   */
+/* selected by the hash of the search key, each protected by    */
+/* its own rwlock, so that concurrent misses on different       */
+/* panel pairs rarely wait on one another.                      */
+/*                                                              */
+/* the cache may be given a memory budget via SetMaxBytes() or  */
+/* the environment variable SCUFF_FIPPI_CACHE_MB, beyond which  */
+/* records are evicted in CLOCK (approximate LRU) order.        */
+/*                                                              */
+/* records preloaded from an indexed cache file are not copied  */
+/* into the tables, but looked up directly in the mapped file.  */
 /*--------------------------------------------------------------*/
+#define NUMFIPPISHARDS 64
 class FIPPICache
  { 
   public:
@@ -325,24 +678,49 @@ class FIPPICache
     void Store(const char *FileName);
     void PreLoad(const char *FileName);
     
-    // look up an entry 
-    QIFIPPIData *GetQIFIPPIData(double **OVa, double **OVb, int ncv);
+    // look up an entry; the record is copied into QIFD
+    void GetQIFIPPIData(double **OVa, double **OVb, int ncv,
+                        QIFIPPIData *QIFD);
+
+    // memory budget in bytes for cached records (0 = no limit);
+    // once the budget is reached, old records are evicted
+    void SetMaxBytes(size_t MaxBytes);
+    size_t GetMaxBytes() { return MaxBytes; }
+
+    // number of in-memory records (not counting records in a
+    // mapped cache file), estimated memory footprint, number of
+    // records evicted so far
+    unsigned long Size();
+    size_t ResidentBytes();
+    unsigned long Evictions();
+
+    // write hit/miss/eviction statistics to the log file
+    void LogStatistics();
 
-    int Hits, Misses;
+    CacheStatistics Stats;
 
   private:
 
     // any implementation of this class will have some kind of 
     // storage table, but to allow maximal flexibility in implementation
-    // i am just going to store an opaque pointer to this table
+    // i am just going to store opaque pointers to the tables
     // in the class body, with all the details left up to the 
     // implementation 
-    void *opTable;
+    void *opShards[NUMFIPPISHARDS];
 
-    rwlock FCLock;
+    rwlock ShardLocks[NUMFIPPISHARDS];
+
+    size_t MaxBytes;
+    int MaxRecordsPerShard;
+
+    void PreLoadIndexed(const char *FileName);
+
+    // indexed cache file mapped by PreLoad(), which is searched
+    // before the in-memory tables
+    MappedCacheFile *MappedFile;
 
     char *PreloadFileName;
-    unsigned int RecordsPreloaded;
+    unsigned long RecordsPreloaded, EvictionsAtPreload;
 
  };
 
@@ -380,6 +758,9 @@ int AssessBFPair(RWGSurface *Sa, int nea, RWGSurface *Sb, int neb, double *rRel=
 
 int NumCommonVertices(RWGSurface *Sa, int npa, RWGSurface *Sb, int npb);
 
+// edge-centroid fingerprint of a surface's current pose (RWGSurface.cc)
+void GetEdgeCentroidSignature(RWGSurface *S, double Signature[9]);
+
 
 int CanonicallyOrderVertices(double **Va, double **Vb, int ncv,
                              double **OVa, double **OVb);
@@ -0,0 +1,98 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * UnitTestUtils.cc -- helpers shared by the SCUFF-EM unit tests that
+ *                  -- compare BEM matrices assembled with and without
+ *                  -- some acceleration
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "UnitTestUtils.h"
+
+using namespace scuff;
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+RWGGeometry *InitBlockTest(const char *TestName, const char *GeoFile,
+                           HMatrix **M, HMatrix **MRef)
+{
+  SetLogFileName("scuff-unit-tests.log");
+  Log("SCUFF-EM %s unit test running on %s",TestName,GetHostName());
+
+  RWGGeometry *G = new RWGGeometry(GeoFile);
+  *M    = G->AllocateBEMMatrix();
+  *MRef = G->AllocateBEMMatrix();
+  return G;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+double BlockError(RWGGeometry *G, int nsa, int nsb, HMatrix *M, HMatrix *MRef)
+{
+  int RowOffset=G->BFIndexOffset[nsa], NR=G->Surfaces[nsa]->NumBFs;
+  int ColOffset=G->BFIndexOffset[nsb], NC=G->Surfaces[nsb]->NumBFs;
+  double Diff2=0.0, Norm2=0.0;
+  for(int nr=RowOffset; nr<RowOffset+NR; nr++)
+   for(int nc=ColOffset; nc<ColOffset+NC; nc++)
+    { cdouble mRef=MRef->GetEntry(nr,nc);
+      Diff2 += norm(M->GetEntry(nr,nc) - mRef);
+      Norm2 += norm(mRef);
+    };
+  return Norm2==0.0 ? sqrt(Diff2) : sqrt(Diff2/Norm2);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void GetBlockErrorRange(RWGGeometry *G, HMatrix *M, HMatrix *MRef,
+                        double *MinError, double *MaxError)
+{
+  *MinError=HUGE_VAL;
+  *MaxError=0.0;
+  for(int nsa=0; nsa<G->NumSurfaces; nsa++)
+   for(int nsb=0; nsb<G->NumSurfaces; nsb++)
+    { double Error=BlockError(G, nsa, nsb, M, MRef);
+      *MinError=fmin(*MinError, Error);
+      *MaxError=fmax(*MaxError, Error);
+    };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void FinishBlockTest(RWGGeometry *G, HMatrix *M, HMatrix *MRef, bool Success)
+{
+  delete M;
+  delete MRef;
+  delete G;
+
+  if (Success)
+   { printf("All tests successfully passed.\n");
+     exit(0);
+   };
+  printf("Some tests FAILED.\n");
+  exit(1);
+}
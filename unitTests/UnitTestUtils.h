@@ -0,0 +1,57 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * UnitTestUtils.h -- helpers shared by the SCUFF-EM unit tests that
+ *                 -- compare BEM matrices assembled with and without
+ *                 -- some acceleration
+ */
+
+#ifndef UNITTESTUTILS_H
+#define UNITTESTUTILS_H
+
+#include "libscuff.h"
+
+/***************************************************************/
+/* open the unit-test log file, read the geometry, and allocate*/
+/* two BEM matrices for it                                     */
+/***************************************************************/
+scuff::RWGGeometry *InitBlockTest(const char *TestName, const char *GeoFile,
+                                  HMatrix **M, HMatrix **MRef);
+
+/***************************************************************/
+/* relative Frobenius-norm difference of the (nsa,nsb) blocks  */
+/***************************************************************/
+double BlockError(scuff::RWGGeometry *G, int nsa, int nsb,
+                  HMatrix *M, HMatrix *MRef);
+
+/***************************************************************/
+/* smallest and largest BlockError() over all blocks           */
+/***************************************************************/
+void GetBlockErrorRange(scuff::RWGGeometry *G, HMatrix *M, HMatrix *MRef,
+                        double *MinError, double *MaxError);
+
+/***************************************************************/
+/* free what InitBlockTest() allocated, print the summary line,*/
+/* and exit with the status expected by 'make check'           */
+/***************************************************************/
+void FinishBlockTest(scuff::RWGGeometry *G, HMatrix *M, HMatrix *MRef,
+                     bool Success);
+
+#endif //UNITTESTUTILS_H
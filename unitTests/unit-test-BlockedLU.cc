@@ -0,0 +1,199 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-BlockedLU.cc -- SCUFF-EM unit test comparing the blocked
+ *                        -- LU factorization used by scuff-cas3D
+ *                        -- with a dense LU factorization
+ *
+ * for a hermitian matrix M split into a leading NAxNA block and a
+ * trailing NBxNB block, we check that
+ *
+ *  (a) the log-determinant from the diagonal of the factors,
+ *  (b) the lower-left block of M^{-1}, and
+ *  (c) the force-type trace Re Tr { M^{-1} D }, where D has only
+ *      a lower-left block (computed from (b) as in scuff-cas3D)
+ *
+ * agree with the dense results, both after the first blocked
+ * factorization and after the trailing rows and columns have been
+ * changed and the factorization updated with the leading block
+ * reused.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+#define II cdouble(0.0,1.0)
+
+#define NA 150
+#define NB 60
+#define NR (NA+NB)
+
+// the blocked and dense factorizations do the same arithmetic in a
+// different order, so the results should agree to near machine precision
+#define BLOCKTOL 1.0e-9
+
+/***************************************************************/
+/* fill rows and columns RC0...NR-1 of M with random entries,  */
+/* keeping M hermitian. M is not diagonally dominant, so the   */
+/* factorizations must pivot.                                  */
+/***************************************************************/
+void RandomizeTrailing(HMatrix *M, int RC0)
+{
+  cdouble Im = (M->RealComplex==LHM_COMPLEX) ? II : 0.0;
+  for(int nc=RC0; nc<NR; nc++)
+   for(int nr=0; nr<=nc; nr++)
+    { cdouble Entry = (drand48()-0.5) + Im*(drand48()-0.5);
+      if (nr==nc) Entry = real(Entry);
+      M->SetEntry(nr, nc, Entry);
+      M->SetEntry(nc, nr, conj(Entry));
+    };
+}
+
+/***************************************************************/
+/* compare blocked and dense results for the current M; returns*/
+/* the number of failed checks                                 */
+/***************************************************************/
+int Compare(HMatrix *M, HMatrix *MBlocked, HMatrix *D, const char *Stage)
+{
+  int RC = M->RealComplex;
+
+  /*--------------------------------------------------------------*/
+  /*- dense reference: log-det, full inverse, and the trace from  */
+  /*- an LUSolve with the columns of D^\dagger stamped into a     */
+  /*- NRxNA matrix, as in GetTraceMInvdM()                        */
+  /*--------------------------------------------------------------*/
+  HMatrix *MLU = new HMatrix(M);
+  MLU->LUFactorize();
+  double LNDetRef=0.0;
+  for(int n=0; n<NR; n++)
+   LNDetRef+=log(abs(MLU->GetEntry(n,n)));
+
+  HMatrix *MInv = new HMatrix(M);
+  MInv->LUFactorize();
+  MInv->LUInvert();
+
+  HMatrix *dM = new HMatrix(NR, NA, RC);
+  dM->Zero();
+  dM->InsertBlockAdjoint(D, NA, 0);
+  MLU->LUSolve(dM);
+  double TraceRef=0.0;
+  for(int n=0; n<NA; n++)
+   TraceRef+=dM->GetEntryD(n,n);
+
+  /*--------------------------------------------------------------*/
+  /*- blocked results                                             */
+  /*--------------------------------------------------------------*/
+  double LNDet=0.0;
+  for(int n=0; n<NR; n++)
+   LNDet+=log(abs(MBlocked->GetEntry(n,n)));
+
+  HMatrix *MInv21 = new HMatrix(NB, NA, RC);
+  MBlocked->LUInverseLowerLeftBlock(MInv21);
+
+  double MaxErr=0.0, MaxEntry=0.0;
+  for(int nr=0; nr<NB; nr++)
+   for(int nc=0; nc<NA; nc++)
+    { MaxErr=fmax(MaxErr, abs(MInv21->GetEntry(nr,nc) - MInv->GetEntry(NA+nr,nc)));
+      MaxEntry=fmax(MaxEntry, abs(MInv->GetEntry(NA+nr,nc)));
+    };
+
+  double Trace=0.0;
+  for(int nr=0; nr<NA; nr++)
+   for(int nc=0; nc<NB; nc++)
+    Trace+=real( MInv21->GetEntry(nc,nr) * D->GetEntry(nr,nc) );
+
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  const char *Type = (RC==LHM_REAL) ? "real" : "complex";
+  int Failed=0;
+
+  bool OK = fabs(LNDet-LNDetRef) < BLOCKTOL*fabs(LNDetRef);
+  printf("%-7s %-8s log det:       %s\n",Type,Stage,OK ? "PASSED" : "FAILED");
+  if (!OK) Failed++;
+  Log("%s %s log det: %.12e vs %.12e",Type,Stage,LNDet,LNDetRef);
+
+  OK = MaxErr < BLOCKTOL*MaxEntry;
+  printf("%-7s %-8s (M^{-1})_{21}: %s\n",Type,Stage,OK ? "PASSED" : "FAILED");
+  if (!OK) Failed++;
+  Log("%s %s (M^{-1})_{21}: max err %.2e, max entry %.2e",Type,Stage,MaxErr,MaxEntry);
+
+  OK = fabs(Trace-TraceRef) < BLOCKTOL*fabs(TraceRef);
+  printf("%-7s %-8s trace:         %s\n",Type,Stage,OK ? "PASSED" : "FAILED");
+  if (!OK) Failed++;
+  Log("%s %s trace: %.12e vs %.12e",Type,Stage,Trace,TraceRef);
+
+  delete MLU;
+  delete MInv;
+  delete dM;
+  delete MInv21;
+  return Failed;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main()
+{
+  SetLogFileName("scuff-unit-tests.log");
+  Log("SCUFF-EM blocked LU unit tests running on %s",GetHostName());
+
+  srand48(0);
+  int Failed=0;
+  for(int RC=LHM_REAL; RC<=LHM_COMPLEX; RC++)
+   { 
+     HMatrix *M = new HMatrix(NR, NR, RC);
+     RandomizeTrailing(M, 0);
+
+     HMatrix *D = new HMatrix(NA, NB, RC);
+     cdouble Im = (RC==LHM_COMPLEX) ? II : 0.0;
+     for(int nr=0; nr<NA; nr++)
+      for(int nc=0; nc<NB; nc++)
+       D->SetEntry(nr, nc, (drand48()-0.5) + Im*(drand48()-0.5));
+
+     HMatrix *MBlocked = new HMatrix(M);
+     MBlocked->LUFactorizeBlocked(NA);
+     Failed+=Compare(M, MBlocked, D, "initial");
+
+     // change the trailing rows and columns (as when the trailing
+     // surfaces move) and update the factorization
+     RandomizeTrailing(M, NA);
+     for(int nr=0; nr<NR; nr++)
+      for(int nc=(nr<NA ? NA : 0); nc<NR; nc++)
+       MBlocked->SetEntry(nr, nc, M->GetEntry(nr,nc));
+     MBlocked->LUFactorizeBlocked(NA, true);
+     Failed+=Compare(M, MBlocked, D, "updated");
+
+     delete M;
+     delete D;
+     delete MBlocked;
+   };
+
+  if (Failed==0)
+   { printf("All tests successfully passed.\n");
+     exit(0);
+   };
+  printf("%i tests FAILED.\n",Failed);
+  exit(1);
+}
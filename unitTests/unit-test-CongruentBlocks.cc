@@ -0,0 +1,126 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-CongruentBlocks.cc -- SCUFF-EM unit test comparing BEM
+ *                              -- matrices assembled with and without
+ *                              -- reuse of blocks coupling congruent
+ *                              -- surface pairs
+ *
+ * the geometry is a chain of three identical spheres at z=0, 3, -3,
+ * so the (0,2) block is the transpose of the (0,1) block and the
+ * (1,2) block must be computed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+#include "UnitTestUtils.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+// copied blocks must agree with computed blocks to quadrature
+// accuracy (transposed copies differ from direct assembly by the
+// slight asymmetry of the panel-panel cubature)
+#define REUSETOL 1.0e-8
+
+/***************************************************************/
+/* largest difference between the (nsa,nsb) block of M and the */
+/* transpose of its (nsc,nsd) block                            */
+/***************************************************************/
+double TransposeMismatch(RWGGeometry *G, HMatrix *M,
+                         int nsa, int nsb, int nsc, int nsd)
+{
+  int RowOffset=G->BFIndexOffset[nsa], ColOffset=G->BFIndexOffset[nsb];
+  int SourceRowOffset=G->BFIndexOffset[nsc], SourceColOffset=G->BFIndexOffset[nsd];
+  double Mismatch=0.0;
+  for(int nr=0; nr<G->Surfaces[nsa]->NumBFs; nr++)
+   for(int nc=0; nc<G->Surfaces[nsb]->NumBFs; nc++)
+    Mismatch=fmax(Mismatch, abs(  M->GetEntry(RowOffset+nr, ColOffset+nc)
+                                - M->GetEntry(SourceRowOffset+nc, SourceColOffset+nr)));
+  return Mismatch;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main()
+{
+  HMatrix *M, *MRef;
+  RWGGeometry *G=InitBlockTest("congruent-block","PECSphereChain_255.scuffgeo",&M,&MRef);
+  int NS=G->NumSurfaces;
+
+  /*--------------------------------------------------------------*/
+  /*- the table must record exactly one reused block: the        -*/
+  /*- transposed copy of (0,1) into (0,2)                         -*/
+  /*--------------------------------------------------------------*/
+  bool Success=true;
+  int *Table=GetCongruentBlockTable(G);
+  int NumReused=0;
+  for(int nsa=0; Table && nsa<NS; nsa++)
+   for(int nsb=nsa+1; nsb<NS; nsb++)
+    if (Table[nsa*NS+nsb]!=-1)
+     NumReused++;
+  bool TableOK =    Table!=0
+                 && NumReused==1
+                 && Table[0*NS+2]==2*(0*NS+1)+1;
+  printf("congruent-block table: %s (%i reused block%s)\n",
+          TableOK ? "PASSED" : "FAILED", NumReused, NumReused==1 ? "" : "s");
+  if (!TableOK) Success=false;
+  if (Table) free(Table);
+
+  #define NUMFREQS 2
+  cdouble Omega[NUMFREQS] = { 1.0, 0.5*II };
+  for(int nf=0; nf<NUMFREQS; nf++)
+   {
+     RWGGeometry::DisableCongruentBlocks=true;
+     G->AssembleBEMMatrix(Omega[nf], MRef);
+     RWGGeometry::DisableCongruentBlocks=false;
+     G->AssembleBEMMatrix(Omega[nf], M);
+
+     /*--------------------------------------------------------------*/
+     /*- the reused block must be an exact copy of its source, while -*/
+     /*- direct assembly differs from the copy by the quadrature     -*/
+     /*- asymmetry; this checks that the block was really reused     -*/
+     /*--------------------------------------------------------------*/
+     double Mismatch    = TransposeMismatch(G, M,    0, 2, 0, 1);
+     double RefMismatch = TransposeMismatch(G, MRef, 0, 2, 0, 1);
+     bool ThisSuccess = (Mismatch==0.0 && RefMismatch>0.0);
+     printf("Omega=%s, block (0,2) reused: %s\n",
+             z2s(Omega[nf]), ThisSuccess ? "PASSED" : "FAILED");
+     if (!ThisSuccess) Success=false;
+
+     for(int nsa=0; nsa<NS; nsa++)
+      for(int nsb=0; nsb<NS; nsb++)
+       { double Error=BlockError(G, nsa, nsb, M, MRef);
+         ThisSuccess = Error < REUSETOL;
+         printf("Omega=%s, block (%i,%i): %s (rel err %.1e)\n",
+                 z2s(Omega[nf]), nsa, nsb, ThisSuccess ? "PASSED" : "FAILED", Error);
+         if (!ThisSuccess) Success=false;
+       };
+   };
+
+  FinishBlockTest(G, M, MRef, Success);
+}
@@ -0,0 +1,90 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-FrequencyInterpolation.cc -- SCUFF-EM unit test comparing
+ *                                     -- BEM matrices interpolated in
+ *                                     -- frequency with direct assembly
+ *
+ * the geometry consists of two dielectric spheres, so the diagonal
+ * blocks couple through two regions and the off-diagonal blocks
+ * through one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+#include "UnitTestUtils.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+// each interpolation panel is validated against exact blocks to this
+// relative accuracy, so interpolated blocks must meet it as well
+#define FREQINTERPTOL 1.0e-3
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main()
+{
+  HMatrix *M, *MRef;
+  RWGGeometry *G=InitBlockTest("frequency-interpolation","SiSpheres_255.scuffgeo",&M,&MRef);
+
+  /***************************************************************/
+  /* all frequencies lie on the same interpolation panel; the    */
+  /* first two off-anchor frequencies are used to validate the   */
+  /* panels, and the BEM matrix is interpolated at the others    */
+  /***************************************************************/
+  #define NUMFREQS 4
+  cdouble Omega[NUMFREQS] = { 0.60, 0.65, 0.70, 0.85 };
+
+  bool Success=true;
+  for(int nf=0; nf<NUMFREQS; nf++)
+   {
+     RWGGeometry::FreqInterpTol=FREQINTERPTOL;
+     G->AssembleBEMMatrix(Omega[nf], M);
+     RWGGeometry::FreqInterpTol=0.0;
+     G->AssembleBEMMatrix(Omega[nf], MRef);
+
+     double MinError, MaxError;
+     GetBlockErrorRange(G, M, MRef, &MinError, &MaxError);
+
+     // at the validation frequencies every block is assembled
+     // exactly; beyond them, every block must actually have been
+     // interpolated (and so differ from the exact block) to within
+     // the tolerance
+     bool ThisSuccess;
+     if (nf<2)
+      ThisSuccess = (MaxError==0.0);
+     else
+      ThisSuccess = (MinError>0.0 && MaxError<FREQINTERPTOL);
+     printf("Omega=%s (%s): %s (block rel err %.1e--%.1e)\n",
+             z2s(Omega[nf]), nf<2 ? "validation" : "interpolated",
+             ThisSuccess ? "PASSED" : "FAILED", MinError, MaxError);
+     if (!ThisSuccess) Success=false;
+   };
+
+  FinishBlockTest(G, M, MRef, Success);
+}
@@ -0,0 +1,196 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-FrequencyScheduler.cc -- SCUFF-EM unit test sharing a list
+ *                                 -- of points among a coordinator and
+ *                                 -- two worker processes on one machine
+ *                                 -- through a common work directory
+ *
+ * the test checks that
+ *  -- points taking longer than the lease timeout are not reassigned
+ *     while their holder is alive (lease renewal);
+ *  -- a point whose holder (a worker) dies midway is reassigned once
+ *     its lease has expired;
+ *  -- a lease left empty by a process that died right after creating
+ *     it is broken once it has expired;
+ *  -- the merged output file lists all points in order.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+using namespace scuff;
+
+#define NUMPOINTS    6
+#define NUMWORKERS   2
+#define LEASETIMEOUT 2.0
+
+// points that take longer than LEASETIMEOUT
+#define SLOWPOINT(n) ((n)==1 || (n)==4)
+
+// the first worker to claim this point dies while processing it
+#define CRASHPOINT   3
+
+// this point starts out with an expired empty lease
+#define EMPTYPOINT   5
+
+static FrequencyScheduler *FS=0;
+static char *WorkDir=0;
+static pid_t CoordinatorPID=0;
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void Task(void *UserData, int nGroup, int nPoint)
+{
+  (void) UserData;
+  (void) nGroup;
+
+  if (nPoint==CRASHPOINT && getpid()!=CoordinatorPID)
+   { char *CrashFile=vstrdup("%s/crashed",WorkDir);
+     int fd=open(CrashFile, O_WRONLY | O_CREAT | O_EXCL, 0644);
+     free(CrashFile);
+     if (fd>=0)
+      { close(fd);
+        kill(getpid(), SIGKILL);
+      };
+   };
+
+  if ( SLOWPOINT(nPoint) )
+   sleep( (unsigned)(1.5*LEASETIMEOUT) + 1 );
+
+  // record each completed evaluation of each point
+  char *CallsFile=vstrdup("%s/calls",WorkDir);
+  int fd=open(CallsFile, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  free(CallsFile);
+  char Line[32];
+  int Len=snprintf(Line, 32, "%i\n", nPoint);
+  if (fd<0 || write(fd, Line, Len)!=Len)
+   ErrExit("could not record point %i",nPoint);
+  close(fd);
+
+  fprintf(FS->OpenOutput(nPoint, "unit-test-FrequencyScheduler.out"),"%i\n",nPoint);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void RunProcess(bool Coordinator)
+{
+  FS=new FrequencyScheduler(NUMPOINTS, 1);
+  FS->SetWorkDir(WorkDir, Coordinator, LEASETIMEOUT);
+  FS->Run(Task, 0);
+  delete FS;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main()
+{
+  SetLogFileName("scuff-unit-tests.log");
+  Log("SCUFF-EM FrequencyScheduler unit tests running on %s",GetHostName());
+
+  char Template[]="/tmp/unit-test-FrequencyScheduler-XXXXXX";
+  WorkDir=mkdtemp(Template);
+  if (!WorkDir)
+   ErrExit("could not create work directory");
+  unlink("unit-test-FrequencyScheduler.out");
+
+  // plant an empty lease that expired an hour ago
+  char *LeaseFile=vstrdup("%s/%i.lease",WorkDir,EMPTYPOINT);
+  int fd=open(LeaseFile, O_WRONLY | O_CREAT, 0644);
+  if (fd>=0) close(fd);
+  struct utimbuf Times;
+  Times.actime = Times.modtime = time(0) - 3600;
+  utime(LeaseFile, &Times);
+  free(LeaseFile);
+
+  CoordinatorPID=getpid();
+  pid_t Workers[NUMWORKERS];
+  for(int nw=0; nw<NUMWORKERS; nw++)
+   { Workers[nw]=fork();
+     if (Workers[nw]==0)
+      { RunProcess(false);
+        _exit(0);
+      };
+   };
+  RunProcess(true);
+  for(int nw=0; nw<NUMWORKERS; nw++)
+   waitpid(Workers[nw], 0, 0);
+
+  /*--------------------------------------------------------------*/
+  /*- each point must have been completed exactly once           -*/
+  /*--------------------------------------------------------------*/
+  int ErrorsDetected=0;
+  int NumCalls[NUMPOINTS];
+  memset(NumCalls, 0, NUMPOINTS*sizeof(int));
+  FILE *f=vfopen("%s/calls","r",WorkDir);
+  int nPoint;
+  while( f && fscanf(f,"%i",&nPoint)==1 )
+   if (0<=nPoint && nPoint<NUMPOINTS)
+    NumCalls[nPoint]++;
+  if (f) fclose(f);
+  for(nPoint=0; nPoint<NUMPOINTS; nPoint++)
+   if (NumCalls[nPoint]!=1)
+    { printf("point %i completed %i times (FAILED)\n",nPoint,NumCalls[nPoint]);
+      ErrorsDetected++;
+    };
+
+  /*--------------------------------------------------------------*/
+  /*- the merged output must list the points in order            -*/
+  /*--------------------------------------------------------------*/
+  f=fopen("unit-test-FrequencyScheduler.out","r");
+  int NumLines=0, Value;
+  while( f && fscanf(f,"%i",&Value)==1 )
+   { if (Value!=NumLines)
+      { printf("line %i of output is %i (FAILED)\n",NumLines,Value);
+        ErrorsDetected++;
+      };
+     NumLines++;
+   };
+  if (f) fclose(f);
+  if (NumLines!=NUMPOINTS)
+   { printf("output has %i lines, not %i (FAILED)\n",NumLines,NUMPOINTS);
+     ErrorsDetected++;
+   };
+
+  char *Command=vstrdup("rm -rf %s",WorkDir);
+  if ( system(Command)!=0 )
+   Warn("could not remove work directory %s",WorkDir);
+  free(Command);
+
+  if (ErrorsDetected==0)
+   { printf("All tests successfully passed.\n");
+     exit(0);
+   };
+  printf("%i tests FAILED.\n",ErrorsDetected);
+  exit(1);
+}
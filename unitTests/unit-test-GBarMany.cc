@@ -0,0 +1,137 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-GBarMany.cc -- SCUFF-EM unit test comparing the batched
+ *                       -- GetGBarMany() with GetGBar() for 1D and
+ *                       -- 2D lattices
+ *
+ * the points include some several unit cells away from the origin
+ * (so that the translation back into the Wigner-Seitz cell matters),
+ * and some with Rho outside the range of the interpolation table
+ * (which go through full Ewald summation).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "GBarAccelerator.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+// GetGBarMany() does the same arithmetic as GetGBar() in a different
+// order, so the results should agree to near machine precision
+#define MANYTOL 1.0e-10
+
+#define RHOMIN 0.1
+#define RHOMAX 0.6
+#define NUMR   100
+
+/***************************************************************/
+/* returns the number of failed points                         */
+/***************************************************************/
+int TestCase(int LDim, cdouble k, bool ExcludeInnerCells)
+{
+  HMatrix *LBasis = new HMatrix(3, LDim, LHM_REAL);
+  LBasis->Zero();
+  LBasis->SetEntry(0, 0, 1.0);
+  if (LDim==2) LBasis->SetEntry(1, 1, 1.1);
+  double kBloch[2] = { 0.4, LDim==1 ? 0.0 : -0.2 };
+
+  GBarAccelerator *GBA
+   = CreateGBarAccelerator(LBasis, RHOMIN, RHOMAX, k, kBloch,
+                           1.0e-3, ExcludeInnerCells);
+
+  // random points with x and y spanning a few unit cells and the
+  // transverse coordinate spanning a range somewhat larger than
+  // [RHOMIN, RHOMAX]
+  srand48(LDim);
+  double R[3*NUMR];
+  for(int nr=0; nr<NUMR; nr++)
+   { double Rho = RHOMIN + (RHOMAX-RHOMIN)*(1.4*drand48() - 0.2);
+     R[3*nr+0] = 5.0*(drand48() - 0.5);
+     if (LDim==1)
+      { double Theta = 2.0*M_PI*drand48();
+        R[3*nr+1] = Rho*cos(Theta);
+        R[3*nr+2] = Rho*sin(Theta);
+      }
+     else
+      { R[3*nr+1] = 5.0*(drand48() - 0.5);
+        R[3*nr+2] = (nr%2) ? Rho : -Rho;
+      };
+   };
+
+  cdouble GMany[NUMR], dGMany[3*NUMR];
+  GetGBarMany(R, NUMR, GBA, GMany, dGMany);
+
+  int Failed=0;
+  for(int nr=0; nr<NUMR; nr++)
+   { cdouble dGRef[3];
+     cdouble GRef = GetGBar(R + 3*nr, GBA, dGRef);
+
+     double Scale  = abs(GRef);
+     double MaxErr = abs(GMany[nr] - GRef);
+     for(int Mu=0; Mu<3; Mu++)
+      { Scale  = fmax(Scale,  abs(dGRef[Mu]));
+        MaxErr = fmax(MaxErr, abs(dGMany[3*nr+Mu] - dGRef[Mu]));
+      };
+     if ( MaxErr > MANYTOL*Scale )
+      { Log("LDim=%i, k=%s, X=(%g,%g,%g): rel err %.2e",
+             LDim,CD2S(k),R[3*nr+0],R[3*nr+1],R[3*nr+2],MaxErr/Scale);
+        Failed++;
+      };
+   };
+
+  printf("LDim=%i, k=%-22s %-20s: %s\n",LDim,CD2S(k),
+          ExcludeInnerCells ? "(inner cells out)" : "(all cells)",
+          Failed ? "FAILED" : "PASSED");
+
+  DestroyGBarAccelerator(GBA);
+  delete LBasis;
+  return Failed;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main()
+{
+  SetLogFileName("scuff-unit-tests.log");
+  Log("SCUFF-EM GBarMany unit tests running on %s",GetHostName());
+
+  cdouble kValues[2]={0.7, cdouble(2.0,0.3)};
+
+  int FailedPoints=0;
+  for(int LDim=1; LDim<=2; LDim++)
+   for(int nk=0; nk<2; nk++)
+    for(int Exclude=0; Exclude<2; Exclude++)
+     FailedPoints += TestCase(LDim, kValues[nk], Exclude==1);
+
+  if (FailedPoints==0)
+   { printf("All tests successfully passed.\n");
+     exit(0);
+   };
+  printf("%i points FAILED.\n",FailedPoints);
+  exit(1);
+}
@@ -0,0 +1,125 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-GBarVDEwaldMany.cc -- SCUFF-EM unit test comparing the
+ *                              -- batched GBarVDEwaldMany() with
+ *                              -- GBarVDEwald() for a 2D lattice
+ *
+ * the points include several at z=0, at small |z|, and at |z| large
+ * compared to the lattice constants, where the reciprocal-space sum
+ * converges in a few terms.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "GBarAccelerator.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+// tolerance on the batched result, relative to the largest of the
+// eight quantities at each point
+#define MANYTOL 1.0e-6
+
+#define NUMZ  6
+#define NUMXY 5
+
+/***************************************************************/
+/* returns the number of failed points                         */
+/***************************************************************/
+int TestCase(cdouble k, bool ExcludeInnerCells)
+{
+  double LBV[2][3] = { {1.0, 0.0, 0.0}, {0.3, 1.2, 0.0} };
+  double kBloch[3] = { 0.4, -0.2, 0.0 };
+
+  double ZValues[NUMZ]   = { 0.0, 0.05, -0.3, 1.0, 4.0, -6.0 };
+  double XYValues[NUMXY][2] = { {0.0, 0.0}, {0.1, 0.2}, {-0.45, 0.3},
+                                {0.5, -0.6}, {0.25, 0.55} };
+
+  int NR = NUMZ*NUMXY;
+  double *R = new double[3*NR];
+  for(int nz=0, nr=0; nz<NUMZ; nz++)
+   for(int nxy=0; nxy<NUMXY; nxy++, nr++)
+    { R[3*nr+0] = XYValues[nxy][0];
+      R[3*nr+1] = XYValues[nxy][1];
+      R[3*nr+2] = ZValues[nz];
+    };
+
+  // (0,0,0) is a lattice point, whose own term cannot be evaluated
+  // unless the inner cells are excluded
+  int nr0 = ExcludeInnerCells ? 0 : 1;
+
+  cdouble *GMany = new cdouble[8*NR];
+  GBarVDEwaldMany(R + 3*nr0, NR-nr0, k, kBloch, LBV, 2, -1.0,
+                  ExcludeInnerCells, GMany + 8*nr0);
+
+  int Failed=0;
+  for(int nr=nr0; nr<NR; nr++)
+   { cdouble GRef[8];
+     GBarVDEwald(R + 3*nr, k, kBloch, LBV, 2, -1.0, ExcludeInnerCells, GRef);
+
+     double Scale=0.0, MaxErr=0.0;
+     for(int n=0; n<8; n++)
+      { Scale  = fmax(Scale,  abs(GRef[n]));
+        MaxErr = fmax(MaxErr, abs(GMany[8*nr+n] - GRef[n]));
+      };
+     if ( MaxErr > MANYTOL*Scale )
+      { Log("k=%s, X=(%g,%g,%g): rel err %.2e",
+             CD2S(k),R[3*nr+0],R[3*nr+1],R[3*nr+2],MaxErr/Scale);
+        Failed++;
+      };
+   };
+
+  printf("k=%-22s %-20s: %s\n",CD2S(k),
+          ExcludeInnerCells ? "(inner cells out)" : "(all cells)",
+          Failed ? "FAILED" : "PASSED");
+
+  delete[] R;
+  delete[] GMany;
+  return Failed;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main()
+{
+  SetLogFileName("scuff-unit-tests.log");
+  Log("SCUFF-EM GBarVDEwaldMany unit tests running on %s",GetHostName());
+
+  cdouble kValues[3]={0.7, cdouble(2.0,0.3), 1.5*II};
+
+  int FailedPoints=0;
+  for(int nk=0; nk<3; nk++)
+   for(int Exclude=0; Exclude<2; Exclude++)
+    FailedPoints += TestCase(kValues[nk], Exclude==1);
+
+  if (FailedPoints==0)
+   { printf("All tests successfully passed.\n");
+     exit(0);
+   };
+  printf("%i points FAILED.\n",FailedPoints);
+  exit(1);
+}
@@ -0,0 +1,126 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-Multipole.cc -- SCUFF-EM unit test comparing BEM matrix
+ *                        -- blocks assembled with multipole treatment
+ *                        -- of well-separated edges, and the
+ *                        -- matrix-free MultipoleBEMOperator, with
+ *                        -- exact assembly
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+#include "UnitTestUtils.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+// the multipole truncation order is chosen to meet the requested
+// tolerance, so the error must fall below each tolerance and must
+// shrink when the tolerance is tightened
+#define NUMTOLS 2
+double MultipoleTols[NUMTOLS] = { 1.0e-2, 1.0e-4 };
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main()
+{
+  HMatrix *M, *MRef;
+  RWGGeometry *G=InitBlockTest("multipole","SiSpheres_255.scuffgeo",&M,&MRef);
+  int N = MRef->NR;
+
+  HVector *X     = new HVector(N, LHM_COMPLEX);
+  HVector *MX    = new HVector(N, LHM_COMPLEX);
+  HVector *MXRef = new HVector(N, LHM_COMPLEX);
+  srand48(0);
+  for(int n=0; n<N; n++)
+   X->SetEntry(n, cdouble(drand48()-0.5, drand48()-0.5));
+
+  #define NUMFREQS 2
+  cdouble Omega[NUMFREQS] = { 1.0, 0.5*II };
+
+  bool Success=true;
+  for(int nf=0; nf<NUMFREQS; nf++)
+   {
+     RWGGeometry::MultipoleTol=0.0;
+     G->AssembleBEMMatrix(Omega[nf], MRef);
+
+     /*--------------------------------------------------------------*/
+     /*- blocks assembled with multipoles; the two spheres are far  -*/
+     /*- enough apart for the off-diagonal blocks to use them, and  -*/
+     /*- the diagonal blocks must come out exact                    -*/
+     /*--------------------------------------------------------------*/
+     double LastError=HUGE_VAL;
+     for(int nt=0; nt<NUMTOLS; nt++)
+      { double Tol=MultipoleTols[nt];
+        RWGGeometry::MultipoleTol=Tol;
+        G->AssembleBEMMatrix(Omega[nf], M);
+        RWGGeometry::MultipoleTol=0.0;
+
+        double Error=0.0;
+        bool DiagonalExact=true;
+        for(int nsa=0; nsa<G->NumSurfaces; nsa++)
+         for(int nsb=0; nsb<G->NumSurfaces; nsb++)
+          { double BE=BlockError(G, nsa, nsb, M, MRef);
+            if (nsa==nsb)
+             DiagonalExact = DiagonalExact && BE==0.0;
+            else
+             Error=fmax(Error, BE);
+          };
+        bool ThisSuccess =    DiagonalExact && Error>0.0
+                           && Error<Tol && Error<LastError;
+        printf("Omega=%s, MultipoleTol=%.0e: %s (off-diagonal rel err %.1e)\n",
+                z2s(Omega[nf]), Tol, ThisSuccess ? "PASSED" : "FAILED", Error);
+        if (!ThisSuccess) Success=false;
+        LastError=Error;
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- matrix-free operator -----------------------------------------*/
+     /*--------------------------------------------------------------*/
+     double Tol=MultipoleTols[NUMTOLS-1];
+     MultipoleBEMOperator *MBO = new MultipoleBEMOperator(G, Omega[nf], Tol);
+     MBO->Apply(X, MX);
+     delete MBO;
+     MRef->Apply(X, MXRef);
+     double Diff2=0.0, Norm2=0.0;
+     for(int n=0; n<N; n++)
+      { Diff2 += norm(MX->GetEntry(n) - MXRef->GetEntry(n));
+        Norm2 += norm(MXRef->GetEntry(n));
+      };
+     double Error=sqrt(Diff2/Norm2);
+     bool ThisSuccess = Error < Tol;
+     printf("Omega=%s, MultipoleBEMOperator: %s (rel err %.1e)\n",
+             z2s(Omega[nf]), ThisSuccess ? "PASSED" : "FAILED", Error);
+     if (!ThisSuccess) Success=false;
+   };
+
+  delete X;
+  delete MX;
+  delete MXRef;
+  FinishBlockTest(G, M, MRef, Success);
+}
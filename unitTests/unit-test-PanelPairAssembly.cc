@@ -0,0 +1,141 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-PanelPairAssembly.cc -- SCUFF-EM unit test checking that
+ *                                -- panel-pair-centric assembly of
+ *                                -- the BEM matrix reproduces the
+ *                                -- usual edge-pair assembly
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+double GetAvgRelError(HMatrix *M, HMatrix *MRef)
+{ 
+  double TotalRelError=0.0, MaxRef=0.0;
+  for(int nr=0; nr<M->NR; nr++)
+   for(int nc=0; nc<M->NC; nc++)
+    MaxRef = fmax(MaxRef, abs(MRef->GetEntry(nr,nc)));
+  if (MaxRef==0.0) MaxRef=1.0;
+
+  for(int nr=0; nr<M->NR; nr++)
+   for(int nc=0; nc<M->NC; nc++)
+    { cdouble m    = M->GetEntry(nr,nc);
+      cdouble mRef = MRef->GetEntry(nr,nc);
+      double Scale = fmax(abs(mRef), 1.0e-6*MaxRef);
+      TotalRelError += abs(m-mRef) / Scale;
+    };
+  return TotalRelError / ((double)(M->NR * M->NC));
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main()
+{ 
+  SetLogFileName("scuff-test-PanelPairAssembly.log");
+  Log("SCUFF-EM panel-pair assembly unit test running on %s",GetHostName());
+
+  double Tolerance=1.0e-8;
+
+  #define NUMTESTS 5
+  const char *GeoFileNames[NUMTESTS]=
+   { "PECSphere_255.scuffgeo", "SiSphere_255.scuffgeo", "SiSphere_255.scuffgeo",
+     "SiSpheres_255.scuffgeo", "SiSlab_40.scuffgeo" };
+  cdouble Omega[NUMTESTS] = { 1.0, 1.0, 0.1*II, 0.1, 1.1 };
+  double kBloch[2] = {0.7, 0.9};
+
+  /***************************************************************/
+  /* full BEM matrices *******************************************/
+  /***************************************************************/
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   { 
+     RWGGeometry *G = new RWGGeometry(GeoFileNames[nt]);
+     HMatrix *MRef  = G->AllocateBEMMatrix();
+     HMatrix *M     = G->AllocateBEMMatrix();
+
+     RWGGeometry::UsePanelPairAssembly=false;
+     G->AssembleBEMMatrix(Omega[nt], G->LDim ? kBloch : 0, MRef);
+     RWGGeometry::UsePanelPairAssembly=true;
+     G->AssembleBEMMatrix(Omega[nt], G->LDim ? kBloch : 0, M);
+
+     double AvgRelError = GetAvgRelError(M, MRef);
+     bool ThisSuccess = (AvgRelError < Tolerance);
+     printf("%s, Omega=%s: %s (AvgRelErr = %.1e)\n",
+             GeoFileNames[nt], z2s(Omega[nt]),
+             ThisSuccess ? "PASSED" : "FAILED", AvgRelError);
+     if (!ThisSuccess) Success=false;
+
+     delete M;
+     delete MRef;
+     delete G;
+   };
+
+  /***************************************************************/
+  /* derivatives of an off-diagonal block ************************/
+  /***************************************************************/
+  RWGGeometry *G = new RWGGeometry("SiSpheres_255.scuffgeo");
+  int NBF0=G->Surfaces[0]->NumBFs, NBF1=G->Surfaces[1]->NumBFs;
+  HMatrix *M[2], *GradM[2][3];
+  for(int n=0; n<2; n++)
+   { M[n]=new HMatrix(NBF0, NBF1, LHM_COMPLEX);
+     for(int Mu=0; Mu<3; Mu++)
+      GradM[n][Mu]=new HMatrix(NBF0, NBF1, LHM_COMPLEX);
+     RWGGeometry::UsePanelPairAssembly=(n==1);
+     G->AssembleBEMMatrixBlock(0, 1, 0.1, 0, M[n], GradM[n]);
+   };
+  RWGGeometry::UsePanelPairAssembly=false;
+
+  for(int Mu=-1; Mu<3; Mu++)
+   { double AvgRelError = (Mu==-1) ? GetAvgRelError(M[1], M[0])
+                                   : GetAvgRelError(GradM[1][Mu], GradM[0][Mu]);
+     bool ThisSuccess = (AvgRelError < Tolerance);
+     printf("Off-diagonal block %s: %s (AvgRelErr = %.1e)\n",
+             Mu==-1 ? "M" : Mu==0 ? "dM/dx" : Mu==1 ? "dM/dy" : "dM/dz",
+             ThisSuccess ? "PASSED" : "FAILED", AvgRelError);
+     if (!ThisSuccess) Success=false;
+   };
+
+  for(int n=0; n<2; n++)
+   { delete M[n];
+     for(int Mu=0; Mu<3; Mu++)
+      delete GradM[n][Mu];
+   };
+  delete G;
+
+  if (Success) 
+   exit(0);
+  else
+   exit(1);
+
+}
@@ -0,0 +1,162 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-TaylorDuffyBatch.cc -- SCUFF-EM unit test comparing
+ *                               -- TaylorDuffyBatch() with TaylorDuffy()
+ *                               -- for common-vertex, common-edge and
+ *                               -- common-triangle panel pairs
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "TaylorDuffy.h"
+
+using namespace scuff;
+
+#define II cdouble (0.0,1.0)
+
+// max evaluations for the adaptive reference integration
+#define REFMAXEVAL 100000
+
+// tolerance on the batch result relative to the reference
+#define BATCHTOL 1.0e-3
+
+const char *CaseNames[4]={0, "common-vertex", "common-edge", "common-triangle"};
+
+/***************************************************************/
+/* fill in the nine (iQa,iQb) TD argument structures for a     */
+/* panel pair, as done in GetPanelPanelInteractionsAllQ()      */
+/***************************************************************/
+void InitArgs(TaylorDuffyArgStruct *Args, int ncv, double **Va, double **Vb,
+              int *PIndex, int *KIndex, cdouble *KParam,
+              cdouble Result[9][3], cdouble Error[9][3])
+{
+  for(int nq=0; nq<9; nq++)
+   { TaylorDuffyArgStruct *A = Args + nq;
+     InitTaylorDuffyArgs(A);
+     A->WhichCase = ncv;
+     A->NumPKs    = (ncv==3) ? 2 : 3;
+     A->PIndex    = PIndex;
+     A->KIndex    = KIndex;
+     A->KParam    = KParam;
+     A->V1        = Va[0];
+     A->V2        = Va[1];
+     A->V3        = Va[2];
+     A->V2P       = Vb[1];
+     A->V3P       = Vb[2];
+     A->Q         = Va[nq/3];
+     A->QP        = Vb[nq%3];
+     A->Result    = Result[nq];
+     A->Error     = Error[nq];
+   };
+}
+
+/***************************************************************/
+/* returns 0 on success, 1 on failure.                         */
+/***************************************************************/
+int TestCase(int ncv, cdouble k)
+{
+  // vertices of the two panels; panel b shares its first ncv
+  // vertices with panel a
+  static double V[5][3]=
+   { { 0.00,  0.00, 0.00},
+     { 0.30,  0.00, 0.02},
+     { 0.12,  0.27, 0.01},
+     {-0.05, -0.25, 0.04},
+     { 0.38,  0.22, 0.07}
+   };
+  double *Va[3] = { V[0], V[1], V[2] };
+  double *Vb[3] = { V[0], V[1], V[2] };
+  if (ncv<3) Vb[2] = (ncv==2) ? V[3] : V[4];
+  if (ncv<2) Vb[1] = V[3];
+
+  int PIndex[3]={TD_UNITY, TD_PMCHWG1, TD_PMCHWC};
+  int KIndex[3]={TD_HELMHOLTZ, TD_HELMHOLTZ, TD_GRADHELMHOLTZ};
+  cdouble KParam[3]={k,k,k};
+  int NumPKs = (ncv==3) ? 2 : 3;
+
+  cdouble BResult[9][3], BError[9][3];
+  cdouble AResult[9][3], AError[9][3];
+  cdouble RResult[9][3], RError[9][3];
+  TaylorDuffyArgStruct BArgs[9], AArgs[9], RArgs[9];
+  InitArgs(BArgs, ncv, Va, Vb, PIndex, KIndex, KParam, BResult, BError);
+  InitArgs(AArgs, ncv, Va, Vb, PIndex, KIndex, KParam, AResult, AError);
+  InitArgs(RArgs, ncv, Va, Vb, PIndex, KIndex, KParam, RResult, RError);
+
+  TaylorDuffyBatch(BArgs, 9);
+  for(int nq=0; nq<9; nq++)
+   { TaylorDuffy(AArgs + nq);
+     RArgs[nq].MaxEval = REFMAXEVAL;
+     TaylorDuffy(RArgs + nq);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- errors are measured relative to the largest reference value */
+  /*- of each {P,K} pair over the nine (iQa,iQb) combinations     */
+  /*--------------------------------------------------------------*/
+  int ErrorsDetected=0;
+  for(int npk=0; npk<NumPKs; npk++)
+   { double Scale=0.0;
+     for(int nq=0; nq<9; nq++)
+      Scale = fmax(Scale, abs(RResult[nq][npk]));
+     if (Scale==0.0) continue;
+
+     for(int nq=0; nq<9; nq++)
+      { double BErr = abs(BResult[nq][npk] - RResult[nq][npk]) / Scale;
+        double AErr = abs(AResult[nq][npk] - RResult[nq][npk]) / Scale;
+        if ( BErr > BATCHTOL || BErr > AErr + 1.0e-10 )
+         { Log("%s, k=%s, nq=%i, npk=%i: batch %.2e, adaptive %.2e",
+                CaseNames[ncv],CD2S(k),nq,npk,BErr,AErr);
+           ErrorsDetected++;
+         };
+      };
+   };
+
+  printf("%-16s k=%-22s: %s\n",CaseNames[ncv],CD2S(k),
+          ErrorsDetected ? "FAILED" : "PASSED");
+  return (ErrorsDetected==0) ? 0 : 1;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main()
+{
+  SetLogFileName("scuff-unit-tests.log");
+  Log("SCUFF-EM TaylorDuffyBatch unit tests running on %s",GetHostName());
+
+  cdouble kValues[3]={0.1, cdouble(2.0,0.5), 20.0*II};
+
+  int FailedCases=0;
+  for(int ncv=1; ncv<=3; ncv++)
+   for(int nk=0; nk<3; nk++)
+    FailedCases += TestCase(ncv, kValues[nk]);
+
+  if (FailedCases==0)
+   { printf("All tests successfully passed.\n");
+     exit(0);
+   };
+  printf("%i test cases FAILED.\n",FailedCases);
+  exit(1);
+}